@@ -109,6 +109,11 @@ enum ModestDbusGetUnreadMessagesArguments
 #define MODEST_DBUS_METHOD_DUMP_OPERATION_QUEUE   "DumpOperationQueue"
 #define MODEST_DBUS_METHOD_DUMP_ACCOUNTS          "DumpAccounts"
 #define MODEST_DBUS_METHOD_DUMP_SEND_QUEUES       "DumpSendQueues"
+#define MODEST_DBUS_METHOD_DUMP_FOLDER_STATS      "DumpFolderStats"
+#define MODEST_DBUS_METHOD_DUMP_CACHES            "DumpCaches"
+#define MODEST_DBUS_METHOD_DUMP_TRACE             "DumpTrace"
+#define MODEST_DBUS_METHOD_DUMP_STARTUP           "DumpStartup"
+#define MODEST_DBUS_METHOD_DUMP_OPERATION_STATS   "DumpOperationStats"
 
 
 
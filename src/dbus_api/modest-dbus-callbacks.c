@@ -42,6 +42,7 @@
 #include "modest-tny-msg.h"
 #include "modest-platform.h"
 #include "modest-defs.h"
+#include "modest-init.h"
 #include <libmodest-dbus-client/libmodest-dbus-client.h>
 #include <libgnomevfs/gnome-vfs-utils.h>
 #include <stdio.h>
@@ -66,6 +67,9 @@
 #include <tny-account.h>
 
 #include <modest-text-utils.h>
+#include <modest-trace.h>
+#include <modest-mail-operation-stats.h>
+#include <modest-startup.h>
 
 #define DISABLE_GET_UNREAD_MSGS_FOR_MULTI_MAILBOX 1
 
@@ -699,6 +703,8 @@ on_open_message (GArray * arguments, gpointer data, osso_rpc_t * retval)
  	val = g_array_index(arguments, osso_rpc_t, MODEST_DBUS_OPEN_MESSAGE_ARG_URI);
  	uri = g_strdup (val.value.s);
 
+	modest_trace_mark ("dbus:open-message", uri);
+
 	is_merge = g_str_has_prefix (uri, "merge:");
 
 	/* Get the account */
@@ -1113,6 +1119,210 @@ on_dbus_method_dump_operation_queue (DBusConnection *con, DBusMessage *message)
 	return OSSO_OK;
 }
 
+static gint 
+on_dbus_method_dump_operation_stats (DBusConnection *con, DBusMessage *message)
+{
+	gchar *str;
+	gchar *stats_str;
+	
+	DBusMessage *reply;
+	dbus_uint32_t serial = 0;
+
+	/* Write the pending records too, so the file is up to date */
+	modest_mail_operation_stats_flush ();
+
+	stats_str = modest_mail_operation_stats_to_string ();
+	str = g_strdup_printf ("\noperation stats\n"
+			       "===============\n"
+			       "%s\n",
+			       stats_str);
+	g_free (stats_str);
+	
+	g_printerr (str);
+	
+	reply = dbus_message_new_method_return (message);
+	if (reply) {
+		dbus_message_append_args (reply,
+					  DBUS_TYPE_STRING, &str,
+					  DBUS_TYPE_INVALID);
+		dbus_connection_send (con, reply, &serial);
+		dbus_connection_flush (con);
+		dbus_message_unref (reply);
+	}	
+	g_free (str);
+
+	/* Let modest die */
+	g_idle_add (notify_error_in_dbus_callback, NULL);
+
+	return OSSO_OK;
+}
+
+
+static gint 
+on_dbus_method_dump_folder_stats (DBusConnection *con, DBusMessage *message)
+{
+	gchar *str;
+	gchar *stats_str;
+	ModestFolderStatsMgr *stats_mgr;
+
+	DBusMessage *reply;
+	dbus_uint32_t serial = 0;
+
+	stats_mgr = modest_runtime_get_folder_stats_mgr ();
+	stats_str = (stats_mgr) ? modest_folder_stats_mgr_to_string (stats_mgr) : NULL;
+
+	str = g_strdup_printf ("\nfolder stats\n"
+			       "============\n"
+			       "%s\n",
+			       stats_str ? stats_str : "<not available>");
+	g_free (stats_str);
+
+	g_printerr (str);
+
+	reply = dbus_message_new_method_return (message);
+	if (reply) {
+		dbus_message_append_args (reply,
+					  DBUS_TYPE_STRING, &str,
+					  DBUS_TYPE_INVALID);
+		dbus_connection_send (con, reply, &serial);
+		dbus_connection_flush (con);
+		dbus_message_unref (reply);
+	}
+	g_free (str);
+
+	/* Let modest die */
+	g_idle_add (notify_error_in_dbus_callback, NULL);
+
+	return OSSO_OK;
+}
+
+static gint 
+on_dbus_method_dump_caches (DBusConnection *con, DBusMessage *message)
+{
+	gchar *str;
+	gchar *caches_str, *windows_str;
+
+	DBusMessage *reply;
+	dbus_uint32_t serial = 0;
+
+	caches_str = modest_cache_mgr_to_string (modest_runtime_get_cache_mgr ());
+
+	/* There are no pre-built windows without UI */
+	if (modest_init_ui_is_initialized ())
+		windows_str = modest_window_mgr_caches_to_string (modest_runtime_get_window_mgr ());
+	else
+		windows_str = g_strdup ("<no UI>");
+
+	str = g_strdup_printf ("\ncaches\n"
+			       "======\n"
+			       "%s\n"
+			       "windows\n"
+			       "%s\n",
+			       caches_str, windows_str);
+	g_free (caches_str);
+	g_free (windows_str);
+
+	g_printerr (str);
+
+	reply = dbus_message_new_method_return (message);
+	if (reply) {
+		dbus_message_append_args (reply,
+					  DBUS_TYPE_STRING, &str,
+					  DBUS_TYPE_INVALID);
+		dbus_connection_send (con, reply, &serial);
+		dbus_connection_flush (con);
+		dbus_message_unref (reply);
+	}
+	g_free (str);
+
+	/* Let modest die */
+	g_idle_add (notify_error_in_dbus_callback, NULL);
+
+	return OSSO_OK;
+}
+
+static gint 
+on_dbus_method_dump_startup (DBusConnection *con, DBusMessage *message)
+{
+	gchar *str;
+	gchar *startup_str;
+
+	DBusMessage *reply;
+	dbus_uint32_t serial = 0;
+
+	startup_str = modest_startup_to_string ();
+
+	str = g_strdup_printf ("\nstartup\n"
+			       "=======\n"
+			       "%s\n",
+			       startup_str);
+	g_free (startup_str);
+
+	g_printerr (str);
+
+	reply = dbus_message_new_method_return (message);
+	if (reply) {
+		dbus_message_append_args (reply,
+					  DBUS_TYPE_STRING, &str,
+					  DBUS_TYPE_INVALID);
+		dbus_connection_send (con, reply, &serial);
+		dbus_connection_flush (con);
+		dbus_message_unref (reply);
+	}
+	g_free (str);
+
+	/* Let modest die */
+	g_idle_add (notify_error_in_dbus_callback, NULL);
+
+	return OSSO_OK;
+}
+
+static gint 
+on_dbus_method_dump_trace (DBusConnection *con, DBusMessage *message)
+{
+	gchar *str;
+	gchar *trace_str;
+	gchar *filename;
+	GError *error = NULL;
+
+	DBusMessage *reply;
+	dbus_uint32_t serial = 0;
+
+	/* Keep a copy in a file, the traces could be large */
+	filename = g_build_filename (g_get_home_dir (), MODEST_DIR, MODEST_TRACE_FILE, NULL);
+	if (!modest_trace_dump_to_file (filename, &error)) {
+		g_warning ("%s: could not write %s: %s", __FUNCTION__, filename,
+			   error ? error->message : "");
+		g_clear_error (&error);
+	}
+
+	trace_str = modest_trace_to_string ();
+	str = g_strdup_printf ("\ntrace (%s)\n"
+			       "=====\n"
+			       "%s\n",
+			       filename, trace_str);
+	g_free (trace_str);
+	g_free (filename);
+
+	g_printerr ("%s", str);
+
+	reply = dbus_message_new_method_return (message);
+	if (reply) {
+		dbus_message_append_args (reply,
+					  DBUS_TYPE_STRING, &str,
+					  DBUS_TYPE_INVALID);
+		dbus_connection_send (con, reply, &serial);
+		dbus_connection_flush (con);
+		dbus_message_unref (reply);
+	}
+	g_free (str);
+
+	/* Let modest die */
+	g_idle_add (notify_error_in_dbus_callback, NULL);
+
+	return OSSO_OK;
+}
+
 
 
 static gint 
@@ -1582,6 +1792,32 @@ modest_dbus_check_present_modal ()
 	return (NULL != dialog);
 }
 
+/* Methods that show windows or dialogs. When modest runs as a
+   D-Bus service the UI is initialized the first time one of them
+   is called */
+static gboolean
+method_needs_ui (const gchar *method)
+{
+	static const gchar *ui_methods[] = {
+		MODEST_DBUS_METHOD_MAIL_TO,
+		MODEST_DBUS_METHOD_OPEN_MESSAGE,
+		MODEST_DBUS_METHOD_OPEN_ACCOUNT,
+		MODEST_DBUS_METHOD_COMPOSE_MAIL,
+		MODEST_DBUS_METHOD_DELETE_MESSAGE,
+		MODEST_DBUS_METHOD_OPEN_DEFAULT_INBOX,
+		MODEST_DBUS_METHOD_TOP_APPLICATION,
+		MODEST_DBUS_METHOD_OPEN_EDIT_ACCOUNTS_DIALOG,
+		NULL
+	};
+	gint i;
+
+	for (i = 0; ui_methods[i]; i++)
+		if (g_ascii_strcasecmp (method, ui_methods[i]) == 0)
+			return TRUE;
+
+	return FALSE;
+}
+
 /* Callback for normal D-BUS messages */
 gint
 modest_dbus_req_handler(const gchar * interface, const gchar * method,
@@ -1590,10 +1826,17 @@ modest_dbus_req_handler(const gchar * interface, const gchar * method,
 {
 	/* Check memory low conditions */
 	if (modest_platform_check_memory_low (NULL, FALSE)) {
+		if (modest_init_ui_is_initialized ())
+			modest_window_mgr_release_caches (modest_runtime_get_window_mgr ());
 		g_idle_add (on_idle_show_memory_low, NULL);
 		goto param_error;
 	}
 
+	if (method_needs_ui (method) && !modest_init_ui ()) {
+		g_printerr ("modest: cannot initialize the UI to handle %s\n", method);
+		return OSSO_ERROR;
+	}
+
 	if (g_ascii_strcasecmp (method, MODEST_DBUS_METHOD_MAIL_TO) == 0) {
 		if (arguments->len != MODEST_DBUS_MAIL_TO_ARGS_COUNT)
 			goto param_error;
@@ -2890,6 +3133,11 @@ modest_dbus_req_filter (DBusConnection *con,
 						MODEST_DBUS_METHOD_DUMP_OPERATION_QUEUE)) {
 		on_dbus_method_dump_operation_queue (con, message);
 		handled = TRUE;
+	} else if (dbus_message_is_method_call (message,
+						MODEST_DBUS_IFACE,
+						MODEST_DBUS_METHOD_DUMP_OPERATION_STATS)) {
+		on_dbus_method_dump_operation_stats (con, message);
+		handled = TRUE;
 	} else if (dbus_message_is_method_call (message,
 						MODEST_DBUS_IFACE,
 						MODEST_DBUS_METHOD_DUMP_ACCOUNTS)) {
@@ -2900,6 +3148,26 @@ modest_dbus_req_filter (DBusConnection *con,
 						MODEST_DBUS_METHOD_DUMP_SEND_QUEUES)) {
 		on_dbus_method_dump_send_queues (con, message);
 		handled = TRUE;
+	} else if (dbus_message_is_method_call (message,
+						MODEST_DBUS_IFACE,
+						MODEST_DBUS_METHOD_DUMP_FOLDER_STATS)) {
+		on_dbus_method_dump_folder_stats (con, message);
+		handled = TRUE;
+	} else if (dbus_message_is_method_call (message,
+						MODEST_DBUS_IFACE,
+						MODEST_DBUS_METHOD_DUMP_CACHES)) {
+		on_dbus_method_dump_caches (con, message);
+		handled = TRUE;
+	} else if (dbus_message_is_method_call (message,
+						MODEST_DBUS_IFACE,
+						MODEST_DBUS_METHOD_DUMP_TRACE)) {
+		on_dbus_method_dump_trace (con, message);
+		handled = TRUE;
+	} else if (dbus_message_is_method_call (message,
+						MODEST_DBUS_IFACE,
+						MODEST_DBUS_METHOD_DUMP_STARTUP)) {
+		on_dbus_method_dump_startup (con, message);
+		handled = TRUE;
 	} else {
 		/* Note that this mentions methods that were already handled in modest_dbus_req_handler(). */
 		/* 
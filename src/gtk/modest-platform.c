@@ -34,6 +34,8 @@
 #include <modest-defs.h>
 #include <modest-scrollable.h>
 #include <modest-runtime.h>
+#include <modest-init.h>
+#include <modest-cache-mgr.h>
 #include <modest-header-view.h>
 #include "modest-widget-memory.h"
 #include <modest-utils.h>
@@ -159,6 +161,12 @@ modest_platform_init (int argc, char *argv[])
 	return TRUE;
 }
 
+gboolean
+modest_platform_init_ui (int argc, char *argv[])
+{
+	return TRUE;
+}
+
 gboolean
 modest_platform_uninit (void)
 {
@@ -280,14 +288,56 @@ modest_platform_show_uri_popup (const gchar *uri)
 }
 
 
+/* icons are loaded again and again while rendering the folder and
+ * header views, so we keep the most recently used ones around. The
+ * cache is flushed if the icon theme changes */
+static void
+on_icon_theme_changed (GtkIconTheme *theme, gpointer user_data)
+{
+	modest_cache_mgr_flush (modest_runtime_get_cache_mgr (),
+				MODEST_CACHE_MGR_CACHE_TYPE_PIXBUF);
+}
+
 GdkPixbuf*
 modest_platform_get_icon (const gchar *name, guint icon_size)
 {
-	return gtk_icon_theme_load_icon (gtk_icon_theme_get_default (),
-					 name,
-					 icon_size,
-					 0,
-					 NULL);
+	static gboolean theme_watched = FALSE;
+	ModestCacheMgr *cache_mgr;
+	GtkIconTheme *current_theme;
+	GdkPixbuf *pixbuf;
+	gchar *key;
+
+	g_return_val_if_fail (name, NULL);
+
+	current_theme = gtk_icon_theme_get_default ();
+	if (!theme_watched) {
+		g_signal_connect (current_theme, "changed",
+				  G_CALLBACK (on_icon_theme_changed), NULL);
+		theme_watched = TRUE;
+	}
+
+	cache_mgr = modest_runtime_get_cache_mgr ();
+	key = g_strdup_printf ("%s:%u", name, icon_size);
+	pixbuf = (GdkPixbuf *) modest_cache_mgr_lookup (cache_mgr,
+							MODEST_CACHE_MGR_CACHE_TYPE_PIXBUF,
+							key);
+	if (pixbuf) {
+		g_object_ref (pixbuf);
+	} else {
+		pixbuf = gtk_icon_theme_load_icon (current_theme,
+						   name,
+						   icon_size,
+						   0,
+						   NULL);
+		if (pixbuf)
+			modest_cache_mgr_insert (cache_mgr, MODEST_CACHE_MGR_CACHE_TYPE_PIXBUF,
+						 key, pixbuf,
+						 gdk_pixbuf_get_rowstride (pixbuf) *
+						 gdk_pixbuf_get_height (pixbuf));
+	}
+	g_free (key);
+
+	return pixbuf;
 }
 
 const gchar*
@@ -999,6 +1049,10 @@ modest_platform_run_confirmation_dialog (GtkWindow *parent_window,
 	GtkWidget *dialog;
 	gint response;
 
+	/* We could be running as a D-Bus service without UI */
+	if (!modest_init_ui ())
+		return GTK_RESPONSE_CANCEL;
+
 	dialog = gtk_message_dialog_new (parent_window, GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
 					 GTK_MESSAGE_QUESTION,
 					 GTK_BUTTONS_OK_CANCEL,
@@ -1022,6 +1076,10 @@ modest_platform_run_confirmation_dialog_with_buttons (GtkWindow *parent_window,
 	GtkWidget *dialog;
 	gint response;
 	
+	/* We could be running as a D-Bus service without UI */
+	if (!modest_init_ui ())
+		return GTK_RESPONSE_CANCEL;
+
 	dialog = gtk_message_dialog_new (parent_window, GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
 					 GTK_MESSAGE_QUESTION,
 					 GTK_BUTTONS_NONE,
@@ -1048,6 +1106,10 @@ modest_platform_run_information_dialog (GtkWindow *parent_window,
 {
 	GtkWidget *note;
 	
+	/* We could be running as a D-Bus service without UI */
+	if (!modest_init_ui ())
+		return;
+
 	note = gtk_message_dialog_new (parent_window, GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
 				       GTK_MESSAGE_INFO,
 				       GTK_BUTTONS_OK,
@@ -1307,6 +1369,10 @@ modest_platform_information_banner (GtkWidget *parent,
 {
 	GtkWidget *banner;
 
+	/* Nothing to show it over if the UI was not initialized */
+	if (!modest_init_ui_is_initialized ())
+		return;
+
 	banner = modest_shell_banner_new (parent);
 	modest_shell_banner_set_icon (MODEST_SHELL_BANNER (banner), icon_name);
 	modest_shell_banner_set_text (MODEST_SHELL_BANNER (banner), text);
@@ -1330,6 +1396,10 @@ modest_platform_information_banner_with_timeout (GtkWidget *parent,
 {
 	GtkWidget *banner;
 
+	/* Nothing to show it over if the UI was not initialized */
+	if (!modest_init_ui_is_initialized ())
+		return;
+
 	banner = modest_shell_banner_new_with_timeout (parent, timeout);
 	modest_shell_banner_set_icon (MODEST_SHELL_BANNER (banner), icon_name);
 	modest_shell_banner_set_text (MODEST_SHELL_BANNER (banner), text);
@@ -1351,6 +1421,15 @@ modest_platform_animation_banner (GtkWidget *parent,
 	return banner;
 }
 
+void
+modest_platform_animation_banner_set_text (GtkWidget *banner,
+					   const gchar *text)
+{
+	g_return_if_fail (banner && text);
+
+	modest_shell_banner_set_text (MODEST_SHELL_BANNER (banner), text);
+}
+
 typedef struct
 {
 	GMainLoop* loop;
@@ -1479,10 +1558,14 @@ modest_platform_run_certificate_confirmation_dialog (const gchar* server_name,
 {
 	GtkWidget *note;
 	gint response;
+	gchar *question;
 
-	
-	gchar *question = g_strdup_printf (_("mcen_nc_unknown_certificate"),
-					   server_name);
+	/* We could be running as a D-Bus service without UI */
+	if (!modest_init_ui ())
+		return FALSE;
+
+	question = g_strdup_printf (_("mcen_nc_unknown_certificate"),
+				    server_name);
 
 	/* We use GTK_RESPONSE_APPLY because we want the button in the
 	   middle of OK and CANCEL the same as the browser does for
@@ -1516,8 +1599,12 @@ gboolean
 modest_platform_run_alert_dialog (const gchar* prompt,
 				  gboolean is_question)
 {
-
 	gboolean retval = TRUE;
+
+	/* We could be running as a D-Bus service without UI */
+	if (!modest_init_ui ())
+		return FALSE;
+
 	if (is_question) {
 		GtkWidget *dialog;
 		/* The Tinymail documentation says that we should show Yes and No buttons,
@@ -41,6 +41,8 @@
 #include <libedataserver/e-data-server-util.h>
 #include "modest-platform.h"
 #include "modest-runtime.h"
+#include "modest-startup.h"
+#include "modest-recipient-index.h"
 #include "widgets/modest-window-mgr.h"
 #include "widgets/modest-ui-constants.h"
 #include <string.h>
@@ -519,19 +521,24 @@ static gint
 compare_addresses (const gchar *address1,
 		   const gchar *mail2)
 {
-	gint retval;
-	gchar *mail1, *mail1_down, *mail2_down;
-
-	/* Perform a case insensitive comparison */
-	mail1 = modest_text_utils_get_email_address (address1);
-	mail1_down = g_ascii_strdown (mail1, -1);
-	mail2_down = g_ascii_strdown (mail2, -1);
-	retval = g_strcmp0 (mail1_down, mail2_down);
-	g_free (mail1);
-	g_free (mail1_down);
-	g_free (mail2_down);
+	const gchar *mail1, *end;
+	gsize len;
+
+	/* Perform a case insensitive comparison of the email part. It's
+	   called for every email of every contact, so do not allocate */
+	mail1 = strrchr (address1, '<');
+	end = mail1 ? strchr (mail1, '>') : NULL;
+	if (end) {
+		mail1++;
+		len = end - mail1;
+	} else {
+		mail1 = address1;
+		len = strlen (address1);
+	}
 
-	return retval;
+	if (g_ascii_strncasecmp (mail1, mail2, len) != 0)
+		return 1;
+	return (mail2[len] == '\0') ? 0 : -1;
 }
 
 static EContact *
@@ -810,11 +817,37 @@ modest_address_book_check_names (ModestRecptEditor *recpt_editor,
 				g_free (message);
 				result = FALSE;
 			} else if (strstr (address, "@") == NULL) {
-				/* here goes searching in addressbook */
 				gboolean canceled;
 				GSList *contact_ids = NULL;
 				GSList *resolved_addresses = NULL;
+				gchar *known_address;
+
+				/* The names used before in the mails are
+				   resolved without querying the address book */
+				modest_startup_wait (MODEST_STARTUP_BARRIER_RECIPIENT_INDEX);
+				known_address = modest_recipient_index_lookup (address);
+				if (known_address) {
+					GSList *addr_list = NULL;
+					gint new_length;
+
+					g_free (address);
+					address = known_address;
+					addr_list = g_slist_prepend (addr_list, address);
+					modest_recpt_editor_replace_with_resolved_recipient (recpt_editor,
+											     &start_iter, &end_iter,
+											     addr_list,
+											     "");
+					g_slist_free (addr_list);
+
+					/* update offset delta */
+					recipients = modest_recpt_editor_get_recipients (recpt_editor);
+					new_length = g_utf8_strlen (recipients, -1);
+					offset_delta = offset_delta + new_length - last_length;
+					last_length = new_length;
+					goto resolved;
+				}
 
+				/* here goes searching in addressbook */
 				result = resolve_address (address, &resolved_addresses, &contact_ids, &canceled);
 
 				if (result) {
@@ -886,6 +919,7 @@ modest_address_book_check_names (ModestRecptEditor *recpt_editor,
 			}
 		}
 
+	resolved:
 		/* so, it seems a valid address */
 		/* note: adding it the to the addressbook if it did not exist yet,
 		 * and adding it to the recent_list */
@@ -1329,6 +1363,9 @@ modest_address_book_has_address (const gchar *address)
 
 	g_return_val_if_fail (address, FALSE);
 
+	/* It's opened after the first window is shown */
+	modest_startup_wait (MODEST_STARTUP_BARRIER_ADDRESS_BOOK);
+
 	if (!book) {
 		if (!open_addressbook ()) {
 			g_return_val_if_reached (FALSE);
@@ -1385,6 +1422,9 @@ modest_address_book_add_address_list (GSList *address_list)
 
 	g_return_if_fail (address_list);
 
+	/* It's opened after the first window is shown */
+	modest_startup_wait (MODEST_STARTUP_BARRIER_ADDRESS_BOOK);
+
 	if (!book)
 		if (!open_addressbook ())
 			g_return_if_reached ();
@@ -298,30 +298,6 @@ modest_hildon2_window_mgr_close_all_windows (ModestWindowMgr *self)
 	return !failed;
 }
 
-static gint
-compare_msguids (ModestWindow *win,
-		 const gchar *uid)
-{
-	const gchar *msg_uid;
-
-	if ((!MODEST_IS_MSG_EDIT_WINDOW (win)) && (!MODEST_IS_MSG_VIEW_WINDOW (win)))
-		return 1;
-
-	/* Get message uid from msg window */
-	if (MODEST_IS_MSG_EDIT_WINDOW (win)) {
-		msg_uid = modest_msg_edit_window_get_message_uid (MODEST_MSG_EDIT_WINDOW (win));
-		if (msg_uid && uid &&!strcmp (msg_uid, uid))
-			return 0;
-	} else {
-		msg_uid = modest_msg_view_window_get_message_uid (MODEST_MSG_VIEW_WINDOW (win));
-	}
-
-	if (msg_uid && uid &&!strcmp (msg_uid, uid))
-		return 0;
-	else
-		return 1;
-}
-
 static gint
 compare_headers (ModestWindow *win,
 		 TnyHeader *header)
@@ -347,68 +323,22 @@ static gboolean
 modest_hildon2_window_mgr_find_registered_header (ModestWindowMgr *self, TnyHeader *header,
 						  ModestWindow **win)
 {
-	ModestHildon2WindowMgrPrivate *priv = NULL;
-	gchar* uid = NULL;
-	gboolean has_header, has_window = FALSE;
-	GList *item = NULL;
-
 	g_return_val_if_fail (MODEST_IS_HILDON2_WINDOW_MGR (self), FALSE);
 	g_return_val_if_fail (TNY_IS_HEADER(header), FALSE);
-	
-	priv = MODEST_HILDON2_WINDOW_MGR_GET_PRIVATE (self);
 
-	has_header = MODEST_WINDOW_MGR_CLASS (parent_class)->find_registered_header (self, header, win);
-	
-	uid = modest_tny_folder_get_header_unique_id (header);
-	
-	item = g_list_find_custom (priv->window_list, uid, (GCompareFunc) compare_msguids);
-	if (item) {
-		has_window = TRUE;
-		if (win) {
-			if ((!MODEST_IS_MSG_VIEW_WINDOW(item->data)) && 
-			    (!MODEST_IS_MSG_EDIT_WINDOW (item->data)))
-				g_debug ("not a valid window!");
-			else {
-				g_debug ("found a window");
-				*win = MODEST_WINDOW (item->data);
-			}
-		}
-	}
-	g_free (uid);
-	
-	return has_header || has_window;
+	/* The parent class indexes both the pre-registered headers
+	   and the windows showing them */
+	return MODEST_WINDOW_MGR_CLASS (parent_class)->find_registered_header (self, header, win);
 }
 
 static gboolean
 modest_hildon2_window_mgr_find_registered_message_uid (ModestWindowMgr *self, const gchar *msg_uid,
 						       ModestWindow **win)
 {
-	ModestHildon2WindowMgrPrivate *priv = NULL;
-	gboolean has_header, has_window = FALSE;
-	GList *item = NULL;
-
 	g_return_val_if_fail (MODEST_IS_HILDON2_WINDOW_MGR (self), FALSE);
 	g_return_val_if_fail (msg_uid && msg_uid[0] != '\0', FALSE);
-	
-	priv = MODEST_HILDON2_WINDOW_MGR_GET_PRIVATE (self);
 
-	has_header = MODEST_WINDOW_MGR_CLASS (parent_class)->find_registered_message_uid (self, msg_uid, win);
-	
-	item = g_list_find_custom (priv->window_list, msg_uid, (GCompareFunc) compare_msguids);
-	if (item) {
-		has_window = TRUE;
-		if (win) {
-			if ((!MODEST_IS_MSG_VIEW_WINDOW(item->data)) && 
-			    (!MODEST_IS_MSG_EDIT_WINDOW (item->data)))
-				g_debug ("not a valid window!");
-			else {
-				g_debug ("found a window");
-				*win = MODEST_WINDOW (item->data);
-			}
-		}
-	}
-	
-	return has_header || has_window;
+	return MODEST_WINDOW_MGR_CLASS (parent_class)->find_registered_message_uid (self, msg_uid, win);
 }
 
 static GList *
@@ -493,7 +423,7 @@ modest_hildon2_window_mgr_register_window (ModestWindowMgr *self,
 			uid = modest_tny_folder_get_header_unique_id (header);
 		/* Embedded messages do not have uid */
 		if (uid) {
-			if (g_list_find_custom (priv->window_list, uid, (GCompareFunc) compare_msguids)) {
+			if (_modest_window_mgr_lookup_window (self, uid)) {
 				g_debug ("%s found another view window showing the same header", __FUNCTION__);
 				g_free (uid);
 				g_object_unref (header);
@@ -640,6 +570,7 @@ modest_hildon2_window_mgr_register_window (ModestWindowMgr *self,
 
 	return TRUE;
 fail:
+	_modest_window_mgr_unindex_window (self, window);
 	/* Add to list. Keep a reference to the window */
 	priv->window_list = g_list_remove (priv->window_list, window);
 	g_object_unref (window);
@@ -34,6 +34,8 @@
 #include <modest-defs.h>
 #include <modest-scrollable.h>
 #include <modest-runtime.h>
+#include <modest-init.h>
+#include <modest-cache-mgr.h>
 #include <modest-header-view.h>
 #include "modest-hildon2-global-settings-dialog.h"
 #include "modest-widget-memory.h"
@@ -232,10 +234,16 @@ modest_platform_init (int argc, char *argv[])
 		modest_account_mgr_free_account_names (acc_names);
 	}
 
-	
+	return TRUE;
+}
+
+gboolean
+modest_platform_init_ui (int argc, char *argv[])
+{
 #ifdef MODEST_HAVE_ABOOK
-	/* initialize the addressbook */
-	if (!osso_abook_init (&argc, &argv, osso_context)) {
+	/* initialize the addressbook. It requires Gtk+ to be
+	   initialized, so it's done with the rest of the UI */
+	if (!osso_abook_init (&argc, &argv, modest_maemo_utils_get_osso_context ())) {
 		g_printerr ("modest: failed to initialized addressbook\n");
 		return FALSE;
 	}
@@ -511,12 +519,25 @@ modest_platform_show_uri_popup (const gchar *uri)
 }
 
 
+/* icons are loaded again and again while rendering the folder and
+ * header views, so we keep the most recently used ones around. The
+ * cache is flushed if the icon theme changes */
+static void
+on_icon_theme_changed (GtkIconTheme *theme, gpointer user_data)
+{
+	modest_cache_mgr_flush (modest_runtime_get_cache_mgr (),
+				MODEST_CACHE_MGR_CACHE_TYPE_PIXBUF);
+}
+
 GdkPixbuf*
 modest_platform_get_icon (const gchar *name, guint icon_size)
 {
+	static gboolean theme_watched = FALSE;
 	GError *err = NULL;
 	GdkPixbuf* pixbuf = NULL;
 	GtkIconTheme *current_theme = NULL;
+	ModestCacheMgr *cache_mgr;
+	gchar *key;
 
 	g_return_val_if_fail (name, NULL);
 
@@ -527,6 +548,22 @@ modest_platform_get_icon (const gchar *name, guint icon_size)
 		return NULL;
 
 	current_theme = gtk_icon_theme_get_default ();
+	if (!theme_watched) {
+		g_signal_connect (current_theme, "changed",
+				  G_CALLBACK (on_icon_theme_changed), NULL);
+		theme_watched = TRUE;
+	}
+
+	cache_mgr = modest_runtime_get_cache_mgr ();
+	key = g_strdup_printf ("%s:%u", name, icon_size);
+	pixbuf = (GdkPixbuf *) modest_cache_mgr_lookup (cache_mgr,
+							MODEST_CACHE_MGR_CACHE_TYPE_PIXBUF,
+							key);
+	if (pixbuf) {
+		g_free (key);
+		return g_object_ref (pixbuf);
+	}
+
 	pixbuf = gtk_icon_theme_load_icon (current_theme, name, icon_size,
 					   GTK_ICON_LOOKUP_NO_SVG,
 					   &err);
@@ -534,7 +571,14 @@ modest_platform_get_icon (const gchar *name, guint icon_size)
 		g_warning ("Error loading theme icon '%s': %s\n",
 			    name, err->message);
 		g_error_free (err);
-	} 
+	} else {
+		modest_cache_mgr_insert (cache_mgr, MODEST_CACHE_MGR_CACHE_TYPE_PIXBUF,
+					 key, pixbuf,
+					 gdk_pixbuf_get_rowstride (pixbuf) *
+					 gdk_pixbuf_get_height (pixbuf));
+	}
+	g_free (key);
+
 	return pixbuf;
 }
 
@@ -1236,6 +1280,10 @@ modest_platform_run_confirmation_dialog (GtkWindow *parent_window,
 	GtkWidget *dialog;
 	gint response;
 	
+	/* We could be running as a D-Bus service without UI */
+	if (!modest_init_ui ())
+		return GTK_RESPONSE_CANCEL;
+
 	dialog = hildon_note_new_confirmation (parent_window, message);
 	modest_window_mgr_set_modal (modest_runtime_get_window_mgr (), 
 				     GTK_WINDOW (dialog), parent_window);
@@ -1256,6 +1304,10 @@ modest_platform_run_confirmation_dialog_with_buttons (GtkWindow *parent_window,
 	GtkWidget *dialog;
 	gint response;
 	
+	/* We could be running as a D-Bus service without UI */
+	if (!modest_init_ui ())
+		return GTK_RESPONSE_CANCEL;
+
 	dialog = hildon_note_new_confirmation_add_buttons (parent_window, message,
 							   button_accept, GTK_RESPONSE_ACCEPT,
 							   button_cancel, GTK_RESPONSE_CANCEL,
@@ -1278,6 +1330,10 @@ modest_platform_run_information_dialog (GtkWindow *parent_window,
 {
 	GtkWidget *note;
 	
+	/* We could be running as a D-Bus service without UI */
+	if (!modest_init_ui ())
+		return;
+
 	note = hildon_note_new_information (parent_window, message);
 	if (block)
 		modest_window_mgr_set_modal (modest_runtime_get_window_mgr (),
@@ -1837,6 +1893,10 @@ modest_platform_information_banner (GtkWidget *parent,
 	GtkWidget *banner_parent = NULL;
 	ModestWindowMgr *mgr = modest_runtime_get_window_mgr ();
 
+	/* Nothing to show it over if the UI was not initialized */
+	if (!modest_init_ui_is_initialized ())
+		return;
+
 	if (modest_window_mgr_get_num_windows (mgr) == 0)
 		return;
 
@@ -1868,6 +1928,10 @@ modest_platform_system_banner (GtkWidget *parent,
 	GtkWidget *banner = NULL;
 	ModestWindowMgr *mgr = modest_runtime_get_window_mgr ();
 
+	/* Nothing to show it over if the UI was not initialized */
+	if (!modest_init_ui_is_initialized ())
+		return;
+
 	if (parent && GTK_IS_WINDOW (parent)) {
 		if (!gtk_window_is_active (GTK_WINDOW (parent)))
 			parent = NULL;
@@ -1888,6 +1952,10 @@ modest_platform_information_banner_with_timeout (GtkWidget *parent,
 {
 	GtkWidget *banner;
 
+	/* Nothing to show it over if the UI was not initialized */
+	if (!modest_init_ui_is_initialized ())
+		return;
+
 	if (modest_window_mgr_get_num_windows (modest_runtime_get_window_mgr ()) == 0)
 		return;
 
@@ -1916,6 +1984,15 @@ modest_platform_animation_banner (GtkWidget *parent,
 	return inf_note;
 }
 
+void
+modest_platform_animation_banner_set_text (GtkWidget *banner,
+					   const gchar *text)
+{
+	g_return_if_fail (banner && text);
+
+	hildon_banner_set_text (HILDON_BANNER (banner), text);
+}
+
 typedef struct
 {
 	GMainLoop* loop;
@@ -2050,6 +2127,10 @@ modest_platform_run_certificate_confirmation_dialog (const gchar* server_name,
 	ModestWindow *win;
 	HildonWindowStack *stack;
 
+	/* We could be running as a D-Bus service without UI */
+	if (!modest_init_ui ())
+		return FALSE;
+
 	stack = hildon_window_stack_get_default ();
 	win = MODEST_WINDOW (hildon_window_stack_peek (stack));
 
@@ -2096,6 +2177,10 @@ modest_platform_run_alert_dialog (const gchar* prompt,
 	ModestWindow *top_win;
 	HildonWindowStack *stack;
 
+	/* We could be running as a D-Bus service without UI */
+	if (!modest_init_ui ())
+		return FALSE;
+
 	stack = hildon_window_stack_get_default ();
 	top_win = MODEST_WINDOW (hildon_window_stack_peek (stack));
 
@@ -32,7 +32,11 @@
  * can build modest without any addressbook support
  */
 
+#include <string.h>
 #include "modest-address-book.h"
+#include "modest-text-utils.h"
+#include "modest-recipient-index.h"
+#include "modest-startup.h"
 
 void modest_address_book_add_address (const gchar *address,
 				      GtkWindow *parent)
@@ -51,6 +55,62 @@ void modest_address_book_select_addresses (ModestRecptEditor *editor,
 gboolean modest_address_book_check_names (ModestRecptEditor *editor,
 					  GSList **address_list)
 {
+	const gchar *recipients;
+	GSList *start_indexes = NULL, *end_indexes = NULL;
+	GSList *current_start, *current_end;
+	GtkTextBuffer *buffer;
+
+	g_return_val_if_fail (MODEST_IS_RECPT_EDITOR (editor), FALSE);
+
+	/* There is no address book, but the names used before in the
+	   mails can be resolved with the recipient index. Go backwards,
+	   so replacing a name does not move the next ones */
+	recipients = modest_recpt_editor_get_recipients (editor);
+	modest_text_utils_get_addresses_indexes (recipients, &start_indexes, &end_indexes);
+	start_indexes = g_slist_reverse (start_indexes);
+	end_indexes = g_slist_reverse (end_indexes);
+	buffer = modest_recpt_editor_get_buffer (editor);
+
+	for (current_start = start_indexes, current_end = end_indexes;
+	     current_start && current_end;
+	     current_start = g_slist_next (current_start),
+		     current_end = g_slist_next (current_end)) {
+		gchar *start_ptr, *end_ptr, *address, *known_address;
+		gint start_pos, end_pos;
+
+		start_pos = *((gint *) current_start->data);
+		end_pos = *((gint *) current_end->data);
+		start_ptr = g_utf8_offset_to_pointer (recipients, start_pos);
+		end_ptr = g_utf8_offset_to_pointer (recipients, end_pos);
+		address = g_strstrip (g_strndup (start_ptr, end_ptr - start_ptr));
+
+		known_address = NULL;
+		if (address[0] != '\0' && !strchr (address, '@')) {
+			/* The index is loaded in a deferred startup phase */
+			modest_startup_wait (MODEST_STARTUP_BARRIER_RECIPIENT_INDEX);
+			known_address = modest_recipient_index_lookup (address);
+		}
+		if (known_address) {
+			GtkTextIter start_iter, end_iter;
+			GSList *addr_list;
+
+			gtk_text_buffer_get_iter_at_offset (buffer, &start_iter, start_pos);
+			gtk_text_buffer_get_iter_at_offset (buffer, &end_iter, end_pos);
+			addr_list = g_slist_prepend (NULL, known_address);
+			modest_recpt_editor_replace_with_resolved_recipient (editor,
+									     &start_iter, &end_iter,
+									     addr_list, "");
+			g_slist_free (addr_list);
+			g_free (known_address);
+		}
+		g_free (address);
+	}
+
+	g_slist_foreach (start_indexes, (GFunc) g_free, NULL);
+	g_slist_foreach (end_indexes, (GFunc) g_free, NULL);
+	g_slist_free (start_indexes);
+	g_slist_free (end_indexes);
+
 	/* let's be optimistic */
 	return TRUE;
 }
@@ -0,0 +1,640 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include <libgnomevfs/gnome-vfs.h>
+#include <tny-platform-factory.h>
+#include "modest-defs.h"
+#include "modest-runtime.h"
+#include "modest-startup.h"
+#include "modest-mail-operation.h"
+#include "modest-mail-operation-queue.h"
+#include "modest-account-mgr-helpers.h"
+#include "modest-tny-account-store.h"
+#include "modest-file-stream.h"
+#include "modest-autosave.h"
+
+/*
+ * A journal is a header line followed by records like
+ *
+ *    TAG OFFSET REMOVED LENGTH\n<LENGTH bytes>\n
+ *
+ * Every record but SPLICE replaces a whole field. SPLICE replaces
+ * REMOVED bytes of the body, starting at OFFSET, with the
+ * payload. The first record of a journal (and the first one after
+ * a compaction) has all the fields
+ */
+#define JOURNAL_MAGIC  "MODEST-AUTOSAVE 1\n"
+#define JOURNAL_SUFFIX ".journal"
+
+static const struct {
+	const gchar *tag;
+	glong        offset;
+} string_fields[] = {
+	{ "ACCOUNT",     G_STRUCT_OFFSET (ModestAutosaveState, account_name) },
+	{ "FROM",        G_STRUCT_OFFSET (ModestAutosaveState, from) },
+	{ "TO",          G_STRUCT_OFFSET (ModestAutosaveState, to) },
+	{ "CC",          G_STRUCT_OFFSET (ModestAutosaveState, cc) },
+	{ "BCC",         G_STRUCT_OFFSET (ModestAutosaveState, bcc) },
+	{ "SUBJECT",     G_STRUCT_OFFSET (ModestAutosaveState, subject) },
+	{ "BODY",        G_STRUCT_OFFSET (ModestAutosaveState, body) },
+	{ "REFERENCES",  G_STRUCT_OFFSET (ModestAutosaveState, references) },
+	{ "IN-REPLY-TO", G_STRUCT_OFFSET (ModestAutosaveState, in_reply_to) }
+};
+#define STATE_FIELD(state,i) G_STRUCT_MEMBER (gchar*, (state), string_fields[(i)].offset)
+
+typedef enum {
+	JOB_APPEND,
+	JOB_REPLACE,
+	JOB_UNLINK
+} JobType;
+
+typedef struct {
+	JobType  type;
+	gchar   *filename;
+	GString *data;
+} WriteJob;
+
+struct _ModestAutosaveJournal {
+	gchar               *filename;
+	ModestAutosaveState *last;   /* NULL if nothing was written yet */
+	gsize                size;
+};
+
+/* All the writes are done by this single thread, in order */
+static GThreadPool *writer = NULL;
+static gchar *session_prefix = NULL;
+static guint journal_count = 0;
+
+static gchar*
+get_autosave_dir (void)
+{
+	return g_build_filename (g_get_home_dir (), MODEST_DIR, MODEST_AUTOSAVE_DIR, NULL);
+}
+
+static gboolean
+write_all (int fd, const gchar *data, gsize len)
+{
+	while (len > 0) {
+		ssize_t written = write (fd, data, len);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return FALSE;
+		}
+		data += written;
+		len -= written;
+	}
+	return TRUE;
+}
+
+static void
+run_job (gpointer data, gpointer userdata)
+{
+	WriteJob *job = (WriteJob *) data;
+	gchar *dirname, *tmp_filename;
+	gboolean ok;
+	int fd;
+
+	switch (job->type) {
+	case JOB_APPEND:
+		fd = g_open (job->filename, O_WRONLY | O_APPEND | O_CREAT, 0600);
+		ok = (fd >= 0) && write_all (fd, job->data->str, job->data->len) && (fsync (fd) == 0);
+		if (fd >= 0)
+			close (fd);
+		if (!ok)
+			g_warning ("%s: could not write %s", __FUNCTION__, job->filename);
+		break;
+	case JOB_REPLACE:
+		dirname = g_path_get_dirname (job->filename);
+		g_mkdir_with_parents (dirname, 0700);
+		g_free (dirname);
+
+		/* Write it aside and rename it, so there is always a
+		   complete journal on disk */
+		tmp_filename = g_strconcat (job->filename, ".tmp", NULL);
+		fd = g_open (tmp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		ok = (fd >= 0) && write_all (fd, job->data->str, job->data->len) && (fsync (fd) == 0);
+		if (fd >= 0)
+			close (fd);
+		if (!ok || g_rename (tmp_filename, job->filename) != 0) {
+			g_warning ("%s: could not write %s", __FUNCTION__, job->filename);
+			g_unlink (tmp_filename);
+		}
+		g_free (tmp_filename);
+		break;
+	case JOB_UNLINK:
+		g_unlink (job->filename);
+		break;
+	}
+
+	g_free (job->filename);
+	if (job->data)
+		g_string_free (job->data, TRUE);
+	g_slice_free (WriteJob, job);
+}
+
+static void
+push_job (JobType type, const gchar *filename, GString *data)
+{
+	WriteJob *job;
+
+	job = g_slice_new0 (WriteJob);
+	job->type = type;
+	job->filename = g_strdup (filename);
+	job->data = data;
+
+	if (!writer && g_thread_supported ())
+		writer = g_thread_pool_new (run_job, NULL, 1, FALSE, NULL);
+
+	if (writer)
+		g_thread_pool_push (writer, job, NULL);
+	else
+		run_job (job, NULL);
+}
+
+static gchar*
+join_attachments (GSList *uris)
+{
+	GString *str;
+	GSList *node;
+
+	str = g_string_new ("");
+	for (node = uris; node; node = g_slist_next (node)) {
+		if (node != uris)
+			g_string_append_c (str, '\n');
+		g_string_append (str, (const gchar *) node->data);
+	}
+
+	return g_string_free (str, FALSE);
+}
+
+static void
+append_record (GString *str, const gchar *tag, gsize offset, gsize removed,
+	       const gchar *payload, gsize length)
+{
+	g_string_append_printf (str, "%s %lu %lu %lu\n", tag,
+				(gulong) offset, (gulong) removed, (gulong) length);
+	g_string_append_len (str, payload, length);
+	g_string_append_c (str, '\n');
+}
+
+/* Only the part of the body between the common prefix and the
+   common suffix is written, typing adds a few bytes per autosave
+   whatever the size of the body */
+static void
+append_body_splice (GString *str, const gchar *old_body, const gchar *body)
+{
+	gsize old_len, len, prefix = 0, suffix = 0;
+
+	old_len = strlen (old_body);
+	len = strlen (body);
+
+	while (prefix < old_len && prefix < len && old_body[prefix] == body[prefix])
+		prefix++;
+	while (suffix < old_len - prefix && suffix < len - prefix &&
+	       old_body[old_len - suffix - 1] == body[len - suffix - 1])
+		suffix++;
+
+	append_record (str, "SPLICE", prefix, old_len - prefix - suffix,
+		       body + prefix, len - prefix - suffix);
+}
+
+/* If @old_state is NULL all the fields are written */
+static void
+append_changes (GString *str, ModestAutosaveState *old_state, ModestAutosaveState *state)
+{
+	gchar *old_attachments, *attachments;
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (string_fields); i++) {
+		const gchar *old_value = (old_state) ? STATE_FIELD (old_state, i) : NULL;
+		const gchar *value = STATE_FIELD (state, i);
+
+		if (old_value && !strcmp (old_value, value))
+			continue;
+
+		if (old_value && string_fields[i].offset == G_STRUCT_OFFSET (ModestAutosaveState, body))
+			append_body_splice (str, old_value, value);
+		else
+			append_record (str, string_fields[i].tag, 0, 0, value, strlen (value));
+	}
+
+	if (!old_state || old_state->priority_flags != state->priority_flags) {
+		gchar *priority = g_strdup_printf ("%d", (gint) state->priority_flags);
+		append_record (str, "PRIORITY", 0, 0, priority, strlen (priority));
+		g_free (priority);
+	}
+
+	old_attachments = (old_state) ? join_attachments (old_state->attachments) : NULL;
+	attachments = join_attachments (state->attachments);
+	if (!old_attachments || strcmp (old_attachments, attachments))
+		append_record (str, "ATTACHMENTS", 0, 0, attachments, strlen (attachments));
+	g_free (old_attachments);
+	g_free (attachments);
+}
+
+/* Applies the record at *@p to @state and moves *@p to the next
+   one. Returns FALSE if the record is incomplete or corrupt */
+static gboolean
+apply_record (ModestAutosaveState *state, const gchar **p, const gchar *end)
+{
+	const gchar *eol, *payload;
+	gulong offset, removed, length;
+	gchar tag[16];
+	gchar *line;
+	gboolean ok;
+	guint i;
+
+	eol = memchr (*p, '\n', end - *p);
+	if (!eol)
+		return FALSE;
+
+	line = g_strndup (*p, eol - *p);
+	ok = (sscanf (line, "%15s %lu %lu %lu", tag, &offset, &removed, &length) == 4);
+	g_free (line);
+
+	payload = eol + 1;
+	if (!ok || (gulong) (end - payload) <= length || payload[length] != '\n')
+		return FALSE;
+	*p = payload + length + 1;
+
+	if (!strcmp (tag, "SPLICE")) {
+		gsize body_len = strlen (state->body);
+		GString *body;
+
+		if (offset > body_len || removed > body_len - offset)
+			return FALSE;
+
+		body = g_string_new_len (state->body, offset);
+		g_string_append_len (body, payload, length);
+		g_string_append (body, state->body + offset + removed);
+		g_free (state->body);
+		state->body = g_string_free (body, FALSE);
+	} else if (!strcmp (tag, "PRIORITY")) {
+		state->priority_flags = (TnyHeaderFlags) strtol (payload, NULL, 10);
+	} else if (!strcmp (tag, "ATTACHMENTS")) {
+		gchar *uris, **split;
+
+		g_slist_foreach (state->attachments, (GFunc) g_free, NULL);
+		g_slist_free (state->attachments);
+		state->attachments = NULL;
+
+		uris = g_strndup (payload, length);
+		split = g_strsplit (uris, "\n", -1);
+		for (i = 0; split[i]; i++) {
+			if (split[i][0] != '\0')
+				state->attachments = g_slist_prepend (state->attachments,
+								      g_strdup (split[i]));
+		}
+		state->attachments = g_slist_reverse (state->attachments);
+		g_strfreev (split);
+		g_free (uris);
+	} else {
+		for (i = 0; i < G_N_ELEMENTS (string_fields); i++) {
+			if (!strcmp (tag, string_fields[i].tag)) {
+				g_free (STATE_FIELD (state, i));
+				STATE_FIELD (state, i) = g_strndup (payload, length);
+				break;
+			}
+		}
+		if (i == G_N_ELEMENTS (string_fields))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static ModestAutosaveState*
+read_journal (const gchar *filename)
+{
+	ModestAutosaveState *state;
+	const gchar *p, *end;
+	gchar *contents;
+	gsize length;
+
+	if (!g_file_get_contents (filename, &contents, &length, NULL))
+		return NULL;
+
+	if (length < strlen (JOURNAL_MAGIC) ||
+	    strncmp (contents, JOURNAL_MAGIC, strlen (JOURNAL_MAGIC))) {
+		g_free (contents);
+		return NULL;
+	}
+
+	state = modest_autosave_state_new ();
+	p = contents + strlen (JOURNAL_MAGIC);
+	end = contents + length;
+
+	/* A crash while writing leaves a torn last record, in that
+	   case we get the state of the previous autosave */
+	while (p < end && apply_record (state, &p, end))
+		;
+
+	g_free (contents);
+
+	if (!g_utf8_validate (state->body, -1, NULL)) {
+		modest_autosave_state_free (state);
+		return NULL;
+	}
+
+	return state;
+}
+
+static gboolean
+state_is_empty (ModestAutosaveState *state)
+{
+	return state->to[0] == '\0' && state->cc[0] == '\0' && state->bcc[0] == '\0' &&
+		state->subject[0] == '\0' && state->body[0] == '\0' && !state->attachments;
+}
+
+ModestAutosaveState*
+modest_autosave_state_new (void)
+{
+	ModestAutosaveState *state;
+	guint i;
+
+	state = g_slice_new0 (ModestAutosaveState);
+	for (i = 0; i < G_N_ELEMENTS (string_fields); i++)
+		STATE_FIELD (state, i) = g_strdup ("");
+
+	return state;
+}
+
+void
+modest_autosave_state_free (ModestAutosaveState *state)
+{
+	guint i;
+
+	g_return_if_fail (state);
+
+	for (i = 0; i < G_N_ELEMENTS (string_fields); i++)
+		g_free (STATE_FIELD (state, i));
+	g_slist_foreach (state->attachments, (GFunc) g_free, NULL);
+	g_slist_free (state->attachments);
+
+	g_slice_free (ModestAutosaveState, state);
+}
+
+ModestAutosaveJournal*
+modest_autosave_journal_new (void)
+{
+	ModestAutosaveJournal *journal;
+	gchar *dirname, *basename;
+
+	/* The pid and the start time identify the journals of this
+	   session, so the recovery does not take them for the ones
+	   of a crashed session */
+	if (!session_prefix)
+		session_prefix = g_strdup_printf ("%d-%ld-", (gint) getpid (), (glong) time (NULL));
+
+	dirname = get_autosave_dir ();
+	basename = g_strdup_printf ("%s%u" JOURNAL_SUFFIX, session_prefix, journal_count++);
+
+	journal = g_slice_new0 (ModestAutosaveJournal);
+	journal->filename = g_build_filename (dirname, basename, NULL);
+
+	g_free (basename);
+	g_free (dirname);
+
+	return journal;
+}
+
+void
+modest_autosave_journal_record (ModestAutosaveJournal *journal,
+				ModestAutosaveState *state)
+{
+	GString *data;
+
+	g_return_if_fail (journal);
+	g_return_if_fail (state);
+
+	data = g_string_new ("");
+	if (journal->last && journal->size < MODEST_AUTOSAVE_JOURNAL_MAX_SIZE) {
+		append_changes (data, journal->last, state);
+		if (data->len == 0) {
+			g_string_free (data, TRUE);
+			modest_autosave_state_free (state);
+			return;
+		}
+		journal->size += data->len;
+		push_job (JOB_APPEND, journal->filename, data);
+	} else {
+		/* The first write, or the journal is too big: replace
+		   it with the current state */
+		g_string_append (data, JOURNAL_MAGIC);
+		append_changes (data, NULL, state);
+		journal->size = data->len;
+		push_job (JOB_REPLACE, journal->filename, data);
+	}
+
+	if (journal->last)
+		modest_autosave_state_free (journal->last);
+	journal->last = state;
+}
+
+void
+modest_autosave_journal_discard (ModestAutosaveJournal *journal)
+{
+	g_return_if_fail (journal);
+
+	if (journal->last) {
+		push_job (JOB_UNLINK, journal->filename, NULL);
+		modest_autosave_state_free (journal->last);
+	}
+
+	g_free (journal->filename);
+	g_slice_free (ModestAutosaveJournal, journal);
+}
+
+static TnyMimePart*
+create_attachment (const gchar *uri)
+{
+	GnomeVFSURI *vfs_uri;
+	TnyMimePart *part;
+	TnyStream *stream;
+	gchar *escaped_filename, *filename;
+
+	vfs_uri = gnome_vfs_uri_new (uri);
+	if (!vfs_uri)
+		return NULL;
+
+	escaped_filename = g_path_get_basename (gnome_vfs_uri_get_path (vfs_uri));
+	filename = gnome_vfs_unescape_string_for_display (escaped_filename);
+
+	/* The file is read while the draft is saved */
+	stream = modest_file_stream_new (uri);
+	part = tny_platform_factory_new_mime_part (modest_runtime_get_platform_factory ());
+	tny_mime_part_construct (part, stream, gnome_vfs_get_mime_type_for_name (filename), "base64");
+	tny_mime_part_set_filename (part, filename);
+
+	g_free (filename);
+	g_free (escaped_filename);
+	gnome_vfs_uri_unref (vfs_uri);
+	g_object_unref (stream);
+
+	return part;
+}
+
+static void
+on_recovered_draft_saved (ModestMailOperation *mail_op,
+			  TnyMsg *saved_draft,
+			  gpointer userdata)
+{
+	gchar *filename = (gchar *) userdata;
+	ModestMailOperationStatus status;
+
+	/* FINISHED_WITH_ERRORS means that some attachment could not
+	   be read, retrying would not help */
+	status = modest_mail_operation_get_status (mail_op);
+	if (status == MODEST_MAIL_OPERATION_STATUS_SUCCESS ||
+	    status == MODEST_MAIL_OPERATION_STATUS_FINISHED_WITH_ERRORS)
+		push_job (JOB_UNLINK, filename, NULL);
+	else
+		g_warning ("%s: could not recover %s", __FUNCTION__, filename);
+
+	g_free (filename);
+}
+
+static void
+recover_journal (const gchar *filename)
+{
+	ModestAutosaveState *state;
+	TnyTransportAccount *transport_account = NULL;
+	ModestMailOperation *mail_op;
+	GList *attachments = NULL;
+	gchar *account_name;
+	GSList *node;
+
+	state = read_journal (filename);
+	if (!state || state_is_empty (state)) {
+		push_job (JOB_UNLINK, filename, NULL);
+		if (state)
+			modest_autosave_state_free (state);
+		return;
+	}
+
+	if (state->account_name[0] != '\0')
+		account_name = g_strdup (state->account_name);
+	else
+		account_name = modest_account_mgr_get_default_account (modest_runtime_get_account_mgr ());
+	if (account_name)
+		transport_account = TNY_TRANSPORT_ACCOUNT
+			(modest_tny_account_store_get_server_account (modest_runtime_get_account_store (),
+								      account_name,
+								      TNY_ACCOUNT_TYPE_TRANSPORT));
+	if (!transport_account) {
+		/* Keep the journal, the account could be fixed later */
+		g_warning ("%s: no transport account found for '%s'", __FUNCTION__, account_name);
+		g_free (account_name);
+		modest_autosave_state_free (state);
+		return;
+	}
+
+	for (node = state->attachments; node; node = g_slist_next (node)) {
+		TnyMimePart *part = create_attachment ((const gchar *) node->data);
+		if (part)
+			attachments = g_list_append (attachments, part);
+	}
+
+	mail_op = modest_mail_operation_new (NULL);
+	modest_mail_operation_queue_add (modest_runtime_get_mail_operation_queue (), mail_op);
+	modest_mail_operation_save_to_drafts (mail_op, transport_account, NULL,
+					      state->from, state->to, state->cc, state->bcc,
+					      state->subject, state->body, NULL,
+					      attachments, NULL,
+					      state->priority_flags,
+					      (state->references[0] != '\0') ? state->references : NULL,
+					      (state->in_reply_to[0] != '\0') ? state->in_reply_to : NULL,
+					      on_recovered_draft_saved,
+					      g_strdup (filename));
+
+	g_list_foreach (attachments, (GFunc) g_object_unref, NULL);
+	g_list_free (attachments);
+	g_object_unref (mail_op);
+	g_object_unref (transport_account);
+	g_free (account_name);
+	modest_autosave_state_free (state);
+}
+
+void
+modest_autosave_recover (void)
+{
+	const gchar *name;
+	gchar *dirname;
+	GDir *dir;
+
+	/* The recovered messages are saved in the local drafts */
+	modest_startup_wait (MODEST_STARTUP_BARRIER_LOCAL_FOLDERS);
+
+	dirname = get_autosave_dir ();
+	dir = g_dir_open (dirname, 0, NULL);
+	if (!dir) {
+		g_free (dirname);
+		return;
+	}
+
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		gchar *filename;
+
+		/* Skip the journals of the editors of this session */
+		if (session_prefix && g_str_has_prefix (name, session_prefix))
+			continue;
+
+		filename = g_build_filename (dirname, name, NULL);
+		if (g_str_has_suffix (name, JOURNAL_SUFFIX))
+			recover_journal (filename);
+		else
+			/* Leftover of an interrupted rewrite, the
+			   journal itself is still complete */
+			push_job (JOB_UNLINK, filename, NULL);
+		g_free (filename);
+	}
+
+	g_dir_close (dir);
+	g_free (dirname);
+}
+
+void
+modest_autosave_shutdown (void)
+{
+	if (writer) {
+		/* Wait for the pending writes */
+		g_thread_pool_free (writer, FALSE, TRUE);
+		writer = NULL;
+	}
+}
@@ -0,0 +1,135 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MODEST_AUTOSAVE_H__
+#define __MODEST_AUTOSAVE_H__
+
+#include <glib.h>
+#include <tny-header.h>
+
+G_BEGIN_DECLS
+
+/* default number of seconds between autosaves, see
+   MODEST_CONF_AUTOSAVE_INTERVAL */
+#define MODEST_AUTOSAVE_DEFAULT_INTERVAL 30
+
+/* the journal is rewritten with just the current state when it's
+   bigger than this */
+#define MODEST_AUTOSAVE_JOURNAL_MAX_SIZE (256*1024)
+
+/*
+ * the contents of the editor that are journaled. The strings are
+ * never NULL, and @attachments is a list of the uris of the attached
+ * files
+ */
+typedef struct {
+	gchar          *account_name;
+	gchar          *from;
+	gchar          *to;
+	gchar          *cc;
+	gchar          *bcc;
+	gchar          *subject;
+	gchar          *body;
+	gchar          *references;
+	gchar          *in_reply_to;
+	TnyHeaderFlags  priority_flags;
+	GSList         *attachments;
+} ModestAutosaveState;
+
+typedef struct _ModestAutosaveJournal ModestAutosaveJournal;
+
+/**
+ * modest_autosave_state_new:
+ *
+ * Returns: a new empty #ModestAutosaveState. Free it with
+ * modest_autosave_state_free
+ */
+ModestAutosaveState*   modest_autosave_state_new        (void);
+
+/**
+ * modest_autosave_state_free:
+ * @state: a #ModestAutosaveState
+ *
+ * frees @state and all its fields
+ */
+void                   modest_autosave_state_free       (ModestAutosaveState *state);
+
+/**
+ * modest_autosave_journal_new:
+ *
+ * creates a new journal. The file is not created until the first
+ * modest_autosave_journal_record. It must be called from the main
+ * thread
+ *
+ * Returns: a new #ModestAutosaveJournal
+ */
+ModestAutosaveJournal* modest_autosave_journal_new      (void);
+
+/**
+ * modest_autosave_journal_record:
+ * @journal: a #ModestAutosaveJournal
+ * @state: the current #ModestAutosaveState of the editor
+ *
+ * appends to the journal file the changes between @state and the
+ * previously recorded one. The file is written in a worker thread,
+ * so this function does not block. @journal takes the ownership of
+ * @state
+ */
+void                   modest_autosave_journal_record   (ModestAutosaveJournal *journal,
+							 ModestAutosaveState *state);
+
+/**
+ * modest_autosave_journal_discard:
+ * @journal: a #ModestAutosaveJournal
+ *
+ * removes the journal file and frees @journal. It must be called
+ * once the message was saved, sent or discarded, only the journals
+ * of the editors that were not closed remain on disk
+ */
+void                   modest_autosave_journal_discard  (ModestAutosaveJournal *journal);
+
+/**
+ * modest_autosave_recover:
+ *
+ * saves to the drafts folder the messages of the journals left by
+ * a previous run, and removes the journals once they are saved
+ */
+void                   modest_autosave_recover          (void);
+
+/**
+ * modest_autosave_shutdown:
+ *
+ * waits until all the pending writes are done. It should be called
+ * before exiting
+ */
+void                   modest_autosave_shutdown         (void);
+
+G_END_DECLS
+
+#endif /* __MODEST_AUTOSAVE_H__ */
@@ -0,0 +1,322 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* modest-buffered-stream.c */
+
+#include <config.h>
+#include <string.h>
+#include <tny-stream.h>
+#include "modest-buffered-stream.h"
+
+/* 'private'/'protected' functions */
+static void  modest_buffered_stream_class_init   (ModestBufferedStreamClass *klass);
+static void  modest_buffered_stream_init         (ModestBufferedStream *obj);
+static void  modest_buffered_stream_finalize     (GObject *obj);
+
+static void  modest_buffered_stream_iface_init   (gpointer g_iface, gpointer iface_data);
+
+typedef struct _ModestBufferedStreamPrivate ModestBufferedStreamPrivate;
+struct _ModestBufferedStreamPrivate {
+	TnyStream *out_stream;
+	gchar     *buffer;
+	gsize      buffer_size;
+	gsize      buffer_len;
+	gsize      written;
+
+	ModestBufferedStreamProgressFunc progress_func;
+	gpointer   progress_data;
+};
+#define MODEST_BUFFERED_STREAM_GET_PRIVATE(o)      (G_TYPE_INSTANCE_GET_PRIVATE((o), \
+                                                    MODEST_TYPE_BUFFERED_STREAM, \
+                                                    ModestBufferedStreamPrivate))
+/* globals */
+static GObjectClass *parent_class = NULL;
+
+GType
+modest_buffered_stream_get_type (void)
+{
+	static GType my_type = 0;
+	if (!my_type) {
+		static const GTypeInfo my_info = {
+			sizeof(ModestBufferedStreamClass),
+			NULL,		/* base init */
+			NULL,		/* base finalize */
+			(GClassInitFunc) modest_buffered_stream_class_init,
+			NULL,		/* class finalize */
+			NULL,		/* class data */
+			sizeof(ModestBufferedStream),
+			1,		/* n_preallocs */
+			(GInstanceInitFunc) modest_buffered_stream_init,
+			NULL
+		};
+
+		static const GInterfaceInfo iface_info = {
+			(GInterfaceInitFunc) modest_buffered_stream_iface_init,
+			NULL,         /* interface_finalize */
+			NULL          /* interface_data */
+                };
+
+		my_type = g_type_register_static (G_TYPE_OBJECT,
+		                                  "ModestBufferedStream",
+		                                  &my_info, 0);
+
+		g_type_add_interface_static (my_type, TNY_TYPE_STREAM,
+					     &iface_info);
+	}
+	return my_type;
+}
+
+static void
+modest_buffered_stream_class_init (ModestBufferedStreamClass *klass)
+{
+	GObjectClass *gobject_class;
+	gobject_class = (GObjectClass*) klass;
+
+	parent_class            = g_type_class_peek_parent (klass);
+	gobject_class->finalize = modest_buffered_stream_finalize;
+
+	g_type_class_add_private (gobject_class, sizeof(ModestBufferedStreamPrivate));
+}
+
+static void
+modest_buffered_stream_init (ModestBufferedStream *obj)
+{
+	ModestBufferedStreamPrivate *priv;
+	priv = MODEST_BUFFERED_STREAM_GET_PRIVATE(obj);
+
+	priv->out_stream = NULL;
+	priv->buffer = NULL;
+	priv->buffer_size = 0;
+	priv->buffer_len = 0;
+	priv->written = 0;
+	priv->progress_func = NULL;
+	priv->progress_data = NULL;
+}
+
+static void
+modest_buffered_stream_finalize (GObject *obj)
+{
+	ModestBufferedStreamPrivate *priv;
+
+	priv = MODEST_BUFFERED_STREAM_GET_PRIVATE(obj);
+
+	/* Data not flushed at this point is discarded, the stream
+	   users are responsible of flushing or closing it */
+	if (priv->out_stream)
+		g_object_unref (priv->out_stream);
+	priv->out_stream = NULL;
+
+	g_free (priv->buffer);
+	priv->buffer = NULL;
+
+	G_OBJECT_CLASS(parent_class)->finalize (obj);
+}
+
+TnyStream*
+modest_buffered_stream_new (TnyStream *out_stream, gsize buffer_size)
+{
+	GObject *obj;
+	ModestBufferedStreamPrivate *priv;
+
+	g_return_val_if_fail (TNY_IS_STREAM (out_stream), NULL);
+
+	obj  = G_OBJECT(g_object_new(MODEST_TYPE_BUFFERED_STREAM, NULL));
+	priv = MODEST_BUFFERED_STREAM_GET_PRIVATE(obj);
+
+	priv->out_stream = g_object_ref (out_stream);
+	priv->buffer_size = (buffer_size > 0) ? buffer_size : MODEST_BUFFERED_STREAM_DEFAULT_SIZE;
+	priv->buffer = g_malloc (priv->buffer_size);
+
+	return TNY_STREAM (obj);
+}
+
+void
+modest_buffered_stream_set_progress_func (ModestBufferedStream *self,
+					  ModestBufferedStreamProgressFunc func,
+					  gpointer user_data)
+{
+	ModestBufferedStreamPrivate *priv;
+
+	g_return_if_fail (MODEST_IS_BUFFERED_STREAM (self));
+	priv = MODEST_BUFFERED_STREAM_GET_PRIVATE (self);
+
+	priv->progress_func = func;
+	priv->progress_data = user_data;
+}
+
+gsize
+modest_buffered_stream_get_written (ModestBufferedStream *self)
+{
+	g_return_val_if_fail (MODEST_IS_BUFFERED_STREAM (self), 0);
+
+	return MODEST_BUFFERED_STREAM_GET_PRIVATE (self)->written;
+}
+
+/* writes the whole buffer to the output stream. Returns FALSE in
+   case of error */
+static gboolean
+write_buffer (ModestBufferedStream *self)
+{
+	ModestBufferedStreamPrivate *priv = MODEST_BUFFERED_STREAM_GET_PRIVATE (self);
+	gchar *offset;
+	gsize pending_bytes;
+
+	if (priv->buffer_len == 0)
+		return TRUE;
+
+	offset = priv->buffer;
+	pending_bytes = priv->buffer_len;
+	while (pending_bytes > 0) {
+		gssize written_bytes;
+
+		written_bytes = tny_stream_write (priv->out_stream, offset, pending_bytes);
+		if (written_bytes <= 0)
+			return FALSE;
+		offset += written_bytes;
+		pending_bytes -= written_bytes;
+	}
+
+	priv->written += priv->buffer_len;
+	if (priv->progress_func)
+		priv->progress_func (self, priv->buffer_len, priv->written, priv->progress_data);
+	priv->buffer_len = 0;
+
+	return TRUE;
+}
+
+/* the rest are interface functions */
+
+static gssize
+buffered_stream_read (TnyStream *self, char *buffer, gsize n)
+{
+	return -1; /* we cannot read */
+}
+
+static gssize
+buffered_stream_write (TnyStream *self, const char *buffer, gsize n)
+{
+	ModestBufferedStreamPrivate *priv = MODEST_BUFFERED_STREAM_GET_PRIVATE (self);
+	gsize pending = n;
+
+	if (!priv->out_stream)
+		return -1;
+
+	while (pending > 0) {
+		gsize chunk;
+
+		chunk = MIN (pending, priv->buffer_size - priv->buffer_len);
+		memcpy (priv->buffer + priv->buffer_len, buffer, chunk);
+		priv->buffer_len += chunk;
+		buffer += chunk;
+		pending -= chunk;
+
+		if (priv->buffer_len == priv->buffer_size &&
+		    !write_buffer (MODEST_BUFFERED_STREAM (self)))
+			return -1;
+	}
+
+	return (gssize) n;
+}
+
+static gint
+buffered_stream_flush (TnyStream *self)
+{
+	ModestBufferedStreamPrivate *priv = MODEST_BUFFERED_STREAM_GET_PRIVATE (self);
+
+	if (!priv->out_stream)
+		return -1;
+
+	if (!write_buffer (MODEST_BUFFERED_STREAM (self)))
+		return -1;
+
+	return tny_stream_flush (priv->out_stream);
+}
+
+static gint
+buffered_stream_close (TnyStream *self)
+{
+	ModestBufferedStreamPrivate *priv = MODEST_BUFFERED_STREAM_GET_PRIVATE (self);
+	gint retval;
+
+	if (!priv->out_stream)
+		return -1;
+
+	retval = write_buffer (MODEST_BUFFERED_STREAM (self)) ? 0 : -1;
+	if (tny_stream_close (priv->out_stream) == -1)
+		retval = -1;
+
+	g_object_unref (priv->out_stream);
+	priv->out_stream = NULL;
+	priv->buffer_len = 0;
+
+	return retval;
+}
+
+static gboolean
+buffered_stream_is_eos (TnyStream *self)
+{
+	return TRUE;
+}
+
+static gint
+buffered_stream_reset (TnyStream *self)
+{
+	ModestBufferedStreamPrivate *priv = MODEST_BUFFERED_STREAM_GET_PRIVATE (self);
+
+	/* pending data would end up in the wrong place */
+	priv->buffer_len = 0;
+	priv->written = 0;
+
+	return priv->out_stream ? tny_stream_reset (priv->out_stream) : -1;
+}
+
+static gssize
+buffered_stream_write_to_stream (TnyStream *self, TnyStream *output)
+{
+	return -1; /* we cannot read */
+}
+
+static void
+modest_buffered_stream_iface_init (gpointer g_iface, gpointer iface_data)
+{
+	TnyStreamIface *klass;
+
+	g_return_if_fail (g_iface);
+
+	klass = (TnyStreamIface *) g_iface;
+
+	klass->read            = buffered_stream_read;
+	klass->write           = buffered_stream_write;
+	klass->flush           = buffered_stream_flush;
+	klass->close           = buffered_stream_close;
+	klass->is_eos          = buffered_stream_is_eos;
+	klass->reset           = buffered_stream_reset;
+	klass->write_to_stream = buffered_stream_write_to_stream;
+}
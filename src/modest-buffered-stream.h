@@ -0,0 +1,120 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* modest-buffered-stream.h */
+
+#ifndef __MODEST_BUFFERED_STREAM_H__
+#define __MODEST_BUFFERED_STREAM_H__
+
+#include <glib-object.h>
+#include <tny-stream.h>
+
+G_BEGIN_DECLS
+
+/* convenience macros */
+#define MODEST_TYPE_BUFFERED_STREAM             (modest_buffered_stream_get_type())
+#define MODEST_BUFFERED_STREAM(obj)             (G_TYPE_CHECK_INSTANCE_CAST((obj),MODEST_TYPE_BUFFERED_STREAM,ModestBufferedStream))
+#define MODEST_BUFFERED_STREAM_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST((klass),MODEST_TYPE_BUFFERED_STREAM,ModestBufferedStreamClass))
+#define MODEST_IS_BUFFERED_STREAM(obj)          (G_TYPE_CHECK_INSTANCE_TYPE((obj),MODEST_TYPE_BUFFERED_STREAM))
+#define MODEST_IS_BUFFERED_STREAM_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE((klass),MODEST_TYPE_BUFFERED_STREAM))
+#define MODEST_BUFFERED_STREAM_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS((obj),MODEST_TYPE_BUFFERED_STREAM,ModestBufferedStreamClass))
+
+/* default size of the write buffer, in bytes */
+#define MODEST_BUFFERED_STREAM_DEFAULT_SIZE (64 * 1024)
+
+typedef struct _ModestBufferedStream      ModestBufferedStream;
+typedef struct _ModestBufferedStreamClass ModestBufferedStreamClass;
+
+struct _ModestBufferedStream {
+	GObject parent;
+};
+
+struct _ModestBufferedStreamClass {
+	GObjectClass parent_class;
+};
+
+/**
+ * ModestBufferedStreamProgressFunc:
+ * @self: the #ModestBufferedStream
+ * @delta: number of bytes written to the output stream since the last call
+ * @total: total number of bytes written to the output stream
+ * @user_data: the user data passed to modest_buffered_stream_set_progress_func
+ *
+ * Called each time the buffer is flushed to the output stream. Note
+ * that it's called from the thread that writes into the stream, that
+ * is not necessarily the main loop.
+ */
+typedef void (*ModestBufferedStreamProgressFunc) (ModestBufferedStream *self,
+						  gsize delta,
+						  gsize total,
+						  gpointer user_data);
+
+GType       modest_buffered_stream_get_type    (void) G_GNUC_CONST;
+
+
+/**
+ * modest_buffered_stream_new:
+ * @out_stream: the #TnyStream the data will be written to
+ * @buffer_size: size of the write buffer, or 0 to use
+ * %MODEST_BUFFERED_STREAM_DEFAULT_SIZE
+ *
+ * creates a new write-only #TnyStream that accumulates data in a
+ * fixed-size buffer and writes it to @out_stream in chunks of
+ * @buffer_size bytes. Memory usage does not depend on the amount of
+ * data written through it.
+ *
+ * Returns: a new #TnyStream
+ **/
+TnyStream*  modest_buffered_stream_new         (TnyStream *out_stream, gsize buffer_size);
+
+/**
+ * modest_buffered_stream_set_progress_func:
+ * @self: a #ModestBufferedStream
+ * @func: a #ModestBufferedStreamProgressFunc, or %NULL
+ * @user_data: data to pass to @func
+ *
+ * sets the function that will be notified about the bytes written
+ * to the output stream
+ **/
+void        modest_buffered_stream_set_progress_func (ModestBufferedStream *self,
+						      ModestBufferedStreamProgressFunc func,
+						      gpointer user_data);
+
+/**
+ * modest_buffered_stream_get_written:
+ * @self: a #ModestBufferedStream
+ *
+ * Returns: the number of bytes written to the output stream so far
+ **/
+gsize       modest_buffered_stream_get_written (ModestBufferedStream *self);
+
+G_END_DECLS
+
+#endif /* __MODEST_BUFFERED_STREAM_H__ */
@@ -29,7 +29,7 @@
 
 #include <config.h>
 #include <modest-cache-mgr.h>
-#include <stdio.h>
+#include <string.h>
 
 /* 'private'/'protected' functions */
 static void modest_cache_mgr_class_init (ModestCacheMgrClass *klass);
@@ -42,12 +42,40 @@ enum {
 	LAST_SIGNAL
 };
 
+/* default budgets of the bounded caches, in bytes */
+#define DISPLAY_STRING_CACHE_BUDGET  (256 * 1024)
+#define PIXBUF_CACHE_BUDGET          (2 * 1024 * 1024)
+
+/* approximate overhead of every entry (hash node, list link, entry) */
+#define CACHE_ENTRY_OVERHEAD         (sizeof (CacheEntry) + sizeof (GList) + 4 * sizeof (gpointer))
+
+typedef struct {
+	gpointer  key;
+	gpointer  value;
+	gsize     size;
+	GList    *link;    /* our link in the lru queue */
+} CacheEntry;
+
+/* a size bounded cache with LRU eviction */
+typedef struct {
+	GHashTable     *entries;    /* key => CacheEntry */
+	GQueue         *lru;        /* CacheEntry, most recently used first */
+	GDestroyNotify  key_free;
+	GDestroyNotify  value_free;
+	gpointer      (*key_copy)   (gconstpointer key);
+	gpointer      (*value_copy) (gconstpointer value);
+	gsize           bytes;
+	gsize           budget;
+	guint           hits;
+	guint           misses;
+	guint           evictions;
+} BoundedCache;
+
 typedef struct _ModestCacheMgrPrivate ModestCacheMgrPrivate;
 struct _ModestCacheMgrPrivate {
-	GHashTable *date_str_cache;
-	GHashTable *display_str_cache;
-	GHashTable *pixbuf_cache;
-	GHashTable *send_queue_cache;
+	BoundedCache *display_str_cache;
+	BoundedCache *pixbuf_cache;
+	GHashTable   *send_queue_cache;
 };
 #define MODEST_CACHE_MGR_GET_PRIVATE(o)      (G_TYPE_INSTANCE_GET_PRIVATE((o), \
                                               MODEST_TYPE_CACHE_MGR, \
@@ -102,6 +130,78 @@ void my_object_unref (GObject *obj)
 		g_object_unref (obj);
 }
 
+static gpointer
+my_object_ref (gconstpointer obj)
+{
+	return obj ? g_object_ref ((gpointer) obj) : NULL;
+}
+
+static gpointer
+my_strdup (gconstpointer str)
+{
+	return g_strdup ((const gchar *) str);
+}
+
+static BoundedCache*
+bounded_cache_new (GHashFunc hash_func, GEqualFunc equal_func,
+		   gpointer (*key_copy) (gconstpointer), GDestroyNotify key_free,
+		   gpointer (*value_copy) (gconstpointer), GDestroyNotify value_free,
+		   gsize budget)
+{
+	BoundedCache *cache;
+
+	cache = g_slice_new0 (BoundedCache);
+	/* the entries own the keys and the values, see entry_free */
+	cache->entries    = g_hash_table_new (hash_func, equal_func);
+	cache->lru        = g_queue_new ();
+	cache->key_copy   = key_copy;
+	cache->key_free   = key_free;
+	cache->value_copy = value_copy;
+	cache->value_free = value_free;
+	cache->budget     = budget;
+
+	return cache;
+}
+
+static void
+bounded_cache_remove_entry (BoundedCache *cache, CacheEntry *entry)
+{
+	g_hash_table_remove (cache->entries, entry->key);
+	g_queue_delete_link (cache->lru, entry->link);
+	cache->bytes -= entry->size;
+
+	if (cache->key_free)
+		cache->key_free (entry->key);
+	if (cache->value_free)
+		cache->value_free (entry->value);
+	g_slice_free (CacheEntry, entry);
+}
+
+static void
+bounded_cache_evict (BoundedCache *cache, gsize budget)
+{
+	while (cache->bytes > budget && !g_queue_is_empty (cache->lru)) {
+		bounded_cache_remove_entry (cache, (CacheEntry *) g_queue_peek_tail (cache->lru));
+		cache->evictions++;
+	}
+}
+
+static void
+bounded_cache_flush (BoundedCache *cache)
+{
+	while (!g_queue_is_empty (cache->lru))
+		bounded_cache_remove_entry (cache, (CacheEntry *) g_queue_peek_tail (cache->lru));
+}
+
+static void
+bounded_cache_free (BoundedCache *cache)
+{
+	bounded_cache_flush (cache);
+	g_hash_table_destroy (cache->entries);
+	g_queue_free (cache->lru);
+	g_slice_free (BoundedCache, cache);
+}
+
 static void
 modest_cache_mgr_init (ModestCacheMgr *obj)
 {
@@ -109,21 +209,22 @@ modest_cache_mgr_init (ModestCacheMgr *obj)
 
  	priv = MODEST_CACHE_MGR_GET_PRIVATE(obj);
 	
-	priv->date_str_cache =
-		g_hash_table_new_full (g_int_hash,  /* time_t */
-				       g_int_equal,
-				       NULL,        /* int -> no need to free */
-				       g_free);     /* gchar* */
 	priv->display_str_cache =
-		g_hash_table_new_full (g_str_hash,  /* gchar* */
-				       g_str_equal,
-				       g_free,      /* gchar* */
-				       g_free);     /* gchar* */
+		bounded_cache_new (g_str_hash,       /* gchar* */
+				   g_str_equal,
+				   my_strdup,
+				   g_free,           /* gchar* */
+				   my_strdup,
+				   g_free,           /* gchar* */
+				   DISPLAY_STRING_CACHE_BUDGET);
 	priv->pixbuf_cache =
-		g_hash_table_new_full (g_str_hash,   /* gchar* */
-				       g_str_equal,  
-				       g_free,       /* gchar*/
-				       (GDestroyNotify)my_object_unref);
+		bounded_cache_new (g_str_hash,       /* gchar* */
+				   g_str_equal,
+				   my_strdup,
+				   g_free,           /* gchar* */
+				   my_object_ref,
+				   (GDestroyNotify) my_object_unref,
+				   PIXBUF_CACHE_BUDGET);
 	priv->send_queue_cache =
 		g_hash_table_new_full (g_direct_hash,   /* ptr */
 				       g_direct_equal,  
@@ -135,15 +236,13 @@ modest_cache_mgr_init (ModestCacheMgr *obj)
 static void
 modest_cache_mgr_finalize (GObject *obj)
 {
-	ModestCacheMgr *self;
-	self = MODEST_CACHE_MGR(obj);
-	
 	ModestCacheMgrPrivate *priv;
  	priv = MODEST_CACHE_MGR_GET_PRIVATE(obj);
 	
-	modest_cache_mgr_flush_all (self);
+	bounded_cache_free (priv->display_str_cache);
+	bounded_cache_free (priv->pixbuf_cache);
+	g_hash_table_destroy (priv->send_queue_cache);
 
-	priv->date_str_cache    = NULL;
 	priv->display_str_cache = NULL;
 	priv->pixbuf_cache      = NULL;
 	priv->send_queue_cache  = NULL;
@@ -151,20 +250,31 @@ modest_cache_mgr_finalize (GObject *obj)
 	G_OBJECT_CLASS(parent_class)->finalize (obj);
 }
 
-static GHashTable*
-get_cache (ModestCacheMgrPrivate *priv, ModestCacheMgrCacheType type)
+static BoundedCache*
+get_bounded_cache (ModestCacheMgrPrivate *priv, ModestCacheMgrCacheType type)
 {
 	switch (type) {
-	case MODEST_CACHE_MGR_CACHE_TYPE_DATE_STRING:
-		return priv->date_str_cache;
 	case MODEST_CACHE_MGR_CACHE_TYPE_DISPLAY_STRING:
 		return priv->display_str_cache;
 	case MODEST_CACHE_MGR_CACHE_TYPE_PIXBUF:
 		return priv->pixbuf_cache;
+	default:
+		return NULL;
+	}
+}
+
+static const gchar*
+get_cache_name (ModestCacheMgrCacheType type)
+{
+	switch (type) {
+	case MODEST_CACHE_MGR_CACHE_TYPE_DISPLAY_STRING:
+		return "display-string";
+	case MODEST_CACHE_MGR_CACHE_TYPE_PIXBUF:
+		return "pixbuf";
 	case MODEST_CACHE_MGR_CACHE_TYPE_SEND_QUEUE:
-		return priv->send_queue_cache;	
+		return "send-queue";
 	default:
-		g_return_val_if_reached(NULL); /* should not happen */
+		g_return_val_if_reached (NULL); /* should not happen */
 	}
 }
 
@@ -180,20 +290,112 @@ GHashTable*
 modest_cache_mgr_get_cache   (ModestCacheMgr* self, ModestCacheMgrCacheType type)
 {
 	ModestCacheMgrPrivate *priv;
-	GHashTable *cache;
 	
 	g_return_val_if_fail (self, NULL);
+	g_return_val_if_fail (type >= 0 && type < MODEST_CACHE_MGR_CACHE_TYPE_NUM, NULL);
+
+	priv  = MODEST_CACHE_MGR_GET_PRIVATE(self);
+
+	/* the bounded caches must be accessed through lookup/insert,
+	   otherwise we could not keep track of their size */
+	g_return_val_if_fail (type == MODEST_CACHE_MGR_CACHE_TYPE_SEND_QUEUE, NULL);
 	
-	if (!(type >= 0 && type <= MODEST_CACHE_MGR_CACHE_TYPE_NUM)) {
-		printf ("DEBUG: %s: incorrect type = %d\n", __FUNCTION__, type);	
+	return priv->send_queue_cache;
+}
+
+
+gpointer
+modest_cache_mgr_lookup (ModestCacheMgr *self,
+			 ModestCacheMgrCacheType type,
+			 gconstpointer key)
+{
+	ModestCacheMgrPrivate *priv;
+	BoundedCache *cache;
+	CacheEntry *entry;
+
+	g_return_val_if_fail (self, NULL);
+
+	priv  = MODEST_CACHE_MGR_GET_PRIVATE(self);
+	cache = get_bounded_cache (priv, type);
+	g_return_val_if_fail (cache, NULL);
+
+	entry = (CacheEntry *) g_hash_table_lookup (cache->entries, key);
+	if (!entry) {
+		cache->misses++;
+		return NULL;
 	}
-	
-	g_return_val_if_fail (type >= 0 && type <= MODEST_CACHE_MGR_CACHE_TYPE_NUM, NULL);
+
+	/* move it to the head, it's the most recently used now */
+	cache->hits++;
+	if (entry->link != cache->lru->head) {
+		g_queue_unlink (cache->lru, entry->link);
+		g_queue_push_head_link (cache->lru, entry->link);
+	}
+
+	return entry->value;
+}
+
+
+void
+modest_cache_mgr_insert (ModestCacheMgr *self,
+			 ModestCacheMgrCacheType type,
+			 gconstpointer key,
+			 gconstpointer value,
+			 gsize size)
+{
+	ModestCacheMgrPrivate *priv;
+	BoundedCache *cache;
+	CacheEntry *entry;
+
+	g_return_if_fail (self);
+	g_return_if_fail (value);
 
 	priv  = MODEST_CACHE_MGR_GET_PRIVATE(self);
-	
-	cache = get_cache (priv, type);
-	return cache;
+	cache = get_bounded_cache (priv, type);
+	g_return_if_fail (cache);
+
+	entry = (CacheEntry *) g_hash_table_lookup (cache->entries, key);
+	if (entry)
+		bounded_cache_remove_entry (cache, entry);
+
+	size += CACHE_ENTRY_OVERHEAD;
+
+	/* do not let a single huge entry flush the whole cache */
+	if (cache->budget && size > cache->budget)
+		return;
+
+	entry = g_slice_new (CacheEntry);
+	entry->key   = cache->key_copy (key);
+	entry->value = cache->value_copy (value);
+	entry->size  = size;
+	g_queue_push_head (cache->lru, entry);
+	entry->link  = cache->lru->head;
+
+	g_hash_table_insert (cache->entries, entry->key, entry);
+	cache->bytes += size;
+
+	if (cache->budget)
+		bounded_cache_evict (cache, cache->budget);
+}
+
+
+void
+modest_cache_mgr_set_budget (ModestCacheMgr *self,
+			     ModestCacheMgrCacheType type,
+			     gsize budget)
+{
+	ModestCacheMgrPrivate *priv;
+	BoundedCache *cache;
+
+	g_return_if_fail (self);
+
+	priv  = MODEST_CACHE_MGR_GET_PRIVATE(self);
+	cache = get_bounded_cache (priv, type);
+	g_return_if_fail (cache);
+
+	cache->budget = budget;
+	if (budget)
+		bounded_cache_evict (cache, budget);
 }
 
 
@@ -201,16 +403,21 @@ void
 modest_cache_mgr_flush (ModestCacheMgr *self, ModestCacheMgrCacheType type)
 {
 	ModestCacheMgrPrivate *priv;
-	GHashTable *cache;
+	BoundedCache *cache;
 	
 	g_return_if_fail (self);
-	g_return_if_fail (type >= 0 && type <= MODEST_CACHE_MGR_CACHE_TYPE_NUM);
+	g_return_if_fail (type >= 0 && type < MODEST_CACHE_MGR_CACHE_TYPE_NUM);
 	
 	priv  = MODEST_CACHE_MGR_GET_PRIVATE(self);
 
-	cache = get_cache (priv, type);
-	if (cache)
-		g_hash_table_destroy (cache);
+	/* we only remove the contents, as the cache could be used
+	   again afterwards */
+	if (type == MODEST_CACHE_MGR_CACHE_TYPE_SEND_QUEUE) {
+		g_hash_table_remove_all (priv->send_queue_cache);
+	} else {
+		cache = get_bounded_cache (priv, type);
+		bounded_cache_flush (cache);
+	}
 }
 
 
@@ -225,17 +432,87 @@ modest_cache_mgr_flush_all (ModestCacheMgr *self)
 }
 
 
-guint
-modest_cache_mgr_get_size (ModestCacheMgr *self, ModestCacheMgrCacheType type)
+void
+modest_cache_mgr_on_memory_low (ModestCacheMgr *self)
 {
 	ModestCacheMgrPrivate *priv;
-	GHashTable *cache;
-	
+	int i;
+
+	g_return_if_fail (self);
+
 	priv = MODEST_CACHE_MGR_GET_PRIVATE(self);
 
+	/* the send queues are not just a cache, we can not drop
+	   them, so we only release the bounded caches */
+	for (i = 0; i != MODEST_CACHE_MGR_CACHE_TYPE_NUM; ++i) {
+		BoundedCache *cache = get_bounded_cache (priv, i);
+		if (cache)
+			bounded_cache_evict (cache, 0);
+	}
+}
+
+
+guint
+modest_cache_mgr_get_size (ModestCacheMgr *self, ModestCacheMgrCacheType type)
+{
+	ModestCacheMgrStats stats;
+
 	g_return_val_if_fail (self, 0);
-	g_return_val_if_fail (type >= 0 && type <= MODEST_CACHE_MGR_CACHE_TYPE_NUM, 0);
+	g_return_val_if_fail (type >= 0 && type < MODEST_CACHE_MGR_CACHE_TYPE_NUM, 0);
+
+	modest_cache_mgr_get_stats (self, type, &stats);
+	return stats.entries;
+}
+
+
+void
+modest_cache_mgr_get_stats (ModestCacheMgr *self,
+			    ModestCacheMgrCacheType type,
+			    ModestCacheMgrStats *stats)
+{
+	ModestCacheMgrPrivate *priv;
+	BoundedCache *cache;
+
+	g_return_if_fail (self);
+	g_return_if_fail (stats);
+	g_return_if_fail (type >= 0 && type < MODEST_CACHE_MGR_CACHE_TYPE_NUM);
+
+	memset (stats, 0, sizeof (ModestCacheMgrStats));
+	priv  = MODEST_CACHE_MGR_GET_PRIVATE(self);
+
+	cache = get_bounded_cache (priv, type);
+	if (cache) {
+		stats->entries   = g_hash_table_size (cache->entries);
+		stats->bytes     = cache->bytes;
+		stats->budget    = cache->budget;
+		stats->hits      = cache->hits;
+		stats->misses    = cache->misses;
+		stats->evictions = cache->evictions;
+	} else {
+		stats->entries   = g_hash_table_size (priv->send_queue_cache);
+	}
+}
+
+
+gchar*
+modest_cache_mgr_to_string (ModestCacheMgr *self)
+{
+	GString *str;
+	int i;
+
+	g_return_val_if_fail (self, NULL);
+
+	str = g_string_new ("");
+	for (i = 0; i != MODEST_CACHE_MGR_CACHE_TYPE_NUM; ++i) {
+		ModestCacheMgrStats stats;
+
+		modest_cache_mgr_get_stats (self, i, &stats);
+		g_string_append_printf (str,
+					"%s: %u entries, %" G_GSIZE_FORMAT "/%" G_GSIZE_FORMAT
+					" bytes, %u hits, %u misses, %u evictions\n",
+					get_cache_name (i), stats.entries, stats.bytes,
+					stats.budget, stats.hits, stats.misses, stats.evictions);
+	}
 
-	cache = get_cache (priv, type);
-	return cache ? g_hash_table_size (cache) : 0;
+	return g_string_free (str, FALSE);
 }
@@ -58,14 +58,25 @@ struct _ModestCacheMgrClass {
  * the caches managed by this class
  */
 typedef enum {
-	MODEST_CACHE_MGR_CACHE_TYPE_DATE_STRING,       /* time_t => string */
-	MODEST_CACHE_MGR_CACHE_TYPE_DISPLAY_STRING,    /* gchar* => gchar* */
-	MODEST_CACHE_MGR_CACHE_TYPE_PIXBUF,            /* gchar* => GdkPixbuf */
+	MODEST_CACHE_MGR_CACHE_TYPE_DISPLAY_STRING,    /* recipients => display string */
+	MODEST_CACHE_MGR_CACHE_TYPE_PIXBUF,            /* "icon-name:size" => GdkPixbuf */
 	MODEST_CACHE_MGR_CACHE_TYPE_SEND_QUEUE,        /* TnyAccount* => TnySendQueue* */
 
 	MODEST_CACHE_MGR_CACHE_TYPE_NUM
 } ModestCacheMgrCacheType;
 
+/*
+ * statistics of a cache
+ */
+typedef struct {
+	guint entries;      /* number of [key,value]-pairs */
+	gsize bytes;        /* estimated size of the entries */
+	gsize budget;       /* max bytes, 0 means unbounded */
+	guint hits;
+	guint misses;
+	guint evictions;
+} ModestCacheMgrStats;
+
 
 /**
  * modest_cache_mgr_get_type:
@@ -91,14 +102,66 @@ ModestCacheMgr*    modest_cache_mgr_new          (void);
  * @self: a valid cache mgr obj
  * @type: a valid cache mgr cache type
  * 
- * get the cache (GHashTable) of the requested type
+ * get the cache (GHashTable) of the requested type. Only the
+ * unbounded caches (MODEST_CACHE_MGR_CACHE_TYPE_SEND_QUEUE) can be
+ * accessed this way, use modest_cache_mgr_lookup and
+ * modest_cache_mgr_insert for the others
  * 
- * Returns: the requested cache (GHashTable)  
- * the returned  hashtable should NOT be destroyed or unref'd.
+ * Returns: the requested cache (GHashTable), or NULL if the cache is
+ * a bounded one. The returned hashtable should NOT be destroyed or
+ * unref'd.
  */
 GHashTable*     modest_cache_mgr_get_cache    (ModestCacheMgr* self, ModestCacheMgrCacheType type);
 
 
+/**
+ * modest_cache_mgr_lookup:
+ * @self: a valid cache mgr obj
+ * @type: a bounded cache type
+ * @key: the key, a string
+ *
+ * looks for @key in the cache, and marks it as the most recently
+ * used entry
+ *
+ * Returns: the value, or NULL if it's not in the cache. It's owned
+ * by the cache, so ref or copy it if you want to keep it. It should
+ * be used from the main loop
+ */
+gpointer        modest_cache_mgr_lookup       (ModestCacheMgr *self,
+					       ModestCacheMgrCacheType type,
+					       gconstpointer key);
+
+/**
+ * modest_cache_mgr_insert:
+ * @self: a valid cache mgr obj
+ * @type: a bounded cache type
+ * @key: the key, see modest_cache_mgr_lookup
+ * @value: the value, a string or a #GdkPixbuf depending on @type
+ * @size: the approximate size of @value in bytes
+ *
+ * inserts a copy of @key and a reference to (or a copy of) @value
+ * in the cache, replacing the former value. The least recently used
+ * entries are evicted if the budget of the cache is exceeded
+ */
+void            modest_cache_mgr_insert       (ModestCacheMgr *self,
+					       ModestCacheMgrCacheType type,
+					       gconstpointer key,
+					       gconstpointer value,
+					       gsize size);
+
+/**
+ * modest_cache_mgr_set_budget:
+ * @self: a valid cache mgr obj
+ * @type: a bounded cache type
+ * @budget: the max number of bytes, or 0 for no limit
+ *
+ * sets the budget of the cache. Entries are evicted if it's smaller
+ * than the current size
+ */
+void            modest_cache_mgr_set_budget   (ModestCacheMgr *self,
+					       ModestCacheMgrCacheType type,
+					       gsize budget);
+
 /**
  * modest_cache_mgr_flush
  * @self: a valid cache mgr obj
@@ -118,6 +181,16 @@ void            modest_cache_mgr_flush        (ModestCacheMgr *self, ModestCache
 void            modest_cache_mgr_flush_all    (ModestCacheMgr *self);
 
 
+/**
+ * modest_cache_mgr_on_memory_low
+ * @self: a valid cache mgr obj
+ *
+ * releases the contents of all the bounded caches. It should be
+ * called whenever we detect that the device is running out of memory
+ */
+void            modest_cache_mgr_on_memory_low (ModestCacheMgr *self);
+
+
 /**
  * modest_cache_mgr_get_size
  * @self: a valid cache mgr obj
@@ -129,6 +202,30 @@ void            modest_cache_mgr_flush_all    (ModestCacheMgr *self);
  */
 guint           modest_cache_mgr_get_size     (ModestCacheMgr *self, ModestCacheMgrCacheType type);
 
+/**
+ * modest_cache_mgr_get_stats
+ * @self: a valid cache mgr obj
+ * @type: a valid cache mgr cache type
+ * @stats: a #ModestCacheMgrStats to fill
+ *
+ * get the usage statistics of the cache. For the unbounded caches
+ * only the number of entries is available
+ */
+void            modest_cache_mgr_get_stats    (ModestCacheMgr *self,
+					       ModestCacheMgrCacheType type,
+					       ModestCacheMgrStats *stats);
+
+/**
+ * modest_cache_mgr_to_string:
+ * @self: a valid cache mgr obj
+ *
+ * Returns a string representation of the statistics of all the
+ * caches (for debugging)
+ *
+ * Returns: a newly allocated string
+ */
+gchar*          modest_cache_mgr_to_string    (ModestCacheMgr *self);
+
 G_END_DECLS
 
 #endif /* __MODEST_CACHE_MGR_H__ */
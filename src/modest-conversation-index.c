@@ -0,0 +1,915 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include <tny-account-store.h>
+#include "modest-defs.h"
+#include "modest-runtime.h"
+#include "modest-text-utils.h"
+#include "modest-tny-msg.h"
+#include "modest-conversation-index.h"
+
+/* 'private'/'protected' functions */
+static void modest_conversation_index_class_init (ModestConversationIndexClass *klass);
+static void modest_conversation_index_init       (ModestConversationIndex *obj);
+static void modest_conversation_index_finalize   (GObject *obj);
+
+/* The threads are the sets of a union-find forest of messages. The
+   nodes are created for the seen messages and for the ones that are
+   only referenced by them, as they could link messages that do not
+   reference each other */
+typedef struct _ThreadNode ThreadNode;
+struct _ThreadNode {
+	gchar      *msgid;
+	ThreadNode *parent;  /* itself in the root of the thread */
+	guint       seq;     /* creation order, to break the ties */
+	gboolean    seen;    /* FALSE if it's only referenced */
+	gboolean    linked;  /* its references are known */
+	time_t      date;
+	ThreadNode *subject_anchor; /* the message it was threaded with
+				       by subject, until its references
+				       are known */
+
+	/* only valid in the root of the thread */
+	ThreadNode *first;   /* the oldest seen message */
+	guint       count;   /* the number of seen messages */
+	gboolean    by_subject; /* some messages joined it by subject */
+};
+
+/* A link learnt from the references, "node replies to parent". They
+   are kept to thread the messages again when a thread by subject
+   was wrong, as a union-find forest cannot split a thread */
+typedef struct {
+	ThreadNode *node;
+	ThreadNode *parent;
+} ThreadLink;
+
+/* The first message seen with a subject, and whether any message
+   seen with it was a reply */
+typedef struct {
+	ThreadNode *node;
+	gboolean    replied;
+} SubjectEntry;
+
+typedef struct _ModestConversationIndexPrivate ModestConversationIndexPrivate;
+struct _ModestConversationIndexPrivate {
+	gchar      *url;
+	gchar      *filename;
+	GHashTable *nodes;     /* msgid => ThreadNode */
+	GHashTable *subjects;  /* casefolded subject without prefixes => SubjectEntry */
+	GArray     *links;     /* ThreadLink */
+	guint       next_seq;
+};
+#define MODEST_CONVERSATION_INDEX_GET_PRIVATE(o)      (G_TYPE_INSTANCE_GET_PRIVATE((o), \
+                                                       MODEST_TYPE_CONVERSATION_INDEX, \
+                                                       ModestConversationIndexPrivate))
+
+enum {
+	THREADS_CHANGED_SIGNAL,
+	LAST_SIGNAL
+};
+
+/* globals */
+static GObjectClass *parent_class = NULL;
+
+static guint signals[LAST_SIGNAL] = {0};
+
+/* folder URL => ModestConversationIndex, weak references */
+static GHashTable *indexes = NULL;
+
+/* the msgid of the headers is cached in the headers themselves, as
+   the sort functions need it for every comparison */
+static GQuark msgid_quark = 0;
+
+GType
+modest_conversation_index_get_type (void)
+{
+	static GType my_type = 0;
+	if (!my_type) {
+		static const GTypeInfo my_info = {
+			sizeof(ModestConversationIndexClass),
+			NULL,		/* base init */
+			NULL,		/* base finalize */
+			(GClassInitFunc) modest_conversation_index_class_init,
+			NULL,		/* class finalize */
+			NULL,		/* class data */
+			sizeof(ModestConversationIndex),
+			0,		/* n_preallocs */
+			(GInstanceInitFunc) modest_conversation_index_init,
+			NULL
+		};
+
+		my_type = g_type_register_static (G_TYPE_OBJECT,
+		                                  "ModestConversationIndex",
+		                                  &my_info, 0);
+	}
+	return my_type;
+}
+
+static void
+modest_conversation_index_class_init (ModestConversationIndexClass *klass)
+{
+	GObjectClass *gobject_class;
+	gobject_class = (GObjectClass*) klass;
+
+	parent_class            = g_type_class_peek_parent (klass);
+	gobject_class->finalize = modest_conversation_index_finalize;
+
+	g_type_class_add_private (gobject_class, sizeof(ModestConversationIndexPrivate));
+
+	msgid_quark = g_quark_from_static_string ("modest-conversation-index-msgid");
+
+	/**
+	 * ModestConversationIndex::threads-changed
+	 * @self: the #ModestConversationIndex that emits the signal
+	 *
+	 * Emitted when the threads of messages that were already
+	 * added change their order, for example when two threads are
+	 * merged, or when a message threaded by subject is threaded
+	 * again by its references. The handlers should sort the
+	 * messages again
+	 */
+	signals[THREADS_CHANGED_SIGNAL] =
+		g_signal_new ("threads_changed",
+			      G_TYPE_FROM_CLASS (gobject_class),
+			      G_SIGNAL_RUN_FIRST,
+			      G_STRUCT_OFFSET (ModestConversationIndexClass, threads_changed),
+			      NULL, NULL,
+			      g_cclosure_marshal_VOID__VOID,
+			      G_TYPE_NONE, 0);
+}
+
+static void
+thread_node_free (ThreadNode *node)
+{
+	g_free (node->msgid);
+	g_slice_free (ThreadNode, node);
+}
+
+static void
+subject_entry_free (SubjectEntry *entry)
+{
+	g_slice_free (SubjectEntry, entry);
+}
+
+static void
+modest_conversation_index_init (ModestConversationIndex *obj)
+{
+	ModestConversationIndexPrivate *priv;
+
+	priv = MODEST_CONVERSATION_INDEX_GET_PRIVATE(obj);
+
+	priv->url = NULL;
+	priv->filename = NULL;
+	priv->nodes = g_hash_table_new_full (g_str_hash, g_str_equal,
+					     NULL, /* the key is owned by the node */
+					     (GDestroyNotify) thread_node_free);
+	priv->subjects = g_hash_table_new_full (g_str_hash, g_str_equal,
+						g_free,
+						(GDestroyNotify) subject_entry_free);
+	priv->links = g_array_new (FALSE, FALSE, sizeof (ThreadLink));
+	priv->next_seq = 0;
+}
+
+static void
+modest_conversation_index_finalize (GObject *obj)
+{
+	ModestConversationIndexPrivate *priv;
+
+	priv = MODEST_CONVERSATION_INDEX_GET_PRIVATE(obj);
+
+	if (indexes && priv->url)
+		g_hash_table_remove (indexes, priv->url);
+
+	g_array_free (priv->links, TRUE);
+	g_hash_table_destroy (priv->subjects);
+	g_hash_table_destroy (priv->nodes);
+	g_free (priv->filename);
+	g_free (priv->url);
+
+	G_OBJECT_CLASS(parent_class)->finalize (obj);
+}
+
+/* Returns the message id without the angle brackets and the blank
+   spaces, or NULL if it's empty */
+static gchar *
+normalize_msgid (const gchar *msgid, gsize len)
+{
+	const gchar *end;
+
+	end = msgid + len;
+	while (msgid < end && (g_ascii_isspace (*msgid) || *msgid == '<'))
+		msgid++;
+	while (end > msgid && (g_ascii_isspace (end[-1]) || end[-1] == '>'))
+		end--;
+
+	return (end > msgid) ? g_strndup (msgid, end - msgid) : NULL;
+}
+
+/* Appends to @ids the message ids of a References or In-Reply-To
+   header, in order. The ids are usually enclosed in angle brackets,
+   but some mailers only separate them with blank spaces */
+static void
+parse_msgids (const gchar *value, GPtrArray *ids)
+{
+	const gchar *start, *end;
+	gchar *id;
+
+	if (!value)
+		return;
+
+	if (strchr (value, '<')) {
+		while ((start = strchr (value, '<')) && (end = strchr (start, '>'))) {
+			id = normalize_msgid (start, end - start);
+			if (id)
+				g_ptr_array_add (ids, id);
+			value = end + 1;
+		}
+	} else {
+		while (*value) {
+			while (g_ascii_isspace (*value))
+				value++;
+			end = value;
+			while (*end && !g_ascii_isspace (*end))
+				end++;
+			id = normalize_msgid (value, end - value);
+			if (id)
+				g_ptr_array_add (ids, id);
+			value = end;
+		}
+	}
+}
+
+/* Returns the key of @header in the index, its message id or its
+   uid if it has none */
+static gchar *
+get_header_msgid (TnyHeader *header)
+{
+	gchar *value, *msgid;
+
+	value = tny_header_dup_message_id (header);
+	msgid = value ? normalize_msgid (value, strlen (value)) : NULL;
+	g_free (value);
+
+	if (!msgid) {
+		value = tny_header_dup_uid (header);
+		msgid = g_strconcat ("uid:", value ? value : "", NULL);
+		g_free (value);
+	}
+
+	return msgid;
+}
+
+static ThreadNode *
+get_node (ModestConversationIndexPrivate *priv, const gchar *msgid)
+{
+	ThreadNode *node;
+
+	node = g_hash_table_lookup (priv->nodes, msgid);
+	if (!node) {
+		node = g_slice_new0 (ThreadNode);
+		node->msgid = g_strdup (msgid);
+		node->parent = node;
+		node->seq = priv->next_seq++;
+		g_hash_table_insert (priv->nodes, node->msgid, node);
+	}
+
+	return node;
+}
+
+/* Path halving keeps the trees flat, so this is almost constant
+   time */
+static ThreadNode *
+find_thread (ThreadNode *node)
+{
+	while (node->parent != node) {
+		node->parent = node->parent->parent;
+		node = node->parent;
+	}
+	return node;
+}
+
+/* The same without halving the path, for the functions that must
+   not modify the index, like the sort function. The union by size
+   keeps the trees shallow anyway */
+static ThreadNode *
+get_thread (ThreadNode *node)
+{
+	while (node->parent != node)
+		node = node->parent;
+	return node;
+}
+
+static ThreadNode *
+older_node (ThreadNode *a, ThreadNode *b)
+{
+	if (!a)
+		return b;
+	if (!b)
+		return a;
+	if (a->date != b->date)
+		return (a->date < b->date) ? a : b;
+	return (a->seq < b->seq) ? a : b;
+}
+
+/* Merges the threads of @a and @b. @adding is the message being
+   added, if any, whose position does not matter yet. Returns TRUE
+   if the order of the messages already compared changed, which
+   happens when the first message of one of the threads is not the
+   first one of the merged thread */
+static gboolean
+merge_threads (ThreadNode *a, ThreadNode *b, ThreadNode *adding)
+{
+	ThreadNode *ra, *rb, *first;
+	guint placed_a, placed_b;
+	gboolean changed;
+
+	ra = find_thread (a);
+	rb = find_thread (b);
+	if (ra == rb)
+		return FALSE;
+
+	placed_a = ra->count - ((adding && find_thread (adding) == ra) ? 1 : 0);
+	placed_b = rb->count - ((adding && find_thread (adding) == rb) ? 1 : 0);
+	first = older_node (ra->first, rb->first);
+	changed = (placed_a > 0 && ra->first != first) ||
+		(placed_b > 0 && rb->first != first);
+
+	/* The bigger thread is kept as root */
+	if (rb->count > ra->count || (rb->count == ra->count && rb->seq < ra->seq)) {
+		ThreadNode *tmp = ra;
+		ra = rb;
+		rb = tmp;
+	}
+	rb->parent = ra;
+	ra->count += rb->count;
+	ra->first = first;
+	ra->by_subject = ra->by_subject || rb->by_subject;
+
+	return changed;
+}
+
+static void
+reset_node (gpointer key, gpointer value, gpointer user_data)
+{
+	ThreadNode *node = (ThreadNode *) value;
+
+	node->parent = node;
+	node->first = node->seen ? node : NULL;
+	node->count = node->seen ? 1 : 0;
+	node->by_subject = FALSE;
+}
+
+static void
+link_by_subject (gpointer key, gpointer value, gpointer user_data)
+{
+	ThreadNode *node = (ThreadNode *) value;
+
+	if (node->subject_anchor) {
+		merge_threads (node, node->subject_anchor, NULL);
+		find_thread (node)->by_subject = TRUE;
+	}
+}
+
+/* Threads all the messages again from the links and the threads by
+   subject that are still valid. It's only needed when a message
+   threaded by subject turns out to reply to another thread */
+static void
+rethread (ModestConversationIndexPrivate *priv)
+{
+	guint i;
+
+	g_hash_table_foreach (priv->nodes, reset_node, NULL);
+	for (i = 0; i < priv->links->len; i++) {
+		ThreadLink *thread_link = &g_array_index (priv->links, ThreadLink, i);
+		merge_threads (thread_link->node, thread_link->parent, NULL);
+	}
+	g_hash_table_foreach (priv->nodes, link_by_subject, NULL);
+}
+
+/* Links the message @msgid with the one it replies to. Returns TRUE
+   if the link is new, that is, if both messages were not in the
+   same thread through their references already */
+static gboolean
+add_link (ModestConversationIndexPrivate *priv,
+	  const gchar *msgid,
+	  const gchar *parent_msgid,
+	  gboolean *changed)
+{
+	ThreadNode *node, *parent, *root;
+	ThreadLink new_link;
+	gboolean wrong_subject = FALSE;
+
+	node = get_node (priv, msgid);
+	parent = get_node (priv, parent_msgid);
+	node->linked = TRUE;
+
+	/* The thread by subject was a guess, that is right if it
+	   replies to the message it was threaded with */
+	if (node->subject_anchor) {
+		wrong_subject = (node->subject_anchor != parent);
+		node->subject_anchor = NULL;
+	}
+
+	/* The threads joined by subject could be split later, so
+	   they don't make a link redundant */
+	root = find_thread (node);
+	if (!wrong_subject && root == find_thread (parent) && !root->by_subject)
+		return FALSE;
+
+	new_link.node = node;
+	new_link.parent = parent;
+	g_array_append_val (priv->links, new_link);
+
+	if (wrong_subject) {
+		rethread (priv);
+		if (changed)
+			*changed = TRUE;
+	} else if (merge_threads (node, parent, NULL) && changed) {
+		*changed = TRUE;
+	}
+
+	return TRUE;
+}
+
+/* Threads @node by its subject if its references are not known. It
+   joins the thread of the first message seen with the same subject
+   if any of them is a reply, so "Re: foo" and "foo" are threaded
+   together but two unrelated messages called "Hello" are not. The
+   link is undone if the references of @node are learnt later and
+   it replies to another message */
+static gboolean
+thread_by_subject (ModestConversationIndexPrivate *priv,
+		   ThreadNode *node,
+		   TnyHeader *header)
+{
+	gchar *subject, *base;
+	SubjectEntry *entry;
+	gint prefix_len;
+	gboolean changed = FALSE;
+
+	subject = tny_header_dup_subject (header);
+	if (!subject)
+		return FALSE;
+
+	prefix_len = modest_text_utils_get_subject_prefix_len (subject);
+	base = g_utf8_casefold (g_strstrip (subject + prefix_len), -1);
+	g_free (subject);
+
+	if (base[0] == '\0') {
+		g_free (base);
+		return FALSE;
+	}
+
+	entry = g_hash_table_lookup (priv->subjects, base);
+	if (!entry) {
+		entry = g_slice_new (SubjectEntry);
+		entry->node = node;
+		entry->replied = (prefix_len > 0);
+		g_hash_table_insert (priv->subjects, base, entry);
+		return FALSE;
+	}
+	g_free (base);
+
+	if ((prefix_len > 0 || entry->replied) &&
+	    find_thread (entry->node) != find_thread (node)) {
+		node->subject_anchor = entry->node;
+		changed = merge_threads (entry->node, node, node);
+		find_thread (node)->by_subject = TRUE;
+	}
+	if (prefix_len > 0)
+		entry->replied = TRUE;
+
+	return changed;
+}
+
+static void
+add_header (ModestConversationIndex *self,
+	    TnyHeader *header,
+	    const gchar *msgid)
+{
+	ModestConversationIndexPrivate *priv;
+	ThreadNode *node, *root, *first;
+	gboolean changed;
+
+	priv = MODEST_CONVERSATION_INDEX_GET_PRIVATE (self);
+
+	node = get_node (priv, msgid);
+	node->seen = TRUE;
+	node->date = tny_header_get_date_sent (header);
+
+	/* It could join a thread through the messages that reference
+	   it, and be older than the messages already there */
+	root = find_thread (node);
+	first = older_node (root->first, node);
+	changed = (root->count > 0 && root->first != first);
+	root->first = first;
+	root->count++;
+
+	if (!node->linked && thread_by_subject (priv, node, header))
+		changed = TRUE;
+
+	if (changed)
+		g_signal_emit (self, signals[THREADS_CHANGED_SIGNAL], 0);
+}
+
+/* Returns the node of @header if it was added to the index. The
+   index is not modified */
+static ThreadNode *
+lookup_header_node (ModestConversationIndexPrivate *priv, TnyHeader *header)
+{
+	const gchar *msgid;
+	ThreadNode *node;
+
+	/* The msgid is cached when the header is added */
+	msgid = g_object_get_qdata (G_OBJECT (header), msgid_quark);
+	if (!msgid)
+		return NULL;
+
+	node = g_hash_table_lookup (priv->nodes, msgid);
+
+	return (node && node->seen) ? node : NULL;
+}
+
+static gchar *
+get_index_filename (const gchar *url)
+{
+	const gchar *cache_dir;
+	gchar *hash, *basename, *filename;
+
+	cache_dir = tny_account_store_get_cache_dir (TNY_ACCOUNT_STORE (modest_runtime_get_account_store ()));
+	if (!cache_dir)
+		return NULL;
+
+	/* The URL is hashed, as it's used as a file name */
+	hash = g_compute_checksum_for_string (G_CHECKSUM_MD5, url, -1);
+	basename = g_strconcat (hash, ".threads", NULL);
+	filename = g_build_filename (cache_dir, MODEST_CONVERSATION_INDEX_DIR, basename, NULL);
+	g_free (basename);
+	g_free (hash);
+
+	return filename;
+}
+
+/* The links are appended to the file as they're learnt, one
+   "msgid\tparent msgid" per line */
+static void
+append_links (const gchar *filename, const gchar *lines)
+{
+	gchar *dirname;
+	FILE *file;
+
+	dirname = g_path_get_dirname (filename);
+	g_mkdir_with_parents (dirname, 0700);
+	g_free (dirname);
+
+	file = g_fopen (filename, "a");
+	if (!file) {
+		g_warning ("%s: cannot open %s", __FUNCTION__, filename);
+		return;
+	}
+	fputs (lines, file);
+	fclose (file);
+}
+
+/* Reads the links of the file. The ones that do not link anything
+   new (because the same message was retrieved again while the index
+   was not loaded) are dropped from the file when they're the
+   majority */
+static void
+load_links (ModestConversationIndexPrivate *priv)
+{
+	gchar *contents = NULL;
+	gchar **lines, **cursor;
+	GString *kept;
+	guint n_kept = 0, n_dropped = 0;
+
+	if (!g_file_get_contents (priv->filename, &contents, NULL, NULL))
+		return;
+
+	kept = g_string_new ("");
+	lines = g_strsplit (contents, "\n", -1);
+	g_free (contents);
+
+	for (cursor = lines; *cursor; cursor++) {
+		gchar *tab = strchr (*cursor, '\t');
+
+		if (!tab || tab == *cursor || tab[1] == '\0')
+			continue;
+		*tab = '\0';
+		if (add_link (priv, *cursor, tab + 1, NULL)) {
+			g_string_append_printf (kept, "%s\t%s\n", *cursor, tab + 1);
+			n_kept++;
+		} else {
+			n_dropped++;
+		}
+	}
+	g_strfreev (lines);
+
+	if (n_dropped > n_kept)
+		g_file_set_contents (priv->filename, kept->str, kept->len, NULL);
+	g_string_free (kept, TRUE);
+}
+
+ModestConversationIndex*
+modest_conversation_index_get_for_folder (TnyFolder *folder)
+{
+	ModestConversationIndex *self;
+	ModestConversationIndexPrivate *priv;
+	gchar *url;
+
+	g_return_val_if_fail (TNY_IS_FOLDER (folder), NULL);
+
+	url = tny_folder_get_url_string (folder);
+	if (!url)
+		return NULL;
+
+	if (!indexes)
+		indexes = g_hash_table_new (g_str_hash, g_str_equal);
+
+	self = g_hash_table_lookup (indexes, url);
+	if (self) {
+		g_free (url);
+		return g_object_ref (self);
+	}
+
+	self = MODEST_CONVERSATION_INDEX (g_object_new (MODEST_TYPE_CONVERSATION_INDEX, NULL));
+	priv = MODEST_CONVERSATION_INDEX_GET_PRIVATE (self);
+	priv->url = url;
+	priv->filename = get_index_filename (url);
+	if (priv->filename)
+		load_links (priv);
+
+	g_hash_table_insert (indexes, priv->url, self);
+
+	return self;
+}
+
+void
+modest_conversation_index_add_header (ModestConversationIndex *self,
+				      TnyHeader *header)
+{
+	ModestConversationIndexPrivate *priv;
+	ThreadNode *node;
+	gchar *msgid;
+
+	g_return_if_fail (MODEST_IS_CONVERSATION_INDEX (self));
+	g_return_if_fail (TNY_IS_HEADER (header));
+
+	priv = MODEST_CONVERSATION_INDEX_GET_PRIVATE (self);
+
+	msgid = g_object_get_qdata (G_OBJECT (header), msgid_quark);
+	if (!msgid) {
+		msgid = get_header_msgid (header);
+		g_object_set_qdata_full (G_OBJECT (header), msgid_quark, msgid, g_free);
+	}
+
+	node = g_hash_table_lookup (priv->nodes, msgid);
+	if (!node || !node->seen)
+		add_header (self, header, msgid);
+}
+
+gint
+modest_conversation_index_compare (ModestConversationIndex *self,
+				   TnyHeader *header1,
+				   TnyHeader *header2,
+				   gboolean newest_first)
+{
+	ModestConversationIndexPrivate *priv;
+	ThreadNode *node1, *node2, *root1 = NULL, *root2 = NULL;
+
+	g_return_val_if_fail (MODEST_IS_CONVERSATION_INDEX (self), 0);
+	g_return_val_if_fail (TNY_IS_HEADER (header1) && TNY_IS_HEADER (header2), 0);
+
+	priv = MODEST_CONVERSATION_INDEX_GET_PRIVATE (self);
+
+	node1 = lookup_header_node (priv, header1);
+	node2 = lookup_header_node (priv, header2);
+	if (node1 && node1 == node2)
+		return 0;
+
+	if (node1)
+		root1 = get_thread (node1);
+	if (node2)
+		root2 = get_thread (node2);
+
+	/* The headers that were not added are threads of their own */
+	if (!root1 || root1 != root2) {
+		time_t date1, date2;
+		gint cmp;
+
+		date1 = root1 ? root1->first->date : tny_header_get_date_sent (header1);
+		date2 = root2 ? root2->first->date : tny_header_get_date_sent (header2);
+		if (date1 != date2)
+			cmp = (date1 < date2) ? -1 : 1;
+		else if (root1 && root2)
+			cmp = (root1->seq < root2->seq) ? -1 : 1;
+		else
+			cmp = (root1 ? 1 : 0) - (root2 ? 1 : 0);
+		return newest_first ? -cmp : cmp;
+	}
+
+	/* The oldest messages of a thread first */
+	if (node1->date != node2->date)
+		return (node1->date < node2->date) ? -1 : 1;
+	return (node1->seq < node2->seq) ? -1 : 1;
+}
+
+gboolean
+modest_conversation_index_is_reply (ModestConversationIndex *self,
+				    TnyHeader *header)
+{
+	ThreadNode *node;
+
+	g_return_val_if_fail (MODEST_IS_CONVERSATION_INDEX (self), FALSE);
+	g_return_val_if_fail (TNY_IS_HEADER (header), FALSE);
+
+	node = lookup_header_node (MODEST_CONVERSATION_INDEX_GET_PRIVATE (self), header);
+
+	return node && get_thread (node)->first != node;
+}
+
+static void
+free_msgids (GPtrArray *ids)
+{
+	guint i;
+
+	for (i = 0; i < ids->len; i++)
+		g_free (g_ptr_array_index (ids, i));
+	g_ptr_array_free (ids, TRUE);
+}
+
+/* Returns the message ids from the oldest ancestor to the message
+   itself, or NULL if the message has no id */
+static GPtrArray *
+get_msgid_chain (const gchar *message_id,
+		 const gchar *references,
+		 const gchar *in_reply_to)
+{
+	GPtrArray *ids;
+	gchar *msgid;
+	guint i;
+
+	msgid = message_id ? normalize_msgid (message_id, strlen (message_id)) : NULL;
+	if (!msgid)
+		return NULL;
+
+	/* The References header lists the ancestors of the message,
+	   the oldest first. In-Reply-To is the parent, and it's the
+	   only one available if the sender does not add References */
+	ids = g_ptr_array_new ();
+	parse_msgids (references, ids);
+	if (in_reply_to) {
+		GPtrArray *parents = g_ptr_array_new ();
+
+		parse_msgids (in_reply_to, parents);
+		if (parents->len > 0 &&
+		    (ids->len == 0 ||
+		     strcmp (g_ptr_array_index (ids, ids->len - 1), g_ptr_array_index (parents, 0)))) {
+			g_ptr_array_add (ids, g_ptr_array_index (parents, 0));
+			g_ptr_array_index (parents, 0) = NULL;
+		}
+		for (i = 0; i < parents->len; i++)
+			g_free (g_ptr_array_index (parents, i));
+		g_ptr_array_free (parents, TRUE);
+	}
+	g_ptr_array_add (ids, msgid);
+
+	return ids;
+}
+
+void
+modest_conversation_index_add_references (ModestConversationIndex *self,
+					  const gchar *message_id,
+					  const gchar *references,
+					  const gchar *in_reply_to)
+{
+	ModestConversationIndexPrivate *priv;
+	GPtrArray *ids;
+	GString *lines;
+	gboolean changed = FALSE;
+	guint i;
+
+	g_return_if_fail (MODEST_IS_CONVERSATION_INDEX (self));
+
+	priv = MODEST_CONVERSATION_INDEX_GET_PRIVATE (self);
+
+	ids = get_msgid_chain (message_id, references, in_reply_to);
+	if (!ids)
+		return;
+
+	/* Every message is linked with the one it replies to */
+	lines = g_string_new ("");
+	for (i = 1; i < ids->len; i++) {
+		const gchar *child = g_ptr_array_index (ids, i);
+		const gchar *parent = g_ptr_array_index (ids, i - 1);
+
+		if (strcmp (child, parent) && add_link (priv, child, parent, &changed))
+			g_string_append_printf (lines, "%s\t%s\n", child, parent);
+	}
+
+	if (lines->len > 0 && priv->filename)
+		append_links (priv->filename, lines->str);
+
+	if (changed)
+		g_signal_emit (self, signals[THREADS_CHANGED_SIGNAL], 0);
+
+	g_string_free (lines, TRUE);
+	free_msgids (ids);
+}
+
+void
+modest_conversation_index_add_msg (TnyFolder *folder,
+				   TnyMsg *msg)
+{
+	ModestConversationIndex *self;
+	gchar *message_id = NULL, *references = NULL, *in_reply_to = NULL;
+	gchar *url;
+
+	g_return_if_fail (TNY_IS_FOLDER (folder));
+	g_return_if_fail (TNY_IS_MSG (msg));
+
+	url = tny_folder_get_url_string (folder);
+	if (!url)
+		return;
+
+	modest_tny_msg_get_references (msg, &message_id, &references, &in_reply_to);
+
+	self = indexes ? g_hash_table_lookup (indexes, url) : NULL;
+	if (self) {
+		modest_conversation_index_add_references (self, message_id, references, in_reply_to);
+	} else {
+		GPtrArray *ids;
+
+		/* The links are only saved, they'll be loaded with the
+		   index */
+		ids = get_msgid_chain (message_id, references, in_reply_to);
+		if (ids) {
+			GString *lines = g_string_new ("");
+			gchar *filename;
+			guint i;
+
+			for (i = 1; i < ids->len; i++) {
+				const gchar *child = g_ptr_array_index (ids, i);
+				const gchar *parent = g_ptr_array_index (ids, i - 1);
+
+				if (strcmp (child, parent))
+					g_string_append_printf (lines, "%s\t%s\n", child, parent);
+			}
+
+			filename = (lines->len > 0) ? get_index_filename (url) : NULL;
+			if (filename)
+				append_links (filename, lines->str);
+
+			g_free (filename);
+			g_string_free (lines, TRUE);
+			free_msgids (ids);
+		}
+	}
+
+	g_free (url);
+	g_free (message_id);
+	g_free (references);
+	g_free (in_reply_to);
+}
+
+gchar **
+modest_conversation_index_parse_msgids (const gchar *value)
+{
+	GPtrArray *ids;
+
+	ids = g_ptr_array_new ();
+	parse_msgids (value, ids);
+	g_ptr_array_add (ids, NULL);
+
+	return (gchar **) g_ptr_array_free (ids, FALSE);
+}
@@ -0,0 +1,197 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MODEST_CONVERSATION_INDEX_H__
+#define __MODEST_CONVERSATION_INDEX_H__
+
+#include <glib-object.h>
+#include <tny-folder.h>
+#include <tny-header.h>
+#include <tny-msg.h>
+
+G_BEGIN_DECLS
+
+/* convenience macros */
+#define MODEST_TYPE_CONVERSATION_INDEX             (modest_conversation_index_get_type())
+#define MODEST_CONVERSATION_INDEX(obj)             (G_TYPE_CHECK_INSTANCE_CAST((obj),MODEST_TYPE_CONVERSATION_INDEX,ModestConversationIndex))
+#define MODEST_CONVERSATION_INDEX_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST((klass),MODEST_TYPE_CONVERSATION_INDEX,GObject))
+#define MODEST_IS_CONVERSATION_INDEX(obj)          (G_TYPE_CHECK_INSTANCE_TYPE((obj),MODEST_TYPE_CONVERSATION_INDEX))
+#define MODEST_IS_CONVERSATION_INDEX_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE((klass),MODEST_TYPE_CONVERSATION_INDEX))
+#define MODEST_CONVERSATION_INDEX_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS((obj),MODEST_TYPE_CONVERSATION_INDEX,ModestConversationIndexClass))
+
+typedef struct _ModestConversationIndex      ModestConversationIndex;
+typedef struct _ModestConversationIndexClass ModestConversationIndexClass;
+
+struct _ModestConversationIndex {
+	 GObject parent;
+};
+
+struct _ModestConversationIndexClass {
+	GObjectClass parent_class;
+
+	/* signals */
+	void (*threads_changed) (ModestConversationIndex *self);
+};
+
+/*
+ * The conversation index groups the messages of a folder in
+ * threads. The messages are linked by their Message-ID, References
+ * and In-Reply-To headers, JWZ-style, and the messages whose
+ * references are not known yet are linked by their subject if one
+ * of them is a reply ("Re: foo" joins the thread of "foo"). A
+ * message threaded by subject is threaded again if its references
+ * are learnt later and it replies to another thread.
+ *
+ * The index is built incrementally: every message is added once, in
+ * almost constant time, and it joins an existing thread or starts a
+ * new one, so the folder is only threaded again from scratch when a
+ * thread by subject was wrong. The links between messages are saved
+ * in the folder cache, as the references are only available in the
+ * full messages.
+ *
+ * All the functions must be called from the main loop
+ */
+
+/**
+ * modest_conversation_index_get_type:
+ *
+ * get the GType for ModestConversationIndex
+ *
+ * Returns: the GType
+ */
+GType        modest_conversation_index_get_type    (void) G_GNUC_CONST;
+
+/**
+ * modest_conversation_index_get_for_folder:
+ * @folder: a #TnyFolder
+ *
+ * gets the conversation index of @folder. There is only one index
+ * per folder, it's created and its links loaded from the folder
+ * cache the first time it's requested, and it's shared while it's
+ * referenced
+ *
+ * Returns: a #ModestConversationIndex, or %NULL if the folder has
+ * no URL. Unref it after use
+ */
+ModestConversationIndex* modest_conversation_index_get_for_folder (TnyFolder *folder);
+
+/**
+ * modest_conversation_index_add_header:
+ * @self: a #ModestConversationIndex
+ * @header: a #TnyHeader of the folder
+ *
+ * adds @header to the index, if it's not there yet. Call it when the
+ * header is inserted in the model, before it's sorted. The
+ * "threads-changed" signal is emitted if the order of the headers
+ * already added changed
+ */
+void         modest_conversation_index_add_header (ModestConversationIndex *self,
+						   TnyHeader *header);
+
+/**
+ * modest_conversation_index_compare:
+ * @self: a #ModestConversationIndex
+ * @header1: a #TnyHeader of the folder
+ * @header2: a #TnyHeader of the folder
+ * @newest_first: whether the newest threads go first
+ *
+ * compares two headers in thread order. The threads are sorted by
+ * the date of their first message, and the messages of a thread by
+ * date, always the oldest first. The headers that were not added
+ * with modest_conversation_index_add_header() are sorted as threads
+ * of their own. The index is not modified, so it can be used as a
+ * sort function
+ *
+ * Returns: a negative value if @header1 goes before @header2, a
+ * positive value if it goes after, and 0 if they're the same
+ */
+gint         modest_conversation_index_compare (ModestConversationIndex *self,
+						TnyHeader *header1,
+						TnyHeader *header2,
+						gboolean newest_first);
+
+/**
+ * modest_conversation_index_is_reply:
+ * @self: a #ModestConversationIndex
+ * @header: a #TnyHeader of the folder
+ *
+ * checks if @header is in a thread with older messages, so it
+ * could be shown indented below them. The index is not modified
+ *
+ * Returns: %TRUE if @header was added and it's not the first
+ * message of its thread
+ */
+gboolean     modest_conversation_index_is_reply (ModestConversationIndex *self,
+						 TnyHeader *header);
+
+/**
+ * modest_conversation_index_add_references:
+ * @self: a #ModestConversationIndex
+ * @message_id: the Message-ID header of a message
+ * @references: the References header of the message, or %NULL
+ * @in_reply_to: the In-Reply-To header of the message, or %NULL
+ *
+ * learns the references of a message, linking it with the messages
+ * it replies to. The new links are saved in the folder cache. The
+ * "threads-changed" signal is emitted if threads were merged or
+ * threaded again
+ */
+void         modest_conversation_index_add_references (ModestConversationIndex *self,
+						       const gchar *message_id,
+						       const gchar *references,
+						       const gchar *in_reply_to);
+
+/**
+ * modest_conversation_index_add_msg:
+ * @folder: a #TnyFolder
+ * @msg: a #TnyMsg of @folder
+ *
+ * learns the references of @msg in the index of @folder, see
+ * modest_conversation_index_add_references(). Call it when a full
+ * message is retrieved. The links are saved even if the index of
+ * @folder is not in use
+ */
+void         modest_conversation_index_add_msg (TnyFolder *folder,
+						TnyMsg *msg);
+
+/**
+ * modest_conversation_index_parse_msgids:
+ * @value: the value of a References or In-Reply-To header, or %NULL
+ *
+ * gets the message ids of @value, in order, without the angle
+ * brackets. The ids are usually enclosed in angle brackets, but
+ * some mailers only separate them with blank spaces
+ *
+ * Returns: a %NULL terminated array of ids, free it with g_strfreev()
+ */
+gchar **     modest_conversation_index_parse_msgids (const gchar *value);
+
+G_END_DECLS
+
+#endif /* __MODEST_CONVERSATION_INDEX_H__ */
@@ -56,6 +56,13 @@ const gchar *modest_defs_namespace (const gchar *string);
 #define MODEST_CACHE_DIR                  "cache"
 #define MODEST_IMAGES_CACHE_DIR           "images"
 #define MODEST_IMAGES_CACHE_SIZE          (1024*1024)
+#define MODEST_BODIES_CACHE_DIR           "bodies"
+#define MODEST_BODIES_CACHE_SIZE          (2*1024*1024)
+#define MODEST_TRACE_FILE                 "trace.log"
+#define MODEST_OPERATION_STATS_FILE       "operation-stats.log"
+#define MODEST_AUTOSAVE_DIR               "autosave"
+#define MODEST_RECIPIENT_INDEX_FILE       "recipients.index"
+#define MODEST_CONVERSATION_INDEX_DIR     "threads" /* inside the cache dir */
 
 #define MODEST_LOCAL_FOLDERS_ACCOUNT_ID   "local_folders"
 #define MODEST_LOCAL_FOLDERS_ACCOUNT_NAME MODEST_LOCAL_FOLDERS_ACCOUNT_ID
@@ -245,6 +252,7 @@ const gchar *modest_defs_namespace (const gchar *string);
 #define MODEST_CONF_UPDATE_WHEN_CONNECTED_BY (modest_defs_namespace ("/update_when_connected_by")) /* int */
 #define MODEST_CONF_UPDATE_INTERVAL (modest_defs_namespace ("/update_interval")) /* int */
 #define MODEST_CONF_MSG_SIZE_LIMIT (modest_defs_namespace ("/msg_size_limit")) /* int */
+#define MODEST_CONF_AUTOSAVE_INTERVAL (modest_defs_namespace ("/autosave_interval")) /* int, seconds, 0 disables it */
 #define MODEST_CONF_PLAY_SOUND_MSG_ARRIVE (modest_defs_namespace ("/play_sound_msg_arrive")) /* bool */
 #define MODEST_CONF_PREFER_FORMATTED_TEXT (modest_defs_namespace ("/prefer_formatted_text")) /* bool */
 #define MODEST_CONF_REPLY_TYPE           (modest_defs_namespace ("/reply_type"))        /*  int  */
@@ -43,6 +43,7 @@ struct _ModestDimmingRulePrivate {
 	gchar *action_path;
 	GtkWidget *widget;
 	gchar *notification;
+	ModestDimmingDeps deps;
 };
 
 #define MODEST_DIMMING_RULE_GET_PRIVATE(o)      (G_TYPE_INSTANCE_GET_PRIVATE((o), \
@@ -101,6 +102,7 @@ modest_dimming_rule_init (ModestDimmingRule *obj)
 	priv->action_path = NULL;
 	priv->widget = NULL;
 	priv->notification = NULL;
+	priv->deps = MODEST_DIMMING_DEPS_ALL;
 }
 
 static void
@@ -253,6 +255,29 @@ modest_dimming_rule_get_group (ModestDimmingRule *rule)
 	return g_object_ref(priv->group);
 }
 
+void
+modest_dimming_rule_set_deps (ModestDimmingRule *rule,
+			      ModestDimmingDeps deps)
+{
+	ModestDimmingRulePrivate *priv = NULL;
+
+	g_return_if_fail (MODEST_IS_DIMMING_RULE (rule));
+	priv = MODEST_DIMMING_RULE_GET_PRIVATE(rule);
+
+	priv->deps = deps;
+}
+
+ModestDimmingDeps
+modest_dimming_rule_get_deps (ModestDimmingRule *rule)
+{
+	ModestDimmingRulePrivate *priv = NULL;
+
+	g_return_val_if_fail (MODEST_IS_DIMMING_RULE (rule), MODEST_DIMMING_DEPS_ALL);
+	priv = MODEST_DIMMING_RULE_GET_PRIVATE(rule);
+
+	return priv->deps;
+}
+
 void
 modest_dimming_rule_set_notification (ModestDimmingRule *rule,
 				      const gchar *notification)
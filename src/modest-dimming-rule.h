@@ -156,6 +156,26 @@ modest_dimming_rule_get_action_path (ModestDimmingRule *rule);
 GtkWidget *
 modest_dimming_rule_get_widget (ModestDimmingRule *rule);
 
+/**
+ * modest_dimming_rule_set_deps:
+ * @rule: a #ModestDimmingRule
+ * @deps: the #ModestDimmingDeps inputs the rule depends on
+ *
+ * Sets the inputs the result of @rule depends on. The rules groups
+ * use them to skip the rules whose inputs did not change. By
+ * default a rule depends on %MODEST_DIMMING_DEPS_ALL
+ */
+void modest_dimming_rule_set_deps (ModestDimmingRule *rule,
+				   ModestDimmingDeps deps);
+
+/**
+ * modest_dimming_rule_get_deps:
+ * @rule: a #ModestDimmingRule
+ *
+ * Returns: the #ModestDimmingDeps inputs @rule depends on
+ */
+ModestDimmingDeps modest_dimming_rule_get_deps (ModestDimmingRule *rule);
+
 void modest_dimming_rule_set_notification (ModestDimmingRule *rule,
 					   const gchar *notification);
 
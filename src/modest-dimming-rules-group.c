@@ -32,6 +32,8 @@
 #include "modest-dimming-rule.h"
 #include "modest-platform.h"
 #include "modest-ui-dimming-rules.h"
+#include "modest-debug.h"
+#include "modest-trace.h"
 
 static void modest_dimming_rules_group_class_init (ModestDimmingRulesGroupClass *klass);
 static void modest_dimming_rules_group_init       (ModestDimmingRulesGroup *obj);
@@ -57,8 +59,17 @@ struct _ModestDimmingRulesGroupPrivate {
 	GHashTable *rules_map;
 	GSList *widget_rules;
 	gboolean window_weak_ref;
+	ModestDimmingDeps dirty;
 };
 
+typedef struct {
+	ModestDimmingDeps dirty;
+	guint evaluated;
+	guint skipped;
+	ModestWindow *window;
+	gboolean state_defined;
+} ExecuteHelper;
+
 
 #define MODEST_DIMMING_RULES_GROUP_GET_PRIVATE(o)      (G_TYPE_INSTANCE_GET_PRIVATE((o), \
                                                    MODEST_TYPE_DIMMING_RULES_GROUP, \
@@ -67,6 +78,13 @@ struct _ModestDimmingRulesGroupPrivate {
 /* globals */
 static GObjectClass *parent_class = NULL;
 
+/* Evaluation statistics, shared by all the groups */
+static guint64 stats_evaluated = 0;
+static guint64 stats_skipped = 0;
+static guint stats_period_evaluated = 0;
+static gdouble stats_rate = 0.0;
+static GTimer *stats_timer = NULL;
+
 static void _execute_dimming_rule (gpointer key, gpointer value, gpointer user_data);
 static void _execute_widget_dimming_rule (gpointer data, gpointer user_data);
 
@@ -123,6 +141,7 @@ modest_dimming_rules_group_init (ModestDimmingRulesGroup *obj)
 						 (GDestroyNotify) g_object_unref);
 	priv->widget_rules = NULL;
 	priv->window_weak_ref = FALSE;
+	priv->dirty = MODEST_DIMMING_DEPS_ALL;
 }
 
 static void
@@ -217,8 +236,9 @@ _add_rule (ModestDimmingRulesGroup *self,
 			  G_CALLBACK (_insensitive_press_callback), 
 			  rule);
 #endif
-	/* Register new dimming rule */		
+	/* Register new dimming rule, it has not been evaluated yet */		
 	modest_dimming_rule_set_group (rule, self);
+	priv->dirty = MODEST_DIMMING_DEPS_ALL;
 	action_path = modest_dimming_rule_get_action_path (rule);
 	if (action_path)
 		g_hash_table_insert (priv->rules_map, g_strdup(action_path), rule);
@@ -251,6 +271,7 @@ modest_dimming_rules_group_add_widget_rule (ModestDimmingRulesGroup *self,
 	dim_rule = modest_dimming_rule_new_from_widget (priv->window,
 							(ModestDimmingCallback) callback,
 							widget);
+	modest_dimming_rule_set_deps (dim_rule, modest_ui_dimming_rules_get_deps (callback));
 
 	_add_rule (self, dim_rule, window);
 }
@@ -302,6 +323,8 @@ modest_dimming_rules_group_add_rules (ModestDimmingRulesGroup *self,
 		dim_rule = modest_dimming_rule_new (priv->window,
 						    (ModestDimmingCallback) entry.callback,
 						    entry.action_path);
+		modest_dimming_rule_set_deps (dim_rule,
+					      modest_ui_dimming_rules_get_deps (entry.callback));
 
 		_add_rule (self, dim_rule, window);
 	}
@@ -318,11 +341,62 @@ modest_dimming_rules_group_notifications_enabled (ModestDimmingRulesGroup *self)
 	return priv->notifications_enabled;
 } 
 
+void
+modest_dimming_rules_group_invalidate (ModestDimmingRulesGroup *self,
+				       ModestDimmingDeps deps)
+{
+	ModestDimmingRulesGroupPrivate *priv;
+
+	g_return_if_fail (MODEST_IS_DIMMING_RULES_GROUP(self));
+	priv = MODEST_DIMMING_RULES_GROUP_GET_PRIVATE(self);
+
+	priv->dirty |= deps;
+}
+
+static void
+update_stats (const gchar *name, guint evaluated, guint skipped)
+{
+	gdouble elapsed;
+
+	stats_evaluated += evaluated;
+	stats_skipped += skipped;
+	stats_period_evaluated += evaluated;
+
+	if (!stats_timer)
+		stats_timer = g_timer_new ();
+
+	/* Recompute the rate at most once per second */
+	elapsed = g_timer_elapsed (stats_timer, NULL);
+	if (elapsed >= 1.0) {
+		stats_rate = stats_period_evaluated / elapsed;
+		stats_period_evaluated = 0;
+		g_timer_start (stats_timer);
+	}
+
+	MODEST_DEBUG_BLOCK (g_debug ("dimming group %s: %u evaluated, %u skipped (%.1f rules/s)",
+				     name, evaluated, skipped, stats_rate););
+}
+
+void
+modest_dimming_rules_group_get_stats (guint64 *evaluated,
+				      guint64 *skipped,
+				      gdouble *rules_per_second)
+{
+	if (evaluated)
+		*evaluated = stats_evaluated;
+	if (skipped)
+		*skipped = stats_skipped;
+	if (rules_per_second)
+		*rules_per_second = stats_rate;
+}
+
 void 
 modest_dimming_rules_group_execute (ModestDimmingRulesGroup *self) 
 {
 	ModestDimmingRulesGroupPrivate *priv;
-	DimmedState *state = NULL;
+	ModestDimmingSnapshot *snapshot;
+	ModestTraceSpan *span;
+	ExecuteHelper helper;
 
 	g_return_if_fail (MODEST_IS_DIMMING_RULES_GROUP(self));
 	priv = MODEST_DIMMING_RULES_GROUP_GET_PRIVATE(self);
@@ -330,18 +404,64 @@ modest_dimming_rules_group_execute (ModestDimmingRulesGroup *self)
 	if (!priv->window)
 		return;
 
-	/* Init dimming rules init data */
-	state = modest_ui_dimming_rules_define_dimming_state (priv->window);	
-	modest_window_set_dimming_state (priv->window, state);
+	/* Nothing changed since the last evaluation */
+	if (priv->dirty == MODEST_DIMMING_DEPS_NONE)
+		return;
+
+	/* Reset it before executing the rules, so changes notified
+	   while they run are not lost */
+	helper.dirty = priv->dirty;
+	helper.evaluated = 0;
+	helper.skipped = 0;
+	helper.window = priv->window;
+	helper.state_defined = FALSE;
+	priv->dirty = MODEST_DIMMING_DEPS_NONE;
+
+	span = modest_trace_begin ("dimming", priv->name);
+
+	/* The dimmed state is defined before running the first rule
+	   that is not skipped, see _process_rule_if_dirty */
+	snapshot = modest_ui_dimming_rules_snapshot_new (priv->window);
 
 	/* execute group dimming rules */
-	g_hash_table_foreach (priv->rules_map, _execute_dimming_rule, NULL);
-	g_slist_foreach (priv->widget_rules, (GFunc) _execute_widget_dimming_rule, NULL);
+	g_hash_table_foreach (priv->rules_map, _execute_dimming_rule, &helper);
+	g_slist_foreach (priv->widget_rules, (GFunc) _execute_widget_dimming_rule, &helper);
 
 	/* Free dimming ruls init data */
-	modest_window_set_dimming_state (priv->window, NULL);
+	modest_ui_dimming_rules_snapshot_free (snapshot);
+	if (helper.state_defined)
+		modest_window_set_dimming_state (priv->window, NULL);
+
+	modest_trace_end (span);
+	update_stats (priv->name, helper.evaluated, helper.skipped);
 }
 
+static void
+_process_rule_if_dirty (ModestDimmingRule *rule,
+			ExecuteHelper *helper)
+{
+	ModestDimmingDeps deps;
+
+	/* Rules without dependencies are only evaluated on full
+	   refreshes */
+	deps = modest_dimming_rule_get_deps (rule);
+	if (helper->dirty == MODEST_DIMMING_DEPS_ALL || (deps & helper->dirty)) {
+		/* Any rule could read the dimmed state, so define it
+		   before running the first one. Nothing is computed
+		   if all the rules are skipped */
+		if (!helper->state_defined) {
+			DimmedState *state;
+
+			state = modest_ui_dimming_rules_define_dimming_state (helper->window);
+			modest_window_set_dimming_state (helper->window, state);
+			helper->state_defined = TRUE;
+		}
+		modest_dimming_rule_process (rule);
+		helper->evaluated++;
+	} else {
+		helper->skipped++;
+	}
+}
 
 static void
 _execute_dimming_rule (gpointer key, gpointer value, gpointer user_data)
@@ -349,7 +469,7 @@ _execute_dimming_rule (gpointer key, gpointer value, gpointer user_data)
 	g_return_if_fail (MODEST_IS_DIMMING_RULE (value));
 
 	/* Process dimming rule */
-	modest_dimming_rule_process (MODEST_DIMMING_RULE(value));
+	_process_rule_if_dirty (MODEST_DIMMING_RULE(value), (ExecuteHelper *) user_data);
 }
 
 static void
@@ -358,7 +478,7 @@ _execute_widget_dimming_rule (gpointer data, gpointer user_data)
 	g_return_if_fail (MODEST_IS_DIMMING_RULE (data));
 
 	/* Process dimming rule */
-	modest_dimming_rule_process (MODEST_DIMMING_RULE(data));
+	_process_rule_if_dirty (MODEST_DIMMING_RULE(data), (ExecuteHelper *) user_data);
 }
 
 #ifndef MODEST_TOOLKIT_GTK
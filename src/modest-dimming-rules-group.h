@@ -124,6 +124,33 @@ modest_dimming_rules_group_add_widget_rule (ModestDimmingRulesGroup *self,
 gchar *
 modest_dimming_rules_group_get_name (ModestDimmingRulesGroup *self);
 
+/**
+ * modest_dimming_rules_group_invalidate:
+ * @self: the #ModestDimmingRulesGroup object which stores dimming rules.
+ * @deps: the #ModestDimmingDeps inputs that changed
+ *
+ * Marks @deps as changed. The next execution of @self will evaluate
+ * the rules that depend on them, and skip the rest. Use
+ * %MODEST_DIMMING_DEPS_ALL to force a full evaluation.
+ **/
+void
+modest_dimming_rules_group_invalidate (ModestDimmingRulesGroup *self,
+				       ModestDimmingDeps deps);
+
+/**
+ * modest_dimming_rules_group_get_stats:
+ * @evaluated: return location for the number of rules evaluated, or %NULL
+ * @skipped: return location for the number of rules skipped, or %NULL
+ * @rules_per_second: return location for the last measured
+ * evaluation rate, or %NULL
+ *
+ * Gets the evaluation statistics of all the dimming rules groups
+ **/
+void
+modest_dimming_rules_group_get_stats (guint64 *evaluated,
+				      guint64 *skipped,
+				      gdouble *rules_per_second);
+
 G_END_DECLS
 
 #endif /* __MODEST_DIMMING_RULES_GROUP_H__ */
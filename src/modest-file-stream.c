@@ -0,0 +1,286 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* modest-file-stream.c */
+
+#include <config.h>
+#include <string.h>
+#include <tny-stream.h>
+#include <libgnomevfs/gnome-vfs.h>
+#include "modest-file-stream.h"
+
+/* 'private'/'protected' functions */
+static void  modest_file_stream_class_init   (ModestFileStreamClass *klass);
+static void  modest_file_stream_init         (ModestFileStream *obj);
+static void  modest_file_stream_finalize     (GObject *obj);
+
+static void  modest_file_stream_iface_init   (gpointer g_iface, gpointer iface_data);
+
+typedef struct _ModestFileStreamPrivate ModestFileStreamPrivate;
+struct _ModestFileStreamPrivate {
+	gchar          *uri;
+	GnomeVFSHandle *handle;
+	gboolean        eos;
+};
+#define MODEST_FILE_STREAM_GET_PRIVATE(o)      (G_TYPE_INSTANCE_GET_PRIVATE((o), \
+                                                MODEST_TYPE_FILE_STREAM, \
+                                                ModestFileStreamPrivate))
+/* globals */
+static GObjectClass *parent_class = NULL;
+
+GType
+modest_file_stream_get_type (void)
+{
+	static GType my_type = 0;
+	if (!my_type) {
+		static const GTypeInfo my_info = {
+			sizeof(ModestFileStreamClass),
+			NULL,		/* base init */
+			NULL,		/* base finalize */
+			(GClassInitFunc) modest_file_stream_class_init,
+			NULL,		/* class finalize */
+			NULL,		/* class data */
+			sizeof(ModestFileStream),
+			1,		/* n_preallocs */
+			(GInstanceInitFunc) modest_file_stream_init,
+			NULL
+		};
+
+		static const GInterfaceInfo iface_info = {
+			(GInterfaceInitFunc) modest_file_stream_iface_init,
+			NULL,         /* interface_finalize */
+			NULL          /* interface_data */
+                };
+
+		my_type = g_type_register_static (G_TYPE_OBJECT,
+		                                  "ModestFileStream",
+		                                  &my_info, 0);
+
+		g_type_add_interface_static (my_type, TNY_TYPE_STREAM,
+					     &iface_info);
+	}
+	return my_type;
+}
+
+static void
+modest_file_stream_class_init (ModestFileStreamClass *klass)
+{
+	GObjectClass *gobject_class;
+	gobject_class = (GObjectClass*) klass;
+
+	parent_class            = g_type_class_peek_parent (klass);
+	gobject_class->finalize = modest_file_stream_finalize;
+
+	g_type_class_add_private (gobject_class, sizeof(ModestFileStreamPrivate));
+}
+
+static void
+modest_file_stream_init (ModestFileStream *obj)
+{
+	ModestFileStreamPrivate *priv;
+	priv = MODEST_FILE_STREAM_GET_PRIVATE(obj);
+
+	priv->uri = NULL;
+	priv->handle = NULL;
+	priv->eos = FALSE;
+}
+
+static void
+close_handle (ModestFileStream *self)
+{
+	ModestFileStreamPrivate *priv = MODEST_FILE_STREAM_GET_PRIVATE (self);
+
+	if (priv->handle) {
+		gnome_vfs_close (priv->handle);
+		priv->handle = NULL;
+	}
+}
+
+static void
+modest_file_stream_finalize (GObject *obj)
+{
+	ModestFileStreamPrivate *priv;
+
+	priv = MODEST_FILE_STREAM_GET_PRIVATE(obj);
+
+	close_handle (MODEST_FILE_STREAM (obj));
+	g_free (priv->uri);
+	priv->uri = NULL;
+
+	G_OBJECT_CLASS(parent_class)->finalize (obj);
+}
+
+TnyStream*
+modest_file_stream_new (const gchar *uri)
+{
+	GObject *obj;
+	ModestFileStreamPrivate *priv;
+
+	g_return_val_if_fail (uri, NULL);
+
+	obj  = G_OBJECT(g_object_new(MODEST_TYPE_FILE_STREAM, NULL));
+	priv = MODEST_FILE_STREAM_GET_PRIVATE(obj);
+
+	priv->uri = g_strdup (uri);
+
+	return TNY_STREAM (obj);
+}
+
+const gchar*
+modest_file_stream_get_uri (ModestFileStream *self)
+{
+	g_return_val_if_fail (MODEST_IS_FILE_STREAM (self), NULL);
+
+	return MODEST_FILE_STREAM_GET_PRIVATE (self)->uri;
+}
+
+/* the rest are interface functions */
+
+static gssize
+file_stream_read (TnyStream *self, char *buffer, gsize n)
+{
+	ModestFileStreamPrivate *priv = MODEST_FILE_STREAM_GET_PRIVATE (self);
+	GnomeVFSFileSize read_bytes = 0;
+	GnomeVFSResult result;
+
+	if (priv->eos)
+		return 0;
+
+	if (!priv->handle &&
+	    gnome_vfs_open (&priv->handle, priv->uri, GNOME_VFS_OPEN_READ) != GNOME_VFS_OK) {
+		priv->handle = NULL;
+		return -1;
+	}
+
+	result = gnome_vfs_read (priv->handle, buffer, n, &read_bytes);
+	if (result == GNOME_VFS_ERROR_EOF || (result == GNOME_VFS_OK && read_bytes == 0)) {
+		/* Do not keep the file open until the stream is
+		   finalized, the message could live for long */
+		priv->eos = TRUE;
+		close_handle (MODEST_FILE_STREAM (self));
+		return 0;
+	} else if (result != GNOME_VFS_OK) {
+		return -1;
+	}
+
+	return (gssize) read_bytes;
+}
+
+static gssize
+file_stream_write (TnyStream *self, const char *buffer, gsize n)
+{
+	return -1; /* we cannot write */
+}
+
+static gint
+file_stream_flush (TnyStream *self)
+{
+	return 0;
+}
+
+static gint
+file_stream_close (TnyStream *self)
+{
+	close_handle (MODEST_FILE_STREAM (self));
+
+	return 0;
+}
+
+static gboolean
+file_stream_is_eos (TnyStream *self)
+{
+	return MODEST_FILE_STREAM_GET_PRIVATE (self)->eos;
+}
+
+static gint
+file_stream_reset (TnyStream *self)
+{
+	ModestFileStreamPrivate *priv = MODEST_FILE_STREAM_GET_PRIVATE (self);
+
+	/* The next read opens it again, from the beginning */
+	close_handle (MODEST_FILE_STREAM (self));
+	priv->eos = FALSE;
+
+	return 0;
+}
+
+static gssize
+file_stream_write_to_stream (TnyStream *self, TnyStream *output)
+{
+	gchar *buffer;
+	gssize total = 0;
+
+	buffer = g_malloc (MODEST_FILE_STREAM_CHUNK_SIZE);
+	while (!file_stream_is_eos (self)) {
+		gssize read_bytes, written;
+		gchar *offset;
+
+		read_bytes = file_stream_read (self, buffer, MODEST_FILE_STREAM_CHUNK_SIZE);
+		if (read_bytes < 0) {
+			total = -1;
+			break;
+		}
+
+		offset = buffer;
+		while (read_bytes > 0) {
+			written = tny_stream_write (output, offset, read_bytes);
+			if (written <= 0) {
+				total = -1;
+				break;
+			}
+			offset += written;
+			read_bytes -= written;
+			total += written;
+		}
+		if (total < 0)
+			break;
+	}
+	g_free (buffer);
+
+	return total;
+}
+
+static void
+modest_file_stream_iface_init (gpointer g_iface, gpointer iface_data)
+{
+	TnyStreamIface *klass;
+
+	g_return_if_fail (g_iface);
+
+	klass = (TnyStreamIface *) g_iface;
+
+	klass->read            = file_stream_read;
+	klass->write           = file_stream_write;
+	klass->flush           = file_stream_flush;
+	klass->close           = file_stream_close;
+	klass->is_eos          = file_stream_is_eos;
+	klass->reset           = file_stream_reset;
+	klass->write_to_stream = file_stream_write_to_stream;
+}
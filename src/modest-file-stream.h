@@ -0,0 +1,91 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* modest-file-stream.h */
+
+#ifndef __MODEST_FILE_STREAM_H__
+#define __MODEST_FILE_STREAM_H__
+
+#include <glib-object.h>
+#include <tny-stream.h>
+
+G_BEGIN_DECLS
+
+/* convenience macros */
+#define MODEST_TYPE_FILE_STREAM             (modest_file_stream_get_type())
+#define MODEST_FILE_STREAM(obj)             (G_TYPE_CHECK_INSTANCE_CAST((obj),MODEST_TYPE_FILE_STREAM,ModestFileStream))
+#define MODEST_FILE_STREAM_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST((klass),MODEST_TYPE_FILE_STREAM,ModestFileStreamClass))
+#define MODEST_IS_FILE_STREAM(obj)          (G_TYPE_CHECK_INSTANCE_TYPE((obj),MODEST_TYPE_FILE_STREAM))
+#define MODEST_IS_FILE_STREAM_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE((klass),MODEST_TYPE_FILE_STREAM))
+#define MODEST_FILE_STREAM_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS((obj),MODEST_TYPE_FILE_STREAM,ModestFileStreamClass))
+
+/* size of the chunks used by tny_stream_write_to_stream, in bytes */
+#define MODEST_FILE_STREAM_CHUNK_SIZE (64 * 1024)
+
+typedef struct _ModestFileStream      ModestFileStream;
+typedef struct _ModestFileStreamClass ModestFileStreamClass;
+
+struct _ModestFileStream {
+	GObject parent;
+};
+
+struct _ModestFileStreamClass {
+	GObjectClass parent_class;
+};
+
+GType       modest_file_stream_get_type    (void) G_GNUC_CONST;
+
+
+/**
+ * modest_file_stream_new:
+ * @uri: the uri of a file
+ *
+ * creates a new read-only #TnyStream for the contents of
+ * @uri. The file is not opened until the first read, and it's
+ * closed once the end of the file is reached. A reset makes the
+ * next read open the file again, so it works with the uris that are
+ * not seekable too (obex, upnp...). Nothing is kept in memory, and
+ * no file descriptor is kept open while the stream is not being read
+ *
+ * Returns: a new #TnyStream
+ **/
+TnyStream*  modest_file_stream_new         (const gchar *uri);
+
+/**
+ * modest_file_stream_get_uri:
+ * @self: a #ModestFileStream
+ *
+ * Returns: the uri of the file, do not free it
+ **/
+const gchar* modest_file_stream_get_uri    (ModestFileStream *self);
+
+G_END_DECLS
+
+#endif /* __MODEST_FILE_STREAM_H__ */
@@ -0,0 +1,770 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <tny-simple-list.h>
+#include <tny-folder.h>
+#include <tny-folder-observer.h>
+#include <tny-folder-store-observer.h>
+#include <tny-folder-change.h>
+#include <tny-folder-store-change.h>
+#include <tny-merge-folder.h>
+#include "modest-folder-stats-mgr.h"
+
+/* 'private'/'protected' functions */
+static void modest_folder_stats_mgr_class_init (ModestFolderStatsMgrClass *klass);
+static void modest_folder_stats_mgr_init       (ModestFolderStatsMgr *obj);
+static void modest_folder_stats_mgr_finalize   (GObject *obj);
+
+static void tny_folder_observer_init (TnyFolderObserverIface *iface);
+static void tny_folder_store_observer_init (TnyFolderStoreObserverIface *iface);
+
+static void track_children (ModestFolderStatsMgr *self, TnyFolderStore *store);
+
+/* A node of the folder tree. @subtree contains the stats of the node
+   and all its descendants, so a query is just a hash lookup. Changes
+   in a folder are propagated to its ancestors, which is O(depth) */
+typedef struct _StatsNode StatsNode;
+struct _StatsNode {
+	gchar *id;
+	TnyFolderStore *store;  /* weak pointer, NULL once it's finalized */
+	StatsNode *parent;
+	GSList *children;
+
+	/* the stats of this folder only */
+	guint msg_count;
+	guint local_size;
+
+	ModestFolderStats subtree;
+};
+
+typedef struct _ModestFolderStatsMgrPrivate ModestFolderStatsMgrPrivate;
+struct _ModestFolderStatsMgrPrivate {
+	GMutex     *lock;
+	GHashTable *nodes;      /* id => StatsNode */
+
+	TnyAccountStore *account_store;
+	gulong      account_inserted_handler;
+	gulong      account_removed_handler;
+};
+#define MODEST_FOLDER_STATS_MGR_GET_PRIVATE(o)      (G_TYPE_INSTANCE_GET_PRIVATE((o), \
+                                                     MODEST_TYPE_FOLDER_STATS_MGR, \
+                                                     ModestFolderStatsMgrPrivate))
+/* globals */
+static GObjectClass *parent_class = NULL;
+
+GType
+modest_folder_stats_mgr_get_type (void)
+{
+	static GType my_type = 0;
+	if (!my_type) {
+		static const GTypeInfo my_info = {
+			sizeof(ModestFolderStatsMgrClass),
+			NULL,		/* base init */
+			NULL,		/* base finalize */
+			(GClassInitFunc) modest_folder_stats_mgr_class_init,
+			NULL,		/* class finalize */
+			NULL,		/* class data */
+			sizeof(ModestFolderStatsMgr),
+			0,		/* n_preallocs */
+			(GInstanceInitFunc) modest_folder_stats_mgr_init,
+			NULL
+		};
+		static const GInterfaceInfo tny_folder_observer_info = {
+			(GInterfaceInitFunc) tny_folder_observer_init, /* interface_init */
+			NULL,         /* interface_finalize */
+			NULL          /* interface_data */
+		};
+		static const GInterfaceInfo tny_folder_store_observer_info = {
+			(GInterfaceInitFunc) tny_folder_store_observer_init, /* interface_init */
+			NULL,         /* interface_finalize */
+			NULL          /* interface_data */
+		};
+
+		my_type = g_type_register_static (G_TYPE_OBJECT,
+		                                  "ModestFolderStatsMgr",
+		                                  &my_info, 0);
+
+		g_type_add_interface_static (my_type, TNY_TYPE_FOLDER_OBSERVER,
+					     &tny_folder_observer_info);
+		g_type_add_interface_static (my_type, TNY_TYPE_FOLDER_STORE_OBSERVER,
+					     &tny_folder_store_observer_info);
+	}
+	return my_type;
+}
+
+static void
+modest_folder_stats_mgr_class_init (ModestFolderStatsMgrClass *klass)
+{
+	GObjectClass *gobject_class;
+	gobject_class = (GObjectClass*) klass;
+
+	parent_class            = g_type_class_peek_parent (klass);
+	gobject_class->finalize = modest_folder_stats_mgr_finalize;
+
+	g_type_class_add_private (gobject_class, sizeof(ModestFolderStatsMgrPrivate));
+}
+
+static void
+stats_node_free (StatsNode *node)
+{
+	g_slist_free (node->children);
+	g_free (node->id);
+	if (node->store)
+		g_object_remove_weak_pointer ((GObject *) node->store, (gpointer *) &node->store);
+	g_slice_free (StatsNode, node);
+}
+
+static void
+modest_folder_stats_mgr_init (ModestFolderStatsMgr *obj)
+{
+	ModestFolderStatsMgrPrivate *priv;
+
+	priv = MODEST_FOLDER_STATS_MGR_GET_PRIVATE(obj);
+
+	priv->lock = g_mutex_new ();
+	priv->nodes = g_hash_table_new_full (g_str_hash, g_str_equal,
+					     NULL, /* the key is owned by the node */
+					     (GDestroyNotify) stats_node_free);
+	priv->account_store = NULL;
+	priv->account_inserted_handler = 0;
+	priv->account_removed_handler = 0;
+}
+
+static void
+remove_observers_foreach (gpointer key, gpointer value, gpointer user_data)
+{
+	StatsNode *node = (StatsNode *) value;
+
+	if (!node->store)
+		return;
+
+	if (TNY_IS_FOLDER (node->store))
+		tny_folder_remove_observer (TNY_FOLDER (node->store),
+					    TNY_FOLDER_OBSERVER (user_data));
+	tny_folder_store_remove_observer (node->store,
+					  TNY_FOLDER_STORE_OBSERVER (user_data));
+}
+
+static void
+modest_folder_stats_mgr_finalize (GObject *obj)
+{
+	ModestFolderStatsMgrPrivate *priv;
+
+	priv = MODEST_FOLDER_STATS_MGR_GET_PRIVATE(obj);
+
+	if (priv->account_store) {
+		if (g_signal_handler_is_connected (priv->account_store,
+						   priv->account_inserted_handler))
+			g_signal_handler_disconnect (priv->account_store,
+						     priv->account_inserted_handler);
+		if (g_signal_handler_is_connected (priv->account_store,
+						   priv->account_removed_handler))
+			g_signal_handler_disconnect (priv->account_store,
+						     priv->account_removed_handler);
+		g_object_unref (priv->account_store);
+		priv->account_store = NULL;
+	}
+
+	g_hash_table_foreach (priv->nodes, remove_observers_foreach, obj);
+	g_hash_table_destroy (priv->nodes);
+	priv->nodes = NULL;
+
+	g_mutex_free (priv->lock);
+	priv->lock = NULL;
+
+	G_OBJECT_CLASS(parent_class)->finalize (obj);
+}
+
+/* Returns the key used to index a folder store, or NULL if it's not
+   a folder nor an account */
+static gchar *
+get_store_id (TnyFolderStore *store)
+{
+	if (TNY_IS_FOLDER (store))
+		return tny_folder_get_url_string (TNY_FOLDER (store));
+	else if (TNY_IS_ACCOUNT (store))
+		return g_strdup (tny_account_get_id (TNY_ACCOUNT (store)));
+	else
+		return NULL;
+}
+
+/* Must be called with the lock held */
+static void
+propagate_delta (StatsNode *node, gint msg_count, gint local_size, gint folders)
+{
+	while (node) {
+		node->subtree.msg_count += msg_count;
+		node->subtree.local_size += local_size;
+		node->subtree.folders += folders;
+		node = node->parent;
+	}
+}
+
+/* Must be called with the lock held */
+static void
+set_node_stats (StatsNode *node, guint msg_count, guint local_size)
+{
+	propagate_delta (node,
+			 (gint) msg_count - (gint) node->msg_count,
+			 (gint) local_size - (gint) node->local_size,
+			 0);
+	node->msg_count = msg_count;
+	node->local_size = local_size;
+}
+
+/* Must be called with the lock held. The folder store of the node
+   was finalized and now @store is the instance for the same id, so
+   the node starts watching it. Returns TRUE if @store has to be
+   observed */
+static gboolean
+rebind_node (StatsNode *node, TnyFolderStore *store)
+{
+	if (node->store)
+		return FALSE;
+
+	node->store = store;
+	g_object_add_weak_pointer ((GObject *) store, (gpointer *) &node->store);
+
+	return TRUE;
+}
+
+/* Must be called with the lock held. It takes the ownership of
+   @id. Returns the new or the rebound node, or NULL if it was
+   already there or if the parent is not tracked */
+static StatsNode *
+add_node (ModestFolderStatsMgrPrivate *priv,
+	  TnyFolderStore *store,
+	  gchar *id,
+	  const gchar *parent_id,
+	  guint msg_count,
+	  guint local_size)
+{
+	StatsNode *node, *parent = NULL;
+
+	node = g_hash_table_lookup (priv->nodes, id);
+	if (node) {
+		g_free (id);
+		if (!rebind_node (node, store))
+			return NULL;
+		set_node_stats (node, msg_count, local_size);
+		return node;
+	}
+
+	if (parent_id) {
+		parent = g_hash_table_lookup (priv->nodes, parent_id);
+		if (!parent) {
+			g_free (id);
+			return NULL;
+		}
+	}
+
+	node = g_slice_new0 (StatsNode);
+	node->id = id;
+	/* Do not keep the folders alive, they're already kept by
+	   their stores while they're in use */
+	node->store = store;
+	g_object_add_weak_pointer ((GObject *) store, (gpointer *) &node->store);
+	node->parent = parent;
+	node->msg_count = msg_count;
+	node->local_size = local_size;
+	node->subtree.msg_count = msg_count;
+	node->subtree.local_size = local_size;
+	node->subtree.folders = 0;
+
+	g_hash_table_insert (priv->nodes, node->id, node);
+	if (parent) {
+		parent->children = g_slist_prepend (parent->children, node);
+		propagate_delta (parent, msg_count, local_size, 1);
+	}
+
+	return node;
+}
+
+/* Must be called with the lock held. Removes the node and its
+   descendants, and returns the list of folder stores that were being
+   observed (the caller must unref them) */
+static GSList *
+remove_node (ModestFolderStatsMgrPrivate *priv,
+	     StatsNode *node,
+	     GSList *removed)
+{
+	while (node->children) {
+		StatsNode *child = (StatsNode *) node->children->data;
+		removed = remove_node (priv, child, removed);
+	}
+
+	if (node->parent) {
+		node->parent->children = g_slist_remove (node->parent->children, node);
+		propagate_delta (node->parent,
+				 - (gint) node->subtree.msg_count,
+				 - (gint) node->subtree.local_size,
+				 - (gint) (node->subtree.folders + 1));
+	}
+
+	if (node->store)
+		removed = g_slist_prepend (removed, g_object_ref (node->store));
+	g_hash_table_remove (priv->nodes, node->id);
+
+	return removed;
+}
+
+static void
+stop_observing (ModestFolderStatsMgr *self, GSList *stores)
+{
+	GSList *node;
+
+	for (node = stores; node; node = g_slist_next (node)) {
+		TnyFolderStore *store = TNY_FOLDER_STORE (node->data);
+
+		if (TNY_IS_FOLDER (store))
+			tny_folder_remove_observer (TNY_FOLDER (store), TNY_FOLDER_OBSERVER (self));
+		tny_folder_store_remove_observer (store, TNY_FOLDER_STORE_OBSERVER (self));
+		g_object_unref (store);
+	}
+	g_slist_free (stores);
+}
+
+static void
+remove_store (ModestFolderStatsMgr *self, TnyFolderStore *store)
+{
+	ModestFolderStatsMgrPrivate *priv;
+	StatsNode *node;
+	GSList *removed = NULL;
+	gchar *id;
+
+	priv = MODEST_FOLDER_STATS_MGR_GET_PRIVATE (self);
+
+	id = get_store_id (store);
+	if (!id)
+		return;
+
+	g_mutex_lock (priv->lock);
+	node = g_hash_table_lookup (priv->nodes, id);
+	if (node)
+		removed = remove_node (priv, node, NULL);
+	g_mutex_unlock (priv->lock);
+	g_free (id);
+
+	stop_observing (self, removed);
+}
+
+/* Adds a folder (and asynchronously its subfolders) under @parent */
+static void
+add_folder (ModestFolderStatsMgr *self,
+	    TnyFolderStore *parent,
+	    TnyFolder *folder)
+{
+	ModestFolderStatsMgrPrivate *priv;
+	gchar *id, *parent_id;
+	guint msg_count, local_size;
+	StatsNode *node;
+
+	priv = MODEST_FOLDER_STATS_MGR_GET_PRIVATE (self);
+
+	id = get_store_id (TNY_FOLDER_STORE (folder));
+	parent_id = get_store_id (parent);
+	if (!id || !parent_id) {
+		g_free (id);
+		g_free (parent_id);
+		return;
+	}
+
+	/* Read them outside the lock */
+	msg_count = tny_folder_get_all_count (folder);
+	local_size = tny_folder_get_local_size (folder);
+
+	g_mutex_lock (priv->lock);
+	node = add_node (priv, TNY_FOLDER_STORE (folder), id, parent_id, msg_count, local_size);
+	g_mutex_unlock (priv->lock);
+	g_free (parent_id);
+
+	if (!node)
+		return;
+
+	tny_folder_add_observer (folder, TNY_FOLDER_OBSERVER (self));
+	tny_folder_store_add_observer (TNY_FOLDER_STORE (folder),
+				       TNY_FOLDER_STORE_OBSERVER (self));
+
+	/* Avoid the outbox, as in modest_tny_folder_store_get_folder_stats */
+	if (!TNY_IS_MERGE_FOLDER (folder) &&
+	    tny_folder_get_folder_type (folder) != TNY_FOLDER_TYPE_OUTBOX)
+		track_children (self, TNY_FOLDER_STORE (folder));
+}
+
+static void
+on_get_folders_cb (TnyFolderStore *folder_store,
+		   gboolean canceled,
+		   TnyList *list,
+		   GError *err,
+		   gpointer user_data)
+{
+	ModestFolderStatsMgr *self = MODEST_FOLDER_STATS_MGR (user_data);
+	TnyIterator *iter;
+
+	if (canceled || err)
+		goto frees;
+
+	iter = tny_list_create_iterator (list);
+	while (!tny_iterator_is_done (iter)) {
+		GObject *folder = tny_iterator_get_current (iter);
+
+		if (TNY_IS_FOLDER (folder))
+			add_folder (self, folder_store, TNY_FOLDER (folder));
+		g_object_unref (folder);
+		tny_iterator_next (iter);
+	}
+	g_object_unref (iter);
+
+ frees:
+	g_object_unref (self);
+}
+
+static void
+track_children (ModestFolderStatsMgr *self, TnyFolderStore *store)
+{
+	TnyList *folders;
+
+	folders = tny_simple_list_new ();
+	tny_folder_store_get_folders_async (store, folders, NULL, FALSE,
+					    on_get_folders_cb, NULL,
+					    g_object_ref (self));
+	g_object_unref (folders);
+}
+
+static void
+on_account_inserted (TnyAccountStore *account_store,
+		     TnyAccount *account,
+		     gpointer user_data)
+{
+	modest_folder_stats_mgr_add_account (MODEST_FOLDER_STATS_MGR (user_data), account);
+}
+
+static void
+on_account_removed (TnyAccountStore *account_store,
+		    TnyAccount *account,
+		    gpointer user_data)
+{
+	modest_folder_stats_mgr_remove_account (MODEST_FOLDER_STATS_MGR (user_data), account);
+}
+
+ModestFolderStatsMgr*
+modest_folder_stats_mgr_new (TnyAccountStore *account_store)
+{
+	ModestFolderStatsMgr *self;
+	ModestFolderStatsMgrPrivate *priv;
+	TnyList *accounts;
+	TnyIterator *iter;
+
+	g_return_val_if_fail (TNY_IS_ACCOUNT_STORE (account_store), NULL);
+
+	self = MODEST_FOLDER_STATS_MGR (g_object_new (MODEST_TYPE_FOLDER_STATS_MGR, NULL));
+	priv = MODEST_FOLDER_STATS_MGR_GET_PRIVATE (self);
+
+	priv->account_store = g_object_ref (account_store);
+	priv->account_inserted_handler =
+		g_signal_connect (account_store, "account_inserted",
+				  G_CALLBACK (on_account_inserted), self);
+	priv->account_removed_handler =
+		g_signal_connect (account_store, "account_removed",
+				  G_CALLBACK (on_account_removed), self);
+
+	accounts = tny_simple_list_new ();
+	tny_account_store_get_accounts (account_store, accounts,
+					TNY_ACCOUNT_STORE_STORE_ACCOUNTS);
+	iter = tny_list_create_iterator (accounts);
+	while (!tny_iterator_is_done (iter)) {
+		TnyAccount *account = TNY_ACCOUNT (tny_iterator_get_current (iter));
+
+		modest_folder_stats_mgr_add_account (self, account);
+		g_object_unref (account);
+		tny_iterator_next (iter);
+	}
+	g_object_unref (iter);
+	g_object_unref (accounts);
+
+	return self;
+}
+
+void
+modest_folder_stats_mgr_add_account (ModestFolderStatsMgr *self,
+				     TnyAccount *account)
+{
+	ModestFolderStatsMgrPrivate *priv;
+	StatsNode *node;
+	gchar *id;
+
+	g_return_if_fail (MODEST_IS_FOLDER_STATS_MGR (self));
+	g_return_if_fail (TNY_IS_ACCOUNT (account));
+
+	/* Transport accounts have no folders */
+	if (!TNY_IS_FOLDER_STORE (account))
+		return;
+
+	priv = MODEST_FOLDER_STATS_MGR_GET_PRIVATE (self);
+
+	id = get_store_id (TNY_FOLDER_STORE (account));
+	if (!id)
+		return;
+
+	g_mutex_lock (priv->lock);
+	node = add_node (priv, TNY_FOLDER_STORE (account), id, NULL, 0, 0);
+	g_mutex_unlock (priv->lock);
+
+	if (!node)
+		return;
+
+	tny_folder_store_add_observer (TNY_FOLDER_STORE (account),
+				       TNY_FOLDER_STORE_OBSERVER (self));
+	track_children (self, TNY_FOLDER_STORE (account));
+}
+
+void
+modest_folder_stats_mgr_remove_account (ModestFolderStatsMgr *self,
+					TnyAccount *account)
+{
+	g_return_if_fail (MODEST_IS_FOLDER_STATS_MGR (self));
+	g_return_if_fail (TNY_IS_ACCOUNT (account));
+
+	if (TNY_IS_FOLDER_STORE (account))
+		remove_store (self, TNY_FOLDER_STORE (account));
+}
+
+static void
+update_folder (ModestFolderStatsMgr *self,
+	       TnyFolder *folder,
+	       guint msg_count,
+	       guint local_size)
+{
+	ModestFolderStatsMgrPrivate *priv;
+	StatsNode *node;
+	gboolean rebound = FALSE;
+	gchar *id;
+
+	priv = MODEST_FOLDER_STATS_MGR_GET_PRIVATE (self);
+
+	id = get_store_id (TNY_FOLDER_STORE (folder));
+	if (!id)
+		return;
+
+	g_mutex_lock (priv->lock);
+	node = g_hash_table_lookup (priv->nodes, id);
+	if (node) {
+		rebound = rebind_node (node, TNY_FOLDER_STORE (folder));
+		set_node_stats (node, msg_count, local_size);
+	}
+	g_mutex_unlock (priv->lock);
+	g_free (id);
+
+	/* The instance we were observing was finalized, observe the
+	   new one so its stats do not get stale */
+	if (rebound) {
+		tny_folder_add_observer (folder, TNY_FOLDER_OBSERVER (self));
+		tny_folder_store_add_observer (TNY_FOLDER_STORE (folder),
+					       TNY_FOLDER_STORE_OBSERVER (self));
+	}
+}
+
+void
+modest_folder_stats_mgr_folder_changed (ModestFolderStatsMgr *self,
+					TnyFolder *folder)
+{
+	g_return_if_fail (MODEST_IS_FOLDER_STATS_MGR (self));
+	g_return_if_fail (TNY_IS_FOLDER (folder));
+
+	update_folder (self, folder,
+		       tny_folder_get_all_count (folder),
+		       tny_folder_get_local_size (folder));
+}
+
+gboolean
+modest_folder_stats_mgr_get_stats_by_id (ModestFolderStatsMgr *self,
+					 const gchar *id,
+					 ModestFolderStats *stats)
+{
+	ModestFolderStatsMgrPrivate *priv;
+	StatsNode *node;
+
+	g_return_val_if_fail (MODEST_IS_FOLDER_STATS_MGR (self), FALSE);
+	g_return_val_if_fail (id && stats, FALSE);
+
+	priv = MODEST_FOLDER_STATS_MGR_GET_PRIVATE (self);
+
+	g_mutex_lock (priv->lock);
+	node = g_hash_table_lookup (priv->nodes, id);
+	if (node)
+		*stats = node->subtree;
+	g_mutex_unlock (priv->lock);
+
+	return node != NULL;
+}
+
+gboolean
+modest_folder_stats_mgr_get_stats (ModestFolderStatsMgr *self,
+				   TnyFolderStore *store,
+				   ModestFolderStats *stats)
+{
+	gboolean retval;
+	gchar *id;
+
+	g_return_val_if_fail (MODEST_IS_FOLDER_STATS_MGR (self), FALSE);
+	g_return_val_if_fail (TNY_IS_FOLDER_STORE (store), FALSE);
+
+	id = get_store_id (store);
+	if (!id)
+		return FALSE;
+
+	retval = modest_folder_stats_mgr_get_stats_by_id (self, id, stats);
+	g_free (id);
+
+	return retval;
+}
+
+static void
+collect_ids (gpointer key, gpointer value, gpointer user_data)
+{
+	GSList **ids = (GSList **) user_data;
+	*ids = g_slist_prepend (*ids, key);
+}
+
+gchar*
+modest_folder_stats_mgr_to_string (ModestFolderStatsMgr *self)
+{
+	ModestFolderStatsMgrPrivate *priv;
+	GString *str;
+	GSList *ids = NULL, *cursor;
+
+	g_return_val_if_fail (MODEST_IS_FOLDER_STATS_MGR (self), NULL);
+
+	priv = MODEST_FOLDER_STATS_MGR_GET_PRIVATE (self);
+
+	str = g_string_new ("");
+
+	g_mutex_lock (priv->lock);
+	g_hash_table_foreach (priv->nodes, collect_ids, &ids);
+	ids = g_slist_sort (ids, (GCompareFunc) strcmp);
+	g_string_append_printf (str, "folder stats (%02d)\n-------------------------\n",
+				g_slist_length (ids));
+	for (cursor = ids; cursor; cursor = g_slist_next (cursor)) {
+		StatsNode *node = g_hash_table_lookup (priv->nodes, cursor->data);
+
+		g_string_append_printf (str, "%s: msgs=%u size=%u folders=%u (own msgs=%u size=%u)\n",
+					node->id,
+					node->subtree.msg_count,
+					node->subtree.local_size,
+					node->subtree.folders,
+					node->msg_count,
+					node->local_size);
+	}
+	g_mutex_unlock (priv->lock);
+	g_slist_free (ids);
+
+	return g_string_free (str, FALSE);
+}
+
+/* Folder observer: keeps the counts and the local size up to date */
+static void
+folder_observer_update (TnyFolderObserver *self, TnyFolderChange *change)
+{
+	TnyFolderChangeChanged changed;
+	TnyFolder *folder;
+
+	changed = tny_folder_change_get_changed (change);
+	if (!(changed & (TNY_FOLDER_CHANGE_CHANGED_ALL_COUNT |
+			 TNY_FOLDER_CHANGE_CHANGED_ADDED_HEADERS |
+			 TNY_FOLDER_CHANGE_CHANGED_EXPUNGED_HEADERS |
+			 TNY_FOLDER_CHANGE_CHANGED_MSG_RECEIVED)))
+		return;
+
+	folder = tny_folder_change_get_folder (change);
+	if (!folder)
+		return;
+
+	modest_folder_stats_mgr_folder_changed (MODEST_FOLDER_STATS_MGR (self), folder);
+	g_object_unref (folder);
+}
+
+/* Folder store observer: keeps track of created and removed folders */
+static void
+folder_store_observer_update (TnyFolderStoreObserver *self, TnyFolderStoreChange *change)
+{
+	TnyFolderStoreChangeChanged changed;
+	TnyFolderStore *store;
+	TnyList *list;
+	TnyIterator *iter;
+
+	changed = tny_folder_store_change_get_changed (change);
+	store = tny_folder_store_change_get_folder_store (change);
+	if (!store)
+		return;
+
+	if (changed & TNY_FOLDER_STORE_CHANGE_CHANGED_REMOVED_FOLDERS) {
+		list = tny_simple_list_new ();
+		tny_folder_store_change_get_removed_folders (change, list);
+		iter = tny_list_create_iterator (list);
+		while (!tny_iterator_is_done (iter)) {
+			TnyFolderStore *folder = TNY_FOLDER_STORE (tny_iterator_get_current (iter));
+			remove_store (MODEST_FOLDER_STATS_MGR (self), folder);
+			g_object_unref (folder);
+			tny_iterator_next (iter);
+		}
+		g_object_unref (iter);
+		g_object_unref (list);
+	}
+
+	if (changed & TNY_FOLDER_STORE_CHANGE_CHANGED_CREATED_FOLDERS) {
+		list = tny_simple_list_new ();
+		tny_folder_store_change_get_created_folders (change, list);
+		iter = tny_list_create_iterator (list);
+		while (!tny_iterator_is_done (iter)) {
+			GObject *folder = tny_iterator_get_current (iter);
+			if (TNY_IS_FOLDER (folder))
+				add_folder (MODEST_FOLDER_STATS_MGR (self), store, TNY_FOLDER (folder));
+			g_object_unref (folder);
+			tny_iterator_next (iter);
+		}
+		g_object_unref (iter);
+		g_object_unref (list);
+	}
+
+	g_object_unref (store);
+}
+
+static void
+tny_folder_observer_init (TnyFolderObserverIface *iface)
+{
+	iface->update = folder_observer_update;
+}
+
+static void
+tny_folder_store_observer_init (TnyFolderStoreObserverIface *iface)
+{
+	iface->update = folder_store_observer_update;
+}
@@ -0,0 +1,166 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MODEST_FOLDER_STATS_MGR_H__
+#define __MODEST_FOLDER_STATS_MGR_H__
+
+#include <glib-object.h>
+#include <tny-account-store.h>
+#include <tny-folder-store.h>
+#include <modest-tny-account.h>
+
+G_BEGIN_DECLS
+
+/* convenience macros */
+#define MODEST_TYPE_FOLDER_STATS_MGR             (modest_folder_stats_mgr_get_type())
+#define MODEST_FOLDER_STATS_MGR(obj)             (G_TYPE_CHECK_INSTANCE_CAST((obj),MODEST_TYPE_FOLDER_STATS_MGR,ModestFolderStatsMgr))
+#define MODEST_FOLDER_STATS_MGR_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST((klass),MODEST_TYPE_FOLDER_STATS_MGR,GObject))
+#define MODEST_IS_FOLDER_STATS_MGR(obj)          (G_TYPE_CHECK_INSTANCE_TYPE((obj),MODEST_TYPE_FOLDER_STATS_MGR))
+#define MODEST_IS_FOLDER_STATS_MGR_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE((klass),MODEST_TYPE_FOLDER_STATS_MGR))
+#define MODEST_FOLDER_STATS_MGR_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS((obj),MODEST_TYPE_FOLDER_STATS_MGR,ModestFolderStatsMgrClass))
+
+typedef struct _ModestFolderStatsMgr      ModestFolderStatsMgr;
+typedef struct _ModestFolderStatsMgrClass ModestFolderStatsMgrClass;
+
+struct _ModestFolderStatsMgr {
+	 GObject parent;
+};
+
+struct _ModestFolderStatsMgrClass {
+	GObjectClass parent_class;
+};
+
+/**
+ * modest_folder_stats_mgr_get_type:
+ *
+ * get the GType for ModestFolderStatsMgr
+ *
+ * Returns: the GType
+ */
+GType        modest_folder_stats_mgr_get_type    (void) G_GNUC_CONST;
+
+/**
+ * modest_folder_stats_mgr_new:
+ * @account_store: the #TnyAccountStore whose store accounts will be tracked
+ *
+ * instantiate a new folder stats mgr. It keeps the message count,
+ * the local size and the number of subfolders of every folder of
+ * the store accounts of @account_store. The folders are not kept
+ * alive by the manager, only observed. The statistics are
+ * collected asynchronously when the accounts are added, and then
+ * kept up to date incrementally from the folder and folder store
+ * observers, so queries never need to traverse the folder tree
+ *
+ * Returns: a new #ModestFolderStatsMgr
+ */
+ModestFolderStatsMgr* modest_folder_stats_mgr_new (TnyAccountStore *account_store);
+
+/**
+ * modest_folder_stats_mgr_add_account:
+ * @self: a #ModestFolderStatsMgr
+ * @account: a #TnyStoreAccount
+ *
+ * starts tracking the folders of @account. Accounts inserted in
+ * the account store are added automatically
+ */
+void         modest_folder_stats_mgr_add_account (ModestFolderStatsMgr *self,
+						  TnyAccount *account);
+
+/**
+ * modest_folder_stats_mgr_remove_account:
+ * @self: a #ModestFolderStatsMgr
+ * @account: a #TnyStoreAccount
+ *
+ * stops tracking the folders of @account. Accounts removed from the
+ * account store are removed automatically
+ */
+void         modest_folder_stats_mgr_remove_account (ModestFolderStatsMgr *self,
+						     TnyAccount *account);
+
+/**
+ * modest_folder_stats_mgr_get_stats:
+ * @self: a #ModestFolderStatsMgr
+ * @store: a #TnyFolder or a #TnyAccount
+ * @stats: a #ModestFolderStats that will be filled with the stats of
+ * @store and all its descendants
+ *
+ * gets the statistics of the subtree whose root is @store. This is
+ * a constant time operation
+ *
+ * Returns: %TRUE if @store is being tracked, %FALSE otherwise (in
+ * that case @stats is not modified)
+ */
+gboolean     modest_folder_stats_mgr_get_stats (ModestFolderStatsMgr *self,
+						TnyFolderStore *store,
+						ModestFolderStats *stats);
+
+/**
+ * modest_folder_stats_mgr_get_stats_by_id:
+ * @self: a #ModestFolderStatsMgr
+ * @id: the id of an account or the URL of a folder
+ * @stats: a #ModestFolderStats
+ *
+ * same as modest_folder_stats_mgr_get_stats() but using the account
+ * id or the folder URL string as identifier
+ *
+ * Returns: %TRUE if @id is being tracked, %FALSE otherwise
+ */
+gboolean     modest_folder_stats_mgr_get_stats_by_id (ModestFolderStatsMgr *self,
+						      const gchar *id,
+						      ModestFolderStats *stats);
+
+/**
+ * modest_folder_stats_mgr_folder_changed:
+ * @self: a #ModestFolderStatsMgr
+ * @folder: a #TnyFolder
+ *
+ * re-reads the message count and the local size of @folder. The
+ * manager calls it for the changes notified to its folder observer.
+ * Use it too after writing into the folder cache (for example after
+ * retrieving messages) as those changes are not always notified.
+ * If the instance of @folder that was being observed was finalized,
+ * the manager starts observing @folder
+ */
+void         modest_folder_stats_mgr_folder_changed (ModestFolderStatsMgr *self,
+						     TnyFolder *folder);
+
+/**
+ * modest_folder_stats_mgr_to_string:
+ * @self: a #ModestFolderStatsMgr
+ *
+ * Returns a string representation of the stats of every tracked
+ * account and folder (for debugging and monitoring)
+ *
+ * Returns: a newly allocated string
+ */
+gchar*       modest_folder_stats_mgr_to_string (ModestFolderStatsMgr *self);
+
+G_END_DECLS
+
+#endif /* __MODEST_FOLDER_STATS_MGR_H__ */
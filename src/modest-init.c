@@ -53,7 +53,13 @@
 #include <libgnomevfs/gnome-vfs.h>
 #include <string.h>
 #include "modest-text-utils.h"
+#include "modest-startup.h"
+#include "modest-mail-operation.h"
+#include "modest-mail-operation-stats.h"
+#include "modest-autosave.h"
+#include "modest-recipient-index.h"
 #include <locale.h>
+#include <gtk/gtk.h>
 #ifdef MODEST_TOOLKIT_HILDON2
 #include "modest-hildon-includes.h"
 #endif
@@ -67,9 +73,19 @@ static void     init_debug_logging (void);
 static void     init_default_settings (ModestConf *conf);
 static void     init_device_name (ModestConf *conf);
 static gboolean init_ui (gint argc, gchar** argv);
+static gboolean init_ui_subsystems (gint argc, gchar** argv);
+static void     init_local_folders (void);
 
 
 static gboolean _is_initialized = FALSE;
+static gboolean _ui_initialized = FALSE;
+
+/* set by init_local_folders, read once its barrier is ready */
+static gboolean _local_folders_initialized = FALSE;
+
+/* kept to initialize the UI on demand */
+static gint _argc = 0;
+static gchar **_argv = NULL;
 
 /*
  * defaults for the column headers
@@ -198,6 +214,21 @@ force_ke_recv_load (void)
 
 gboolean
 modest_init (int argc, char *argv[])
+{
+	if (!modest_init_without_ui (argc, argv))
+		return FALSE;
+
+	if (!init_ui_subsystems (argc, argv)) {
+		modest_init_uninit ();
+		g_printerr ("modest: failed to init ui\n");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+gboolean
+modest_init_without_ui (int argc, char *argv[])
 {
 	gboolean reset;
 
@@ -206,6 +237,8 @@ modest_init (int argc, char *argv[])
 		return FALSE;
 	}
 
+	modest_startup_phase_start ();
+
 	init_i18n();
 
 	if (!force_ke_recv_load()) {
@@ -221,6 +254,7 @@ modest_init (int argc, char *argv[])
 
 	/* initialize the prng, we need it when creating random files */
 	srandom((int)getpid());
+	modest_startup_phase_done ("i18n-debug");
 
 	if (!gnome_vfs_initialized()) {
 		if (!gnome_vfs_init ()) {
@@ -228,26 +262,43 @@ modest_init (int argc, char *argv[])
 			return FALSE;
 		}
 	}
+	modest_startup_phase_done ("gnome-vfs");
 
 	if (!modest_runtime_init()) {
 		modest_init_uninit ();
 		g_printerr ("modest: failed to initialize the modest runtime\n");
 		return FALSE;
 	}
+	modest_startup_phase_done ("runtime");
 
+	/* The plugins add protocols, and main() creates the account
+	   store, that needs them, right after this function */
 	modest_plugin_factory_load_all (modest_runtime_get_plugin_factory ());
+	modest_startup_phase_done ("plugins");
+
+	/* Only touches the file system, so it can be done in a
+	   thread while we read the configuration. It's waited for at
+	   the end of this function */
+	modest_startup_defer (MODEST_STARTUP_BARRIER_LOCAL_FOLDERS,
+			      MODEST_STARTUP_DEFER_THREAD,
+			      init_local_folders);
+
+	/* The recipient index is only needed when the user starts
+	   typing addresses */
+	modest_startup_defer (MODEST_STARTUP_BARRIER_RECIPIENT_INDEX,
+			      MODEST_STARTUP_DEFER_THREAD,
+			      modest_recipient_index_load);
 
 	/* do an initial guess for the device name */
 	init_device_name (modest_runtime_get_conf());
+	modest_startup_phase_done ("device-name");
 
 	if (!modest_platform_init(argc, argv)) {
 		modest_init_uninit ();
 		g_printerr ("modest: failed to run platform-specific initialization\n");
 		return FALSE;
 	}
-
-	/* Initialize addressbook */
-	modest_address_book_init ();
+	modest_startup_phase_done ("platform");
 
 	reset = modest_runtime_get_debug_flags () & MODEST_RUNTIME_DEBUG_FACTORY_SETTINGS;
 	if (!init_header_columns(modest_runtime_get_conf(), TRUE)) {
@@ -255,28 +306,99 @@ modest_init (int argc, char *argv[])
 		g_printerr ("modest: failed to init header columns\n");
 		return FALSE;
 	}
+	modest_startup_phase_done ("header-columns");
 
 	init_default_settings (modest_runtime_get_conf ());
+	modest_startup_phase_done ("default-settings");
 
-	if (!modest_init_local_folders(NULL)) {
+	if (!init_default_account_maybe (modest_runtime_get_account_mgr ())) {
 		modest_init_uninit ();
-		g_printerr ("modest: failed to init local folders\n");
+		g_printerr ("modest: failed to init default account\n");
 		return FALSE;
 	}
+	modest_startup_phase_done ("default-account");
 
-	if (!init_default_account_maybe (modest_runtime_get_account_mgr ())) {
+	/* The account store needs them */
+	modest_startup_wait (MODEST_STARTUP_BARRIER_LOCAL_FOLDERS);
+	if (!_local_folders_initialized) {
 		modest_init_uninit ();
-		g_printerr ("modest: failed to init default account\n");
+		g_printerr ("modest: failed to init local folders\n");
 		return FALSE;
 	}
 
-	if (!init_ui (argc, argv)) {
-		modest_init_uninit ();
+	_argc = argc;
+	_argv = argv;
+
+	return _is_initialized = TRUE;
+}
+
+gboolean
+modest_init_ui (void)
+{
+	if (_ui_initialized)
+		return TRUE;
+
+	if (!_is_initialized) {
+		g_printerr ("modest: %s called before modest_init_without_ui\n", __FUNCTION__);
+		return FALSE;
+	}
+
+	/* This is the first time we need Gtk+ */
+	if (!gtk_init_check (&_argc, &_argv)) {
+		g_printerr ("modest: failed to initialize gtk\n");
+		return FALSE;
+	}
+
+	if (!init_ui_subsystems (_argc, _argv)) {
 		g_printerr ("modest: failed to init ui\n");
 		return FALSE;
 	}
 
-	return _is_initialized = TRUE;
+	/* Create cached windows */
+	modest_window_mgr_create_caches (modest_runtime_get_window_mgr ());
+
+	return TRUE;
+}
+
+gboolean
+modest_init_ui_is_initialized (void)
+{
+	return _ui_initialized;
+}
+
+static gboolean
+init_ui_subsystems (gint argc, gchar** argv)
+{
+	modest_startup_phase_start ();
+
+	if (!modest_platform_init_ui (argc, argv)) {
+		g_printerr ("modest: failed to run platform-specific ui initialization\n");
+		return FALSE;
+	}
+	modest_startup_phase_done ("platform-ui");
+
+	/* Initialize addressbook. Opening it could take seconds,
+	   and it's not needed to show the first window */
+	modest_startup_defer (MODEST_STARTUP_BARRIER_ADDRESS_BOOK,
+			      MODEST_STARTUP_DEFER_IDLE,
+			      modest_address_book_init);
+
+	if (!init_ui (argc, argv))
+		return FALSE;
+	modest_startup_phase_done ("ui");
+
+	/* Save the drafts of the editors of a crashed session */
+	modest_startup_defer (MODEST_STARTUP_BARRIER_AUTOSAVE,
+			      MODEST_STARTUP_DEFER_IDLE,
+			      modest_autosave_recover);
+
+	return _ui_initialized = TRUE;
+}
+
+static void
+init_local_folders (void)
+{
+	_local_folders_initialized = modest_init_local_folders (NULL);
 }
 
 
@@ -298,11 +420,39 @@ init_ui (gint argc, gchar** argv)
 }
 
 
+/* Seconds to wait for the remote drafts uploads when exiting */
+#define REMOTE_DRAFTS_FLUSH_TIMEOUT 15
+
 gboolean
 modest_init_uninit (void)
 {
 	if (!_is_initialized)
 		return TRUE; 
+
+	/* Do not run the deferred initialization while exiting */
+	modest_startup_shutdown ();
+
+	/* Upload the remote drafts that are still waiting. The main
+	   loop is not running anymore, so it's iterated here until
+	   they finish, with a limit */
+	if (modest_mail_operation_flush_remote_drafts ()) {
+		GTimer *timer = g_timer_new ();
+		while (modest_mail_operation_flush_remote_drafts () &&
+		       g_timer_elapsed (timer, NULL) < REMOTE_DRAFTS_FLUSH_TIMEOUT) {
+			if (!g_main_context_iteration (NULL, FALSE))
+				g_usleep (G_USEC_PER_SEC / 20);
+		}
+		g_timer_destroy (timer);
+	}
+
+	/* Do not lose the last operation stats */
+	modest_mail_operation_stats_flush ();
+
+	/* Finish writing the autosave journals */
+	modest_autosave_shutdown ();
+
+	/* Save the addresses used in this session */
+	modest_recipient_index_flush ();
 	
 	if (!modest_runtime_uninit())
 		g_printerr ("modest: failed to uninit runtime\n");
@@ -314,6 +464,7 @@ modest_init_uninit (void)
 		gnome_vfs_shutdown ();
 
 	_is_initialized = FALSE;
+	_ui_initialized = FALSE;
 	return TRUE;
 }
 
@@ -621,95 +772,111 @@ init_i18n (void)
 }
 
 
-/* 
- *  This function registers our custom toolbar icons, so they can be
- *  themed. The idea of this function was taken from the gtk-demo
- */
-static void
-init_stock_icons (void)
-{
-	static gboolean registered = FALSE;
-
-	if (!registered) {
-		GtkIconTheme *current_theme;
-		GdkPixbuf *pixbuf;
-		GtkIconFactory *factory;
-		gint i;
-
-		static GtkStockItem items[] = {
+static GtkStockItem stock_items[] = {
 #ifdef MODEST_TOOLKIT_HILDON2
-			{ MODEST_STOCK_SORT, "sort mail", 0, 0, NULL },
-			{ MODEST_STOCK_REFRESH, "refresh mail", 0, 0, NULL },
+	{ MODEST_STOCK_SORT, "sort mail", 0, 0, NULL },
+	{ MODEST_STOCK_REFRESH, "refresh mail", 0, 0, NULL },
 #endif /*MODEST_TOOLKIT_GTK*/
-			{ MODEST_STOCK_MAIL_SEND, "send mail", 0, 0, NULL },
-			{ MODEST_STOCK_NEW_MAIL, "new mail", 0, 0, NULL },
-			{ MODEST_STOCK_REPLY, "reply", 0, 0, NULL },
-			{ MODEST_STOCK_REPLY_ALL, "reply all", 0, 0, NULL },
-			{ MODEST_STOCK_FORWARD, "forward", 0, 0, NULL },
- 			{ MODEST_STOCK_DELETE, "delete", 0, 0, NULL },
-		};
+	{ MODEST_STOCK_MAIL_SEND, "send mail", 0, 0, NULL },
+	{ MODEST_STOCK_NEW_MAIL, "new mail", 0, 0, NULL },
+	{ MODEST_STOCK_REPLY, "reply", 0, 0, NULL },
+	{ MODEST_STOCK_REPLY_ALL, "reply all", 0, 0, NULL },
+	{ MODEST_STOCK_FORWARD, "forward", 0, 0, NULL },
+	{ MODEST_STOCK_DELETE, "delete", 0, 0, NULL },
+};
 
-		static gchar *items_names [] = {
+static gchar *stock_items_names [] = {
 #ifdef MODEST_TOOLKIT_HILDON2
-			MODEST_TOOLBAR_ICON_SORT,
-			MODEST_TOOLBAR_ICON_REFRESH,
+	MODEST_TOOLBAR_ICON_SORT,
+	MODEST_TOOLBAR_ICON_REFRESH,
 #endif /*MODEST_TOOLKIT_GTK*/
-			MODEST_TOOLBAR_ICON_MAIL_SEND,
-			MODEST_TOOLBAR_ICON_NEW_MAIL,
-			MODEST_TOOLBAR_ICON_REPLY,
-			MODEST_TOOLBAR_ICON_REPLY_ALL,
-			MODEST_TOOLBAR_ICON_FORWARD,
- 			MODEST_TOOLBAR_ICON_DELETE,
-		};
+	MODEST_TOOLBAR_ICON_MAIL_SEND,
+	MODEST_TOOLBAR_ICON_NEW_MAIL,
+	MODEST_TOOLBAR_ICON_REPLY,
+	MODEST_TOOLBAR_ICON_REPLY_ALL,
+	MODEST_TOOLBAR_ICON_FORWARD,
+	MODEST_TOOLBAR_ICON_DELETE,
+};
 
-		registered = TRUE;
+/* The icons from this one on are only used by the message view
+   window toolbar, so they're loaded after the first window is shown */
+#define FIRST_DEFERRED_STOCK_ITEM (G_N_ELEMENTS (stock_items) - 4)
 
-		/* Register our stock items */
-		gtk_stock_add (items, G_N_ELEMENTS (items));
+static GtkIconFactory *stock_icon_factory = NULL;
 
-		/* Add our custom icon factory to the list of defaults */
-		factory = gtk_icon_factory_new ();
-		gtk_icon_factory_add_default (factory);
+static void
+load_stock_icons (guint first, guint last)
+{
+	GtkIconTheme *current_theme;
+	GdkPixbuf *pixbuf;
+	guint i;
 
-		current_theme = gtk_icon_theme_get_default ();
+	current_theme = gtk_icon_theme_get_default ();
 
-		/* Register icons to accompany stock items */
-		for (i = 0; i < G_N_ELEMENTS (items); i++) {
+	/* Register icons to accompany stock items */
+	for (i = first; i < last; i++) {
 
 #ifndef MODEST_PLATFORM_GTK
-			pixbuf = gtk_icon_theme_load_icon (current_theme,
-							   items_names[i],
+		pixbuf = gtk_icon_theme_load_icon (current_theme,
+						   stock_items_names[i],
 #ifdef MODEST_TOOLKIT_HILDON2
-							   MODEST_ICON_SIZE_BIG,
+						   MODEST_ICON_SIZE_BIG,
 #else
-							   MODEST_ICON_SIZE_SMALL,
+						   MODEST_ICON_SIZE_SMALL,
 #endif
-							   GTK_ICON_LOOKUP_NO_SVG,
-							   NULL);
+						   GTK_ICON_LOOKUP_NO_SVG,
+						   NULL);
 #else
-			pixbuf = gdk_pixbuf_new_from_file (items_names[i], NULL);
+		pixbuf = gdk_pixbuf_new_from_file (stock_items_names[i], NULL);
 #endif
 
-			if (pixbuf != NULL) {
-				GtkIconSet *icon_set;
+		if (pixbuf != NULL) {
+			GtkIconSet *icon_set;
 
 #ifndef MODEST_TOOLKIT_HILDON2
-				GdkPixbuf *transparent;
-				transparent = gdk_pixbuf_add_alpha (pixbuf, TRUE, 0xff, 0xff, 0xff);
-				icon_set = gtk_icon_set_new_from_pixbuf (transparent);
-				g_object_unref (transparent);
+			GdkPixbuf *transparent;
+			transparent = gdk_pixbuf_add_alpha (pixbuf, TRUE, 0xff, 0xff, 0xff);
+			icon_set = gtk_icon_set_new_from_pixbuf (transparent);
+			g_object_unref (transparent);
 #else
-				icon_set = gtk_icon_set_new_from_pixbuf (pixbuf);
+			icon_set = gtk_icon_set_new_from_pixbuf (pixbuf);
 #endif
-				gtk_icon_factory_add (factory, items[i].stock_id, icon_set);
-				gtk_icon_set_unref (icon_set);
-				g_object_unref (pixbuf);
-			}
-			else
-				g_warning ("%s: failed to load %s icon", __FUNCTION__, items_names[i]);
+			gtk_icon_factory_add (stock_icon_factory, stock_items[i].stock_id, icon_set);
+			gtk_icon_set_unref (icon_set);
+			g_object_unref (pixbuf);
 		}
-		/* Drop our reference to the factory, GTK will hold a reference. */
-		g_object_unref (factory);
+		else
+			g_warning ("%s: failed to load %s icon", __FUNCTION__, stock_items_names[i]);
+	}
+}
+
+static void
+init_deferred_stock_icons (void)
+{
+	load_stock_icons (FIRST_DEFERRED_STOCK_ITEM, G_N_ELEMENTS (stock_items));
+}
+
+/* 
+ *  This function registers our custom toolbar icons, so they can be
+ *  themed. The idea of this function was taken from the gtk-demo
+ */
+static void
+init_stock_icons (void)
+{
+	if (!stock_icon_factory) {
+		/* Register our stock items */
+		gtk_stock_add (stock_items, G_N_ELEMENTS (stock_items));
+
+		/* Add our custom icon factory to the list of
+		   defaults. GTK will hold a reference */
+		stock_icon_factory = gtk_icon_factory_new ();
+		gtk_icon_factory_add_default (stock_icon_factory);
+		g_object_unref (stock_icon_factory);
+
+		load_stock_icons (0, FIRST_DEFERRED_STOCK_ITEM);
+		modest_startup_defer (MODEST_STARTUP_BARRIER_STOCK_ICONS,
+				      MODEST_STARTUP_DEFER_IDLE,
+				      init_deferred_stock_icons);
 	}
 }
 
@@ -777,6 +944,10 @@ init_default_settings (ModestConf *conf)
 	if (!modest_conf_key_exists (conf, MODEST_CONF_MSG_SIZE_LIMIT, NULL))
 		modest_conf_set_int (conf, MODEST_CONF_MSG_SIZE_LIMIT, 100, NULL);
 
+	if (!modest_conf_key_exists (conf, MODEST_CONF_AUTOSAVE_INTERVAL, NULL))
+		modest_conf_set_int (conf, MODEST_CONF_AUTOSAVE_INTERVAL,
+				     MODEST_AUTOSAVE_DEFAULT_INTERVAL, NULL);
+
 	if (!modest_conf_key_exists (conf, MODEST_CONF_PLAY_SOUND_MSG_ARRIVE, NULL))
 		modest_conf_set_bool (conf, MODEST_CONF_PLAY_SOUND_MSG_ARRIVE, FALSE, NULL);
 
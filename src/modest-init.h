@@ -51,6 +51,40 @@ G_BEGIN_DECLS
  */
 gboolean modest_init (int argc, char *argv[]);
 
+/**
+ * modest_init_without_ui:
+ * @argc:
+ * @argv:
+ *
+ * like modest_init, but it does not initialize the UI subsystems
+ * (stock icons, address book, notifications...). It's used when
+ * modest runs only to serve D-Bus requests. Gtk+ does not need to
+ * be initialized before calling it. @argv must be valid until the
+ * UI is initialized with modest_init_ui
+ *
+ * TRUE if this succeeded, FALSE otherwise.
+ */
+gboolean modest_init_without_ui (int argc, char *argv[]);
+
+/**
+ * modest_init_ui:
+ *
+ * initializes Gtk+ and the UI subsystems if modest was initialized
+ * with modest_init_without_ui, and creates the cached windows. It
+ * does nothing if the UI was already initialized
+ *
+ * TRUE if the UI is ready to be used, FALSE otherwise (for example
+ * if there is no display)
+ */
+gboolean modest_init_ui (void);
+
+/**
+ * modest_init_ui_is_initialized:
+ *
+ * TRUE if the UI subsystems were initialized, FALSE otherwise
+ */
+gboolean modest_init_ui_is_initialized (void);
+
 
 /**
  * modest_init_uninit:
@@ -28,10 +28,12 @@
  */
 
 #include "config.h"
+#include <string.h>
 #include "modest-marshal.h"
 #include "modest-mail-operation-queue.h"
 #include "modest-runtime.h"
 #include "modest-debug.h"
+#include "modest-trace.h"
 
 /* 'private'/'protected' functions */
 static void modest_mail_operation_queue_class_init (ModestMailOperationQueueClass *klass);
@@ -49,6 +51,26 @@ enum {
 	NUM_SIGNALS
 };
 
+/* an operation added with modest_mail_operation_queue_add_scheduled */
+typedef struct {
+	ModestMailOperation *mail_op;
+	gchar *account_name;
+	gchar *coalesce_key;
+	ModestMailOperationQueuePriority priority;
+	ModestMailOperationQueueRunFunc run_func;
+	gpointer userdata;
+	GDestroyNotify destroy_func;
+	gint64 queued_time;
+	gboolean running;
+} ScheduledOp;
+
+/* time the scheduled operations waited before being started */
+typedef struct {
+	guint  count;
+	gint64 total;
+	gint64 max;
+} WaitStats;
+
 typedef struct _ModestMailOperationQueuePrivate ModestMailOperationQueuePrivate;
 struct _ModestMailOperationQueuePrivate {
 	GQueue *op_queue;
@@ -56,6 +78,16 @@ struct _ModestMailOperationQueuePrivate {
 	guint   op_id;
 	guint   queue_empty_handler;
 	gboolean running_final_sync;
+
+	/* scheduler, protected by queue_lock too */
+	GList      *pending;             /* waiting ScheduledOp, by priority */
+	GHashTable *scheduled;           /* ModestMailOperation -> ScheduledOp */
+	GHashTable *running_per_account; /* account name -> running operations */
+	guint       max_running;
+	guint       max_running_per_account;
+	guint       schedule_handler;
+	guint       coalesced;
+	WaitStats   wait_stats[MODEST_MAIL_OPERATION_QUEUE_PRIORITY_NUM];
 };
 #define MODEST_MAIL_OPERATION_QUEUE_GET_PRIVATE(o)      (G_TYPE_INSTANCE_GET_PRIVATE((o), \
                                                          MODEST_TYPE_MAIL_OPERATION_QUEUE, \
@@ -150,6 +182,28 @@ modest_mail_operation_queue_init (ModestMailOperationQueue *obj)
 	priv->op_id = 0;
 	priv->queue_empty_handler = 0;
 	priv->running_final_sync = FALSE;
+
+	priv->pending = NULL;
+	priv->scheduled = g_hash_table_new (g_direct_hash, g_direct_equal);
+	priv->running_per_account = g_hash_table_new_full (g_str_hash, g_str_equal,
+							   g_free, NULL);
+	priv->max_running = MODEST_MAIL_OPERATION_QUEUE_DEFAULT_MAX_RUNNING;
+	priv->max_running_per_account = MODEST_MAIL_OPERATION_QUEUE_DEFAULT_MAX_RUNNING_PER_ACCOUNT;
+	priv->schedule_handler = 0;
+	priv->coalesced = 0;
+	memset (priv->wait_stats, 0, sizeof (priv->wait_stats));
+}
+
+static void
+scheduled_op_free (ScheduledOp *sop)
+{
+	/* Once started the run function owns the user data */
+	if (!sop->running && sop->destroy_func)
+		sop->destroy_func (sop->userdata);
+
+	g_free (sop->account_name);
+	g_free (sop->coalesce_key);
+	g_slice_free (ScheduledOp, sop);
 }
 
 static void
@@ -190,9 +244,33 @@ static void
 modest_mail_operation_queue_finalize (GObject *obj)
 {
 	ModestMailOperationQueuePrivate *priv;
+	GList *scheduled, *node;
 
 	priv = MODEST_MAIL_OPERATION_QUEUE_GET_PRIVATE(obj);
 
+	if (priv->schedule_handler) {
+		g_source_remove (priv->schedule_handler);
+		priv->schedule_handler = 0;
+	}
+
+	/* The waiting operations were never started, so there is
+	   nothing to cancel, just drop them */
+	for (node = priv->pending; node; node = g_list_next (node)) {
+		ScheduledOp *sop = (ScheduledOp *) node->data;
+
+		g_signal_handlers_disconnect_by_func (sop->mail_op, G_CALLBACK (on_operation_finished), obj);
+		g_queue_remove (priv->op_queue, sop->mail_op);
+		g_object_unref (sop->mail_op);
+	}
+	g_list_free (priv->pending);
+	priv->pending = NULL;
+
+	scheduled = g_hash_table_get_values (priv->scheduled);
+	g_list_foreach (scheduled, (GFunc) scheduled_op_free, NULL);
+	g_list_free (scheduled);
+	g_hash_table_destroy (priv->scheduled);
+	g_hash_table_destroy (priv->running_per_account);
+
 	g_mutex_lock (priv->queue_lock);
 
 	MODEST_DEBUG_BLOCK (
@@ -270,6 +348,8 @@ modest_mail_operation_queue_add (ModestMailOperationQueue *self,
 
 	priv = MODEST_MAIL_OPERATION_QUEUE_GET_PRIVATE(self);
 
+	modest_mail_operation_set_queued (mail_op);
+
 	g_mutex_lock (priv->queue_lock);
 	g_queue_push_tail (priv->op_queue, g_object_ref (mail_op));
 	g_mutex_unlock (priv->queue_lock);
@@ -295,6 +375,254 @@ modest_mail_operation_queue_add (ModestMailOperationQueue *self,
 		       mail_op, MODEST_MAIL_OPERATION_QUEUE_OPERATION_ADDED);
 }
 
+static GList *
+insert_pending_op (GList *pending, ScheduledOp *sop)
+{
+	GList *node;
+
+	/* FIFO between the operations with the same priority */
+	for (node = pending; node; node = g_list_next (node)) {
+		if (((ScheduledOp *) node->data)->priority > sop->priority)
+			break;
+	}
+
+	return g_list_insert_before (pending, node, sop);
+}
+
+static gboolean
+has_coalesce_key (gpointer key, gpointer value, gpointer user_data)
+{
+	ScheduledOp *sop = (ScheduledOp *) value;
+
+	return sop->coalesce_key && !strcmp (sop->coalesce_key, (const gchar *) user_data);
+}
+
+static guint
+get_running_for_account (ModestMailOperationQueuePrivate *priv,
+			 const gchar *account_name)
+{
+	return GPOINTER_TO_UINT (g_hash_table_lookup (priv->running_per_account, account_name));
+}
+
+static void
+update_running_for_account (ModestMailOperationQueuePrivate *priv,
+			    const gchar *account_name,
+			    gint delta)
+{
+	guint running;
+
+	running = get_running_for_account (priv, account_name) + delta;
+	if (running > 0)
+		g_hash_table_insert (priv->running_per_account,
+				     g_strdup (account_name),
+				     GUINT_TO_POINTER (running));
+	else
+		g_hash_table_remove (priv->running_per_account, account_name);
+}
+
+/* Must be called with the queue lock held */
+static ScheduledOp *
+pop_runnable_op (ModestMailOperationQueuePrivate *priv)
+{
+	GList *node;
+	guint running;
+
+	running = g_queue_get_length (priv->op_queue) - g_list_length (priv->pending);
+	if (priv->max_running && running >= priv->max_running)
+		return NULL;
+
+	for (node = priv->pending; node; node = g_list_next (node)) {
+		ScheduledOp *sop = (ScheduledOp *) node->data;
+		WaitStats *stats;
+		gint64 wait;
+
+		if (sop->account_name && priv->max_running_per_account &&
+		    get_running_for_account (priv, sop->account_name) >= priv->max_running_per_account)
+			continue;
+
+		priv->pending = g_list_delete_link (priv->pending, node);
+		sop->running = TRUE;
+		if (sop->account_name)
+			update_running_for_account (priv, sop->account_name, 1);
+
+		wait = modest_trace_get_monotonic_time () - sop->queued_time;
+		stats = &(priv->wait_stats[sop->priority]);
+		stats->count++;
+		stats->total += wait;
+		if (wait > stats->max)
+			stats->max = wait;
+
+		return sop;
+	}
+
+	return NULL;
+}
+
+static void
+run_pending_ops (ModestMailOperationQueue *self)
+{
+	ModestMailOperationQueuePrivate *priv;
+	ScheduledOp *sop;
+
+	priv = MODEST_MAIL_OPERATION_QUEUE_GET_PRIVATE(self);
+
+	g_mutex_lock (priv->queue_lock);
+	sop = pop_runnable_op (priv);
+	g_mutex_unlock (priv->queue_lock);
+
+	while (sop) {
+		MODEST_DEBUG_BLOCK (print_queue_item (sop->mail_op, "run"););
+
+		/* Do not use sop after this, the operation could
+		   finish, and be removed from the queue, inside */
+		sop->run_func (sop->mail_op, sop->userdata);
+
+		g_mutex_lock (priv->queue_lock);
+		sop = pop_runnable_op (priv);
+		g_mutex_unlock (priv->queue_lock);
+	}
+}
+
+static gboolean
+run_pending_ops_idle (gpointer user_data)
+{
+	ModestMailOperationQueue *self = (ModestMailOperationQueue *) user_data;
+	ModestMailOperationQueuePrivate *priv;
+
+	priv = MODEST_MAIL_OPERATION_QUEUE_GET_PRIVATE(self);
+	priv->schedule_handler = 0;
+
+	gdk_threads_enter ();
+	run_pending_ops (self);
+	gdk_threads_leave ();
+
+	return FALSE;
+}
+
+static void
+schedule_pending_ops (ModestMailOperationQueue *self)
+{
+	ModestMailOperationQueuePrivate *priv;
+
+	priv = MODEST_MAIL_OPERATION_QUEUE_GET_PRIVATE(self);
+
+	/* We start them in an idle because we could be inside the
+	   handler of the operation-finished signal of another one */
+	if (!priv->schedule_handler)
+		priv->schedule_handler = g_idle_add (run_pending_ops_idle, self);
+}
+
+gboolean
+modest_mail_operation_queue_add_scheduled (ModestMailOperationQueue *self,
+					   ModestMailOperation *mail_op,
+					   const gchar *account_name,
+					   ModestMailOperationQueuePriority priority,
+					   const gchar *coalesce_key,
+					   ModestMailOperationQueueCoalesceFunc coalesce_func,
+					   ModestMailOperationQueueRunFunc run_func,
+					   gpointer userdata,
+					   GDestroyNotify destroy_func)
+{
+	ModestMailOperationQueuePrivate *priv;
+	ScheduledOp *sop;
+
+	g_return_val_if_fail (MODEST_IS_MAIL_OPERATION_QUEUE (self), FALSE);
+	g_return_val_if_fail (MODEST_IS_MAIL_OPERATION (mail_op), FALSE);
+	g_return_val_if_fail (priority < MODEST_MAIL_OPERATION_QUEUE_PRIORITY_NUM, FALSE);
+	g_return_val_if_fail (run_func, FALSE);
+
+	priv = MODEST_MAIL_OPERATION_QUEUE_GET_PRIVATE(self);
+
+	if (coalesce_key) {
+		ScheduledOp *equivalent;
+
+		g_mutex_lock (priv->queue_lock);
+		equivalent = g_hash_table_find (priv->scheduled, has_coalesce_key,
+						(gpointer) coalesce_key);
+		if (equivalent) {
+			priv->coalesced++;
+			/* The waiting one inherits the priority of
+			   the discarded one if it's higher */
+			if (!equivalent->running && priority < equivalent->priority) {
+				priv->pending = g_list_remove (priv->pending, equivalent);
+				equivalent->priority = priority;
+				priv->pending = insert_pending_op (priv->pending, equivalent);
+			}
+			/* The userdata of a running one belongs to
+			   its run_func */
+			if (coalesce_func)
+				coalesce_func (equivalent->mail_op,
+					       equivalent->running ? NULL : equivalent->userdata,
+					       userdata);
+		}
+		g_mutex_unlock (priv->queue_lock);
+
+		if (equivalent) {
+			MODEST_DEBUG_BLOCK (g_debug ("%s: coalesced '%s'", __FUNCTION__, coalesce_key););
+			if (destroy_func)
+				destroy_func (userdata);
+			return FALSE;
+		}
+	}
+
+	modest_mail_operation_queue_add (self, mail_op);
+
+	sop = g_slice_new0 (ScheduledOp);
+	sop->mail_op = mail_op;
+	sop->account_name = g_strdup (account_name);
+	sop->coalesce_key = g_strdup (coalesce_key);
+	sop->priority = priority;
+	sop->run_func = run_func;
+	sop->userdata = userdata;
+	sop->destroy_func = destroy_func;
+	sop->queued_time = modest_trace_get_monotonic_time ();
+	sop->running = FALSE;
+
+	g_mutex_lock (priv->queue_lock);
+	g_hash_table_insert (priv->scheduled, mail_op, sop);
+	priv->pending = insert_pending_op (priv->pending, sop);
+	g_mutex_unlock (priv->queue_lock);
+
+	run_pending_ops (self);
+
+	return TRUE;
+}
+
+void
+modest_mail_operation_queue_set_limits (ModestMailOperationQueue *self,
+					guint max_running,
+					guint max_running_per_account)
+{
+	ModestMailOperationQueuePrivate *priv;
+
+	g_return_if_fail (MODEST_IS_MAIL_OPERATION_QUEUE (self));
+
+	priv = MODEST_MAIL_OPERATION_QUEUE_GET_PRIVATE(self);
+
+	g_mutex_lock (priv->queue_lock);
+	priv->max_running = max_running;
+	priv->max_running_per_account = max_running_per_account;
+	g_mutex_unlock (priv->queue_lock);
+
+	/* Limits could be higher now */
+	schedule_pending_ops (self);
+}
+
+static gboolean
+is_pending_op (ModestMailOperationQueuePrivate *priv,
+	       ModestMailOperation *mail_op)
+{
+	ScheduledOp *sop;
+	gboolean pending;
+
+	g_mutex_lock (priv->queue_lock);
+	sop = g_hash_table_lookup (priv->scheduled, mail_op);
+	pending = sop && !sop->running;
+	g_mutex_unlock (priv->queue_lock);
+
+	return pending;
+}
+
 static gboolean
 notify_queue_empty (gpointer user_data)
 {
@@ -333,7 +661,9 @@ modest_mail_operation_queue_remove (ModestMailOperationQueue *self,
 {
 	ModestMailOperationQueuePrivate *priv;
 	ModestMailOperationStatus status;
+	ScheduledOp *sop;
 	guint num_elements;
+	gboolean has_pending;
 
 	g_return_if_fail (MODEST_IS_MAIL_OPERATION_QUEUE (self));
 	g_return_if_fail (MODEST_IS_MAIL_OPERATION (mail_op));
@@ -343,6 +673,15 @@ modest_mail_operation_queue_remove (ModestMailOperationQueue *self,
 	g_mutex_lock (priv->queue_lock);
 	g_queue_remove (priv->op_queue, mail_op);
 	num_elements = priv->op_queue->length;
+	sop = g_hash_table_lookup (priv->scheduled, mail_op);
+	if (sop) {
+		g_hash_table_remove (priv->scheduled, mail_op);
+		if (!sop->running)
+			priv->pending = g_list_remove (priv->pending, sop);
+		else if (sop->account_name)
+			update_running_for_account (priv, sop->account_name, -1);
+	}
+	has_pending = (priv->pending != NULL);
 	g_mutex_unlock (priv->queue_lock);
 
 	MODEST_DEBUG_BLOCK (print_queue_item (mail_op, "remove"););
@@ -377,8 +716,14 @@ modest_mail_operation_queue_remove (ModestMailOperationQueue *self,
 	}
 
 	/* Free object */
+	if (sop)
+		scheduled_op_free (sop);
 	g_object_unref (G_OBJECT (mail_op));
 
+	/* A slot could have been released */
+	if (has_pending)
+		schedule_pending_ops (self);
+
 	/* Emit the queue empty-signal. See the function to know why
 	   we emit it in an idle */
 	if (num_elements == 0) {
@@ -421,6 +766,13 @@ modest_mail_operation_queue_cancel (ModestMailOperationQueue *self,
 	priv = MODEST_MAIL_OPERATION_QUEUE_GET_PRIVATE(self);
 
 	MODEST_DEBUG_BLOCK (print_queue_item (mail_op, "cancel"););
+
+	/* Waiting operations were not started yet, so we only have
+	   to remove them from the queue */
+	if (is_pending_op (priv, mail_op)) {
+		modest_mail_operation_queue_remove (self, mail_op);
+		return;
+	}
 	
 	/* This triggers a progess_changed signal in which we remove
 	 * the operation from the queue. */
@@ -461,6 +813,8 @@ modest_mail_operation_queue_cancel_all (ModestMailOperationQueue *self)
 	for(cur = operations_to_cancel; cur != NULL; cur = cur->next) {
 		if (!MODEST_IS_MAIL_OPERATION(cur->data))
 			g_printerr ("modest: cur->data is not a valid mail operation\n");
+		else if (is_pending_op (priv, MODEST_MAIL_OPERATION (cur->data)))
+			modest_mail_operation_queue_remove (self, MODEST_MAIL_OPERATION (cur->data));
 		else
 			modest_mail_operation_cancel (MODEST_MAIL_OPERATION (cur->data));
 	}
@@ -515,19 +869,76 @@ modest_mail_operation_queue_get_by_source (ModestMailOperationQueue *self,
 	return found_operations;
 }
 
+typedef struct
+{
+	gchar **str;
+	ModestMailOperationQueuePrivate *priv;
+	gint64 now;
+} AccumulateInfo;
+
+static const gchar*
+priority_to_string (ModestMailOperationQueuePriority priority)
+{
+	switch (priority) {
+	case MODEST_MAIL_OPERATION_QUEUE_PRIORITY_NORMAL: return "normal";
+	case MODEST_MAIL_OPERATION_QUEUE_PRIORITY_LOW:    return "low";
+	default:                                          return "unknown";
+	}
+}
+
 static void
-accumulate_mail_op_strings (ModestMailOperation *op, gchar **str)
+accumulate_mail_op_strings (ModestMailOperation *op, AccumulateInfo *info)
 {
-	gchar *mail_op_to_str = modest_mail_operation_to_string (op);
-	*str = g_strdup_printf ("%s\n%s", *str, mail_op_to_str);
+	gchar *mail_op_to_str, *copy;
+	ScheduledOp *sop;
+
+	mail_op_to_str = modest_mail_operation_to_string (op);
+	copy = *(info->str);
+	sop = g_hash_table_lookup (info->priv->scheduled, op);
+	if (sop && !sop->running)
+		*(info->str) = g_strdup_printf ("%s\n%s <waiting, %s priority, \"%s\", %lld ms>",
+						copy, mail_op_to_str,
+						priority_to_string (sop->priority),
+						sop->account_name ? sop->account_name : "",
+						(long long) (info->now - sop->queued_time) / 1000);
+	else
+		*(info->str) = g_strdup_printf ("%s\n%s", copy, mail_op_to_str);
+	g_free (copy);
 	g_free (mail_op_to_str);
 }
 
+static gchar*
+scheduler_to_string (ModestMailOperationQueuePrivate *priv)
+{
+	GString *str;
+	guint len, waiting;
+	gint i;
+
+	len = g_queue_get_length (priv->op_queue);
+	waiting = g_list_length (priv->pending);
+
+	str = g_string_new ("");
+	g_string_append_printf (str, "scheduler: %d running (max %d, %d per account), "
+				"%d waiting, %d coalesced",
+				len - waiting, priv->max_running, priv->max_running_per_account,
+				waiting, priv->coalesced);
+	for (i = 0; i < MODEST_MAIL_OPERATION_QUEUE_PRIORITY_NUM; i++) {
+		WaitStats *stats = &(priv->wait_stats[i]);
+
+		g_string_append_printf (str, "\nqueue wait (%s): %d started, avg %lld ms, max %lld ms",
+					priority_to_string (i), stats->count,
+					stats->count ? (long long) (stats->total / stats->count) / 1000 : 0LL,
+					(long long) stats->max / 1000);
+	}
+
+	return g_string_free (str, FALSE);
+}
+
 
 gchar*
 modest_mail_operation_queue_to_string (ModestMailOperationQueue *self)
 {
-	gchar *str = NULL;
+	gchar *str = NULL, *scheduler;
 	guint len;
 	ModestMailOperationQueuePrivate *priv;
 
@@ -535,18 +946,26 @@ modest_mail_operation_queue_to_string (ModestMailOperationQueue *self)
 
 	priv = MODEST_MAIL_OPERATION_QUEUE_GET_PRIVATE(self);
 
+	g_mutex_lock (priv->queue_lock);
 	len = g_queue_get_length (priv->op_queue);
-	str = g_strdup_printf ("mail operation queue (%02d)\n-------------------------", len);
+	scheduler = scheduler_to_string (priv);
+	str = g_strdup_printf ("mail operation queue (%02d)\n%s\n-------------------------",
+			       len, scheduler);
+	g_free (scheduler);
 	if (len == 0) {
 		gchar *copy;
 		copy = str;
 		str = g_strdup_printf ("%s\n%s", copy, "<empty>");
 		g_free (copy);
 	} else {
-		g_mutex_lock (priv->queue_lock);
-		g_queue_foreach (priv->op_queue, (GFunc)accumulate_mail_op_strings, &str);
-		g_mutex_unlock (priv->queue_lock);
+		AccumulateInfo info;
+
+		info.str = &str;
+		info.priv = priv;
+		info.now = modest_trace_get_monotonic_time ();
+		g_queue_foreach (priv->op_queue, (GFunc)accumulate_mail_op_strings, &info);
 	}
+	g_mutex_unlock (priv->queue_lock);
 
 	return str;
 }
@@ -50,6 +50,21 @@ typedef enum _ModestMailOperationQueueNotification {
 	MODEST_MAIL_OPERATION_QUEUE_OPERATION_REMOVED
 } ModestMailOperationQueueNotification;
 
+/*
+ * Priorities of the scheduled operations. Operations with a higher
+ * priority are started before any other waiting one, whatever the
+ * order they were added to the queue
+ */
+typedef enum _ModestMailOperationQueuePriority {
+	MODEST_MAIL_OPERATION_QUEUE_PRIORITY_NORMAL,  /* requested by the user */
+	MODEST_MAIL_OPERATION_QUEUE_PRIORITY_LOW,     /* background updates */
+	MODEST_MAIL_OPERATION_QUEUE_PRIORITY_NUM
+} ModestMailOperationQueuePriority;
+
+/* default concurrency limits of the scheduler, 0 means no limit */
+#define MODEST_MAIL_OPERATION_QUEUE_DEFAULT_MAX_RUNNING             4
+#define MODEST_MAIL_OPERATION_QUEUE_DEFAULT_MAX_RUNNING_PER_ACCOUNT 1
+
 typedef struct _ModestMailOperationQueue      ModestMailOperationQueue;
 typedef struct _ModestMailOperationQueueClass ModestMailOperationQueueClass;
 
@@ -69,6 +84,34 @@ struct _ModestMailOperationQueueClass {
 };
 
 
+/**
+ * ModestMailOperationQueueRunFunc:
+ * @mail_op: the scheduled #ModestMailOperation
+ * @userdata: the user data passed to modest_mail_operation_queue_add_scheduled()
+ *
+ * Called by the queue when a scheduled operation can start. The
+ * function must start @mail_op (or remove it from the queue) and
+ * takes the ownership of @userdata
+ **/
+typedef void (*ModestMailOperationQueueRunFunc) (ModestMailOperation *mail_op,
+						 gpointer userdata);
+
+/**
+ * ModestMailOperationQueueCoalesceFunc:
+ * @mail_op: the scheduled #ModestMailOperation that was already in the queue
+ * @userdata: the user data of @mail_op, or %NULL if it's already running
+ * @new_userdata: the user data of the operation that is being discarded
+ *
+ * Called by the queue when a new scheduled operation is discarded
+ * because @mail_op is equivalent, so @mail_op could inherit whatever
+ * the discarded one asked for. It's called with the queue locked, so
+ * it must not call any function of the queue. @new_userdata is freed
+ * just after this call
+ **/
+typedef void (*ModestMailOperationQueueCoalesceFunc) (ModestMailOperation *mail_op,
+						      gpointer userdata,
+						      gpointer new_userdata);
+
 /* member functions */
 GType                   modest_mail_operation_queue_get_type      (void) G_GNUC_CONST;
 
@@ -85,6 +128,64 @@ ModestMailOperationQueue *    modest_mail_operation_queue_new  (void);
 void    modest_mail_operation_queue_add        (ModestMailOperationQueue *op_queue, 
 						ModestMailOperation *mail_op);
 
+/**
+ * modest_mail_operation_queue_add_scheduled:
+ * @op_queue: a #ModestMailOperationQueue
+ * @mail_op: the #ModestMailOperation that will be added to the queue
+ * @account_name: the name of the account @mail_op will work with, or %NULL
+ * @priority: a #ModestMailOperationQueuePriority
+ * @coalesce_key: a key identifying equivalent operations, or %NULL
+ * @coalesce_func: function called when @mail_op is discarded because
+ * of an equivalent operation, or %NULL
+ * @run_func: the function that starts the operation
+ * @userdata: user data for @run_func
+ * @destroy_func: function to free @userdata if @run_func is never called
+ *
+ * Adds a mail operation to the queue, like
+ * modest_mail_operation_queue_add(), but instead of being started
+ * by the caller, the queue calls @run_func as soon as the global
+ * and the per-account concurrency limits allow it. Waiting
+ * operations are started by @priority and then in the order they
+ * were added. @run_func could be called before this function
+ * returns.
+ *
+ * If there is already a waiting or running operation with the same
+ * @coalesce_key then @mail_op is not added, @coalesce_func is called
+ * with the equivalent operation, @userdata is freed with
+ * @destroy_func and the waiting operation gets the higher of both
+ * priorities. Scheduled operations that are canceled before being
+ * started are removed from the queue and their @userdata freed with
+ * @destroy_func too.
+ *
+ * Returns: %TRUE if @mail_op was added to the queue, %FALSE if it
+ * was coalesced with an equivalent operation
+ **/
+gboolean modest_mail_operation_queue_add_scheduled (ModestMailOperationQueue *op_queue,
+						    ModestMailOperation *mail_op,
+						    const gchar *account_name,
+						    ModestMailOperationQueuePriority priority,
+						    const gchar *coalesce_key,
+						    ModestMailOperationQueueCoalesceFunc coalesce_func,
+						    ModestMailOperationQueueRunFunc run_func,
+						    gpointer userdata,
+						    GDestroyNotify destroy_func);
+
+/**
+ * modest_mail_operation_queue_set_limits:
+ * @op_queue: a #ModestMailOperationQueue
+ * @max_running: the maximum number of running operations, 0 for no limit
+ * @max_running_per_account: the maximum number of scheduled
+ * operations running for the same account, 0 for no limit
+ *
+ * Sets the concurrency limits used to start the operations added
+ * with modest_mail_operation_queue_add_scheduled(). Operations added
+ * with modest_mail_operation_queue_add() are always started by the
+ * caller, but they count as running ones for the global limit
+ **/
+void    modest_mail_operation_queue_set_limits (ModestMailOperationQueue *op_queue,
+						guint max_running,
+						guint max_running_per_account);
+
 /**
  * modest_mail_operation_queue_remove:
  * @op_queue: a #ModestMailOperationQueue
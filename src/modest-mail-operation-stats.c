@@ -0,0 +1,262 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+#include "modest-defs.h"
+#include "modest-trace.h"
+#include "modest-mail-operation-stats.h"
+
+/* DISCONNECT_ACCOUNT is the last type of the enum */
+#define NUM_OP_TYPES (MODEST_MAIL_OPERATION_TYPE_DISCONNECT_ACCOUNT + 1)
+
+typedef struct {
+	guint   count;
+	guint   failed;               /* failed, with errors or canceled */
+	guint   not_started;
+	guint   waited;
+	gint64  total_wait;           /* usecs between queued and started */
+	guint   progressed;
+	gint64  total_first_progress; /* usecs between started and the first progress */
+	gint64  total;                /* usecs between started and finished */
+	gint64  max;
+	guint64 bytes;
+	guint   histogram[MODEST_MAIL_OPERATION_STATS_BUCKETS];
+} TypeStats;
+
+G_LOCK_DEFINE_STATIC (stats_lock);
+static TypeStats stats[NUM_OP_TYPES];
+static GString *pending_records = NULL;
+static guint flush_handler = 0;
+
+static const gchar*
+get_status_name (ModestMailOperationStatus status)
+{
+	switch (status) {
+	case MODEST_MAIL_OPERATION_STATUS_SUCCESS:              return "SUCCESS";
+	case MODEST_MAIL_OPERATION_STATUS_FINISHED_WITH_ERRORS: return "FINISHED-WITH-ERRORS";
+	case MODEST_MAIL_OPERATION_STATUS_FAILED:               return "FAILED";
+	case MODEST_MAIL_OPERATION_STATUS_CANCELED:             return "CANCELLED";
+	case MODEST_MAIL_OPERATION_STATUS_IN_PROGRESS:          return "IN-PROGRESS";
+	default:                                                return "INVALID";
+	}
+}
+
+static guint
+get_bucket (gint64 usecs)
+{
+	guint64 msecs;
+	guint bucket = 0;
+
+	msecs = (usecs > 0) ? usecs / 1000 : 0;
+	while (msecs > 0 && bucket < MODEST_MAIL_OPERATION_STATS_BUCKETS - 1) {
+		msecs >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+static gboolean
+on_flush_timeout (gpointer userdata)
+{
+	flush_handler = 0;
+	modest_mail_operation_stats_flush ();
+
+	return FALSE;
+}
+
+void
+modest_mail_operation_stats_record (ModestMailOperationTypeOperation op_type,
+				    ModestMailOperationStatus status,
+				    const ModestMailOperationMetrics *metrics)
+{
+	TypeStats *type_stats;
+	gint64 duration = 0;
+
+	g_return_if_fail (metrics);
+	g_return_if_fail (op_type < NUM_OP_TYPES);
+
+	G_LOCK (stats_lock);
+
+	type_stats = &(stats[op_type]);
+	type_stats->count++;
+	type_stats->bytes += metrics->bytes;
+	if (status != MODEST_MAIL_OPERATION_STATUS_SUCCESS)
+		type_stats->failed++;
+
+	if (metrics->started == 0) {
+		type_stats->not_started++;
+	} else {
+		if (metrics->queued) {
+			type_stats->waited++;
+			type_stats->total_wait += metrics->started - metrics->queued;
+		}
+		if (metrics->first_progress) {
+			type_stats->progressed++;
+			type_stats->total_first_progress += metrics->first_progress - metrics->started;
+		}
+		duration = metrics->finished - metrics->started;
+		type_stats->total += duration;
+		if (duration > type_stats->max)
+			type_stats->max = duration;
+		type_stats->histogram[get_bucket (duration)]++;
+	}
+
+	/* Keep it in memory until the next flush, we do not want to
+	   write to disk every time an operation finishes */
+	if (!pending_records)
+		pending_records = g_string_new ("");
+	g_string_append_printf (pending_records, "%ld %s %s queued=%lld first-progress=%lld "
+				"total=%lld bytes=%llu\n",
+				(glong) time (NULL),
+				modest_mail_operation_type_to_string (op_type),
+				get_status_name (status),
+				(metrics->queued && metrics->started) ?
+				(long long) (metrics->started - metrics->queued) / 1000 : -1LL,
+				(metrics->first_progress && metrics->started) ?
+				(long long) (metrics->first_progress - metrics->started) / 1000 : -1LL,
+				metrics->started ? (long long) duration / 1000 : -1LL,
+				(unsigned long long) metrics->bytes);
+
+	if (!flush_handler)
+		flush_handler = g_timeout_add_seconds (MODEST_MAIL_OPERATION_STATS_FLUSH_INTERVAL,
+						       on_flush_timeout, NULL);
+
+	G_UNLOCK (stats_lock);
+}
+
+gchar*
+modest_mail_operation_stats_to_string (void)
+{
+	GString *str;
+	gint i, j;
+
+	str = g_string_new ("");
+
+	G_LOCK (stats_lock);
+	for (i = 0; i < NUM_OP_TYPES; i++) {
+		TypeStats *type_stats = &(stats[i]);
+		guint started;
+
+		if (type_stats->count == 0)
+			continue;
+
+		started = type_stats->count - type_stats->not_started;
+		g_string_append_printf (str, "%s: %d finished, %d failed, %d not started, "
+					"%llu bytes\n",
+					modest_mail_operation_type_to_string (i),
+					type_stats->count, type_stats->failed,
+					type_stats->not_started,
+					(unsigned long long) type_stats->bytes);
+		g_string_append_printf (str, "    avg queued %lld ms, avg first progress %lld ms, "
+					"avg %lld ms, max %lld ms\n",
+					type_stats->waited ?
+					(long long) (type_stats->total_wait / type_stats->waited) / 1000 : 0LL,
+					type_stats->progressed ?
+					(long long) (type_stats->total_first_progress / type_stats->progressed) / 1000 : 0LL,
+					started ? (long long) (type_stats->total / started) / 1000 : 0LL,
+					(long long) type_stats->max / 1000);
+
+		g_string_append (str, "   ");
+		for (j = 0; j < MODEST_MAIL_OPERATION_STATS_BUCKETS; j++) {
+			if (type_stats->histogram[j] == 0)
+				continue;
+			if (j == MODEST_MAIL_OPERATION_STATS_BUCKETS - 1)
+				g_string_append_printf (str, " >=%dms:%d", 1 << (j - 1),
+							type_stats->histogram[j]);
+			else
+				g_string_append_printf (str, " <%dms:%d", 1 << j,
+							type_stats->histogram[j]);
+		}
+		g_string_append (str, "\n");
+	}
+	G_UNLOCK (stats_lock);
+
+	if (str->len == 0)
+		g_string_append (str, "<empty>\n");
+
+	return g_string_free (str, FALSE);
+}
+
+void
+modest_mail_operation_stats_flush (void)
+{
+	GString *records;
+	gchar *filename;
+	struct stat buf;
+	FILE *file;
+
+	G_LOCK (stats_lock);
+	records = pending_records;
+	pending_records = NULL;
+	if (flush_handler) {
+		g_source_remove (flush_handler);
+		flush_handler = 0;
+	}
+	G_UNLOCK (stats_lock);
+
+	if (!records)
+		return;
+
+	filename = g_build_filename (g_get_home_dir (), MODEST_DIR,
+				     MODEST_OPERATION_STATS_FILE, NULL);
+
+	/* Keep just the previous file, we do not want it to grow
+	   forever */
+	if (g_stat (filename, &buf) == 0 &&
+	    buf.st_size > MODEST_MAIL_OPERATION_STATS_FILE_MAX_SIZE) {
+		gchar *old_filename = g_strconcat (filename, ".old", NULL);
+		if (g_rename (filename, old_filename) != 0)
+			g_warning ("%s: could not rotate %s", __FUNCTION__, filename);
+		g_free (old_filename);
+	}
+
+	file = g_fopen (filename, "a");
+	if (file) {
+		fputs (records->str, file);
+		fclose (file);
+	} else {
+		g_warning ("%s: could not write %s", __FUNCTION__, filename);
+	}
+
+	g_free (filename);
+	g_string_free (records, TRUE);
+}
+
+void
+modest_mail_operation_stats_clear (void)
+{
+	G_LOCK (stats_lock);
+	memset (stats, 0, sizeof (stats));
+	G_UNLOCK (stats_lock);
+}
@@ -0,0 +1,105 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MODEST_MAIL_OPERATION_STATS_H__
+#define __MODEST_MAIL_OPERATION_STATS_H__
+
+#include <glib.h>
+#include "modest-mail-operation.h"
+
+G_BEGIN_DECLS
+
+/* number of buckets of the latency histograms. The first one is
+   for the operations shorter than 1ms, the bucket n (n > 0) for the
+   ones in [2^(n-1), 2^n) ms, and the last one for all the longer
+   ones */
+#define MODEST_MAIL_OPERATION_STATS_BUCKETS 18
+
+/* the stats file is renamed to MODEST_OPERATION_STATS_FILE.old when
+   it's bigger than this */
+#define MODEST_MAIL_OPERATION_STATS_FILE_MAX_SIZE (64*1024)
+
+/* seconds between writes to the stats file */
+#define MODEST_MAIL_OPERATION_STATS_FLUSH_INTERVAL 60
+
+/*
+ * the timestamps (monotonic usecs, see
+ * modest_trace_get_monotonic_time) of a mail operation, 0 if the
+ * operation did not reach that point
+ */
+typedef struct {
+	gint64  queued;
+	gint64  started;
+	gint64  first_progress;
+	gint64  finished;
+	guint64 bytes;
+} ModestMailOperationMetrics;
+
+/**
+ * modest_mail_operation_stats_record:
+ * @op_type: the type of the finished operation
+ * @status: the final status of the operation
+ * @metrics: the #ModestMailOperationMetrics of the operation
+ *
+ * adds a finished operation to the statistics of its type, and
+ * appends it to the stats file. The file is written later, in
+ * batches
+ */
+void     modest_mail_operation_stats_record         (ModestMailOperationTypeOperation op_type,
+						     ModestMailOperationStatus status,
+						     const ModestMailOperationMetrics *metrics);
+
+/**
+ * modest_mail_operation_stats_to_string:
+ *
+ * Returns a string representation of the statistics of every type
+ * of operation: counts, average times and the latency histogram
+ *
+ * Returns: a newly allocated string
+ */
+gchar*   modest_mail_operation_stats_to_string      (void);
+
+/**
+ * modest_mail_operation_stats_flush:
+ *
+ * writes the pending records to the stats file now. It's done
+ * periodically, but it should be called before exiting too
+ */
+void     modest_mail_operation_stats_flush          (void);
+
+/**
+ * modest_mail_operation_stats_clear:
+ *
+ * resets the statistics. The stats file is not modified
+ */
+void     modest_mail_operation_stats_clear          (void);
+
+G_END_DECLS
+
+#endif /* __MODEST_MAIL_OPERATION_STATS_H__ */
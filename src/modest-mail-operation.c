@@ -63,6 +63,10 @@
 #include <libgnomevfs/gnome-vfs.h>
 #include "modest-utils.h"
 #include "modest-debug.h"
+#include "modest-trace.h"
+#include "modest-mail-operation-stats.h"
+#include "modest-recipient-index.h"
+#include "modest-conversation-index.h"
 #ifdef MODEST_USE_LIBTIME
 #include <clockd/libtime.h>
 #endif
@@ -96,6 +100,8 @@ static void     get_msg_status_cb (GObject *obj,
 static void     modest_mail_operation_notify_start (ModestMailOperation *self);
 static void     modest_mail_operation_notify_end (ModestMailOperation *self);
 
+static void     cancel_remote_draft_upload (TnyMsg *draft_msg);
+
 static void     notify_progress_of_multiple_messages (ModestMailOperation *self,
 						      TnyStatus *status,
 						      gint *last_total_bytes,
@@ -116,6 +122,7 @@ static void     sync_folder_finish_callback (TnyFolder *self,
 static gboolean _check_memory_low         (ModestMailOperation *mail_op);
 
 
+
 typedef struct {
 	ModestTnySendQueue *queue;
 	ModestMailOperation *self;
@@ -139,7 +146,6 @@ typedef struct
 	gint pending_calls;
 	gboolean poke_all;
 	TnyFolderObserver *observer;
-	gboolean interactive;
 	gboolean msg_readed;
 	gboolean update_folder_counts;
 	guint retries_left;
@@ -178,6 +184,9 @@ struct _ModestMailOperationPrivate {
 	ErrorCheckingUserDataDestroyer error_checking_user_data_destroyer;
 	ModestMailOperationStatus  status;	
 	ModestMailOperationTypeOperation op_type;
+	ModestTraceSpan           *trace_span;
+	ModestMailOperationMetrics metrics;
+	gboolean                   interactive;
 };
 
 #define MODEST_MAIL_OPERATION_GET_PRIVATE(o)      (G_TYPE_INSTANCE_GET_PRIVATE((o), \
@@ -201,6 +210,7 @@ typedef struct {
 	gint total_bytes;
 	TnyIterator *get_parts;
 	TnyMsg *msg;
+	ModestTraceSpan *trace_span;
 } GetMsgInfo;
 
 typedef struct _RefreshAsyncHelper {	
@@ -308,6 +318,22 @@ modest_mail_operation_get_type (void)
 	return my_type;
 }
 
+static void
+on_progress_changed (ModestMailOperation *self,
+		     ModestMailOperationState *state,
+		     gpointer user_data)
+{
+	ModestMailOperationPrivate *priv;
+
+	priv = MODEST_MAIL_OPERATION_GET_PRIVATE(self);
+
+	if (!priv->metrics.first_progress && priv->metrics.started)
+		priv->metrics.first_progress = modest_trace_get_monotonic_time ();
+
+	if (state && state->bytes_done > priv->metrics.bytes)
+		priv->metrics.bytes = (guint64) state->bytes_done;
+}
+
 static void
 modest_mail_operation_class_init (ModestMailOperationClass *klass)
 {
@@ -316,6 +342,7 @@ modest_mail_operation_class_init (ModestMailOperationClass *klass)
 
 	parent_class            = g_type_class_peek_parent (klass);
 	gobject_class->finalize = modest_mail_operation_finalize;
+	klass->progress_changed = on_progress_changed;
 
 	g_type_class_add_private (gobject_class, sizeof(ModestMailOperationPrivate));
 
@@ -387,6 +414,9 @@ modest_mail_operation_init (ModestMailOperation *obj)
 	priv->source         = NULL;
 	priv->error_checking = NULL;
 	priv->error_checking_user_data = NULL;
+	priv->trace_span     = NULL;
+	priv->interactive    = FALSE;
+	memset (&(priv->metrics), 0, sizeof (ModestMailOperationMetrics));
 }
 
 static void
@@ -410,6 +440,10 @@ modest_mail_operation_finalize (GObject *obj)
 		g_object_unref (priv->account);
 		priv->account = NULL;
 	}
+	if (priv->trace_span) {
+		modest_trace_cancel (priv->trace_span);
+		priv->trace_span = NULL;
+	}
 
 
 	G_OBJECT_CLASS(parent_class)->finalize (obj);
@@ -1189,9 +1223,11 @@ modest_mail_operation_send_new_mail (ModestMailOperation *self,
 	if (transport_account)
 		g_object_ref (transport_account);
 	info->draft_msg = draft_msg;
-	if (draft_msg)
+	if (draft_msg) {
 		g_object_ref (draft_msg);
-
+		/* The draft is sent, do not upload it later */
+		cancel_remote_draft_upload (draft_msg);
+	}
 
 	modest_mail_operation_create_msg (self, from, to, cc, bcc, subject, plain_body, html_body,
 					  attachments_list, images_list, priority_flags,
@@ -1226,6 +1262,8 @@ finish_save_remote_draft (ModestAccountProtocol *protocol,
 		/* Priority for errors in save to local stage */
 		priv->error = g_error_copy (err);
 		priv->status = MODEST_MAIL_OPERATION_STATUS_FAILED;
+	} else if (priv->status == MODEST_MAIL_OPERATION_STATUS_IN_PROGRESS) {
+		priv->status = MODEST_MAIL_OPERATION_STATUS_SUCCESS;
 	}
 
 	if (info->callback)
@@ -1240,6 +1278,181 @@ finish_save_remote_draft (ModestAccountProtocol *protocol,
 	g_slice_free (FinishSaveRemoteDraftInfo, info);
 }
 
+/* The remote drafts are not uploaded when the draft is saved locally
+   but some seconds later, in a background mail operation. If the
+   draft is saved again before that, only the last version is
+   uploaded, replacing the one that was in the server. The pending
+   uploads are indexed by the last saved version of the draft, that
+   is the draft_msg of the next save. Only used from the main loop */
+#define REMOTE_DRAFT_UPLOAD_DELAY 30
+
+typedef struct
+{
+	ModestAccountProtocol *protocol;
+	TnyTransportAccount *transport_account;
+	TnyMsg *msg;
+	TnyMsg *old_msg;
+	guint timeout_id;
+} RemoteDraftUpload;
+
+static GHashTable *remote_draft_uploads = NULL;
+static guint remote_draft_uploads_running = 0;
+
+static void
+finish_remote_draft_upload (ModestAccountProtocol *protocol,
+			    GError *err,
+			    const gchar *account_id,
+			    TnyMsg *new_remote_msg,
+			    TnyMsg *new_msg,
+			    TnyMsg *old_msg,
+			    gpointer userdata)
+{
+	remote_draft_uploads_running--;
+	finish_save_remote_draft (protocol, err, account_id, new_remote_msg,
+				  new_msg, old_msg, userdata);
+}
+
+static void
+remote_draft_upload_free (RemoteDraftUpload *upload)
+{
+	g_object_unref (upload->protocol);
+	g_object_unref (upload->transport_account);
+	g_object_unref (upload->msg);
+	if (upload->old_msg)
+		g_object_unref (upload->old_msg);
+	g_slice_free (RemoteDraftUpload, upload);
+}
+
+/* The upload runs in the background, maybe once the editor that
+   saved the draft is closed, so the failures are reported here */
+static void
+remote_draft_upload_error_handler (ModestMailOperation *mail_op,
+				   gpointer user_data)
+{
+	if (modest_mail_operation_get_status (mail_op) != MODEST_MAIL_OPERATION_STATUS_CANCELED)
+		modest_platform_information_banner (NULL, NULL, _("mail_in_ui_save_error"));
+}
+
+static void
+upload_remote_draft (RemoteDraftUpload *upload)
+{
+	FinishSaveRemoteDraftInfo *srd_info;
+	ModestMailOperationPrivate *priv;
+	ModestMailOperation *mail_op;
+
+	g_hash_table_remove (remote_draft_uploads, upload->msg);
+
+	mail_op = modest_mail_operation_new_with_error_handling (NULL,
+								 remote_draft_upload_error_handler,
+								 NULL, NULL);
+	priv = MODEST_MAIL_OPERATION_GET_PRIVATE (mail_op);
+	priv->op_type = MODEST_MAIL_OPERATION_TYPE_INFO;
+	priv->account = g_object_ref (upload->transport_account);
+	priv->status = MODEST_MAIL_OPERATION_STATUS_IN_PROGRESS;
+	modest_mail_operation_queue_add (modest_runtime_get_mail_operation_queue (), mail_op);
+	modest_mail_operation_notify_start (mail_op);
+
+	/* The reference of the mail operation is released in the
+	   callback */
+	srd_info = g_slice_new (FinishSaveRemoteDraftInfo);
+	srd_info->mailop = mail_op;
+	srd_info->msg = g_object_ref (upload->msg);
+	srd_info->callback = NULL;
+	srd_info->userdata = NULL;
+	remote_draft_uploads_running++;
+	modest_account_protocol_save_remote_draft (upload->protocol,
+						   tny_account_get_id (TNY_ACCOUNT (upload->transport_account)),
+						   upload->msg, upload->old_msg,
+						   finish_remote_draft_upload,
+						   srd_info);
+
+	remote_draft_upload_free (upload);
+}
+
+static gboolean
+upload_remote_draft_timeout (gpointer userdata)
+{
+	/* This is a GDK lock because we are a timeout callback and
+	   the mail operation emits signals handled by Gtk+ code */
+	gdk_threads_enter ();
+	upload_remote_draft ((RemoteDraftUpload *) userdata);
+	gdk_threads_leave ();
+
+	return FALSE;
+}
+
+static void
+cancel_remote_draft_upload (TnyMsg *draft_msg)
+{
+	RemoteDraftUpload *upload;
+
+	if (!remote_draft_uploads)
+		return;
+
+	upload = g_hash_table_lookup (remote_draft_uploads, draft_msg);
+	if (upload) {
+		g_source_remove (upload->timeout_id);
+		g_hash_table_remove (remote_draft_uploads, upload->msg);
+		remote_draft_upload_free (upload);
+	}
+}
+
+static gboolean
+get_first_upload (gpointer key, gpointer value, gpointer user_data)
+{
+	return TRUE;
+}
+
+gboolean
+modest_mail_operation_flush_remote_drafts (void)
+{
+	RemoteDraftUpload *upload;
+
+	while (remote_draft_uploads &&
+	       (upload = g_hash_table_find (remote_draft_uploads, get_first_upload, NULL))) {
+		g_source_remove (upload->timeout_id);
+		/* It removes the upload from the pending ones */
+		upload_remote_draft (upload);
+	}
+
+	return (remote_draft_uploads_running > 0);
+}
+
+static void
+schedule_remote_draft_upload (ModestAccountProtocol *protocol,
+			      TnyTransportAccount *transport_account,
+			      TnyMsg *msg,
+			      TnyMsg *draft_msg)
+{
+	RemoteDraftUpload *upload = NULL;
+
+	if (!remote_draft_uploads)
+		remote_draft_uploads = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	if (draft_msg)
+		upload = g_hash_table_lookup (remote_draft_uploads, draft_msg);
+
+	if (upload) {
+		/* The previous version was never uploaded, so the
+		   one in the server is still upload->old_msg */
+		g_source_remove (upload->timeout_id);
+		g_hash_table_remove (remote_draft_uploads, upload->msg);
+		g_object_unref (upload->msg);
+		g_object_unref (upload->protocol);
+		upload->protocol = g_object_ref (protocol);
+	} else {
+		upload = g_slice_new0 (RemoteDraftUpload);
+		upload->protocol = g_object_ref (protocol);
+		upload->transport_account = g_object_ref (transport_account);
+		upload->old_msg = (draft_msg) ? g_object_ref (draft_msg) : NULL;
+	}
+	upload->msg = g_object_ref (msg);
+	g_hash_table_insert (remote_draft_uploads, upload->msg, upload);
+
+	upload->timeout_id = g_timeout_add_seconds (REMOTE_DRAFT_UPLOAD_DELAY,
+						    upload_remote_draft_timeout, upload);
+}
+
 typedef struct
 {
 	TnyTransportAccount *transport_account;
@@ -1260,7 +1473,6 @@ modest_mail_operation_save_to_drafts_add_msg_cb(TnyFolder *self,
 	ModestMailOperationPrivate *priv = NULL;
 	SaveToDraftsAddMsgInfo *info = (SaveToDraftsAddMsgInfo *) userdata;
 	GError *io_error = NULL;
-	gboolean callback_called = FALSE;
 
 	priv = MODEST_MAIL_OPERATION_GET_PRIVATE(info->mailop);
 
@@ -1305,7 +1517,9 @@ modest_mail_operation_save_to_drafts_add_msg_cb(TnyFolder *self,
 		priv->status = MODEST_MAIL_OPERATION_STATUS_SUCCESS;
 	}
 
-	if (info->transport_account) {
+	/* Upload the draft to the server later, see
+	   schedule_remote_draft_upload */
+	if (info->transport_account && priv->status != MODEST_MAIL_OPERATION_STATUS_FAILED) {
 		ModestProtocolType transport_protocol_type;
 		ModestProtocol *transport_protocol;
 
@@ -1313,24 +1527,14 @@ modest_mail_operation_save_to_drafts_add_msg_cb(TnyFolder *self,
 
 		transport_protocol = modest_protocol_registry_get_protocol_by_type (modest_runtime_get_protocol_registry (),
 										    transport_protocol_type);
-		if (transport_protocol && MODEST_IS_ACCOUNT_PROTOCOL (transport_protocol)) {
-			FinishSaveRemoteDraftInfo *srd_info = g_slice_new (FinishSaveRemoteDraftInfo);
-			srd_info->mailop = info->mailop?g_object_ref (info->mailop):NULL;
-			srd_info->msg = info->msg?g_object_ref (info->msg):NULL;
-			srd_info->callback = info->callback;
-			srd_info->userdata = info->user_data;
-			modest_account_protocol_save_remote_draft (MODEST_ACCOUNT_PROTOCOL (transport_protocol), 
-								   tny_account_get_id (TNY_ACCOUNT (info->transport_account)),
-								   info->msg, info->draft_msg,
-								   finish_save_remote_draft,
-								   srd_info);
-								   
-			callback_called = TRUE;
-		}
+		if (transport_protocol && MODEST_IS_ACCOUNT_PROTOCOL (transport_protocol))
+			schedule_remote_draft_upload (MODEST_ACCOUNT_PROTOCOL (transport_protocol),
+						      info->transport_account,
+						      info->msg, info->draft_msg);
 	}
 
 	/* Call the user callback */
-	if (!callback_called && info->callback)
+	if (info->callback)
 		info->callback (info->mailop, info->msg, info->user_data);
 
 	if (info->transport_account)
@@ -1342,8 +1546,7 @@ modest_mail_operation_save_to_drafts_add_msg_cb(TnyFolder *self,
 	if (info->msg)
 		g_object_unref (G_OBJECT (info->msg));
 
-	if (!callback_called)
-		modest_mail_operation_notify_end (info->mailop);
+	modest_mail_operation_notify_end (info->mailop);
         if (info->mailop)
 		g_object_unref(info->mailop);
 	g_slice_free (SaveToDraftsAddMsgInfo, info);
@@ -1562,6 +1765,7 @@ update_account_send_mail (UpdateAccountInfo *info)
 {
 	TnyTransportAccount *transport_account = NULL;
 	ModestTnyAccountStore *account_store;
+	ModestMailOperationPrivate *priv;
 
 	if (info->update_folder_counts)
 		return;
@@ -1604,9 +1808,12 @@ update_account_send_mail (UpdateAccountInfo *info)
 								 mail_op);
 				modest_mail_operation_queue_wakeup (mail_op, MODEST_TNY_SEND_QUEUE (send_queue));
 
-				/* Try to send */
+				/* Try to send. It's checked here and not when the
+				   operation starts because it could have been
+				   requested by the user in the meantime */
+				priv = MODEST_MAIL_OPERATION_GET_PRIVATE (info->mail_op);
 				modest_tny_send_queue_set_requested_send_receive (MODEST_TNY_SEND_QUEUE (send_queue), 
-										  info->interactive);
+										  priv->interactive);
 			}
 		}
 	}
@@ -1831,8 +2038,15 @@ folder_refreshed_cb (TnyFolder *current_folder,
 		}
 		while (!tny_iterator_is_done (new_headers_iter)) {
 			TnyHeader *header = NULL;
+			gchar *from;
 
 			header = TNY_HEADER (tny_iterator_get_current (new_headers_iter));
+
+			/* Remember the senders for the address completion */
+			from = tny_header_dup_from (header);
+			modest_recipient_index_add (from, FALSE);
+			g_free (from);
+
 			/* Apply per-message size limits */
 			if (tny_header_get_message_size (header) < max_size)
 				g_ptr_array_add (new_headers_array, g_object_ref (header));
@@ -2199,7 +2413,8 @@ modest_mail_operation_update_account (ModestMailOperation *self,
 	info->folders2 = tny_simple_list_new ();
 	info->mail_op = g_object_ref (self);
 	info->poke_all = poke_all;
-	info->interactive = interactive;
+	if (interactive)
+		priv->interactive = TRUE;
 	info->update_folder_counts = FALSE;
 	info->account_name = g_strdup (account_name);
 	info->callback = callback;
@@ -2281,7 +2496,6 @@ modest_mail_operation_update_folder_counts (ModestMailOperation *self,
 	info->folders2 = tny_simple_list_new ();
 	info->mail_op = g_object_ref (self);
 	info->poke_all = TRUE;
-	info->interactive = FALSE;
 	info->update_folder_counts = TRUE;
 	info->account_name = g_strdup (account_name);
 	info->callback = NULL;
@@ -2516,6 +2730,7 @@ modest_mail_operation_remove_folder (ModestMailOperation *self,
 		TnyFolderStore *parent = tny_folder_get_folder_store (folder);
 		if (parent) {
 			modest_mail_operation_notify_start (self);
+			modest_bodies_cache_remove_folder (folder);
 			tny_folder_store_remove_folder (parent, folder, &(priv->error));
 			CHECK_EXCEPTION (priv, MODEST_MAIL_OPERATION_STATUS_FAILED);
 			
@@ -2837,6 +3052,19 @@ modest_mail_operation_rename_folder (ModestMailOperation *self,
 /* **************************  MSG  ACTIONS  ************************* */
 /* ******************************************************************* */
 
+static void
+trace_get_msg_begin (GetMsgInfo *helper, TnyHeader *header)
+{
+	gchar *uid;
+
+	if (!modest_trace_is_enabled ())
+		return;
+
+	uid = tny_header_dup_uid (header);
+	helper->trace_span = modest_trace_begin ("mail-op:get-msg", uid);
+	g_free (uid);
+}
+
 void 
 modest_mail_operation_find_msg (ModestMailOperation *self,
 				TnyFolder *folder,
@@ -2899,6 +3127,7 @@ modest_mail_operation_find_msg (ModestMailOperation *self,
 				0, state, NULL);
 	g_slice_free (ModestMailOperationState, state);
 	
+	helper->trace_span = modest_trace_begin ("mail-op:get-msg", msg_uid);
 	tny_folder_find_msg_async (folder, msg_uid, get_msg_async_cb, get_msg_status_cb, helper);
 }
 
@@ -2968,6 +3197,7 @@ modest_mail_operation_get_msg (ModestMailOperation *self,
 				0, state, NULL);
 	g_slice_free (ModestMailOperationState, state);
 	
+	trace_get_msg_begin (helper, header);
 	tny_folder_get_msg_async (folder, header, get_msg_async_cb, get_msg_status_cb, helper);
 
 	g_object_unref (G_OBJECT (folder));
@@ -3051,6 +3281,7 @@ modest_mail_operation_get_msg_and_parts (ModestMailOperation *self,
 				0, state, NULL);
 	g_slice_free (ModestMailOperationState, state);
 	
+	trace_get_msg_begin (helper, header);
 	tny_folder_get_msg_async (folder, header, get_msg_async_cb, get_msg_status_cb, helper);
 
 	g_object_unref (G_OBJECT (folder));
@@ -3143,6 +3374,27 @@ get_msg_async_cb (TnyFolder *folder,
 	if (info->header == NULL && msg)
 		info->header = tny_msg_get_header (msg);
 
+	/* The references are only available in the full message */
+	if (msg && !canceled && !err && (finished || info->get_parts == NULL))
+		modest_conversation_index_add_msg (folder, msg);
+
+	/* The message was written in the folder cache, and that is
+	   not always notified to the folder observers */
+	if (msg && !canceled && !err && finished) {
+		ModestFolderStatsMgr *stats_mgr = modest_runtime_get_folder_stats_mgr ();
+		if (stats_mgr)
+			modest_folder_stats_mgr_folder_changed (stats_mgr, folder);
+	}
+
+	/* The message (and the parts) are available now */
+	if (finished && info->trace_span) {
+		if (canceled || err)
+			modest_trace_cancel (info->trace_span);
+		else
+			modest_trace_end (info->trace_span);
+		info->trace_span = NULL;
+	}
+
 	/* Call the user callback */
 	if (info->user_callback && (finished || (info->get_parts == NULL)))
 		info->user_callback (info->mail_op, info->header, canceled, 
@@ -3488,6 +3740,9 @@ modest_mail_operation_remove_msgs (ModestMailOperation *self,
 	}
 	g_object_unref (iter);
 
+	/* Forget their rendered bodies */
+	modest_bodies_cache_remove_msgs (remove_headers);
+
 	/* remove message from folder */
 	modest_mail_operation_notify_start (self);
 	tny_folder_remove_msgs_async (folder, remove_headers, remove_msgs_async_cb, 
@@ -3847,6 +4102,10 @@ modest_mail_operation_xfer_msgs (ModestMailOperation *self,
 	/* Do not delete messages if leave on server is TRUE */
 	helper->delete = (leave_on_server) ? FALSE : delete_original;
 
+	/* The moved messages will be expunged from the source folder */
+	if (helper->delete)
+		modest_bodies_cache_remove_msgs (headers);
+
 	modest_mail_operation_notify_start (self);
 
 	/* Start notifying progress */
@@ -4230,6 +4489,17 @@ modest_mail_operation_notify_start (ModestMailOperation *self)
 	/* Ensure that all the fields are filled correctly */
 	g_return_if_fail (priv->op_type != MODEST_MAIL_OPERATION_TYPE_UNKNOWN);
 
+	/* Trace the whole life of the operation. The type is used as
+	   the name of the span, it's a static string */
+	if (modest_trace_is_enabled ()) {
+		modest_trace_cancel (priv->trace_span);
+		priv->trace_span = modest_trace_begin (modest_mail_operation_type_to_string (priv->op_type),
+						       priv->account ? tny_account_get_id (priv->account) : NULL);
+	}
+
+	if (!priv->metrics.started)
+		priv->metrics.started = modest_trace_get_monotonic_time ();
+
 	/* Notify the observers about the mail operation. We do not
 	   wrapp this emission because we assume that this function is
 	   always called from within the main lock */
@@ -4258,11 +4528,45 @@ modest_mail_operation_notify_end (ModestMailOperation *self)
 	   function is always called from within the main lock */
 	g_signal_emit (G_OBJECT (self), signals[OPERATION_FINISHED_SIGNAL], 0, NULL);
 
+	modest_trace_end (priv->trace_span);
+	priv->trace_span = NULL;
+
+	/* Operations that never got a type (for example the ones
+	   that failed before doing anything) are not interesting */
+	if (priv->op_type != MODEST_MAIL_OPERATION_TYPE_UNKNOWN) {
+		priv->metrics.finished = modest_trace_get_monotonic_time ();
+		modest_mail_operation_stats_record (priv->op_type, priv->status, &(priv->metrics));
+	}
+
 	/* Remove the error user data */
 	if (priv->error_checking_user_data && priv->error_checking_user_data_destroyer)
 		priv->error_checking_user_data_destroyer (priv->error_checking_user_data);
 }
 
+void
+modest_mail_operation_set_queued (ModestMailOperation *self)
+{
+	ModestMailOperationPrivate *priv = NULL;
+
+	g_return_if_fail (MODEST_IS_MAIL_OPERATION (self));
+
+	priv = MODEST_MAIL_OPERATION_GET_PRIVATE(self);
+
+	priv->metrics.queued = modest_trace_get_monotonic_time ();
+}
+
+void
+modest_mail_operation_set_interactive (ModestMailOperation *self)
+{
+	ModestMailOperationPrivate *priv = NULL;
+
+	g_return_if_fail (MODEST_IS_MAIL_OPERATION (self));
+
+	priv = MODEST_MAIL_OPERATION_GET_PRIVATE(self);
+
+	priv->interactive = TRUE;
+}
+
 TnyAccount *
 modest_mail_operation_get_account (ModestMailOperation *self)
 {
@@ -4335,6 +4639,27 @@ void modest_mail_operation_disconnect_account (ModestMailOperation *self, TnyAcc
 	modest_mail_operation_notify_start (self);
 }
 
+const gchar*
+modest_mail_operation_type_to_string (ModestMailOperationTypeOperation op_type)
+{
+	switch (op_type) {
+	case MODEST_MAIL_OPERATION_TYPE_SEND:    return "SEND";
+	case MODEST_MAIL_OPERATION_TYPE_SEND_AND_RECEIVE:    return "SEND-AND-RECEIVE";
+	case MODEST_MAIL_OPERATION_TYPE_RECEIVE: return "RECEIVE";
+	case MODEST_MAIL_OPERATION_TYPE_OPEN:    return "OPEN";
+	case MODEST_MAIL_OPERATION_TYPE_DELETE:  return "DELETE";
+	case MODEST_MAIL_OPERATION_TYPE_INFO:    return "INFO";
+	case MODEST_MAIL_OPERATION_TYPE_RUN_QUEUE: return "RUN-QUEUE";
+	case MODEST_MAIL_OPERATION_TYPE_SYNC_FOLDER: return "SYNC-FOLDER";
+	case MODEST_MAIL_OPERATION_TYPE_SHUTDOWN: return "SHUTDOWN";
+	case MODEST_MAIL_OPERATION_TYPE_QUEUE_WAKEUP: return "QUEUE-WAKEUP";
+	case MODEST_MAIL_OPERATION_TYPE_UPDATE_FOLDER_COUNTS: return "UPDATE-FOLDER-COUNTS";
+	case MODEST_MAIL_OPERATION_TYPE_DISCONNECT_ACCOUNT: return "DISCONNECT-ACCOUNT";
+	case MODEST_MAIL_OPERATION_TYPE_UNKNOWN: return "UNKNOWN";
+	default: return "UNEXPECTED";
+	}
+}
+
 gchar*
 modest_mail_operation_to_string (ModestMailOperation *self)
 {
@@ -4349,19 +4674,7 @@ modest_mail_operation_to_string (ModestMailOperation *self)
 	if (priv->op_type == MODEST_MAIL_OPERATION_TYPE_UNKNOWN)
 		return g_strdup_printf ("%p <new operation>", self);
 	
-	switch (priv->op_type) {
-	case MODEST_MAIL_OPERATION_TYPE_SEND:    type= "SEND";    break;
-	case MODEST_MAIL_OPERATION_TYPE_SEND_AND_RECEIVE:    type= "SEND-AND-RECEIVE";    break;
-	case MODEST_MAIL_OPERATION_TYPE_RECEIVE: type= "RECEIVE"; break;
-	case MODEST_MAIL_OPERATION_TYPE_OPEN:    type= "OPEN";    break;
-	case MODEST_MAIL_OPERATION_TYPE_DELETE:  type= "DELETE";  break;
-	case MODEST_MAIL_OPERATION_TYPE_INFO:    type= "INFO";    break;
-	case MODEST_MAIL_OPERATION_TYPE_RUN_QUEUE: type= "RUN-QUEUE"; break;
-	case MODEST_MAIL_OPERATION_TYPE_SYNC_FOLDER: type= "SYNC-FOLDER"; break;
-	case MODEST_MAIL_OPERATION_TYPE_SHUTDOWN: type= "SHUTDOWN"; break;
-	case MODEST_MAIL_OPERATION_TYPE_UNKNOWN: type= "UNKNOWN"; break;
-	default: type = "UNEXPECTED"; break;
-	}
+	type = modest_mail_operation_type_to_string (priv->op_type);
 
 	switch (priv->status) {
 	case MODEST_MAIL_OPERATION_STATUS_INVALID:              status= "INVALID"; break;
@@ -4390,6 +4703,10 @@ _check_memory_low (ModestMailOperation *mail_op)
 	if (modest_platform_check_memory_low (NULL, FALSE)) {
 		ModestMailOperationPrivate *priv;
 
+		/* Release the memory used by the caches, they could
+		   be regenerated later if needed */
+		modest_cache_mgr_on_memory_low (modest_runtime_get_cache_mgr ());
+
 		priv = MODEST_MAIL_OPERATION_GET_PRIVATE (mail_op);
 		priv->status = MODEST_MAIL_OPERATION_STATUS_FAILED;
 		g_set_error (&(priv->error),
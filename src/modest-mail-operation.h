@@ -869,6 +869,49 @@ void modest_mail_operation_disconnect_account (ModestMailOperation *self, TnyAcc
  **/
 gchar* modest_mail_operation_to_string (ModestMailOperation *self);
 
+/**
+ * modest_mail_operation_type_to_string:
+ * @op_type: a #ModestMailOperationTypeOperation
+ *
+ * get a name for the type of operation (for debugging)
+ *
+ * Returns: a static string
+ **/
+const gchar* modest_mail_operation_type_to_string (ModestMailOperationTypeOperation op_type);
+
+/**
+ * modest_mail_operation_set_queued:
+ * @self: a #ModestMailOperation
+ *
+ * marks the time the operation was added to the mail operation
+ * queue, used to measure how long it waited before starting. It's
+ * called by #ModestMailOperationQueue
+ **/
+void modest_mail_operation_set_queued (ModestMailOperation *self);
+
+/**
+ * modest_mail_operation_set_interactive:
+ * @self: a #ModestMailOperation
+ *
+ * marks the operation as requested by the user, as if it was started
+ * with @interactive set to %TRUE. It could be called at any time,
+ * even while the operation is running, for example when the user
+ * asks for a send&receive that is already running in the background
+ **/
+void modest_mail_operation_set_interactive (ModestMailOperation *self);
+
+/**
+ * modest_mail_operation_flush_remote_drafts:
+ *
+ * starts now the uploads of remote drafts that were waiting for
+ * their delay, see modest_mail_operation_save_to_drafts(). It must be
+ * called before exiting, so the last version of the drafts is not
+ * lost
+ *
+ * Returns: %TRUE if there are uploads of remote drafts running
+ **/
+gboolean modest_mail_operation_flush_remote_drafts (void);
+
 
 G_END_DECLS
 
@@ -35,11 +35,14 @@
 #include "modest-init.h"
 #include "modest-platform.h"
 #include "modest-ui-actions.h"
+#include "modest-startup.h"
 
 static gboolean show_ui = FALSE;
+static gboolean daemon_mode = FALSE;
 static GOptionEntry option_entries [] =
 {
 	{ "show-ui", 's', 0, G_OPTION_ARG_NONE, &show_ui, "Show UI immediately, so no wait for DBUS activation", NULL },
+	{ "daemon", 'd', 0, G_OPTION_ARG_NONE, &daemon_mode, "Only provide the D-Bus service, the UI is initialized on demand", NULL },
 	{ NULL }
 };
 
@@ -49,6 +52,9 @@ typedef struct {
 	gulong get_password_handler;
 } MainSignalHandlers;
 
+/* The main loop when running as a D-Bus service */
+static GMainLoop *daemon_loop = NULL;
+
 static gboolean
 on_idle_exit_modest (gpointer data)
 {
@@ -59,6 +65,13 @@ on_idle_exit_modest (gpointer data)
 	gdk_threads_enter ();
 	mail_op_queue = modest_runtime_get_mail_operation_queue ();
 
+	/* Upload the remote drafts that are waiting, we'll try to
+	   exit again when the queue gets empty */
+	if (modest_mail_operation_flush_remote_drafts ()) {
+		gdk_threads_leave ();
+		return FALSE;
+	}
+
 	if (modest_tny_account_store_is_shutdown (modest_runtime_get_account_store ()) &&
 	    modest_mail_operation_queue_running_shutdown (mail_op_queue)) {
 
@@ -73,10 +86,17 @@ on_idle_exit_modest (gpointer data)
 		g_free (handlers);
 
 		/* Wait for remaining tasks */
-		while (gtk_events_pending ())
-			gtk_main_iteration ();
+		if (daemon_loop) {
+			while (g_main_context_pending (NULL))
+				g_main_context_iteration (NULL, FALSE);
 
-		gtk_main_quit ();
+			g_main_loop_quit (daemon_loop);
+		} else {
+			while (gtk_events_pending ())
+				gtk_main_iteration ();
+
+			gtk_main_quit ();
+		}
 	} else {
 		ModestMailOperation *mail_op;
 		mail_op = modest_mail_operation_new (NULL);
@@ -120,6 +140,27 @@ on_window_list_empty (ModestWindowMgr *window_mgr,
 		g_idle_add_full (G_PRIORITY_LOW, on_idle_exit_modest, user_data, NULL);
 }
 
+static void
+on_password_requested (TnyAccountStore *account_store,
+		       const gchar* server_account_name,
+		       gchar **username,
+		       gchar **password,
+		       gboolean *cancel,
+		       gboolean *remember,
+		       gpointer user_data)
+{
+	/* When running as a D-Bus service the UI could not be
+	   initialized yet, we need it to ask the user */
+	if (!modest_init_ui ()) {
+		*cancel = TRUE;
+		return;
+	}
+
+	modest_ui_actions_on_password_requested (account_store, server_account_name,
+						 username, password, cancel,
+						 remember, NULL);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -138,7 +179,9 @@ main (int argc, char *argv[])
 
 	context = g_option_context_new ("- Modest email client");
 	g_option_context_add_main_entries (context, option_entries, GETTEXT_PACKAGE);
-	g_option_context_add_group (context, gtk_get_option_group (TRUE));
+	/* Do not open the display while parsing, we could be running
+	   without one */
+	g_option_context_add_group (context, gtk_get_option_group (FALSE));
 	if (!g_option_context_parse (context, &argc, &argv, &error)) {
 		g_print ("option parsing failed: %s\n", error->message);
 		g_option_context_free (context);
@@ -146,37 +189,67 @@ main (int argc, char *argv[])
 	}
 	g_option_context_free (context);
 
-	if (!show_ui) {
+	if (show_ui && daemon_mode) {
+		g_printerr ("modest: --show-ui and --daemon can not be used together\n");
+		exit (1);
+	}
+
+	if (!show_ui && !daemon_mode) {
 		g_print ("modest: use 'modest -s' to start from cmdline  with UI\n");
 	}
 
 	if (!g_thread_supported())
 		g_thread_init (NULL);
 
+	modest_startup_phase_start ();
+
 	gdk_threads_init ();
 	gdk_threads_enter ();
 
 	if (!getenv("DISPLAY")) {
-		g_printerr ("modest: DISPLAY env variable is not set\n");
-		retval = 1;
-		goto cleanup;
+		if (show_ui) {
+			g_printerr ("modest: DISPLAY env variable is not set\n");
+			retval = 1;
+			goto cleanup;
+		}
+		if (!daemon_mode) {
+			g_print ("modest: DISPLAY env variable is not set, running as a D-Bus service\n");
+			daemon_mode = TRUE;
+		}
 	}
 
-	if (!gtk_init_check (&argc, &argv)) {
-		g_printerr ("modest: failed to initialize gtk\n");
-		retval = 1;
-		goto cleanup;
-	}
+	if (daemon_mode) {
+		/* Gtk+ and the UI are initialized by modest_init_ui
+		   when a D-Bus method needs them */
+		if (!modest_init_without_ui (argc, argv)) {
+			g_printerr ("modest: cannot init modest\n");
+			retval = 1;
+			goto cleanup;
+		}
+	} else {
+		if (!gtk_init_check (&argc, &argv)) {
+			g_printerr ("modest: failed to initialize gtk\n");
+			retval = 1;
+			goto cleanup;
+		}
+		modest_startup_phase_done ("gtk");
 
-	if (!modest_init (argc, argv)) {
-		g_printerr ("modest: cannot init modest\n");
-		retval = 1;
-		goto cleanup;
+		if (!modest_init (argc, argv)) {
+			g_printerr ("modest: cannot init modest\n");
+			retval = 1;
+			goto cleanup;
+		}
 	}
 
 	/* Create the account store & launch send queues */
 	acc_store = modest_runtime_get_account_store ();
 	modest_tny_account_store_start_send_queues (acc_store);
+	modest_startup_phase_done ("account-store");
+
+	/* Start collecting the folder stats, they're read in the
+	   background from now on */
+	modest_runtime_get_folder_stats_mgr ();
+	modest_startup_phase_done ("folder-stats");
 
 	handlers = g_malloc0 (sizeof (MainSignalHandlers));
 	/* Connect to the "queue-emtpy" signal */
@@ -197,12 +270,16 @@ main (int argc, char *argv[])
 	handlers->get_password_handler =
 		g_signal_connect (acc_store,
 				  "password_requested",
-				  G_CALLBACK (modest_ui_actions_on_password_requested),
+				  G_CALLBACK (on_password_requested),
 				  NULL);
 
-	/* Create cached windows */
-	mgr = modest_runtime_get_window_mgr ();
-	modest_window_mgr_create_caches (mgr);
+	/* Create cached windows. In daemon mode this is done when
+	   the UI is initialized */
+	if (!daemon_mode) {
+		mgr = modest_runtime_get_window_mgr ();
+		modest_window_mgr_create_caches (mgr);
+		modest_startup_phase_done ("window-caches");
+	}
 
 	/* Usually, we only show the UI when we get the "top_application" D-Bus method.
 	 * This allows modest to start via D-Bus activation to provide a service,
@@ -220,9 +297,21 @@ main (int argc, char *argv[])
 			retval = 1;
 			goto cleanup;
 		}
+		modest_startup_phase_done ("initial-window");
 	}
 
-	gtk_main ();
+	if (daemon_mode) {
+		/* Gtk+ may never be initialized in this mode, so its
+		   main loop can not be used */
+		daemon_loop = g_main_loop_new (NULL, FALSE);
+		gdk_threads_leave ();
+		g_main_loop_run (daemon_loop);
+		gdk_threads_enter ();
+		g_main_loop_unref (daemon_loop);
+		daemon_loop = NULL;
+	} else {
+		gtk_main ();
+	}
 
 cleanup:
 	gdk_threads_leave ();
@@ -61,6 +61,16 @@ typedef enum _ModestConnectedVia {
  */
 gboolean modest_platform_init (int argc, char *argv[]);
 
+/**
+ * modest_platform_init_ui:
+ *
+ * platform specific initialization of the UI subsystems. Gtk+ must
+ * be already initialized when this is called
+ *
+ * Returns: TRUE if succeeded, FALSE otherwise
+ */
+gboolean modest_platform_init_ui (int argc, char *argv[]);
+
 
 /**
  * modest_platform_platform_init:
@@ -361,6 +371,12 @@ GtkWidget *
 modest_platform_animation_banner (GtkWidget *parent,
 				  const gchar *annimation_name,
 				  const gchar *text);
+
+/* Changes the text of a banner created with
+ * modest_platform_animation_banner, e.g. to show the progress of the
+ * operation */
+void modest_platform_animation_banner_set_text (GtkWidget *banner,
+						const gchar *text);
 				  
 /* TODO: This isn't platform-dependent, so this isn't the best place for this. */
 /* Return TRUE immediately if the account is already online,
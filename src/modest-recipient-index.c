@@ -0,0 +1,529 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <glib/gstdio.h>
+#include "modest-defs.h"
+#include "modest-text-utils.h"
+#include "modest-recipient-index.h"
+
+/* a sent mail counts as much as this number of received ones */
+#define SENT_WEIGHT 2
+
+/* the use count of an address is halved every HALF_LIFE seconds
+   (30 days) without using it */
+#define HALF_LIFE (30 * 24 * 60 * 60)
+
+typedef struct {
+	gchar  *address;   /* as shown, "Name <email>" or the email */
+	gchar  *email;     /* lowercase */
+	gchar  *name;      /* lowercase display name, or NULL */
+	guint   count;
+	glong   last_used;
+} IndexEntry;
+
+/* The keys point into the email and the name of their entry, one
+   for the email and one for every word of the name, so "John
+   Smith <js@example.com>" is found by "js", "john" and "smith" */
+typedef struct {
+	const gchar *key;
+	IndexEntry  *entry;
+	gboolean     whole; /* it's the whole email or name */
+} IndexKey;
+
+/* file_lock serializes the reads and writes of the index file, it's
+   always taken before index_lock */
+G_LOCK_DEFINE_STATIC (file_lock);
+G_LOCK_DEFINE_STATIC (index_lock);
+static GHashTable *entries = NULL;  /* email -> IndexEntry */
+static GArray *keys = NULL;         /* IndexKey, sorted by key */
+static gboolean keys_dirty = FALSE;
+static gboolean changed = FALSE;
+static gboolean loaded = FALSE;
+static guint flush_handler = 0;
+
+static void
+index_entry_free (IndexEntry *entry)
+{
+	g_free (entry->address);
+	g_free (entry->email);
+	g_free (entry->name);
+	g_slice_free (IndexEntry, entry);
+}
+
+static gdouble
+get_score (IndexEntry *entry, glong now)
+{
+	glong age;
+
+	age = MAX (now - entry->last_used, 0);
+	return entry->count * pow (0.5, (gdouble) age / HALF_LIFE);
+}
+
+static gboolean
+is_word_separator (gchar c)
+{
+	return c == ' ' || c == '.' || c == '-' || c == '_' || c == ',';
+}
+
+static gint
+compare_keys (gconstpointer a, gconstpointer b)
+{
+	return strcmp (((IndexKey *) a)->key, ((IndexKey *) b)->key);
+}
+
+static void
+add_key (IndexEntry *entry, const gchar *key, gboolean whole)
+{
+	IndexKey index_key;
+
+	index_key.key = key;
+	index_key.entry = entry;
+	index_key.whole = whole;
+	g_array_append_val (keys, index_key);
+}
+
+static void
+add_entry_keys (gpointer key, gpointer value, gpointer userdata)
+{
+	IndexEntry *entry = (IndexEntry *) value;
+	const gchar *p;
+
+	add_key (entry, entry->email, TRUE);
+	if (!entry->name)
+		return;
+
+	add_key (entry, entry->name, TRUE);
+	for (p = entry->name + 1; *p; p++) {
+		if (is_word_separator (*(p - 1)) && !is_word_separator (*p))
+			add_key (entry, p, FALSE);
+	}
+}
+
+/* must be called with index_lock held */
+static void
+update_keys (void)
+{
+	if (!keys_dirty && keys)
+		return;
+
+	if (keys)
+		g_array_set_size (keys, 0);
+	else
+		keys = g_array_new (FALSE, FALSE, sizeof (IndexKey));
+	if (entries)
+		g_hash_table_foreach (entries, add_entry_keys, NULL);
+	g_array_sort (keys, compare_keys);
+	keys_dirty = FALSE;
+}
+
+/* returns the position of the first key not lower than @key */
+static guint
+find_first_key (const gchar *key)
+{
+	guint low = 0, high = keys->len;
+
+	while (low < high) {
+		guint middle = (low + high) / 2;
+		if (strcmp (g_array_index (keys, IndexKey, middle).key, key) < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+/* the display name of @address in lowercase without quotes, or NULL
+   if it has no name */
+static gchar*
+get_name_key (const gchar *address)
+{
+	gchar *display, *name;
+
+	display = g_strdup (address);
+	modest_text_utils_get_display_address (display);
+	g_strstrip (g_strdelimit (display, "\"", ' '));
+	if (display[0] == '\0' || display[0] == '<' || strchr (display, '@')) {
+		g_free (display);
+		return NULL;
+	}
+
+	name = g_utf8_strdown (display, -1);
+	g_free (display);
+
+	return name;
+}
+
+/* must be called with index_lock held */
+static void
+add_address (const gchar *address, guint count, glong last_used)
+{
+	IndexEntry *entry;
+	gchar *email, *email_key, *name;
+
+	if (!g_utf8_validate (address, -1, NULL))
+		return;
+
+	email = modest_text_utils_get_email_address (address);
+	if (!email)
+		return;
+	g_strstrip (email);
+	if (!strchr (email, '@') || strchr (email, ' ')) {
+		g_free (email);
+		return;
+	}
+	email_key = g_utf8_strdown (email, -1);
+	name = get_name_key (address);
+
+	if (!entries)
+		entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+						 NULL, (GDestroyNotify) index_entry_free);
+
+	entry = g_hash_table_lookup (entries, email_key);
+	if (!entry) {
+		entry = g_slice_new0 (IndexEntry);
+		entry->email = email_key;
+		entry->address = name ? g_strstrip (g_strdup (address)) : g_strdup (email);
+		entry->name = name;
+		g_hash_table_insert (entries, entry->email, entry);
+		keys_dirty = TRUE;
+	} else if (name && g_strcmp0 (name, entry->name)) {
+		/* Keep the last display name used with the address */
+		g_free (entry->address);
+		g_free (entry->name);
+		entry->address = g_strstrip (g_strdup (address));
+		entry->name = name;
+		keys_dirty = TRUE;
+		g_free (email_key);
+	} else {
+		g_free (name);
+		g_free (email_key);
+	}
+	/* The index file has an address per line */
+	g_strdelimit (entry->address, "\t\n\r", ' ');
+	entry->count += count;
+	entry->last_used = MAX (entry->last_used, last_used);
+
+	g_free (email);
+}
+
+static gboolean
+on_flush_timeout (gpointer userdata)
+{
+	modest_recipient_index_flush ();
+
+	return FALSE;
+}
+
+/* must be called with file_lock held */
+static void
+load_file (void)
+{
+	gchar *filename, *contents = NULL;
+	gchar **lines;
+	gint i;
+
+	if (loaded)
+		return;
+
+	filename = g_build_filename (g_get_home_dir (), MODEST_DIR,
+				     MODEST_RECIPIENT_INDEX_FILE, NULL);
+	if (!g_file_get_contents (filename, &contents, NULL, NULL)) {
+		G_LOCK (index_lock);
+		loaded = TRUE;
+		G_UNLOCK (index_lock);
+		g_free (filename);
+		return;
+	}
+	g_free (filename);
+
+	lines = g_strsplit (contents, "\n", -1);
+	g_free (contents);
+
+	G_LOCK (index_lock);
+	for (i = 0; lines[i]; i++) {
+		gchar **fields;
+
+		/* count \t last used \t address */
+		fields = g_strsplit (lines[i], "\t", 3);
+		if (g_strv_length (fields) == 3 && g_utf8_validate (fields[2], -1, NULL))
+			add_address (fields[2], (guint) strtoul (fields[0], NULL, 10),
+				     strtol (fields[1], NULL, 10));
+		g_strfreev (fields);
+	}
+	loaded = TRUE;
+	G_UNLOCK (index_lock);
+
+	g_strfreev (lines);
+}
+
+void
+modest_recipient_index_load (void)
+{
+	G_LOCK (file_lock);
+	load_file ();
+	G_UNLOCK (file_lock);
+}
+
+void
+modest_recipient_index_add (const gchar *recipients,
+			    gboolean sent)
+{
+	GSList *addresses, *node;
+	glong now;
+
+	if (!recipients || recipients[0] == '\0')
+		return;
+
+	addresses = modest_text_utils_split_addresses_list (recipients);
+	if (!addresses)
+		return;
+
+	now = (glong) time (NULL);
+
+	G_LOCK (index_lock);
+	for (node = addresses; node; node = g_slist_next (node))
+		add_address ((const gchar *) node->data, sent ? SENT_WEIGHT : 1, now);
+
+	changed = TRUE;
+	if (!flush_handler)
+		flush_handler = g_timeout_add_seconds (MODEST_RECIPIENT_INDEX_FLUSH_INTERVAL,
+						       on_flush_timeout, NULL);
+	G_UNLOCK (index_lock);
+
+	g_slist_foreach (addresses, (GFunc) g_free, NULL);
+	g_slist_free (addresses);
+}
+
+typedef struct {
+	IndexEntry *entry;
+	gdouble     score;
+} ScoredEntry;
+
+static gint
+compare_scored_entries (gconstpointer a, gconstpointer b)
+{
+	const ScoredEntry *sa = (const ScoredEntry *) a;
+	const ScoredEntry *sb = (const ScoredEntry *) b;
+
+	if (sa->score != sb->score)
+		return (sa->score > sb->score) ? -1 : 1;
+
+	/* Keep the keys of the same entry together */
+	if (sa->entry != sb->entry)
+		return (sa->entry < sb->entry) ? -1 : 1;
+
+	return 0;
+}
+
+GSList*
+modest_recipient_index_complete (const gchar *prefix,
+				 guint max)
+{
+	GArray *matches;
+	GSList *result = NULL;
+	IndexEntry *last = NULL;
+	gchar *prefix_key;
+	gsize prefix_len;
+	guint i, count = 0;
+	glong now;
+
+	g_return_val_if_fail (prefix, NULL);
+
+	prefix_key = g_utf8_strdown (prefix, -1);
+	g_strchug (prefix_key);
+	prefix_len = strlen (prefix_key);
+	if (prefix_len == 0) {
+		g_free (prefix_key);
+		return NULL;
+	}
+
+	matches = g_array_new (FALSE, FALSE, sizeof (ScoredEntry));
+	now = (glong) time (NULL);
+
+	G_LOCK (index_lock);
+	update_keys ();
+	for (i = find_first_key (prefix_key); i < keys->len; i++) {
+		IndexKey *key = &g_array_index (keys, IndexKey, i);
+		ScoredEntry scored;
+
+		if (strncmp (key->key, prefix_key, prefix_len) != 0)
+			break;
+		scored.entry = key->entry;
+		scored.score = get_score (key->entry, now);
+		g_array_append_val (matches, scored);
+	}
+	g_array_sort (matches, compare_scored_entries);
+
+	for (i = 0; i < matches->len && (max == 0 || count < max); i++) {
+		ScoredEntry *scored = &g_array_index (matches, ScoredEntry, i);
+
+		if (scored->entry == last)
+			continue;
+		result = g_slist_prepend (result, g_strdup (scored->entry->address));
+		last = scored->entry;
+		count++;
+	}
+	G_UNLOCK (index_lock);
+
+	g_array_free (matches, TRUE);
+	g_free (prefix_key);
+
+	return g_slist_reverse (result);
+}
+
+gchar*
+modest_recipient_index_lookup (const gchar *name)
+{
+	IndexEntry *found = NULL;
+	gchar *key, *result = NULL;
+	guint i;
+
+	g_return_val_if_fail (name, NULL);
+
+	if (strchr (name, '@')) {
+		gchar *email = modest_text_utils_get_email_address (name);
+		if (!email)
+			return NULL;
+		key = g_utf8_strdown (g_strstrip (email), -1);
+		g_free (email);
+	} else {
+		key = get_name_key (name);
+		if (!key)
+			return NULL;
+	}
+
+	G_LOCK (index_lock);
+	update_keys ();
+	for (i = find_first_key (key); i < keys->len; i++) {
+		IndexKey *index_key = &g_array_index (keys, IndexKey, i);
+
+		if (strcmp (index_key->key, key) != 0)
+			break;
+		if (!index_key->whole || index_key->entry == found)
+			continue;
+		if (found) {
+			/* Ambiguous */
+			found = NULL;
+			break;
+		}
+		found = index_key->entry;
+	}
+	if (found)
+		result = g_strdup (found->address);
+	G_UNLOCK (index_lock);
+
+	g_free (key);
+
+	return result;
+}
+
+static gint
+compare_entries_by_score (gconstpointer a, gconstpointer b, gpointer userdata)
+{
+	glong now = *((glong *) userdata);
+	gdouble score_a = get_score (*((IndexEntry **) a), now);
+	gdouble score_b = get_score (*((IndexEntry **) b), now);
+
+	if (score_a == score_b)
+		return 0;
+	return (score_a > score_b) ? -1 : 1;
+}
+
+static void
+add_to_array (gpointer key, gpointer value, gpointer userdata)
+{
+	g_ptr_array_add ((GPtrArray *) userdata, value);
+}
+
+void
+modest_recipient_index_flush (void)
+{
+	GPtrArray *sorted;
+	GString *str = NULL;
+	glong now;
+	guint i;
+
+	G_LOCK (file_lock);
+
+	/* Do not overwrite the addresses of the file if it was
+	   never read */
+	load_file ();
+
+	G_LOCK (index_lock);
+	if (flush_handler) {
+		g_source_remove (flush_handler);
+		flush_handler = 0;
+	}
+	if (changed && entries) {
+		now = (glong) time (NULL);
+		sorted = g_ptr_array_sized_new (g_hash_table_size (entries));
+		g_hash_table_foreach (entries, add_to_array, sorted);
+		g_ptr_array_sort_with_data (sorted, compare_entries_by_score, &now);
+
+		str = g_string_sized_new (sorted->len * 48);
+		for (i = 0; i < sorted->len; i++) {
+			IndexEntry *entry = (IndexEntry *) g_ptr_array_index (sorted, i);
+
+			/* Forget the least used ones */
+			if (i >= MODEST_RECIPIENT_INDEX_MAX_ENTRIES) {
+				g_hash_table_remove (entries, entry->email);
+				keys_dirty = TRUE;
+				continue;
+			}
+			g_string_append_printf (str, "%u\t%ld\t%s\n",
+						entry->count, entry->last_used, entry->address);
+		}
+		g_ptr_array_free (sorted, TRUE);
+		changed = FALSE;
+	}
+	G_UNLOCK (index_lock);
+
+	if (str) {
+		gchar *filename;
+		GError *error = NULL;
+
+		filename = g_build_filename (g_get_home_dir (), MODEST_DIR,
+					     MODEST_RECIPIENT_INDEX_FILE, NULL);
+		if (!g_file_set_contents (filename, str->str, str->len, &error)) {
+			g_warning ("%s: could not write %s: %s", __FUNCTION__, filename,
+				   error ? error->message : "");
+			if (error)
+				g_error_free (error);
+		}
+		g_free (filename);
+		g_string_free (str, TRUE);
+	}
+
+	G_UNLOCK (file_lock);
+}
@@ -0,0 +1,114 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MODEST_RECIPIENT_INDEX_H__
+#define __MODEST_RECIPIENT_INDEX_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* the least used addresses are dropped when the index is saved with
+   more entries than this */
+#define MODEST_RECIPIENT_INDEX_MAX_ENTRIES 2000
+
+/* seconds between the last change and the write of the index file */
+#define MODEST_RECIPIENT_INDEX_FLUSH_INTERVAL 30
+
+/*
+ * The recipient index keeps the addresses seen in the sent and
+ * received mails, with the number of times they were seen and the
+ * last time, so they can be completed while typing them. The
+ * addresses can be found by a prefix of their email or of any of
+ * the words of their display name.
+ *
+ * All the functions can be called from any thread
+ */
+
+/**
+ * modest_recipient_index_load:
+ *
+ * reads the index file. The addresses added before it are merged
+ * with the ones in the file. It's deferred at startup, as the index
+ * is not needed to show the first window
+ */
+void      modest_recipient_index_load      (void);
+
+/**
+ * modest_recipient_index_add:
+ * @recipients: a list of addresses, as in the To: or From: headers
+ * @sent: %TRUE if they are the recipients of a sent mail, which are
+ * ranked higher than the senders of the received ones
+ *
+ * adds @recipients to the index, or updates their ranking if they
+ * were already there. The index file is written later
+ */
+void      modest_recipient_index_add       (const gchar *recipients,
+					    gboolean sent);
+
+/**
+ * modest_recipient_index_complete:
+ * @prefix: the beginning of an email address or of a name
+ * @max: the maximum number of results, 0 means no limit
+ *
+ * looks for the addresses whose email, or a word of their display
+ * name, start with @prefix. The comparison is case insensitive
+ *
+ * Returns: a newly allocated list of newly allocated strings, the
+ * full addresses ("Name <email>") ranked by use and recency, the
+ * best first
+ */
+GSList*   modest_recipient_index_complete  (const gchar *prefix,
+					    guint max);
+
+/**
+ * modest_recipient_index_lookup:
+ * @name: an email address or a display name
+ *
+ * looks for the address whose email or whole display name is @name
+ * (case insensitive). The names shared by several addresses are
+ * not resolved
+ *
+ * Returns: the full address in a newly allocated string, or %NULL
+ * if there is no unique match
+ */
+gchar*    modest_recipient_index_lookup    (const gchar *name);
+
+/**
+ * modest_recipient_index_flush:
+ *
+ * writes the index file now if it was changed. It's done some
+ * seconds after the changes, but it should be called before exiting
+ * too
+ */
+void      modest_recipient_index_flush     (void);
+
+G_END_DECLS
+
+#endif /* __MODEST_RECIPIENT_INDEX_H__ */
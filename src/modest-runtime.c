@@ -54,6 +54,9 @@ static ModestSingletons       *_singletons    = NULL;
 // as it leads to various chicken & problems with initialization
 static ModestTnyAccountStore  *_account_store  = NULL;
 
+/* created on demand, as it needs the account store */
+static ModestFolderStatsMgr   *_folder_stats_mgr = NULL;
+
 /* Signal handlers for the send queues */
 static GSList *_sig_handlers = NULL;
 
@@ -99,6 +102,11 @@ modest_runtime_uninit (void)
 
 	g_debug ("%s: cleaned up signal manager", __FUNCTION__);
 
+	if (_folder_stats_mgr) {
+		g_object_unref (_folder_stats_mgr);
+		_folder_stats_mgr = NULL;
+	}
+
 	MODEST_DEBUG_VERIFY_OBJECT_LAST_REF(_singletons,"");
 	g_object_unref(_singletons);
 	_singletons = NULL;
@@ -136,6 +144,13 @@ modest_runtime_get_images_cache   (void)
 	return modest_singletons_get_images_cache (_singletons);
 }
 
+TnyStreamCache*
+modest_runtime_get_bodies_cache   (void)
+{
+	g_return_val_if_fail (_singletons, NULL);
+	return modest_singletons_get_bodies_cache (_singletons);
+}
+
 ModestEmailClipboard*
 modest_runtime_get_email_clipboard   (void)
 {
@@ -161,6 +176,23 @@ modest_runtime_get_account_store   (void)
 	return _account_store;
 }
 
+ModestFolderStatsMgr*
+modest_runtime_get_folder_stats_mgr (void)
+{
+	g_return_val_if_fail (_singletons, NULL);
+
+	if (!_folder_stats_mgr) {
+		ModestTnyAccountStore *account_store;
+
+		account_store = modest_runtime_get_account_store ();
+		if (!account_store)
+			return NULL;
+		_folder_stats_mgr =
+			modest_folder_stats_mgr_new (TNY_ACCOUNT_STORE (account_store));
+	}
+	return _folder_stats_mgr;
+}
+
 ModestConf*
 modest_runtime_get_conf (void)
 {
@@ -313,7 +345,9 @@ modest_runtime_get_debug_flags ()
 		{ "debug-objects",      MODEST_RUNTIME_DEBUG_OBJECTS },
 		{ "debug-signals",      MODEST_RUNTIME_DEBUG_SIGNALS },
 		{ "factory-settings",   MODEST_RUNTIME_DEBUG_FACTORY_SETTINGS},
-		{ "debug-code",         MODEST_RUNTIME_DEBUG_CODE}
+		{ "debug-code",         MODEST_RUNTIME_DEBUG_CODE},
+		{ "trace",              MODEST_RUNTIME_DEBUG_TRACE},
+		{ "startup",            MODEST_RUNTIME_DEBUG_STARTUP}
 	};
 	const gchar *str;
 	static ModestRuntimeDebugFlags debug_flags = -1;
@@ -35,6 +35,7 @@
 #include <modest-conf.h>
 #include <modest-account-mgr.h>
 #include <modest-cache-mgr.h>
+#include <modest-folder-stats-mgr.h>
 #include <modest-email-clipboard.h>
 #include <modest-mail-operation-queue.h>
 #include <modest-tny-account-store.h>
@@ -57,7 +58,9 @@ typedef enum {
 	MODEST_RUNTIME_DEBUG_OBJECTS               = 1 << 2, /* for g_type_init */
 	MODEST_RUNTIME_DEBUG_SIGNALS               = 1 << 3, /* for g_type_init */
 	MODEST_RUNTIME_DEBUG_FACTORY_SETTINGS      = 1 << 4, /* reset to factory defaults */
-	MODEST_RUNTIME_DEBUG_CODE                  = 1 << 5  /* print various debugging messages */
+	MODEST_RUNTIME_DEBUG_CODE                  = 1 << 5, /* print various debugging messages */
+	MODEST_RUNTIME_DEBUG_TRACE                 = 1 << 6, /* record the spans of modest-trace */
+	MODEST_RUNTIME_DEBUG_STARTUP               = 1 << 7  /* print the duration of the startup phases */
 } ModestRuntimeDebugFlags;
 
 /**
@@ -134,6 +137,15 @@ ModestAccountMgr*         modest_runtime_get_account_mgr   (void);
  **/
 TnyStreamCache*         modest_runtime_get_images_cache   (void);
 
+/**
+ * modest_runtime_get_bodies_cache:
+ * 
+ * get the rendered bodies #TnyStreamCache singleton instance
+ * 
+ * Returns: the bodies #TnyStreamCache singleton. This should NOT be unref'd.
+ **/
+TnyStreamCache*         modest_runtime_get_bodies_cache   (void);
+
 /**
  * modest_runtime_get_email_clipboard:
  * 
@@ -153,6 +165,17 @@ ModestEmailClipboard*     modest_runtime_get_email_clipboard   (void);
 ModestTnyAccountStore*    modest_runtime_get_account_store (void);
 
 
+/**
+ * modest_runtime_get_folder_stats_mgr:
+ * 
+ * get the #ModestFolderStatsMgr singleton instance. It's created
+ * the first time it's requested, and from then on it keeps the
+ * folder statistics of all the store accounts up to date
+ *
+ * Returns: the #ModestFolderStatsMgr singleton. This should NOT be unref'd.
+ **/
+ModestFolderStatsMgr*     modest_runtime_get_folder_stats_mgr (void);
+
 /**
  * modest_runtime_get_cache_mgr:
  * 
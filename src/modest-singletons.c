@@ -57,6 +57,7 @@ struct _ModestSingletonsPrivate {
 	ModestPluginFactory   *plugin_factory;
 	ModestToolkitFactory      *toolkit_factory;
 	TnyStreamCache            *images_cache;
+	TnyStreamCache            *bodies_cache;
 };
 #define MODEST_SINGLETONS_GET_PRIVATE(o)      (G_TYPE_INSTANCE_GET_PRIVATE((o), \
                                                MODEST_TYPE_SINGLETONS, \
@@ -105,6 +106,7 @@ modest_singletons_init (ModestSingletons *obj)
 {
 	ModestSingletonsPrivate *priv;
 	gchar *images_cache_path;
+	gchar *bodies_cache_path;
 	priv = MODEST_SINGLETONS_GET_PRIVATE(obj);
 
 	priv->conf            = NULL;
@@ -126,6 +128,7 @@ modest_singletons_init (ModestSingletons *obj)
 	}
 	modest_protocol_registry_set_to_default (priv->protocol_registry);
 	priv->images_cache    = NULL;
+	priv->bodies_cache    = NULL;
 	
 	priv->conf           = modest_conf_new ();
 	if (!priv->conf) {
@@ -199,6 +202,14 @@ modest_singletons_init (ModestSingletons *obj)
 		return;
 	}
 
+	bodies_cache_path = g_build_filename (g_get_home_dir (), MODEST_DIR, MODEST_BODIES_CACHE_DIR, NULL);
+	priv->bodies_cache = tny_fs_stream_cache_new (bodies_cache_path, MODEST_BODIES_CACHE_SIZE);
+	g_free (bodies_cache_path);
+	if (!priv->bodies_cache) {
+		g_printerr ("modest: cannot create bodies cache instance\n");
+		return;
+	}
+
 }
 
 static void
@@ -213,6 +224,12 @@ modest_singletons_finalize (GObject *obj)
 		g_object_unref (G_OBJECT (priv->images_cache));
 		priv->images_cache = NULL;
 	}
+
+	if (priv->bodies_cache) {
+		MODEST_DEBUG_VERIFY_OBJECT_LAST_REF (priv->bodies_cache, "");
+		g_object_unref (G_OBJECT (priv->bodies_cache));
+		priv->bodies_cache = NULL;
+	}
 	
 	if (priv->window_mgr) {
 		MODEST_DEBUG_VERIFY_OBJECT_LAST_REF(priv->window_mgr,"");
@@ -390,6 +407,13 @@ modest_singletons_get_images_cache (ModestSingletons *self)
 	return MODEST_SINGLETONS_GET_PRIVATE(self)->images_cache;
 }
 
+TnyStreamCache* 
+modest_singletons_get_bodies_cache (ModestSingletons *self)
+{
+	g_return_val_if_fail (self, NULL);
+	return MODEST_SINGLETONS_GET_PRIVATE(self)->bodies_cache;
+}
+
 ModestPluginFactory *
 modest_singletons_get_plugin_factory (ModestSingletons *self)
 {
@@ -222,6 +222,14 @@ ModestProtocolRegistry*          modest_singletons_get_protocol_registry
  */
 TnyStreamCache*           modest_singletons_get_images_cache         (ModestSingletons *self);
 
+/**
+ * modest_singletons_get_bodies_cache:
+ * @self: a #ModestSingletons
+ *
+ * Gets the #TnyStreamCache used to store the rendered message bodies.
+ */
+TnyStreamCache*           modest_singletons_get_bodies_cache         (ModestSingletons *self);
+
 /**
  * modest_singletons_get_plugin_factory:
  * @self: a #ModestSingletons
@@ -0,0 +1,379 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+#include <gdk/gdk.h>
+#include <modest-runtime.h>
+#include "modest-trace.h"
+#include "modest-startup.h"
+
+typedef enum {
+	PHASE_SYNC,
+	PHASE_IDLE,
+	PHASE_THREAD,
+	PHASE_ON_DEMAND,  /* deferred, but somebody needed it before */
+	PHASE_WAIT        /* time blocked waiting for a worker thread */
+} PhaseKind;
+
+typedef struct {
+	const gchar *name;
+	PhaseKind    kind;
+	gint64       start;   /* usecs */
+	gint64       end;     /* usecs */
+} StartupPhase;
+
+typedef enum {
+	BARRIER_READY = 0,
+	BARRIER_PENDING,
+	BARRIER_RUNNING
+} BarrierState;
+
+typedef struct {
+	BarrierState       state;
+	ModestStartupFunc  func;
+	guint              idle_id;
+	GThread           *thread;   /* joined by the first waiter */
+} StartupBarrier;
+
+static const gchar *kind_names[] = {
+	"sync", "idle", "thread", "on-demand", "wait"
+};
+
+static const gchar *barrier_names[MODEST_STARTUP_BARRIER_NUM] = {
+	"local-folders", "address-book", "stock-icons", "autosave",
+	"recipient-index"
+};
+
+G_LOCK_DEFINE_STATIC (startup_lock);
+static GArray *phases = NULL;
+static StartupBarrier barriers[MODEST_STARTUP_BARRIER_NUM];
+static guint deferred_count = 0;   /* deferred and not finished */
+static gboolean reported = FALSE;
+static gint64 origin = 0;
+
+/* only used from the main thread */
+static gint64 phase_start = 0;
+
+/* call with the lock held */
+static void
+add_phase (const gchar *name, PhaseKind kind, gint64 start, gint64 end)
+{
+	StartupPhase phase;
+
+	if (G_UNLIKELY (!phases))
+		phases = g_array_new (FALSE, FALSE, sizeof (StartupPhase));
+	if (G_UNLIKELY (!origin))
+		origin = start;
+
+	phase.name = name;
+	phase.kind = kind;
+	phase.start = start;
+	phase.end = end;
+	g_array_append_val (phases, phase);
+}
+
+static void
+maybe_report (void)
+{
+	gboolean report;
+	gchar *str;
+
+	G_LOCK (startup_lock);
+	report = (deferred_count == 0 && !reported);
+	if (report)
+		reported = TRUE;
+	G_UNLOCK (startup_lock);
+
+	if (!report || !(modest_runtime_get_debug_flags () & MODEST_RUNTIME_DEBUG_STARTUP))
+		return;
+
+	str = modest_startup_to_string ();
+	g_printerr ("\nstartup\n"
+		    "=======\n"
+		    "%s\n", str);
+	g_free (str);
+}
+
+void
+modest_startup_phase_start (void)
+{
+	phase_start = modest_trace_get_monotonic_time ();
+
+	G_LOCK (startup_lock);
+	if (!origin)
+		origin = phase_start;
+	G_UNLOCK (startup_lock);
+}
+
+void
+modest_startup_phase_done (const gchar *name)
+{
+	gint64 end;
+
+	g_return_if_fail (name);
+
+	end = modest_trace_get_monotonic_time ();
+	if (!phase_start)
+		phase_start = end;
+
+	G_LOCK (startup_lock);
+	add_phase (name, PHASE_SYNC, phase_start, end);
+	G_UNLOCK (startup_lock);
+
+	phase_start = end;
+}
+
+static void
+run_barrier (ModestStartupBarrier barrier, ModestStartupFunc func, PhaseKind kind)
+{
+	ModestTraceSpan *span;
+	gint64 start, end;
+
+	span = modest_trace_begin (barrier_names[barrier], kind_names[kind]);
+	start = modest_trace_get_monotonic_time ();
+	func ();
+	end = modest_trace_get_monotonic_time ();
+	modest_trace_end (span);
+
+	G_LOCK (startup_lock);
+	add_phase (barrier_names[barrier], kind, start, end);
+	barriers[barrier].state = BARRIER_READY;
+	barriers[barrier].func = NULL;
+	deferred_count--;
+	G_UNLOCK (startup_lock);
+}
+
+static gboolean
+run_barrier_idle (gpointer userdata)
+{
+	ModestStartupBarrier barrier = GPOINTER_TO_INT (userdata);
+	ModestStartupFunc func;
+
+	G_LOCK (startup_lock);
+	barriers[barrier].idle_id = 0;
+	if (barriers[barrier].state != BARRIER_PENDING) {
+		G_UNLOCK (startup_lock);
+		return FALSE;
+	}
+	func = barriers[barrier].func;
+	barriers[barrier].state = BARRIER_RUNNING;
+	G_UNLOCK (startup_lock);
+
+	run_barrier (barrier, func, PHASE_IDLE);
+	maybe_report ();
+
+	return FALSE;
+}
+
+static gpointer
+run_barrier_thread (gpointer userdata)
+{
+	ModestStartupBarrier barrier = GPOINTER_TO_INT (userdata);
+	ModestStartupFunc func;
+
+	G_LOCK (startup_lock);
+	func = barriers[barrier].func;
+	G_UNLOCK (startup_lock);
+
+	run_barrier (barrier, func, PHASE_THREAD);
+	maybe_report ();
+
+	return NULL;
+}
+
+void
+modest_startup_defer (ModestStartupBarrier barrier,
+		      ModestStartupDeferMode mode,
+		      ModestStartupFunc func)
+{
+	StartupBarrier *b;
+
+	g_return_if_fail (barrier < MODEST_STARTUP_BARRIER_NUM);
+	g_return_if_fail (func);
+
+	if (mode == MODEST_STARTUP_DEFER_THREAD && !g_thread_supported ()) {
+		modest_startup_phase_start ();
+		func ();
+		modest_startup_phase_done (barrier_names[barrier]);
+		return;
+	}
+
+	G_LOCK (startup_lock);
+	b = &barriers[barrier];
+	if (b->state != BARRIER_READY || b->thread) {
+		G_UNLOCK (startup_lock);
+		g_warning ("%s: %s was already deferred", __FUNCTION__, barrier_names[barrier]);
+		return;
+	}
+
+	b->func = func;
+	deferred_count++;
+	reported = FALSE;
+
+	if (mode == MODEST_STARTUP_DEFER_THREAD) {
+		b->state = BARRIER_RUNNING;
+		b->thread = g_thread_create (run_barrier_thread, GINT_TO_POINTER (barrier), TRUE, NULL);
+		if (!b->thread) {
+			g_warning ("%s: could not create a thread for %s, running it when idle",
+				   __FUNCTION__, barrier_names[barrier]);
+			mode = MODEST_STARTUP_DEFER_IDLE;
+		}
+	}
+
+	if (mode == MODEST_STARTUP_DEFER_IDLE) {
+		b->state = BARRIER_PENDING;
+		b->idle_id = gdk_threads_add_idle_full (G_PRIORITY_LOW, run_barrier_idle,
+							GINT_TO_POINTER (barrier), NULL);
+	}
+	G_UNLOCK (startup_lock);
+}
+
+void
+modest_startup_wait (ModestStartupBarrier barrier)
+{
+	StartupBarrier *b;
+	ModestStartupFunc func = NULL;
+	GThread *thread = NULL;
+	gboolean blocked = FALSE;
+
+	g_return_if_fail (barrier < MODEST_STARTUP_BARRIER_NUM);
+
+	G_LOCK (startup_lock);
+	b = &barriers[barrier];
+	if (b->state == BARRIER_PENDING) {
+		/* Not run yet, do it now */
+		if (b->idle_id) {
+			g_source_remove (b->idle_id);
+			b->idle_id = 0;
+		}
+		func = b->func;
+		b->state = BARRIER_RUNNING;
+	} else if (b->thread) {
+		thread = b->thread;
+		b->thread = NULL;
+		blocked = (b->state == BARRIER_RUNNING);
+	}
+	G_UNLOCK (startup_lock);
+
+	if (func) {
+		run_barrier (barrier, func, PHASE_ON_DEMAND);
+		maybe_report ();
+	} else if (thread) {
+		gint64 start;
+
+		start = modest_trace_get_monotonic_time ();
+		g_thread_join (thread);
+		if (blocked) {
+			G_LOCK (startup_lock);
+			add_phase (barrier_names[barrier], PHASE_WAIT, start,
+				   modest_trace_get_monotonic_time ());
+			G_UNLOCK (startup_lock);
+		}
+	}
+}
+
+gboolean
+modest_startup_is_ready (ModestStartupBarrier barrier)
+{
+	gboolean ready;
+
+	g_return_val_if_fail (barrier < MODEST_STARTUP_BARRIER_NUM, FALSE);
+
+	G_LOCK (startup_lock);
+	ready = (barriers[barrier].state == BARRIER_READY);
+	G_UNLOCK (startup_lock);
+
+	return ready;
+}
+
+void
+modest_startup_shutdown (void)
+{
+	gint i;
+
+	for (i = 0; i < MODEST_STARTUP_BARRIER_NUM; i++) {
+		StartupBarrier *b;
+		GThread *thread;
+
+		G_LOCK (startup_lock);
+		b = &barriers[i];
+		if (b->state == BARRIER_PENDING) {
+			/* Cancel it, we're exiting */
+			if (b->idle_id) {
+				g_source_remove (b->idle_id);
+				b->idle_id = 0;
+			}
+			b->state = BARRIER_READY;
+			b->func = NULL;
+			deferred_count--;
+		}
+		thread = b->thread;
+		b->thread = NULL;
+		G_UNLOCK (startup_lock);
+
+		if (thread)
+			g_thread_join (thread);
+	}
+}
+
+gchar*
+modest_startup_to_string (void)
+{
+	GString *str;
+	gint64 sync_total = 0;
+	guint i;
+
+	str = g_string_new ("start(ms)\tduration(ms)\tmode\tname\n");
+
+	G_LOCK (startup_lock);
+	for (i = 0; phases && i < phases->len; i++) {
+		StartupPhase *phase = &g_array_index (phases, StartupPhase, i);
+
+		g_string_append_printf (str, "%.3f\t%.3f\t%s\t%s\n",
+					(phase->start - origin) / 1000.0,
+					(phase->end - phase->start) / 1000.0,
+					kind_names[phase->kind], phase->name);
+
+		/* everything that blocked the main thread */
+		if (phase->kind != PHASE_IDLE && phase->kind != PHASE_THREAD)
+			sync_total += phase->end - phase->start;
+	}
+
+	g_string_append_printf (str, "\nblocking total(ms)\t%.3f\n", sync_total / 1000.0);
+
+	g_string_append (str, "pending\t");
+	for (i = 0; i < MODEST_STARTUP_BARRIER_NUM; i++) {
+		if (barriers[i].state != BARRIER_READY)
+			g_string_append_printf (str, "%s ", barrier_names[i]);
+	}
+	g_string_append_c (str, '\n');
+	G_UNLOCK (startup_lock);
+
+	return g_string_free (str, FALSE);
+}
@@ -0,0 +1,132 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MODEST_STARTUP_H__
+#define __MODEST_STARTUP_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * the subsystems that are not needed to show the first window. They
+ * are initialized after it, and the code that needs one of them
+ * must call modest_startup_wait before using it
+ */
+typedef enum {
+	MODEST_STARTUP_BARRIER_LOCAL_FOLDERS,
+	MODEST_STARTUP_BARRIER_ADDRESS_BOOK,
+	MODEST_STARTUP_BARRIER_STOCK_ICONS,
+	MODEST_STARTUP_BARRIER_AUTOSAVE,
+	MODEST_STARTUP_BARRIER_RECIPIENT_INDEX,
+
+	MODEST_STARTUP_BARRIER_NUM
+} ModestStartupBarrier;
+
+typedef enum {
+	MODEST_STARTUP_DEFER_IDLE,   /* in the main loop, when it's idle */
+	MODEST_STARTUP_DEFER_THREAD  /* in a worker thread */
+} ModestStartupDeferMode;
+
+typedef void (*ModestStartupFunc) (void);
+
+/**
+ * modest_startup_phase_start:
+ *
+ * sets the start of the next phase to the current time. It must be
+ * called from the main thread
+ */
+void      modest_startup_phase_start  (void);
+
+/**
+ * modest_startup_phase_done:
+ * @name: the name of the phase. It must be a static string
+ *
+ * records that the phase @name finished, it started in the last
+ * call to modest_startup_phase_start or modest_startup_phase_done.
+ * It must be called from the main thread
+ */
+void      modest_startup_phase_done   (const gchar *name);
+
+/**
+ * modest_startup_defer:
+ * @barrier: the #ModestStartupBarrier
+ * @mode: where @func should be run
+ * @func: the initialization function
+ *
+ * schedules @func to be run after the first window is shown. If
+ * threads are not supported, MODEST_STARTUP_DEFER_THREAD functions
+ * are run immediately. It must be called from the main thread
+ */
+void      modest_startup_defer        (ModestStartupBarrier barrier,
+				       ModestStartupDeferMode mode,
+				       ModestStartupFunc func);
+
+/**
+ * modest_startup_wait:
+ * @barrier: the #ModestStartupBarrier
+ *
+ * blocks until @barrier is ready. If its function was not run yet,
+ * it's run now. It returns immediately if @barrier was never
+ * deferred. It must be called from the main thread
+ */
+void      modest_startup_wait         (ModestStartupBarrier barrier);
+
+/**
+ * modest_startup_is_ready:
+ * @barrier: the #ModestStartupBarrier
+ *
+ * Returns: %TRUE if the function of @barrier was already run or if
+ * it was never deferred, %FALSE otherwise
+ */
+gboolean  modest_startup_is_ready     (ModestStartupBarrier barrier);
+
+/**
+ * modest_startup_shutdown:
+ *
+ * cancels the deferred functions that were not run yet, and waits
+ * for the ones running in worker threads
+ */
+void      modest_startup_shutdown     (void);
+
+/**
+ * modest_startup_to_string:
+ *
+ * Returns a string representation of the recorded phases, with
+ * their start time and duration, and of the barriers still
+ * pending. If MODEST_DEBUG contains "startup" it's printed once all
+ * the deferred functions finished
+ *
+ * Returns: a newly allocated string
+ */
+gchar*    modest_startup_to_string    (void);
+
+G_END_DECLS
+
+#endif /* __MODEST_STARTUP_H__ */
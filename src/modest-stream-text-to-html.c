@@ -34,6 +34,7 @@
 #include <tny-stream.h>
 #include <string.h>
 #include <modest-text-utils.h>
+#include <modest-trace.h>
 
 #define HTML_PREFIX "<html><head>" \
 	"<meta http-equiv=\"content-type\" content=\"text/html; charset=utf8\">" \
@@ -61,6 +62,7 @@ struct _ModestStreamTextToHtmlPrivate {
 	gsize line_limit;
 	gsize total_output;
 	gsize total_lines_output;
+	ModestTraceSpan *trace_span;
 };
 #define MODEST_STREAM_TEXT_TO_HTML_GET_PRIVATE(o)      (G_TYPE_INSTANCE_GET_PRIVATE((o), \
                                                        MODEST_TYPE_STREAM_TEXT_TO_HTML, \
@@ -128,6 +130,7 @@ modest_stream_text_to_html_init (ModestStreamTextToHtml *obj)
 	priv->full_limit = 0;
 	priv->total_output = 0;
 	priv->total_lines_output = 0;
+	priv->trace_span = NULL;
 	modest_text_utils_hyperlinkify_begin ();
 }
 
@@ -143,6 +146,8 @@ modest_stream_text_to_html_finalize (GObject *obj)
 	if (priv->line_buffer != NULL) {
 		g_string_free (priv->line_buffer, TRUE);
 	}
+	/* It was never closed */
+	modest_trace_cancel (priv->trace_span);
 	modest_text_utils_hyperlinkify_end ();
 }
 
@@ -256,6 +261,8 @@ text_to_html_write (TnyStream *self, const char *buffer, size_t n)
 
 	modest_text_utils_hyperlinkify_begin ();
 	if ((!priv->written_prefix) && (n > 0)) {
+		/* Measure from the first write until it's closed */
+		priv->trace_span = modest_trace_begin ("text-to-html", NULL);
 		if (!write_line (self, HTML_PREFIX, FALSE)) {
 			modest_text_utils_hyperlinkify_end ();
 			return -1;
@@ -319,6 +326,9 @@ text_to_html_close (TnyStream *self)
 	
 	priv->out_stream = NULL;
 
+	modest_trace_end (priv->trace_span);
+	priv->trace_span = NULL;
+
 	return 0;
 }
 
@@ -368,132 +368,117 @@ modest_text_utils_derived_subject (const gchar *subject, gboolean is_reply)
 }
 
 
-/* Performs a case-insensitive strstr for ASCII strings */
-static const gchar *
-ascii_stristr(const gchar *haystack, const gchar *needle)
+/* the lowercase email of the address at @span, to compare the
+   addresses in a hash table */
+static gchar*
+get_email_key (const gchar *addresses, const ModestAddressSpan *span)
 {
-	int needle_len;
-	int haystack_len;
-	const gchar *pos;
-	const gchar *max_pos;
-
-	if (haystack == NULL || needle == NULL) {
-		return haystack;  /* as in strstr */
-	}
-
-	needle_len = strlen(needle);
-
-	if (needle_len == 0) {
-		return haystack;  /* as in strstr */
-	}
-
-	haystack_len = strlen(haystack);
-	max_pos = haystack + haystack_len - needle_len;
-
-	for (pos = haystack; pos <= max_pos; pos++) {
-		if (g_ascii_strncasecmp (pos, needle, needle_len) == 0) {
-			return pos;
-		}
-	}
-
-	return NULL;
+	return g_ascii_strdown (addresses + span->email_start,
+				span->email_end - span->email_start);
 }
 
+static void
+append_address (GString *str, const gchar *addresses, const ModestAddressSpan *span)
+{
+	if (str->len > 0)
+		g_string_append_c (str, ',');
+	g_string_append_len (str, addresses + span->start, span->end - span->start);
+}
 
 gchar*
-modest_text_utils_remove_address (const gchar *address_list, const gchar *address)
+modest_text_utils_remove_addresses (const gchar *address_list, const gchar *addresses)
 {
-	gchar *dup, *token, *ptr = NULL, *result;
+	GArray *spans;
+	GHashTable *table;
 	GString *filtered_emails;
-	gchar *email_address;
+	gboolean removed = FALSE;
+	guint i;
 
 	g_return_val_if_fail (address_list, NULL);
 
-	if (!address)
+	if (!addresses)
 		return g_strdup (address_list);
 
-	email_address = get_email_from_address (address);
-
-	/* search for substring */
-	if (!ascii_stristr ((const char *) address_list, (const char *) email_address)) {
-		g_free (email_address);
-		return g_strdup (address_list);
+	/* The emails to remove */
+	table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	spans = modest_text_utils_parse_addresses (addresses);
+	for (i = 0; i < spans->len; i++) {
+		ModestAddressSpan *span = &g_array_index (spans, ModestAddressSpan, i);
+		g_hash_table_insert (table, get_email_key (addresses, span), GINT_TO_POINTER (1));
 	}
+	g_array_free (spans, TRUE);
 
-	dup = g_strdup (address_list);
-	filtered_emails = g_string_new (NULL);
+	filtered_emails = g_string_sized_new (strlen (address_list));
+	spans = modest_text_utils_parse_addresses (address_list);
+	for (i = 0; i < spans->len; i++) {
+		ModestAddressSpan *span = &g_array_index (spans, ModestAddressSpan, i);
+		gchar *email = get_email_key (address_list, span);
 
-	token = strtok_r (dup, ",", &ptr);
-
-	while (token != NULL) {
 		/* Add to list if not found */
-		if (!ascii_stristr ((const char *) token, (const char *) email_address)) {
-			if (filtered_emails->len == 0)
-				g_string_append_printf (filtered_emails, "%s", g_strstrip (token));
-			else
-				g_string_append_printf (filtered_emails, ",%s", g_strstrip (token));
-		}
-		token = strtok_r (NULL, ",", &ptr);
+		if (g_hash_table_lookup (table, email))
+			removed = TRUE;
+		else
+			append_address (filtered_emails, address_list, span);
+		g_free (email);
 	}
-	result = filtered_emails->str;
+	g_array_free (spans, TRUE);
+	g_hash_table_unref (table);
 
-	/* Clean */
-	g_free (email_address);
-	g_free (dup);
-	g_string_free (filtered_emails, FALSE);
+	/* Return the list untouched if there was nothing to remove */
+	if (!removed) {
+		g_string_free (filtered_emails, TRUE);
+		return g_strdup (address_list);
+	}
 
-	return result;
+	return g_string_free (filtered_emails, FALSE);
+}
+
+gchar*
+modest_text_utils_remove_address (const gchar *address_list, const gchar *address)
+{
+	g_return_val_if_fail (address_list, NULL);
+
+	return modest_text_utils_remove_addresses (address_list, address);
 }
 
 
 gchar*
 modest_text_utils_remove_duplicate_addresses (const gchar *address_list)
 {
-	GSList *addresses, *cursor;
+	GArray *spans;
 	GHashTable *table;
-	gchar *new_list = NULL;
-	
+	GString *new_list;
+	guint i;
+
 	g_return_val_if_fail (address_list, NULL);
 
 	table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
-	addresses = modest_text_utils_split_addresses_list (address_list);
+	new_list = g_string_sized_new (strlen (address_list));
+	spans = modest_text_utils_parse_addresses (address_list);
 
-	cursor = addresses;
-	while (cursor) {
-		const gchar* address = (const gchar*)cursor->data;
+	for (i = 0; i < spans->len; i++) {
+		ModestAddressSpan *span = &g_array_index (spans, ModestAddressSpan, i);
 
 		/* We need only the email to just compare it and not
 		   the full address which would make "a <a@a.com>"
 		   different from "a@a.com" */
-		const gchar *email = get_email_from_address (address);
+		gchar *email = get_email_key (address_list, span);
 
 		/* ignore the address if already seen */
-		if (g_hash_table_lookup (table, email) == 0) {
-			gchar *tmp;
-
+		if (g_hash_table_lookup (table, email) == NULL) {
 			/* Include the full address and not only the
 			   email in the returned list */
-			if (!new_list) {
-				tmp = g_strdup (address);
-			} else {
-				tmp = g_strjoin (",", new_list, address, NULL);
-				g_free (new_list);
-			}
-			new_list = tmp;
-			
-			g_hash_table_insert (table, (gchar*)email, GINT_TO_POINTER(1));
+			append_address (new_list, address_list, span);
+			g_hash_table_insert (table, email, GINT_TO_POINTER (1));
+		} else {
+			g_free (email);
 		}
-		cursor = g_slist_next (cursor);
 	}
 
+	g_array_free (spans, TRUE);
 	g_hash_table_unref (table);
-	g_slist_foreach (addresses, (GFunc)g_free, NULL);
-	g_slist_free (addresses);
 
-	if (new_list == NULL)
-		new_list = g_strdup ("");
-
-	return new_list;
+	return g_string_free (new_list, FALSE);
 }
 
 
@@ -634,7 +619,9 @@ modest_text_utils_convert_to_html_body (const gchar *data, gssize n, gboolean hy
 void
 modest_text_utils_get_addresses_indexes (const gchar *addresses, GSList **start_indexes, GSList **end_indexes)
 {
-	gchar *start, *cur;
+	const gchar *cur;
+	gint offset, start_offset;
+	gboolean seen_at = FALSE;
 
 	if (!addresses)
 		return;
@@ -642,34 +629,36 @@ modest_text_utils_get_addresses_indexes (const gchar *addresses, GSList **start_
 	if (strlen (addresses) == 0)
 		return;
 
-	start = (gchar*) addresses;
-	cur = (gchar*) addresses;
-
-	for (cur = start; *cur != '\0'; cur = g_utf8_next_char (cur)) {
-		if (*cur == ',' || *cur == ';') {
+	/* Keep the offsets instead of computing them from the start
+	   of the string at every separator */
+	start_offset = 0;
+	for (cur = addresses, offset = 0; *cur != '\0'; cur = g_utf8_next_char (cur), offset++) {
+		if (*cur == '@') {
+			seen_at = TRUE;
+		} else if (*cur == ',' || *cur == ';') {
 			gint *start_index, *end_index;
-			gchar *next_char = g_utf8_next_char (cur);
+			const gchar *next_char = g_utf8_next_char (cur);
 
-			if (!g_utf8_strchr (start, (cur - start + 1), g_utf8_get_char ("@")) &&
-			    next_char && *next_char != '\n' && *next_char != '\0')
+			if (!seen_at && *next_char != '\n' && *next_char != '\0')
 				continue;
 
 			start_index = g_new0 (gint, 1);
 			end_index = g_new0 (gint, 1);
-			*start_index = g_utf8_pointer_to_offset (addresses, start);
-			*end_index = g_utf8_pointer_to_offset (addresses, cur);;
+			*start_index = start_offset;
+			*end_index = offset;
 			*start_indexes = g_slist_prepend (*start_indexes, start_index);
 			*end_indexes = g_slist_prepend (*end_indexes, end_index);
-			start = g_utf8_next_char (cur);
+			start_offset = offset + 1;
+			seen_at = FALSE;
 		}
 	}
 
-	if (start != cur) {
+	if (start_offset != offset) {
 		gint *start_index, *end_index;
 		start_index = g_new0 (gint, 1);
 		end_index = g_new0 (gint, 1);
-		*start_index = g_utf8_pointer_to_offset (addresses, start);
-		*end_index = g_utf8_pointer_to_offset (addresses, cur);;
+		*start_index = start_offset;
+		*end_index = offset;
 		*start_indexes = g_slist_prepend (*start_indexes, start_index);
 		*end_indexes = g_slist_prepend (*end_indexes, end_index);
 	}
@@ -680,55 +669,164 @@ modest_text_utils_get_addresses_indexes (const gchar *addresses, GSList **start_
 		*end_indexes = g_slist_reverse (*end_indexes);
 }
 
+static gboolean
+is_address_space (gchar c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
 
-GSList *
-modest_text_utils_split_addresses_list (const gchar *addresses)
+GArray *
+modest_text_utils_parse_addresses (const gchar *addresses)
 {
-	GSList *head;
-	const gchar *my_addrs = addresses;
-	const gchar *end;
-	gchar *addr;
-	gboolean after_at = FALSE;
+	GArray *spans;
+	const gchar *p;
+	const gchar *start = NULL, *last = NULL;
+	const gchar *word_start = NULL, *bare_start = NULL, *bare_end = NULL;
+	const gchar *angle_start = NULL, *angle_end = NULL;
+	gboolean quoted = FALSE, in_angle = FALSE;
+	gboolean seen_at = FALSE, word_at = FALSE, angle_at = FALSE;
+	gint comment_depth = 0;
 
 	g_return_val_if_fail (addresses, NULL);
 
-	/* skip any space, ',', ';' '\n' at the start */
-	while (my_addrs && (my_addrs[0] == ' ' || my_addrs[0] == ',' ||
-			    my_addrs[0] == ';' || my_addrs[0] == '\n'))
-	       ++my_addrs;
+	spans = g_array_new (FALSE, FALSE, sizeof (ModestAddressSpan));
 
-	/* are we at the end of addresses list? */
-	if (!my_addrs[0])
-		return NULL;
+	for (p = addresses; ; p++) {
+		gchar c = *p;
 
-	/* nope, we are at the start of some address
-	 * now, let's find the end of the address */
-	end = my_addrs + 1;
-	while (end[0] && end[0] != ';' && !(after_at && end[0] == ',')) {
-		if (end[0] == '\"') {
-			while (end[0] && end[0] != '\"')
-				++end;
+		/* Separators are not special inside quoted strings,
+		   comments and angle addresses */
+		if (c != '\0' && quoted) {
+			if (c == '\\' && p[1] != '\0')
+				p++;
+			else if (c == '\"')
+				quoted = FALSE;
+			last = p;
+			continue;
 		}
-		if (end[0] == '@') {
-			after_at = TRUE;
+		if (c != '\0' && comment_depth > 0) {
+			if (c == '\\' && p[1] != '\0')
+				p++;
+			else if (c == '(')
+				comment_depth++;
+			else if (c == ')')
+				comment_depth--;
+			last = p;
+			continue;
+		}
+		if (c != '\0' && in_angle) {
+			if (c == '>') {
+				in_angle = FALSE;
+				angle_end = p;
+			} else if (c == '@') {
+				angle_at = seen_at = TRUE;
+			}
+			last = p;
+			continue;
+		}
+
+		/* The words end at the spaces and the special chars. The
+		   first one with an '@' is the email if there is no
+		   angle address */
+		if (word_start && (c == '\0' || is_address_space (c) || strchr ("\"(<>,;", c))) {
+			if (word_at && !bare_start) {
+				bare_start = word_start;
+				bare_end = p;
+			}
+			word_start = NULL;
+			word_at = FALSE;
+		}
+
+		/* A ',' only ends an address with an email, so "Doe,
+		   John <john@example.com>" is a single one */
+		if (c == '\0' || c == ';' || (c == ',' && (seen_at || angle_end))) {
+			if (start) {
+				ModestAddressSpan span;
+
+				if (in_angle)
+					angle_end = p;
+
+				span.start = start - addresses;
+				span.end = last + 1 - addresses;
+				if (angle_end && angle_at) {
+					span.email_start = angle_start - addresses;
+					span.email_end = angle_end - addresses;
+				} else if (bare_start) {
+					span.email_start = bare_start - addresses;
+					span.email_end = bare_end - addresses;
+				} else if (angle_end) {
+					span.email_start = angle_start - addresses;
+					span.email_end = angle_end - addresses;
+				} else {
+					span.email_start = span.start;
+					span.email_end = span.end;
+				}
+				g_array_append_val (spans, span);
+			}
+			if (c == '\0')
+				break;
+
+			start = last = NULL;
+			bare_start = bare_end = angle_start = angle_end = NULL;
+			seen_at = angle_at = FALSE;
+			continue;
 		}
-		if ((end[0] && end[0] == '>')&&(end[1] && end[1] == ',')) {
-			++end;
+
+		if (is_address_space (c))
+			continue;
+
+		if (!start)
+			start = p;
+		last = p;
+
+		switch (c) {
+		case '"':
+			quoted = TRUE;
+			break;
+		case '(':
+			comment_depth = 1;
 			break;
+		case '<':
+			in_angle = TRUE;
+			angle_start = p + 1;
+			angle_end = NULL;
+			angle_at = FALSE;
+			break;
+		case '>':
+		case ',':
+			break;
+		default:
+			if (!word_start)
+				word_start = p;
+			if (c == '@')
+				word_at = seen_at = TRUE;
 		}
-		++end;
 	}
 
-	/* we got the address; copy it and remove trailing whitespace */
-	addr = g_strndup (my_addrs, end - my_addrs);
-	g_strchomp (addr);
+	return spans;
+}
 
-	remove_extra_spaces (addr);
+GSList *
+modest_text_utils_split_addresses_list (const gchar *addresses)
+{
+	GSList *head = NULL;
+	GArray *spans;
+	guint i;
+
+	g_return_val_if_fail (addresses, NULL);
+
+	spans = modest_text_utils_parse_addresses (addresses);
+	for (i = 0; i < spans->len; i++) {
+		ModestAddressSpan *span = &g_array_index (spans, ModestAddressSpan, i);
+		gchar *addr;
 
-	head = g_slist_append (NULL, addr);
-	head->next = modest_text_utils_split_addresses_list (end); /* recurse */
+		addr = g_strndup (addresses + span->start, span->end - span->start);
+		remove_extra_spaces (addr);
+		head = g_slist_prepend (head, addr);
+	}
+	g_array_free (spans, TRUE);
 
-	return head;
+	return g_slist_reverse (head);
 }
 
 gchar *
@@ -1443,30 +1541,36 @@ gchar *
 modest_text_utils_get_display_addresses (const gchar *recipients)
 {
 	gchar *addresses;
-	GSList *recipient_list;
+	GArray *spans;
+
+	g_return_val_if_fail (recipients, NULL);
 
 	addresses = NULL;
-	recipient_list = modest_text_utils_split_addresses_list (recipients);
-	if (recipient_list) {
+	spans = modest_text_utils_parse_addresses (recipients);
+	if (spans->len > 0) {
 		GString *add_string = g_string_sized_new (strlen (recipients));
-		GSList *iter = recipient_list;
-		gboolean first = TRUE;
-
-		while (iter) {
-			/* Strings are changed in place */
-			modest_text_utils_get_display_address ((gchar *) iter->data);
-			if (G_UNLIKELY (first)) {
-				g_string_append_printf (add_string, "%s", (gchar *) iter->data);
-				first = FALSE;
-			} else {
-				g_string_append_printf (add_string, ", %s", (gchar *) iter->data);
-			}
-			iter = g_slist_next (iter);
+		gchar *display;
+		guint i;
+
+		/* Reuse the same buffer for every address, the display
+		   address is never longer than the address */
+		display = g_malloc (strlen (recipients) + 1);
+		for (i = 0; i < spans->len; i++) {
+			ModestAddressSpan *span = &g_array_index (spans, ModestAddressSpan, i);
+			guint len = span->end - span->start;
+
+			memcpy (display, recipients + span->start, len);
+			display[len] = '\0';
+			remove_extra_spaces (display);
+			modest_text_utils_get_display_address (display);
+			if (G_LIKELY (i > 0))
+				g_string_append (add_string, ", ");
+			g_string_append (add_string, display);
 		}
-		g_slist_foreach (recipient_list, (GFunc) g_free, NULL);
-		g_slist_free (recipient_list);
+		g_free (display);
 		addresses = g_string_free (add_string, FALSE);
 	}
+	g_array_free (spans, TRUE);
 
 	return addresses;
 }
@@ -2159,14 +2263,22 @@ modest_text_utils_remove_duplicate_addresses_list (GSList *address_list)
 		/* We need only the email to just compare it and not
 		   the full address which would make "a <a@a.com>"
 		   different from "a@a.com" */
-		const gchar *email = get_email_from_address (address);
+		gchar *email = NULL;
+		GArray *spans = modest_text_utils_parse_addresses (address);
+
+		if (spans->len > 0)
+			email = get_email_key (address, &g_array_index (spans, ModestAddressSpan, 0));
+		else
+			email = g_strdup ("");
+		g_array_free (spans, TRUE);
 
 		/* ignore the address if already seen */
 		if (g_hash_table_lookup (table, email) == 0) {
-			g_hash_table_insert (table, (gchar*)email, GINT_TO_POINTER(1));
+			g_hash_table_insert (table, email, GINT_TO_POINTER(1));
 			iter = g_slist_next (iter);
 		} else {
 			GSList *tmp = g_slist_next (iter);
+			g_free (email);
 			new_list = g_slist_delete_link (new_list, iter);
 			iter = tmp;
 		}
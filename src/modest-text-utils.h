@@ -267,6 +267,49 @@ gchar*   modest_text_utils_inline (const gchar *text,
 				   const gchar *to,
 				   const gchar *subject);
 
+/*
+ * the byte offsets of an address in a list of addresses, see
+ * modest_text_utils_parse_addresses. The ends are exclusive
+ */
+typedef struct {
+	guint start;        /* the address, without the surrounding spaces */
+	guint end;
+	guint email_start;  /* its email, without the angle brackets */
+	guint email_end;
+} ModestAddressSpan;
+
+/**
+ * modest_text_utils_parse_addresses:
+ * @addresses: non-NULL string with a list of addresses in the format
+ * understood by email protocols, separated by ',' or ';'
+ *
+ * finds the addresses of @addresses in a single pass, without
+ * copying them. Quoted strings, comments and angle addresses can
+ * contain separators, and a ',' only ends an address with an email,
+ * so "Doe, John <john@example.com>" is a single address. The email
+ * of an address is its angle address, or its first word with an '@'
+ *
+ * Returns: a newly allocated #GArray of #ModestAddressSpan, with the
+ * offsets relative to @addresses
+ */
+GArray*  modest_text_utils_parse_addresses (const gchar *addresses);
+
+/**
+ * modest_text_utils_remove_addresses
+ * @address_list: non-NULL string with a comma-separated list of email addresses
+ * @addresses: a list of the addresses to remove
+ *
+ * remove all the addresses with the emails of @addresses (case
+ * insensitive) from a list of email addresses, in linear time. If
+ * @addresses is NULL, returns an unchanged (but newly allocated)
+ * @address_list
+ *
+ * Returns: a newly allocated string containing the new list, or NULL
+ * in case of error or the original @address_list was NULL
+ */
+gchar*   modest_text_utils_remove_addresses (const gchar *address_list,
+					     const gchar *addresses);
+
 /**
  * modest_text_utils_remove_address
  * @address_list: non-NULL string with a comma-separated list of email addresses
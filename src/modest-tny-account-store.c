@@ -42,6 +42,7 @@
 #include <tny-camel-pop-store-account.h>
 #include "modest-text-utils.h"
 #include <modest-runtime.h>
+#include <modest-init.h>
 #include <modest-marshal.h>
 #include <modest-protocol-registry.h>
 #include <modest-local-folder-info.h>
@@ -112,6 +113,25 @@ static void    remove_connection_specific_transport_accounts      (ModestTnyAcco
 
 static inline gboolean only_local_accounts        (ModestTnyAccountStore *self);
 
+/* The keys an account is indexed by */
+typedef struct {
+	gchar *id;
+	gchar *name;    /* the parent modest account */
+	gchar *url;     /* see get_url_key */
+} AccountKeys;
+
+/* Hash indexes of a list of accounts, so we do not have to iterate
+   it for every lookup. The accounts are not reffed, the list keeps
+   the references, so always use add_account_to_list and
+   remove_account_from_list to modify it */
+typedef struct {
+	TnyList    *accounts;
+	GHashTable *keys;      /* TnyAccount* -> AccountKeys */
+	GHashTable *by_id;
+	GHashTable *by_name;
+	GHashTable *by_url;    /* url key -> GSList of TnyAccount* */
+} AccountIndex;
+
 /* list my signals */
 enum {
 	ACCOUNT_CHANGED_SIGNAL,
@@ -136,6 +156,11 @@ struct _ModestTnyAccountStorePrivate {
 	TnyList             *store_accounts;
 	TnyList             *transport_accounts;
 	TnyList             *store_accounts_outboxes;
+
+	/* and their indexes */
+	AccountIndex        *store_index;
+	AccountIndex        *transport_index;
+	AccountIndex        *outboxes_index;
 	
 	/* Matches transport accounts and outbox folder */
 	GHashTable          *outbox_of_transport;
@@ -300,6 +325,242 @@ foreach_account_append_to_list (gpointer data,
 	tny_list_append (list, G_OBJECT (data));
 }
 
+/********************************************************************/
+/*                      Indexes of the accounts                     */
+/********************************************************************/
+
+/*
+ * Returns the part of the url that identifies the account: the
+ * protocol, the user and the host, without the password, the
+ * parameters or the folder. Local accounts have no host, so their
+ * path is kept, without the folder (the fragment)
+ */
+static gchar*
+get_url_key (const gchar *url)
+{
+	const gchar *authority, *end, *host, *user_end;
+	GString *key;
+
+	if (!url)
+		return NULL;
+
+	authority = strstr (url, "://");
+	if (!authority)
+		return g_strndup (url, strcspn (url, "#"));
+	authority += 3;
+
+	end = authority + strcspn (authority, "/?#");
+	if (end == authority)
+		return g_strndup (url, strcspn (url, "#"));
+
+	key = g_string_new_len (url, authority - url);
+	host = g_strrstr_len (authority, end - authority, "@");
+	if (host) {
+		user_end = authority + strcspn (authority, ";:@");
+		g_string_append_len (key, authority, user_end - authority);
+		host++;
+		g_string_append_c (key, '@');
+	} else {
+		host = authority;
+	}
+	g_string_append_len (key, host, end - host);
+
+	return g_string_free (key, FALSE);
+}
+
+static void
+account_keys_free (AccountKeys *keys)
+{
+	g_free (keys->id);
+	g_free (keys->name);
+	g_free (keys->url);
+	g_slice_free (AccountKeys, keys);
+}
+
+static AccountIndex*
+account_index_new (TnyList *accounts)
+{
+	AccountIndex *index;
+
+	index = g_slice_new (AccountIndex);
+	index->accounts = accounts;
+	index->keys = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+					     (GDestroyNotify) account_keys_free);
+	/* The keys are owned by the AccountKeys */
+	index->by_id = g_hash_table_new (g_str_hash, g_str_equal);
+	index->by_name = g_hash_table_new (g_str_hash, g_str_equal);
+	/* Several accounts could share the key, but not match the
+	   same urls (different paths of local accounts for example),
+	   so all of them are kept */
+	index->by_url = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+					       (GDestroyNotify) g_slist_free);
+
+	return index;
+}
+
+static void
+account_index_free (AccountIndex *index)
+{
+	g_hash_table_destroy (index->by_id);
+	g_hash_table_destroy (index->by_name);
+	g_hash_table_destroy (index->by_url);
+	g_hash_table_destroy (index->keys);
+	g_slice_free (AccountIndex, index);
+}
+
+static void
+index_key (GHashTable *table, const gchar *key, TnyAccount *account)
+{
+	/* Like when iterating the list, the first account wins */
+	if (key && !g_hash_table_lookup (table, key))
+		g_hash_table_insert (table, (gpointer) key, account);
+}
+
+static void
+account_index_add (AccountIndex *index, TnyAccount *account)
+{
+	AccountKeys *keys;
+	gchar *url;
+
+	if (g_hash_table_lookup (index->keys, account))
+		return;
+
+	keys = g_slice_new (AccountKeys);
+	keys->id = g_strdup (tny_account_get_id (account));
+	keys->name = g_strdup (modest_tny_account_get_parent_modest_account_name_for_server_account (account));
+	url = tny_account_get_url_string (account);
+	keys->url = get_url_key (url);
+	g_free (url);
+	g_hash_table_insert (index->keys, account, keys);
+
+	index_key (index->by_id, keys->id, account);
+	index_key (index->by_name, keys->name, account);
+
+	if (keys->url) {
+		GSList *accounts;
+
+		accounts = g_hash_table_lookup (index->by_url, keys->url);
+		if (accounts)
+			g_slist_append (accounts, account);
+		else
+			g_hash_table_insert (index->by_url, g_strdup (keys->url),
+					     g_slist_prepend (NULL, account));
+	}
+}
+
+static void
+unindex_key (AccountIndex *index, GHashTable *table, const gchar *key,
+	     TnyAccount *account, glong key_offset)
+{
+	TnyIterator *iter;
+	gboolean found = FALSE;
+
+	if (!key || g_hash_table_lookup (table, key) != account)
+		return;
+
+	g_hash_table_remove (table, key);
+
+	/* Another account of the list could have the same key */
+	iter = tny_list_create_iterator (index->accounts);
+	while (!tny_iterator_is_done (iter) && !found) {
+		TnyAccount *other;
+
+		other = TNY_ACCOUNT (tny_iterator_get_current (iter));
+		if (other != account) {
+			AccountKeys *other_keys;
+			const gchar *other_key;
+
+			other_keys = g_hash_table_lookup (index->keys, other);
+			other_key = other_keys ? G_STRUCT_MEMBER (gchar *, other_keys, key_offset) : NULL;
+			if (other_key && strcmp (other_key, key) == 0) {
+				g_hash_table_insert (table, (gpointer) other_key, other);
+				found = TRUE;
+			}
+		}
+		g_object_unref (other);
+		tny_iterator_next (iter);
+	}
+	g_object_unref (iter);
+}
+
+static void
+account_index_remove (AccountIndex *index, TnyAccount *account)
+{
+	AccountKeys *keys;
+
+	keys = g_hash_table_lookup (index->keys, account);
+	if (!keys)
+		return;
+
+	unindex_key (index, index->by_id, keys->id, account,
+		     G_STRUCT_OFFSET (AccountKeys, id));
+	unindex_key (index, index->by_name, keys->name, account,
+		     G_STRUCT_OFFSET (AccountKeys, name));
+
+	if (keys->url) {
+		gpointer orig_key, accounts;
+
+		if (g_hash_table_lookup_extended (index->by_url, keys->url, &orig_key, &accounts)) {
+			/* Steal it, otherwise the list would be freed */
+			g_hash_table_steal (index->by_url, keys->url);
+			accounts = g_slist_remove ((GSList *) accounts, account);
+			if (accounts)
+				g_hash_table_insert (index->by_url, orig_key, accounts);
+			else
+				g_free (orig_key);
+		}
+	}
+
+	g_hash_table_remove (index->keys, account);
+}
+
+/* Returns a new reference */
+static TnyAccount*
+account_index_lookup (AccountIndex *index,
+		      ModestTnyAccountStoreQueryType type,
+		      const gchar *str)
+{
+	TnyAccount *account = NULL;
+	GSList *node;
+	gchar *key;
+
+	switch (type) {
+	case MODEST_TNY_ACCOUNT_STORE_QUERY_ID:
+		account = g_hash_table_lookup (index->by_id, str);
+		break;
+	case MODEST_TNY_ACCOUNT_STORE_QUERY_URL:
+		/* Every account is indexed, so if none of the
+		   accounts with the same key matches there is no
+		   need to look any further */
+		key = get_url_key (str);
+		node = key ? g_hash_table_lookup (index->by_url, key) : NULL;
+		g_free (key);
+
+		for (; node && !account; node = g_slist_next (node)) {
+			if (tny_account_matches_url_string (TNY_ACCOUNT (node->data), str))
+				account = TNY_ACCOUNT (node->data);
+		}
+		break;
+	}
+
+	return (account) ? g_object_ref (account) : NULL;
+}
+
+static void
+add_account_to_list (AccountIndex *index, TnyAccount *account)
+{
+	tny_list_append (index->accounts, G_OBJECT (account));
+	account_index_add (index, account);
+}
+
+static void
+remove_account_from_list (AccountIndex *index, TnyAccount *account)
+{
+	/* Before removing it, the list could have the last reference */
+	account_index_remove (index, account);
+	tny_list_remove (index->accounts, G_OBJECT (account));
+}
+
 /********************************************************************/
 /*           Control the state of the MMC local account             */
 /********************************************************************/
@@ -317,7 +578,7 @@ add_mmc_account(ModestTnyAccountStore *self, gboolean emit_insert_signal)
 									    g_getenv (MODEST_MMC1_VOLUMEPATH_ENV));
 
 	/* Add to the list of store accounts */
-	tny_list_append (priv->store_accounts, G_OBJECT (mmc_account));
+	add_account_to_list (priv->store_index, mmc_account);
 
 	if (emit_insert_signal) {
 		g_signal_emit (G_OBJECT (self), 
@@ -396,7 +657,7 @@ on_vfs_volume_unmounted(GnomeVFSVolumeMonitor *volume_monitor,
 
 		if (found) {
 			/* Remove from the list */
-			tny_list_remove (priv->store_accounts, G_OBJECT (mmc_account));
+			remove_account_from_list (priv->store_index, mmc_account);
 			
 			/* Notify observers */
 			g_signal_emit (G_OBJECT (self),
@@ -446,8 +707,16 @@ on_account_changed (ModestAccountMgr *acc_mgr,
 		tny_account = TNY_ACCOUNT (tny_iterator_get_current (iter));
 		if (tny_account) {
 			if (!strcmp (tny_account_get_id (tny_account), account_name)) {
+				AccountIndex *index;
+
 				found = TRUE;
 				modest_tny_account_update_from_account (tny_account, get_password, forget_password);
+
+				/* The url could have changed */
+				index = (account_type == TNY_ACCOUNT_TYPE_STORE) ?
+					priv->store_index : priv->transport_index;
+				account_index_remove (index, tny_account);
+				account_index_add (index, tny_account);
 				g_signal_emit (G_OBJECT(self), signals[ACCOUNT_CHANGED_SIGNAL], 0, tny_account);
 			}
 			g_object_unref (tny_account);
@@ -481,6 +750,12 @@ show_wrong_password_dialog (TnyAccountStore *self,
 		return;
 	}
 
+	/* We could be running as a D-Bus service without UI */
+	if (!modest_init_ui ()) {
+		g_debug ("%s: not showing the account settings dialog. NO UI", __FUNCTION__);
+		return;
+	}
+
 	if (g_object_get_data (G_OBJECT (account), "connection_specific") != NULL) {
 		modest_ui_actions_on_smtp_servers (NULL, NULL);
 	} else {
@@ -801,6 +1076,21 @@ modest_tny_account_store_finalize (GObject *obj)
 		priv->device = NULL;
 	}
 
+	if (priv->store_index) {
+		account_index_free (priv->store_index);
+		priv->store_index = NULL;
+	}
+
+	if (priv->transport_index) {
+		account_index_free (priv->transport_index);
+		priv->transport_index = NULL;
+	}
+
+	if (priv->outboxes_index) {
+		account_index_free (priv->outboxes_index);
+		priv->outboxes_index = NULL;
+	}
+
 	/* Destroy all accounts. Disconnect all accounts before they are destroyed */
 	if (priv->store_accounts) {
 		tny_list_foreach (priv->store_accounts, (GFunc)account_verify_last_ref, "store");
@@ -982,11 +1272,14 @@ modest_tny_account_store_new (ModestAccountMgr *account_mgr,
 	priv->store_accounts = tny_simple_list_new ();
 	priv->transport_accounts = tny_simple_list_new ();
 	priv->store_accounts_outboxes = tny_simple_list_new ();
+	priv->store_index = account_index_new (priv->store_accounts);
+	priv->transport_index = account_index_new (priv->transport_accounts);
+	priv->outboxes_index = account_index_new (priv->store_accounts_outboxes);
 
 	/* Create the local folders account */
 	local_account =
 		modest_tny_account_new_for_local_folders (priv->account_mgr, priv->session, NULL);
-	tny_list_append (priv->store_accounts, G_OBJECT(local_account));
+	add_account_to_list (priv->store_index, local_account);
 	g_object_unref (local_account);
 
 	/* Add the other remote accounts. Do this after adding the
@@ -1245,61 +1538,6 @@ modest_tny_account_store_get_session  (TnyAccountStore *self)
 	return MODEST_TNY_ACCOUNT_STORE_GET_PRIVATE (self)->session;
 }
 
-static TnyAccount*
-get_tny_account_by (TnyList *accounts,
-		    ModestTnyAccountStoreQueryType type,
-		    const gchar *str)
-{
-	TnyIterator *iter = NULL;
-	gboolean found = FALSE;
-	TnyAccount *retval = NULL;
-
-	g_return_val_if_fail (TNY_IS_LIST(accounts), NULL);
-
-	if (tny_list_get_length(accounts) == 0) {
-		g_warning ("%s: account list is empty", __FUNCTION__);
-		return NULL;
-	}
-	
-	iter = tny_list_create_iterator (accounts);
-	while (!tny_iterator_is_done (iter) && !found) {
-		TnyAccount *tmp_account = NULL;
-		const gchar *val = NULL;
-
-		tmp_account = TNY_ACCOUNT (tny_iterator_get_current (iter));
-		if (!TNY_IS_ACCOUNT(tmp_account)) {
-			g_warning ("%s: not a valid account", __FUNCTION__);
-			tmp_account = NULL;
-			break;
-		}
-
-		switch (type) {
-		case MODEST_TNY_ACCOUNT_STORE_QUERY_ID:
-			val = tny_account_get_id (tmp_account);
-			break;
-		case MODEST_TNY_ACCOUNT_STORE_QUERY_URL:
-			val = tny_account_get_url_string (tmp_account);
-			break;
-		}
-		
-		if (type == MODEST_TNY_ACCOUNT_STORE_QUERY_URL && 
-		    tny_account_matches_url_string (tmp_account, str)) {
-			retval = g_object_ref (tmp_account);
-			found = TRUE;
-		} else {
-			if (val && str && strcmp (val, str) == 0) {
-				retval = g_object_ref (tmp_account);
-				found = TRUE;
-			}
-		}
-		g_object_unref (tmp_account);
-		tny_iterator_next (iter);
-	}
-	g_object_unref (iter);
-
-	return retval;
-}
-
 TnyAccount*
 modest_tny_account_store_get_tny_account_by (ModestTnyAccountStore *self, 
 					     ModestTnyAccountStoreQueryType type,
@@ -1314,16 +1552,16 @@ modest_tny_account_store_get_tny_account_by (ModestTnyAccountStore *self,
 	priv = MODEST_TNY_ACCOUNT_STORE_GET_PRIVATE(self);
 	
 	/* Search in store accounts */
-	account = get_tny_account_by (priv->store_accounts, type, str);
+	account = account_index_lookup (priv->store_index, type, str);
 
 	/* If we already found something, no need to search the transport accounts */
 	if (!account) {
-		account = get_tny_account_by (priv->transport_accounts, type, str);
+		account = account_index_lookup (priv->transport_index, type, str);
 
 		/* If we already found something, no need to search the
 		   per-account outbox accounts */
 		if (!account)
-			account = get_tny_account_by (priv->store_accounts_outboxes, type, str);
+			account = account_index_lookup (priv->outboxes_index, type, str);
 	}
 
 	/* Warn if nothing was found. This is generally unusual. */
@@ -1346,9 +1584,7 @@ modest_tny_account_store_get_server_account (ModestTnyAccountStore *self,
 {
 	ModestTnyAccountStorePrivate *priv = NULL;
 	TnyAccount *retval = NULL;
-	TnyList *account_list = NULL;
-	TnyIterator *iter = NULL;
-	gboolean found;
+	AccountIndex *index = NULL;
 
 	g_return_val_if_fail (self, NULL);
 	g_return_val_if_fail (account_name, NULL);
@@ -1358,42 +1594,25 @@ modest_tny_account_store_get_server_account (ModestTnyAccountStore *self,
 	
 	priv = MODEST_TNY_ACCOUNT_STORE_GET_PRIVATE(self);
 
-	account_list = (type == TNY_ACCOUNT_TYPE_STORE) ? 
-		priv->store_accounts : 
-		priv->transport_accounts;
+	index = (type == TNY_ACCOUNT_TYPE_STORE) ? 
+		priv->store_index : 
+		priv->transport_index;
 
-	if (!account_list) {
+	if (!index) {
 		g_printerr ("%s: No server accounts of type %s\n", __FUNCTION__, 
 			(type == TNY_ACCOUNT_TYPE_STORE) ? "store" : "transport");
 		return NULL;
 	}
 	
 	/* Look for the server account */
-	found = FALSE;
-	iter = tny_list_create_iterator (account_list);
-	while (!tny_iterator_is_done (iter) && !found) {
-		const gchar *modest_acc_name;
-		TnyAccount *tmp_account;
-
-		tmp_account = TNY_ACCOUNT (tny_iterator_get_current (iter));
-		modest_acc_name = 
-			modest_tny_account_get_parent_modest_account_name_for_server_account (tmp_account);
-		
-		if (account_name && modest_acc_name && !strcmp (account_name, modest_acc_name)) {
-			found = TRUE;
-			retval = g_object_ref (tmp_account);
-		}
-		/* Free and continue */
-		g_object_unref (tmp_account);
-		tny_iterator_next (iter);
-	}
-	g_object_unref (iter);
-
-	if (!found) {
+	retval = g_hash_table_lookup (index->by_name, account_name);
+	if (retval) {
+		g_object_ref (retval);
+	} else {
 		g_printerr ("modest: %s: could not get tny %s account for %s\n." \
 			    "Number of server accounts of this type=%d\n", __FUNCTION__,
 			    (type == TNY_ACCOUNT_TYPE_STORE) ? "store" : "transport",
-			    account_name, tny_list_get_length (account_list));
+			    account_name, tny_list_get_length (index->accounts));
 	}
 
 	/* Returns a new reference */
@@ -1679,7 +1898,7 @@ add_outbox_from_transport_account_to_global_outbox (ModestTnyAccountStore *self,
 		return;
 	}
 
-	tny_list_append (priv->store_accounts_outboxes, G_OBJECT (account_outbox));
+	add_account_to_list (priv->outboxes_index, account_outbox);
 	
 	/* Get the outbox folder */
 	folders = tny_simple_list_new ();
@@ -1722,8 +1941,8 @@ insert_account (ModestTnyAccountStore *self,
 	}
 
 	/* Add accounts to the lists */
-	tny_list_append (priv->store_accounts, G_OBJECT (store_account));
-	tny_list_append (priv->transport_accounts, G_OBJECT (transport_account));
+	add_account_to_list (priv->store_index, store_account);
+	add_account_to_list (priv->transport_index, transport_account);
 
 	/* Create a new pseudo-account with an outbox for this
 	   transport account and add it to the global outbox
@@ -1828,7 +2047,7 @@ remove_transport_account (ModestTnyAccountStore *self,
 	   observers. Do not need to wait for account
 	   disconnection */
 	g_signal_emit (G_OBJECT (self), signals [ACCOUNT_REMOVED_SIGNAL], 0, transport_account);
-	tny_list_remove (priv->transport_accounts, (GObject *) transport_account);
+	remove_account_from_list (priv->transport_index, TNY_ACCOUNT (transport_account));
 		
 	/* Remove the OUTBOX of the account from the global outbox */
 	outbox = g_hash_table_lookup (priv->outbox_of_transport, transport_account);
@@ -1838,7 +2057,7 @@ remove_transport_account (ModestTnyAccountStore *self,
 		TnyAccount *outbox_account = tny_folder_get_account (outbox);
 
 		if (outbox_account) {
-			tny_list_remove (priv->store_accounts_outboxes, G_OBJECT (outbox_account));
+			remove_account_from_list (priv->outboxes_index, outbox_account);
 			/* Remove existing emails to send */
 			tny_store_account_delete_cache (TNY_STORE_ACCOUNT (outbox_account));
 			g_object_unref (outbox_account);
@@ -1878,7 +2097,7 @@ images_cache_remove_filter (TnyStreamCache *self, const gchar *id, const gchar *
 
 	account_name_with_separator = g_strconcat (account_name, "__", NULL);
 
-	result = (g_str_has_prefix (id, account_name));
+	result = (g_str_has_prefix (id, account_name_with_separator));
 	g_free (account_name_with_separator);
 
 	return result;
@@ -1914,7 +2133,7 @@ on_account_removed (ModestAccountMgr *acc_mgr,
 		/* Remove it from the list of accounts and notify the
 		   observers. Do not need to wait for account
 		   disconnection */
-		tny_list_remove (priv->store_accounts, (GObject *) store_account);
+		remove_account_from_list (priv->store_index, store_account);
 		g_signal_emit (G_OBJECT (self), signals [ACCOUNT_REMOVED_SIGNAL], 0, store_account);
 
 		/* Cancel all pending operations */
@@ -1949,6 +2168,10 @@ on_account_removed (ModestAccountMgr *acc_mgr,
 	stream_cache = modest_runtime_get_images_cache ();
 	tny_stream_cache_remove (stream_cache, (TnyStreamCacheRemoveFilter) images_cache_remove_filter, (gpointer) account);
 
+	/* Remove cached bodies. They use the same key format */
+	stream_cache = modest_runtime_get_bodies_cache ();
+	tny_stream_cache_remove (stream_cache, (TnyStreamCacheRemoveFilter) images_cache_remove_filter, (gpointer) account);
+
 	/* If there are no more user accounts then delete the
 	   transport specific SMTP servers */
 	if (only_local_accounts (self))
@@ -1979,7 +2202,7 @@ modest_tny_account_store_new_connection_specific_transport_account (ModestTnyAcc
 				   "connection_specific", 
 				   GINT_TO_POINTER (TRUE));
 		
-		tny_list_append (priv->transport_accounts, G_OBJECT (tny_account));
+		add_account_to_list (priv->transport_index, tny_account);
 		add_outbox_from_transport_account_to_global_outbox (self, 
 								    name, 
 								    tny_account);
@@ -41,6 +41,7 @@
 #include <modest-tny-folder.h>
 #include "modest-tny-mime-part.h"
 #include <modest-error.h>
+#include <modest-trace.h>
 
 
 #ifdef HAVE_CONFIG_H
@@ -324,6 +325,53 @@ copy_mime_part (TnyMimePart *part, GError **err)
 	return result;
 }
 
+#define MODEST_TNY_MSG_SHAREABLE_PART "modest-shareable-part"
+
+void
+modest_tny_msg_set_part_shareable (TnyMimePart *part)
+{
+	g_return_if_fail (TNY_IS_MIME_PART (part));
+
+	g_object_set_data (G_OBJECT (part), MODEST_TNY_MSG_SHAREABLE_PART,
+			   GINT_TO_POINTER (TRUE));
+}
+
+/* A part can be added to the new message by reference, instead of
+   being copied, if the editor owns it (it's a part of the saved draft
+   being edited) and add_attachments would not modify it, that is,
+   it's already base64 encoded and it has the disposition that the copy
+   would get. So saving a draft again does not decode and encode its
+   attachments and images again */
+static gboolean
+can_share_mime_part (TnyMimePart *part, gboolean add_inline)
+{
+	const gchar *enc;
+	gchar *disposition;
+	gboolean result;
+
+	if (TNY_IS_MSG (part) || !TNY_IS_CAMEL_MIME_PART (part))
+		return FALSE;
+
+	if (!g_object_get_data (G_OBJECT (part), MODEST_TNY_MSG_SHAREABLE_PART))
+		return FALSE;
+
+	enc = tny_mime_part_get_transfer_encoding (part);
+	if (!enc || g_ascii_strcasecmp (enc, "base64"))
+		return FALSE;
+
+	if (!add_inline && !tny_mime_part_get_filename (part))
+		return FALSE;
+
+	disposition = modest_tny_mime_part_get_header_value (part, "Content-Disposition");
+	if (add_inline)
+		result = disposition && !g_ascii_strncasecmp (disposition, "inline", 6);
+	else
+		result = disposition && !g_ascii_strncasecmp (disposition, "attachment", 10);
+	g_free (disposition);
+
+	return result;
+}
+
 static gint
 add_attachments (TnyMimePart *part, GList *attachments_list, gboolean add_inline, GError **err)
 {
@@ -335,7 +383,13 @@ add_attachments (TnyMimePart *part, GList *attachments_list, gboolean add_inline
 	for (pos = (GList *)attachments_list; pos; pos = pos->next) {
 
 		old_attachment = pos->data;
-		if (!tny_mime_part_is_purged (old_attachment)) {
+		if (tny_mime_part_is_purged (old_attachment))
+			continue;
+
+		if (can_share_mime_part (old_attachment, add_inline)) {
+			tny_mime_part_add_part (TNY_MIME_PART (part), old_attachment);
+			attached++;
+		} else {
 			gchar *old_cid;
 			old_cid = g_strdup (tny_mime_part_get_content_id (old_attachment));
 			attachment_part = copy_mime_part (old_attachment, err);
@@ -810,10 +864,17 @@ modest_tny_msg_find_calendar_from_mime_part (TnyMimePart *msg)
 TnyMimePart*
 modest_tny_msg_find_body_part (TnyMsg *msg, gboolean want_html)
 {
+	ModestTraceSpan *span;
+	TnyMimePart *result;
+
 	g_return_val_if_fail (msg && TNY_IS_MSG(msg), NULL);
 	
-	return modest_tny_msg_find_body_part_from_mime_part (TNY_MIME_PART(msg),
-							     want_html);
+	span = modest_trace_begin ("find-body-part", NULL);
+	result = modest_tny_msg_find_body_part_from_mime_part (TNY_MIME_PART(msg),
+							       want_html);
+	modest_trace_end (span);
+
+	return result;
 }
 
 TnyMimePart*
@@ -1231,28 +1292,17 @@ get_new_to (TnyMsg *msg, TnyHeader *header, const gchar* from,
 static gchar*
 get_new_cc (TnyHeader *header, const gchar* from, const gchar *new_to)
 {
-	gchar *old_cc, *result, *dup;
+	gchar *old_cc, *result, *dup, *remove;
 
 	old_cc = tny_header_dup_cc (header);
 	if (!old_cc)
 		return NULL;
 
-	/* remove me (the new From:) from the Cc: list */
-	dup =  modest_text_utils_remove_address (old_cc, from);
-
-	if (new_to) {
-		gchar **to_parts, **current;
-
-		to_parts = g_strsplit (new_to, ",", 0);
-		for (current = to_parts; current && *current != '\0'; current++) {
-			gchar *dup2;
-
-			dup2 = modest_text_utils_remove_address (dup, g_strstrip (*current));
-			g_free (dup);
-			dup = dup2;
-		}
-		g_strfreev (to_parts);
-	}
+	/* remove me (the new From:) and the new To: from the Cc:
+	   list, all at once */
+	remove = g_strjoin (",", from ? from : "", new_to ? new_to : "", NULL);
+	dup = modest_text_utils_remove_addresses (old_cc, remove);
+	g_free (remove);
 
 	result = modest_text_utils_remove_duplicate_addresses (dup);
 	g_free (dup);
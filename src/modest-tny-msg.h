@@ -215,6 +215,18 @@ TnyMsg*       modest_tny_msg_create_reply_msg     (TnyMsg *msg,
  **/
 const gchar*  modest_tny_msg_get_parent_uid (TnyMsg *msg);
 
+/**
+ * modest_tny_msg_set_part_shareable
+ * @part: a valid #TnyMimePart
+ *
+ * marks @part as owned by the editor of a draft. The message builders
+ * add these parts to the new message by reference, instead of copying
+ * them, if they are already in the form they would be copied to. Only
+ * the parts of a draft that modest saved should be marked, never the
+ * parts of a message being replied or forwarded
+ **/
+void          modest_tny_msg_set_part_shareable (TnyMimePart *part);
+
 
 /**
  * modest_tny_msg_estimate_size:
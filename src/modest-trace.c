@@ -0,0 +1,340 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <modest-runtime.h>
+#include "modest-trace.h"
+
+struct _ModestTraceSpan {
+	const gchar *name;
+	gchar       *detail;
+	gpointer     thread;
+	gint64       start;   /* usecs */
+	gint64       end;     /* usecs */
+};
+
+/* the ring buffer. It stores copies of the finished spans */
+typedef struct {
+	ModestTraceSpan *spans;
+	guint            capacity;
+	guint            next;      /* where the next span will be stored */
+	guint            count;     /* number of valid spans */
+	gint64           origin;    /* timestamp of the first recorded span */
+} TraceRing;
+
+G_LOCK_DEFINE_STATIC (trace_lock);
+static TraceRing *ring = NULL;
+static gint enabled = -1;
+
+gint64
+modest_trace_get_monotonic_time (void)
+{
+	/* wall clock changes must not affect the measures */
+#if GLIB_CHECK_VERSION(2,28,0)
+	return g_get_monotonic_time ();
+#else
+	GTimeVal tv;
+#ifdef HAVE_CLOCK_GETTIME
+	struct timespec ts;
+
+	if (clock_gettime (CLOCK_MONOTONIC, &ts) == 0)
+		return ((gint64) ts.tv_sec) * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+#endif
+	g_get_current_time (&tv);
+	return ((gint64) tv.tv_sec) * G_USEC_PER_SEC + tv.tv_usec;
+#endif
+}
+
+/* call with the lock held */
+static TraceRing*
+get_ring (void)
+{
+	if (G_UNLIKELY (!ring)) {
+		ring = g_new0 (TraceRing, 1);
+		ring->capacity = MODEST_TRACE_DEFAULT_CAPACITY;
+		ring->spans = g_new0 (ModestTraceSpan, ring->capacity);
+		ring->origin = modest_trace_get_monotonic_time ();
+	}
+	return ring;
+}
+
+void
+modest_trace_set_enabled (gboolean value)
+{
+	enabled = value ? 1 : 0;
+}
+
+gboolean
+modest_trace_is_enabled (void)
+{
+	if (G_UNLIKELY (enabled == -1))
+		enabled = (modest_runtime_get_debug_flags () & MODEST_RUNTIME_DEBUG_TRACE) ? 1 : 0;
+
+	return enabled == 1;
+}
+
+ModestTraceSpan*
+modest_trace_begin (const gchar *name,
+		    const gchar *detail)
+{
+	ModestTraceSpan *span;
+
+	g_return_val_if_fail (name, NULL);
+
+	if (!modest_trace_is_enabled ())
+		return NULL;
+
+	span = g_slice_new (ModestTraceSpan);
+	span->name = name;
+	span->detail = g_strdup (detail);
+	span->thread = g_thread_self ();
+	span->end = 0;
+	span->start = modest_trace_get_monotonic_time ();
+
+	return span;
+}
+
+void
+modest_trace_end (ModestTraceSpan *span)
+{
+	TraceRing *r;
+	ModestTraceSpan *slot;
+
+	if (!span)
+		return;
+
+	span->end = modest_trace_get_monotonic_time ();
+
+	G_LOCK (trace_lock);
+	r = get_ring ();
+	slot = &(r->spans[r->next]);
+
+	/* overwrite the oldest one if it's full */
+	g_free (slot->detail);
+	*slot = *span;
+
+	r->next = (r->next + 1) % r->capacity;
+	if (r->count < r->capacity)
+		r->count++;
+	G_UNLOCK (trace_lock);
+
+	g_slice_free (ModestTraceSpan, span);
+}
+
+void
+modest_trace_cancel (ModestTraceSpan *span)
+{
+	if (!span)
+		return;
+
+	g_free (span->detail);
+	g_slice_free (ModestTraceSpan, span);
+}
+
+void
+modest_trace_mark (const gchar *name,
+		   const gchar *detail)
+{
+	modest_trace_end (modest_trace_begin (name, detail));
+}
+
+void
+modest_trace_clear (void)
+{
+	guint i;
+
+	G_LOCK (trace_lock);
+	if (ring) {
+		for (i = 0; i < ring->capacity; i++) {
+			g_free (ring->spans[i].detail);
+			ring->spans[i].detail = NULL;
+		}
+		ring->next = 0;
+		ring->count = 0;
+		ring->origin = modest_trace_get_monotonic_time ();
+	}
+	G_UNLOCK (trace_lock);
+}
+
+/* call with the lock held. Returns the i-th oldest span */
+static ModestTraceSpan*
+nth_span (TraceRing *r, guint i)
+{
+	return &(r->spans[(r->next + r->capacity - r->count + i) % r->capacity]);
+}
+
+static int
+compare_durations (gconstpointer a, gconstpointer b)
+{
+	gint64 da = *((const gint64 *) a);
+	gint64 db = *((const gint64 *) b);
+
+	return (da > db) - (da < db);
+}
+
+static gdouble
+percentile (gint64 *sorted, guint count, guint percent)
+{
+	guint index;
+
+	/* nearest rank */
+	index = (count * percent + 99) / 100;
+	if (index > 0)
+		index--;
+
+	return sorted[MIN (index, count - 1)] / 1000.0;
+}
+
+/* call with the lock held */
+static gboolean
+compute_stats (TraceRing *r, const gchar *name, ModestTraceStats *stats)
+{
+	gint64 *durations;
+	guint i, count = 0;
+
+	memset (stats, 0, sizeof (ModestTraceStats));
+	if (!r || r->count == 0)
+		return FALSE;
+
+	durations = g_new (gint64, r->count);
+	for (i = 0; i < r->count; i++) {
+		ModestTraceSpan *span = nth_span (r, i);
+		if (strcmp (span->name, name) == 0)
+			durations[count++] = span->end - span->start;
+	}
+
+	modest_trace_compute_stats (durations, count, stats);
+	g_free (durations);
+
+	return count > 0;
+}
+
+void
+modest_trace_compute_stats (gint64 *durations,
+			    guint count,
+			    ModestTraceStats *stats)
+{
+	g_return_if_fail (stats);
+
+	memset (stats, 0, sizeof (ModestTraceStats));
+	if (count == 0)
+		return;
+
+	qsort (durations, count, sizeof (gint64), compare_durations);
+	stats->count = count;
+	stats->min = durations[0] / 1000.0;
+	stats->max = durations[count - 1] / 1000.0;
+	stats->p50 = percentile (durations, count, 50);
+	stats->p95 = percentile (durations, count, 95);
+}
+
+gboolean
+modest_trace_get_stats (const gchar *name,
+			ModestTraceStats *stats)
+{
+	gboolean result;
+
+	g_return_val_if_fail (name, FALSE);
+	g_return_val_if_fail (stats, FALSE);
+
+	G_LOCK (trace_lock);
+	result = compute_stats (ring, name, stats);
+	G_UNLOCK (trace_lock);
+
+	return result;
+}
+
+gchar*
+modest_trace_to_string (void)
+{
+	GString *str;
+	GHashTable *names;
+	GList *names_list, *node;
+	guint i;
+
+	str = g_string_new ("");
+
+	G_LOCK (trace_lock);
+	if (!ring || ring->count == 0) {
+		G_UNLOCK (trace_lock);
+		g_string_append (str, modest_trace_is_enabled () ?
+				 "<no spans>\n" : "<disabled, set MODEST_DEBUG=trace>\n");
+		return g_string_free (str, FALSE);
+	}
+
+	names = g_hash_table_new (g_str_hash, g_str_equal);
+	g_string_append (str, "start(ms)\tduration(ms)\tthread\tname\tdetail\n");
+	for (i = 0; i < ring->count; i++) {
+		ModestTraceSpan *span = nth_span (ring, i);
+
+		g_string_append_printf (str, "%.3f\t%.3f\t%p\t%s\t%s\n",
+					(span->start - ring->origin) / 1000.0,
+					(span->end - span->start) / 1000.0,
+					span->thread, span->name,
+					span->detail ? span->detail : "");
+		g_hash_table_insert (names, (gpointer) span->name, (gpointer) span->name);
+	}
+
+	g_string_append (str, "\nname\tcount\tmin(ms)\tp50(ms)\tp95(ms)\tmax(ms)\n");
+	names_list = g_hash_table_get_keys (names);
+	names_list = g_list_sort (names_list, (GCompareFunc) strcmp);
+	for (node = names_list; node; node = g_list_next (node)) {
+		ModestTraceStats stats;
+
+		compute_stats (ring, (const gchar *) node->data, &stats);
+		g_string_append_printf (str, "%s\t%u\t%.3f\t%.3f\t%.3f\t%.3f\n",
+					(const gchar *) node->data, stats.count,
+					stats.min, stats.p50, stats.p95, stats.max);
+	}
+	G_UNLOCK (trace_lock);
+
+	g_list_free (names_list);
+	g_hash_table_destroy (names);
+
+	return g_string_free (str, FALSE);
+}
+
+gboolean
+modest_trace_dump_to_file (const gchar *filename,
+			   GError **error)
+{
+	gchar *str;
+	gboolean result;
+
+	g_return_val_if_fail (filename, FALSE);
+
+	str = modest_trace_to_string ();
+	result = g_file_set_contents (filename, str, -1, error);
+	g_free (str);
+
+	return result;
+}
@@ -0,0 +1,184 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MODEST_TRACE_H__
+#define __MODEST_TRACE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* max number of spans kept in the ring buffer */
+#define MODEST_TRACE_DEFAULT_CAPACITY 4096
+
+typedef struct _ModestTraceSpan ModestTraceSpan;
+
+/*
+ * latency statistics of the spans with the same name, in
+ * milliseconds
+ */
+typedef struct {
+	guint   count;
+	gdouble min;
+	gdouble max;
+	gdouble p50;
+	gdouble p95;
+} ModestTraceStats;
+
+/**
+ * modest_trace_set_enabled:
+ * @enabled: whether to record the spans or not
+ *
+ * enables or disables the tracing. It's disabled by default unless
+ * MODEST_DEBUG contains "trace"
+ */
+void              modest_trace_set_enabled   (gboolean enabled);
+
+/**
+ * modest_trace_is_enabled:
+ *
+ * Returns: %TRUE if the spans are being recorded
+ */
+gboolean          modest_trace_is_enabled    (void);
+
+/**
+ * modest_trace_begin:
+ * @name: the name of the span. It must be a static string
+ * @detail: some extra information about the span (for example the
+ * UID of the message), or %NULL
+ *
+ * starts a span. It could be finished from any thread, and also in
+ * a different main loop iteration, so it could be used to measure
+ * asynchronous operations
+ *
+ * Returns: a #ModestTraceSpan to be passed to modest_trace_end, or
+ * %NULL if tracing is disabled
+ */
+ModestTraceSpan*  modest_trace_begin         (const gchar *name,
+					      const gchar *detail);
+
+/**
+ * modest_trace_end:
+ * @span: a #ModestTraceSpan, or %NULL
+ *
+ * finishes the span, and records it in the ring buffer, the oldest
+ * span is overwritten if it's full. @span must not be used
+ * afterwards
+ */
+void              modest_trace_end           (ModestTraceSpan *span);
+
+/**
+ * modest_trace_cancel:
+ * @span: a #ModestTraceSpan, or %NULL
+ *
+ * frees the span without recording it, for example if the operation
+ * was aborted. @span must not be used afterwards
+ */
+void              modest_trace_cancel        (ModestTraceSpan *span);
+
+/**
+ * modest_trace_mark:
+ * @name: the name of the event. It must be a static string
+ * @detail: some extra information, or %NULL
+ *
+ * records a zero length span, useful to mark instant events like
+ * user requests
+ */
+void              modest_trace_mark          (const gchar *name,
+					      const gchar *detail);
+
+/**
+ * modest_trace_clear:
+ *
+ * removes all the recorded spans
+ */
+void              modest_trace_clear         (void);
+
+/**
+ * modest_trace_get_stats:
+ * @name: the name of the spans
+ * @stats: a #ModestTraceStats to fill
+ *
+ * computes the latency statistics of the recorded spans called
+ * @name
+ *
+ * Returns: %TRUE if there is any span called @name, %FALSE otherwise
+ */
+gboolean          modest_trace_get_stats     (const gchar *name,
+					      ModestTraceStats *stats);
+
+/**
+ * modest_trace_compute_stats:
+ * @durations: an array of durations, in microseconds. It's sorted
+ * in place
+ * @count: the number of elements of @durations
+ * @stats: a #ModestTraceStats to fill
+ *
+ * computes the latency statistics of a set of samples not recorded
+ * in the ring buffer, for example all the samples of a benchmark
+ */
+void              modest_trace_compute_stats (gint64 *durations,
+					      guint count,
+					      ModestTraceStats *stats);
+
+/**
+ * modest_trace_to_string:
+ *
+ * Returns a string representation of the recorded spans, in the
+ * order they finished, followed by the statistics of every span name
+ *
+ * Returns: a newly allocated string
+ */
+gchar*            modest_trace_to_string     (void);
+
+/**
+ * modest_trace_dump_to_file:
+ * @filename: the file to write
+ * @error: a #GError, or %NULL
+ *
+ * writes the result of modest_trace_to_string to @filename
+ *
+ * Returns: %TRUE on success, %FALSE otherwise
+ */
+gboolean          modest_trace_dump_to_file  (const gchar *filename,
+					      GError **error);
+
+/**
+ * modest_trace_get_monotonic_time:
+ *
+ * gets the time used to measure the spans. It's not affected by
+ * the changes of the wall clock
+ *
+ * Returns: the time in microseconds, from an arbitrary origin
+ */
+gint64            modest_trace_get_monotonic_time (void);
+
+G_END_DECLS
+
+#endif /* __MODEST_TRACE_H__ */
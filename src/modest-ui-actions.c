@@ -72,6 +72,7 @@
 #include "modest-account-mgr-helpers.h"
 #include "modest-mail-operation.h"
 #include "modest-text-utils.h"
+#include "modest-recipient-index.h"
 #include <modest-widget-memory.h>
 #include <tny-error.h>
 #include <tny-simple-list.h>
@@ -684,7 +685,6 @@ modest_ui_actions_compose_msg(ModestWindow *win,
 	ModestWindow *msg_win = NULL;
 	ModestAccountMgr *mgr = modest_runtime_get_account_mgr();
 	ModestTnyAccountStore *store = modest_runtime_get_account_store();
-	GnomeVFSFileSize total_size, allowed_size;
 	guint64 available_disk, expected_size, parts_size;
 	guint parts_count;
 
@@ -767,8 +767,6 @@ modest_ui_actions_compose_msg(ModestWindow *win,
 
 	/* Create and register edit window */
 	/* This is destroyed by TODO. */
-	total_size = 0;
-	allowed_size = MODEST_MAX_ATTACHMENT_SIZE;
 	msg_win = modest_msg_edit_window_new (msg, account_name, mailbox, FALSE);
 
 	if (!modest_window_mgr_register_window (modest_runtime_get_window_mgr(), msg_win, win)) {
@@ -778,20 +776,11 @@ modest_ui_actions_compose_msg(ModestWindow *win,
 	modest_msg_edit_window_set_modified (MODEST_MSG_EDIT_WINDOW (msg_win), set_as_modified);
 	gtk_widget_show_all (GTK_WIDGET (msg_win));
 
+	/* The sizes are checked asynchronously, against the total
+	   size of the attachments */
 	while (attachments) {
-		GnomeVFSFileSize att_size;
-		att_size =
-			modest_msg_edit_window_attach_file_one((ModestMsgEditWindow *)msg_win,
-							       attachments->data, allowed_size);
-		total_size += att_size;
-
-		if (att_size > allowed_size) {
-			g_debug ("%s: total size: %u",
-				 __FUNCTION__, (unsigned int)total_size);
-			break;
-		}
-		allowed_size -= att_size;
-
+		modest_msg_edit_window_attach_file_one((ModestMsgEditWindow *)msg_win,
+						       attachments->data, MODEST_MAX_ATTACHMENT_SIZE);
 		attachments = g_slist_next(attachments);
 	}
 
@@ -2322,6 +2311,20 @@ typedef struct {
 	gboolean force_connection;
 } SendReceiveInfo;
 
+static void
+send_receive_info_free (SendReceiveInfo *info)
+{
+	if (info->mail_op)
+		g_object_unref (G_OBJECT (info->mail_op));
+	if (info->account_name)
+		g_free (info->account_name);
+	if (info->win)
+		g_object_unref (info->win);
+	if (info->account)
+		g_object_unref (info->account);
+	g_slice_free (SendReceiveInfo, info);
+}
+
 static void
 do_send_receive_performer (gboolean canceled,
 			   GError *err,
@@ -2354,15 +2357,61 @@ do_send_receive_performer (gboolean canceled,
 
  clean:
 	/* Frees */
-	if (info->mail_op)
-		g_object_unref (G_OBJECT (info->mail_op));
-	if (info->account_name)
-		g_free (info->account_name);
-	if (info->win)
-		g_object_unref (info->win);
-	if (info->account)
-		g_object_unref (info->account);
-	g_slice_free (SendReceiveInfo, info);
+	send_receive_info_free (info);
+}
+
+static void
+send_receive_run (ModestMailOperation *mail_op,
+		  gpointer userdata)
+{
+	SendReceiveInfo *info = (SendReceiveInfo *) userdata;
+	ModestProtocolType account_type;
+
+	/* for POP3 account we should go offline before we can sync account */
+	account_type = modest_tny_account_get_protocol_type (info->account);
+	if (MODEST_PROTOCOLS_STORE_POP == account_type) {
+		info->disconnect_op =
+			modest_mail_operation_new ((info->win) ? G_OBJECT (info->win) : NULL);
+		modest_mail_operation_queue_add (modest_runtime_get_mail_operation_queue (),
+			info->disconnect_op);
+		g_signal_connect (G_OBJECT (info->disconnect_op), "operation-finished",
+			G_CALLBACK (modest_ui_actions_send_receive_offline), info);
+		modest_mail_operation_disconnect_account (info->disconnect_op, info->account);
+	}
+	else {
+		/* Invoke the connect and perform */
+		info->disconnect_op = NULL;
+		modest_platform_connect_and_perform (info->parent_window,
+		info->force_connection, info->account, do_send_receive_performer, info);
+	}
+}
+
+static void
+send_receive_coalesce (ModestMailOperation *mail_op,
+		       gpointer userdata,
+		       gpointer new_userdata)
+{
+	SendReceiveInfo *info = (SendReceiveInfo *) userdata;
+	SendReceiveInfo *new_info = (SendReceiveInfo *) new_userdata;
+
+	/* An automatic update does not change anything, but if the
+	   user asks for one while an automatic update is waiting or
+	   running then it must behave as if the user requested it */
+	if (!new_info->interactive)
+		return;
+
+	modest_mail_operation_set_interactive (mail_op);
+
+	/* Not started yet */
+	if (info) {
+		info->interactive = TRUE;
+		info->poke_status = info->poke_status || new_info->poke_status;
+		info->force_connection = info->force_connection || new_info->force_connection;
+		if (!info->win && new_info->win) {
+			info->win = g_object_ref (new_info->win);
+			info->parent_window = new_info->parent_window;
+		}
+	}
 }
 
 /*
@@ -2378,9 +2427,8 @@ modest_ui_actions_do_send_receive (const gchar *account_name,
 				   gboolean interactive,
 				   ModestWindow *win)
 {
-	gchar *acc_name = NULL;
+	gchar *acc_name = NULL, *coalesce_key;
 	SendReceiveInfo *info;
-	ModestProtocolType account_type;
 	ModestTnyAccountStore *acc_store;
 	TnyAccount *account;
 
@@ -2441,25 +2489,23 @@ modest_ui_actions_do_send_receive (const gchar *account_name,
 	info->mail_op = modest_mail_operation_new_with_error_handling ((info->win) ? G_OBJECT (info->win) : NULL,
 								       modest_ui_actions_disk_operations_error_handler,
 								       NULL, NULL);
-	modest_mail_operation_queue_add (modest_runtime_get_mail_operation_queue (), info->mail_op);
+	info->disconnect_op = NULL;
 
-	/* for POP3 account we should go offline before we can sync account */
-	account_type = modest_tny_account_get_protocol_type (account);
-	if (MODEST_PROTOCOLS_STORE_POP == account_type) {
-		info->disconnect_op =
-			modest_mail_operation_new ((info->win) ? G_OBJECT (info->win) : NULL);
-		modest_mail_operation_queue_add (modest_runtime_get_mail_operation_queue (),
-			info->disconnect_op);
-		g_signal_connect (G_OBJECT (info->disconnect_op), "operation-finished",
-			G_CALLBACK (modest_ui_actions_send_receive_offline), info);
-		modest_mail_operation_disconnect_account (info->disconnect_op, account);
-	}
-	else {
-		/* Invoke the connect and perform */
-		modest_platform_connect_and_perform (info->parent_window,
-		force_connection, info->account, do_send_receive_performer, info);
-		info->disconnect_op = NULL;
-	}
+	/* Let the queue start it when there are free slots. Automatic
+	   updates have a lower priority than the ones requested by
+	   the user, and an update of an account that is already
+	   waiting or running is discarded, although the one already
+	   in the queue becomes interactive if this one was */
+	coalesce_key = g_strdup_printf ("update-account:%s", acc_name);
+	modest_mail_operation_queue_add_scheduled (modest_runtime_get_mail_operation_queue (),
+						   info->mail_op, acc_name,
+						   interactive ?
+						   MODEST_MAIL_OPERATION_QUEUE_PRIORITY_NORMAL :
+						   MODEST_MAIL_OPERATION_QUEUE_PRIORITY_LOW,
+						   coalesce_key, send_receive_coalesce,
+						   send_receive_run, info,
+						   (GDestroyNotify) send_receive_info_free);
+	g_free (coalesce_key);
 }
 
 static void
@@ -2744,9 +2790,13 @@ on_save_to_drafts_cb (ModestMailOperation *mail_op,
 
 	edit_window = MODEST_MSG_EDIT_WINDOW (user_data);
 
-	/* Set draft is there was no error */
-	if (!modest_mail_operation_get_error (mail_op))
+	/* Set draft is there was no error. The window is not modified
+	   anymore only if the save really happened, otherwise the next
+	   save must write the draft again */
+	if (!modest_mail_operation_get_error (mail_op)) {
 		modest_msg_edit_window_set_draft (edit_window, saved_draft);
+		modest_msg_edit_window_set_modified (edit_window, FALSE);
+	}
 
 	g_object_unref(edit_window);
 }
@@ -2804,6 +2854,34 @@ enough_space_for_message (ModestMsgEditWindow *edit_window,
 	return TRUE;
 }
 
+static gboolean
+is_saved_draft (TnyMsg *msg)
+{
+	TnyFolder *folder;
+	gboolean result = FALSE;
+
+	folder = tny_msg_get_folder (msg);
+	if (folder) {
+		result = (modest_tny_folder_guess_folder_type (folder) == TNY_FOLDER_TYPE_DRAFTS);
+		g_object_unref (folder);
+	}
+
+	return result;
+}
+
+static void
+show_saved_to_drafts_banner (void)
+{
+	gchar *text;
+
+	/* In hildon2 we always show the information banner on saving to drafts.
+	 * It will be a system information banner in this case.
+	 */
+	text = g_strdup_printf (_("mail_va_saved_to_drafts"), _("mcen_me_folder_drafts"));
+	modest_platform_information_banner (NULL, NULL, text);
+	g_free (text);
+}
+
 gboolean
 modest_ui_actions_on_save_to_drafts (GtkWidget *widget, ModestMsgEditWindow *edit_window)
 {
@@ -2818,6 +2896,15 @@ modest_ui_actions_on_save_to_drafts (GtkWidget *widget, ModestMsgEditWindow *edi
 
 	data = modest_msg_edit_window_get_msg_data (edit_window);
 
+	/* Nothing to write if the draft did not change since it was
+	   saved */
+	if (data->draft_msg && !modest_msg_edit_window_is_modified (edit_window) &&
+	    is_saved_draft (data->draft_msg)) {
+		show_saved_to_drafts_banner ();
+		modest_msg_edit_window_free_msg_data (edit_window, data);
+		return TRUE;
+	}
+
 	/* Check size */
 	if (!enough_space_for_message (edit_window, data)) {
 		modest_msg_edit_window_free_msg_data (edit_window, data);
@@ -2875,13 +2962,7 @@ modest_ui_actions_on_save_to_drafts (GtkWidget *widget, ModestMsgEditWindow *edi
 					      on_save_to_drafts_cb,
 					      g_object_ref(edit_window));
 
-	/* In hildon2 we always show the information banner on saving to drafts.
-	 * It will be a system information banner in this case.
-	 */
-	gchar *text = g_strdup_printf (_("mail_va_saved_to_drafts"), _("mcen_me_folder_drafts"));
-	modest_platform_information_banner (NULL, NULL, text);
-	g_free (text);
-	modest_msg_edit_window_set_modified (edit_window, FALSE);
+	show_saved_to_drafts_banner ();
 
 	/* Frees */
 	g_free (account_name);
@@ -2988,6 +3069,13 @@ modest_ui_actions_on_send (GtkWidget *widget, ModestMsgEditWindow *edit_window)
 							    data->priority_flags);
 
 
+	/* Remember the recipients for the address completion */
+	if (result) {
+		modest_recipient_index_add (data->to, TRUE);
+		modest_recipient_index_add (data->cc, TRUE);
+		modest_recipient_index_add (data->bcc, TRUE);
+	}
+
 	/* Free data: */
 	g_free (account_name);
 	g_object_unref (G_OBJECT (transport_account));
@@ -28,8 +28,11 @@
  */
 
 #include "modest-debug.h"
+#include "modest-runtime.h"
+#include "modest-signal-mgr.h"
 #include "modest-ui-dimming-manager.h"
 #include "modest-dimming-rules-group-priv.h"
+#include <tny-device.h>
 
 static void modest_ui_dimming_manager_class_init (ModestUIDimmingManagerClass *klass);
 static void modest_ui_dimming_manager_init       (ModestUIDimmingManager *obj);
@@ -37,6 +40,15 @@ static void modest_ui_dimming_manager_finalize   (GObject *obj);
 static void modest_ui_dimming_manager_dispose    (GObject *obj);
 
 static void _process_all_rules (gpointer key, gpointer value, gpointer user_data);
+static void _invalidate_rules (gpointer key, gpointer value, gpointer user_data);
+
+static void on_queue_changed (ModestMailOperationQueue *queue,
+			      ModestMailOperation *mail_op,
+			      ModestMailOperationQueueNotification type,
+			      ModestUIDimmingManager *self);
+static void on_connection_changed (TnyDevice *device,
+				   gboolean online,
+				   ModestUIDimmingManager *self);
 
 #define WIDGET_DIMMING_MODE "widget-dimming-mode"
 
@@ -45,6 +57,7 @@ typedef struct _ModestUIDimmingManagerPrivate ModestUIDimmingManagerPrivate;
 struct _ModestUIDimmingManagerPrivate {
 	GHashTable *groups_map;
 	GHashTable *delayed_calls;
+	GSList *sighandlers;
 };
 
 #define MODEST_UI_DIMMING_MANAGER_GET_PRIVATE(o)      (G_TYPE_INSTANCE_GET_PRIVATE((o), \
@@ -106,6 +119,19 @@ modest_ui_dimming_manager_init (ModestUIDimmingManager *obj)
 						     g_str_equal,
 						     g_free,
 						     NULL);
+
+	/* The operations and the connectivity are global, so we do
+	   not wait for the windows to tell us about them */
+	priv->sighandlers = modest_signal_mgr_connect (NULL,
+						       G_OBJECT (modest_runtime_get_mail_operation_queue ()),
+						       "queue-changed",
+						       G_CALLBACK (on_queue_changed),
+						       obj);
+	priv->sighandlers = modest_signal_mgr_connect (priv->sighandlers,
+						       G_OBJECT (modest_runtime_get_device ()),
+						       "connection_changed",
+						       G_CALLBACK (on_connection_changed),
+						       obj);
 }
 
 static void
@@ -155,6 +181,9 @@ modest_ui_dimming_manager_dispose (GObject *obj)
 
 	priv = MODEST_UI_DIMMING_MANAGER_GET_PRIVATE(obj);
 
+	modest_signal_mgr_disconnect_all_and_destroy (priv->sighandlers);
+	priv->sighandlers = NULL;
+
 	if (priv->delayed_calls != NULL && (g_hash_table_size (priv->delayed_calls) > 0)) {
 		/* Remove all pending calls */
 		g_hash_table_foreach (priv->delayed_calls,
@@ -278,6 +307,34 @@ process_dimming_rules_delayed_destroyer (gpointer data)
 void
 modest_ui_dimming_manager_process_dimming_rules_group (ModestUIDimmingManager *self,
 						       const gchar *group_name)
+{
+	modest_ui_dimming_manager_process_dimming_rules_group_for (self, group_name,
+								   MODEST_DIMMING_DEPS_ALL);
+}
+
+void
+modest_ui_dimming_manager_invalidate_dimming_rules_group (ModestUIDimmingManager *self,
+							  const gchar *group_name,
+							  ModestDimmingDeps deps)
+{
+	ModestDimmingRulesGroup *group = NULL;
+	ModestUIDimmingManagerPrivate *priv;
+
+	g_return_if_fail (group_name != NULL);
+
+	priv = MODEST_UI_DIMMING_MANAGER_GET_PRIVATE(self);
+	if (!priv->groups_map)
+		return;
+
+	group = MODEST_DIMMING_RULES_GROUP(g_hash_table_lookup (priv->groups_map, group_name));
+	if (group)
+		modest_dimming_rules_group_invalidate (group, deps);
+}
+
+void
+modest_ui_dimming_manager_process_dimming_rules_group_for (ModestUIDimmingManager *self,
+							   const gchar *group_name,
+							   ModestDimmingDeps deps)
 {
 	ModestDimmingRulesGroup *group = NULL;
 	ModestUIDimmingManagerPrivate *priv;
@@ -292,6 +349,9 @@ modest_ui_dimming_manager_process_dimming_rules_group (ModestUIDimmingManager *s
 	group = MODEST_DIMMING_RULES_GROUP(g_hash_table_lookup (priv->groups_map, group_name));
 	g_return_if_fail (group != NULL);
 
+	/* The changes are accumulated until the delayed check runs */
+	modest_dimming_rules_group_invalidate (group, deps);
+
 	/* If there was another pending dimming operation check then ignore this */
 	handler = g_hash_table_lookup (priv->delayed_calls, group_name);
 	if (!handler) {
@@ -319,9 +379,49 @@ _process_all_rules (gpointer key, gpointer value, gpointer user_data)
 {
 	g_return_if_fail (MODEST_IS_DIMMING_RULES_GROUP (value));
 
+	modest_dimming_rules_group_invalidate (MODEST_DIMMING_RULES_GROUP (value),
+					       MODEST_DIMMING_DEPS_ALL);
 	modest_dimming_rules_group_execute (MODEST_DIMMING_RULES_GROUP (value));
 }
 
+static void
+_invalidate_rules (gpointer key, gpointer value, gpointer user_data)
+{
+	g_return_if_fail (MODEST_IS_DIMMING_RULES_GROUP (value));
+
+	modest_dimming_rules_group_invalidate (MODEST_DIMMING_RULES_GROUP (value),
+					       (ModestDimmingDeps) GPOINTER_TO_INT (user_data));
+}
+
+static void
+on_queue_changed (ModestMailOperationQueue *queue,
+		  ModestMailOperation *mail_op,
+		  ModestMailOperationQueueNotification type,
+		  ModestUIDimmingManager *self)
+{
+	ModestUIDimmingManagerPrivate *priv;
+
+	/* We only mark the rules as dirty, the windows decide when
+	   the rules must be checked again */
+	priv = MODEST_UI_DIMMING_MANAGER_GET_PRIVATE(self);
+	if (priv->groups_map)
+		g_hash_table_foreach (priv->groups_map, _invalidate_rules,
+				      GINT_TO_POINTER (MODEST_DIMMING_DEPS_OPERATIONS));
+}
+
+static void
+on_connection_changed (TnyDevice *device,
+		       gboolean online,
+		       ModestUIDimmingManager *self)
+{
+	ModestUIDimmingManagerPrivate *priv;
+
+	priv = MODEST_UI_DIMMING_MANAGER_GET_PRIVATE(self);
+	if (priv->groups_map)
+		g_hash_table_foreach (priv->groups_map, _invalidate_rules,
+				      GINT_TO_POINTER (MODEST_DIMMING_DEPS_CONNECTIVITY));
+}
+
 void
 modest_ui_dimming_manager_set_widget_dimming_mode (GtkWidget *widget,
 						   ModestUIDimmingMode mode)
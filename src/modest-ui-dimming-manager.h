@@ -78,6 +78,21 @@ void
 modest_ui_dimming_manager_process_dimming_rules_group (ModestUIDimmingManager *self,
 						       const gchar *group_name);
 
+/* Like modest_ui_dimming_manager_process_dimming_rules_group but only
+ * the rules that depend on @deps are evaluated */
+void
+modest_ui_dimming_manager_process_dimming_rules_group_for (ModestUIDimmingManager *self,
+							   const gchar *group_name,
+							   ModestDimmingDeps deps);
+
+/* Marks @deps as changed for @group_name without scheduling a
+ * check. They will be taken into account the next time the group is
+ * processed */
+void
+modest_ui_dimming_manager_invalidate_dimming_rules_group (ModestUIDimmingManager *self,
+							  const gchar *group_name,
+							  ModestDimmingDeps deps);
+
 void
 modest_ui_dimming_manager_set_widget_dimming_mode (GtkWidget *widget,
 						   ModestUIDimmingMode mode);
@@ -71,6 +71,120 @@ static gboolean _msgs_send_in_progress (void);
 static gboolean _all_msgs_in_sending_status (ModestHeaderView *header_view) G_GNUC_UNUSED;
 static gboolean _forbid_outgoing_xfers (ModestWindow *window);
 
+/* Inputs shared by all the rules of an evaluation. They're computed
+ * the first time a rule needs them */
+#define SNAPSHOT_UNKNOWN -1
+
+struct _ModestDimmingSnapshot {
+	ModestWindow *window;
+	gint transfer_mode;
+	gint download_in_progress;
+	gint forbid_outgoing_xfers;
+	gint send_receive_in_progress;
+	gint msgs_send_in_progress;
+	ModestDimmingSnapshot *previous;
+};
+
+static ModestDimmingSnapshot *current_snapshot = NULL;
+
+/* What each rule depends on. Rules not listed here depend on
+ * everything, as for example the editor ones, that check the focus
+ * or the contents of the editor */
+static const struct {
+	GCallback callback;
+	ModestDimmingDeps deps;
+} rules_deps[] = {
+	{ G_CALLBACK (modest_ui_dimming_rules_always_dimmed), MODEST_DIMMING_DEPS_NONE },
+	{ G_CALLBACK (modest_ui_dimming_rules_on_reply_msg),
+	  MODEST_DIMMING_DEPS_SELECTION | MODEST_DIMMING_DEPS_FOLDER | MODEST_DIMMING_DEPS_OPERATIONS },
+	{ G_CALLBACK (modest_ui_dimming_rules_on_delete_msg),
+	  MODEST_DIMMING_DEPS_SELECTION | MODEST_DIMMING_DEPS_OPERATIONS },
+	{ G_CALLBACK (modest_ui_dimming_rules_on_details),
+	  MODEST_DIMMING_DEPS_SELECTION | MODEST_DIMMING_DEPS_OPERATIONS },
+	{ G_CALLBACK (modest_ui_dimming_rules_on_fetch_images),
+	  MODEST_DIMMING_DEPS_SELECTION | MODEST_DIMMING_DEPS_OPERATIONS },
+	{ G_CALLBACK (modest_ui_dimming_rules_on_mark_as_read_msg_in_view), MODEST_DIMMING_DEPS_SELECTION },
+	{ G_CALLBACK (modest_ui_dimming_rules_on_mark_as_unread_msg_in_view), MODEST_DIMMING_DEPS_SELECTION },
+	{ G_CALLBACK (modest_ui_dimming_rules_on_view_window_move_to),
+	  MODEST_DIMMING_DEPS_SELECTION | MODEST_DIMMING_DEPS_OPERATIONS },
+	{ G_CALLBACK (modest_ui_dimming_rules_on_find_in_msg),
+	  MODEST_DIMMING_DEPS_SELECTION | MODEST_DIMMING_DEPS_OPERATIONS },
+	{ G_CALLBACK (modest_ui_dimming_rules_on_view_previous),
+	  MODEST_DIMMING_DEPS_SELECTION | MODEST_DIMMING_DEPS_FOLDER | MODEST_DIMMING_DEPS_OPERATIONS },
+	{ G_CALLBACK (modest_ui_dimming_rules_on_view_next),
+	  MODEST_DIMMING_DEPS_SELECTION | MODEST_DIMMING_DEPS_FOLDER | MODEST_DIMMING_DEPS_OPERATIONS },
+	{ G_CALLBACK (modest_ui_dimming_rules_on_view_attachments), MODEST_DIMMING_DEPS_SELECTION },
+	{ G_CALLBACK (modest_ui_dimming_rules_on_save_attachments), MODEST_DIMMING_DEPS_SELECTION },
+	{ G_CALLBACK (modest_ui_dimming_rules_on_remove_attachments),
+	  MODEST_DIMMING_DEPS_SELECTION | MODEST_DIMMING_DEPS_FOLDER | MODEST_DIMMING_DEPS_OPERATIONS },
+	{ G_CALLBACK (modest_ui_dimming_rules_on_copy),
+	  MODEST_DIMMING_DEPS_SELECTION | MODEST_DIMMING_DEPS_CLIPBOARD },
+	{ G_CALLBACK (modest_ui_dimming_rules_on_cut),
+	  MODEST_DIMMING_DEPS_SELECTION | MODEST_DIMMING_DEPS_CLIPBOARD },
+	{ G_CALLBACK (modest_ui_dimming_rules_on_add_to_contacts), MODEST_DIMMING_DEPS_SELECTION },
+	{ G_CALLBACK (modest_ui_dimming_rules_on_cancel_sending_all), MODEST_DIMMING_DEPS_OPERATIONS },
+	{ G_CALLBACK (modest_ui_dimming_rules_on_send_receive),
+	  MODEST_DIMMING_DEPS_OPERATIONS | MODEST_DIMMING_DEPS_CONNECTIVITY },
+	{ G_CALLBACK (modest_ui_dimming_rules_on_send_receive_all),
+	  MODEST_DIMMING_DEPS_OPERATIONS | MODEST_DIMMING_DEPS_CONNECTIVITY },
+};
+
+ModestDimmingDeps
+modest_ui_dimming_rules_get_deps (GCallback callback)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (rules_deps); i++) {
+		if (rules_deps[i].callback == callback)
+			return rules_deps[i].deps;
+	}
+
+	return MODEST_DIMMING_DEPS_ALL;
+}
+
+ModestDimmingSnapshot *
+modest_ui_dimming_rules_snapshot_new (ModestWindow *window)
+{
+	ModestDimmingSnapshot *snapshot;
+
+	g_return_val_if_fail (MODEST_IS_WINDOW (window), NULL);
+
+	snapshot = g_slice_new (ModestDimmingSnapshot);
+	snapshot->window = window;
+	snapshot->transfer_mode = SNAPSHOT_UNKNOWN;
+	snapshot->download_in_progress = SNAPSHOT_UNKNOWN;
+	snapshot->forbid_outgoing_xfers = SNAPSHOT_UNKNOWN;
+	snapshot->send_receive_in_progress = SNAPSHOT_UNKNOWN;
+	snapshot->msgs_send_in_progress = SNAPSHOT_UNKNOWN;
+
+	/* Rules could trigger the evaluation of other groups */
+	snapshot->previous = current_snapshot;
+	current_snapshot = snapshot;
+
+	return snapshot;
+}
+
+void
+modest_ui_dimming_rules_snapshot_free (ModestDimmingSnapshot *snapshot)
+{
+	if (!snapshot)
+		return;
+
+	g_return_if_fail (snapshot == current_snapshot);
+
+	current_snapshot = snapshot->previous;
+	g_slice_free (ModestDimmingSnapshot, snapshot);
+}
+
+static ModestDimmingSnapshot *
+_get_snapshot (ModestWindow *win)
+{
+	if (current_snapshot && current_snapshot->window == win)
+		return current_snapshot;
+	else
+		return NULL;
+}
+
 
 
 static DimmedState *
@@ -571,10 +685,15 @@ modest_ui_dimming_rules_on_move_to (ModestWindow *win, gpointer user_data)
 static gboolean
 _forbid_outgoing_xfers (ModestWindow *window)
 {
+	ModestDimmingSnapshot *snapshot;
 	const gchar *account_name = NULL;
 	TnyAccount *account = NULL;
 	gboolean dimmed = FALSE;
 
+	snapshot = _get_snapshot (window);
+	if (snapshot && snapshot->forbid_outgoing_xfers != SNAPSHOT_UNKNOWN)
+		return snapshot->forbid_outgoing_xfers;
+
 #ifdef MODEST_TOOLKIT_HILDON2
 	/* We cannot just get the active account because the active
 	   account of a header window that shows the headers of a
@@ -611,6 +730,10 @@ _forbid_outgoing_xfers (ModestWindow *window)
 
 		g_object_unref (account);
 	}
+
+	if (snapshot)
+		snapshot->forbid_outgoing_xfers = dimmed;
+
 	return dimmed;
 }
 
@@ -1122,6 +1245,11 @@ modest_ui_dimming_rules_on_send (ModestWindow *win, gpointer user_data)
 		if (dimmed)
 			modest_dimming_rule_set_notification (rule, _("mcen_ib_add_recipients_first"));
 	}
+
+	/* The message is not complete while images are inserted or
+	   the attachments are checked */
+	if (!dimmed)
+		dimmed = modest_msg_edit_window_has_pending_parts (MODEST_MSG_EDIT_WINDOW (win));
 	
 	return dimmed;
 }
@@ -1556,14 +1684,22 @@ _purged_attach_selected (ModestWindow *win, gboolean all, ModestDimmingRule *rul
 static gboolean
 _msg_download_in_progress (ModestWindow *win)
 {
+	ModestDimmingSnapshot *snapshot;
 	gboolean result = FALSE;
 
 	g_return_val_if_fail (MODEST_IS_WINDOW (win), FALSE);
 
+	snapshot = _get_snapshot (win);
+	if (snapshot && snapshot->download_in_progress != SNAPSHOT_UNKNOWN)
+		return snapshot->download_in_progress;
+
 	if (MODEST_IS_MSG_VIEW_WINDOW (win)) {
 		result = modest_msg_view_window_toolbar_on_transfer_mode (MODEST_MSG_VIEW_WINDOW(win));
 	}
 
+	if (snapshot)
+		snapshot->download_in_progress = result;
+
 	return result;
 }
 
@@ -1638,8 +1774,13 @@ frees:
 static gboolean
 _transfer_mode_enabled (ModestWindow *win)
 {
+	ModestDimmingSnapshot *snapshot;
 	gboolean result = FALSE;
 
+	snapshot = _get_snapshot (win);
+	if (snapshot && snapshot->transfer_mode != SNAPSHOT_UNKNOWN)
+		return snapshot->transfer_mode;
+
         /* Check dimming */
         if (MODEST_IS_MSG_VIEW_WINDOW(win)) {
                 result = modest_msg_view_window_transfer_mode_enabled (MODEST_MSG_VIEW_WINDOW (win));
@@ -1651,6 +1792,9 @@ _transfer_mode_enabled (ModestWindow *win)
                 g_warning("_transfer_mode_enabled called with wrong window type");
         }
 
+	if (snapshot)
+		snapshot->transfer_mode = result;
+
 	return result;
 }
 
@@ -1694,7 +1838,8 @@ modest_ui_dimming_rules_on_save_to_drafts (ModestWindow *win,
 	rule = MODEST_DIMMING_RULE (user_data);
 
 	/* Check dimmed rule */	
-	return !modest_msg_edit_window_is_modified (MODEST_MSG_EDIT_WINDOW (win));
+	return !modest_msg_edit_window_is_modified (MODEST_MSG_EDIT_WINDOW (win)) ||
+		modest_msg_edit_window_has_pending_parts (MODEST_MSG_EDIT_WINDOW (win));
 }
 
 gboolean
@@ -1709,10 +1854,15 @@ modest_ui_dimming_rules_on_insert_image (ModestWindow *win,
 static gboolean 
 _send_receive_in_progress (ModestWindow *win)
 {
+	ModestDimmingSnapshot *snapshot;
 	ModestMailOperationQueue *queue;
 	GSList *op_list, *node;
 	gboolean found_send_receive;
 
+	snapshot = _get_snapshot (win);
+	if (snapshot && snapshot->send_receive_in_progress != SNAPSHOT_UNKNOWN)
+		return snapshot->send_receive_in_progress;
+
 	queue = modest_runtime_get_mail_operation_queue ();
 	op_list = modest_mail_operation_queue_get_by_source (queue, G_OBJECT (win));
 
@@ -1732,6 +1882,9 @@ _send_receive_in_progress (ModestWindow *win)
 		g_slist_free (op_list);
 	}
 
+	if (snapshot)
+		snapshot->send_receive_in_progress = found_send_receive;
+
 	return found_send_receive;
 }
 
@@ -1744,6 +1897,10 @@ _msgs_send_in_progress (void)
 	GSList *send_queues = NULL, *node = NULL;
 	gboolean found = FALSE;
 
+	/* It does not depend on the window, so any snapshot is valid */
+	if (current_snapshot && current_snapshot->msgs_send_in_progress != SNAPSHOT_UNKNOWN)
+		return current_snapshot->msgs_send_in_progress;
+
 	cache_mgr = modest_runtime_get_cache_mgr ();
 	send_queue_cache = modest_cache_mgr_get_cache (cache_mgr,
 						       MODEST_CACHE_MGR_CACHE_TYPE_SEND_QUEUE);
@@ -1762,6 +1919,9 @@ _msgs_send_in_progress (void)
 
 	g_slist_free (send_queues);
 
+	if (current_snapshot)
+		current_snapshot->msgs_send_in_progress = found;
+
 	return found;
 }
 
@@ -38,6 +38,16 @@ G_BEGIN_DECLS
 /* Window dimming state */
 DimmedState *modest_ui_dimming_rules_define_dimming_state (ModestWindow *window);
 
+/* Inputs shared by the rules evaluated in the same pass. Create it
+ * before executing the rules and free it right after */
+typedef struct _ModestDimmingSnapshot ModestDimmingSnapshot;
+
+ModestDimmingSnapshot *modest_ui_dimming_rules_snapshot_new (ModestWindow *window);
+void modest_ui_dimming_rules_snapshot_free (ModestDimmingSnapshot *snapshot);
+
+/* The inputs a rule depends on, MODEST_DIMMING_DEPS_ALL if unknown */
+ModestDimmingDeps modest_ui_dimming_rules_get_deps (GCallback callback);
+
 /* Menu & toolbar dimming rules */
 gboolean modest_ui_dimming_rules_on_new_msg (ModestWindow *win, gpointer user_data);
 gboolean modest_ui_dimming_rules_on_new_msg_or_folder (ModestWindow *win, gpointer user_data);
@@ -27,13 +27,18 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <config.h>
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <errno.h>
 #include <string.h> /* for strlen */
+#include <fcntl.h>
+#include <unistd.h>
 #include <modest-runtime.h>
 #include <libgnomevfs/gnome-vfs.h>
 #include <tny-fs-stream.h>
+#include <tny-seekable.h>
+#include <tny-stream-cache.h>
 #include <tny-camel-account.h>
 #include <tny-status.h>
 #include <tny-camel-send-queue.h>
@@ -44,6 +49,8 @@
 #include <modest-account-protocol.h>
 #include "modest-account-mgr-helpers.h"
 #include "modest-text-utils.h"
+#include "modest-tny-account.h"
+#include "modest-tny-folder.h"
 #include <modest-local-folder-info.h>
 #include "widgets/modest-header-view.h"
 #include "modest-widget-memory.h"
@@ -53,6 +60,9 @@
 #include <modest-gtk-window-mgr.h>
 #endif
 #include <langinfo.h>
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
 
 GQuark
 modest_utils_get_supported_secure_authentication_error_quark (void)
@@ -193,6 +203,98 @@ modest_utils_create_temp_stream (const gchar *orig_name, const gchar *hash_base,
 	return TNY_FS_STREAM (tny_fs_stream_new (fd));
 }
 
+#define COPY_FILE_CHUNK_SIZE (64 * 1024)
+
+gssize
+modest_utils_copy_file (const gchar *source,
+			const gchar *destination,
+			void (*progress_func) (gsize delta, gpointer user_data),
+			gpointer user_data)
+{
+	gint in_fd, out_fd, saved_errno;
+	gssize copied = 0;
+	gssize read_bytes;
+
+	g_return_val_if_fail (source && destination, -1);
+
+	in_fd = g_open (source, O_RDONLY, 0);
+	if (in_fd == -1)
+		return -1;
+
+	out_fd = g_open (destination, O_CREAT|O_WRONLY|O_TRUNC, 0644);
+	if (out_fd == -1) {
+		saved_errno = errno;
+		close (in_fd);
+		errno = saved_errno;
+		return -1;
+	}
+
+#if defined(HAVE_SYS_SENDFILE_H) && defined(HAVE_SENDFILE)
+	/* Let the kernel do the copy. Older kernels do not support
+	   regular files as the destination, in that case we fall back
+	   to the user space copy below */
+	while ((read_bytes = sendfile (out_fd, in_fd, NULL, COPY_FILE_CHUNK_SIZE)) > 0) {
+		copied += read_bytes;
+		if (progress_func)
+			progress_func (read_bytes, user_data);
+	}
+	if (read_bytes == 0)
+		goto finish;
+	if (copied > 0 || (errno != EINVAL && errno != ENOSYS)) {
+		copied = -1;
+		goto finish;
+	}
+#endif
+
+	{
+		gchar *buffer = g_malloc (COPY_FILE_CHUNK_SIZE);
+
+		while ((read_bytes = read (in_fd, buffer, COPY_FILE_CHUNK_SIZE)) != 0) {
+			gchar *offset = buffer;
+
+			if (read_bytes == -1) {
+				if (errno == EINTR)
+					continue;
+				copied = -1;
+				break;
+			}
+			while (read_bytes > 0) {
+				gssize written = write (out_fd, offset, read_bytes);
+				if (written == -1) {
+					if (errno == EINTR)
+						continue;
+					break;
+				}
+				offset += written;
+				read_bytes -= written;
+				copied += written;
+				if (progress_func)
+					progress_func (written, user_data);
+			}
+			if (read_bytes > 0) {
+				copied = -1;
+				break;
+			}
+		}
+		saved_errno = errno;
+		g_free (buffer);
+		errno = saved_errno;
+	}
+
+#if defined(HAVE_SYS_SENDFILE_H) && defined(HAVE_SENDFILE)
+ finish:
+#endif
+	saved_errno = errno;
+	close (in_fd);
+	if (close (out_fd) == -1 && copied != -1) {
+		saved_errno = errno;
+		copied = -1;
+	}
+	errno = saved_errno;
+
+	return copied;
+}
+
 typedef struct 
 {
 	GList **result;
@@ -547,7 +649,6 @@ launch_sort_headers_dialog (ModestWindow *parent_window,
 	gint attachments_sort_id;
 	gint priority_sort_id;
 	GtkTreeSortable *sortable;
-	GtkTreeModel *filter;
 
 	/* Get header window */
 	if (MODEST_IS_HEADER_WINDOW (parent_window)) {
@@ -560,7 +661,7 @@ launch_sort_headers_dialog (ModestWindow *parent_window,
 	cols = modest_header_view_get_columns (header_view);
 	if (cols == NULL) 
 		return;
-#define SORT_ID_NUM 6
+#define SORT_ID_NUM 7
 	int sort_model_ids[SORT_ID_NUM];
 	int sort_ids[SORT_ID_NUM];
 
@@ -612,9 +713,13 @@ launch_sort_headers_dialog (ModestWindow *parent_window,
 	sort_model_ids[sort_key] = TNY_GTK_HEADER_LIST_MODEL_FLAGS_COLUMN;
 	sort_ids[sort_key] = TNY_HEADER_FLAG_PRIORITY_MASK;
 	priority_sort_id = sort_key;
+
+	sort_key = checked_modest_sort_criterium_view_add_sort_key (MODEST_SORT_CRITERIUM_VIEW (dialog), _("Conversation"),
+								    SORT_ID_NUM);
+	sort_model_ids[sort_key] = MODEST_HEADER_VIEW_THREAD_SORT_COLUMN;
+	sort_ids[sort_key] = 0;
 	
-	filter = gtk_tree_view_get_model (GTK_TREE_VIEW (header_view));
-	sortable = GTK_TREE_SORTABLE (gtk_tree_model_filter_get_model (GTK_TREE_MODEL_FILTER (filter)));
+	sortable = modest_header_view_get_sortable (header_view);
 	/* Launch dialogs */
 	if (!gtk_tree_sortable_get_sort_column_id (sortable,
 						   &current_sort_colid, &current_sort_type)) {
@@ -717,6 +822,203 @@ modest_images_cache_get_id (const gchar *account, const gchar *uri)
 	return result;
 }
 
+static gchar *
+bodies_cache_get_folder_prefix (TnyFolder *folder)
+{
+	TnyAccount *account;
+	const gchar *account_name = NULL;
+	gchar *url, *folder_hash, *result;
+
+	account = modest_tny_folder_get_account (folder);
+	if (account) {
+		account_name = modest_tny_account_get_parent_modest_account_name_for_server_account (account);
+		if (!account_name)
+			account_name = tny_account_get_id (account);
+	}
+
+	/* The URL is hashed, as it's used as a file name by the cache */
+	url = tny_folder_get_url_string (folder);
+	folder_hash = url ? g_compute_checksum_for_string (G_CHECKSUM_MD5, url, -1) : NULL;
+
+	if (account_name && folder_hash)
+		result = g_strdup_printf ("%s__%s__", account_name, folder_hash);
+	else
+		result = NULL;
+
+	g_free (folder_hash);
+	g_free (url);
+	if (account)
+		g_object_unref (account);
+
+	return result;
+}
+
+static gchar *
+bodies_cache_get_msg_prefix (TnyHeader *header)
+{
+	TnyFolder *folder;
+	gchar *uid, *folder_prefix, *uid_hash, *result = NULL;
+
+	folder = tny_header_get_folder (header);
+	if (!folder)
+		return NULL;
+
+	uid = tny_header_dup_uid (header);
+	folder_prefix = bodies_cache_get_folder_prefix (folder);
+	if (uid && uid[0] != '\0' && folder_prefix) {
+		uid_hash = g_compute_checksum_for_string (G_CHECKSUM_MD5, uid, -1);
+		result = g_strdup_printf ("%s%s__", folder_prefix, uid_hash);
+		g_free (uid_hash);
+	}
+
+	g_free (folder_prefix);
+	g_free (uid);
+	g_object_unref (folder);
+
+	return result;
+}
+
+gchar *
+modest_bodies_cache_get_id (TnyHeader *header, const gchar *render_options)
+{
+	gchar *prefix, *result;
+
+	g_return_val_if_fail (TNY_IS_HEADER (header), NULL);
+	g_return_val_if_fail (render_options, NULL);
+
+	prefix = bodies_cache_get_msg_prefix (header);
+	if (!prefix)
+		return NULL;
+
+	result = g_strconcat (prefix, render_options, NULL);
+	g_free (prefix);
+
+	return result;
+}
+
+static TnyStream *
+bodies_cache_fetch_rendered (TnyStreamCache *cache, gint64 *expected_size, TnyStream *rendered)
+{
+	off_t size;
+
+	/* NULL means that we only want to check if it's cached */
+	if (!rendered) {
+		*expected_size = 0;
+		return NULL;
+	}
+
+	/* The cache makes room for this size, so it must be the
+	   real one */
+	size = tny_seekable_seek (TNY_SEEKABLE (rendered), 0, SEEK_END);
+	tny_stream_reset (rendered);
+	if (size < 0) {
+		*expected_size = 0;
+		return NULL;
+	}
+	*expected_size = (gint64) size;
+
+	return g_object_ref (rendered);
+}
+
+TnyStream *
+modest_bodies_cache_get_stream (const gchar *cache_id, TnyStream *rendered)
+{
+	TnyStreamCache *cache;
+
+	g_return_val_if_fail (cache_id, NULL);
+	g_return_val_if_fail (rendered == NULL || TNY_IS_SEEKABLE (rendered), NULL);
+
+	cache = modest_runtime_get_bodies_cache ();
+	if (!cache)
+		return NULL;
+
+	return tny_stream_cache_get_stream (cache, cache_id,
+					    (TnyStreamCacheOpenStreamFetcher) bodies_cache_fetch_rendered,
+					    rendered);
+}
+
+static gboolean
+bodies_cache_remove_filter (TnyStreamCache *self, const gchar *id, GHashTable *prefixes)
+{
+	const gchar *tmp;
+
+	if (id == NULL || id[0] == '\0')
+		return FALSE;
+
+	/* The options are always the last component of the id */
+	tmp = g_strrstr (id, "__");
+	if (tmp) {
+		gchar *prefix;
+		gboolean result;
+
+		prefix = g_strndup (id, tmp - id + 2);
+		result = (g_hash_table_lookup (prefixes, prefix) != NULL);
+		g_free (prefix);
+
+		return result;
+	}
+	return FALSE;
+}
+
+void
+modest_bodies_cache_remove_msgs (TnyList *headers)
+{
+	TnyStreamCache *cache;
+	GHashTable *prefixes;
+	TnyIterator *iter;
+
+	g_return_if_fail (TNY_IS_LIST (headers));
+
+	cache = modest_runtime_get_bodies_cache ();
+	if (!cache)
+		return;
+
+	/* Remove all of them with a single pass over the cache */
+	prefixes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	iter = tny_list_create_iterator (headers);
+	while (!tny_iterator_is_done (iter)) {
+		TnyHeader *header;
+		gchar *prefix;
+
+		header = TNY_HEADER (tny_iterator_get_current (iter));
+		prefix = bodies_cache_get_msg_prefix (header);
+		if (prefix)
+			g_hash_table_insert (prefixes, prefix, GINT_TO_POINTER (TRUE));
+		g_object_unref (header);
+		tny_iterator_next (iter);
+	}
+	g_object_unref (iter);
+
+	if (g_hash_table_size (prefixes) > 0)
+		tny_stream_cache_remove (cache, (TnyStreamCacheRemoveFilter) bodies_cache_remove_filter, prefixes);
+	g_hash_table_destroy (prefixes);
+}
+
+static gboolean
+bodies_cache_remove_folder_filter (TnyStreamCache *self, const gchar *id, const gchar *prefix)
+{
+	return (id != NULL && g_str_has_prefix (id, prefix));
+}
+
+void
+modest_bodies_cache_remove_folder (TnyFolder *folder)
+{
+	TnyStreamCache *cache;
+	gchar *prefix;
+
+	g_return_if_fail (TNY_IS_FOLDER (folder));
+
+	cache = modest_runtime_get_bodies_cache ();
+	if (!cache)
+		return;
+
+	prefix = bodies_cache_get_folder_prefix (folder);
+	if (prefix) {
+		tny_stream_cache_remove (cache, (TnyStreamCacheRemoveFilter) bodies_cache_remove_folder_filter, prefix);
+		g_free (prefix);
+	}
+}
+
 gchar *
 modest_utils_get_account_name_from_recipient (const gchar *from_header, gchar **mailbox)
 {
@@ -34,6 +34,8 @@
 #include <gtk/gtk.h>
 #include <stdio.h> /* for FILE* */
 #include <tny-fs-stream.h>
+#include <tny-folder.h>
+#include <tny-header.h>
 #include <modest-protocol.h>
 #include "widgets/modest-validating-entry.h"
 #include <widgets/modest-window.h>
@@ -93,6 +95,28 @@ gboolean modest_utils_file_exists (const gchar *filename);
  */
 TnyFsStream *modest_utils_create_temp_stream (const gchar *orig_name, const gchar *hash_base, gchar **path);
 
+/**
+ * modest_utils_copy_file:
+ * @source: path of the local file to copy
+ * @destination: path of the local file to create or overwrite
+ * @progress_func: function called after each copied chunk, or %NULL
+ * @user_data: data passed to @progress_func
+ *
+ * Copies @source into @destination without going through the mime
+ * part decoders. It uses the kernel to copy the data whenever
+ * possible (sendfile), and falls back to a fixed size buffer
+ * otherwise, so memory usage does not depend on the size of the
+ * file. This function blocks so it should not be used from the
+ * main loop.
+ *
+ * Returns: the number of bytes copied, or -1 in case of error. In
+ * that case errno is set accordingly.
+ */
+gssize modest_utils_copy_file (const gchar *source,
+			       const gchar *destination,
+			       void (*progress_func) (gsize delta, gpointer user_data),
+			       gpointer user_data);
+
 /**
  * modest_utils_get_supported_secure_authentication_methods:
  * @proto: the protocol
@@ -183,6 +207,54 @@ guint64 modest_utils_get_available_space (const gchar *maildir_path);
  */
 gchar *modest_images_cache_get_id (const gchar *account, const gchar *uri);
 
+/**
+ * modest_bodies_cache_get_id:
+ * @header: the #TnyHeader of the message
+ * @render_options: a string identifying the rendering options
+ *
+ * obtains the key of the rendered body of a message in the bodies
+ * cache. It's built from the modest account name, the folder URL,
+ * the UID of the message and the rendering options, so the cached
+ * contents could be removed per account, folder or message
+ *
+ * Returns: a newly allocated string containing the key, or NULL if
+ * the message does not belong to any folder
+ */
+gchar *modest_bodies_cache_get_id (TnyHeader *header, const gchar *render_options);
+
+/**
+ * modest_bodies_cache_get_stream:
+ * @cache_id: the key of a rendered body, see modest_bodies_cache_get_id()
+ * @rendered: a seekable #TnyStream with the rendered body, or %NULL
+ *
+ * obtains a stream to read the rendered body identified by
+ * @cache_id. If it's not in the bodies cache and @rendered is not
+ * %NULL then @rendered is stored in the cache as it's read from the
+ * returned stream. The cache accounts the real length of @rendered
+ *
+ * Returns: a #TnyStream, or %NULL if the body is not cached and
+ * @rendered is %NULL, or if there is no bodies cache
+ */
+TnyStream *modest_bodies_cache_get_stream (const gchar *cache_id, TnyStream *rendered);
+
+/**
+ * modest_bodies_cache_remove_msgs:
+ * @headers: a #TnyList of #TnyHeader
+ *
+ * removes the rendered bodies of the given messages from the bodies
+ * cache. It should be called whenever the messages are expunged
+ */
+void modest_bodies_cache_remove_msgs (TnyList *headers);
+
+/**
+ * modest_bodies_cache_remove_folder:
+ * @folder: a #TnyFolder
+ *
+ * removes the rendered bodies of all the messages of @folder from
+ * the bodies cache
+ */
+void modest_bodies_cache_remove_folder (TnyFolder *folder);
+
 
 /**
  * modest_utils_get_account_name_from_recipient:
@@ -374,7 +374,6 @@ restore_settings_header_view (ModestConf *conf, ModestHeaderView *header_view,
 		GList *cols = NULL;
 		GList *colwidths = NULL;
 		GList *colsortables = NULL;
-		GtkTreeModel *sortable, *filter;
 
 		cursor = data = modest_conf_get_string (conf, key, NULL);
 		while (cursor && sscanf (cursor, "%d:%d:%d ", &col, &width, &sort) == 3) {
@@ -401,8 +400,6 @@ restore_settings_header_view (ModestConf *conf, ModestHeaderView *header_view,
 		if (cols) {
 			GList *viewcolumns, *colcursor, *widthcursor;
 			modest_header_view_set_columns (header_view, cols, type);
-			filter = gtk_tree_view_get_model (GTK_TREE_VIEW (header_view));
-			sortable = gtk_tree_model_filter_get_model (GTK_TREE_MODEL_FILTER (filter));
 
 			widthcursor = colwidths;
 			colcursor = viewcolumns = gtk_tree_view_get_columns (GTK_TREE_VIEW(header_view));
@@ -431,15 +428,14 @@ restore_settings_header_view (ModestConf *conf, ModestHeaderView *header_view,
 	}
 
 	if (sort_colid >= 0) {
-		GtkTreeModel *filter_model = gtk_tree_view_get_model (GTK_TREE_VIEW (header_view));
-		GtkTreeModel *sortable = gtk_tree_model_filter_get_model (GTK_TREE_MODEL_FILTER (filter_model));
+		GtkTreeSortable *sortable = modest_header_view_get_sortable (header_view);
 		if (sort_colid == TNY_GTK_HEADER_LIST_MODEL_FLAGS_COLUMN)
 			modest_header_view_sort_by_column_id (header_view, 0, sort_type);
-		gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (sortable),
+		gtk_tree_sortable_set_sort_column_id (sortable,
 						      sort_colid,
 						      sort_type);
 		modest_header_view_sort_by_column_id (header_view, sort_colid, sort_type);
-		gtk_tree_sortable_sort_column_changed (GTK_TREE_SORTABLE (sortable));
+		gtk_tree_sortable_sort_column_changed (sortable);
 	}
 
 	g_free (key);
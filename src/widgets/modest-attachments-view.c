@@ -334,6 +334,34 @@ modest_attachments_view_add_attachment (ModestAttachmentsView *attachments_view,
 	gtk_widget_queue_resize (GTK_WIDGET (attachments_view));
 }
 
+/* sets the size of an attachment added with detect_size FALSE, once
+   it's known */
+void
+modest_attachments_view_set_attachment_size (ModestAttachmentsView *attachments_view, TnyMimePart *part,
+					     guint64 size)
+{
+	ModestAttachmentsViewPrivate *priv = NULL;
+	GList *box_children = NULL, *node = NULL;
+
+	g_return_if_fail (MODEST_IS_ATTACHMENTS_VIEW (attachments_view));
+	g_return_if_fail (TNY_IS_MIME_PART (part));
+
+	priv = MODEST_ATTACHMENTS_VIEW_GET_PRIVATE (attachments_view);
+	box_children = gtk_container_get_children (GTK_CONTAINER (priv->box));
+
+	for (node = box_children; node != NULL; node = g_list_next (node)) {
+		ModestAttachmentView *att_view = (ModestAttachmentView *) node->data;
+		TnyMimePart *cur_mime_part = tny_mime_part_view_get_part (TNY_MIME_PART_VIEW (att_view));
+
+		g_object_unref (cur_mime_part);
+		if (cur_mime_part == part) {
+			modest_attachment_view_set_size (att_view, size);
+			break;
+		}
+	}
+	g_list_free (box_children);
+}
+
 void
 modest_attachments_view_remove_attachment (ModestAttachmentsView *atts_view, TnyMimePart *mime_part)
 {
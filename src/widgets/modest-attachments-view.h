@@ -76,6 +76,8 @@ GtkWidget* modest_attachments_view_new (TnyMsg *msg);
 void modest_attachments_view_set_message (ModestAttachmentsView *attachments_view, TnyMsg *msg, gboolean want_html);
 void modest_attachments_view_add_attachment (ModestAttachmentsView *attachments_view, TnyMimePart *part,
 					     gboolean detect_size, guint64 size);
+void modest_attachments_view_set_attachment_size (ModestAttachmentsView *attachments_view, TnyMimePart *part,
+						  guint64 size);
 void modest_attachments_view_remove_attachment (ModestAttachmentsView *attachments_view, TnyMimePart *part);
 void modest_attachments_view_remove_attachment_by_id (ModestAttachmentsView *attachments_view, const gchar *att_id);
 TnyList *modest_attachments_view_get_attachments (ModestAttachmentsView *attachments_view);
@@ -38,6 +38,8 @@
 #include <tny-folder-store.h>
 #include <modest-tny-folder.h>
 #include <modest-tny-account.h>
+#include <modest-runtime.h>
+#include <modest-folder-stats-mgr.h>
 #include <modest-text-utils.h>
 #include <modest-datetime-formatter.h>
 #include <string.h> /* for strlen */
@@ -367,6 +369,8 @@ modest_details_dialog_set_folder_default (ModestDetailsDialog *self,
 {
 	gchar *count_s, *size_s, *name = NULL;
 	guint size, count;
+	ModestFolderStatsMgr *stats_mgr;
+	ModestFolderStats stats;
 
 	g_return_if_fail (folder && TNY_IS_FOLDER (folder));
 	g_return_if_fail (modest_tny_folder_guess_folder_type (folder)
@@ -375,9 +379,21 @@ modest_details_dialog_set_folder_default (ModestDetailsDialog *self,
 	/* Set window title */
 	gtk_window_set_title (GTK_WINDOW (self), _("mcen_ti_folder_properties"));
 
-	/* Get data. We use our function because it's recursive */
-	count = tny_folder_get_all_count (TNY_FOLDER (folder));
-	size = tny_folder_get_local_size (TNY_FOLDER (folder));
+	/* Get data. The stats manager already has the totals of the
+	   folder and its subfolders, so we do not have to traverse
+	   them. Refresh the folder itself first, as not all of its
+	   changes are notified */
+	stats_mgr = modest_runtime_get_folder_stats_mgr ();
+	if (stats_mgr)
+		modest_folder_stats_mgr_folder_changed (stats_mgr, folder);
+	if (stats_mgr &&
+	    modest_folder_stats_mgr_get_stats (stats_mgr, TNY_FOLDER_STORE (folder), &stats)) {
+		count = stats.msg_count;
+		size = stats.local_size;
+	} else {
+		count = tny_folder_get_all_count (TNY_FOLDER (folder));
+		size = tny_folder_get_local_size (TNY_FOLDER (folder));
+	}
 
 	/* Format count and size */
 	count_s = g_strdup_printf ("%d", count);
@@ -161,6 +161,17 @@ static void on_activity_changed (TnyGtkFolderListStore *store,
 				 gboolean activity,
 				 ModestFolderView *folder_view);
 
+static void         row_cache_remove (ModestFolderView *self, GObject *instance);
+static void         row_cache_clear (ModestFolderView *self);
+
+static void         folder_index_add (ModestFolderView *self,
+				      GtkTreeModel *tny_model,
+				      GtkTreePath *path,
+				      GtkTreeIter *iter);
+static void         folder_index_rebuild (ModestFolderView *self,
+					  GtkTreeModel *tny_model);
+static void         folder_index_prune (ModestFolderView *self);
+
 enum {
 	FOLDER_SELECTION_CHANGED_SIGNAL,
 	FOLDER_DISPLAY_NAME_CHANGED_SIGNAL,
@@ -221,6 +232,14 @@ struct _ModestFolderViewPrivate {
 	ModestDatetimeFormatter *datetime_formatter;
 
 	gboolean tree_view;
+
+	/* Presentation cache of the rows, see get_row_cache () */
+	GHashTable *row_cache;
+
+	/* "account id/folder id" -> GtkTreeRowReference in the tny
+	   model, see folder_index_key () */
+	GHashTable *folder_index;
+	guint folder_index_prune_idle;
 };
 #define MODEST_FOLDER_VIEW_GET_PRIVATE(o)			\
 	(G_TYPE_INSTANCE_GET_PRIVATE((o),			\
@@ -463,6 +482,8 @@ on_get_mmc_account_name (TnyStoreAccount* account, gpointer user_data)
 		 * it calls the cell_data_func callbacks again: */
 		ModestFolderView *self = data->self;
 		GtkTreeModel *model = gtk_tree_view_get_model (GTK_TREE_VIEW (self));
+
+		row_cache_remove (self, G_OBJECT (account));
 	 	if (model)
 			gtk_tree_model_foreach(model, on_model_foreach_set_name, account);
 	}
@@ -651,34 +672,103 @@ replace_special_folder_prefix (gchar **item_name)
 							         MODEST_FOLDER_DOT);
 }
 
+typedef struct {
+	GdkPixbuf *pixbuf;
+	GdkPixbuf *pixbuf_open;
+	GdkPixbuf *pixbuf_close;
+} ThreePixbufs;
+
+/* The presentation state of a row. Computing it requires some
+   expensive calls (folder type guessing, message counts, string
+   formatting...) so it's computed only once and then reused in every
+   paint until the row changes. Account rows are not fully cached
+   because their weight and last updated string depend on the state
+   of the account manager */
+typedef struct {
+	ModestFolderView *self;
+	GObject       *instance;
+	gchar         *name;
+	gint           weight;
+	gchar         *messages;
+	ThreePixbufs  *icons;
+} FolderRowCache;
+
+static ThreePixbufs* get_folder_icons (ModestFolderView *folder_view,
+				       TnyFolderType type,
+				       GObject *instance);
+static void          free_pixbufs     (ThreePixbufs *pixbufs);
+
 static void
-text_cell_data  (GtkTreeViewColumn *column,
-		 GtkCellRenderer *renderer,
-		 GtkTreeModel *tree_model,
-		 GtkTreeIter *iter,
-		 gpointer data)
+row_cache_free (FolderRowCache *cache)
+{
+	g_free (cache->name);
+	g_free (cache->messages);
+	if (cache->icons)
+		free_pixbufs (cache->icons);
+	g_slice_free (FolderRowCache, cache);
+}
+
+static void
+on_row_instance_finalized (gpointer data, GObject *instance)
 {
 	ModestFolderViewPrivate *priv;
-	GObject *rendobj = (GObject *) renderer;
-	gchar *fname = NULL;
-	TnyFolderType type = TNY_FOLDER_TYPE_UNKNOWN;
-	GObject *instance = NULL;
-	gboolean use_markup = FALSE;
+	FolderRowCache *cache;
 
-	gtk_tree_model_get (tree_model, iter,
-			    NAME_COLUMN, &fname,
-			    TYPE_COLUMN, &type,
-			    INSTANCE_COLUMN, &instance,
-			    -1);
-	if (!fname || !instance)
-		goto end;
+	priv = MODEST_FOLDER_VIEW_GET_PRIVATE (data);
 
-	ModestFolderView *self = MODEST_FOLDER_VIEW (data);
-	priv =	MODEST_FOLDER_VIEW_GET_PRIVATE (self);
+	/* The weak reference is already gone, so steal it instead
+	   of removing it */
+	cache = g_hash_table_lookup (priv->row_cache, instance);
+	if (cache) {
+		g_hash_table_steal (priv->row_cache, instance);
+		row_cache_free (cache);
+	}
+}
+
+static void
+row_cache_destroy (gpointer data)
+{
+	FolderRowCache *cache = (FolderRowCache *) data;
 
+	g_object_weak_unref (cache->instance, on_row_instance_finalized, cache->self);
+	row_cache_free (cache);
+}
+
+static void
+row_cache_remove (ModestFolderView *self, GObject *instance)
+{
+	ModestFolderViewPrivate *priv = MODEST_FOLDER_VIEW_GET_PRIVATE (self);
+
+	if (instance)
+		g_hash_table_remove (priv->row_cache, instance);
+}
+
+static void
+row_cache_clear (ModestFolderView *self)
+{
+	ModestFolderViewPrivate *priv = MODEST_FOLDER_VIEW_GET_PRIVATE (self);
+
+	g_hash_table_remove_all (priv->row_cache);
+}
+
+/* Computes the text, weight and message count string of a row. It
+   takes the ownership of fname. The weight of the account rows is
+   not cached, see account_row_weight */
+static gchar *
+get_row_name (ModestFolderView *self,
+	      gchar *fname,
+	      TnyFolderType type,
+	      GObject *instance,
+	      gint *weight,
+	      gchar **messages)
+{
+	ModestFolderViewPrivate *priv;
+	gboolean use_markup = FALSE;
 	gchar *item_name = NULL;
 	gint item_weight = 400;
 
+	priv =	MODEST_FOLDER_VIEW_GET_PRIVATE (self);
+
 	if (type != TNY_FOLDER_TYPE_ROOT) {
 		gint number = 0;
 		gboolean drafts;
@@ -721,6 +811,10 @@ text_cell_data  (GtkTreeViewColumn *column,
 			item_name = g_strdup (fname);
 			if (number > 0) {
 				item_weight = 800;
+				*messages =
+					g_strdup_printf (ngettext ((drafts) ? "mcen_ti_message" : "mcen_va_new_message",
+								   (drafts) ? "mcen_ti_messages" : "mcen_va_new_messages",
+								   number), number);
 			} else {
 				item_weight = 400;
 			}
@@ -741,19 +835,6 @@ text_cell_data  (GtkTreeViewColumn *column,
 
 	} else if (TNY_IS_ACCOUNT (instance)) {
 		/* If it's a server account */
-		ModestAccountMgr *account_mgr;
-		gchar *account_name;
-
-		item_weight = 400;
-		account_mgr = modest_runtime_get_account_mgr();
-		account_name = modest_account_mgr_get_account_from_tny_account(account_mgr, 
-										      TNY_ACCOUNT(instance));
-		if (account_name) {
-			if (modest_account_mgr_get_has_new_mails (account_mgr, account_name))
-				item_weight = 800;
-			g_free(account_name);
-		}
-
 		if (modest_tny_account_is_virtual_local_folders (TNY_ACCOUNT (instance))) {
 			item_name = g_strdup (priv->local_account_name);
 		} else if (modest_tny_account_is_memory_card_account (TNY_ACCOUNT (instance))) {
@@ -789,38 +870,49 @@ text_cell_data  (GtkTreeViewColumn *column,
 		replace_special_folder_prefix (&item_name);
 	}
 
-	if (item_name && item_weight) {
-		/* Set the name in the treeview cell: */
-		if (priv->cell_style == MODEST_FOLDER_VIEW_CELL_STYLE_COMPACT && item_weight == 800 && 
-		    (priv->active_color.red != 0 || priv->active_color.blue != 0 || priv->active_color.green != 0)) {
-			g_object_set (rendobj, 
-				      "text", item_name, 
-				      "weight-set", FALSE,
-				      "foreground-set", TRUE,
-				      "foreground-gdk", &(priv->active_color),
-				      NULL);
-		} else {
-			g_object_set (rendobj, 
-				      "text", item_name,
-				      "foreground-set", FALSE,
-				      "weight-set", TRUE, 
-				      "weight", item_weight,
-				      NULL);
-		}
+	g_free (fname);
+	*weight = item_weight;
 
-		/* Notify display name observers */
-		/* TODO: What listens for this signal, and how can it use only the new name? */
-		if (((GObject *) priv->cur_folder_store) == instance) {
-			g_signal_emit (G_OBJECT(self),
-					       signals[FOLDER_DISPLAY_NAME_CHANGED_SIGNAL], 0,
-					       item_name);
-		}
-		g_free (item_name);
+	return item_name;
+}
 
-	}
+/* Returns the cached presentation state of the row, computing it if
+   needed. The returned value is owned by the folder view */
+static FolderRowCache *
+get_row_cache (ModestFolderView *self,
+	       GtkTreeModel *tree_model,
+	       GtkTreeIter *iter,
+	       GObject *instance)
+{
+	ModestFolderViewPrivate *priv;
+	FolderRowCache *cache;
+	TnyFolderType type = TNY_FOLDER_TYPE_UNKNOWN;
+	gchar *fname = NULL;
+
+	priv = MODEST_FOLDER_VIEW_GET_PRIVATE (self);
+
+	cache = g_hash_table_lookup (priv->row_cache, instance);
+	if (cache)
+		return cache;
+
+	gtk_tree_model_get (tree_model, iter,
+			    NAME_COLUMN, &fname,
+			    TYPE_COLUMN, &type,
+			    -1);
+
+	cache = g_slice_new0 (FolderRowCache);
+	cache->self = self;
+	cache->instance = instance;
+	cache->icons = get_folder_icons (self, type, instance);
+	if (fname)
+		cache->name = get_row_name (self, fname, type, instance,
+					    &cache->weight, &cache->messages);
+
+	g_hash_table_insert (priv->row_cache, instance, cache);
+	g_object_weak_ref (instance, on_row_instance_finalized, self);
 
 	/* If it is a Memory card account, make sure that we have the correct name.
-	 * This function will be trigerred again when the name has been retrieved: */
+	 * The row will be invalidated again when the name has been retrieved: */
 	if (TNY_IS_STORE_ACCOUNT (instance) &&
 		modest_tny_account_is_memory_card_account (TNY_ACCOUNT (instance))) {
 
@@ -836,11 +928,124 @@ text_cell_data  (GtkTreeViewColumn *column,
 		modest_tny_account_get_mmc_account_name (TNY_STORE_ACCOUNT (instance),
 							 on_get_mmc_account_name, callback_data);
 	}
+
+	return cache;
+}
+
+/* The has_new_mails flag is not notified, so the weight of the
+   account rows is never cached */
+static gint
+account_row_weight (TnyAccount *account)
+{
+	ModestAccountMgr *account_mgr;
+	gchar *account_name;
+	gint weight = 400;
+
+	account_mgr = modest_runtime_get_account_mgr();
+	account_name = modest_account_mgr_get_account_from_tny_account(account_mgr, account);
+	if (account_name) {
+		if (modest_account_mgr_get_has_new_mails (account_mgr, account_name))
+			weight = 800;
+		g_free(account_name);
+	}
+	return weight;
+}
+
+static void
+on_tny_model_row_changed (GtkTreeModel *model,
+			  GtkTreePath *path,
+			  GtkTreeIter *iter,
+			  gpointer user_data)
+{
+	GObject *instance = NULL;
+
+	gtk_tree_model_get (model, iter,
+			    INSTANCE_COLUMN, &instance,
+			    -1);
+	if (instance) {
+		row_cache_remove (MODEST_FOLDER_VIEW (user_data), instance);
+		g_object_unref (instance);
+	}
+
+	/* Rows are usually inserted empty and filled later */
+	folder_index_add (MODEST_FOLDER_VIEW (user_data), model, path, iter);
+}
+
+static void
+on_tny_model_row_inserted (GtkTreeModel *model,
+			   GtkTreePath *path,
+			   GtkTreeIter *iter,
+			   gpointer user_data)
+{
+	folder_index_add (MODEST_FOLDER_VIEW (user_data), model, path, iter);
+}
+
+static void
+on_tny_model_row_deleted (GtkTreeModel *model,
+			  GtkTreePath *path,
+			  gpointer user_data)
+{
+	folder_index_prune (MODEST_FOLDER_VIEW (user_data));
+}
+
+static void
+text_cell_data  (GtkTreeViewColumn *column,
+		 GtkCellRenderer *renderer,
+		 GtkTreeModel *tree_model,
+		 GtkTreeIter *iter,
+		 gpointer data)
+{
+	ModestFolderViewPrivate *priv;
+	GObject *rendobj = (GObject *) renderer;
+	GObject *instance = NULL;
+	FolderRowCache *cache;
+	gint item_weight;
+
+	gtk_tree_model_get (tree_model, iter,
+			    INSTANCE_COLUMN, &instance,
+			    -1);
+	if (!instance)
+		return;
+
+	ModestFolderView *self = MODEST_FOLDER_VIEW (data);
+	priv =	MODEST_FOLDER_VIEW_GET_PRIVATE (self);
+
+	cache = get_row_cache (self, tree_model, iter, instance);
+	if (!cache->name)
+		goto end;
+
+	if (TNY_IS_ACCOUNT (instance))
+		item_weight = account_row_weight (TNY_ACCOUNT (instance));
+	else
+		item_weight = cache->weight;
+
+	/* Set the name in the treeview cell: */
+	if (priv->cell_style == MODEST_FOLDER_VIEW_CELL_STYLE_COMPACT && item_weight == 800 && 
+	    (priv->active_color.red != 0 || priv->active_color.blue != 0 || priv->active_color.green != 0)) {
+		g_object_set (rendobj, 
+			      "text", cache->name, 
+			      "weight-set", FALSE,
+			      "foreground-set", TRUE,
+			      "foreground-gdk", &(priv->active_color),
+			      NULL);
+	} else {
+		g_object_set (rendobj, 
+			      "text", cache->name,
+			      "foreground-set", FALSE,
+			      "weight-set", TRUE, 
+			      "weight", item_weight,
+			      NULL);
+	}
+
+	/* Notify display name observers */
+	/* TODO: What listens for this signal, and how can it use only the new name? */
+	if (((GObject *) priv->cur_folder_store) == instance) {
+		g_signal_emit (G_OBJECT(self),
+			       signals[FOLDER_DISPLAY_NAME_CHANGED_SIGNAL], 0,
+			       cache->name);
+	}
  end:
-	if (instance)
-		g_object_unref (G_OBJECT (instance));
-	if (fname)
-		g_free (fname);
+	g_object_unref (G_OBJECT (instance));
 }
 
 /* Get the string for the last updated time. Result must NOT be g_freed */
@@ -885,22 +1090,17 @@ messages_cell_data  (GtkTreeViewColumn *column,
 		 gpointer data)
 {
 	ModestFolderView *self; 
-	ModestFolderViewPrivate *priv;
 	GObject *rendobj = (GObject *) renderer;
-	TnyFolderType type = TNY_FOLDER_TYPE_UNKNOWN;
 	GObject *instance = NULL;
 	gchar *item_name = NULL;
 
 	gtk_tree_model_get (tree_model, iter,
-			    TYPE_COLUMN, &type,
 			    INSTANCE_COLUMN, &instance,
 			    -1);
 	if (!instance)
 		goto end;
 
 	self = MODEST_FOLDER_VIEW (data);
-	priv =	MODEST_FOLDER_VIEW_GET_PRIVATE (self);
-
 
 	if (TNY_IS_ACCOUNT(instance)) {
 		ModestAccountSettings *settings = NULL;
@@ -914,64 +1114,26 @@ messages_cell_data  (GtkTreeViewColumn *column,
 			g_free(account_name);
 		}
 
-		if (settings)
+		if (settings) {
 			item_name = g_strconcat (_("mcen_ti_lastupdated"), "\n",
 					 	get_last_updated_string(self, account_mgr, settings),
 					 	NULL);
-	}
-
-
-	if (type != TNY_FOLDER_TYPE_ROOT) {
-		gint number = 0;
-		gboolean drafts;
-		gboolean is_local;
-
-		is_local = modest_tny_folder_is_local_folder (TNY_FOLDER (instance)) ||
-			modest_tny_folder_is_memory_card_folder (TNY_FOLDER (instance));
-
-		if (is_local) {
-			type = modest_tny_folder_get_local_or_mmc_folder_type (TNY_FOLDER (instance));
-		} else {
-			/* Sometimes an special folder is reported by the server as
-			   NORMAL, like some versions of Dovecot */
-			if (type == TNY_FOLDER_TYPE_NORMAL ||
-			    type == TNY_FOLDER_TYPE_UNKNOWN) {
-				type = modest_tny_folder_guess_folder_type (TNY_FOLDER (instance));
-			}
-		}
-
-		/* note: we cannot reliably get the counts from the tree model, we need
-		 * to use explicit calls on tny_folder for some reason.
-		 */
-		/* Select the number to show: the unread or unsent messages. in case of outbox/drafts, show all */
-		if (is_local && ((type == TNY_FOLDER_TYPE_DRAFTS) ||
-				 (type == TNY_FOLDER_TYPE_OUTBOX) ||
-				 (type == TNY_FOLDER_TYPE_MERGE))) { /* _OUTBOX actually returns _MERGE... */
-			number = tny_folder_get_all_count (TNY_FOLDER(instance));
-			drafts = TRUE;
-		} else {
-			number = tny_folder_get_unread_count (TNY_FOLDER(instance));
-			drafts = FALSE;
+			g_object_unref (settings);
 		}
+	} else {
+		FolderRowCache *cache;
 
-		if ((priv->cell_style == MODEST_FOLDER_VIEW_CELL_STYLE_COMPACT) && (number > 0)) {
-			item_name =
-				g_strdup_printf (ngettext ((drafts) ? "mcen_ti_message" : "mcen_va_new_message",
-							   (drafts) ? "mcen_ti_messages" : "mcen_va_new_messages",
-							   number), number);
-		}
+		cache = get_row_cache (self, tree_model, iter, instance);
+		if (cache->messages)
+			item_name = g_strdup (cache->messages);
 	}
 
 	if (!item_name)
 		item_name = g_strdup ("");
 
-	if (item_name) {
-		/* Set the name in the treeview cell: */
-		g_object_set (rendobj,"text", item_name, NULL);
-
-		g_free (item_name);
-
-	}
+	/* Set the name in the treeview cell: */
+	g_object_set (rendobj,"text", item_name, NULL);
+	g_free (item_name);
 
  end:
 	if (instance)
@@ -979,13 +1141,6 @@ messages_cell_data  (GtkTreeViewColumn *column,
 }
 
 
-typedef struct {
-	GdkPixbuf *pixbuf;
-	GdkPixbuf *pixbuf_open;
-	GdkPixbuf *pixbuf_close;
-} ThreePixbufs;
-
-
 static inline GdkPixbuf *
 get_composite_pixbuf (const gchar *icon_name,
 		      const gint size,
@@ -1020,6 +1175,7 @@ get_composite_icons (const gchar *icon_code,
 		icon = modest_platform_get_icon (icon_code, FOLDER_ICON_SIZE);
 		if (icon) {
 			*pixbuf = gdk_pixbuf_copy (icon);
+			g_object_unref (icon);
 		} else {
 			*pixbuf = NULL;
 		}
@@ -1276,7 +1432,6 @@ icon_cell_data  (GtkTreeViewColumn *column,
 		 gpointer data)
 {
 	GObject *rendobj = NULL, *instance = NULL;
-	TnyFolderType type = TNY_FOLDER_TYPE_UNKNOWN;
 	gboolean has_children;
 	ThreePixbufs *pixbufs;
 	ModestFolderView *folder_view = (ModestFolderView *) data;
@@ -1284,7 +1439,6 @@ icon_cell_data  (GtkTreeViewColumn *column,
 	rendobj = (GObject *) renderer;
 
 	gtk_tree_model_get (tree_model, iter,
-			    TYPE_COLUMN, &type,
 			    INSTANCE_COLUMN, &instance,
 			    -1);
 
@@ -1292,9 +1446,12 @@ icon_cell_data  (GtkTreeViewColumn *column,
 		return;
 
 	has_children = gtk_tree_model_iter_has_child (tree_model, iter);
-	pixbufs = get_folder_icons (folder_view, type, instance);
+	pixbufs = get_row_cache (folder_view, tree_model, iter, instance)->icons;
 	g_object_unref (instance);
 
+	if (!pixbufs)
+		return;
+
 	/* Set pixbuf */
 	g_object_set (rendobj, "pixbuf", pixbufs->pixbuf, NULL);
 
@@ -1302,8 +1459,6 @@ icon_cell_data  (GtkTreeViewColumn *column,
 		g_object_set (rendobj, "pixbuf-expander-open", pixbufs->pixbuf_open, NULL);
 		g_object_set (rendobj, "pixbuf-expander-closed", pixbufs->pixbuf_close, NULL);
 	}
-
-	free_pixbufs (pixbufs);
 }
 
 static void
@@ -1410,6 +1565,11 @@ modest_folder_view_init (ModestFolderView *obj)
 	priv->show_non_move = TRUE;
 	priv->list_to_move = NULL;
 	priv->show_message_count = TRUE;
+	priv->row_cache = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+						 NULL, row_cache_destroy);
+	priv->folder_index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+						    (GDestroyNotify) gtk_tree_row_reference_free);
+	priv->folder_index_prune_idle = 0;
 
 	/* Build treeview */
 	add_columns (GTK_WIDGET (obj));
@@ -1490,6 +1650,9 @@ modest_folder_view_dispose (GObject *obj)
 		priv->list_to_move = NULL;
 	}
 
+	if (priv->row_cache)
+		g_hash_table_remove_all (priv->row_cache);
+
 	G_OBJECT_CLASS(parent_class)->dispose (obj);
 }
 
@@ -1548,6 +1711,21 @@ modest_folder_view_finalize (GObject *obj)
 	/* Clear hidding array created by cut operation */
 	_clear_hidding_filter (MODEST_FOLDER_VIEW (obj));
 
+	if (priv->row_cache) {
+		g_hash_table_destroy (priv->row_cache);
+		priv->row_cache = NULL;
+	}
+
+	if (priv->folder_index_prune_idle > 0) {
+		g_source_remove (priv->folder_index_prune_idle);
+		priv->folder_index_prune_idle = 0;
+	}
+
+	if (priv->folder_index) {
+		g_hash_table_destroy (priv->folder_index);
+		priv->folder_index = NULL;
+	}
+
 	gdk_color_parse ("000", &priv->active_color);
 
 	G_OBJECT_CLASS(parent_class)->finalize (obj);
@@ -1740,6 +1918,10 @@ on_account_changed (TnyAccountStore *account_store,
 		gtk_tree_selection_unselect_all (sel);
 	}
 
+	/* The account name could have changed, and the folder rows
+	   could show it too */
+	row_cache_clear (self);
+
 	/* Remove the account from the model */
 	tny_list_remove (TNY_LIST (model), G_OBJECT (tny_account));
 
@@ -1965,57 +2147,214 @@ is_parent_of (TnyFolder *a, TnyFolder *b)
 	return retval;
 }
 
-typedef struct _ForeachFolderInfo {
-	gchar *needle;
-	gboolean found;
-} ForeachFolderInfo;
+/* The folder ids are only unique inside an account ("INBOX" is in
+   all of them), so the index is keyed by the account id too. @id
+   replaces the id of @folder if not NULL */
+static gchar *
+folder_index_key (TnyFolder *folder, const gchar *id)
+{
+	TnyAccount *account;
+	gchar *key;
+
+	if (!id)
+		id = tny_folder_get_id (folder);
+	if (!id)
+		return NULL;
 
-static gboolean 
-foreach_folder_with_id (GtkTreeModel *model,
-			GtkTreePath *path,
-			GtkTreeIter *iter,
-			gpointer data)
+	account = modest_tny_folder_get_account (folder);
+	key = g_strconcat (account ? tny_account_get_id (account) : "", "/", id, NULL);
+	if (account)
+		g_object_unref (account);
+
+	return key;
+}
+
+static void
+folder_index_add (ModestFolderView *self,
+		  GtkTreeModel *tny_model,
+		  GtkTreePath *path,
+		  GtkTreeIter *iter)
 {
-	ForeachFolderInfo *info;
-	GObject *instance;
+	ModestFolderViewPrivate *priv;
+	GObject *instance = NULL;
+	gchar *key = NULL;
 
-	info = (ForeachFolderInfo *) data;
-	gtk_tree_model_get (model, iter,
+	priv = MODEST_FOLDER_VIEW_GET_PRIVATE (self);
+
+	gtk_tree_model_get (tny_model, iter,
 			    INSTANCE_COLUMN, &instance,
 			    -1);
+	if (!instance)
+		return;
 
-	if (TNY_IS_FOLDER (instance)) {
-		const gchar *id;
-		gchar *collate;
-		id = tny_folder_get_id (TNY_FOLDER (instance));
-		if (id) {
-			collate = g_utf8_collate_key (id, -1);
-			info->found = !strcmp (info->needle, collate);
-			g_free (collate);
+	if (TNY_IS_FOLDER (instance))
+		key = folder_index_key (TNY_FOLDER (instance), NULL);
+	if (key) {
+		GtkTreeRowReference *ref;
+		gboolean indexed = FALSE;
+
+		/* Row changes are very frequent (counts update), do
+		   not recreate the reference if it did not move */
+		ref = g_hash_table_lookup (priv->folder_index, key);
+		if (ref && gtk_tree_row_reference_valid (ref)) {
+			GtkTreePath *ref_path = gtk_tree_row_reference_get_path (ref);
+			indexed = (gtk_tree_path_compare (ref_path, path) == 0);
+			gtk_tree_path_free (ref_path);
 		}
+		if (!indexed)
+			g_hash_table_replace (priv->folder_index, key,
+					      gtk_tree_row_reference_new (tny_model, path));
+		else
+			g_free (key);
+	}
+	g_object_unref (instance);
+}
+
+static gboolean
+folder_index_foreach_add (GtkTreeModel *model,
+			  GtkTreePath *path,
+			  GtkTreeIter *iter,
+			  gpointer data)
+{
+	folder_index_add (MODEST_FOLDER_VIEW (data), model, path, iter);
+	return FALSE;
+}
+
+static void
+folder_index_rebuild (ModestFolderView *self,
+		      GtkTreeModel *tny_model)
+{
+	ModestFolderViewPrivate *priv;
+
+	priv = MODEST_FOLDER_VIEW_GET_PRIVATE (self);
+
+	g_hash_table_remove_all (priv->folder_index);
+	if (tny_model)
+		gtk_tree_model_foreach (tny_model, folder_index_foreach_add, self);
+}
+
+static gboolean
+folder_index_is_stale (gpointer key, gpointer value, gpointer user_data)
+{
+	return !gtk_tree_row_reference_valid ((GtkTreeRowReference *) value);
+}
+
+static gboolean
+folder_index_prune_idle (gpointer user_data)
+{
+	ModestFolderViewPrivate *priv = MODEST_FOLDER_VIEW_GET_PRIVATE (user_data);
+
+	priv->folder_index_prune_idle = 0;
+	g_hash_table_foreach_remove (priv->folder_index, folder_index_is_stale, NULL);
+
+	return FALSE;
+}
+
+/* Removes the entries of the deleted rows. It's done in an idle
+   because the references are not invalidated yet when the handlers
+   of row-deleted run */
+static void
+folder_index_prune (ModestFolderView *self)
+{
+	ModestFolderViewPrivate *priv = MODEST_FOLDER_VIEW_GET_PRIVATE (self);
+
+	if (priv->folder_index_prune_idle == 0)
+		priv->folder_index_prune_idle = g_idle_add (folder_index_prune_idle, self);
+}
+
+/* Returns the path in the tny model of the folder with the given
+   key (see folder_index_key), and optionally a new reference to the
+   folder. Stale entries (rows deleted or whose folder changed its
+   id) are removed */
+static GtkTreePath *
+folder_index_lookup (ModestFolderView *self,
+		     const gchar *key,
+		     TnyFolder **folder)
+{
+	ModestFolderViewPrivate *priv;
+	GtkTreeRowReference *ref;
+	GtkTreeModel *tny_model;
+	GtkTreePath *path;
+	GtkTreeIter iter;
+	GObject *instance = NULL;
+	gchar *instance_key = NULL;
+
+	priv = MODEST_FOLDER_VIEW_GET_PRIVATE (self);
+
+	ref = g_hash_table_lookup (priv->folder_index, key);
+	if (!ref)
+		return NULL;
+
+	if (!gtk_tree_row_reference_valid (ref)) {
+		g_hash_table_remove (priv->folder_index, key);
+		return NULL;
 	}
 
+	tny_model = gtk_tree_row_reference_get_model (ref);
+	path = gtk_tree_row_reference_get_path (ref);
+	if (gtk_tree_model_get_iter (tny_model, &iter, path))
+		gtk_tree_model_get (tny_model, &iter,
+				    INSTANCE_COLUMN, &instance,
+				    -1);
+
+	if (TNY_IS_FOLDER (instance))
+		instance_key = folder_index_key (TNY_FOLDER (instance), NULL);
+
+	if (g_strcmp0 (instance_key, key)) {
+		g_hash_table_remove (priv->folder_index, key);
+		gtk_tree_path_free (path);
+		path = NULL;
+	} else if (folder) {
+		*folder = TNY_FOLDER (g_object_ref (instance));
+	}
+
+	g_free (instance_key);
 	if (instance)
 		g_object_unref (instance);
 
-	return info->found;
-	
+	return path;
 }
 
+/* Converts a path of the tny model to the filter model of the view,
+   it's NULL if the row is filtered out */
+static GtkTreePath *
+tny_path_to_filter_path (ModestFolderView *self, GtkTreePath *tny_path)
+{
+	GtkTreeModel *filter_model, *sort_model;
+	GtkTreePath *sort_path, *filter_path = NULL;
+
+	if (!get_inner_models (self, &filter_model, &sort_model, NULL))
+		return NULL;
+
+	sort_path = gtk_tree_model_sort_convert_child_path_to_path (GTK_TREE_MODEL_SORT (sort_model),
+								    tny_path);
+	if (sort_path) {
+		filter_path = gtk_tree_model_filter_convert_child_path_to_path (GTK_TREE_MODEL_FILTER (filter_model),
+										sort_path);
+		gtk_tree_path_free (sort_path);
+	}
+
+	return filter_path;
+}
 
+/* Whether the view shows a folder with the given key, see
+   folder_index_key */
 static gboolean
-has_folder_with_id (ModestFolderView *self, const gchar *id)
+has_folder_with_key (ModestFolderView *self, const gchar *key)
 {
-	GtkTreeModel *model;
-	ForeachFolderInfo info = {NULL, FALSE};
+	GtkTreePath *path, *filter_path = NULL;
 
-	model = gtk_tree_view_get_model (GTK_TREE_VIEW (self));
-	info.needle = g_utf8_collate_key (id, -1);
-	
-	gtk_tree_model_foreach (model, foreach_folder_with_id, &info);
-	g_free (info.needle);
+	path = folder_index_lookup (self, key, NULL);
+	if (path) {
+		filter_path = tny_path_to_filter_path (self, path);
+		gtk_tree_path_free (path);
+	}
 
-	return info.found;
+	if (filter_path) {
+		gtk_tree_path_free (filter_path);
+		return TRUE;
+	}
+	return FALSE;
 }
 
 static gboolean
@@ -2031,15 +2370,17 @@ has_child_with_name_of (ModestFolderView *self, TnyFolder *a, TnyFolder *b)
 		
 		if (b_id) {
 			const gchar *last_bar;
-			gchar *string_to_match;
+			gchar *string_to_match, *key;
 			last_bar = g_strrstr (b_id, "/");
 			if (last_bar)
 				last_bar++;
 			else
 				last_bar = b_id;
 			string_to_match = g_strconcat (a_id, "/", last_bar, NULL);
-			retval = has_folder_with_id (self, string_to_match);
+			key = folder_index_key (a, string_to_match);
+			retval = has_folder_with_key (self, key);
 			g_free (string_to_match);
+			g_free (key);
 		}
 	}
 
@@ -2566,10 +2907,20 @@ modest_folder_view_update_model (ModestFolderView *self,
 			priv->signal_handlers = modest_signal_mgr_disconnect (priv->signal_handlers,
 									      G_OBJECT (old_tny_model), 
 									      "activity-changed");
+			priv->signal_handlers = modest_signal_mgr_disconnect (priv->signal_handlers,
+									      G_OBJECT (old_tny_model),
+									      "row-changed");
+			priv->signal_handlers = modest_signal_mgr_disconnect (priv->signal_handlers,
+									      G_OBJECT (old_tny_model),
+									      "row-inserted");
+			priv->signal_handlers = modest_signal_mgr_disconnect (priv->signal_handlers,
+									      G_OBJECT (old_tny_model),
+									      "row-deleted");
 		}
 	}
 
 	/* Set new model */
+	row_cache_clear (self);
 	gtk_tree_view_set_model (GTK_TREE_VIEW(self), filter_model);
 
 	priv->signal_handlers = modest_signal_mgr_connect (priv->signal_handlers,
@@ -2577,6 +2928,22 @@ modest_folder_view_update_model (ModestFolderView *self,
 							   "activity-changed",
 							   G_CALLBACK (on_activity_changed),
 							   self);
+	priv->signal_handlers = modest_signal_mgr_connect (priv->signal_handlers,
+							   G_OBJECT (model),
+							   "row-changed",
+							   G_CALLBACK (on_tny_model_row_changed),
+							   self);
+	priv->signal_handlers = modest_signal_mgr_connect (priv->signal_handlers,
+							   G_OBJECT (model),
+							   "row-inserted",
+							   G_CALLBACK (on_tny_model_row_inserted),
+							   self);
+	priv->signal_handlers = modest_signal_mgr_connect (priv->signal_handlers,
+							   G_OBJECT (model),
+							   "row-deleted",
+							   G_CALLBACK (on_tny_model_row_deleted),
+							   self);
+	folder_index_rebuild (self, model);
 
 	g_object_unref (model);
 	g_object_unref (filter_model);
@@ -3090,6 +3457,7 @@ on_configuration_key_changed (ModestConf* conf,
 		else
 			priv->local_account_name = modest_conf_get_string (modest_runtime_get_conf(),
 									   MODEST_CONF_DEVICE_NAME, NULL);
+		row_cache_clear (self);
 
 		/* Force a redraw */
 #if GTK_CHECK_VERSION(2, 8, 0)
@@ -3118,6 +3486,7 @@ modest_folder_view_set_style (ModestFolderView *self,
 
 
 	priv->style = style;
+	row_cache_clear (self);
 }
 
 void
@@ -3205,6 +3574,40 @@ find_folder_iter (GtkTreeModel *model, GtkTreeIter *iter, GtkTreeIter *folder_it
 	return FALSE;
 }
 
+/* Looks for the folder in the view using the folder index. Returns
+   FALSE if it's not found that way (not indexed, another instance
+   with the same id, or filtered out), in that case the caller must
+   fallback to find_folder_iter */
+static gboolean
+find_folder_iter_fast (ModestFolderView *self, TnyFolder *folder,
+		       GtkTreeIter *folder_iter)
+{
+	GtkTreePath *tny_path, *filter_path = NULL;
+	TnyFolder *indexed = NULL;
+	gboolean found = FALSE;
+	gchar *key;
+
+	key = folder_index_key (folder, NULL);
+	if (!key)
+		return FALSE;
+
+	tny_path = folder_index_lookup (self, key, &indexed);
+	g_free (key);
+	if (!tny_path)
+		return FALSE;
+
+	if (indexed == folder)
+		filter_path = tny_path_to_filter_path (self, tny_path);
+	g_object_unref (indexed);
+	gtk_tree_path_free (tny_path);
+
+	if (filter_path) {
+		found = gtk_tree_model_get_iter (gtk_tree_view_get_model (GTK_TREE_VIEW (self)),
+						 folder_iter, filter_path);
+		gtk_tree_path_free (filter_path);
+	}
+	return found;
+}
 
 void
 modest_folder_view_disable_next_folder_selection (ModestFolderView *self)
@@ -3229,6 +3632,7 @@ modest_folder_view_select_folder (ModestFolderView *self, TnyFolder *folder,
 	GtkTreeIter iter, folder_iter;
 	GtkTreeSelection *sel;
 	ModestFolderViewPrivate *priv = NULL;
+	gboolean found;
 
 	g_return_val_if_fail (self && MODEST_IS_FOLDER_VIEW (self), FALSE);
 	g_return_val_if_fail (folder && TNY_IS_FOLDER (folder), FALSE);
@@ -3258,7 +3662,11 @@ modest_folder_view_select_folder (ModestFolderView *self, TnyFolder *folder,
 		return FALSE;
 	}
 
-	if (find_folder_iter (model, &iter, &folder_iter, folder)) {
+	found = find_folder_iter_fast (self, folder, &folder_iter);
+	if (!found)
+		found = find_folder_iter (model, &iter, &folder_iter, folder);
+
+	if (found) {
 		GtkTreePath *path;
 
 		path = gtk_tree_model_get_path (model, &folder_iter);
@@ -3336,9 +3744,18 @@ modest_folder_view_copy_model (ModestFolderView *folder_view_src,
 
 	/* Get src model*/
 	if (get_inner_models (folder_view_dst, NULL, NULL, &old_tny_model)) {
-		modest_signal_mgr_disconnect (dst_priv->signal_handlers,
-					      G_OBJECT (old_tny_model),
-					      "activity-changed");
+		dst_priv->signal_handlers = modest_signal_mgr_disconnect (dst_priv->signal_handlers,
+									  G_OBJECT (old_tny_model),
+									  "activity-changed");
+		dst_priv->signal_handlers = modest_signal_mgr_disconnect (dst_priv->signal_handlers,
+									  G_OBJECT (old_tny_model),
+									  "row-changed");
+		dst_priv->signal_handlers = modest_signal_mgr_disconnect (dst_priv->signal_handlers,
+									  G_OBJECT (old_tny_model),
+									  "row-inserted");
+		dst_priv->signal_handlers = modest_signal_mgr_disconnect (dst_priv->signal_handlers,
+									  G_OBJECT (old_tny_model),
+									  "row-deleted");
 	}
 	filter_model = gtk_tree_view_get_model (GTK_TREE_VIEW (folder_view_src));
 	model = gtk_tree_model_filter_get_model (GTK_TREE_MODEL_FILTER(filter_model));
@@ -3353,6 +3770,7 @@ modest_folder_view_copy_model (ModestFolderView *folder_view_src,
 
 
 	/* Set copied model */
+	row_cache_clear (folder_view_dst);
 	gtk_tree_view_set_model (GTK_TREE_VIEW (folder_view_dst), new_filter_model);
 	if (new_tny_model) {
 		dst_priv->signal_handlers = modest_signal_mgr_connect (dst_priv->signal_handlers,
@@ -3360,7 +3778,23 @@ modest_folder_view_copy_model (ModestFolderView *folder_view_src,
 								       "activity-changed",
 								       G_CALLBACK (on_activity_changed),
 								       folder_view_dst);
+		dst_priv->signal_handlers = modest_signal_mgr_connect (dst_priv->signal_handlers,
+								       G_OBJECT (new_tny_model),
+								       "row-changed",
+								       G_CALLBACK (on_tny_model_row_changed),
+								       folder_view_dst);
+		dst_priv->signal_handlers = modest_signal_mgr_connect (dst_priv->signal_handlers,
+								       G_OBJECT (new_tny_model),
+								       "row-inserted",
+								       G_CALLBACK (on_tny_model_row_inserted),
+								       folder_view_dst);
+		dst_priv->signal_handlers = modest_signal_mgr_connect (dst_priv->signal_handlers,
+								       G_OBJECT (new_tny_model),
+								       "row-deleted",
+								       G_CALLBACK (on_tny_model_row_deleted),
+								       folder_view_dst);
 	}
+	folder_index_rebuild (folder_view_dst, new_tny_model);
 
 	/* Free */
 	g_object_unref (new_filter_model);
@@ -3397,6 +3831,7 @@ modest_folder_view_show_message_count (ModestFolderView *folder_view,
 
 	priv = MODEST_FOLDER_VIEW_GET_PRIVATE(folder_view);
 	priv->show_message_count = show;
+	row_cache_clear (folder_view);
 
 	g_object_set (G_OBJECT (priv->messages_renderer),
 		      "visible", (priv->cell_style == MODEST_FOLDER_VIEW_CELL_STYLE_COMPACT && priv->show_message_count),
@@ -3456,6 +3891,7 @@ on_display_name_changed (ModestAccountMgr *mgr,
 	ModestFolderView *self;
 
 	self = MODEST_FOLDER_VIEW (user_data);
+	row_cache_clear (self);
 
 	/* Force a redraw */
 #if GTK_CHECK_VERSION(2, 8, 0)
@@ -3479,6 +3915,7 @@ modest_folder_view_set_cell_style (ModestFolderView *self,
 	priv = MODEST_FOLDER_VIEW_GET_PRIVATE (self);
 
 	priv->cell_style = cell_style;
+	row_cache_clear (self);
 
 	g_object_set (G_OBJECT (priv->messages_renderer),
 		      "visible", (cell_style == MODEST_FOLDER_VIEW_CELL_STYLE_COMPACT && priv->show_message_count),
@@ -3659,6 +4096,7 @@ modest_folder_view_set_mailbox (ModestFolderView *self, const gchar *mailbox)
 		g_free (priv->mailbox);
 
 	priv->mailbox = g_strdup (mailbox);
+	row_cache_clear (self);
 
 	/* Notify observers */
 	g_signal_emit (G_OBJECT(self),
@@ -34,6 +34,7 @@
 #include <gtkhtml/gtkhtml-search.h>
 #include <tny-stream.h>
 #include <tny-mime-part-view.h>
+#include <tny-camel-mem-stream.h>
 #include "modest-tny-mime-part.h"
 #include <modest-stream-text-to-html.h>
 #include <modest-text-utils.h>
@@ -45,6 +46,19 @@
 #include <libgnomevfs/gnome-vfs.h>
 #include <gdk/gdkkeysyms.h>
 #include <modest-ui-constants.h>
+#include <modest-trace.h>
+#include <modest-utils.h>
+
+/* Limits of the rendered contents */
+#define MAX_RENDERED_SIZE (128*1024)
+#define TEXT_LINKIFY_LIMIT (64*1024)
+#define TEXT_FULL_LIMIT (128*1024)
+#define TEXT_LINE_LIMIT 1024
+
+/* Identifies the rendering options of the text parts in the bodies
+   cache. Update it whenever the limits above or the text to html
+   conversion change, so the old contents are not used anymore */
+#define TEXT_RENDER_OPTIONS "text_64k_128k_1024"
 
 /* gobject structure methods */
 static void    modest_gtkhtml_mime_part_view_class_init (ModestGtkhtmlMimePartViewClass *klass);
@@ -125,6 +139,13 @@ struct _ModestGtkhtmlMimePartViewPrivate {
 	gboolean view_images;
 	gboolean has_external_images;
 	GSList *sighandlers;
+
+	/* The part being rendered, not ref'd, it's only used to
+	   discard the callbacks of the parts already replaced */
+	TnyMimePart *rendering_part;
+	ModestTraceSpan *render_span;
+
+	TnyHeader *cache_header;
 };
 
 #define MODEST_GTKHTML_MIME_PART_VIEW_GET_PRIVATE(o)      (G_TYPE_INSTANCE_GET_PRIVATE((o), \
@@ -328,6 +349,9 @@ modest_gtkhtml_mime_part_view_init (ModestGtkhtmlMimePartView *self)
 	priv->part = NULL;
 	priv->current_zoom = 1.0;
 	priv->view_images = FALSE;
+	priv->rendering_part = NULL;
+	priv->render_span = NULL;
+	priv->cache_header = NULL;
 	priv->has_external_images = FALSE;
 }
 
@@ -338,6 +362,7 @@ modest_gtkhtml_mime_part_view_finalize (GObject *obj)
 
 	modest_signal_mgr_disconnect_all_and_destroy (priv->sighandlers);
 	priv->sighandlers = NULL;
+	modest_trace_cancel (priv->render_span);
 
 	G_OBJECT_CLASS (parent_class)->finalize (obj);
 }
@@ -354,6 +379,11 @@ modest_gtkhtml_mime_part_view_dispose (GObject *obj)
 		priv->part = NULL;
 	}
 
+	if (priv->cache_header) {
+		g_object_unref (priv->cache_header);
+		priv->cache_header = NULL;
+	}
+
 	G_OBJECT_CLASS (parent_class)->dispose (obj);
 }
 
@@ -450,6 +480,24 @@ on_url_requested (GtkWidget *widget, const gchar *uri, GtkHTMLStream *stream,
 }
 
 /* INTERNAL API */
+
+/* Called when the contents of @part were completely written to the
+   widget. The spans of the parts replaced in the meantime were
+   already cancelled by set_part */
+static void
+part_decoded (ModestGtkhtmlMimePartView *self, TnyMimePart *part)
+{
+	ModestGtkhtmlMimePartViewPrivate *priv = MODEST_GTKHTML_MIME_PART_VIEW_GET_PRIVATE (self);
+
+	if (part != priv->rendering_part)
+		return;
+
+	priv->rendering_part = NULL;
+	modest_trace_end (priv->render_span);
+	priv->render_span = NULL;
+	g_signal_emit_by_name (self, "rendered");
+}
+
 static void
 decode_to_stream_cb (TnyMimePart *self,
 		     gboolean cancelled,
@@ -473,6 +521,97 @@ decode_to_stream_cb (TnyMimePart *self,
 		}
 	}
 	tny_stream_close (stream);
+	part_decoded (view, self);
+}
+
+typedef struct {
+	ModestGtkhtmlMimePartView *view;
+	TnyStream *mem_stream;
+	TnyStream *out_stream;
+	gchar *cache_id;
+} RenderToCacheHelper;
+
+static void
+write_rendered_body (ModestGtkhtmlMimePartView *self, TnyMimePart *part,
+		     TnyStream *input, TnyStream *output)
+{
+	char buffer[4096];
+
+	while (!tny_stream_is_eos (input)) {
+		gssize nb_read;
+
+		nb_read = tny_stream_read (input, buffer, sizeof (buffer));
+		if (nb_read < 0)
+			break;
+		if (nb_read > 0 && tny_stream_write (output, buffer, nb_read) < 0)
+			break;
+	}
+
+	if (modest_tny_stream_gtkhtml_limit_reached (MODEST_TNY_STREAM_GTKHTML (output))) {
+		g_signal_emit (G_OBJECT (self), signals[LIMIT_ERROR_SIGNAL], 0);
+	}
+	tny_stream_close (output);
+	part_decoded (self, part);
+}
+
+static void
+decode_to_cache_cb (TnyMimePart *part,
+		    gboolean cancelled,
+		    TnyStream *stream,
+		    GError *err,
+		    gpointer user_data)
+{
+	RenderToCacheHelper *helper = (RenderToCacheHelper *) user_data;
+	TnyStream *cache_stream = NULL;
+	gboolean limit_reached;
+
+	if (tny_stream_write (stream, "\n", 1) == -1) {
+		g_warning ("failed to write CR in %s", __FUNCTION__);
+	}
+	limit_reached = modest_stream_text_to_html_limit_reached (MODEST_STREAM_TEXT_TO_HTML (stream));
+	if (limit_reached) {
+		g_signal_emit (G_OBJECT (helper->view), signals[LIMIT_ERROR_SIGNAL], 0);
+	}
+
+	/* This flushes the html to the memory stream */
+	tny_stream_close (stream);
+	tny_stream_reset (helper->mem_stream);
+
+	/* Do not cache incomplete contents, we would not be able to
+	   notify about the limits when showing them again */
+	if (!cancelled && !err && !limit_reached)
+		cache_stream = modest_bodies_cache_get_stream (helper->cache_id, helper->mem_stream);
+
+	/* Reading it from the cache stream is what stores it in the cache */
+	if (cache_stream) {
+		write_rendered_body (helper->view, part, cache_stream, helper->out_stream);
+		tny_stream_close (cache_stream);
+		g_object_unref (cache_stream);
+	} else {
+		write_rendered_body (helper->view, part, helper->mem_stream, helper->out_stream);
+	}
+
+	g_object_unref (helper->mem_stream);
+	g_object_unref (helper->out_stream);
+	g_object_unref (helper->view);
+	g_free (helper->cache_id);
+	g_slice_free (RenderToCacheHelper, helper);
+}
+
+static TnyStream *
+create_text_to_html_stream (TnyStream *out_stream)
+{
+	TnyStream *text_to_html_stream;
+
+	text_to_html_stream = TNY_STREAM (modest_stream_text_to_html_new (out_stream));
+	modest_stream_text_to_html_set_linkify_limit (MODEST_STREAM_TEXT_TO_HTML (text_to_html_stream),
+						      TEXT_LINKIFY_LIMIT);
+	modest_stream_text_to_html_set_full_limit (MODEST_STREAM_TEXT_TO_HTML (text_to_html_stream),
+						   TEXT_FULL_LIMIT);
+	modest_stream_text_to_html_set_line_limit (MODEST_STREAM_TEXT_TO_HTML (text_to_html_stream),
+						   TEXT_LINE_LIMIT);
+
+	return text_to_html_stream;
 }
 
 static void
@@ -492,7 +631,7 @@ set_html_part (ModestGtkhtmlMimePartView *self, TnyMimePart *part, const gchar *
 	g_free (content_type);
 
 	tny_stream     = TNY_STREAM(modest_tny_stream_gtkhtml_new (gtkhtml_stream, GTK_HTML (self)));
-	modest_tny_stream_gtkhtml_set_max_size (MODEST_TNY_STREAM_GTKHTML (tny_stream), 128*1024);
+	modest_tny_stream_gtkhtml_set_max_size (MODEST_TNY_STREAM_GTKHTML (tny_stream), MAX_RENDERED_SIZE);
 	tny_stream_reset (tny_stream);
 
 	tny_mime_part_decode_to_stream_async (TNY_MIME_PART (part),
@@ -504,25 +643,57 @@ set_html_part (ModestGtkhtmlMimePartView *self, TnyMimePart *part, const gchar *
 static void
 set_text_part (ModestGtkhtmlMimePartView *self, TnyMimePart *part)
 {
+	ModestGtkhtmlMimePartViewPrivate *priv;
 	TnyStream* text_to_html_stream, *tny_stream;
 	GtkHTMLStream *gtkhtml_stream;
+	gchar *cache_id = NULL;
 
 	g_return_if_fail (self);
 	g_return_if_fail (part);
 
+	priv = MODEST_GTKHTML_MIME_PART_VIEW_GET_PRIVATE (self);
+
 	g_signal_emit (G_OBJECT (self), signals[STOP_STREAMS_SIGNAL], 0);
 
 	gtkhtml_stream = gtk_html_begin(GTK_HTML(self));
 	tny_stream =  TNY_STREAM(modest_tny_stream_gtkhtml_new (gtkhtml_stream, GTK_HTML (self)));
-	modest_tny_stream_gtkhtml_set_max_size (MODEST_TNY_STREAM_GTKHTML (tny_stream), 128*1024);
-	text_to_html_stream = TNY_STREAM (modest_stream_text_to_html_new (tny_stream));
-	modest_stream_text_to_html_set_linkify_limit (MODEST_STREAM_TEXT_TO_HTML (text_to_html_stream),
-						      64*1024);
-	modest_stream_text_to_html_set_full_limit (MODEST_STREAM_TEXT_TO_HTML (text_to_html_stream),
-						   128*1024);
-	modest_stream_text_to_html_set_line_limit (MODEST_STREAM_TEXT_TO_HTML (text_to_html_stream),
-						   1024);
+	modest_tny_stream_gtkhtml_set_max_size (MODEST_TNY_STREAM_GTKHTML (tny_stream), MAX_RENDERED_SIZE);
+
+	if (priv->cache_header && modest_runtime_get_bodies_cache ())
+		cache_id = modest_bodies_cache_get_id (priv->cache_header, TEXT_RENDER_OPTIONS);
+
+	if (cache_id) {
+		TnyStream *cache_stream;
 
+		/* If it was already rendered we do not need to decode it again */
+		cache_stream = modest_bodies_cache_get_stream (cache_id, NULL);
+		if (cache_stream) {
+			write_rendered_body (self, part, cache_stream, tny_stream);
+			tny_stream_close (cache_stream);
+			g_object_unref (cache_stream);
+			g_free (cache_id);
+		} else {
+			RenderToCacheHelper *helper;
+
+			/* Render it to memory, it'll be stored in
+			   the cache and shown when finished */
+			helper = g_slice_new0 (RenderToCacheHelper);
+			helper->view = g_object_ref (self);
+			helper->mem_stream = TNY_STREAM (tny_camel_mem_stream_new ());
+			helper->out_stream = g_object_ref (tny_stream);
+			helper->cache_id = cache_id;
+
+			text_to_html_stream = create_text_to_html_stream (helper->mem_stream);
+			tny_mime_part_decode_to_stream_async (TNY_MIME_PART (part),
+							      text_to_html_stream, decode_to_cache_cb,
+							      NULL, helper);
+			g_object_unref (G_OBJECT(text_to_html_stream));
+		}
+		g_object_unref (G_OBJECT(tny_stream));
+		return;
+	}
+
+	text_to_html_stream = create_text_to_html_stream (tny_stream);
 	tny_mime_part_decode_to_stream_async (TNY_MIME_PART (part),
 					      text_to_html_stream, decode_to_stream_cb,
 					      NULL, self);
@@ -561,11 +732,18 @@ set_part (ModestGtkhtmlMimePartView *self, TnyMimePart *part)
 		priv->part = part;
 	}
 	
+	/* The former one was not finished, it was replaced */
+	modest_trace_cancel (priv->render_span);
+	priv->render_span = NULL;
+	priv->rendering_part = part;
+
 	if (!part) {
 		set_empty_part (self);
 		return;
 	}
 
+	priv->render_span = modest_trace_begin ("gtkhtml-view:render", tny_mime_part_get_content_type (part));
+
 	header_content_type = modest_tny_mime_part_get_header_value (part, "Content-Type");
 	if (header_content_type) {
 		header_content_type = g_strstrip (header_content_type);
@@ -974,3 +1152,21 @@ modest_gtkhtml_mime_part_view_get_selection_area_default (ModestISearchView *sel
 {
 	return get_selection_area (MODEST_GTKHTML_MIME_PART_VIEW (self), x, y, width, height);
 }
+
+void
+modest_gtkhtml_mime_part_view_set_cache_header (ModestGtkhtmlMimePartView *self,
+						TnyHeader *header)
+{
+	ModestGtkhtmlMimePartViewPrivate *priv;
+
+	g_return_if_fail (MODEST_IS_GTKHTML_MIME_PART_VIEW (self));
+	g_return_if_fail (header == NULL || TNY_IS_HEADER (header));
+
+	priv = MODEST_GTKHTML_MIME_PART_VIEW_GET_PRIVATE (self);
+
+	if (header != priv->cache_header) {
+		if (priv->cache_header)
+			g_object_unref (priv->cache_header);
+		priv->cache_header = (header) ? g_object_ref (header) : NULL;
+	}
+}
@@ -35,6 +35,7 @@
 #include <glib-object.h>
 #include <gtkhtml/gtkhtml.h>
 #include <tny-mime-part-view.h>
+#include <tny-header.h>
 #include <widgets/modest-mime-part-view.h>
 #include <widgets/modest-zoomable.h>
 #include <widgets/modest-isearch-view.h>
@@ -105,6 +106,19 @@ GType        modest_gtkhtml_mime_part_view_get_type    (void) G_GNUC_CONST;
  */
 GtkWidget   *modest_gtkhtml_mime_part_view_new (void);
 
+/**
+ * modest_gtkhtml_mime_part_view_set_cache_header:
+ * @self: a #ModestGtkhtmlMimePartView
+ * @header: the #TnyHeader of the message whose body is shown, or %NULL
+ *
+ * sets the message the parts shown afterwards belong to. The text
+ * parts are rendered only once, and then read from the bodies cache
+ * using the folder and the UID of @header as key. Set it to %NULL
+ * for parts that are not the body of the message.
+ */
+void         modest_gtkhtml_mime_part_view_set_cache_header (ModestGtkhtmlMimePartView *self,
+							     TnyHeader *header);
+
 G_END_DECLS
 
 #endif /* __MODEST_GTK_HTML_MIME_PART_VIEW_H__ */
@@ -54,6 +54,7 @@
 #include <modest-icon-names.h>
 #include <tny-camel-bs-mime-part.h>
 #include <modest-runtime.h>
+#include <modest-trace.h>
 
 /* 'private'/'protected' functions */
 static void     modest_gtkhtml_msg_view_class_init   (ModestGtkhtmlMsgViewClass *klass);
@@ -81,6 +82,7 @@ static gboolean on_fetch_url (GtkWidget *widget, const gchar *uri, TnyStream *st
 			      ModestGtkhtmlMsgView *msg_view);
 static gboolean on_link_hover (GtkWidget *widget, const gchar *uri, ModestGtkhtmlMsgView *msg_view);
 static void on_limit_error (GtkWidget *widget, ModestGtkhtmlMsgView *msg_view);
+static void on_body_rendered (GtkWidget *widget, ModestGtkhtmlMsgView *msg_view);
 
 #ifdef MAEMO_CHANGES
 static void     on_tap_and_hold (GtkWidget *widget, gpointer userdata); 
@@ -283,6 +285,8 @@ struct _ModestGtkhtmlMsgViewPrivate {
 	gchar *last_url;
 
 	gboolean has_blocked_bs_images;
+	/* from set_msg until the body is rendered */
+	ModestTraceSpan *open_span;
 };
 
 #define MODEST_GTKHTML_MSG_VIEW_GET_PRIVATE(o)      (G_TYPE_INSTANCE_GET_PRIVATE((o), \
@@ -1182,6 +1186,7 @@ modest_gtkhtml_msg_view_init (ModestGtkhtmlMsgView *obj)
 	gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (priv->html_scroll), GTK_POLICY_NEVER, GTK_POLICY_NEVER);
 
 	priv->msg                     = NULL;
+	priv->open_span               = NULL;
 
 	priv->body_view                 = GTK_WIDGET (g_object_new (MODEST_TYPE_GTKHTML_MIME_PART_VIEW, NULL));
 	priv->mail_header_view        = GTK_WIDGET (modest_compact_mail_header_view_new ());
@@ -1203,6 +1208,8 @@ modest_gtkhtml_msg_view_init (ModestGtkhtmlMsgView *obj)
 				       G_CALLBACK(on_link_hover), obj);
 	g_signal_connect (G_OBJECT(priv->body_view), "limit_error",
 			  G_CALLBACK(on_limit_error), obj);
+	g_signal_connect (G_OBJECT(priv->body_view), "rendered",
+			  G_CALLBACK(on_body_rendered), obj);
 #ifdef MAEMO_CHANGES
 	g_signal_connect (G_OBJECT(priv->body_view), "motion-notify-event",
 			  G_CALLBACK (motion_notify_event), obj);
@@ -1316,6 +1323,9 @@ modest_gtkhtml_msg_view_finalize (GObject *obj)
 		priv->msg = NULL;
 	}
 
+	modest_trace_cancel (priv->open_span);
+	priv->open_span = NULL;
+
 	if (priv->idle_resize_children_id > 0) {
 		g_source_remove (priv->idle_resize_children_id);
 		priv->idle_resize_children_id = 0;
@@ -1675,6 +1685,17 @@ on_limit_error (GtkWidget *widget, ModestGtkhtmlMsgView *msg_view)
 	g_signal_emit_by_name (G_OBJECT (msg_view), "limit-error");
 }
 
+static void
+on_body_rendered (GtkWidget *widget, ModestGtkhtmlMsgView *msg_view)
+{
+	ModestGtkhtmlMsgViewPrivate *priv = MODEST_GTKHTML_MSG_VIEW_GET_PRIVATE (msg_view);
+
+	modest_trace_end (priv->open_span);
+	priv->open_span = NULL;
+
+	g_signal_emit_by_name (G_OBJECT (msg_view), "rendered");
+}
+
 static gboolean
 part_cids_equal (const gchar *part_cid1,
 		 const gchar *part_cid2)
@@ -1848,6 +1869,10 @@ set_message (ModestGtkhtmlMsgView *self, TnyMsg *msg, TnyMimePart *other_body)
 		priv->msg = msg;
 	}
 
+	/* The former message was replaced before being rendered */
+	modest_trace_cancel (priv->open_span);
+	priv->open_span = NULL;
+
 	if (!msg) {
 		tny_header_view_clear (TNY_HEADER_VIEW (priv->mail_header_view));
 		modest_attachments_view_set_message (MODEST_ATTACHMENTS_VIEW (priv->attachments_view), NULL, TRUE);
@@ -1860,6 +1885,7 @@ set_message (ModestGtkhtmlMsgView *self, TnyMsg *msg, TnyMimePart *other_body)
 		gtk_widget_hide (priv->calendar_actions_container);
 		gtk_widget_hide_all (priv->calendar_actions_container);
 		gtk_widget_set_no_show_all (priv->mail_header_view, TRUE);
+		modest_gtkhtml_mime_part_view_set_cache_header (MODEST_GTKHTML_MIME_PART_VIEW (priv->body_view), NULL);
 		tny_mime_part_view_clear (TNY_MIME_PART_VIEW (priv->body_view));
 
 		html_vadj = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (priv->html_scroll));
@@ -1883,8 +1909,13 @@ set_message (ModestGtkhtmlMsgView *self, TnyMsg *msg, TnyMimePart *other_body)
 		return;
 	}
 
+	priv->open_span = modest_trace_begin ("msg-view:open", NULL);
+
 	header = tny_msg_get_header (msg);
 	tny_header_view_set_header (TNY_HEADER_VIEW (priv->mail_header_view), header);
+	/* Only the main body of the message is cached */
+	modest_gtkhtml_mime_part_view_set_cache_header (MODEST_GTKHTML_MIME_PART_VIEW (priv->body_view),
+							other_body ? NULL : header);
 	g_object_unref (header);
 
 	modest_attachments_view_set_message (MODEST_ATTACHMENTS_VIEW (priv->attachments_view),
@@ -1929,6 +1960,8 @@ set_message (ModestGtkhtmlMsgView *self, TnyMsg *msg, TnyMimePart *other_body)
 
 	} else {
 		tny_mime_part_view_clear (TNY_MIME_PART_VIEW (priv->body_view));
+		/* Nothing else to render */
+		on_body_rendered (priv->body_view, self);
 	}
 
 	/* Refresh priority */
@@ -0,0 +1,1118 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include "modest-header-index-model.h"
+
+/* 'private'/'protected' functions */
+static void modest_header_index_model_class_init (ModestHeaderIndexModelClass *klass);
+static void modest_header_index_model_init       (ModestHeaderIndexModel *obj);
+static void modest_header_index_model_finalize   (GObject *obj);
+
+static void gtk_tree_model_init    (GtkTreeModelIface *iface);
+static void gtk_tree_sortable_init (GtkTreeSortableIface *iface);
+
+/* The state of every child row */
+enum {
+	ROW_HIDDEN = 0,
+	ROW_SHOWN,
+	ROW_PENDING   /* inserted in the child model but not merged yet */
+};
+
+/* The position of a child row that is not shown */
+#define NOT_SHOWN G_MAXUINT
+
+typedef struct {
+	gint sort_column_id;
+	GtkTreeIterCompareFunc func;
+	gpointer data;
+	GDestroyNotify destroy;
+} SortFunc;
+
+typedef struct _ModestHeaderIndexModelPrivate ModestHeaderIndexModelPrivate;
+struct _ModestHeaderIndexModelPrivate {
+	GtkTreeModel *child_model;
+	gulong        row_inserted_handler;
+	gulong        row_deleted_handler;
+	gulong        row_changed_handler;
+
+	/* The shown child rows, sorted. The iters are positions in
+	   this array */
+	GArray       *rows;         /* guint */
+	/* The reverse map of rows: the position of every child row,
+	   or NOT_SHOWN */
+	GArray       *positions;    /* guint, one per child row */
+	GArray       *child_state;  /* guint8, one per child row */
+	guint         n_pending;
+	guint         merge_idle;
+	gint          stamp;
+
+	GtkTreeModelFilterVisibleFunc visible_func;
+	gpointer      visible_data;
+	GDestroyNotify visible_destroy;
+
+	gint          sort_column_id;
+	GtkSortType   order;
+	GSList       *sort_funcs;   /* SortFunc */
+	SortFunc      default_sort;
+};
+#define MODEST_HEADER_INDEX_MODEL_GET_PRIVATE(o)      (G_TYPE_INSTANCE_GET_PRIVATE((o), \
+                                                       MODEST_TYPE_HEADER_INDEX_MODEL, \
+                                                       ModestHeaderIndexModelPrivate))
+
+#define ROW_AT(priv,pos)   g_array_index ((priv)->rows, guint, (pos))
+#define STATE_OF(priv,row) g_array_index ((priv)->child_state, guint8, (row))
+#define POSITION_OF(priv,row) g_array_index ((priv)->positions, guint, (row))
+
+/* globals */
+static GObjectClass *parent_class = NULL;
+
+GType
+modest_header_index_model_get_type (void)
+{
+	static GType my_type = 0;
+	if (!my_type) {
+		static const GTypeInfo my_info = {
+			sizeof(ModestHeaderIndexModelClass),
+			NULL,		/* base init */
+			NULL,		/* base finalize */
+			(GClassInitFunc) modest_header_index_model_class_init,
+			NULL,		/* class finalize */
+			NULL,		/* class data */
+			sizeof(ModestHeaderIndexModel),
+			0,		/* n_preallocs */
+			(GInstanceInitFunc) modest_header_index_model_init,
+			NULL
+		};
+		static const GInterfaceInfo gtk_tree_model_info = {
+			(GInterfaceInitFunc) gtk_tree_model_init, /* interface_init */
+			NULL,         /* interface_finalize */
+			NULL          /* interface_data */
+		};
+		static const GInterfaceInfo gtk_tree_sortable_info = {
+			(GInterfaceInitFunc) gtk_tree_sortable_init, /* interface_init */
+			NULL,         /* interface_finalize */
+			NULL          /* interface_data */
+		};
+
+		my_type = g_type_register_static (G_TYPE_OBJECT,
+		                                  "ModestHeaderIndexModel",
+		                                  &my_info, 0);
+
+		g_type_add_interface_static (my_type, GTK_TYPE_TREE_MODEL,
+					     &gtk_tree_model_info);
+		g_type_add_interface_static (my_type, GTK_TYPE_TREE_SORTABLE,
+					     &gtk_tree_sortable_info);
+	}
+	return my_type;
+}
+
+static void
+modest_header_index_model_class_init (ModestHeaderIndexModelClass *klass)
+{
+	GObjectClass *gobject_class;
+	gobject_class = (GObjectClass*) klass;
+
+	parent_class            = g_type_class_peek_parent (klass);
+	gobject_class->finalize = modest_header_index_model_finalize;
+
+	g_type_class_add_private (gobject_class, sizeof(ModestHeaderIndexModelPrivate));
+}
+
+static void
+modest_header_index_model_init (ModestHeaderIndexModel *obj)
+{
+	ModestHeaderIndexModelPrivate *priv;
+
+	priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE(obj);
+
+	priv->child_model = NULL;
+	priv->row_inserted_handler = 0;
+	priv->row_deleted_handler = 0;
+	priv->row_changed_handler = 0;
+	priv->rows = g_array_new (FALSE, FALSE, sizeof (guint));
+	priv->positions = g_array_new (FALSE, FALSE, sizeof (guint));
+	priv->child_state = g_array_new (FALSE, FALSE, sizeof (guint8));
+	priv->n_pending = 0;
+	priv->merge_idle = 0;
+	priv->stamp = g_random_int ();
+	priv->visible_func = NULL;
+	priv->visible_data = NULL;
+	priv->visible_destroy = NULL;
+	priv->sort_column_id = GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID;
+	priv->order = GTK_SORT_ASCENDING;
+	priv->sort_funcs = NULL;
+	memset (&priv->default_sort, 0, sizeof (SortFunc));
+}
+
+static void
+sort_func_free (SortFunc *sort_func)
+{
+	if (sort_func->destroy)
+		sort_func->destroy (sort_func->data);
+	g_slice_free (SortFunc, sort_func);
+}
+
+static void
+modest_header_index_model_finalize (GObject *obj)
+{
+	ModestHeaderIndexModelPrivate *priv;
+
+	priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE(obj);
+
+	if (priv->merge_idle > 0) {
+		g_source_remove (priv->merge_idle);
+		priv->merge_idle = 0;
+	}
+
+	if (priv->child_model) {
+		g_signal_handler_disconnect (priv->child_model, priv->row_inserted_handler);
+		g_signal_handler_disconnect (priv->child_model, priv->row_deleted_handler);
+		g_signal_handler_disconnect (priv->child_model, priv->row_changed_handler);
+		g_object_unref (priv->child_model);
+		priv->child_model = NULL;
+	}
+
+	if (priv->visible_destroy)
+		priv->visible_destroy (priv->visible_data);
+	if (priv->default_sort.destroy)
+		priv->default_sort.destroy (priv->default_sort.data);
+	g_slist_foreach (priv->sort_funcs, (GFunc) sort_func_free, NULL);
+	g_slist_free (priv->sort_funcs);
+
+	g_array_free (priv->rows, TRUE);
+	g_array_free (priv->positions, TRUE);
+	g_array_free (priv->child_state, TRUE);
+
+	G_OBJECT_CLASS(parent_class)->finalize (obj);
+}
+
+/* Sorting */
+
+static SortFunc *
+get_sort_func (ModestHeaderIndexModelPrivate *priv, gint sort_column_id)
+{
+	GSList *node;
+
+	if (sort_column_id == GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID)
+		return priv->default_sort.func ? &priv->default_sort : NULL;
+
+	for (node = priv->sort_funcs; node; node = g_slist_next (node)) {
+		SortFunc *sort_func = (SortFunc *) node->data;
+		if (sort_func->sort_column_id == sort_column_id)
+			return sort_func;
+	}
+	return NULL;
+}
+
+static gboolean
+is_integer_type (GType type)
+{
+	return (type == G_TYPE_INT || type == G_TYPE_UINT ||
+		type == G_TYPE_LONG || type == G_TYPE_ULONG ||
+		type == G_TYPE_INT64 || type == G_TYPE_UINT64 ||
+		type == G_TYPE_BOOLEAN);
+}
+
+static gint64
+get_integer_value (GValue *value)
+{
+	switch (G_VALUE_TYPE (value)) {
+	case G_TYPE_INT: return g_value_get_int (value);
+	case G_TYPE_UINT: return g_value_get_uint (value);
+	case G_TYPE_LONG: return g_value_get_long (value);
+	case G_TYPE_ULONG: return g_value_get_ulong (value);
+	case G_TYPE_INT64: return g_value_get_int64 (value);
+	case G_TYPE_UINT64: return (gint64) g_value_get_uint64 (value);
+	case G_TYPE_BOOLEAN: return g_value_get_boolean (value);
+	default: return 0;
+	}
+}
+
+/* The comparison of a column without a sort function, like the one
+   of GtkTreeModelSort */
+static gint
+compare_values (GtkTreeModel *model, GtkTreeIter *a, GtkTreeIter *b, gint column)
+{
+	GValue value_a = {0,}, value_b = {0,};
+	gint cmp = 0;
+
+	gtk_tree_model_get_value (model, a, column, &value_a);
+	gtk_tree_model_get_value (model, b, column, &value_b);
+
+	if (is_integer_type (G_VALUE_TYPE (&value_a))) {
+		gint64 int_a = get_integer_value (&value_a);
+		gint64 int_b = get_integer_value (&value_b);
+		cmp = (int_a < int_b) ? -1 : (int_a > int_b) ? 1 : 0;
+	} else if (G_VALUE_TYPE (&value_a) == G_TYPE_STRING) {
+		const gchar *str_a = g_value_get_string (&value_a);
+		const gchar *str_b = g_value_get_string (&value_b);
+		if (str_a && str_b)
+			cmp = g_utf8_collate (str_a, str_b);
+		else
+			cmp = (str_a ? 1 : 0) - (str_b ? 1 : 0);
+	}
+
+	g_value_unset (&value_a);
+	g_value_unset (&value_b);
+
+	return cmp;
+}
+
+/* The sort column ids without a sort function must be columns of the
+   child model */
+static gboolean
+is_child_column (ModestHeaderIndexModelPrivate *priv, gint column)
+{
+	return (column >= 0 && column < gtk_tree_model_get_n_columns (priv->child_model));
+}
+
+static gboolean
+get_child_iter (ModestHeaderIndexModelPrivate *priv, guint row, GtkTreeIter *child_iter)
+{
+	return gtk_tree_model_iter_nth_child (priv->child_model, child_iter, NULL, row);
+}
+
+/* Compares two child rows in the current order. The ties are broken
+   by the child position, so two different rows are never equal and
+   the positions can be found with a binary search */
+static gint
+compare_rows (ModestHeaderIndexModelPrivate *priv, guint a, guint b)
+{
+	GtkTreeIter iter_a, iter_b;
+	SortFunc *sort_func;
+	gint cmp = 0;
+
+	if (a == b)
+		return 0;
+
+	if (priv->sort_column_id != GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID &&
+	    get_child_iter (priv, a, &iter_a) && get_child_iter (priv, b, &iter_b)) {
+		sort_func = get_sort_func (priv, priv->sort_column_id);
+		if (sort_func)
+			cmp = sort_func->func (priv->child_model, &iter_a, &iter_b, sort_func->data);
+		else if (is_child_column (priv, priv->sort_column_id))
+			cmp = compare_values (priv->child_model, &iter_a, &iter_b, priv->sort_column_id);
+
+		if (priv->order == GTK_SORT_DESCENDING)
+			cmp = -cmp;
+	}
+
+	if (cmp == 0)
+		cmp = (a < b) ? -1 : 1;
+
+	return cmp;
+}
+
+static gint
+compare_rows_qsort (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+	return compare_rows ((ModestHeaderIndexModelPrivate *) user_data,
+			     *((const guint *) a), *((const guint *) b));
+}
+
+typedef struct {
+	gint64 key;
+	guint row;
+} SortKey;
+
+static gint
+compare_keys (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+	const SortKey *key_a = (const SortKey *) a;
+	const SortKey *key_b = (const SortKey *) b;
+	GtkSortType order = (GtkSortType) GPOINTER_TO_INT (user_data);
+
+	if (key_a->key != key_b->key) {
+		if (order == GTK_SORT_DESCENDING)
+			return (key_a->key > key_b->key) ? -1 : 1;
+		else
+			return (key_a->key < key_b->key) ? -1 : 1;
+	}
+	return (key_a->row < key_b->row) ? -1 : 1;
+}
+
+/* Sorts an array of child rows. The integer columns without a sort
+   function (the dates and the sizes) are read once per row instead
+   of twice per comparison */
+static void
+sort_rows (ModestHeaderIndexModelPrivate *priv, GArray *rows)
+{
+	GType type = G_TYPE_INVALID;
+	guint i;
+
+	if (rows->len < 2)
+		return;
+
+	if (is_child_column (priv, priv->sort_column_id) &&
+	    !get_sort_func (priv, priv->sort_column_id))
+		type = gtk_tree_model_get_column_type (priv->child_model, priv->sort_column_id);
+
+	if (is_integer_type (type)) {
+		SortKey *keys = g_new (SortKey, rows->len);
+
+		for (i = 0; i < rows->len; i++) {
+			GtkTreeIter child_iter;
+			GValue value = {0,};
+
+			keys[i].row = g_array_index (rows, guint, i);
+			keys[i].key = 0;
+			if (get_child_iter (priv, keys[i].row, &child_iter)) {
+				gtk_tree_model_get_value (priv->child_model, &child_iter,
+							  priv->sort_column_id, &value);
+				keys[i].key = get_integer_value (&value);
+				g_value_unset (&value);
+			}
+		}
+		g_qsort_with_data (keys, rows->len, sizeof (SortKey), compare_keys,
+				   GINT_TO_POINTER (priv->order));
+		for (i = 0; i < rows->len; i++)
+			g_array_index (rows, guint, i) = keys[i].row;
+		g_free (keys);
+	} else {
+		g_qsort_with_data (rows->data, rows->len, sizeof (guint),
+				   compare_rows_qsort, priv);
+	}
+}
+
+/* Returns the position where @row is or would be inserted */
+static guint
+lower_bound (ModestHeaderIndexModelPrivate *priv, guint row)
+{
+	guint low = 0, high = priv->rows->len;
+
+	while (low < high) {
+		guint mid = low + (high - low) / 2;
+		if (compare_rows (priv, ROW_AT (priv, mid), row) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+/* Updates the reverse map for the shown rows in [@from, @to) */
+static void
+update_positions (ModestHeaderIndexModelPrivate *priv, guint from, guint to)
+{
+	guint pos;
+
+	for (pos = from; pos < to; pos++)
+		POSITION_OF (priv, ROW_AT (priv, pos)) = pos;
+}
+
+static gboolean
+is_visible (ModestHeaderIndexModelPrivate *priv, guint row)
+{
+	GtkTreeIter child_iter;
+
+	if (!get_child_iter (priv, row, &child_iter))
+		return FALSE;
+	if (!priv->visible_func)
+		return TRUE;
+	return priv->visible_func (priv->child_model, &child_iter, priv->visible_data);
+}
+
+/* Signals */
+
+static void
+emit_row_inserted (ModestHeaderIndexModel *self, guint pos)
+{
+	ModestHeaderIndexModelPrivate *priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (self);
+	GtkTreePath *path;
+	GtkTreeIter iter;
+
+	iter.stamp = priv->stamp;
+	iter.user_data = GUINT_TO_POINTER (pos);
+	path = gtk_tree_path_new_from_indices (pos, -1);
+	gtk_tree_model_row_inserted (GTK_TREE_MODEL (self), path, &iter);
+	gtk_tree_path_free (path);
+}
+
+static void
+emit_row_deleted (ModestHeaderIndexModel *self, guint pos)
+{
+	GtkTreePath *path;
+
+	path = gtk_tree_path_new_from_indices (pos, -1);
+	gtk_tree_model_row_deleted (GTK_TREE_MODEL (self), path);
+	gtk_tree_path_free (path);
+}
+
+static void
+emit_row_changed (ModestHeaderIndexModel *self, guint pos)
+{
+	ModestHeaderIndexModelPrivate *priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (self);
+	GtkTreePath *path;
+	GtkTreeIter iter;
+
+	iter.stamp = priv->stamp;
+	iter.user_data = GUINT_TO_POINTER (pos);
+	path = gtk_tree_path_new_from_indices (pos, -1);
+	gtk_tree_model_row_changed (GTK_TREE_MODEL (self), path, &iter);
+	gtk_tree_path_free (path);
+}
+
+static void
+emit_rows_reordered (ModestHeaderIndexModel *self, gint *new_order)
+{
+	GtkTreePath *path;
+
+	path = gtk_tree_path_new ();
+	gtk_tree_model_rows_reordered (GTK_TREE_MODEL (self), path, NULL, new_order);
+	gtk_tree_path_free (path);
+}
+
+/* Merges the sorted @added rows in the shown ones. The merged array
+   is built at once and then the insertions are notified in
+   ascending order, so every notified position is right for the rows
+   already notified. That is O(n + k) instead of O(n) per row */
+static void
+merge_rows (ModestHeaderIndexModel *self, GArray *added)
+{
+	ModestHeaderIndexModelPrivate *priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (self);
+	GArray *merged, *positions;
+	guint i = 0, j = 0;
+
+	if (added->len == 0)
+		return;
+
+	merged = g_array_sized_new (FALSE, FALSE, sizeof (guint), priv->rows->len + added->len);
+	positions = g_array_sized_new (FALSE, FALSE, sizeof (guint), added->len);
+
+	while (i < priv->rows->len || j < added->len) {
+		guint row;
+
+		if (j == added->len ||
+		    (i < priv->rows->len &&
+		     compare_rows (priv, ROW_AT (priv, i), g_array_index (added, guint, j)) < 0)) {
+			row = ROW_AT (priv, i++);
+		} else {
+			row = g_array_index (added, guint, j++);
+			STATE_OF (priv, row) = ROW_SHOWN;
+			g_array_append_val (positions, merged->len);
+		}
+		g_array_append_val (merged, row);
+	}
+
+	g_array_free (priv->rows, TRUE);
+	priv->rows = merged;
+	priv->stamp++;
+	update_positions (priv, g_array_index (positions, guint, 0), priv->rows->len);
+
+	for (i = 0; i < positions->len; i++)
+		emit_row_inserted (self, g_array_index (positions, guint, i));
+	g_array_free (positions, TRUE);
+}
+
+/* Adds the pending child rows that are visible */
+static void
+merge_pending (ModestHeaderIndexModel *self)
+{
+	ModestHeaderIndexModelPrivate *priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (self);
+	GArray *added;
+	guint row;
+
+	if (priv->merge_idle > 0) {
+		g_source_remove (priv->merge_idle);
+		priv->merge_idle = 0;
+	}
+
+	if (priv->n_pending == 0)
+		return;
+
+	added = g_array_sized_new (FALSE, FALSE, sizeof (guint), priv->n_pending);
+	for (row = 0; row < priv->child_state->len && priv->n_pending > 0; row++) {
+		if (STATE_OF (priv, row) != ROW_PENDING)
+			continue;
+		priv->n_pending--;
+		if (is_visible (priv, row))
+			g_array_append_val (added, row);
+		else
+			STATE_OF (priv, row) = ROW_HIDDEN;
+	}
+	priv->n_pending = 0;
+
+	sort_rows (priv, added);
+	merge_rows (self, added);
+	g_array_free (added, TRUE);
+}
+
+static gboolean
+merge_pending_idle (gpointer userdata)
+{
+	ModestHeaderIndexModel *self = MODEST_HEADER_INDEX_MODEL (userdata);
+
+	gdk_threads_enter ();
+	MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (self)->merge_idle = 0;
+	merge_pending (self);
+	gdk_threads_leave ();
+
+	return FALSE;
+}
+
+/* Sorts all the shown rows again, after a change of the sort column
+   or function */
+static void
+resort (ModestHeaderIndexModel *self)
+{
+	ModestHeaderIndexModelPrivate *priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (self);
+	gint *new_order;
+	guint pos;
+
+	merge_pending (self);
+	if (priv->rows->len == 0)
+		return;
+
+	sort_rows (priv, priv->rows);
+	priv->stamp++;
+
+	/* The reverse map still has the positions before sorting */
+	new_order = g_new (gint, priv->rows->len);
+	for (pos = 0; pos < priv->rows->len; pos++)
+		new_order[pos] = POSITION_OF (priv, ROW_AT (priv, pos));
+	update_positions (priv, 0, priv->rows->len);
+	emit_rows_reordered (self, new_order);
+
+	g_free (new_order);
+}
+
+/* Moves the row at @from to its sorted position, when its sort key
+   changed */
+static void
+move_row (ModestHeaderIndexModel *self, guint from)
+{
+	ModestHeaderIndexModelPrivate *priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (self);
+	guint row, to, pos;
+	gint *new_order;
+
+	row = ROW_AT (priv, from);
+	g_array_remove_index (priv->rows, from);
+	to = lower_bound (priv, row);
+	g_array_insert_val (priv->rows, to, row);
+	update_positions (priv, MIN (from, to), MAX (from, to) + 1);
+	priv->stamp++;
+
+	if (to != from) {
+		new_order = g_new (gint, priv->rows->len);
+		for (pos = 0; pos < priv->rows->len; pos++) {
+			if (pos == to)
+				new_order[pos] = from;
+			else if (from < to && pos >= from && pos < to)
+				new_order[pos] = pos + 1;
+			else if (from > to && pos > to && pos <= from)
+				new_order[pos] = pos - 1;
+			else
+				new_order[pos] = pos;
+		}
+		emit_rows_reordered (self, new_order);
+		g_free (new_order);
+	}
+
+	emit_row_changed (self, to);
+}
+
+/* Child model handlers */
+
+static void
+on_child_row_inserted (GtkTreeModel *child_model,
+		       GtkTreePath *path,
+		       GtkTreeIter *child_iter,
+		       ModestHeaderIndexModel *self)
+{
+	ModestHeaderIndexModelPrivate *priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (self);
+	guint8 state = ROW_PENDING;
+	guint position = NOT_SHOWN;
+	guint row, next;
+
+	row = gtk_tree_path_get_indices (path)[0];
+
+	/* The rows are usually appended, otherwise the shown child
+	   rows after it are renumbered through the reverse map. Their
+	   positions don't change */
+	for (next = row; next < priv->child_state->len; next++)
+		if (POSITION_OF (priv, next) != NOT_SHOWN)
+			ROW_AT (priv, POSITION_OF (priv, next))++;
+	g_array_insert_val (priv->positions, row, position);
+	g_array_insert_val (priv->child_state, row, state);
+
+	/* They're merged in batches */
+	priv->n_pending++;
+	if (priv->merge_idle == 0)
+		priv->merge_idle = g_idle_add (merge_pending_idle, self);
+}
+
+static void
+on_child_row_deleted (GtkTreeModel *child_model,
+		      GtkTreePath *path,
+		      ModestHeaderIndexModel *self)
+{
+	ModestHeaderIndexModelPrivate *priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (self);
+	guint row, next, found;
+
+	row = gtk_tree_path_get_indices (path)[0];
+	if (row >= priv->child_state->len)
+		return;
+
+	/* The row is already gone from the child model, so it's found
+	   with the reverse map instead of comparing it. The shown
+	   child rows after it are renumbered the same way */
+	found = POSITION_OF (priv, row);
+	for (next = row + 1; next < priv->child_state->len; next++)
+		if (POSITION_OF (priv, next) != NOT_SHOWN)
+			ROW_AT (priv, POSITION_OF (priv, next))--;
+
+	if (STATE_OF (priv, row) == ROW_PENDING)
+		priv->n_pending--;
+	g_array_remove_index (priv->positions, row);
+	g_array_remove_index (priv->child_state, row);
+
+	if (found != NOT_SHOWN) {
+		g_array_remove_index (priv->rows, found);
+		update_positions (priv, found, priv->rows->len);
+		priv->stamp++;
+		emit_row_deleted (self, found);
+	}
+}
+
+static void
+on_child_row_changed (GtkTreeModel *child_model,
+		      GtkTreePath *path,
+		      GtkTreeIter *child_iter,
+		      ModestHeaderIndexModel *self)
+{
+	ModestHeaderIndexModelPrivate *priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (self);
+	gboolean visible;
+	guint row, pos;
+
+	row = gtk_tree_path_get_indices (path)[0];
+	if (row >= priv->child_state->len || STATE_OF (priv, row) == ROW_PENDING)
+		return;
+
+	visible = is_visible (priv, row);
+	if (STATE_OF (priv, row) == ROW_HIDDEN) {
+		if (visible) {
+			pos = lower_bound (priv, row);
+			g_array_insert_val (priv->rows, pos, row);
+			update_positions (priv, pos, priv->rows->len);
+			STATE_OF (priv, row) = ROW_SHOWN;
+			priv->stamp++;
+			emit_row_inserted (self, pos);
+		}
+		return;
+	}
+
+	pos = POSITION_OF (priv, row);
+	if (pos == NOT_SHOWN)
+		return;
+
+	if (!visible) {
+		g_array_remove_index (priv->rows, pos);
+		update_positions (priv, pos, priv->rows->len);
+		POSITION_OF (priv, row) = NOT_SHOWN;
+		STATE_OF (priv, row) = ROW_HIDDEN;
+		priv->stamp++;
+		emit_row_deleted (self, pos);
+	} else if ((pos > 0 && compare_rows (priv, ROW_AT (priv, pos - 1), row) > 0) ||
+		   (pos + 1 < priv->rows->len && compare_rows (priv, row, ROW_AT (priv, pos + 1)) > 0)) {
+		move_row (self, pos);
+	} else {
+		emit_row_changed (self, pos);
+	}
+}
+
+GtkTreeModel*
+modest_header_index_model_new (GtkTreeModel *child_model)
+{
+	ModestHeaderIndexModel *self;
+	ModestHeaderIndexModelPrivate *priv;
+	GtkTreeIter child_iter;
+
+	g_return_val_if_fail (GTK_IS_TREE_MODEL (child_model), NULL);
+
+	self = MODEST_HEADER_INDEX_MODEL (g_object_new (MODEST_TYPE_HEADER_INDEX_MODEL, NULL));
+	priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (self);
+
+	priv->child_model = g_object_ref (child_model);
+	priv->row_inserted_handler =
+		g_signal_connect (child_model, "row-inserted",
+				  G_CALLBACK (on_child_row_inserted), self);
+	priv->row_deleted_handler =
+		g_signal_connect (child_model, "row-deleted",
+				  G_CALLBACK (on_child_row_deleted), self);
+	priv->row_changed_handler =
+		g_signal_connect (child_model, "row-changed",
+				  G_CALLBACK (on_child_row_changed), self);
+
+	/* The rows already in the child model are merged like the
+	   inserted ones, as the visible function is not set yet */
+	if (gtk_tree_model_get_iter_first (child_model, &child_iter)) {
+		guint8 state = ROW_PENDING;
+		guint position = NOT_SHOWN;
+		do {
+			g_array_append_val (priv->positions, position);
+			g_array_append_val (priv->child_state, state);
+			priv->n_pending++;
+		} while (gtk_tree_model_iter_next (child_model, &child_iter));
+		priv->merge_idle = g_idle_add (merge_pending_idle, self);
+	}
+
+	return GTK_TREE_MODEL (self);
+}
+
+GtkTreeModel*
+modest_header_index_model_get_model (ModestHeaderIndexModel *self)
+{
+	g_return_val_if_fail (MODEST_IS_HEADER_INDEX_MODEL (self), NULL);
+
+	return MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (self)->child_model;
+}
+
+void
+modest_header_index_model_set_visible_func (ModestHeaderIndexModel *self,
+					    GtkTreeModelFilterVisibleFunc func,
+					    gpointer data,
+					    GDestroyNotify destroy)
+{
+	ModestHeaderIndexModelPrivate *priv;
+
+	g_return_if_fail (MODEST_IS_HEADER_INDEX_MODEL (self));
+	priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (self);
+
+	if (priv->visible_destroy)
+		priv->visible_destroy (priv->visible_data);
+
+	priv->visible_func = func;
+	priv->visible_data = data;
+	priv->visible_destroy = destroy;
+}
+
+void
+modest_header_index_model_refilter (ModestHeaderIndexModel *self)
+{
+	ModestHeaderIndexModelPrivate *priv;
+	GArray *added, *removed;
+	guint8 *visible;
+	guint row, pos, kept;
+
+	g_return_if_fail (MODEST_IS_HEADER_INDEX_MODEL (self));
+	priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (self);
+
+	merge_pending (self);
+	if (priv->child_state->len == 0)
+		return;
+
+	visible = g_new (guint8, priv->child_state->len);
+	for (row = 0; row < priv->child_state->len; row++)
+		visible[row] = is_visible (priv, row);
+
+	/* Remove the rows that are hidden now. The array is compacted
+	   at once and then the removals are notified from the last one,
+	   so the positions still to be notified don't change */
+	removed = g_array_new (FALSE, FALSE, sizeof (guint));
+	kept = 0;
+	for (pos = 0; pos < priv->rows->len; pos++) {
+		row = ROW_AT (priv, pos);
+		if (visible[row]) {
+			ROW_AT (priv, kept++) = row;
+		} else {
+			POSITION_OF (priv, row) = NOT_SHOWN;
+			STATE_OF (priv, row) = ROW_HIDDEN;
+			g_array_append_val (removed, pos);
+		}
+	}
+	if (removed->len > 0) {
+		g_array_set_size (priv->rows, kept);
+		update_positions (priv, g_array_index (removed, guint, 0), kept);
+		priv->stamp++;
+		for (pos = removed->len; pos > 0; pos--)
+			emit_row_deleted (self, g_array_index (removed, guint, pos - 1));
+	}
+	g_array_free (removed, TRUE);
+
+	/* And add the ones that are visible now */
+	added = g_array_new (FALSE, FALSE, sizeof (guint));
+	for (row = 0; row < priv->child_state->len; row++) {
+		if (visible[row] && STATE_OF (priv, row) == ROW_HIDDEN)
+			g_array_append_val (added, row);
+	}
+	sort_rows (priv, added);
+	merge_rows (self, added);
+	g_array_free (added, TRUE);
+
+	g_free (visible);
+}
+
+/* GtkTreeModel implementation */
+
+static GtkTreeModelFlags
+get_flags (GtkTreeModel *model)
+{
+	return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint
+get_n_columns (GtkTreeModel *model)
+{
+	ModestHeaderIndexModelPrivate *priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (model);
+
+	return gtk_tree_model_get_n_columns (priv->child_model);
+}
+
+static GType
+get_column_type (GtkTreeModel *model, gint column)
+{
+	ModestHeaderIndexModelPrivate *priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (model);
+
+	return gtk_tree_model_get_column_type (priv->child_model, column);
+}
+
+static gboolean
+set_iter (ModestHeaderIndexModelPrivate *priv, GtkTreeIter *iter, gint pos)
+{
+	if (pos < 0 || pos >= (gint) priv->rows->len) {
+		iter->stamp = 0;
+		return FALSE;
+	}
+
+	iter->stamp = priv->stamp;
+	iter->user_data = GINT_TO_POINTER (pos);
+	return TRUE;
+}
+
+static gboolean
+get_iter (GtkTreeModel *model, GtkTreeIter *iter, GtkTreePath *path)
+{
+	ModestHeaderIndexModelPrivate *priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (model);
+
+	if (gtk_tree_path_get_depth (path) != 1)
+		return FALSE;
+
+	return set_iter (priv, iter, gtk_tree_path_get_indices (path)[0]);
+}
+
+static GtkTreePath *
+get_path (GtkTreeModel *model, GtkTreeIter *iter)
+{
+	ModestHeaderIndexModelPrivate *priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (model);
+
+	g_return_val_if_fail (iter->stamp == priv->stamp, NULL);
+
+	return gtk_tree_path_new_from_indices (GPOINTER_TO_INT (iter->user_data), -1);
+}
+
+static void
+get_value (GtkTreeModel *model, GtkTreeIter *iter, gint column, GValue *value)
+{
+	ModestHeaderIndexModelPrivate *priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (model);
+	GtkTreeIter child_iter;
+	gint pos;
+
+	g_return_if_fail (iter->stamp == priv->stamp);
+
+	pos = GPOINTER_TO_INT (iter->user_data);
+	if (pos >= (gint) priv->rows->len ||
+	    !get_child_iter (priv, ROW_AT (priv, pos), &child_iter)) {
+		g_value_init (value, gtk_tree_model_get_column_type (priv->child_model, column));
+		return;
+	}
+
+	gtk_tree_model_get_value (priv->child_model, &child_iter, column, value);
+}
+
+static gboolean
+iter_next (GtkTreeModel *model, GtkTreeIter *iter)
+{
+	ModestHeaderIndexModelPrivate *priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (model);
+
+	if (iter->stamp != priv->stamp)
+		return FALSE;
+
+	return set_iter (priv, iter, GPOINTER_TO_INT (iter->user_data) + 1);
+}
+
+static gboolean
+iter_children (GtkTreeModel *model, GtkTreeIter *iter, GtkTreeIter *parent)
+{
+	ModestHeaderIndexModelPrivate *priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (model);
+
+	if (parent)
+		return FALSE;
+
+	return set_iter (priv, iter, 0);
+}
+
+static gboolean
+iter_has_child (GtkTreeModel *model, GtkTreeIter *iter)
+{
+	return FALSE;
+}
+
+static gint
+iter_n_children (GtkTreeModel *model, GtkTreeIter *iter)
+{
+	ModestHeaderIndexModelPrivate *priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (model);
+
+	if (iter)
+		return 0;
+
+	return priv->rows->len;
+}
+
+static gboolean
+iter_nth_child (GtkTreeModel *model, GtkTreeIter *iter, GtkTreeIter *parent, gint n)
+{
+	ModestHeaderIndexModelPrivate *priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (model);
+
+	if (parent)
+		return FALSE;
+
+	return set_iter (priv, iter, n);
+}
+
+static gboolean
+iter_parent (GtkTreeModel *model, GtkTreeIter *iter, GtkTreeIter *child)
+{
+	return FALSE;
+}
+
+static void
+gtk_tree_model_init (GtkTreeModelIface *iface)
+{
+	iface->get_flags = get_flags;
+	iface->get_n_columns = get_n_columns;
+	iface->get_column_type = get_column_type;
+	iface->get_iter = get_iter;
+	iface->get_path = get_path;
+	iface->get_value = get_value;
+	iface->iter_next = iter_next;
+	iface->iter_children = iter_children;
+	iface->iter_has_child = iter_has_child;
+	iface->iter_n_children = iter_n_children;
+	iface->iter_nth_child = iter_nth_child;
+	iface->iter_parent = iter_parent;
+}
+
+/* GtkTreeSortable implementation */
+
+static gboolean
+get_sort_column_id (GtkTreeSortable *sortable, gint *sort_column_id, GtkSortType *order)
+{
+	ModestHeaderIndexModelPrivate *priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (sortable);
+
+	if (sort_column_id)
+		*sort_column_id = priv->sort_column_id;
+	if (order)
+		*order = priv->order;
+
+	return (priv->sort_column_id != GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID &&
+		priv->sort_column_id != GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID);
+}
+
+static void
+set_sort_column_id (GtkTreeSortable *sortable, gint sort_column_id, GtkSortType order)
+{
+	ModestHeaderIndexModelPrivate *priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (sortable);
+
+	if (priv->sort_column_id == sort_column_id && priv->order == order)
+		return;
+
+	priv->sort_column_id = sort_column_id;
+	priv->order = order;
+
+	gtk_tree_sortable_sort_column_changed (sortable);
+	resort (MODEST_HEADER_INDEX_MODEL (sortable));
+}
+
+static void
+set_sort_func (GtkTreeSortable *sortable,
+	       gint sort_column_id,
+	       GtkTreeIterCompareFunc func,
+	       gpointer data,
+	       GDestroyNotify destroy)
+{
+	ModestHeaderIndexModelPrivate *priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (sortable);
+	SortFunc *sort_func;
+
+	sort_func = get_sort_func (priv, sort_column_id);
+	if (sort_func) {
+		if (sort_func->destroy)
+			sort_func->destroy (sort_func->data);
+	} else {
+		sort_func = g_slice_new0 (SortFunc);
+		sort_func->sort_column_id = sort_column_id;
+		priv->sort_funcs = g_slist_prepend (priv->sort_funcs, sort_func);
+	}
+	sort_func->func = func;
+	sort_func->data = data;
+	sort_func->destroy = destroy;
+
+	if (priv->sort_column_id == sort_column_id)
+		resort (MODEST_HEADER_INDEX_MODEL (sortable));
+}
+
+static void
+set_default_sort_func (GtkTreeSortable *sortable,
+		       GtkTreeIterCompareFunc func,
+		       gpointer data,
+		       GDestroyNotify destroy)
+{
+	ModestHeaderIndexModelPrivate *priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (sortable);
+
+	if (priv->default_sort.destroy)
+		priv->default_sort.destroy (priv->default_sort.data);
+
+	priv->default_sort.sort_column_id = GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID;
+	priv->default_sort.func = func;
+	priv->default_sort.data = data;
+	priv->default_sort.destroy = destroy;
+
+	if (priv->sort_column_id == GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID)
+		resort (MODEST_HEADER_INDEX_MODEL (sortable));
+}
+
+static gboolean
+has_default_sort_func (GtkTreeSortable *sortable)
+{
+	ModestHeaderIndexModelPrivate *priv = MODEST_HEADER_INDEX_MODEL_GET_PRIVATE (sortable);
+
+	return (priv->default_sort.func != NULL);
+}
+
+static void
+gtk_tree_sortable_init (GtkTreeSortableIface *iface)
+{
+	iface->get_sort_column_id = get_sort_column_id;
+	iface->set_sort_column_id = set_sort_column_id;
+	iface->set_sort_func = set_sort_func;
+	iface->set_default_sort_func = set_default_sort_func;
+	iface->has_default_sort_func = has_default_sort_func;
+}
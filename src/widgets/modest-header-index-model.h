@@ -0,0 +1,143 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MODEST_HEADER_INDEX_MODEL_H__
+#define __MODEST_HEADER_INDEX_MODEL_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+/* convenience macros */
+#define MODEST_TYPE_HEADER_INDEX_MODEL             (modest_header_index_model_get_type())
+#define MODEST_HEADER_INDEX_MODEL(obj)             (G_TYPE_CHECK_INSTANCE_CAST((obj),MODEST_TYPE_HEADER_INDEX_MODEL,ModestHeaderIndexModel))
+#define MODEST_HEADER_INDEX_MODEL_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST((klass),MODEST_TYPE_HEADER_INDEX_MODEL,GObject))
+#define MODEST_IS_HEADER_INDEX_MODEL(obj)          (G_TYPE_CHECK_INSTANCE_TYPE((obj),MODEST_TYPE_HEADER_INDEX_MODEL))
+#define MODEST_IS_HEADER_INDEX_MODEL_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE((klass),MODEST_TYPE_HEADER_INDEX_MODEL))
+#define MODEST_HEADER_INDEX_MODEL_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS((obj),MODEST_TYPE_HEADER_INDEX_MODEL,ModestHeaderIndexModelClass))
+
+typedef struct _ModestHeaderIndexModel      ModestHeaderIndexModel;
+typedef struct _ModestHeaderIndexModelClass ModestHeaderIndexModelClass;
+
+struct _ModestHeaderIndexModel {
+	 GObject parent;
+};
+
+struct _ModestHeaderIndexModelClass {
+	GObjectClass parent_class;
+};
+
+/*
+ * The header index model is an index-backed sort and filter model
+ * for a flat list model (a TnyGtkHeaderListModel). In a single layer
+ * it keeps the sorted array of the indexes of the visible child rows,
+ * its reverse map (the position of every child row) and one byte of
+ * state per child row. It replaces the GtkTreeModelSort +
+ * GtkTreeModelFilter stack in big folders, where the per-row nodes of
+ * those two layers and their one by one insertions make the memory
+ * and the time to open the folder grow with its size.
+ *
+ * It does not load the headers lazily: the child model still holds
+ * all of them, and they're all sorted, O(n log n), before the first
+ * paint. The rows inserted in the child model are merged in batches
+ * from an idle instead of with a sorted insertion per row, and the
+ * cell values are read from the child model only when they're
+ * requested, that is, for the painted rows.
+ *
+ * With the reverse map the changes coming from the folder monitor
+ * don't scan the rows: a changed row is found in O(1) and an
+ * appended one is only queued for the next merge. A row deleted or
+ * inserted in the middle of the child model renumbers the indexes of
+ * the child rows after it, which is linear but never reads the child
+ * model.
+ *
+ * The child model must be a flat list whose iters are cheap to get
+ * by index, and it must be used from the main loop
+ */
+
+/**
+ * modest_header_index_model_get_type:
+ *
+ * get the GType for ModestHeaderIndexModel
+ *
+ * Returns: the GType
+ */
+GType        modest_header_index_model_get_type    (void) G_GNUC_CONST;
+
+/**
+ * modest_header_index_model_new:
+ * @child_model: a flat #GtkTreeModel
+ *
+ * creates a new index model for @child_model. The rows of the
+ * child model are shown unsorted until a sort column is set
+ *
+ * Returns: a new #GtkTreeModel that also implements #GtkTreeSortable
+ */
+GtkTreeModel* modest_header_index_model_new (GtkTreeModel *child_model);
+
+/**
+ * modest_header_index_model_get_model:
+ * @self: a #ModestHeaderIndexModel
+ *
+ * gets the child model
+ *
+ * Returns: the child model, the caller does not own a reference
+ */
+GtkTreeModel* modest_header_index_model_get_model (ModestHeaderIndexModel *self);
+
+/**
+ * modest_header_index_model_set_visible_func:
+ * @self: a #ModestHeaderIndexModel
+ * @func: the function that decides if a child row is shown
+ * @data: user data for @func
+ * @destroy: destroy notifier of @data, or %NULL
+ *
+ * sets the function that filters the rows, with the same semantics
+ * of gtk_tree_model_filter_set_visible_func(). @func receives the
+ * child model and the iter of the child row. The function is called
+ * again when a child row changes or when the model is refiltered
+ */
+void         modest_header_index_model_set_visible_func (ModestHeaderIndexModel *self,
+							 GtkTreeModelFilterVisibleFunc func,
+							 gpointer data,
+							 GDestroyNotify destroy);
+
+/**
+ * modest_header_index_model_refilter:
+ * @self: a #ModestHeaderIndexModel
+ *
+ * evaluates the visible function for all the child rows again. The
+ * rows that become hidden are removed and the ones that become
+ * visible are merged in their sorted positions in a single pass
+ */
+void         modest_header_index_model_refilter (ModestHeaderIndexModel *self);
+
+G_END_DECLS
+
+#endif /* __MODEST_HEADER_INDEX_MODEL_H__ */
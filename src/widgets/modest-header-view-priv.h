@@ -38,6 +38,9 @@ G_BEGIN_DECLS
 #define ACTIVE_COLOR "active-color"
 #define BOLD_IS_ACTIVE_COLOR "bold-is-active-color"
 
+/* the header view of a column, see modest_header_view_set_columns */
+#define MODEST_HEADER_VIEW_PTR "modest-header-view"
+
 /* PROTECTED method. It's useful when we want to force a given
    selection to reload a msg. For example if we have selected a header
    in offline mode, when Modest become online, we want to reload the
@@ -65,6 +68,22 @@ void _modest_header_view_compact_header_cell_data  (GtkTreeViewColumn *column,
 
 const gchar *_modest_header_view_get_display_date (ModestHeaderView *self, time_t date);
 
+/* whether the header is shown as a reply in its thread, only when
+   sorting by MODEST_HEADER_VIEW_THREAD_SORT_COLUMN */
+gboolean _modest_header_view_is_thread_reply (ModestHeaderView *self, TnyHeader *header);
+
+/* private: cache of the formatted texts of the rows, see
+   modest-header-view-render.c */
+typedef struct _ModestHeaderViewRowCache ModestHeaderViewRowCache;
+
+ModestHeaderViewRowCache *_modest_header_view_row_cache_new (void);
+void _modest_header_view_row_cache_free (ModestHeaderViewRowCache *cache);
+void _modest_header_view_row_cache_invalidate (ModestHeaderViewRowCache *cache);
+void _modest_header_view_row_cache_clear (ModestHeaderViewRowCache *cache);
+gchar *_modest_header_view_row_cache_to_string (ModestHeaderViewRowCache *cache);
+
+ModestHeaderViewRowCache *_modest_header_view_get_row_cache (ModestHeaderView *self);
+
 typedef enum _ModestHeaderViewCompactHeaderMode {
 	MODEST_HEADER_VIEW_COMPACT_HEADER_MODE_IN = 0,
 	MODEST_HEADER_VIEW_COMPACT_HEADER_MODE_OUT = 1,
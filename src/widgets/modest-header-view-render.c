@@ -38,6 +38,7 @@
 #include <modest-tny-folder.h>
 #include <modest-tny-account.h>
 #include <modest-runtime.h>
+#include <modest-cache-mgr.h>
 #include <glib/gi18n.h>
 #include <modest-platform.h>
 #include <string.h>
@@ -136,35 +137,42 @@ set_common_flags (GtkCellRenderer *renderer, TnyHeaderFlags flags)
 		      NULL);	
 }
 
-static void
-set_cell_text (GtkCellRenderer *renderer,
-	       const gchar *text,
-	       TnyHeaderFlags flags)
+/* We have to limit the size of the text. Otherwise Pango could cause
+   freezes trying to render too large texts. This prevents DoS attacks
+   with specially malformed emails. Returns a newly allocated string
+   if the text had to be truncated, NULL otherwise */
+static gchar *
+truncate_text (const gchar *text)
 {
-	gboolean strikethrough;
-	gboolean bold_is_active_color;
-	GdkColor *color = NULL;
-	PangoWeight weight;
 	gchar *newtext = NULL;
 
-	/* We have to limit the size of the text. Otherwise Pango
-	   could cause freezes trying to render too large texts. This
-	   prevents DoS attacks with specially malformed emails */
 	if (g_utf8_validate(text, -1, NULL)) {
 		if (g_utf8_strlen (text, -1) > MODEST_HEADER_VIEW_MAX_TEXT_LENGTH) {
 			/* UTF-8 bytes are 4 bytes length in the worst case */
-			newtext = g_malloc0 (MODEST_HEADER_VIEW_MAX_TEXT_LENGTH * 4);
+			newtext = g_malloc0 (MODEST_HEADER_VIEW_MAX_TEXT_LENGTH * 4 + 1);
 			g_utf8_strncpy (newtext, text, MODEST_HEADER_VIEW_MAX_TEXT_LENGTH);
-			text = newtext;
 		}
 	} else {
 		if (strlen (text) > MODEST_HEADER_VIEW_MAX_TEXT_LENGTH) {
-			newtext = g_malloc0 (MODEST_HEADER_VIEW_MAX_TEXT_LENGTH);
+			newtext = g_malloc0 (MODEST_HEADER_VIEW_MAX_TEXT_LENGTH + 1);
 			strncpy (newtext, text, MODEST_HEADER_VIEW_MAX_TEXT_LENGTH);
-			text = newtext;
 		}
 	}
 
+	return newtext;
+}
+
+/* Like set_cell_text but for texts that are already truncated, like
+   the ones stored in the row cache */
+static void
+set_truncated_cell_text (GtkCellRenderer *renderer,
+			 const gchar *text,
+			 TnyHeaderFlags flags)
+{
+	gboolean bold_is_active_color;
+	GdkColor *color = NULL;
+	PangoWeight weight;
+
 	bold_is_active_color = GPOINTER_TO_INT (g_object_get_data (G_OBJECT (renderer), BOLD_IS_ACTIVE_COLOR));
 	if (bold_is_active_color) {
 		color = g_object_get_data (G_OBJECT (renderer), ACTIVE_COLOR);
@@ -175,7 +183,6 @@ set_cell_text (GtkCellRenderer *renderer,
 #else
 	weight =  (bold_is_active_color || (flags & TNY_HEADER_FLAG_SEEN)) ? PANGO_WEIGHT_NORMAL: PANGO_WEIGHT_ULTRABOLD;
 #endif
-	strikethrough = (flags & TNY_HEADER_FLAG_DELETED) ?  TRUE:FALSE;
 	g_object_freeze_notify (G_OBJECT (renderer));
 	g_object_set (G_OBJECT (renderer), 
 		      "text", text, 
@@ -195,12 +202,313 @@ set_cell_text (GtkCellRenderer *renderer,
 		}
 	}
 
-	if (newtext)
-		g_free (newtext);
-
 	g_object_thaw_notify (G_OBJECT (renderer));
 }
 
+static void
+set_cell_text (GtkCellRenderer *renderer,
+	       const gchar *text,
+	       TnyHeaderFlags flags)
+{
+	gchar *newtext;
+
+	newtext = truncate_text (text);
+	set_truncated_cell_text (renderer, (newtext) ? newtext : text, flags);
+	g_free (newtext);
+}
+
+/* Formatted row cache. The cell data functions are called for the
+   visible rows on every expose, and copying the strings out of the
+   model, parsing the addresses and formatting the dates every time
+   makes scrolling slow in big folders. So the display texts are
+   computed once per header, when first painted, and reused while
+   the flags of the header do not change. The header view bumps the
+   generation of the cache when something that affects all the rows
+   changes (the style, the datetime format or the current day) */
+
+#define ROW_CACHE_MAX_SIZE 1024
+
+/* the subjects of the replies are indented when the headers are
+   shown in threads */
+#define THREAD_REPLY_PREFIX "\xe2\x86\xb3 "
+
+typedef enum {
+	ROW_TEXT_SUBJECT,
+	ROW_TEXT_FROM,
+	ROW_TEXT_TO,
+	ROW_TEXT_FROM_LIST,
+	ROW_TEXT_TO_LIST,
+	ROW_TEXT_DATE_RECEIVED,
+	ROW_TEXT_DATE_SENT,
+	ROW_TEXT_NUM
+} RowText;
+
+typedef struct {
+	ModestHeaderViewRowCache *cache;
+	TnyHeader *header;
+	GList *link;
+	guint generation;
+	TnyHeaderFlags flags;
+	gboolean is_calendar;
+	gchar *texts[ROW_TEXT_NUM];
+} HeaderRow;
+
+struct _ModestHeaderViewRowCache {
+	/* TnyHeader -> HeaderRow, headers are weak references */
+	GHashTable *rows;
+	/* Most recently painted first */
+	GQueue *lru;
+	guint generation;
+	guint hits;
+	guint misses;
+};
+
+static void
+header_row_reset (HeaderRow *row)
+{
+	gint i;
+
+	for (i = 0; i < ROW_TEXT_NUM; i++) {
+		g_free (row->texts[i]);
+		row->texts[i] = NULL;
+	}
+}
+
+static void
+header_row_free (HeaderRow *row)
+{
+	header_row_reset (row);
+	g_slice_free (HeaderRow, row);
+}
+
+static void
+on_row_header_finalized (gpointer data, GObject *header)
+{
+	ModestHeaderViewRowCache *cache = (ModestHeaderViewRowCache *) data;
+	HeaderRow *row;
+
+	/* The weak reference is already gone, so steal it instead
+	   of removing it */
+	row = g_hash_table_lookup (cache->rows, header);
+	if (row) {
+		g_hash_table_steal (cache->rows, header);
+		g_queue_delete_link (cache->lru, row->link);
+		header_row_free (row);
+	}
+}
+
+static void
+header_row_destroy (gpointer data)
+{
+	HeaderRow *row = (HeaderRow *) data;
+
+	g_object_weak_unref (G_OBJECT (row->header), on_row_header_finalized, row->cache);
+	g_queue_delete_link (row->cache->lru, row->link);
+	header_row_free (row);
+}
+
+ModestHeaderViewRowCache *
+_modest_header_view_row_cache_new (void)
+{
+	ModestHeaderViewRowCache *cache;
+
+	cache = g_slice_new0 (ModestHeaderViewRowCache);
+	cache->rows = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					     NULL, header_row_destroy);
+	cache->lru = g_queue_new ();
+
+	return cache;
+}
+
+void
+_modest_header_view_row_cache_free (ModestHeaderViewRowCache *cache)
+{
+	g_hash_table_destroy (cache->rows);
+	g_queue_free (cache->lru);
+	g_slice_free (ModestHeaderViewRowCache, cache);
+}
+
+void
+_modest_header_view_row_cache_invalidate (ModestHeaderViewRowCache *cache)
+{
+	/* Rows are lazily reformatted the next time they're painted */
+	cache->generation++;
+}
+
+void
+_modest_header_view_row_cache_clear (ModestHeaderViewRowCache *cache)
+{
+	g_hash_table_remove_all (cache->rows);
+}
+
+gchar *
+_modest_header_view_row_cache_to_string (ModestHeaderViewRowCache *cache)
+{
+	return g_strdup_printf ("row cache: %u/%d rows, generation %u, %u hits, %u misses\n",
+				g_hash_table_size (cache->rows), ROW_CACHE_MAX_SIZE,
+				cache->generation, cache->hits, cache->misses);
+}
+
+static ModestHeaderView *
+get_header_view (GtkTreeViewColumn *column)
+{
+	return MODEST_HEADER_VIEW (g_object_get_data (G_OBJECT (column), MODEST_HEADER_VIEW_PTR));
+}
+
+/* Returns the cache row of the header, creating it if needed. The
+   texts of the row are dropped if it's no longer valid */
+static HeaderRow *
+get_header_row (ModestHeaderViewRowCache *cache,
+		TnyHeader *header,
+		TnyHeaderFlags flags)
+{
+	HeaderRow *row;
+
+	row = g_hash_table_lookup (cache->rows, header);
+	if (row) {
+		if (row->generation != cache->generation || row->flags != flags) {
+			header_row_reset (row);
+			row->generation = cache->generation;
+			row->flags = flags;
+		}
+		g_queue_unlink (cache->lru, row->link);
+		g_queue_push_head_link (cache->lru, row->link);
+		return row;
+	}
+
+	/* Evict the least recently painted row */
+	if (g_hash_table_size (cache->rows) >= ROW_CACHE_MAX_SIZE) {
+		HeaderRow *oldest = (HeaderRow *) g_queue_peek_tail (cache->lru);
+		g_hash_table_remove (cache->rows, oldest->header);
+	}
+
+	row = g_slice_new0 (HeaderRow);
+	row->cache = cache;
+	row->header = header;
+	row->generation = cache->generation;
+	row->flags = flags;
+	row->is_calendar = tny_header_get_user_flag (header, "calendar");
+	g_queue_push_head (cache->lru, row);
+	row->link = g_queue_peek_head_link (cache->lru);
+
+	g_hash_table_insert (cache->rows, header, row);
+	g_object_weak_ref (G_OBJECT (header), on_row_header_finalized, cache);
+
+	return row;
+}
+
+/* Formats a list of recipients for display. The same senders and
+   recipients appear in many rows, and in many folders, so the result
+   is kept in the display string cache. Returns a newly allocated
+   string, or NULL if there are no recipients */
+static gchar *
+get_display_addresses (const gchar *recipients)
+{
+	ModestCacheMgr *cache_mgr;
+	const gchar *cached;
+	gchar *str;
+
+	if (!recipients)
+		return NULL;
+
+	cache_mgr = modest_runtime_get_cache_mgr ();
+	cached = (const gchar *) modest_cache_mgr_lookup (cache_mgr,
+							  MODEST_CACHE_MGR_CACHE_TYPE_DISPLAY_STRING,
+							  recipients);
+	if (cached)
+		return g_strdup (cached);
+
+	str = modest_text_utils_get_display_addresses (recipients);
+	if (str)
+		modest_cache_mgr_insert (cache_mgr, MODEST_CACHE_MGR_CACHE_TYPE_DISPLAY_STRING,
+					 recipients, str,
+					 strlen (recipients) + strlen (str) + 2);
+	return str;
+}
+
+/* Returns the display text of the row, formatting it if it's not
+   cached yet. The returned text is already truncated and it's owned
+   by the cache */
+static const gchar *
+get_row_text (ModestHeaderView *self,
+	      HeaderRow *row,
+	      RowText text,
+	      GtkTreeModel *tree_model,
+	      GtkTreeIter *iter)
+{
+	gchar *str = NULL, *recipients = NULL, *newtext;
+	time_t date = 0;
+
+	if (row->texts[text]) {
+		row->cache->hits++;
+		return row->texts[text];
+	}
+	row->cache->misses++;
+
+	switch (text) {
+	case ROW_TEXT_SUBJECT:
+		gtk_tree_model_get (tree_model, iter,
+				    TNY_GTK_HEADER_LIST_MODEL_SUBJECT_COLUMN, &str,
+				    -1);
+		if (!str || str[0] == '\0') {
+			g_free (str);
+			str = g_strdup (_("mail_va_no_subject"));
+		}
+		if (_modest_header_view_is_thread_reply (self, row->header)) {
+			newtext = g_strconcat (THREAD_REPLY_PREFIX, str, NULL);
+			g_free (str);
+			str = newtext;
+		}
+		break;
+	case ROW_TEXT_FROM:
+	case ROW_TEXT_TO:
+		gtk_tree_model_get (tree_model, iter,
+				    (text == ROW_TEXT_FROM) ?
+				    TNY_GTK_HEADER_LIST_MODEL_FROM_COLUMN :
+				    TNY_GTK_HEADER_LIST_MODEL_TO_COLUMN, &str,
+				    -1);
+		if (str)
+			modest_text_utils_get_display_address (str); /* string is changed in-place */
+		if (!str || str[0] == '\0') {
+			g_free (str);
+			str = g_strdup (_("mail_va_no_to"));
+		}
+		break;
+	case ROW_TEXT_FROM_LIST:
+	case ROW_TEXT_TO_LIST:
+		gtk_tree_model_get (tree_model, iter,
+				    (text == ROW_TEXT_FROM_LIST) ?
+				    TNY_GTK_HEADER_LIST_MODEL_FROM_COLUMN :
+				    TNY_GTK_HEADER_LIST_MODEL_TO_COLUMN, &recipients,
+				    -1);
+		str = get_display_addresses (recipients);
+		g_free (recipients);
+		if (!str)
+			str = g_strdup (_("mail_va_no_to"));
+		break;
+	case ROW_TEXT_DATE_RECEIVED:
+	case ROW_TEXT_DATE_SENT:
+		gtk_tree_model_get (tree_model, iter,
+				    (text == ROW_TEXT_DATE_RECEIVED) ?
+				    TNY_GTK_HEADER_LIST_MODEL_DATE_RECEIVED_TIME_T_COLUMN :
+				    TNY_GTK_HEADER_LIST_MODEL_DATE_SENT_TIME_T_COLUMN, &date,
+				    -1);
+		str = g_strdup (date ? _modest_header_view_get_display_date (self, date) : "");
+		break;
+	default:
+		g_return_val_if_reached ("");
+	}
+
+	newtext = truncate_text (str);
+	if (newtext) {
+		g_free (str);
+		str = newtext;
+	}
+	row->texts[text] = str;
+
+	return str;
+}
+
 void
 _modest_header_view_attach_cell_data (GtkTreeViewColumn *column, GtkCellRenderer *renderer,
 				      GtkTreeModel *tree_model, GtkTreeIter *iter, gpointer user_data)
@@ -234,29 +542,30 @@ _modest_header_view_date_cell_data  (GtkTreeViewColumn *column,  GtkCellRenderer
 				     gpointer user_data)
 {
 	TnyHeaderFlags flags;
-	guint date, date_col;
+	TnyHeader *header = NULL;
+	ModestHeaderView *header_view;
+	HeaderRow *row;
 	gboolean received = GPOINTER_TO_INT(user_data);
 
-	if (received)
-		date_col = TNY_GTK_HEADER_LIST_MODEL_DATE_RECEIVED_TIME_T_COLUMN;
-	else
-		date_col = TNY_GTK_HEADER_LIST_MODEL_DATE_SENT_TIME_T_COLUMN;
-
 	gtk_tree_model_get (tree_model, iter,
 			    TNY_GTK_HEADER_LIST_MODEL_FLAGS_COLUMN, &flags,
-			    date_col, &date,
+			    TNY_GTK_HEADER_LIST_MODEL_INSTANCE_COLUMN, &header,
 			    -1);
+	/* The renderer is shared by all the rows, so it must not keep
+	   the text of the previous one */
+	if (!header) {
+		set_truncated_cell_text (renderer, "", flags);
+		return;
+	}
 
-#if GTK_CHECK_VERSION (2, 12, 0)
-	ModestHeaderView *header_view;
-	header_view = MODEST_HEADER_VIEW (gtk_tree_view_column_get_tree_view (column));
-	set_cell_text (renderer,
-		       _modest_header_view_get_display_date (header_view, date),
-		       flags);
-#else
-	set_cell_text (renderer, modest_text_utils_get_display_date (date),
- 		       flags);
-#endif
+	header_view = get_header_view (column);
+	row = get_header_row (_modest_header_view_get_row_cache (header_view), header, flags);
+	set_truncated_cell_text (renderer,
+				 get_row_text (header_view, row,
+					       (received) ? ROW_TEXT_DATE_RECEIVED : ROW_TEXT_DATE_SENT,
+					       tree_model, iter),
+				 flags);
+	g_object_unref (header);
 }
 
 void
@@ -267,24 +576,27 @@ _modest_header_view_sender_receiver_cell_data  (GtkTreeViewColumn *column,
 						gboolean is_sender)
 {
 	TnyHeaderFlags flags;
-	gchar *address;
-	gint sender_receiver_col;
-
-	if (is_sender)
-		sender_receiver_col = TNY_GTK_HEADER_LIST_MODEL_FROM_COLUMN;
-	else
-		sender_receiver_col = TNY_GTK_HEADER_LIST_MODEL_TO_COLUMN;
+	TnyHeader *header = NULL;
+	ModestHeaderView *header_view;
+	HeaderRow *row;
 
 	gtk_tree_model_get (tree_model, iter,
-			    sender_receiver_col,  &address,
 			    TNY_GTK_HEADER_LIST_MODEL_FLAGS_COLUMN, &flags,
+			    TNY_GTK_HEADER_LIST_MODEL_INSTANCE_COLUMN, &header,
 			    -1);
+	if (!header) {
+		set_truncated_cell_text (renderer, "", flags);
+		return;
+	}
 
-	modest_text_utils_get_display_address (address); /* string is changed in-place */
-
-	set_cell_text (renderer, (address && address[0] != '\0')?address:_("mail_va_no_to"),
-		       flags);
-	g_free (address);
+	header_view = get_header_view (column);
+	row = get_header_row (_modest_header_view_get_row_cache (header_view), header, flags);
+	set_truncated_cell_text (renderer,
+				 get_row_text (header_view, row,
+					       (is_sender) ? ROW_TEXT_FROM : ROW_TEXT_TO,
+					       tree_model, iter),
+				 flags);
+	g_object_unref (header);
 }
 /*
  * this for both incoming and outgoing mail, depending on the the user_data
@@ -296,15 +608,13 @@ _modest_header_view_compact_header_cell_data  (GtkTreeViewColumn *column,  GtkCe
 					       GtkTreeModel *tree_model,  GtkTreeIter *iter,  gpointer user_data)
 {
 	TnyHeaderFlags flags = 0;
-	gchar *recipients = NULL, *addresses;
-	gchar *subject = NULL;
-	time_t date;
 	GtkCellRenderer *recipient_cell, *date_or_status_cell, *subject_cell,
 		*attach_cell, *priority_cell,
 		*recipient_box, *subject_box = NULL;
 	TnyHeader *msg_header = NULL;
 	TnyHeaderFlags prio = 0;
-	gboolean is_calendar = FALSE;
+	ModestHeaderView *header_view;
+	HeaderRow *row;
 
 #ifdef MAEMO_CHANGES
 #ifdef HAVE_GTK_TREE_VIEW_COLUMN_GET_CELL_DATA_HINT
@@ -335,22 +645,24 @@ _modest_header_view_compact_header_cell_data  (GtkTreeViewColumn *column,  GtkCe
 
 	ModestHeaderViewCompactHeaderMode header_mode = GPOINTER_TO_INT (user_data); 
 
-	if (header_mode == MODEST_HEADER_VIEW_COMPACT_HEADER_MODE_IN)
-		gtk_tree_model_get (tree_model, iter,
-				    TNY_GTK_HEADER_LIST_MODEL_FLAGS_COLUMN, &flags,
-				    TNY_GTK_HEADER_LIST_MODEL_FROM_COLUMN,  &recipients,
-				    TNY_GTK_HEADER_LIST_MODEL_SUBJECT_COLUMN, &subject,
-				    TNY_GTK_HEADER_LIST_MODEL_DATE_RECEIVED_TIME_T_COLUMN, &date,
-				    TNY_GTK_HEADER_LIST_MODEL_INSTANCE_COLUMN, &msg_header,
-				    -1);
-	else
-		gtk_tree_model_get (tree_model, iter,
-				    TNY_GTK_HEADER_LIST_MODEL_FLAGS_COLUMN, &flags,
-				    TNY_GTK_HEADER_LIST_MODEL_TO_COLUMN,  &recipients,
-				    TNY_GTK_HEADER_LIST_MODEL_SUBJECT_COLUMN, &subject,
-				    TNY_GTK_HEADER_LIST_MODEL_DATE_SENT_TIME_T_COLUMN, &date,
-				    TNY_GTK_HEADER_LIST_MODEL_INSTANCE_COLUMN, &msg_header,
-				    -1);	
+	/* Only the flags and the header are read from the model, the
+	   texts come from the row cache */
+	gtk_tree_model_get (tree_model, iter,
+			    TNY_GTK_HEADER_LIST_MODEL_FLAGS_COLUMN, &flags,
+			    TNY_GTK_HEADER_LIST_MODEL_INSTANCE_COLUMN, &msg_header,
+			    -1);
+	if (!msg_header) {
+		g_object_set (G_OBJECT (attach_cell), "pixbuf", NULL, NULL);
+		g_object_set (G_OBJECT (priority_cell), "pixbuf", NULL, NULL);
+		set_truncated_cell_text (subject_cell, "", flags);
+		set_truncated_cell_text (recipient_cell, "", flags);
+		set_truncated_cell_text (date_or_status_cell, "", flags);
+		return;
+	}
+
+	header_view = get_header_view (column);
+	row = get_header_row (_modest_header_view_get_row_cache (header_view), msg_header, flags);
+
 	/* flags */
 	/* FIXME: we might gain something by doing all the g_object_set's at once */
 	if (flags & TNY_HEADER_FLAG_ATTACHMENTS)
@@ -361,53 +673,45 @@ _modest_header_view_compact_header_cell_data  (GtkTreeViewColumn *column,  GtkCe
 		g_object_set (G_OBJECT (attach_cell), "pixbuf",
 			      NULL, NULL);
 
-	is_calendar = tny_header_get_user_flag (msg_header, "calendar");
-	if (msg_header) {
-		prio = tny_header_get_priority (msg_header);
-	}
-	
+	prio = tny_header_get_priority (msg_header);
 	g_object_set (G_OBJECT (priority_cell), "pixbuf",
-		      get_pixbuf_for_flag (prio, is_calendar),
+		      get_pixbuf_for_flag (prio, row->is_calendar),
 		      NULL);
 
-	set_cell_text (subject_cell, (subject && subject[0] != 0)?subject:_("mail_va_no_subject"), 
-		       flags);
-	g_free (subject);
+	set_truncated_cell_text (subject_cell,
+				 get_row_text (header_view, row, ROW_TEXT_SUBJECT, tree_model, iter),
+				 flags);
 
 	/* Show the list of senders/recipients */
-	addresses = modest_text_utils_get_display_addresses ((const gchar *) recipients);
-	set_cell_text (recipient_cell, (addresses) ? addresses : _("mail_va_no_to"), flags);
-	g_free (addresses);
-	g_free (recipients);
-
-	/* Show status (outbox folder) or sent date */
+	set_truncated_cell_text (recipient_cell,
+				 get_row_text (header_view, row,
+					       (header_mode == MODEST_HEADER_VIEW_COMPACT_HEADER_MODE_IN) ?
+					       ROW_TEXT_FROM_LIST : ROW_TEXT_TO_LIST,
+					       tree_model, iter),
+				 flags);
+
+	/* Show status (outbox folder) or sent date. The status is not
+	   cached as it changes without changing the header flags */
 	if (header_mode == MODEST_HEADER_VIEW_COMPACT_HEADER_MODE_OUTBOX) {
 		ModestTnySendQueueStatus status = MODEST_TNY_SEND_QUEUE_UNKNOWN;
 		const gchar *status_str = "";
-		if (msg_header != NULL) {
-			status = modest_tny_all_send_queues_get_msg_status (msg_header);
-			if (status == MODEST_TNY_SEND_QUEUE_SUSPENDED) {
-				tny_header_set_flag (msg_header, TNY_HEADER_FLAG_SUSPENDED);
-			}
+
+		status = modest_tny_all_send_queues_get_msg_status (msg_header);
+		if (status == MODEST_TNY_SEND_QUEUE_SUSPENDED) {
+			tny_header_set_flag (msg_header, TNY_HEADER_FLAG_SUSPENDED);
 		}
 
 		status_str = get_status_string (status);
 		set_cell_text (date_or_status_cell, status_str, flags);
 	} else {
-#if GTK_CHECK_VERSION (2, 12, 0)
-		ModestHeaderView *header_view;
-		header_view = MODEST_HEADER_VIEW (gtk_tree_view_column_get_tree_view (column));
-		set_cell_text (date_or_status_cell, 
-			       date ? _modest_header_view_get_display_date (header_view, date) : "",
-			       flags);
-#else
-		set_cell_text (date_or_status_cell, 
-			       date ? modest_text_utils_get_display_date (date) : "",
- 			       flags);
-#endif
+		set_truncated_cell_text (date_or_status_cell,
+					 get_row_text (header_view, row,
+						       (header_mode == MODEST_HEADER_VIEW_COMPACT_HEADER_MODE_IN) ?
+						       ROW_TEXT_DATE_RECEIVED : ROW_TEXT_DATE_SENT,
+						       tree_model, iter),
+					 flags);
 	}
-	if (msg_header != NULL)
-		g_object_unref (msg_header);
+	g_object_unref (msg_header);
 }
 
 
@@ -35,6 +35,7 @@
 #include <tny-error.h>
 #include <tny-merge-folder.h>
 #include <string.h>
+#include <time.h>
 
 #include <modest-header-view.h>
 #include <modest-header-view-priv.h>
@@ -51,6 +52,9 @@
 #include <modest-vbox-cell-renderer.h>
 #include <modest-datetime-formatter.h>
 #include <modest-ui-constants.h>
+#include <modest-trace.h>
+#include <modest-conversation-index.h>
+#include "modest-header-index-model.h"
 #ifdef MODEST_TOOLKIT_HILDON2
 #include <hildon/hildon.h>
 #endif
@@ -73,6 +77,11 @@ static gint          cmp_subject_rows       (GtkTreeModel *tree_model,
 					     GtkTreeIter *iter2,
 					     gpointer user_data);
 
+static gint          cmp_thread_rows        (GtkTreeModel *tree_model,
+					     GtkTreeIter *iter1,
+					     GtkTreeIter *iter2,
+					     gpointer user_data);
+
 static gboolean     filter_row             (GtkTreeModel *model,
 					    GtkTreeIter *iter,
 					    gpointer data);
@@ -128,6 +137,7 @@ static gboolean      modest_header_view_on_expose_event (GtkTreeView *header_vie
 static void         on_notify_style (GObject *obj, GParamSpec *spec, gpointer userdata);
 static void         update_style (ModestHeaderView *self);
 static void         modest_header_view_refilter_by_chunks (ModestHeaderView *self);
+static GtkTreeModel *modest_header_view_get_model (ModestHeaderView *header_view);
 
 typedef enum {
 	HEADER_VIEW_NON_EMPTY,
@@ -174,6 +184,8 @@ struct _ModestHeaderViewPrivate {
 	gboolean notify_status; /* whether or not the filter_row should notify about changes in the filtering */
 
 	ModestDatetimeFormatter *datetime_formatter;
+	ModestHeaderViewRowCache *row_cache;
+	guint day_changed_timeout;
 
 	GtkCellRenderer *renderer_subject;
 	GtkCellRenderer *renderer_address;
@@ -192,6 +204,25 @@ struct _ModestHeaderViewPrivate {
 	GtkTreeModel *filtered_model;
 	GtkTreeIter refilter_iter;
 	gint show_latest;
+
+	/* threaded display, see MODEST_HEADER_VIEW_THREAD_SORT_COLUMN */
+	gboolean threaded;
+	gboolean threads_descending;
+	ModestConversationIndex *conversation_index;
+	gulong threads_changed_handler;
+	guint threads_resort_idle;
+
+	/* two-phase open: the cached headers are shown at once and
+	   then reconciled with the refresh, see start_reconcile */
+	GtkTreeModel *reconcile_model;
+	gboolean reconciling;
+	GHashTable *reconcile_flags;
+	gulong reconcile_handlers[3];
+	GtkAdjustment *anchor_adjustment;
+	gulong anchor_value_handler;
+	GtkTreeRowReference *anchor;
+	gint anchor_y;
+	guint anchor_idle;
 };
 
 typedef struct _HeadersCountChangedHelper HeadersCountChangedHelper;
@@ -207,7 +238,9 @@ struct _HeadersCountChangedHelper {
 
 
 
-#define MODEST_HEADER_VIEW_PTR "modest-header-view"
+/* Folders with at least this number of headers are shown through a
+   ModestHeaderIndexModel instead of a sort and a filter model */
+#define INDEX_MODEL_MIN_HEADERS 10000
 
 #define _HEADER_VIEW_SUBJECT_FOLD "_subject_modest_header_view"
 #define _HEADER_VIEW_FROM_FOLD "_from_modest_header_view"
@@ -382,7 +415,7 @@ remove_all_columns (ModestHeaderView *obj)
 gboolean
 modest_header_view_set_columns (ModestHeaderView *self, const GList *columns, TnyFolderType type)
 {
-	GtkTreeModel *sortable, *filter_model;
+	GtkTreeSortable *sortable;
 	GtkTreeViewColumn *column=NULL;
 	GtkTreeSelection *selection = NULL;
 	GtkCellRenderer *renderer_header,
@@ -486,11 +519,7 @@ modest_header_view_set_columns (ModestHeaderView *self, const GList *columns, Tn
 
 	selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(self));
 	gtk_tree_selection_set_mode(selection, GTK_SELECTION_MULTIPLE);
-	sortable = NULL;
-	filter_model = gtk_tree_view_get_model (GTK_TREE_VIEW (self));
-	if (GTK_IS_TREE_MODEL_FILTER (filter_model)) {
-		sortable = gtk_tree_model_filter_get_model (GTK_TREE_MODEL_FILTER (filter_model));
-	}
+	sortable = modest_header_view_get_sortable (self);
 
 	/* Add new columns */
 	for (cursor = columns; cursor; cursor = g_list_next(cursor)) {
@@ -613,6 +642,10 @@ modest_header_view_set_columns (ModestHeaderView *self, const GList *columns, Tn
 						 TNY_GTK_HEADER_LIST_MODEL_SUBJECT_COLUMN,
 						 (GtkTreeIterCompareFunc) cmp_subject_rows,
 						 compact_column, NULL);
+		gtk_tree_sortable_set_sort_func (GTK_TREE_SORTABLE (sortable),
+						 MODEST_HEADER_VIEW_THREAD_SORT_COLUMN,
+						 (GtkTreeIterCompareFunc) cmp_thread_rows,
+						 compact_column, NULL);
 	}
 
 	update_style (self);
@@ -625,7 +658,422 @@ static void
 datetime_format_changed (ModestDatetimeFormatter *formatter,
 			 ModestHeaderView *self)
 {
+	ModestHeaderViewPrivate *priv = MODEST_HEADER_VIEW_GET_PRIVATE (self);
+
+	_modest_header_view_row_cache_invalidate (priv->row_cache);
+	gtk_widget_queue_draw (GTK_WIDGET (self));
+}
+
+/* Seconds until the next local midnight */
+static guint
+get_seconds_to_next_day (void)
+{
+	struct tm now_tm;
+	time_t now;
+
+	now = time (NULL);
+	localtime_r (&now, &now_tm);
+
+	return (24 - now_tm.tm_hour) * 3600 - now_tm.tm_min * 60 - now_tm.tm_sec + 1;
+}
+
+/* The dates of today are shown as times, so the cached dates must
+   be formatted again when the day changes */
+static gboolean
+on_day_changed (gpointer userdata)
+{
+	ModestHeaderView *self = MODEST_HEADER_VIEW (userdata);
+	ModestHeaderViewPrivate *priv = MODEST_HEADER_VIEW_GET_PRIVATE (self);
+
+	gdk_threads_enter ();
+	_modest_header_view_row_cache_invalidate (priv->row_cache);
+	gtk_widget_queue_draw (GTK_WIDGET (self));
+	gdk_threads_leave ();
+
+	priv->day_changed_timeout = g_timeout_add_seconds (get_seconds_to_next_day (),
+							   on_day_changed, self);
+
+	return FALSE;
+}
+
+/* Installing the sort function of the current sort column sorts
+   the model again. It's only needed when threads that were already
+   shown are merged or split, the new messages are just inserted in
+   their thread */
+static gboolean
+resort_threads_idle (gpointer userdata)
+{
+	ModestHeaderView *self = MODEST_HEADER_VIEW (userdata);
+	ModestHeaderViewPrivate *priv = MODEST_HEADER_VIEW_GET_PRIVATE (self);
+	GtkTreeSortable *sortable;
+	GList *cols;
+
+	gdk_threads_enter ();
+	priv->threads_resort_idle = 0;
+
+	sortable = modest_header_view_get_sortable (self);
+	cols = gtk_tree_view_get_columns (GTK_TREE_VIEW (self));
+	if (priv->threaded && cols && sortable) {
+		gtk_tree_sortable_set_sort_func (sortable,
+						 MODEST_HEADER_VIEW_THREAD_SORT_COLUMN,
+						 (GtkTreeIterCompareFunc) cmp_thread_rows,
+						 cols->data, NULL);
+	}
+	g_list_free (cols);
+
+	/* The replies are rendered differently */
+	_modest_header_view_row_cache_invalidate (priv->row_cache);
 	gtk_widget_queue_draw (GTK_WIDGET (self));
+	gdk_threads_leave ();
+
+	return FALSE;
+}
+
+/* It's handled in an idle, so a batch of new headers that merge
+   threads sorts the model once */
+static void
+on_threads_changed (ModestConversationIndex *index,
+		    ModestHeaderView *self)
+{
+	ModestHeaderViewPrivate *priv = MODEST_HEADER_VIEW_GET_PRIVATE (self);
+
+	if (priv->threads_resort_idle == 0)
+		priv->threads_resort_idle = g_idle_add (resort_threads_idle, self);
+}
+
+static void
+clear_conversation_index (ModestHeaderView *self)
+{
+	ModestHeaderViewPrivate *priv = MODEST_HEADER_VIEW_GET_PRIVATE (self);
+
+	if (priv->threads_resort_idle > 0) {
+		g_source_remove (priv->threads_resort_idle);
+		priv->threads_resort_idle = 0;
+	}
+
+	if (priv->conversation_index) {
+		if (g_signal_handler_is_connected (priv->conversation_index,
+						   priv->threads_changed_handler))
+			g_signal_handler_disconnect (priv->conversation_index,
+						     priv->threads_changed_handler);
+		priv->threads_changed_handler = 0;
+		g_object_unref (priv->conversation_index);
+		priv->conversation_index = NULL;
+	}
+}
+
+static void
+add_to_conversation_index (ModestHeaderView *self,
+			   GtkTreeModel *headers_model,
+			   GtkTreeIter *iter)
+{
+	ModestHeaderViewPrivate *priv = MODEST_HEADER_VIEW_GET_PRIVATE (self);
+	TnyHeader *header = NULL;
+
+	gtk_tree_model_get (headers_model, iter,
+			    TNY_GTK_HEADER_LIST_MODEL_INSTANCE_COLUMN, &header,
+			    -1);
+	if (header) {
+		modest_conversation_index_add_header (priv->conversation_index, header);
+		g_object_unref (header);
+	}
+}
+
+/* The headers are added to the conversation index when they're
+   inserted, so the sort function does not need to modify it. This
+   handler is connected before the sortable model is created, so it
+   runs before the new row is sorted */
+static void
+on_headers_row_inserted (GtkTreeModel *headers_model,
+			 GtkTreePath *path,
+			 GtkTreeIter *iter,
+			 ModestHeaderView *self)
+{
+	ModestHeaderViewPrivate *priv = MODEST_HEADER_VIEW_GET_PRIVATE (self);
+
+	if (priv->conversation_index)
+		add_to_conversation_index (self, headers_model, iter);
+}
+
+/* The conversation index of the folder is only loaded while the
+   headers are sorted by thread, then the headers already in
+   @headers_model are added. Returns TRUE if it was loaded now */
+static gboolean
+set_threaded (ModestHeaderView *self,
+	      TnyFolder *folder,
+	      GtkTreeModel *headers_model,
+	      gint sort_colid,
+	      GtkSortType sort_type)
+{
+	ModestHeaderViewPrivate *priv = MODEST_HEADER_VIEW_GET_PRIVATE (self);
+	gboolean threaded;
+
+	threaded = (sort_colid == MODEST_HEADER_VIEW_THREAD_SORT_COLUMN);
+	if (threaded != priv->threaded)
+		_modest_header_view_row_cache_invalidate (priv->row_cache);
+	priv->threaded = threaded;
+	priv->threads_descending = (sort_type == GTK_SORT_DESCENDING);
+
+	if (!threaded) {
+		clear_conversation_index (self);
+	} else if (!priv->conversation_index && folder) {
+		priv->conversation_index = modest_conversation_index_get_for_folder (folder);
+		if (priv->conversation_index) {
+			GtkTreeIter iter;
+			gboolean valid;
+
+			priv->threads_changed_handler =
+				g_signal_connect (G_OBJECT (priv->conversation_index), "threads-changed",
+						  G_CALLBACK (on_threads_changed), self);
+
+			valid = headers_model && gtk_tree_model_get_iter_first (headers_model, &iter);
+			while (valid) {
+				add_to_conversation_index (self, headers_model, &iter);
+				valid = gtk_tree_model_iter_next (headers_model, &iter);
+			}
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/* The first visible row is the anchor of the scroll position while
+   the headers of the folder are loaded and reconciled. It's taken
+   again every time the view scrolls, and there is no anchor at the
+   top of the list, so the new headers sorted first are shown */
+static void
+take_anchor (ModestHeaderView *self)
+{
+	ModestHeaderViewPrivate *priv = MODEST_HEADER_VIEW_GET_PRIVATE (self);
+	GtkTreePath *start = NULL;
+	GdkRectangle area;
+
+	if (priv->anchor) {
+		gtk_tree_row_reference_free (priv->anchor);
+		priv->anchor = NULL;
+	}
+
+	if (gtk_adjustment_get_value (priv->anchor_adjustment) > 0 &&
+	    gtk_tree_view_get_visible_range (GTK_TREE_VIEW (self), &start, NULL)) {
+		gtk_tree_view_get_background_area (GTK_TREE_VIEW (self), start, NULL, &area);
+		priv->anchor = gtk_tree_row_reference_new (priv->reconcile_model, start);
+		priv->anchor_y = area.y;
+		gtk_tree_path_free (start);
+	}
+}
+
+static void
+on_anchor_value_changed (GtkAdjustment *adjustment,
+			 ModestHeaderView *self)
+{
+	take_anchor (self);
+}
+
+/* Scrolls back to the anchor after the headers above it changed. It
+   runs after the tree view has been resized and before it's
+   repainted */
+static gboolean
+restore_anchor_idle (gpointer userdata)
+{
+	ModestHeaderView *self = MODEST_HEADER_VIEW (userdata);
+	ModestHeaderViewPrivate *priv = MODEST_HEADER_VIEW_GET_PRIVATE (self);
+
+	gdk_threads_enter ();
+	priv->anchor_idle = 0;
+
+	if (priv->anchor && gtk_tree_row_reference_valid (priv->anchor)) {
+		GtkTreePath *path;
+		GdkRectangle area;
+
+		path = gtk_tree_row_reference_get_path (priv->anchor);
+		gtk_tree_view_get_background_area (GTK_TREE_VIEW (self), path, NULL, &area);
+		if (area.y != priv->anchor_y)
+			gtk_adjustment_set_value (priv->anchor_adjustment,
+						  gtk_adjustment_get_value (priv->anchor_adjustment) +
+						  area.y - priv->anchor_y);
+		gtk_tree_path_free (path);
+	} else if (priv->anchor) {
+		/* The anchor was removed, keep the current position */
+		take_anchor (self);
+	}
+	gdk_threads_leave ();
+
+	return FALSE;
+}
+
+static void
+on_reconcile_rows_changed (ModestHeaderView *self)
+{
+	ModestHeaderViewPrivate *priv = MODEST_HEADER_VIEW_GET_PRIVATE (self);
+
+	if (priv->anchor && priv->anchor_idle == 0)
+		priv->anchor_idle = g_idle_add_full (GTK_PRIORITY_RESIZE + 1,
+						     restore_anchor_idle, self, NULL);
+}
+
+/* Remembers the flags of the cached headers, to find the ones that
+   the refresh changes */
+static void
+snapshot_reconcile_flags (ModestHeaderView *self,
+			  TnyList *headers)
+{
+	ModestHeaderViewPrivate *priv = MODEST_HEADER_VIEW_GET_PRIVATE (self);
+	TnyIterator *iter;
+
+	if (priv->reconcile_flags)
+		g_hash_table_destroy (priv->reconcile_flags);
+	priv->reconcile_flags = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	iter = tny_list_create_iterator (headers);
+	while (!tny_iterator_is_done (iter)) {
+		TnyHeader *header = TNY_HEADER (tny_iterator_get_current (iter));
+		gchar *uid = tny_header_dup_uid (header);
+
+		if (uid)
+			g_hash_table_insert (priv->reconcile_flags, uid,
+					     GUINT_TO_POINTER (tny_header_get_flags (header)));
+		g_object_unref (header);
+		tny_iterator_next (iter);
+	}
+	g_object_unref (iter);
+}
+
+/* The headers added and expunged by the refresh get into the model
+   through the folder monitor. Here, once the refresh finishes, the
+   rows whose flags changed are notified, so they're painted, sorted
+   and filtered again without replacing the model */
+static void
+notify_reconciled_flags (ModestHeaderView *self)
+{
+	ModestHeaderViewPrivate *priv = MODEST_HEADER_VIEW_GET_PRIVATE (self);
+	GtkTreeModel *model;
+	GtkTreeIter iter;
+
+	priv->reconciling = FALSE;
+	if (!priv->reconcile_flags)
+		return;
+
+	model = modest_header_view_get_model (self);
+	if (!model || !gtk_tree_model_get_iter_first (model, &iter))
+		goto frees;
+
+	do {
+		TnyHeader *header = NULL;
+		TnyHeaderFlags flags;
+		gpointer old_flags;
+		gchar *uid;
+
+		gtk_tree_model_get (model, &iter,
+				    TNY_GTK_HEADER_LIST_MODEL_INSTANCE_COLUMN, &header,
+				    TNY_GTK_HEADER_LIST_MODEL_FLAGS_COLUMN, &flags,
+				    -1);
+		if (!header)
+			continue;
+
+		uid = tny_header_dup_uid (header);
+		if (uid && g_hash_table_lookup_extended (priv->reconcile_flags, uid, NULL, &old_flags) &&
+		    GPOINTER_TO_UINT (old_flags) != (guint) flags) {
+			GtkTreePath *path = gtk_tree_model_get_path (model, &iter);
+			gtk_tree_model_row_changed (model, path, &iter);
+			gtk_tree_path_free (path);
+		}
+		g_free (uid);
+		g_object_unref (header);
+	} while (gtk_tree_model_iter_next (model, &iter));
+
+ frees:
+	g_hash_table_destroy (priv->reconcile_flags);
+	priv->reconcile_flags = NULL;
+}
+
+/* Called when the model of a folder is set. The cached headers are
+   shown while the folder is refreshed (@refresh), and from now on
+   the visible rows keep their scroll position when headers are
+   added or removed above them */
+static void
+start_reconcile (ModestHeaderView *self, gboolean refresh)
+{
+	ModestHeaderViewPrivate *priv = MODEST_HEADER_VIEW_GET_PRIVATE (self);
+	GtkAdjustment *adjustment;
+	GtkTreeModel *model;
+
+	priv->reconciling = refresh;
+	model = gtk_tree_view_get_model (GTK_TREE_VIEW (self));
+	adjustment = gtk_tree_view_get_vadjustment (GTK_TREE_VIEW (self));
+	if (!model || !adjustment)
+		return;
+
+	priv->reconcile_model = g_object_ref (model);
+	priv->reconcile_handlers[0] =
+		g_signal_connect_swapped (priv->reconcile_model, "row-inserted",
+					  G_CALLBACK (on_reconcile_rows_changed), self);
+	priv->reconcile_handlers[1] =
+		g_signal_connect_swapped (priv->reconcile_model, "row-deleted",
+					  G_CALLBACK (on_reconcile_rows_changed), self);
+	priv->reconcile_handlers[2] =
+		g_signal_connect_swapped (priv->reconcile_model, "rows-reordered",
+					  G_CALLBACK (on_reconcile_rows_changed), self);
+
+	priv->anchor_adjustment = g_object_ref (adjustment);
+	priv->anchor_value_handler =
+		g_signal_connect (adjustment, "value-changed",
+				  G_CALLBACK (on_anchor_value_changed), self);
+	take_anchor (self);
+}
+
+static void
+stop_reconcile (ModestHeaderView *self)
+{
+	ModestHeaderViewPrivate *priv = MODEST_HEADER_VIEW_GET_PRIVATE (self);
+	guint i;
+
+	if (priv->anchor_idle > 0) {
+		g_source_remove (priv->anchor_idle);
+		priv->anchor_idle = 0;
+	}
+
+	if (priv->anchor) {
+		gtk_tree_row_reference_free (priv->anchor);
+		priv->anchor = NULL;
+	}
+
+	if (priv->anchor_adjustment) {
+		g_signal_handler_disconnect (priv->anchor_adjustment, priv->anchor_value_handler);
+		g_object_unref (priv->anchor_adjustment);
+		priv->anchor_adjustment = NULL;
+		priv->anchor_value_handler = 0;
+	}
+
+	if (priv->reconcile_model) {
+		for (i = 0; i < G_N_ELEMENTS (priv->reconcile_handlers); i++) {
+			if (g_signal_handler_is_connected (priv->reconcile_model,
+							   priv->reconcile_handlers[i]))
+				g_signal_handler_disconnect (priv->reconcile_model,
+							     priv->reconcile_handlers[i]);
+			priv->reconcile_handlers[i] = 0;
+		}
+		g_object_unref (priv->reconcile_model);
+		priv->reconcile_model = NULL;
+	}
+
+	if (priv->reconcile_flags) {
+		g_hash_table_destroy (priv->reconcile_flags);
+		priv->reconcile_flags = NULL;
+	}
+	priv->reconciling = FALSE;
+}
+
+gboolean
+_modest_header_view_is_thread_reply (ModestHeaderView *self,
+				     TnyHeader *header)
+{
+	ModestHeaderViewPrivate *priv = MODEST_HEADER_VIEW_GET_PRIVATE (self);
+
+	if (!priv->threaded || !priv->conversation_index)
+		return FALSE;
+
+	return modest_conversation_index_is_reply (priv->conversation_index, header);
 }
 
 static void
@@ -668,6 +1116,21 @@ modest_header_view_init (ModestHeaderView *obj)
 	priv->filtered_model = NULL;
 	priv->refilter_handler_id = 0;
 
+	priv->threaded = FALSE;
+	priv->threads_descending = TRUE;
+	priv->conversation_index = NULL;
+	priv->threads_changed_handler = 0;
+	priv->threads_resort_idle = 0;
+
+	priv->reconcile_model = NULL;
+	priv->reconciling = FALSE;
+	priv->reconcile_flags = NULL;
+	priv->anchor_adjustment = NULL;
+	priv->anchor_value_handler = 0;
+	priv->anchor = NULL;
+	priv->anchor_y = 0;
+	priv->anchor_idle = 0;
+
 	/* Sort parameters */
 	for (j=0; j < 2; j++) {
 		for (i=0; i < TNY_FOLDER_TYPE_NUM; i++) {
@@ -680,6 +1143,10 @@ modest_header_view_init (ModestHeaderView *obj)
 	g_signal_connect (G_OBJECT (priv->datetime_formatter), "format-changed",
 			  G_CALLBACK (datetime_format_changed), (gpointer) obj);
 
+	priv->row_cache = _modest_header_view_row_cache_new ();
+	priv->day_changed_timeout = g_timeout_add_seconds (get_seconds_to_next_day (),
+							   on_day_changed, obj);
+
 	setup_drag_and_drop (GTK_WIDGET(obj));
 }
 
@@ -706,6 +1173,14 @@ modest_header_view_dispose (GObject *obj)
 	}
 #endif
 
+	if (priv->day_changed_timeout > 0) {
+		g_source_remove (priv->day_changed_timeout);
+		priv->day_changed_timeout = 0;
+	}
+
+	clear_conversation_index (self);
+	stop_reconcile (self);
+
 	if (priv->datetime_formatter) {
 		g_object_unref (priv->datetime_formatter);
 		priv->datetime_formatter = NULL;
@@ -773,6 +1248,8 @@ modest_header_view_finalize (GObject *obj)
 		g_strfreev (priv->filter_string_splitted);
 	}
 
+	_modest_header_view_row_cache_free (priv->row_cache);
+
 	G_OBJECT_CLASS(parent_class)->finalize (obj);
 }
 
@@ -1176,18 +1653,22 @@ set_folder_intern_get_headers_async_cb (TnyFolder *folder,
 	tny_folder_monitor_add_list (priv->monitor, TNY_LIST (headers));
 	tny_folder_monitor_start (priv->monitor);
 	g_mutex_unlock (priv->observers_lock);
+
+	/* These are the cached headers, the refresh could change them */
+	if (priv->reconciling && folder == priv->folder)
+		snapshot_reconcile_flags (self, headers);
 }
 
 static void
 modest_header_view_set_folder_intern (ModestHeaderView *self,
-				      TnyFolder *folder,
-				      gboolean refresh)
+				      TnyFolder *folder)
 {
 	TnyFolderType type;
 	TnyList *headers;
 	ModestHeaderViewPrivate *priv;
 	GList *cols, *cursor;
 	GtkTreeModel *filter_model, *sortable;
+	gboolean use_index;
 	guint sort_colid;
 	GtkSortType sort_type;
 
@@ -1197,6 +1678,10 @@ modest_header_view_set_folder_intern (ModestHeaderView *self,
 	tny_gtk_header_list_model_set_update_in_batches (TNY_GTK_HEADER_LIST_MODEL (headers), 300);
 	tny_gtk_header_list_model_set_show_latest (TNY_GTK_HEADER_LIST_MODEL (headers), priv->show_latest);
 
+	/* Before creating the sortable model, see on_headers_row_inserted */
+	g_signal_connect_object (G_OBJECT (headers), "row-inserted",
+				 G_CALLBACK (on_headers_row_inserted), self, 0);
+
 	/* Start the monitor in the callback of the
 	   tny_gtk_header_list_model_set_folder call. It's crucial to
 	   do it there and not just after the call because we want the
@@ -1209,23 +1694,37 @@ modest_header_view_set_folder_intern (ModestHeaderView *self,
 	   invoked, then the first call could add a header that will
 	   be added again by tny_gtk_header_list_model_set_folder, so
 	   we'd end up with duplicate headers. sergio */
+	/* The headers are read from the local summary without
+	   refreshing, so they're shown at once. The refresh of
+	   modest_header_view_set_folder updates them later through
+	   the monitor */
 	tny_gtk_header_list_model_set_folder (TNY_GTK_HEADER_LIST_MODEL(headers),
-					      folder, refresh,
+					      folder, FALSE,
 					      set_folder_intern_get_headers_async_cb,
 					      NULL, self);
 
 	/* Init filter_row function to examine empty status */
 	priv->status  = HEADER_VIEW_INIT;
 
-	/* Create sortable model */
-	sortable = gtk_tree_model_sort_new_with_model (GTK_TREE_MODEL (headers));
-	g_object_unref (headers);
+	/* The big folders are sorted and filtered by a single index
+	   model, that doesn't keep a node per row in each layer */
+	use_index = (tny_folder_get_all_count (folder) >= INDEX_MODEL_MIN_HEADERS);
+	if (use_index) {
+		filter_model = modest_header_index_model_new (GTK_TREE_MODEL (headers));
+		modest_header_index_model_set_visible_func (MODEST_HEADER_INDEX_MODEL (filter_model),
+							    filter_row, self, NULL);
+		sortable = filter_model;
+	} else {
+		/* Create sortable model */
+		sortable = gtk_tree_model_sort_new_with_model (GTK_TREE_MODEL (headers));
 
-	/* Create a tree model filter to hide and show rows for cut operations  */
-	filter_model = gtk_tree_model_filter_new (GTK_TREE_MODEL (sortable), NULL);
-	gtk_tree_model_filter_set_visible_func (GTK_TREE_MODEL_FILTER (filter_model),
-						filter_row, self, NULL);
-	g_object_unref (sortable);
+		/* Create a tree model filter to hide and show rows for cut operations  */
+		filter_model = gtk_tree_model_filter_new (GTK_TREE_MODEL (sortable), NULL);
+		gtk_tree_model_filter_set_visible_func (GTK_TREE_MODEL_FILTER (filter_model),
+							filter_row, self, NULL);
+		g_object_unref (sortable);
+	}
+	g_object_unref (headers);
 
 	/* install our special sorting functions */
 	cursor = cols = gtk_tree_view_get_columns (GTK_TREE_VIEW(self));
@@ -1249,9 +1748,17 @@ modest_header_view_set_folder_intern (ModestHeaderView *self,
 						 TNY_GTK_HEADER_LIST_MODEL_SUBJECT_COLUMN,
 						 (GtkTreeIterCompareFunc) cmp_subject_rows,
 						 cols->data, NULL);
+		gtk_tree_sortable_set_sort_func (GTK_TREE_SORTABLE (sortable),
+						 MODEST_HEADER_VIEW_THREAD_SORT_COLUMN,
+						 (GtkTreeIterCompareFunc) cmp_thread_rows,
+						 cols->data, NULL);
+		if (set_threaded (self, folder, GTK_TREE_MODEL (headers), sort_colid, sort_type))
+			on_threads_changed (priv->conversation_index, self);
 	}
 
-	/* Set new model */
+	/* Set new model. The rows of the previous folder won't be
+	   painted again */
+	_modest_header_view_row_cache_clear (priv->row_cache);
 	gtk_tree_view_set_model (GTK_TREE_VIEW (self), filter_model);
 	modest_header_view_notify_observers (self, sortable, tny_folder_get_id (folder));
 	g_object_unref (filter_model);
@@ -1266,7 +1773,7 @@ modest_header_view_sort_by_column_id (ModestHeaderView *self,
 				      GtkSortType sort_type)
 {
 	ModestHeaderViewPrivate *priv = NULL;
-	GtkTreeModel *sortable = NULL, *filter_model = NULL;
+	GtkTreeSortable *sortable = NULL;
 	TnyFolderType type;
 
 	g_return_if_fail (self && MODEST_IS_HEADER_VIEW(self));
@@ -1274,17 +1781,31 @@ modest_header_view_sort_by_column_id (ModestHeaderView *self,
 
 	/* Get model and private data */
 	priv = MODEST_HEADER_VIEW_GET_PRIVATE (self);
-	filter_model = gtk_tree_view_get_model (GTK_TREE_VIEW (self));
-	if (GTK_IS_TREE_MODEL_FILTER (filter_model)) {
-		sortable = gtk_tree_model_filter_get_model (GTK_TREE_MODEL_FILTER (filter_model));
-	}
+	sortable = modest_header_view_get_sortable (self);
 
 	/* Sort tree model */
 	type  = modest_tny_folder_guess_folder_type (priv->folder);
 	if (type == TNY_FOLDER_TYPE_INVALID)
 		g_warning ("%s: BUG: TNY_FOLDER_TYPE_INVALID", __FUNCTION__);
 	else {
-		gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (sortable),
+		GtkTreeModel *headers_model = NULL;
+		gint current_colid;
+		GtkSortType current_type;
+
+		if (MODEST_IS_HEADER_INDEX_MODEL (sortable))
+			headers_model = modest_header_index_model_get_model (MODEST_HEADER_INDEX_MODEL (sortable));
+		else if (GTK_IS_TREE_MODEL_SORT (sortable))
+			headers_model = gtk_tree_model_sort_get_model (GTK_TREE_MODEL_SORT (sortable));
+
+		/* The index must be loaded before sorting. If the
+		   model was already sorted by thread without it, then
+		   setting the same sort column would not sort it again */
+		if (set_threaded (self, priv->folder, headers_model, sort_colid, sort_type) &&
+		    gtk_tree_sortable_get_sort_column_id (sortable,
+							  &current_colid, &current_type) &&
+		    current_colid == (gint) sort_colid && current_type == sort_type)
+			on_threads_changed (priv->conversation_index, self);
+		gtk_tree_sortable_set_sort_column_id (sortable,
 						      sort_colid,
 						      sort_type);
 		/* Store new sort parameters */
@@ -1362,6 +1883,10 @@ folder_refreshed_cb (ModestMailOperation *mail_op,
 
 	priv = MODEST_HEADER_VIEW_GET_PRIVATE(info->header_view);
 
+	/* Apply the flag changes to the cached headers */
+	if (priv->folder == folder)
+		notify_reconciled_flags (info->header_view);
+
 	/* User callback */
 	if (info->cb)
 		info->cb (mail_op, folder, info->user_data);
@@ -1434,6 +1959,9 @@ modest_header_view_set_folder (ModestHeaderView *self,
 		g_object_unref (priv->folder);
 		priv->folder = NULL;
 		g_mutex_unlock (priv->observers_lock);
+
+		clear_conversation_index (self);
+		stop_reconcile (self);
 	}
 
 	if (folder) {
@@ -1442,10 +1970,11 @@ modest_header_view_set_folder (ModestHeaderView *self,
 		ModestMailOperation *mail_op = NULL;
 
 		/* Set folder in the model */
-		modest_header_view_set_folder_intern (self, folder, refresh);
+		modest_header_view_set_folder_intern (self, folder);
 
 		/* Pick my reference. Nothing to do with the mail operation */
 		priv->folder = g_object_ref (folder);
+		start_reconcile (self, refresh);
 
 		/* Do not notify about filterings until the refresh finishes */
 		priv->notify_status = FALSE;
@@ -1500,6 +2029,7 @@ modest_header_view_set_folder (ModestHeaderView *self,
 		}
 
 		gtk_tree_view_set_model (GTK_TREE_VIEW (self), NULL);
+		_modest_header_view_row_cache_clear (priv->row_cache);
 
 		modest_header_view_notify_observers(self, NULL, NULL);
 
@@ -1545,6 +2075,7 @@ on_header_row_activated (GtkTreeView *treeview, GtkTreePath *path,
 	}
 
 	/* Emit signal */
+	modest_trace_mark ("header-view:activated", NULL);
 	g_signal_emit (G_OBJECT(self),
 		       signals[HEADER_ACTIVATED_SIGNAL],
 		       0, header, path);
@@ -1720,6 +2251,44 @@ cmp_subject_rows (GtkTreeModel *tree_model, GtkTreeIter *iter1, GtkTreeIter *ite
 	return cmp;
 }
 
+static gint
+cmp_thread_rows (GtkTreeModel *tree_model, GtkTreeIter *iter1, GtkTreeIter *iter2,
+		 gpointer user_data)
+{
+	ModestHeaderView *self;
+	ModestHeaderViewPrivate *priv;
+	TnyHeader *header1 = NULL, *header2 = NULL;
+	gint cmp = 0;
+
+	g_return_val_if_fail (GTK_IS_TREE_VIEW_COLUMN(user_data), 0);
+
+	self = MODEST_HEADER_VIEW (g_object_get_data (G_OBJECT (user_data), MODEST_HEADER_VIEW_PTR));
+	priv = MODEST_HEADER_VIEW_GET_PRIVATE (self);
+	if (!priv->conversation_index)
+		return 0;
+
+	gtk_tree_model_get (tree_model, iter1, TNY_GTK_HEADER_LIST_MODEL_INSTANCE_COLUMN, &header1, -1);
+	gtk_tree_model_get (tree_model, iter2, TNY_GTK_HEADER_LIST_MODEL_INSTANCE_COLUMN, &header2, -1);
+
+	if (header1 && header2) {
+		cmp = modest_conversation_index_compare (priv->conversation_index,
+							 header1, header2,
+							 priv->threads_descending);
+		/* The sort order only applies to the threads, the
+		   messages of a thread are always shown the oldest
+		   first, so undo the reversal of the sortable model */
+		if (priv->threads_descending)
+			cmp = -cmp;
+	}
+
+	if (header1)
+		g_object_unref (header1);
+	if (header2)
+		g_object_unref (header2);
+
+	return cmp;
+}
+
 /* Drag and drop stuff */
 static void
 drag_data_get_cb (GtkWidget *widget,
@@ -2403,6 +2972,11 @@ modest_header_view_refilter (ModestHeaderView *header_view)
 	if (GTK_IS_TREE_MODEL_FILTER (filter_model)) {
 		priv->status = HEADER_VIEW_INIT;
 		modest_header_view_refilter_by_chunks (header_view);
+	} else if (MODEST_IS_HEADER_INDEX_MODEL (filter_model)) {
+		/* The index model refilters all the rows in a single
+		   pass, there are no nodes to revisit */
+		priv->status = HEADER_VIEW_INIT;
+		modest_header_index_model_refilter (MODEST_HEADER_INDEX_MODEL (filter_model));
 	}
 }
 
@@ -2508,6 +3082,12 @@ _modest_header_view_get_display_date (ModestHeaderView *self, time_t date)
 	return modest_datetime_formatter_display_datetime (priv->datetime_formatter, date);
 }
 
+ModestHeaderViewRowCache *
+_modest_header_view_get_row_cache (ModestHeaderView *self)
+{
+	return MODEST_HEADER_VIEW_GET_PRIVATE (self)->row_cache;
+}
+
 void
 modest_header_view_set_filter (ModestHeaderView *self,
 			       ModestHeaderViewFilter filter)
@@ -2543,6 +3123,7 @@ on_notify_style (GObject *obj, GParamSpec *spec, gpointer userdata)
 {
 	if (strcmp ("style", spec->name) == 0) {
 		update_style (MODEST_HEADER_VIEW (obj));
+		_modest_header_view_row_cache_invalidate (MODEST_HEADER_VIEW_GET_PRIVATE (obj)->row_cache);
 		gtk_widget_queue_draw (GTK_WIDGET (obj));
 	}
 }
@@ -2797,11 +3378,29 @@ modest_header_view_get_model(ModestHeaderView *header_view)
 		if (GTK_IS_TREE_MODEL_SORT (sortable)) {
 			return gtk_tree_model_sort_get_model (GTK_TREE_MODEL_SORT (sortable));
 		}
+	} else if (MODEST_IS_HEADER_INDEX_MODEL (filter)) {
+		return modest_header_index_model_get_model (MODEST_HEADER_INDEX_MODEL (filter));
 	}
 
 	return NULL;
 }
 
+GtkTreeSortable *
+modest_header_view_get_sortable (ModestHeaderView *self)
+{
+	GtkTreeModel *model;
+
+	g_return_val_if_fail (MODEST_IS_HEADER_VIEW (self), NULL);
+
+	model = gtk_tree_view_get_model (GTK_TREE_VIEW (self));
+	if (GTK_IS_TREE_MODEL_FILTER (model))
+		return GTK_TREE_SORTABLE (gtk_tree_model_filter_get_model (GTK_TREE_MODEL_FILTER (model)));
+	else if (MODEST_IS_HEADER_INDEX_MODEL (model))
+		return GTK_TREE_SORTABLE (model);
+
+	return NULL;
+}
+
 #ifdef MODEST_TOOLKIT_HILDON2
 static gboolean
 on_live_search_timeout (ModestHeaderView *self)
@@ -2875,7 +3474,8 @@ refilter_idle_handler (gpointer userdata)
 
 	priv = MODEST_HEADER_VIEW_GET_PRIVATE (self);
 	filter_model = gtk_tree_view_get_model (GTK_TREE_VIEW (self));
-	filtered_model = gtk_tree_model_filter_get_model (GTK_TREE_MODEL_FILTER (filter_model));
+	filtered_model = GTK_IS_TREE_MODEL_FILTER (filter_model) ?
+		gtk_tree_model_filter_get_model (GTK_TREE_MODEL_FILTER (filter_model)) : NULL;
 
 	if (filtered_model != priv->filtered_model) {
 		priv->refilter_handler_id = 0;
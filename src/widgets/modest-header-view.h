@@ -61,6 +61,12 @@ struct _ModestHeaderView {
 #define MODEST_HEADER_VIEW_COLUMN    "header-view-column"
 #define MODEST_HEADER_VIEW_FLAG_SORT "header-view-flags-sort"
 
+/* sort column id that shows the headers grouped in conversations,
+   see #ModestConversationIndex. The sort type applies to the order
+   of the threads, the messages of a thread are always shown the
+   oldest first */
+#define MODEST_HEADER_VIEW_THREAD_SORT_COLUMN TNY_GTK_HEADER_LIST_MODEL_N_COLUMNS
+
 typedef enum _ModestHeaderViewColumn {
 	MODEST_HEADER_VIEW_COLUMN_FROM,
 	MODEST_HEADER_VIEW_COLUMN_TO,
@@ -325,6 +331,19 @@ modest_header_view_get_sort_column_id (ModestHeaderView *self, TnyFolderType typ
 GtkSortType
 modest_header_view_get_sort_type (ModestHeaderView *self, TnyFolderType type);
 
+/**
+ * modest_header_view_get_sortable:
+ * @self: a #ModestHeaderView
+ *
+ * Gets the model of the view that sorts the headers. It's not the
+ * model set in the view, that also filters them.
+ *
+ * Returns: a #GtkTreeSortable, or %NULL if no folder is shown. The
+ * caller does not own a reference
+ **/
+GtkTreeSortable*
+modest_header_view_get_sortable (ModestHeaderView *self);
+
 /**
  * modest_header_view_set_sort_params:
  * @self: a #ModestHeaderView
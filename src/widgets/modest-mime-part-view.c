@@ -36,6 +36,7 @@ enum {
 	ACTIVATE_LINK,
 	LINK_HOVER,
 	FETCH_URL,
+	RENDERED,
 	LAST_SIGNAL
 };
 
@@ -162,6 +163,23 @@ modest_mime_part_view_base_init (gpointer g_class)
 				      G_TYPE_BOOLEAN, 2,
 				      G_TYPE_STRING,
 				      G_TYPE_OBJECT);
+
+		/**
+		 * ModestMimePartView::rendered:
+		 * @self: a #ModestMimePartView instance the signal is emitted
+		 *
+		 * This signal is emitted when the part set in the view
+		 * has been completely rendered. It's not emitted for
+		 * the parts replaced before finishing
+		 */
+		mime_part_view_signals[RENDERED] =
+			g_signal_new ("rendered",
+				      MODEST_TYPE_MIME_PART_VIEW,
+				      G_SIGNAL_RUN_FIRST,
+				      G_STRUCT_OFFSET (ModestMimePartViewIface, rendered),
+				      NULL, NULL,
+				      g_cclosure_marshal_VOID__VOID,
+				      G_TYPE_NONE, 0);
 		initialized = TRUE;
 	}
 }
@@ -52,6 +52,7 @@ struct _ModestMimePartViewIface
 	gboolean (*activate_link) (ModestMimePartView *self, const gchar *uri);
 	gboolean (*link_hover)    (ModestMimePartView *self, const gchar *uri);
 	gboolean (*fetch_url)     (ModestMimePartView *self, const gchar *uri, TnyStream *stream);
+	void     (*rendered)      (ModestMimePartView *self);
 	
 	/* virtuals */
 	gboolean (*is_empty_func) (ModestMimePartView *self);
@@ -60,6 +60,8 @@
 #include "modest-tny-account.h"
 #include "modest-address-book.h"
 #include "modest-text-utils.h"
+#include "modest-autosave.h"
+#include "modest-file-stream.h"
 #include <tny-simple-list.h>
 #include <modest-wp-text-view.h>
 #include <wptextbuffer.h>
@@ -101,9 +103,42 @@
 #define MAX_FROM_VALUE 36
 #define MAX_BODY_LENGTH 128*1024
 #define MAX_BODY_LINES 2048
+#define AUTOSAVE_URI_KEY "modest-autosave-uri"
+#define IMAGE_READ_BUFFER_SIZE (32*1024)
+#define IMAGE_DECODER_THREADS 2
 
 static gboolean is_wp_text_buffer_started = FALSE;
 
+/* The images are decoded and scaled by these threads, see
+   decode_image_async */
+static GThreadPool *image_decoder = NULL;
+
+typedef struct {
+	GdkPixbuf *pixbuf;
+	guint64    stream_size;
+} ImageCacheEntry;
+
+typedef struct {
+	ModestMsgEditWindow *window;
+	GtkTextBuffer       *buffer;
+	TnyMimePart         *part;
+	TnyStream           *stream;
+	gchar               *cid;
+	gchar               *mime_type;
+	GtkTextMark         *mark;        /* NULL if it replaces a placeholder */
+	gboolean             done;
+	GdkPixbuf           *pixbuf;
+	guint64              stream_size;
+	guint64              expected_size; /* counted in pending_images_size */
+} ImageJob;
+
+typedef struct {
+	ModestMsgEditWindow *window;
+	TnyMimePart         *part;
+	GnomeVFSFileSize     allowed_size;
+	GnomeVFSAsyncHandle *handle;
+} AttachmentProbe;
+
 static void  modest_msg_edit_window_class_init   (ModestMsgEditWindowClass *klass);
 static void  modest_msg_edit_window_init         (ModestMsgEditWindow *obj);
 static void  modest_msg_edit_window_finalize     (GObject *obj);
@@ -173,6 +208,13 @@ static gboolean gtk_text_iter_forward_search_insensitive (const GtkTextIter *ite
 
 static void remove_tags (WPTextBuffer *buffer);
 
+static gboolean on_autosave_timeout (gpointer userdata);
+
+static void image_cache_entry_free (ImageCacheEntry *entry);
+
+static void attachment_probe_free (AttachmentProbe *probe);
+static void image_job_free (ImageJob *job);
+
 static void on_account_removed (TnyAccountStore *account_store, 
 				TnyAccount *account,
 				gpointer user_data);
@@ -322,6 +364,12 @@ struct _ModestMsgEditWindowPrivate {
 	TnyList *images;
 	guint64 images_size;
 	gint images_count;
+	GHashTable *image_cache;     /* content id -> ImageCacheEntry */
+	GHashTable *pending_images;  /* content ids being decoded */
+	GQueue *image_inserts;       /* ImageJobs of the inserted images */
+	guint64 pending_images_size; /* expected size of the image_inserts */
+	gboolean closed;             /* late image jobs are dropped */
+	GSList *attachment_probes;   /* AttachmentProbes of the new attachments */
 
 	TnyHeaderFlags priority_flags;
 
@@ -349,6 +397,8 @@ struct _ModestMsgEditWindowPrivate {
 	GtkWidget   *brand_label;
 	GtkWidget   *brand_container;
 
+	ModestAutosaveJournal *autosave_journal;
+	guint        autosave_timeout;
 };
 
 #define MODEST_MSG_EDIT_WINDOW_GET_PRIVATE(o)      (G_TYPE_INSTANCE_GET_PRIVATE((o), \
@@ -444,6 +494,13 @@ modest_msg_edit_window_init (ModestMsgEditWindow *obj)
 	priv->images        = TNY_LIST (tny_simple_list_new ());
 	priv->images_size   = 0;
 	priv->images_count  = 0;
+	priv->image_cache   = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+						     (GDestroyNotify) image_cache_entry_free);
+	priv->pending_images = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	priv->image_inserts = g_queue_new ();
+	priv->pending_images_size = 0;
+	priv->closed = FALSE;
+	priv->attachment_probes = NULL;
 	priv->next_cid      = 0;
 
 	priv->cc_caption    = NULL;
@@ -468,6 +525,9 @@ modest_msg_edit_window_init (ModestMsgEditWindow *obj)
 	priv->clipboard_text = NULL;
 	priv->sent = FALSE;
 
+	priv->autosave_journal = NULL;
+	priv->autosave_timeout = 0;
+
 	priv->scroll_drag_timeout_id = 0;
 	priv->correct_scroll_idle = 0;
 	priv->last_upper = 0.0;
@@ -1119,6 +1179,7 @@ static void
 modest_msg_edit_window_disconnect_signals (ModestWindow *window)
 {
 	ModestMsgEditWindowPrivate *priv = MODEST_MSG_EDIT_WINDOW_GET_PRIVATE (window);
+	GList *node, *next;
 
 	if (gtk_clipboard_get (GDK_SELECTION_PRIMARY) &&
 	    g_signal_handler_is_connected (gtk_clipboard_get (GDK_SELECTION_PRIMARY), 
@@ -1136,6 +1197,37 @@ modest_msg_edit_window_disconnect_signals (ModestWindow *window)
 					   priv->account_removed_handler_id))
 		g_signal_handler_disconnect(modest_runtime_get_account_store (), 
 					   priv->account_removed_handler_id);
+
+	/* The message was sent, saved or discarded, so the autosaved
+	   copy is not needed anymore */
+	if (priv->autosave_timeout > 0) {
+		g_source_remove (priv->autosave_timeout);
+		priv->autosave_timeout = 0;
+	}
+	if (priv->autosave_journal) {
+		modest_autosave_journal_discard (priv->autosave_journal);
+		priv->autosave_journal = NULL;
+	}
+
+	/* Do not insert the images that are still being decoded. The
+	   decoded ones that wait for a previous one are dropped here,
+	   the others when they are decoded */
+	priv->closed = TRUE;
+	for (node = priv->image_inserts->head; node; node = next) {
+		next = node->next;
+		if (((ImageJob *) node->data)->done) {
+			image_job_free ((ImageJob *) node->data);
+			g_queue_delete_link (priv->image_inserts, node);
+		}
+	}
+
+	while (priv->attachment_probes) {
+		AttachmentProbe *probe = (AttachmentProbe *) priv->attachment_probes->data;
+		gnome_vfs_async_cancel (probe->handle);
+		attachment_probe_free (probe);
+		priv->attachment_probes = g_slist_delete_link (priv->attachment_probes,
+							       priv->attachment_probes);
+	}
 }
 
 static void
@@ -1202,6 +1294,9 @@ modest_msg_edit_window_finalize (GObject *obj)
 	g_free (priv->in_reply_to);
 	g_object_unref (priv->attachments);
 	g_object_unref (priv->images);
+	g_hash_table_destroy (priv->image_cache);
+	g_hash_table_destroy (priv->pending_images);
+	g_queue_free (priv->image_inserts);
 
 	/* This had to stay alive for as long as the picker that used it: */
 	modest_pair_list_free (priv->from_field_protos);
@@ -1213,14 +1308,12 @@ static void
 pixbuf_size_prepared (GdkPixbufLoader *loader,
 		      gint width,
 		      gint height,
-		      ModestMsgEditWindow *self)
+		      gpointer userdata)
 {
 	gint new_height, new_width;
-	gboolean set_size;
 	
 	new_height = height;
 	new_width = width;
-	set_size = FALSE;
 
 	if (width > IMAGE_MAX_WIDTH) {
 		new_height = height * IMAGE_MAX_WIDTH / width;
@@ -1230,44 +1323,43 @@ pixbuf_size_prepared (GdkPixbufLoader *loader,
 	gdk_pixbuf_loader_set_size (loader, new_width, new_height);
 }
 
+/* It does not use Gtk+, so it can be run in the image decoder
+   threads */
 static GdkPixbuf *
 pixbuf_from_stream (TnyStream *stream,
 		    const gchar *mime_type,
-		    guint64 *stream_size,
-		    ModestMsgEditWindow *self)
+		    guint64 *stream_size)
 {
 	GdkPixbufLoader *loader;
 	GdkPixbuf *pixbuf;
 	guint64 size;
+	gchar *read_buffer;
 	GError *error = NULL;
 
 	size = 0;
 
-	loader = gdk_pixbuf_loader_new_with_mime_type (mime_type, NULL);
+	loader = (mime_type) ? gdk_pixbuf_loader_new_with_mime_type (mime_type, NULL) : NULL;
 
 	if (loader == NULL) {
 		if (stream_size)
 			*stream_size = 0;
 		return NULL;
 	}
-	g_signal_connect (G_OBJECT (loader), "size-prepared", G_CALLBACK (pixbuf_size_prepared), self);
-
-	modest_window_show_progress (MODEST_WINDOW (self), TRUE);
+	g_signal_connect (G_OBJECT (loader), "size-prepared", G_CALLBACK (pixbuf_size_prepared), NULL);
 
+	read_buffer = g_malloc (IMAGE_READ_BUFFER_SIZE);
 	tny_stream_reset (TNY_STREAM (stream));
 	while (!tny_stream_is_eos (TNY_STREAM (stream))) {
-		unsigned char read_buffer[128];
-		gint readed;
-		readed = tny_stream_read (TNY_STREAM (stream), (char *) read_buffer, 128);
+		gssize readed;
+		readed = tny_stream_read (TNY_STREAM (stream), read_buffer, IMAGE_READ_BUFFER_SIZE);
+		if (readed <= 0)
+			break;
 		size += readed;
-		if (!gdk_pixbuf_loader_write (loader, read_buffer, readed, &error)) {
+		if (!gdk_pixbuf_loader_write (loader, (guchar *) read_buffer, readed, &error)) {
 			break;
 		}
-		/* Allow some UI responsiveness */
-		while (gtk_events_pending ())
-			gtk_main_iteration ();
 	}
-	modest_window_show_progress (MODEST_WINDOW (self), FALSE);
+	g_free (read_buffer);
 
 	gdk_pixbuf_loader_close (loader, &error);
 
@@ -1297,6 +1389,189 @@ pixbuf_from_stream (TnyStream *stream,
 	return pixbuf;
 }
 
+static void
+image_cache_entry_free (ImageCacheEntry *entry)
+{
+	g_object_unref (entry->pixbuf);
+	g_slice_free (ImageCacheEntry, entry);
+}
+
+static void
+image_job_free (ImageJob *job)
+{
+	if (job->mark)
+		gtk_text_buffer_delete_mark (job->buffer, job->mark);
+	if (job->pixbuf)
+		g_object_unref (job->pixbuf);
+	if (job->stream)
+		g_object_unref (job->stream);
+	g_object_unref (job->part);
+	g_object_unref (job->buffer);
+	g_object_unref (job->window);
+	g_free (job->cid);
+	g_free (job->mime_type);
+	g_slice_free (ImageJob, job);
+}
+
+static void
+insert_decoded_image (ImageJob *job)
+{
+	ModestMsgEditWindowPrivate *priv;
+	GtkTextIter position;
+
+	priv = MODEST_MSG_EDIT_WINDOW_GET_PRIVATE (job->window);
+
+	if (job->pixbuf) {
+		gtk_text_buffer_get_iter_at_mark (job->buffer, &position, job->mark);
+		wp_text_buffer_insert_image (WP_TEXT_BUFFER (job->buffer), &position,
+					     job->cid, job->pixbuf);
+		gtk_text_buffer_set_modified (job->buffer, TRUE);
+	} else {
+		/* It was added when the image was requested */
+		tny_list_remove (priv->images, (GObject *) job->part);
+		modest_platform_information_banner (NULL, NULL,
+						    _("mail_ib_file_operation_failed"));
+	}
+}
+
+static gboolean
+on_image_decoded (gpointer userdata)
+{
+	ImageJob *job = (ImageJob *) userdata;
+	ModestMsgEditWindowPrivate *priv;
+
+	gdk_threads_enter ();
+
+	priv = MODEST_MSG_EDIT_WINDOW_GET_PRIVATE (job->window);
+
+	/* The window was closed while the image was decoded */
+	if (priv->closed) {
+		if (job->mark)
+			g_queue_remove (priv->image_inserts, job);
+		image_job_free (job);
+		gdk_threads_leave ();
+		return FALSE;
+	}
+
+	g_hash_table_remove (priv->pending_images, job->cid);
+	if (g_hash_table_size (priv->pending_images) == 0)
+		modest_window_show_progress (MODEST_WINDOW (job->window), FALSE);
+	priv->pending_images_size -= job->expected_size;
+
+	if (job->pixbuf) {
+		ImageCacheEntry *entry;
+
+		entry = g_slice_new (ImageCacheEntry);
+		entry->pixbuf = g_object_ref (job->pixbuf);
+		entry->stream_size = job->stream_size;
+		g_hash_table_replace (priv->image_cache, g_strdup (job->cid), entry);
+
+		priv->images_count ++;
+		priv->images_size += job->stream_size;
+	}
+
+	if (job->mark) {
+		/* Inserted images are added in the order they were
+		   requested, whatever the order they are decoded in */
+		job->done = TRUE;
+		while (!g_queue_is_empty (priv->image_inserts) &&
+		       ((ImageJob *) g_queue_peek_head (priv->image_inserts))->done) {
+			ImageJob *head = (ImageJob *) g_queue_pop_head (priv->image_inserts);
+			insert_decoded_image (head);
+			image_job_free (head);
+		}
+
+		/* Send and save are dimmed while there are images
+		   waiting to be inserted */
+		if (g_queue_is_empty (priv->image_inserts)) {
+			modest_ui_actions_check_toolbar_dimming_rules (MODEST_WINDOW (job->window));
+			modest_ui_actions_check_menu_dimming_rules (MODEST_WINDOW (job->window));
+		}
+	} else {
+#ifndef MODEST_HAVE_LIBWPEDITOR_PLUS
+		if (job->pixbuf)
+			wp_text_buffer_replace_image (WP_TEXT_BUFFER (job->buffer), job->cid, job->pixbuf);
+#endif
+		image_job_free (job);
+	}
+
+	gdk_threads_leave ();
+
+	return FALSE;
+}
+
+static void
+decode_image (gpointer data, gpointer userdata)
+{
+	ImageJob *job = (ImageJob *) data;
+	TnyStream *stream;
+
+	if (job->stream)
+		stream = g_object_ref (job->stream);
+	else
+		stream = tny_mime_part_get_decoded_stream (job->part);
+
+	if (stream) {
+		job->pixbuf = pixbuf_from_stream (stream, job->mime_type, &job->stream_size);
+		g_object_unref (stream);
+	}
+
+	g_idle_add (on_image_decoded, job);
+}
+
+/*
+ * Decodes and scales @part in the image decoder threads. If @mark is
+ * NULL the image replaces the placeholder of its content id once
+ * it's decoded, otherwise it's inserted at @mark, and @stream is the
+ * one @part was constructed with. An inserted @part is added to the
+ * images of the message right away, and @expected_size is counted in
+ * the size of the message until it's decoded
+ */
+static void
+decode_image_async (ModestMsgEditWindow *self,
+		    TnyMimePart *part,
+		    const gchar *mime_type,
+		    TnyStream *stream,
+		    GtkTextMark *mark,
+		    guint64 expected_size)
+{
+	ModestMsgEditWindowPrivate *priv;
+	ImageJob *job;
+
+	priv = MODEST_MSG_EDIT_WINDOW_GET_PRIVATE (self);
+
+	job = g_slice_new0 (ImageJob);
+	job->window = g_object_ref (self);
+	job->buffer = g_object_ref (priv->text_buffer);
+	job->part = g_object_ref (part);
+	job->stream = (stream) ? g_object_ref (stream) : NULL;
+	job->cid = g_strdup (tny_mime_part_get_content_id (part));
+	job->mime_type = g_strdup (mime_type);
+	job->mark = mark;
+
+	if (g_hash_table_size (priv->pending_images) == 0)
+		modest_window_show_progress (MODEST_WINDOW (self), TRUE);
+	g_hash_table_insert (priv->pending_images, g_strdup (job->cid), GINT_TO_POINTER (TRUE));
+	if (mark) {
+		job->expected_size = expected_size;
+		priv->pending_images_size += expected_size;
+		tny_list_prepend (priv->images, (GObject *) part);
+		g_queue_push_tail (priv->image_inserts, job);
+		if (g_queue_get_length (priv->image_inserts) == 1) {
+			modest_ui_actions_check_toolbar_dimming_rules (MODEST_WINDOW (self));
+			modest_ui_actions_check_menu_dimming_rules (MODEST_WINDOW (self));
+		}
+	}
+
+	if (!image_decoder && g_thread_supported ())
+		image_decoder = g_thread_pool_new (decode_image, NULL, IMAGE_DECODER_THREADS, FALSE, NULL);
+
+	if (image_decoder)
+		g_thread_pool_push (image_decoder, job, NULL);
+	else
+		decode_image (job, NULL);
+}
+
 static void
 replace_with_images (ModestMsgEditWindow *self, TnyList *attachments)
 {
@@ -1305,7 +1580,6 @@ replace_with_images (ModestMsgEditWindow *self, TnyList *attachments)
 
 	priv = MODEST_MSG_EDIT_WINDOW_GET_PRIVATE (self);
 
-	g_object_ref (self);
 	for (iter = tny_list_create_iterator (attachments);
 	     !tny_iterator_is_done (iter);
 	     tny_iterator_next (iter)) {
@@ -1313,26 +1587,37 @@ replace_with_images (ModestMsgEditWindow *self, TnyList *attachments)
 		const gchar *cid = tny_mime_part_get_content_id (part);
 		const gchar *mime_type = tny_mime_part_get_content_type (part);
 		if ((cid != NULL)&&(mime_type != NULL)) {
-			guint64 stream_size;
-			TnyStream *stream = tny_mime_part_get_decoded_stream (part);
-			GdkPixbuf *pixbuf = pixbuf_from_stream (stream, mime_type, &stream_size, self);
+			ImageCacheEntry *entry;
 
-
-			g_object_unref (stream);
-
-			if (pixbuf != NULL) {
-				priv->images_count ++;
-				priv->images_size += stream_size;
+			/* The placeholders are shown until the images
+			   are decoded, see on_image_decoded */
+			entry = g_hash_table_lookup (priv->image_cache, cid);
+			if (entry) {
 #ifndef MODEST_HAVE_LIBWPEDITOR_PLUS
-				wp_text_buffer_replace_image (WP_TEXT_BUFFER (priv->text_buffer), cid, pixbuf);
+				wp_text_buffer_replace_image (WP_TEXT_BUFFER (priv->text_buffer), cid, entry->pixbuf);
 #endif
-				g_object_unref (pixbuf);
+			} else if (!g_hash_table_lookup (priv->pending_images, cid)) {
+				decode_image_async (self, part, mime_type, NULL, NULL, 0);
 			}
 		}
 		g_object_unref (part);
 	}
 	g_object_unref (iter);
-	g_object_unref (self);
+}
+
+static void
+set_parts_shareable (TnyList *parts)
+{
+	TnyIterator *iter;
+
+	iter = tny_list_create_iterator (parts);
+	while (!tny_iterator_is_done (iter)) {
+		TnyMimePart *part = TNY_MIME_PART (tny_iterator_get_current (iter));
+		modest_tny_msg_set_part_shareable (part);
+		g_object_unref (part);
+		tny_iterator_next (iter);
+	}
+	g_object_unref (iter);
 }
 
 static void
@@ -1574,8 +1859,13 @@ set_msg (ModestMsgEditWindow *self, TnyMsg *msg, gboolean preserve_is_rich)
 			if (type == TNY_FOLDER_TYPE_INVALID)
 				g_warning ("%s: BUG: TNY_FOLDER_TYPE_INVALID", __FUNCTION__);
 			
-			if (type == TNY_FOLDER_TYPE_DRAFTS) 
+			if (type == TNY_FOLDER_TYPE_DRAFTS) {
 				priv->draft_msg = g_object_ref(msg);
+				/* The parts of our own draft can be
+				   saved again without copying them */
+				set_parts_shareable (priv->attachments);
+				set_parts_shareable (priv->images);
+			}
 			if (type == TNY_FOLDER_TYPE_OUTBOX)
 				priv->outbox_msg = g_object_ref(msg);
 			priv->msg_uid = modest_tny_folder_get_header_unique_id (header);
@@ -1847,6 +2137,7 @@ modest_msg_edit_window_new (TnyMsg *msg, const gchar *account_name, const gchar
 	ModestDimmingRulesGroup *toolbar_rules_group = NULL;
 	ModestDimmingRulesGroup *clipboard_rules_group = NULL;
 	ModestWindowMgr *mgr = NULL;
+	gint autosave_interval;
 
 	g_return_val_if_fail (msg, NULL);
 	g_return_val_if_fail (account_name, NULL);
@@ -1960,6 +2251,12 @@ modest_msg_edit_window_new (TnyMsg *msg, const gchar *account_name, const gchar
 
 	modest_msg_edit_window_clipboard_owner_handle_change_in_idle (MODEST_MSG_EDIT_WINDOW (obj));
 
+	autosave_interval = modest_conf_get_int (modest_runtime_get_conf (),
+						 MODEST_CONF_AUTOSAVE_INTERVAL, NULL);
+	if (autosave_interval > 0)
+		priv->autosave_timeout = g_timeout_add_seconds (autosave_interval,
+								on_autosave_timeout, obj);
+
 	return (ModestWindow*) obj;
 }
 
@@ -2147,10 +2444,21 @@ modest_msg_edit_window_get_parts_size (ModestMsgEditWindow *window,
 
 	modest_attachments_view_get_sizes (MODEST_ATTACHMENTS_VIEW (priv->attachments_view), parts_count, parts_size);
 
-	/* TODO: add images */
-	*parts_size += priv->images_size;
-	*parts_count += priv->images_count;
+	/* The images being inserted count too */
+	*parts_size += priv->images_size + priv->pending_images_size;
+	*parts_count += priv->images_count + g_queue_get_length (priv->image_inserts);
+
+}
+
+gboolean
+modest_msg_edit_window_has_pending_parts (ModestMsgEditWindow *window)
+{
+	ModestMsgEditWindowPrivate *priv;
 
+	g_return_val_if_fail (MODEST_IS_MSG_EDIT_WINDOW (window), FALSE);
+	priv = MODEST_MSG_EDIT_WINDOW_GET_PRIVATE (window);
+
+	return !g_queue_is_empty (priv->image_inserts) || priv->attachment_probes != NULL;
 }
 
 ModestMsgEditFormat
@@ -2588,14 +2896,12 @@ modest_msg_edit_window_insert_image (ModestMsgEditWindow *window)
 		uri = (const gchar *) uri_node->data;
 		result = gnome_vfs_open (&handle, uri, GNOME_VFS_OPEN_READ);
 		if (result == GNOME_VFS_OK) {
-			GdkPixbuf *pixbuf;
 			GnomeVFSFileInfo *info;
 			gchar *filename, *basename, *escaped_filename;
 			TnyMimePart *mime_part;
 			gchar *content_id;
 			const gchar *mime_type = NULL;
 			GnomeVFSURI *vfs_uri;
-			guint64 stream_size;
 
 			gnome_vfs_close (handle);
 			vfs_uri = gnome_vfs_uri_new (uri);
@@ -2637,23 +2943,14 @@ modest_msg_edit_window_insert_image (ModestMsgEditWindow *window)
 			tny_mime_part_set_filename (mime_part, basename);
 			g_free (basename);
 
-			pixbuf = pixbuf_from_stream (stream, mime_type, &stream_size, window);
-
-			if (pixbuf != NULL) {
-				priv->images_size += stream_size;
-				priv->images_count ++;
-				insert_mark = gtk_text_buffer_get_insert (GTK_TEXT_BUFFER (priv->text_buffer));
-				gtk_text_buffer_get_iter_at_mark (GTK_TEXT_BUFFER (priv->text_buffer), &position, insert_mark);
-				wp_text_buffer_insert_image (WP_TEXT_BUFFER (priv->text_buffer), &position, 
-							     tny_mime_part_get_content_id (mime_part), pixbuf);
-				g_object_unref (pixbuf);
-
-				tny_list_prepend (priv->images, (GObject *) mime_part);
-				gtk_text_buffer_set_modified (priv->text_buffer, TRUE);
-			} else {
-				modest_platform_information_banner (NULL, NULL,
-								    _("mail_ib_file_operation_failed"));
-			}
+			/* The image is inserted here once it's decoded */
+			insert_mark = gtk_text_buffer_get_insert (GTK_TEXT_BUFFER (priv->text_buffer));
+			gtk_text_buffer_get_iter_at_mark (GTK_TEXT_BUFFER (priv->text_buffer), &position, insert_mark);
+			decode_image_async (window, mime_part, mime_type, stream,
+					    gtk_text_buffer_create_mark (GTK_TEXT_BUFFER (priv->text_buffer),
+									 NULL, &position, FALSE),
+					    (info->valid_fields & GNOME_VFS_FILE_INFO_FIELDS_SIZE) ? info->size : 0);
+			g_object_unref (stream);
 
 			g_free (filename);
 			g_object_unref (mime_part);
@@ -2671,7 +2968,7 @@ on_attach_file_response (GtkDialog *dialog,
 {
 	GSList *uris = NULL;
 	GSList *uri_node;
-	GnomeVFSFileSize total_size, allowed_size;
+	GnomeVFSFileSize allowed_size;
 	ModestMsgEditWindow *window;
 	ModestMsgEditWindowPrivate *priv;
 	gint att_num;
@@ -2708,21 +3005,11 @@ on_attach_file_response (GtkDialog *dialog,
 					   &att_num, &att_size);
 	allowed_size = MODEST_MAX_ATTACHMENT_SIZE - att_size;
 
-	total_size = 0;
-	for (uri_node = uris; uri_node != NULL; uri_node = g_slist_next (uri_node)) {
-
-		const gchar *uri = (const gchar *) uri_node->data;
-
-		total_size += 
-			modest_msg_edit_window_attach_file_one (window, uri, allowed_size);
-
-		if (total_size > allowed_size) {
-			g_debug ("%s: total size: %u", 
-				   __FUNCTION__, (unsigned int)total_size);
-			break;
-		}
-		allowed_size -= total_size;
-	}
+	/* The sizes are checked later, the attachments are added
+	   without reading the files */
+	for (uri_node = uris; uri_node != NULL; uri_node = g_slist_next (uri_node))
+		modest_msg_edit_window_attach_file_one (window, (const gchar *) uri_node->data,
+							allowed_size);
 	g_slist_foreach (uris, (GFunc) g_free, NULL);
 	g_slist_free (uris);
 
@@ -2777,103 +3064,168 @@ modest_msg_edit_window_offer_attach_file (ModestMsgEditWindow *window)
 }
 
 
-GnomeVFSFileSize
+static void
+remove_attachment (ModestMsgEditWindow *window, TnyMimePart *part)
+{
+	ModestMsgEditWindowPrivate *priv = MODEST_MSG_EDIT_WINDOW_GET_PRIVATE (window);
+
+	tny_list_remove (priv->attachments, (GObject *) part);
+	modest_attachments_view_remove_attachment (MODEST_ATTACHMENTS_VIEW (priv->attachments_view),
+						   part);
+	if (tny_list_get_length (priv->attachments) == 0)
+		gtk_widget_hide (priv->attachments_caption);
+}
+
+static void
+attachment_probe_free (AttachmentProbe *probe)
+{
+	g_object_unref (probe->part);
+	g_slice_free (AttachmentProbe, probe);
+}
+
+static void
+on_attachment_file_info (GnomeVFSAsyncHandle *handle,
+			 GList *results,
+			 gpointer userdata)
+{
+	AttachmentProbe *probe = (AttachmentProbe *) userdata;
+	ModestMsgEditWindowPrivate *priv;
+	GnomeVFSGetFileInfoResult *result;
+	GnomeVFSFileInfo *info;
+
+	gdk_threads_enter ();
+
+	priv = MODEST_MSG_EDIT_WINDOW_GET_PRIVATE (probe->window);
+	priv->attachment_probes = g_slist_remove (priv->attachment_probes, probe);
+
+	result = (results) ? (GnomeVFSGetFileInfoResult *) results->data : NULL;
+	info = (result && result->result == GNOME_VFS_OK) ? result->file_info : NULL;
+
+	if (!info ||
+	    ((info->valid_fields & GNOME_VFS_FILE_INFO_FIELDS_ACCESS) &&
+	     !(info->permissions & GNOME_VFS_PERM_ACCESS_READABLE))) {
+		remove_attachment (probe->window, probe->part);
+		modest_platform_information_banner (NULL, NULL, _FM_OPENING_NOT_ALLOWED);
+	} else if (info->valid_fields & GNOME_VFS_FILE_INFO_FIELDS_SIZE) {
+		gint att_num;
+		guint64 att_size;
+
+		modest_attachments_view_set_attachment_size (MODEST_ATTACHMENTS_VIEW (priv->attachments_view),
+							     probe->part, info->size);
+
+		/* The attachments still being probed count with
+		   their estimated size */
+		modest_attachments_view_get_sizes (MODEST_ATTACHMENTS_VIEW (priv->attachments_view),
+						   &att_num, &att_size);
+		if (probe->allowed_size != 0 &&
+		    (info->size > probe->allowed_size || att_size > MODEST_MAX_ATTACHMENT_SIZE)) {
+			remove_attachment (probe->window, probe->part);
+			modest_platform_information_banner (NULL, NULL,
+							    _("mail_ib_error_attachment_size"));
+		}
+	} else {
+		/* this may fail for weird file systems, like obex,
+		 * upnp... */
+		g_debug ("%s: could not get attachment size", __FUNCTION__);
+	}
+
+	/* Send and save are dimmed while there are attachments being
+	   checked */
+	if (priv->attachment_probes == NULL) {
+		modest_ui_actions_check_toolbar_dimming_rules (MODEST_WINDOW (probe->window));
+		modest_ui_actions_check_menu_dimming_rules (MODEST_WINDOW (probe->window));
+	}
+
+	attachment_probe_free (probe);
+
+	gdk_threads_leave ();
+}
+
+void
 modest_msg_edit_window_attach_file_one (ModestMsgEditWindow *window,
 					const gchar *uri, 
 					GnomeVFSFileSize allowed_size)
 
 {
-	GnomeVFSHandle *handle = NULL;
 	ModestMsgEditWindowPrivate *priv;
-	GnomeVFSResult result;
-	GnomeVFSFileSize size = 0;
-	g_return_val_if_fail (window, 0);
-	g_return_val_if_fail (uri, 0);
+	TnyMimePart *mime_part;
+	TnyStream *stream;
+	const gchar *mime_type;
+	gchar *basename;
+	gchar *escaped_filename;
+	gchar *filename;
+	gchar *content_id;
+	GnomeVFSURI *vfs_uri;
+	AttachmentProbe *probe;
+	GList *uri_list;
+
+	g_return_if_fail (window);
+	g_return_if_fail (uri);
 
 	priv = MODEST_MSG_EDIT_WINDOW_GET_PRIVATE (window);
 
-	result = gnome_vfs_open (&handle, uri, GNOME_VFS_OPEN_READ);
-	if (result == GNOME_VFS_OK) {
-		TnyMimePart *mime_part;
-		TnyStream *stream;
-		const gchar *mime_type = NULL;
-		gchar *basename;
-		gchar *escaped_filename;
-		gchar *filename;
-		gchar *content_id;
-		GnomeVFSFileInfo *info;
-		GnomeVFSURI *vfs_uri;
-
-		gnome_vfs_close (handle);
-		vfs_uri = gnome_vfs_uri_new (uri);
-		
-
-		escaped_filename = g_path_get_basename (gnome_vfs_uri_get_path (vfs_uri));
-		filename = gnome_vfs_unescape_string_for_display (escaped_filename);
-		g_free (escaped_filename);
-		gnome_vfs_uri_unref (vfs_uri);
-
-		info = gnome_vfs_file_info_new ();
-		
-		if (gnome_vfs_get_file_info (uri, 
-					     info, 
-					     GNOME_VFS_FILE_INFO_GET_MIME_TYPE)
-		    == GNOME_VFS_OK)
-			mime_type = gnome_vfs_file_info_get_mime_type (info);
-		mime_part = tny_platform_factory_new_mime_part
-			(modest_runtime_get_platform_factory ());
-		
-		/* try to get the attachment's size; this may fail for weird
-		 * file systems, like obex, upnp... */
-		if (allowed_size != 0 &&
-		    info->valid_fields & GNOME_VFS_FILE_INFO_FIELDS_SIZE) {
-			size = info->size;
-			if (size > allowed_size) {
-				modest_platform_information_banner (NULL, NULL,
-								    _("mail_ib_error_attachment_size"));
-				g_free (filename);
-				return 0;
-			}
-		} else
-			g_debug ("%s: could not get attachment size", __FUNCTION__);
-		
-		stream = create_stream_for_uri (uri);
-		
-		if (stream == NULL) {
-
-			modest_platform_information_banner (NULL, NULL, _FM_OPENING_NOT_ALLOWED);
+	vfs_uri = gnome_vfs_uri_new (uri);
+	if (!vfs_uri) {
+		modest_platform_information_banner (NULL, NULL, _FM_OPENING_NOT_ALLOWED);
+		return;
+	}
 
-			g_object_unref (mime_part);
-			g_free (filename);
-			gnome_vfs_file_info_unref (info);
-			return 0;
-		}
+	escaped_filename = g_path_get_basename (gnome_vfs_uri_get_path (vfs_uri));
+	filename = gnome_vfs_unescape_string_for_display (escaped_filename);
+	g_free (escaped_filename);
+
+	/* Sniffing the mime type would read the file */
+	mime_type = gnome_vfs_get_mime_type_for_name (filename);
+
+	/* Nothing is read here, the file is read and encoded when the
+	   message is sent or saved */
+	stream = modest_file_stream_new (uri);
+	mime_part = tny_platform_factory_new_mime_part
+		(modest_runtime_get_platform_factory ());
+	tny_mime_part_construct (mime_part, stream, mime_type, "base64");
+	g_object_unref (stream);
+
+	content_id = g_strdup_printf ("%d", priv->next_cid);
+	tny_mime_part_set_content_id (mime_part, content_id);
+	g_free (content_id);
+	priv->next_cid++;
+
+	basename = g_path_get_basename (filename);
+	tny_mime_part_set_filename (mime_part, basename);
+	g_free (basename);
+	g_free (filename);
+
+	/* The autosave journal keeps just the uri */
+	g_object_set_data_full (G_OBJECT (mime_part), AUTOSAVE_URI_KEY,
+				g_strdup (uri), g_free);
+
+	tny_list_prepend (priv->attachments, (GObject *) mime_part);
+	modest_attachments_view_add_attachment (MODEST_ATTACHMENTS_VIEW (priv->attachments_view),
+						mime_part, FALSE, 0);
+	gtk_widget_set_no_show_all (priv->attachments_caption, FALSE);
+	gtk_widget_show_all (priv->attachments_caption);
+	gtk_text_buffer_set_modified (priv->text_buffer, TRUE);
 
-		tny_mime_part_construct (mime_part, stream, mime_type, "base64");
-		g_object_unref (stream);
-		
-		content_id = g_strdup_printf ("%d", priv->next_cid);
-		tny_mime_part_set_content_id (mime_part, content_id);
-		g_free (content_id);
-		priv->next_cid++;
-		
-		basename = g_path_get_basename (filename);
-		tny_mime_part_set_filename (mime_part, basename);
-		g_free (basename);
-		
-		tny_list_prepend (priv->attachments, (GObject *) mime_part);
-		modest_attachments_view_add_attachment (MODEST_ATTACHMENTS_VIEW (priv->attachments_view),
-							mime_part,
-							info->size == 0, info->size);
-		gtk_widget_set_no_show_all (priv->attachments_caption, FALSE);
-		gtk_widget_show_all (priv->attachments_caption);
-		gtk_text_buffer_set_modified (priv->text_buffer, TRUE);
-		g_free (filename);
-		g_object_unref (mime_part);
-		gnome_vfs_file_info_unref (info);
+	/* The size, and whether the file can be read, are checked in
+	   background, see on_attachment_file_info */
+	probe = g_slice_new0 (AttachmentProbe);
+	probe->window = window;
+	probe->part = mime_part;
+	probe->allowed_size = allowed_size;
+	priv->attachment_probes = g_slist_prepend (priv->attachment_probes, probe);
+	if (priv->attachment_probes->next == NULL) {
+		modest_ui_actions_check_toolbar_dimming_rules (MODEST_WINDOW (window));
+		modest_ui_actions_check_menu_dimming_rules (MODEST_WINDOW (window));
 	}
 
-	return size;
+	uri_list = g_list_prepend (NULL, vfs_uri);
+	gnome_vfs_async_get_file_info (&probe->handle, uri_list,
+				       GNOME_VFS_FILE_INFO_FOLLOW_LINKS |
+				       GNOME_VFS_FILE_INFO_GET_ACCESS_RIGHTS,
+				       GNOME_VFS_PRIORITY_DEFAULT,
+				       on_attachment_file_info, probe);
+	g_list_free (uri_list);
+	gnome_vfs_uri_unref (vfs_uri);
 }
 
 void
@@ -3824,7 +4176,8 @@ modest_msg_edit_window_clipboard_owner_change (GtkClipboard *clipboard,
 	}
 	priv->clipboard_text = text;
 
-	modest_window_check_dimming_rules_group (MODEST_WINDOW (window), MODEST_DIMMING_RULES_CLIPBOARD);
+	modest_window_check_dimming_rules_group_for (MODEST_WINDOW (window), MODEST_DIMMING_RULES_CLIPBOARD,
+						     MODEST_DIMMING_DEPS_CLIPBOARD | MODEST_DIMMING_DEPS_SELECTION);
 
 	g_object_unref (window);
 }
@@ -3868,7 +4221,8 @@ subject_field_move_cursor (GtkEntry *entry,
 	if (!GTK_WIDGET_VISIBLE (window))
 		return;
 
-	modest_window_check_dimming_rules_group (MODEST_WINDOW (window), MODEST_DIMMING_RULES_CLIPBOARD);
+	modest_window_check_dimming_rules_group_for (MODEST_WINDOW (window), MODEST_DIMMING_RULES_CLIPBOARD,
+						     MODEST_DIMMING_DEPS_SELECTION);
 }
 
 static void 
@@ -4199,6 +4553,11 @@ modest_msg_edit_window_set_draft (ModestMsgEditWindow *window,
 			priv->msg_uid = NULL;
 		}
 		priv->msg_uid = modest_tny_folder_get_header_unique_id (header);
+		g_object_unref (header);
+
+		/* Let it be found by the uid of the new draft */
+		modest_window_mgr_window_uid_changed (modest_runtime_get_window_mgr (),
+						      MODEST_WINDOW (window));
 	}
 
 	priv->draft_msg = draft;
@@ -4308,6 +4667,85 @@ on_account_removed (TnyAccountStore *account_store,
 	}
 }
 
+static ModestAutosaveState*
+get_autosave_state (ModestMsgEditWindow *window)
+{
+	ModestMsgEditWindowPrivate *priv;
+	ModestAutosaveState *state;
+	const gchar *picker_active_id;
+	TnyIterator *iter;
+
+	priv = MODEST_MSG_EDIT_WINDOW_GET_PRIVATE (window);
+	state = modest_autosave_state_new ();
+
+#define SET_FIELD(field,value) G_STMT_START {			\
+		const gchar *_value = (value);			\
+		g_free (state->field);				\
+		state->field = g_strdup (_value ? _value : "");	\
+	} G_STMT_END
+
+	picker_active_id = modest_selector_get_active_id (priv->from_field);
+	if (picker_active_id) {
+		g_free (state->account_name);
+		state->account_name = modest_utils_get_account_name_from_recipient (picker_active_id, NULL);
+		if (!state->account_name)
+			state->account_name = g_strdup ("");
+	}
+	SET_FIELD (from, modest_selector_get_active_display_name (priv->from_field));
+	SET_FIELD (to, modest_recpt_editor_get_recipients (MODEST_RECPT_EDITOR (priv->to_field)));
+	SET_FIELD (cc, modest_recpt_editor_get_recipients (MODEST_RECPT_EDITOR (priv->cc_field)));
+	SET_FIELD (bcc, modest_recpt_editor_get_recipients (MODEST_RECPT_EDITOR (priv->bcc_field)));
+	SET_FIELD (subject, gtk_entry_get_text (GTK_ENTRY (priv->subject_field)));
+	SET_FIELD (references, priv->references);
+	SET_FIELD (in_reply_to, priv->in_reply_to);
+#undef SET_FIELD
+
+	g_free (state->body);
+	state->body = modest_text_utils_text_buffer_get_text (priv->text_buffer);
+	state->priority_flags = priv->priority_flags;
+
+	/* Only the attachments added from files can be restored */
+	iter = tny_list_create_iterator (priv->attachments);
+	while (!tny_iterator_is_done (iter)) {
+		GObject *part = tny_iterator_get_current (iter);
+		const gchar *uri = g_object_get_data (part, AUTOSAVE_URI_KEY);
+
+		if (uri)
+			state->attachments = g_slist_prepend (state->attachments, g_strdup (uri));
+		g_object_unref (part);
+		tny_iterator_next (iter);
+	}
+	g_object_unref (iter);
+	state->attachments = g_slist_reverse (state->attachments);
+
+	return state;
+}
+
+static gboolean
+on_autosave_timeout (gpointer userdata)
+{
+	ModestMsgEditWindow *window = (ModestMsgEditWindow *) userdata;
+	ModestMsgEditWindowPrivate *priv;
+
+	gdk_threads_enter ();
+
+	priv = MODEST_MSG_EDIT_WINDOW_GET_PRIVATE (window);
+	if (modest_msg_edit_window_is_modified (window)) {
+		if (!priv->autosave_journal)
+			priv->autosave_journal = modest_autosave_journal_new ();
+		modest_autosave_journal_record (priv->autosave_journal,
+						get_autosave_state (window));
+	} else if (priv->autosave_journal) {
+		/* Saved to drafts since the last autosave */
+		modest_autosave_journal_discard (priv->autosave_journal);
+		priv->autosave_journal = NULL;
+	}
+
+	gdk_threads_leave ();
+
+	return TRUE;
+}
+
 static void
 update_signature (ModestMsgEditWindow *self,
 		  const gchar *old_account,
@@ -250,9 +250,11 @@ void                    modest_msg_edit_window_offer_attach_file           (Mode
  * attach a file to a MsgEditWindow non interactively, 
  * without file dialog. This is needed by dbus callbacks.
  *
- * Returns: the filesize (if available)
+ * The file is not read until the message is sent or saved. Its size
+ * is checked asynchronously, and the attachment is removed if the
+ * file cannot be read or if it's bigger than @allowed_size
  */
-GnomeVFSFileSize modest_msg_edit_window_attach_file_one           (ModestMsgEditWindow *window, const gchar *file_uri, GnomeVFSFileSize allowed_size);
+void             modest_msg_edit_window_attach_file_one           (ModestMsgEditWindow *window, const gchar *file_uri, GnomeVFSFileSize allowed_size);
 
 /**
  * modest_msg_edit_window_remove_attachments:
@@ -264,6 +266,19 @@ GnomeVFSFileSize modest_msg_edit_window_attach_file_one           (ModestMsgEdit
 void                    modest_msg_edit_window_remove_attachments    (ModestMsgEditWindow *window, 
 								      TnyList *att_list);
 
+/**
+ * modest_msg_edit_window_has_pending_parts:
+ * @window: a #ModestMsgEditWindow
+ *
+ * checks if there are inserted images that are still being decoded,
+ * so they are not in the body of the message yet, or attached files
+ * whose size and permissions are still being checked, so they could
+ * still be removed from the message
+ *
+ * Returns: %TRUE if there are pending parts, %FALSE otherwise
+ */
+gboolean                modest_msg_edit_window_has_pending_parts (ModestMsgEditWindow *window);
+
 /**
  * modest_msg_edit_window_get_parts_size:
  * @window: a #ModestMsgEditWindow
@@ -58,11 +58,13 @@
 #include <modest-mime-part-view.h>
 #include <modest-isearch-view.h>
 #include <modest-tny-mime-part.h>
+#include <modest-buffered-stream.h>
 #include <modest-address-book.h>
 #include <math.h>
 #include <errno.h>
 #include <glib/gstdio.h>
 #include <modest-debug.h>
+#include <modest-startup.h>
 #include <modest-header-window.h>
 #include <modest-account-protocol.h>
 #include <modest-icon-names.h>
@@ -89,6 +91,11 @@
 #define MYDOCS_ENV "MYDOCSDIR"
 #define DOCS_FOLDER ".documents"
 
+/* Max number of attachments decoded at the same time when saving */
+#define SAVE_ATTACHMENTS_MAX_WORKERS 3
+/* Min time between progress updates when saving attachments, in ms */
+#define SAVE_ATTACHMENTS_PROGRESS_INTERVAL 500
+
 typedef struct _ModestMsgViewWindowPrivate ModestMsgViewWindowPrivate;
 struct _ModestMsgViewWindowPrivate {
 
@@ -140,6 +147,9 @@ struct _ModestMsgViewWindowPrivate {
 	TnyMimePart *other_body;
 	TnyMsg * top_msg;
 
+	/* attachment uid => path of the already decoded temporary file */
+	GHashTable *decoded_attachments;
+
 	GSList *sighandlers;
 };
 
@@ -226,7 +236,8 @@ static void init_window (ModestMsgViewWindow *obj);
 
 static gboolean msg_is_visible (TnyHeader *header, gboolean check_outbox);
 
-static void check_dimming_rules_after_change (ModestMsgViewWindow *window);
+static void check_dimming_rules_after_change (ModestMsgViewWindow *window,
+					      ModestDimmingDeps deps);
 
 static gboolean on_fetch_image (ModestMsgView *msgview,
 				const gchar *uri,
@@ -466,6 +477,9 @@ modest_msg_view_window_init (ModestMsgViewWindow *obj)
 	parent_priv = MODEST_WINDOW_GET_PRIVATE(obj);
 	parent_priv->ui_manager = gtk_ui_manager_new();
 
+	/* The toolbar icons are loaded after the first window */
+	modest_startup_wait (MODEST_STARTUP_BARRIER_STOCK_ICONS);
+
 	action_group = gtk_action_group_new ("ModestMsgViewWindowActions");
 	gtk_action_group_set_translation_domain (action_group, GETTEXT_PACKAGE);
 
@@ -513,6 +527,8 @@ modest_msg_view_window_init (ModestMsgViewWindow *obj)
 	priv->remove_attachment_banner = NULL;
 	priv->msg_uid = NULL;
 	priv->other_body = NULL;
+	priv->decoded_attachments = g_hash_table_new_full (g_str_hash, g_str_equal,
+							   g_free, g_free);
 
 	priv->sighandlers = NULL;
 
@@ -709,6 +725,11 @@ modest_msg_view_window_finalize (GObject *obj)
 		priv->msg_uid = NULL;
 	}
 
+	if (priv->decoded_attachments) {
+		g_hash_table_destroy (priv->decoded_attachments);
+		priv->decoded_attachments = NULL;
+	}
+
 	G_OBJECT_CLASS(parent_class)->finalize (obj);
 }
 
@@ -1274,7 +1295,7 @@ modest_msg_view_window_on_row_changed (GtkTreeModel *header_model,
 				       GtkTreeIter *arg2,
 				       ModestMsgViewWindow *window)
 {
-	check_dimming_rules_after_change (window);
+	check_dimming_rules_after_change (window, MODEST_DIMMING_DEPS_SELECTION | MODEST_DIMMING_DEPS_FOLDER);
 }
 
 static void 
@@ -1282,15 +1303,16 @@ modest_msg_view_window_on_row_deleted(GtkTreeModel *header_model,
 				      GtkTreePath *arg1,
 				      ModestMsgViewWindow *window)
 {
-	check_dimming_rules_after_change (window);
+	check_dimming_rules_after_change (window, MODEST_DIMMING_DEPS_SELECTION | MODEST_DIMMING_DEPS_FOLDER);
 }
 	/* The window could have dissapeared */
 
 static void
-check_dimming_rules_after_change (ModestMsgViewWindow *window)
+check_dimming_rules_after_change (ModestMsgViewWindow *window,
+				  ModestDimmingDeps deps)
 {
-	modest_ui_actions_check_menu_dimming_rules (MODEST_WINDOW (window));
-	modest_ui_actions_check_toolbar_dimming_rules (MODEST_WINDOW (window));
+	modest_window_check_dimming_rules_group_for (MODEST_WINDOW (window), MODEST_DIMMING_RULES_MENU, deps);
+	modest_window_check_dimming_rules_group_for (MODEST_WINDOW (window), MODEST_DIMMING_RULES_TOOLBAR, deps);
 }
 
 
@@ -1331,7 +1353,7 @@ modest_msg_view_window_on_row_inserted (GtkTreeModel *model,
 
 		uid = modest_tny_folder_get_header_unique_id (header);
 		if (!g_str_equal(priv->msg_uid, uid)) {
-			check_dimming_rules_after_change (window);
+			check_dimming_rules_after_change (window, MODEST_DIMMING_DEPS_SELECTION | MODEST_DIMMING_DEPS_FOLDER);
 			g_free(uid);
 			g_object_unref (G_OBJECT(header));
 			return;
@@ -1375,7 +1397,7 @@ modest_msg_view_window_on_row_inserted (GtkTreeModel *model,
 				  G_CALLBACK (modest_msg_view_window_on_row_reordered),
 				  window);
 
-	check_dimming_rules_after_change (window);	
+	check_dimming_rules_after_change (window, MODEST_DIMMING_DEPS_SELECTION | MODEST_DIMMING_DEPS_FOLDER);	
 }
 
 static void 
@@ -1420,7 +1442,7 @@ modest_msg_view_window_on_row_reordered (GtkTreeModel *header_model,
 		already_changed = TRUE;
 	}
 
-	check_dimming_rules_after_change (window);
+	check_dimming_rules_after_change (window, MODEST_DIMMING_DEPS_SELECTION | MODEST_DIMMING_DEPS_FOLDER);
 }
 
 /* The modest_msg_view_window_update_model_replaced implements update
@@ -2535,7 +2557,8 @@ modest_msg_view_window_clipboard_owner_change (GtkClipboard *clipboard,
 	if (!GTK_WIDGET_VISIBLE (window))
 		return;
 
-	modest_window_check_dimming_rules_group (MODEST_WINDOW (window), MODEST_DIMMING_RULES_CLIPBOARD);
+	modest_window_check_dimming_rules_group_for (MODEST_WINDOW (window), MODEST_DIMMING_RULES_CLIPBOARD,
+						     MODEST_DIMMING_DEPS_CLIPBOARD);
 }
 
 gboolean 
@@ -2600,13 +2623,17 @@ on_mail_operation_started (ModestMailOperation *mail_op,
 	GSList *tmp;
 	ModestMsgViewWindowPrivate *priv;
 	GObject *source = NULL;
+	ModestDimmingDeps deps;
 
 	self = MODEST_MSG_VIEW_WINDOW (user_data);
 	priv = MODEST_MSG_VIEW_WINDOW_GET_PRIVATE (self);
 	op_type = modest_mail_operation_get_type_operation (mail_op);
 	tmp = priv->progress_widgets;
 	source = modest_mail_operation_get_source(mail_op);
+	deps = MODEST_DIMMING_DEPS_OPERATIONS;
 	if (G_OBJECT (self) == source) {
+		/* Our own operations could change anything */
+		deps = MODEST_DIMMING_DEPS_ALL;
 		if (op_type == MODEST_MAIL_OPERATION_TYPE_RECEIVE ||
 		    op_type == MODEST_MAIL_OPERATION_TYPE_OPEN ||
 		    op_type == MODEST_MAIL_OPERATION_TYPE_DELETE) {
@@ -2619,10 +2646,11 @@ on_mail_operation_started (ModestMailOperation *mail_op,
 			}
 		}
 	}
-	g_object_unref (source);
+	if (source)
+		g_object_unref (source);
 
 	/* Update dimming rules */
-	check_dimming_rules_after_change (self);
+	check_dimming_rules_after_change (self, deps);
 }
 
 static void
@@ -2633,12 +2661,21 @@ on_mail_operation_finished (ModestMailOperation *mail_op,
 	ModestMailOperationTypeOperation op_type;
 	GSList *tmp;
 	ModestMsgViewWindowPrivate *priv;
+	GObject *source;
+	ModestDimmingDeps deps;
 
 	self = MODEST_MSG_VIEW_WINDOW (user_data);
 	priv = MODEST_MSG_VIEW_WINDOW_GET_PRIVATE (self);
 	op_type = modest_mail_operation_get_type_operation (mail_op);
 	tmp = priv->progress_widgets;
 
+	/* The operations of other windows only change the state of
+	   the operation queue, ours could also load the message */
+	source = modest_mail_operation_get_source (mail_op);
+	deps = (source == G_OBJECT (self)) ? MODEST_DIMMING_DEPS_ALL : MODEST_DIMMING_DEPS_OPERATIONS;
+	if (source)
+		g_object_unref (source);
+
 	if (op_type == MODEST_MAIL_OPERATION_TYPE_RECEIVE ||
 	    op_type == MODEST_MAIL_OPERATION_TYPE_OPEN ||
 	    op_type == MODEST_MAIL_OPERATION_TYPE_DELETE) {
@@ -2659,7 +2696,7 @@ on_mail_operation_finished (ModestMailOperation *mail_op,
 	   transfer mode is still enabled so the dimming rule
 	   won't let the user delete the message that has been
 	   readed for example */
-	check_dimming_rules_after_change (self);
+	check_dimming_rules_after_change (self, deps);
 }
 
 static void
@@ -2718,6 +2755,30 @@ typedef struct {
 	gchar *attachment_uid;
 } DecodeAsyncHelper;
 
+/* Returns a newly allocated string that identifies the attachment
+   in the current message, or NULL if it's not an attachment of it */
+static gchar *
+get_attachment_uid (ModestMsgViewWindow *window,
+		    TnyMimePart *mime_part)
+{
+	ModestMsgViewWindowPrivate *priv;
+	const gchar *msg_uid;
+	gint attachment_index;
+	TnyList *attachments;
+
+	priv = MODEST_MSG_VIEW_WINDOW_GET_PRIVATE (window);
+
+	msg_uid = modest_msg_view_window_get_message_uid (window);
+	attachments = modest_msg_view_get_attachments (MODEST_MSG_VIEW (priv->msg_view));
+	attachment_index = modest_list_index (attachments, (GObject *) mime_part);
+	g_object_unref (attachments);
+
+	if (msg_uid && attachment_index >= 0)
+		return g_strdup_printf ("%s/%d", msg_uid, attachment_index);
+
+	return NULL;
+}
+
 static void
 on_decode_to_stream_async_handler (TnyMimePart *mime_part, 
 				   gboolean cancelled, 
@@ -2731,6 +2792,13 @@ on_decode_to_stream_async_handler (TnyMimePart *mime_part,
 
 	priv = MODEST_MSG_VIEW_WINDOW_GET_PRIVATE (helper->self);
 
+	/* Write the data that could remain in the buffer */
+	if (!cancelled && !err && MODEST_IS_BUFFERED_STREAM (stream) &&
+	    tny_stream_flush (stream) == -1) {
+		modest_platform_information_banner (NULL, NULL, _("mail_ib_file_operation_failed"));
+		goto free;
+	}
+
 	if (cancelled || err) {
 		if (err) {
 			gchar *msg;
@@ -2806,6 +2874,12 @@ on_decode_to_stream_async_handler (TnyMimePart *mime_part,
 		/* make the file read-only */
 		g_chmod(helper->file_path, 0444);
 
+		/* Remember it, so next time we could reuse it */
+		if (helper->attachment_uid)
+			g_hash_table_insert (priv->decoded_attachments,
+					     g_strdup (helper->attachment_uid),
+					     g_strdup (helper->file_path));
+
 		/* Activate the file */
 		modest_platform_activate_file (helper->file_path, content_type);
 	}
@@ -2841,23 +2915,13 @@ modest_msg_view_window_view_attachment (ModestMsgViewWindow *window,
 					TnyMimePart *mime_part)
 {
 	ModestMsgViewWindowPrivate *priv;
-	const gchar *msg_uid;
 	gchar *attachment_uid = NULL;
-	gint attachment_index = 0;
-	TnyList *attachments;
 
 	g_return_if_fail (MODEST_IS_MSG_VIEW_WINDOW (window));
 	g_return_if_fail (TNY_IS_MIME_PART (mime_part) || (mime_part == NULL));
 	priv = MODEST_MSG_VIEW_WINDOW_GET_PRIVATE (window);
 
-	msg_uid = modest_msg_view_window_get_message_uid (MODEST_MSG_VIEW_WINDOW (window));
-	attachments = modest_msg_view_get_attachments (MODEST_MSG_VIEW (priv->msg_view));
-	attachment_index = modest_list_index (attachments, (GObject *) mime_part);
-	g_object_unref (attachments);
-
-	if (msg_uid && attachment_index >= 0) {
-		attachment_uid = g_strdup_printf ("%s/%d", msg_uid, attachment_index);
-	}
+	attachment_uid = get_attachment_uid (window, mime_part);
 
 	if (mime_part == NULL) {
 		gboolean error = FALSE;
@@ -2912,6 +2976,18 @@ modest_msg_view_window_view_attachment (ModestMsgViewWindow *window,
 		const gchar *att_filename = tny_mime_part_get_filename (mime_part);
 		gboolean show_error_banner = FALSE;
 		TnyFsStream *temp_stream = NULL;
+		const gchar *decoded_path = NULL;
+
+		/* It was already decoded, no need to do it again */
+		if (attachment_uid)
+			decoded_path = g_hash_table_lookup (priv->decoded_attachments, attachment_uid);
+		if (decoded_path && modest_utils_file_exists (decoded_path)) {
+			modest_platform_activate_file (decoded_path,
+						       tny_mime_part_get_content_type (mime_part));
+			goto frees;
+		}
+		if (attachment_uid)
+			g_hash_table_remove (priv->decoded_attachments, attachment_uid);
 
 		/* if we have the 'att_filename', create a new temporary stream */
 		if (att_filename) {
@@ -2959,11 +3035,17 @@ modest_msg_view_window_view_attachment (ModestMsgViewWindow *window,
 				}
 			}
 
-			if (!decode_in_provider)
-				tny_mime_part_decode_to_stream_async (mime_part, TNY_STREAM (temp_stream),
+			if (!decode_in_provider) {
+				TnyStream *buffered_stream;
+
+				/* Write to disk in big chunks */
+				buffered_stream = modest_buffered_stream_new (TNY_STREAM (temp_stream), 0);
+				tny_mime_part_decode_to_stream_async (mime_part, buffered_stream,
 								      on_decode_to_stream_async_handler,
 								      NULL,
 								      helper);
+				g_object_unref (buffered_stream);
+			}
 			g_object_unref (temp_stream);
 			/* NOTE: files in the temporary area will be automatically
 			 * cleaned after some time if they are no longer in use */
@@ -3077,6 +3159,8 @@ typedef struct
 {
 	gchar *filename;
 	TnyMimePart *part;
+	/* path of a local file with the part already decoded, or NULL */
+	gchar *decoded_path;
 } SaveMimePartPair;
 
 typedef struct
@@ -3085,6 +3169,18 @@ typedef struct
 	GnomeVFSResult result;
 	gchar *uri;
 	ModestMsgViewWindow *window;
+
+	/* The protocol of the account if it decodes the parts by
+	   itself. It's read from the main loop, as the account
+	   manager must not be used from the saving threads */
+	ModestProtocol *protocol;
+
+	/* Protects result, written and progress_id, as the parts
+	   are saved concurrently from several threads */
+	GMutex *lock;
+	gsize written;
+	guint progress_id;
+	GtkWidget *banner;
 } SaveMimePartInfo;
 
 static void save_mime_part_info_free (SaveMimePartInfo *info, gboolean with_struct);
@@ -3100,15 +3196,27 @@ save_mime_part_info_free (SaveMimePartInfo *info, gboolean with_struct)
 	for (node = info->pairs; node != NULL; node = g_list_next (node)) {
 		SaveMimePartPair *pair = (SaveMimePartPair *) node->data;
 		g_free (pair->filename);
+		g_free (pair->decoded_path);
 		g_object_unref (pair->part);
 		g_slice_free (SaveMimePartPair, pair);
 	}
 	g_list_free (info->pairs);
 	info->pairs = NULL;
 	g_free (info->uri);
+	if (info->banner) {
+		gtk_widget_destroy (info->banner);
+		g_object_unref (info->banner);
+		info->banner = NULL;
+	}
+	if (info->protocol) {
+		g_object_unref (info->protocol);
+		info->protocol = NULL;
+	}
 	g_object_unref (info->window);
 	info->window = NULL;
 	if (with_struct) {
+		if (info->lock)
+			g_mutex_free (info->lock);
 		g_slice_free (SaveMimePartInfo, info);
 	}
 }
@@ -3120,6 +3228,13 @@ idle_save_mime_part_show_result (SaveMimePartInfo *info)
 	 * modest_platform_system_banner is or does Gtk+ code */
 
 	gdk_threads_enter (); /* CHECKED */
+
+	/* All the threads are done, so no more progress will come */
+	if (info->progress_id) {
+		g_source_remove (info->progress_id);
+		info->progress_id = 0;
+	}
+
 	if (info->result == GNOME_VFS_ERROR_CANCELLED) {
 		/* nothing */
 	} else if (info->result == GNOME_VFS_OK) {
@@ -3138,7 +3253,7 @@ idle_save_mime_part_show_result (SaveMimePartInfo *info)
 		modest_platform_system_banner (NULL, NULL, _("mail_ib_file_operation_failed"));
 	}
 	set_progress_hint (info->window, FALSE);
-	save_mime_part_info_free (info, FALSE);
+	save_mime_part_info_free (info, TRUE);
 	gdk_threads_leave (); /* CHECKED */
 
 	return FALSE;
@@ -3190,99 +3305,250 @@ save_mime_part_to_file_connect_idle (SaveMimePartInfo *info)
 	return FALSE;
 }
 
-static gpointer
-save_mime_part_to_file (SaveMimePartInfo *info)
+/* Returns TRUE if we need to connect to retrieve the contents of the
+   mime part before saving it */
+static gboolean
+save_mime_part_needs_connection (SaveMimePartInfo *info,
+				 SaveMimePartPair *pair)
 {
-	GnomeVFSHandle *handle;
-	TnyStream *stream;
-	SaveMimePartPair *pair = (SaveMimePartPair *) info->pairs->data;
+	gboolean check_online = TRUE;
+	ModestMsgViewWindowPrivate *priv = NULL;
 
-	if (TNY_IS_CAMEL_BS_MIME_PART (pair->part) &&
-	    !tny_camel_bs_mime_part_is_fetched (TNY_CAMEL_BS_MIME_PART (pair->part))) {
-		gboolean check_online = TRUE;
-		ModestMsgViewWindowPrivate *priv = NULL;
+	if (pair->decoded_path ||
+	    !TNY_IS_CAMEL_BS_MIME_PART (pair->part) ||
+	    tny_camel_bs_mime_part_is_fetched (TNY_CAMEL_BS_MIME_PART (pair->part)))
+		return FALSE;
 
-		/* Check if we really need to connect to save the mime part */
-		priv = MODEST_MSG_VIEW_WINDOW_GET_PRIVATE (info->window);
-		if (g_str_has_prefix (priv->msg_uid, "merge:")) {
-			check_online = FALSE;
-		} else {
-			TnyAccountStore *acc_store;
-			TnyAccount *account = NULL;
+	/* Check if we really need to connect to save the mime part */
+	priv = MODEST_MSG_VIEW_WINDOW_GET_PRIVATE (info->window);
+	if (g_str_has_prefix (priv->msg_uid, "merge:")) {
+		check_online = FALSE;
+	} else {
+		TnyAccountStore *acc_store;
+		TnyAccount *account = NULL;
 
-			acc_store = (TnyAccountStore*) modest_runtime_get_account_store ();
-			account = tny_account_store_find_account (acc_store, priv->msg_uid);
+		acc_store = (TnyAccountStore*) modest_runtime_get_account_store ();
+		account = tny_account_store_find_account (acc_store, priv->msg_uid);
 
-			if (account) {
-				if (tny_account_get_connection_status (account) ==
-				    TNY_CONNECTION_STATUS_CONNECTED)
-					check_online = FALSE;
-				g_object_unref (account);
-			} else {
-				check_online = !tny_device_is_online (tny_account_store_get_device (acc_store));
-			}
+		if (account) {
+			if (tny_account_get_connection_status (account) ==
+			    TNY_CONNECTION_STATUS_CONNECTED)
+				check_online = FALSE;
+			g_object_unref (account);
+		} else {
+			check_online = !tny_device_is_online (tny_account_store_get_device (acc_store));
 		}
+	}
 
-		if (check_online) {
-			g_idle_add ((GSourceFunc) save_mime_part_to_file_connect_idle, info);
-			return NULL;
-		}
+	return check_online;
+}
+
+static void
+save_mime_part_set_result (SaveMimePartInfo *info,
+			   GnomeVFSResult result)
+{
+	g_mutex_lock (info->lock);
+	/* Keep the first error */
+	if (info->result == GNOME_VFS_OK)
+		info->result = result;
+	g_mutex_unlock (info->lock);
+}
+
+/* Shows the number of bytes saved so far. It runs in the main loop */
+static gboolean
+idle_save_mime_part_show_progress (SaveMimePartInfo *info)
+{
+	gchar *size, *text;
+	gsize written;
+
+	gdk_threads_enter (); /* CHECKED */
+
+	g_mutex_lock (info->lock);
+	info->progress_id = 0;
+	written = info->written;
+	g_mutex_unlock (info->lock);
+
+	size = modest_text_utils_get_display_size ((guint64) written);
+	text = g_strdup_printf ("%s %s", _("mcen_me_viewer_save_attachments"), size);
+	if (!info->banner) {
+		info->banner = modest_platform_animation_banner (GTK_WIDGET (info->window), NULL, text);
+		if (info->banner)
+			g_object_ref (info->banner);
+	} else {
+		modest_platform_animation_banner_set_text (info->banner, text);
+	}
+	g_free (text);
+	g_free (size);
+
+	gdk_threads_leave (); /* CHECKED */
+
+	return FALSE;
+}
+
+static void
+save_mime_part_add_written (SaveMimePartInfo *info,
+			    gsize delta)
+{
+	g_mutex_lock (info->lock);
+	info->written += delta;
+	/* The UI is updated from the main loop, at most once per
+	   interval no matter how many threads report progress */
+	if (!info->progress_id)
+		info->progress_id = g_timeout_add (SAVE_ATTACHMENTS_PROGRESS_INTERVAL,
+						   (GSourceFunc) idle_save_mime_part_show_progress,
+						   info);
+	g_mutex_unlock (info->lock);
+}
+
+static void
+on_save_mime_part_progress (ModestBufferedStream *stream,
+			    gsize delta,
+			    gsize total,
+			    gpointer user_data)
+{
+	save_mime_part_add_written ((SaveMimePartInfo *) user_data, delta);
+}
+
+static void
+on_save_mime_part_copy_progress (gsize delta,
+				 gpointer user_data)
+{
+	save_mime_part_add_written ((SaveMimePartInfo *) user_data, delta);
+}
+
+/* Copies the already decoded file if the destination is a local
+   one. Returns FALSE if it could not be done this way, so the mime
+   part will have to be decoded again */
+static gboolean
+save_mime_part_copy_decoded (SaveMimePartInfo *info,
+			     SaveMimePartPair *pair)
+{
+	gchar *local_path;
+	gssize copied;
+
+	local_path = g_filename_from_uri (pair->filename, NULL, NULL);
+	if (!local_path)
+		return FALSE;
+
+	copied = modest_utils_copy_file (pair->decoded_path, local_path,
+					 on_save_mime_part_copy_progress, info);
+	if (copied < 0) {
+		g_warning ("modest: could not copy attachment %s: %s\n",
+			   local_path, g_strerror (errno));
+		save_mime_part_set_result (info, (errno == ENOSPC) ?
+					   GNOME_VFS_ERROR_NO_SPACE : GNOME_VFS_ERROR_IO);
 	}
+	g_free (local_path);
 
-	info->result = gnome_vfs_create (&handle, pair->filename, GNOME_VFS_OPEN_WRITE, FALSE, 0644);
-	if (info->result == GNOME_VFS_OK) {
+	return TRUE;
+}
+
+/* Saves a single mime part. It runs in one of the threads of the
+   pool created by save_mime_part_to_file */
+static void
+save_mime_part_pair (SaveMimePartPair *pair,
+		     SaveMimePartInfo *info)
+{
+	GnomeVFSHandle *handle;
+	GnomeVFSResult result;
+	TnyStream *stream, *buffered_stream;
+
+	if (pair->decoded_path && save_mime_part_copy_decoded (info, pair))
+		return;
+
+	result = gnome_vfs_create (&handle, pair->filename, GNOME_VFS_OPEN_WRITE, FALSE, 0644);
+	if (result == GNOME_VFS_OK) {
 		GError *error = NULL;
 		gboolean decode_in_provider;
 		gssize written;
-		ModestAccountMgr *mgr;
-		const gchar *account;
-		ModestProtocol *protocol = NULL;
 
 		stream = tny_vfs_stream_new (handle);
 
+		/* Write in fixed size chunks, so memory usage does not
+		   depend on the size of the attachment */
+		buffered_stream = modest_buffered_stream_new (stream, 0);
+		modest_buffered_stream_set_progress_func (MODEST_BUFFERED_STREAM (buffered_stream),
+							  on_save_mime_part_progress, info);
+
 		decode_in_provider = FALSE;
-		mgr = modest_runtime_get_account_mgr ();
-		account = modest_window_get_active_account (MODEST_WINDOW (info->window));
-		if (modest_account_mgr_account_is_multimailbox (mgr, account, &protocol)) {
-			if (MODEST_IS_ACCOUNT_PROTOCOL (protocol)) {
-				decode_in_provider = 
-					modest_account_protocol_decode_part_to_stream (
-						MODEST_ACCOUNT_PROTOCOL (protocol),
-						pair->part,
-						pair->filename,
-						stream,
-						&written,
-						&error);
-			}
+		if (info->protocol) {
+			decode_in_provider =
+				modest_account_protocol_decode_part_to_stream (
+					MODEST_ACCOUNT_PROTOCOL (info->protocol),
+					pair->part,
+					pair->filename,
+					buffered_stream,
+					&written,
+					&error);
 		}
 		if (!decode_in_provider)
-			written = tny_mime_part_decode_to_stream (pair->part, stream, &error);
+			written = tny_mime_part_decode_to_stream (pair->part, buffered_stream, &error);
+
+		if (written >= 0 && tny_stream_flush (buffered_stream) == -1)
+			written = -1;
 
 		if (written < 0) {
 			g_warning ("modest: could not save attachment %s: %d (%s)\n", pair->filename, error?error->code:-1, error?error->message:"Unknown error");
 
-			if (error && (error->domain == TNY_ERROR_DOMAIN) &&
-			    (error->code == TNY_IO_ERROR_WRITE) &&
+			if ((!error || ((error->domain == TNY_ERROR_DOMAIN) &&
+					(error->code == TNY_IO_ERROR_WRITE))) &&
 			    (errno == ENOSPC)) {
-				info->result = GNOME_VFS_ERROR_NO_SPACE;
+				save_mime_part_set_result (info, GNOME_VFS_ERROR_NO_SPACE);
 			} else {
-				info->result = GNOME_VFS_ERROR_IO;
+				save_mime_part_set_result (info, GNOME_VFS_ERROR_IO);
 			}
 		}
+		if (error)
+			g_error_free (error);
+		g_object_unref (G_OBJECT (buffered_stream));
 		g_object_unref (G_OBJECT (stream));
 	} else {
 		g_warning ("Could not create save attachment %s: %s\n", 
-			   pair->filename, gnome_vfs_result_to_string (info->result));
+			   pair->filename, gnome_vfs_result_to_string (result));
+		save_mime_part_set_result (info, result);
 	}
+}
 
-	/* Go on saving remaining files */
-	info->pairs = g_list_remove_link (info->pairs, info->pairs);
-	if (info->pairs != NULL) {
-		save_mime_part_to_file (info);
+static gpointer
+save_mime_part_to_file (SaveMimePartInfo *info)
+{
+	GThreadPool *pool;
+	GList *node;
+
+	/* Connect first if any of the parts was not retrieved yet */
+	for (node = info->pairs; node != NULL; node = g_list_next (node)) {
+		if (save_mime_part_needs_connection (info, (SaveMimePartPair *) node->data)) {
+			g_idle_add ((GSourceFunc) save_mime_part_to_file_connect_idle, info);
+			return NULL;
+		}
+	}
+
+	/* Decode the parts concurrently. The number of workers is
+	   limited, and each one only holds a fixed size buffer, so
+	   memory usage is bounded no matter how many attachments we
+	   save or how big they are */
+	info->result = GNOME_VFS_OK;
+	pool = g_thread_pool_new ((GFunc) save_mime_part_pair, info,
+				  MIN (g_list_length (info->pairs), SAVE_ATTACHMENTS_MAX_WORKERS),
+				  TRUE, NULL);
+	if (pool) {
+		for (node = info->pairs; node != NULL; node = g_list_next (node))
+			g_thread_pool_push (pool, node->data, NULL);
+
+		/* Wait for all the parts to be saved */
+		g_thread_pool_free (pool, FALSE, TRUE);
 	} else {
-		g_idle_add ((GSourceFunc) idle_save_mime_part_show_result, info);
+		for (node = info->pairs; node != NULL; node = g_list_next (node))
+			save_mime_part_pair ((SaveMimePartPair *) node->data, info);
 	}
 
+	MODEST_DEBUG_BLOCK (
+		g_debug ("%s: saved %d parts, %" G_GSIZE_FORMAT " bytes written",
+			 __FUNCTION__, g_list_length (info->pairs), info->written);
+	);
+
+	g_idle_add ((GSourceFunc) idle_save_mime_part_show_result, info);
+
 	return NULL;
 }
 
@@ -3339,6 +3605,24 @@ save_mime_parts_to_file_with_checks (GtkWindow *parent,
 
 }
 
+/* Returns the protocol of the active account if it decodes the
+   parts by itself, or NULL. The returned protocol must be unref'd */
+static ModestProtocol *
+get_decode_protocol (ModestMsgViewWindow *window)
+{
+	ModestProtocol *protocol = NULL;
+	const gchar *account;
+
+	account = modest_window_get_active_account (MODEST_WINDOW (window));
+	if (account &&
+	    modest_account_mgr_account_is_multimailbox (modest_runtime_get_account_mgr (),
+							account, &protocol) &&
+	    MODEST_IS_ACCOUNT_PROTOCOL (protocol))
+		return g_object_ref (protocol);
+
+	return NULL;
+}
+
 typedef struct _SaveAttachmentsInfo {
 	TnyList *attachments_list;
 	ModestMsgViewWindow *window;
@@ -3397,9 +3681,23 @@ save_attachments_response (GtkDialog *dialog,
 			    !tny_mime_part_is_purged (mime_part) &&
 			    (tny_mime_part_get_filename (mime_part) != NULL)) {
 				SaveMimePartPair *pair;
+				gchar *attachment_uid;
 
 				pair = g_slice_new0 (SaveMimePartPair);
 
+				/* If it was already decoded we could just copy it */
+				attachment_uid = get_attachment_uid (sa_info->window, mime_part);
+				if (attachment_uid) {
+					ModestMsgViewWindowPrivate *priv;
+					const gchar *decoded_path;
+
+					priv = MODEST_MSG_VIEW_WINDOW_GET_PRIVATE (sa_info->window);
+					decoded_path = g_hash_table_lookup (priv->decoded_attachments, attachment_uid);
+					if (decoded_path && modest_utils_file_exists (decoded_path))
+						pair->decoded_path = g_strdup (decoded_path);
+					g_free (attachment_uid);
+				}
+
 				if (tny_list_get_length (mime_parts) > 1) {
 					gchar *escaped = 
 						gnome_vfs_escape_slashes (tny_mime_part_get_filename (mime_part));
@@ -3419,9 +3717,11 @@ save_attachments_response (GtkDialog *dialog,
 	if (files_to_save != NULL) {
 		SaveMimePartInfo *info = g_slice_new0 (SaveMimePartInfo);
 		info->pairs = files_to_save;
-		info->result = TRUE;
+		info->result = GNOME_VFS_OK;
+		info->lock = g_mutex_new ();
 		info->uri = g_strdup (chooser_uri);
 		info->window = g_object_ref (sa_info->window);
+		info->protocol = get_decode_protocol (sa_info->window);
 		save_mime_parts_to_file_with_checks ((GtkWindow *) dialog, info);
 	}
 	g_free (chooser_uri);
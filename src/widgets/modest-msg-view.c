@@ -41,6 +41,7 @@ enum {
 	SHOW_DETAILS_SIGNAL,
 	LIMIT_ERROR_SIGNAL,
 	HANDLE_CALENDAR_SIGNAL,
+	RENDERED_SIGNAL,
 	LAST_SIGNAL
 };
 static guint signals[LAST_SIGNAL] = {0};
@@ -216,6 +217,17 @@ modest_msg_view_base_init (gpointer g_class)
 				      NULL, NULL,
 				      modest_marshal_BOOLEAN__OBJECT_OBJECT,
 				      G_TYPE_BOOLEAN, 2, G_TYPE_OBJECT, G_TYPE_OBJECT);
+
+		/* emitted when the body of the message set in the
+		   view has been completely rendered */
+		signals[RENDERED_SIGNAL] =
+			g_signal_new ("rendered",
+				      MODEST_TYPE_MSG_VIEW,
+				      G_SIGNAL_RUN_FIRST,
+				      G_STRUCT_OFFSET(ModestMsgViewIface, rendered),
+				      NULL, NULL,
+				      g_cclosure_marshal_VOID__VOID,
+				      G_TYPE_NONE, 0);
 		initialized = TRUE;
 	}
 }
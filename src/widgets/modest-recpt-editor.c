@@ -32,6 +32,7 @@
 #include <gtk/gtk.h>
 
 #include <modest-text-utils.h>
+#include <modest-recipient-index.h>
 #include <modest-recpt-editor.h>
 #include <modest-scroll-text.h>
 #include <pango/pango-attributes.h>
@@ -53,6 +54,11 @@ static GObjectClass *parent_class = NULL;
 
 #define RECIPIENT_TAG_ID "recpt-id"
 
+/* the addresses are completed after typing this number of
+   characters */
+#define MIN_COMPLETION_CHARS 2
+#define MAX_COMPLETION_CANDIDATES 8
+
 /* signals */
 enum {
 	OPEN_ADDRESSBOOK_SIGNAL,
@@ -69,6 +75,7 @@ struct _ModestRecptEditorPrivate
 	gchar *recipients;
 	gulong on_mark_set_handler;
 	gboolean show_abook;
+	gboolean completing;
 };
 
 #define MODEST_RECPT_EDITOR_GET_PRIVATE(o)	\
@@ -113,6 +120,8 @@ static GtkTextTag *prev_iter_has_recipient (GtkTextIter *iter);
 /* static GtkTextTag *next_iter_has_recipient (GtkTextIter *iter); */
 static void select_tag_of_iter (GtkTextIter *iter, GtkTextTag *tag, gboolean grow, gboolean left_not_right);
 static gboolean quote_opened (GtkTextIter *iter);
+static void complete_recipient (ModestRecptEditor *editor, GtkTextBuffer *buffer,
+				GtkTextIter *location, const gchar *text, gint len);
 static gboolean is_valid_insert (const gchar *text, gint len);
 static gchar *create_valid_text (const gchar *text, gint len);
 
@@ -364,6 +373,7 @@ modest_recpt_editor_instance_init (GTypeInstance *instance, gpointer g_class)
 	priv = MODEST_RECPT_EDITOR_GET_PRIVATE (instance);
 
 	priv->show_abook = TRUE;
+	priv->completing = FALSE;
 	priv->abook_button = gtk_button_new ();
 	gtk_widget_set_no_show_all (GTK_WIDGET (priv->abook_button), TRUE);
 	gtk_widget_show (priv->abook_button);
@@ -494,6 +504,9 @@ modest_recpt_editor_on_mark_set (GtkTextBuffer *buffer,
 	if (mark != selection_bound && mark != insert)
 		return;
 
+	/* The selection is not a suggested completion anymore */
+	priv->completing = FALSE;
+
 	gtk_text_buffer_get_iter_at_mark (buffer, &insert_iter, insert);
 	gtk_text_buffer_get_iter_at_mark (buffer, &selection_iter, selection_bound);
 
@@ -638,8 +651,81 @@ create_valid_text (const gchar *text, gint len)
 	return g_string_free (str, FALSE);
 }
 
+/* Suggests the rest of the address being typed at @location, from
+   the addresses used before. The suggestion is inserted selected, so
+   typing replaces it */
+static void
+complete_recipient (ModestRecptEditor *editor,
+		    GtkTextBuffer *buffer,
+		    GtkTextIter *location,
+		    const gchar *text,
+		    gint len)
+{
+	ModestRecptEditorPrivate *priv = MODEST_RECPT_EDITOR_GET_PRIVATE (editor);
+	GtkTextIter start, end;
+	GSList *candidates, *node;
+	gchar *line, *token, *completion = NULL;
+	gsize token_len;
+	gint offset;
+
+	/* Only while typing at the end of an address */
+	if (len <= 0 || g_utf8_strlen (text, len) != 1 || strchr (",;\"<>", text[0]))
+		return;
+	if (!gtk_text_iter_ends_line (location) || quote_opened (location))
+		return;
+
+	start = *location;
+	gtk_text_iter_set_line_offset (&start, 0);
+	line = gtk_text_buffer_get_text (buffer, &start, location, FALSE);
+	token = MAX (strrchr (line, ';'), strrchr (line, ','));
+	token = token ? token + 1 : line;
+	while (*token == ' ')
+		token++;
+	token_len = strlen (token);
+	if (g_utf8_strlen (token, -1) < MIN_COMPLETION_CHARS || strchr (token, '<')) {
+		g_free (line);
+		return;
+	}
+
+	/* The index also matches the words in the middle of the
+	   names, we can only complete the ones that start with the
+	   typed text */
+	candidates = modest_recipient_index_complete (token, MAX_COMPLETION_CANDIDATES);
+	for (node = candidates; node && !completion; node = g_slist_next (node)) {
+		const gchar *address = (const gchar *) node->data;
+
+		if (g_ascii_strncasecmp (address, token, token_len) == 0) {
+			completion = g_strdup (address + token_len);
+		} else {
+			gchar *email = modest_text_utils_get_email_address (address);
+			if (email && g_ascii_strncasecmp (email, token, token_len) == 0)
+				completion = g_strdup (email + token_len);
+			g_free (email);
+		}
+	}
+	g_slist_foreach (candidates, (GFunc) g_free, NULL);
+	g_slist_free (candidates);
+	g_free (line);
+
+	if (completion && completion[0] != '\0') {
+		offset = gtk_text_iter_get_offset (location);
+		end = *location;
+		g_signal_handlers_block_by_func (buffer, modest_recpt_editor_on_insert_text, editor);
+		g_signal_handlers_block_by_func (buffer, modest_recpt_editor_on_insert_text_after, editor);
+		gtk_text_buffer_insert (buffer, &end, completion, -1);
+		g_signal_handlers_unblock_by_func (buffer, modest_recpt_editor_on_insert_text, editor);
+		g_signal_handlers_unblock_by_func (buffer, modest_recpt_editor_on_insert_text_after, editor);
+
+		gtk_text_buffer_get_iter_at_offset (buffer, &start, offset);
+		gtk_text_buffer_select_range (buffer, &start, &end);
+		priv->completing = TRUE;
+	}
+	g_free (completion);
+}
+
 /* Called after the default handler, and thus after the text was
-   inserted. We use this to insert a break after a ',' or a ';'*/
+   inserted. We use this to insert a break after a ',' or a ';', and
+   to complete the address being typed */
 static void
 modest_recpt_editor_on_insert_text_after (GtkTextBuffer *buffer,
 					  GtkTextIter *location,
@@ -654,8 +740,10 @@ modest_recpt_editor_on_insert_text_after (GtkTextBuffer *buffer,
 	prev = *location;
 	/* We must go backwards twice as location points to the next
 	   valid position to insert text */
-	if (!gtk_text_iter_backward_chars (&prev, 2))
+	if (!gtk_text_iter_backward_chars (&prev, 2)) {
+		complete_recipient (editor, buffer, location, text, len);
 		return;
+	}
 
 	prev_char = gtk_text_iter_get_char (&prev);
 	g_signal_handlers_block_by_func (buffer, modest_recpt_editor_on_insert_text, editor);
@@ -669,6 +757,9 @@ modest_recpt_editor_on_insert_text_after (GtkTextBuffer *buffer,
 	}
 	g_signal_handlers_unblock_by_func (buffer, modest_recpt_editor_on_insert_text, editor);
 	g_signal_handlers_unblock_by_func (buffer, modest_recpt_editor_on_insert_text_after, editor);
+
+	if (prev_char != ';' && prev_char != ',')
+		complete_recipient (editor, buffer, location, text, len);
 }
 
 /* Called before the default handler, we use it to validate the inputs */
@@ -679,6 +770,9 @@ modest_recpt_editor_on_insert_text (GtkTextBuffer *buffer,
 				    gint len,
 				    ModestRecptEditor *editor)
 {
+	ModestRecptEditorPrivate *priv = MODEST_RECPT_EDITOR_GET_PRIVATE (editor);
+
+	priv->completing = FALSE;
 	if (len > 1024)
 		len = 1024;
 
@@ -826,6 +920,7 @@ modest_recpt_editor_on_key_press_event (GtkTextView *text_view,
 					  GdkEventKey *key,
 					  ModestRecptEditor *editor)
 {
+	ModestRecptEditorPrivate *priv = MODEST_RECPT_EDITOR_GET_PRIVATE (editor);
 	GtkTextMark *insert;
 	GtkTextMark *selection;
 	GtkTextBuffer * buffer;
@@ -865,6 +960,37 @@ modest_recpt_editor_on_key_press_event (GtkTextView *text_view,
 	has_selection = gtk_text_iter_get_offset (&selection_loc) != gtk_text_iter_get_offset (&location);
 	shift_pressed = key->state & GDK_SHIFT_MASK;
 
+	/* Accept the suggested completion */
+	if (priv->completing && has_selection && !shift_pressed) {
+		switch (key->keyval) {
+		case GDK_Tab:
+		case GDK_Right:
+		case GDK_KP_Right:
+		case GDK_End:
+		case GDK_Return:
+		case GDK_KP_Enter:
+			if (select_to_left)
+				location = selection_loc;
+			gtk_text_buffer_place_cursor (buffer, &location);
+			gtk_text_view_scroll_to_mark (GTK_TEXT_VIEW (text_view), insert, 0.0, FALSE, 0.0, 1.0);
+			priv->completing = FALSE;
+			if (key->keyval != GDK_Return && key->keyval != GDK_KP_Enter)
+				return TRUE;
+
+			/* Return also closes the recipient */
+			selection_loc = location;
+			select_to_left = FALSE;
+			has_selection = FALSE;
+			break;
+		case GDK_Escape:
+			gtk_text_buffer_delete_selection (buffer, TRUE, TRUE);
+			priv->completing = FALSE;
+			return TRUE;
+		default:
+			break;
+		}
+	}
+
 	switch (key->keyval) {
 	case GDK_Left:
 	case GDK_KP_Left: 
@@ -33,6 +33,7 @@
 #include <webkit/webkit.h>
 #include <tny-stream.h>
 #include <tny-mime-part-view.h>
+#include <tny-camel-mem-stream.h>
 #include "modest-tny-mime-part.h"
 #include <modest-stream-text-to-html.h>
 #include <modest-text-utils.h>
@@ -44,6 +45,19 @@
 #include <gdk/gdkkeysyms.h>
 #include <modest-ui-constants.h>
 #include <modest-tny-stream-webkit.h>
+#include <modest-utils.h>
+#include <modest-trace.h>
+
+/* Limits of the rendered contents */
+#define MAX_RENDERED_SIZE (128*1024)
+#define TEXT_LINKIFY_LIMIT (64*1024)
+#define TEXT_FULL_LIMIT (128*1024)
+#define TEXT_LINE_LIMIT 1024
+
+/* Identifies the rendering options of the text parts in the bodies
+   cache. Update it whenever the limits above or the text to html
+   conversion change, so the old contents are not used anymore */
+#define TEXT_RENDER_OPTIONS "text_64k_128k_1024"
 
 /* gobject structure methods */
 static void    modest_webkit_mime_part_view_class_init (ModestWebkitMimePartViewClass *klass);
@@ -78,6 +92,9 @@ static WebKitNavigationResponse on_navigation_requested                      (We
 									      WebKitWebFrame       *frame,
 									      WebKitNetworkRequest *request,
 									      gpointer              user_data);
+static void      on_load_finished (WebKitWebView *web_view,
+				   WebKitWebFrame *frame,
+				   gpointer user_data);
 static void      on_notify_style  (GObject *obj, GParamSpec *spec, gpointer userdata);
 static gboolean  update_style     (ModestWebkitMimePartView *self);
 /* TnyMimePartView implementation */
@@ -141,6 +158,14 @@ struct _ModestWebkitMimePartViewPrivate {
 	gboolean has_external_images;
 	GSList *sighandlers;
 	gchar *last_search;
+	TnyHeader *cache_header;
+
+	/* The part being rendered, not ref'd, it's only used to
+	   discard the callbacks of the parts already replaced */
+	TnyMimePart *rendering_part;
+	gboolean loading;
+	ModestTraceSpan *render_span;
+	ModestTraceSpan *load_span;
 };
 
 #define MODEST_WEBKIT_MIME_PART_VIEW_GET_PRIVATE(o)      (G_TYPE_INSTANCE_GET_PRIVATE((o), \
@@ -321,9 +346,17 @@ modest_webkit_mime_part_view_init (ModestWebkitMimePartView *self)
 	priv->sighandlers = modest_signal_mgr_connect (priv->sighandlers,
 						       G_OBJECT (self), "navigation-requested",
 						       G_CALLBACK (on_navigation_requested), (gpointer) self);
+	priv->sighandlers = modest_signal_mgr_connect (priv->sighandlers,
+						       G_OBJECT (self), "load-finished",
+						       G_CALLBACK (on_load_finished), (gpointer) self);
 
 	priv->part = NULL;
 	priv->last_search = NULL;
+	priv->cache_header = NULL;
+	priv->rendering_part = NULL;
+	priv->loading = FALSE;
+	priv->render_span = NULL;
+	priv->load_span = NULL;
 	priv->current_zoom = 1.0;
 	priv->view_images = FALSE;
 	priv->has_external_images = FALSE;
@@ -353,6 +386,8 @@ modest_webkit_mime_part_view_finalize (GObject *obj)
 	modest_signal_mgr_disconnect_all_and_destroy (priv->sighandlers);
 	priv->sighandlers = NULL;
 	g_free (priv->last_search);
+	modest_trace_cancel (priv->render_span);
+	modest_trace_cancel (priv->load_span);
 
 	G_OBJECT_CLASS (parent_class)->finalize (obj);
 }
@@ -369,6 +404,11 @@ modest_webkit_mime_part_view_dispose (GObject *obj)
 		priv->part = NULL;
 	}
 
+	if (priv->cache_header) {
+		g_object_unref (priv->cache_header);
+		priv->cache_header = NULL;
+	}
+
 	G_OBJECT_CLASS (parent_class)->dispose (obj);
 }
 
@@ -392,6 +432,28 @@ on_navigation_requested                      (WebKitWebView        *web_view,
 	}
 }
 
+static void
+on_load_finished (WebKitWebView *web_view,
+		  WebKitWebFrame *frame,
+		  gpointer user_data)
+{
+	ModestWebkitMimePartViewPrivate *priv = MODEST_WEBKIT_MIME_PART_VIEW_GET_PRIVATE (web_view);
+
+	/* Only the load of the part being rendered counts, not the
+	   empty ones or the frames of the document */
+	if (!priv->loading || frame != webkit_web_view_get_main_frame (web_view))
+		return;
+
+	priv->loading = FALSE;
+	priv->rendering_part = NULL;
+	modest_trace_end (priv->load_span);
+	priv->load_span = NULL;
+	modest_trace_end (priv->render_span);
+	priv->render_span = NULL;
+
+	g_signal_emit_by_name (web_view, "rendered");
+}
+
 static void
 on_resource_request_starting (WebKitWebView *webview,
 			      WebKitWebFrame *frame,
@@ -514,6 +576,21 @@ update_style (ModestWebkitMimePartView *self)
 
 
 /* INTERNAL API */
+/* Called when @part was decoded, just before its contents are
+   loaded in the view. The parts replaced in the meantime are
+   ignored, their spans were already cancelled by set_part */
+static void
+part_decoded (ModestWebkitMimePartView *self, TnyMimePart *part)
+{
+	ModestWebkitMimePartViewPrivate *priv = MODEST_WEBKIT_MIME_PART_VIEW_GET_PRIVATE (self);
+
+	if (part != priv->rendering_part)
+		return;
+
+	priv->load_span = modest_trace_begin ("webkit-view:load", tny_mime_part_get_content_type (part));
+	priv->loading = TRUE;
+}
+
 static void
 decode_to_stream_cb (TnyMimePart *self,
 		     gboolean cancelled,
@@ -536,9 +613,101 @@ decode_to_stream_cb (TnyMimePart *self,
 			g_signal_emit (G_OBJECT (view), signals[LIMIT_ERROR_SIGNAL], 0);
 		}
 	}
+	part_decoded (view, self);
 	tny_stream_close (stream);
 }
 
+typedef struct {
+	ModestWebkitMimePartView *view;
+	TnyStream *mem_stream;
+	TnyStream *out_stream;
+	gchar *cache_id;
+} RenderToCacheHelper;
+
+static void
+write_rendered_body (ModestWebkitMimePartView *self, TnyMimePart *part,
+		     TnyStream *input, TnyStream *output)
+{
+	char buffer[4096];
+
+	while (!tny_stream_is_eos (input)) {
+		gssize nb_read;
+
+		nb_read = tny_stream_read (input, buffer, sizeof (buffer));
+		if (nb_read < 0)
+			break;
+		if (nb_read > 0 && tny_stream_write (output, buffer, nb_read) < 0)
+			break;
+	}
+
+	if (modest_tny_stream_webkit_limit_reached (MODEST_TNY_STREAM_WEBKIT (output))) {
+		g_signal_emit (G_OBJECT (self), signals[LIMIT_ERROR_SIGNAL], 0);
+	}
+	part_decoded (self, part);
+	tny_stream_close (output);
+}
+
+static void
+decode_to_cache_cb (TnyMimePart *part,
+		    gboolean cancelled,
+		    TnyStream *stream,
+		    GError *err,
+		    gpointer user_data)
+{
+	RenderToCacheHelper *helper = (RenderToCacheHelper *) user_data;
+	TnyStream *cache_stream = NULL;
+	gboolean limit_reached;
+
+	if (tny_stream_write (stream, "\n", 1) == -1) {
+		g_warning ("failed to write CR in %s", __FUNCTION__);
+	}
+	limit_reached = modest_stream_text_to_html_limit_reached (MODEST_STREAM_TEXT_TO_HTML (stream));
+	if (limit_reached) {
+		g_signal_emit (G_OBJECT (helper->view), signals[LIMIT_ERROR_SIGNAL], 0);
+	}
+
+	/* This flushes the html to the memory stream */
+	tny_stream_close (stream);
+	tny_stream_reset (helper->mem_stream);
+
+	/* Do not cache incomplete contents, we would not be able to
+	   notify about the limits when showing them again */
+	if (!cancelled && !err && !limit_reached) {
+		cache_stream = modest_bodies_cache_get_stream (helper->cache_id, helper->mem_stream);
+	}
+
+	/* Reading it from the cache stream is what stores it in the cache */
+	if (cache_stream) {
+		write_rendered_body (helper->view, part, cache_stream, helper->out_stream);
+		tny_stream_close (cache_stream);
+		g_object_unref (cache_stream);
+	} else {
+		write_rendered_body (helper->view, part, helper->mem_stream, helper->out_stream);
+	}
+
+	g_object_unref (helper->mem_stream);
+	g_object_unref (helper->out_stream);
+	g_object_unref (helper->view);
+	g_free (helper->cache_id);
+	g_slice_free (RenderToCacheHelper, helper);
+}
+
+static TnyStream *
+create_text_to_html_stream (TnyStream *out_stream)
+{
+	TnyStream *text_to_html_stream;
+
+	text_to_html_stream = TNY_STREAM (modest_stream_text_to_html_new (out_stream));
+	modest_stream_text_to_html_set_linkify_limit (MODEST_STREAM_TEXT_TO_HTML (text_to_html_stream),
+						      TEXT_LINKIFY_LIMIT);
+	modest_stream_text_to_html_set_full_limit (MODEST_STREAM_TEXT_TO_HTML (text_to_html_stream),
+						   TEXT_FULL_LIMIT);
+	modest_stream_text_to_html_set_line_limit (MODEST_STREAM_TEXT_TO_HTML (text_to_html_stream),
+						   TEXT_LINE_LIMIT);
+
+	return text_to_html_stream;
+}
+
 static void
 set_html_part (ModestWebkitMimePartView *self, TnyMimePart *part, const gchar *encoding)
 {
@@ -550,7 +719,7 @@ set_html_part (ModestWebkitMimePartView *self, TnyMimePart *part, const gchar *e
 	g_signal_emit (G_OBJECT (self), signals[STOP_STREAMS_SIGNAL], 0);
 
 	tny_stream     = TNY_STREAM(modest_tny_stream_webkit_new (WEBKIT_WEB_VIEW (self), "text/html", encoding));
-	modest_tny_stream_webkit_set_max_size (MODEST_TNY_STREAM_WEBKIT (tny_stream), 128*1024);
+	modest_tny_stream_webkit_set_max_size (MODEST_TNY_STREAM_WEBKIT (tny_stream), MAX_RENDERED_SIZE);
 	tny_stream_reset (tny_stream);
 
 	tny_mime_part_decode_to_stream_async (TNY_MIME_PART (part),
@@ -562,23 +731,55 @@ set_html_part (ModestWebkitMimePartView *self, TnyMimePart *part, const gchar *e
 static void
 set_text_part (ModestWebkitMimePartView *self, TnyMimePart *part)
 {
+	ModestWebkitMimePartViewPrivate *priv;
 	TnyStream* text_to_html_stream, *tny_stream;
+	gchar *cache_id = NULL;
 
 	g_return_if_fail (self);
 	g_return_if_fail (part);
 
+	priv = MODEST_WEBKIT_MIME_PART_VIEW_GET_PRIVATE (self);
+
 	g_signal_emit (G_OBJECT (self), signals[STOP_STREAMS_SIGNAL], 0);
 
 	tny_stream =  TNY_STREAM(modest_tny_stream_webkit_new (WEBKIT_WEB_VIEW (self), "text/html", "utf-8"));
-	modest_tny_stream_webkit_set_max_size (MODEST_TNY_STREAM_WEBKIT (tny_stream), 128*1024);
-	text_to_html_stream = TNY_STREAM (modest_stream_text_to_html_new (tny_stream));
-	modest_stream_text_to_html_set_linkify_limit (MODEST_STREAM_TEXT_TO_HTML (text_to_html_stream),
-						      64*1024);
-	modest_stream_text_to_html_set_full_limit (MODEST_STREAM_TEXT_TO_HTML (text_to_html_stream),
-						   128*1024);
-	modest_stream_text_to_html_set_line_limit (MODEST_STREAM_TEXT_TO_HTML (text_to_html_stream),
-						   1024);
+	modest_tny_stream_webkit_set_max_size (MODEST_TNY_STREAM_WEBKIT (tny_stream), MAX_RENDERED_SIZE);
 
+	if (priv->cache_header && modest_runtime_get_bodies_cache ())
+		cache_id = modest_bodies_cache_get_id (priv->cache_header, TEXT_RENDER_OPTIONS);
+
+	if (cache_id) {
+		TnyStream *cache_stream;
+
+		/* If it was already rendered we do not need to decode it again */
+		cache_stream = modest_bodies_cache_get_stream (cache_id, NULL);
+		if (cache_stream) {
+			write_rendered_body (self, part, cache_stream, tny_stream);
+			tny_stream_close (cache_stream);
+			g_object_unref (cache_stream);
+			g_free (cache_id);
+		} else {
+			RenderToCacheHelper *helper;
+
+			/* Render it to memory, it'll be stored in
+			   the cache and shown when finished */
+			helper = g_slice_new0 (RenderToCacheHelper);
+			helper->view = g_object_ref (self);
+			helper->mem_stream = TNY_STREAM (tny_camel_mem_stream_new ());
+			helper->out_stream = g_object_ref (tny_stream);
+			helper->cache_id = cache_id;
+
+			text_to_html_stream = create_text_to_html_stream (helper->mem_stream);
+			tny_mime_part_decode_to_stream_async (TNY_MIME_PART (part),
+							      text_to_html_stream, decode_to_cache_cb,
+							      NULL, helper);
+			g_object_unref (G_OBJECT(text_to_html_stream));
+		}
+		g_object_unref (G_OBJECT(tny_stream));
+		return;
+	}
+
+	text_to_html_stream = create_text_to_html_stream (tny_stream);
 	tny_mime_part_decode_to_stream_async (TNY_MIME_PART (part),
 					      text_to_html_stream, decode_to_stream_cb,
 					      NULL, self);
@@ -617,11 +818,21 @@ set_part (ModestWebkitMimePartView *self, TnyMimePart *part)
 		priv->part = part;
 	}
 	
+	/* The former one was not finished, it was replaced */
+	modest_trace_cancel (priv->render_span);
+	priv->render_span = NULL;
+	modest_trace_cancel (priv->load_span);
+	priv->load_span = NULL;
+	priv->loading = FALSE;
+	priv->rendering_part = part;
+
 	if (!part) {
 		set_empty_part (self);
 		return;
 	}
 
+	priv->render_span = modest_trace_begin ("webkit-view:render", tny_mime_part_get_content_type (part));
+
 	header_content_type = modest_tny_mime_part_get_header_value (part, "Content-Type");
 	if (header_content_type) {
 		header_content_type = g_strstrip (header_content_type);
@@ -1018,3 +1229,21 @@ modest_webkit_mime_part_view_get_selection_area_default (ModestISearchView *self
 {
 	return get_selection_area (MODEST_WEBKIT_MIME_PART_VIEW (self), x, y, width, height);
 }
+
+void
+modest_webkit_mime_part_view_set_cache_header (ModestWebkitMimePartView *self,
+					       TnyHeader *header)
+{
+	ModestWebkitMimePartViewPrivate *priv;
+
+	g_return_if_fail (MODEST_IS_WEBKIT_MIME_PART_VIEW (self));
+	g_return_if_fail (header == NULL || TNY_IS_HEADER (header));
+
+	priv = MODEST_WEBKIT_MIME_PART_VIEW_GET_PRIVATE (self);
+
+	if (header != priv->cache_header) {
+		if (priv->cache_header)
+			g_object_unref (priv->cache_header);
+		priv->cache_header = (header) ? g_object_ref (header) : NULL;
+	}
+}
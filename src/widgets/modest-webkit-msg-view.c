@@ -52,6 +52,7 @@
 #include <widgets/modest-isearch-view.h>
 #include <widgets/modest-ui-constants.h>
 #include <modest-icon-names.h>
+#include <modest-trace.h>
 #include <gtk/gtk.h>
 
 /* 'private'/'protected' functions */
@@ -78,6 +79,7 @@ static gboolean on_fetch_url (GtkWidget *widget, const gchar *uri, TnyStream *st
 			      ModestWebkitMsgView *msg_view);
 static gboolean on_link_hover (GtkWidget *widget, const gchar *uri, ModestWebkitMsgView *msg_view);
 static void on_limit_error (GtkWidget *widget, ModestWebkitMsgView *msg_view);
+static void on_body_rendered (GtkWidget *widget, ModestWebkitMsgView *msg_view);
 
 /* TnyMimePartView implementation */
 static void modest_msg_view_mp_clear (TnyMimePartView *self);
@@ -199,6 +201,8 @@ struct _ModestWebkitMsgViewPrivate {
 
 	/* link click management */
 	gchar *last_url;
+	/* from set_msg until the body is rendered */
+	ModestTraceSpan *open_span;
 };
 
 #define MODEST_WEBKIT_MSG_VIEW_GET_PRIVATE(o)      (G_TYPE_INSTANCE_GET_PRIVATE((o), \
@@ -374,6 +378,7 @@ modest_webkit_msg_view_init (ModestWebkitMsgView *obj)
 	priv->current_zoom = 1.0;
 
 	priv->msg                     = NULL;
+	priv->open_span               = NULL;
 
 	priv->body_view                 = GTK_WIDGET (g_object_new (MODEST_TYPE_WEBKIT_MIME_PART_VIEW, NULL));
 	priv->mail_header_view        = GTK_WIDGET (modest_compact_mail_header_view_new ());
@@ -396,6 +401,8 @@ modest_webkit_msg_view_init (ModestWebkitMsgView *obj)
 				       G_CALLBACK(on_link_hover), obj);
 	g_signal_connect (G_OBJECT(priv->body_view), "limit_error",
 			  G_CALLBACK(on_limit_error), obj);
+	g_signal_connect (G_OBJECT(priv->body_view), "rendered",
+			  G_CALLBACK(on_body_rendered), obj);
 
 	g_signal_connect (G_OBJECT (priv->mail_header_view), "recpt-activated", 
 			  G_CALLBACK (on_recpt_activated), obj);
@@ -457,6 +464,9 @@ modest_webkit_msg_view_finalize (GObject *obj)
 		priv->msg = NULL;
 	}
 
+	modest_trace_cancel (priv->open_span);
+	priv->open_span = NULL;
+
 	priv->body_view = NULL;
 	priv->attachments_view = NULL;
 
@@ -611,6 +621,17 @@ on_limit_error (GtkWidget *widget, ModestWebkitMsgView *msg_view)
 	g_signal_emit_by_name (G_OBJECT (msg_view), "limit-error");
 }
 
+static void
+on_body_rendered (GtkWidget *widget, ModestWebkitMsgView *msg_view)
+{
+	ModestWebkitMsgViewPrivate *priv = MODEST_WEBKIT_MSG_VIEW_GET_PRIVATE (msg_view);
+
+	modest_trace_end (priv->open_span);
+	priv->open_span = NULL;
+
+	g_signal_emit_by_name (G_OBJECT (msg_view), "rendered");
+}
+
 
 static TnyMimePart *
 find_cid_image (TnyMsg *msg, const gchar *cid)
@@ -758,6 +779,10 @@ set_message (ModestWebkitMsgView *self, TnyMsg *msg, TnyMimePart *other_body)
 		priv->msg = msg;
 	}
 
+	/* The former message was replaced before being rendered */
+	modest_trace_cancel (priv->open_span);
+	priv->open_span = NULL;
+
 	if (!msg) {
 		tny_header_view_clear (TNY_HEADER_VIEW (priv->mail_header_view));
 		modest_attachments_view_set_message (MODEST_ATTACHMENTS_VIEW (priv->attachments_view), NULL, TRUE);
@@ -767,6 +792,7 @@ set_message (ModestWebkitMsgView *self, TnyMsg *msg, TnyMimePart *other_body)
 		gtk_widget_hide_all (priv->priority_box);
 #endif
 		gtk_widget_set_no_show_all (priv->mail_header_view, TRUE);
+		modest_webkit_mime_part_view_set_cache_header (MODEST_WEBKIT_MIME_PART_VIEW (priv->body_view), NULL);
 		tny_mime_part_view_clear (TNY_MIME_PART_VIEW (priv->body_view));
 
 		gtk_widget_set_size_request (GTK_WIDGET (priv->body_view), 1, 1);
@@ -779,8 +805,13 @@ set_message (ModestWebkitMsgView *self, TnyMsg *msg, TnyMimePart *other_body)
 		return;
 	}
 
+	priv->open_span = modest_trace_begin ("msg-view:open", NULL);
+
 	header = tny_msg_get_header (msg);
 	tny_header_view_set_header (TNY_HEADER_VIEW (priv->mail_header_view), header);
+	/* Only the main body of the message is cached */
+	modest_webkit_mime_part_view_set_cache_header (MODEST_WEBKIT_MIME_PART_VIEW (priv->body_view),
+						       other_body ? NULL : header);
 	g_object_unref (header);
 
 	modest_attachments_view_set_message (MODEST_ATTACHMENTS_VIEW (priv->attachments_view),
@@ -821,6 +852,8 @@ set_message (ModestWebkitMsgView *self, TnyMsg *msg, TnyMimePart *other_body)
 
 	} else {
 		tny_mime_part_view_clear (TNY_MIME_PART_VIEW (priv->body_view));
+		/* Nothing else to render */
+		on_body_rendered (priv->body_view, self);
 	}
 
 	/* Refresh priority */
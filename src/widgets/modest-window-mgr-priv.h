@@ -45,6 +45,31 @@ G_BEGIN_DECLS
  **/
 gboolean       _modest_window_mgr_close_active_modals   (ModestWindowMgr *self);
 
+/**
+ * _modest_window_mgr_lookup_window:
+ * @self: a #ModestWindowMgr
+ * @msg_uid: the unique id of a message
+ *
+ * finds the registered view or editor showing the message with
+ * @msg_uid, without scanning the list of windows
+ *
+ * Return value: the #ModestWindow, or %NULL if there is none
+ **/
+ModestWindow * _modest_window_mgr_lookup_window         (ModestWindowMgr *self,
+							 const gchar *msg_uid);
+
+/**
+ * _modest_window_mgr_unindex_window:
+ * @self: a #ModestWindowMgr
+ * @window: a #ModestWindow
+ *
+ * removes @window from the index of windows by message. The
+ * subclasses must call it if they fail to register a window after
+ * chaining up the register_window method
+ **/
+void           _modest_window_mgr_unindex_window        (ModestWindowMgr *self,
+							 ModestWindow *window);
+
 G_END_DECLS
 
 #endif /* __MODEST_WINDOW_MGR_PRIV_H__ */
@@ -29,6 +29,7 @@
 
 #include <string.h>
 #include "modest-window-mgr.h"
+#include "modest-window-mgr-priv.h"
 #include "modest-runtime.h"
 #include "modest-tny-folder.h"
 #include "modest-ui-actions.h"
@@ -37,6 +38,7 @@
 #include "widgets/modest-msg-edit-window.h"
 #include "widgets/modest-msg-view-window.h"
 #include "modest-debug.h"
+#include "modest-trace.h"
 #include <tny-simple-list.h>
 
 
@@ -91,19 +93,43 @@ enum {
 	NUM_SIGNALS
 };
 
+/* a pool of pre-built windows of the same type, refilled when idle */
+typedef struct {
+	GType        type;
+	GQueue      *windows;
+	guint        max_size;
+	guint        refill_delay;   /* msecs before refilling after a use */
+	guint        refill_id;
+
+	/* metrics */
+	guint        hits;
+	guint        misses;
+	guint        builds;
+	gint64       total_build_time;
+	gint64       max_build_time;
+} WindowPool;
+
+/* the windows showing a message, and whether the message is
+   pre-registered because a window for it is being built. It's
+   alive while any of them holds a reference */
+typedef struct {
+	guint        ref_count;
+	gboolean     preregistered;
+	GSList      *windows;
+} UidEntry;
+
 typedef struct _ModestWindowMgrPrivate ModestWindowMgrPrivate;
 struct _ModestWindowMgrPrivate {
 	guint         banner_counter;
 
 	GSList       *windows_that_prevent_hibernation;
-	GSList       *preregistered_uids;
+	GHashTable   *uids;          /* msg uid -> UidEntry */
+	GHashTable   *window_uids;   /* window -> the msg uid it's indexed with */
 
 	guint        closing_time;
 
-	GtkWidget    *cached_view;
-	GtkWidget    *cached_editor;
-	guint        idle_load_view_id;
-	guint        idle_load_editor_id;
+	WindowPool   *view_pool;
+	WindowPool   *editor_pool;
 
 	guint        queue_change_handler;
 	TnyList      *progress_operations;
@@ -208,40 +234,128 @@ modest_window_mgr_class_init (ModestWindowMgrClass *klass)
 			      G_TYPE_NONE, 0);
 }
 
-static gboolean
-idle_load_view (ModestWindowMgr *mgr)
+static WindowPool *
+window_pool_new (GType type, guint max_size, guint refill_delay)
 {
-	ModestWindowMgrPrivate *priv = MODEST_WINDOW_MGR_GET_PRIVATE (mgr);
-	
-	priv->cached_view = g_object_new (MODEST_TYPE_MSG_VIEW_WINDOW, NULL);
-	priv->idle_load_view_id = 0;
-	return FALSE;
+	WindowPool *pool;
+
+	pool = g_slice_new0 (WindowPool);
+	pool->type = type;
+	pool->windows = g_queue_new ();
+	pool->max_size = max_size;
+	pool->refill_delay = refill_delay;
+
+	return pool;
+}
+
+static void
+window_pool_clear (WindowPool *pool)
+{
+	GtkWidget *window;
+
+	while ((window = g_queue_pop_head (pool->windows)) != NULL)
+		gtk_widget_destroy (window);
+}
+
+static void
+window_pool_free (WindowPool *pool)
+{
+	if (pool->refill_id > 0) {
+		g_source_remove (pool->refill_id);
+		pool->refill_id = 0;
+	}
+	window_pool_clear (pool);
+	g_queue_free (pool->windows);
+	g_slice_free (WindowPool, pool);
+}
+
+static GtkWidget *
+window_pool_build (WindowPool *pool)
+{
+	GtkWidget *window;
+	gint64 start, elapsed;
+
+	start = modest_trace_get_monotonic_time ();
+	window = g_object_new (pool->type, NULL);
+	elapsed = modest_trace_get_monotonic_time () - start;
+
+	pool->builds++;
+	pool->total_build_time += elapsed;
+	if (elapsed > pool->max_build_time)
+		pool->max_build_time = elapsed;
+
+	return window;
 }
 
 static gboolean
-idle_load_editor (ModestWindowMgr *mgr)
+window_pool_refill (gpointer userdata)
 {
-	ModestWindowMgrPrivate *priv = MODEST_WINDOW_MGR_GET_PRIVATE (mgr);
-	
-	priv->cached_editor = g_object_new (MODEST_TYPE_MSG_EDIT_WINDOW, NULL);
-	priv->idle_load_editor_id = 0;
+	WindowPool *pool = (WindowPool *) userdata;
+
+	pool->refill_id = 0;
+
+	/* Pre-built windows are just an optimization, give the
+	   memory back if the system is running out of it */
+	if (modest_platform_check_memory_low (NULL, FALSE)) {
+		window_pool_clear (pool);
+		return FALSE;
+	}
+
+	if (g_queue_get_length (pool->windows) < pool->max_size)
+		g_queue_push_tail (pool->windows, window_pool_build (pool));
+
+	/* Build the rest one by one, without blocking the UI for
+	   too long */
+	if (g_queue_get_length (pool->windows) < pool->max_size)
+		pool->refill_id = g_idle_add_full (G_PRIORITY_LOW, window_pool_refill,
+						   pool, NULL);
+
 	return FALSE;
 }
 
 static void
-load_new_view (ModestWindowMgr *self)
+window_pool_schedule_refill (WindowPool *pool)
 {
-	ModestWindowMgrPrivate *priv = MODEST_WINDOW_MGR_GET_PRIVATE (self);
-	if ((priv->cached_view == NULL) && (priv->idle_load_view_id == 0))
-		priv->idle_load_view_id = g_timeout_add (2500, (GSourceFunc) idle_load_view, self);
+	/* We wait a bit because the window we have just handed out
+	   is very likely being shown right now */
+	if ((g_queue_get_length (pool->windows) < pool->max_size) && (pool->refill_id == 0))
+		pool->refill_id = g_timeout_add (pool->refill_delay, window_pool_refill, pool);
+}
+
+static GtkWidget *
+window_pool_get (WindowPool *pool)
+{
+	GtkWidget *window;
+
+	window = g_queue_pop_head (pool->windows);
+	if (window) {
+		pool->hits++;
+	} else {
+		pool->misses++;
+		window = window_pool_build (pool);
+	}
+	window_pool_schedule_refill (pool);
+
+	return window;
+}
+
+static gchar *
+window_pool_to_string (WindowPool *pool)
+{
+	return g_strdup_printf ("%s: %d/%d ready, %d hits, %d misses, "
+				"%d built (avg %lld ms, max %lld ms)",
+				g_type_name (pool->type),
+				g_queue_get_length (pool->windows), pool->max_size,
+				pool->hits, pool->misses, pool->builds,
+				pool->builds ? (long long) (pool->total_build_time / pool->builds) / 1000 : 0LL,
+				(long long) pool->max_build_time / 1000);
 }
 
 static void
-load_new_editor (ModestWindowMgr *self)
+uid_entry_free (UidEntry *entry)
 {
-	ModestWindowMgrPrivate *priv = MODEST_WINDOW_MGR_GET_PRIVATE (self);
-	if ((priv->cached_editor == NULL) && (priv->idle_load_editor_id == 0))
-		priv->idle_load_editor_id = g_timeout_add (5000, (GSourceFunc) idle_load_editor, self);
+	g_slist_free (entry->windows);
+	g_slice_free (UidEntry, entry);
 }
 
 static void
@@ -251,12 +365,17 @@ modest_window_mgr_init (ModestWindowMgr *obj)
 
 	priv = MODEST_WINDOW_MGR_GET_PRIVATE(obj);
 	priv->banner_counter = 0;
-	priv->preregistered_uids = NULL;
+	priv->uids = g_hash_table_new_full (g_str_hash, g_str_equal,
+					    g_free, (GDestroyNotify) uid_entry_free);
+	priv->window_uids = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+						   NULL, g_free);
 
 	priv->closing_time = 0;
 
-	priv->cached_view = NULL;
-	priv->cached_editor = NULL;
+	priv->view_pool = window_pool_new (MODEST_TYPE_MSG_VIEW_WINDOW,
+					   MODEST_WINDOW_MGR_DEFAULT_VIEW_POOL_SIZE, 2500);
+	priv->editor_pool = window_pool_new (MODEST_TYPE_MSG_EDIT_WINDOW,
+					     MODEST_WINDOW_MGR_DEFAULT_EDITOR_POOL_SIZE, 5000);
 
 	priv->windows_that_prevent_hibernation = NULL;
 
@@ -269,28 +388,18 @@ modest_window_mgr_finalize (GObject *obj)
 {
 	ModestWindowMgrPrivate *priv = MODEST_WINDOW_MGR_GET_PRIVATE(obj);
 
-	if (priv->idle_load_view_id > 0) {
-		g_source_remove (priv->idle_load_view_id);
-		priv->idle_load_view_id = 0;
-	}
-	
-	if (priv->idle_load_editor_id > 0) {
-		g_source_remove (priv->idle_load_editor_id);
-		priv->idle_load_editor_id = 0;
+	if (priv->view_pool) {
+		window_pool_free (priv->view_pool);
+		priv->view_pool = NULL;
 	}
-	
-	if (priv->cached_view) {
-		gtk_widget_destroy (priv->cached_view);
-		priv->cached_view = NULL;
-	}
-	if (priv->cached_editor) {
-		gtk_widget_destroy (priv->cached_editor);
-		priv->cached_editor = NULL;
+	if (priv->editor_pool) {
+		window_pool_free (priv->editor_pool);
+		priv->editor_pool = NULL;
 	}
 
 	if (priv->windows_that_prevent_hibernation) {
 		g_slist_free (priv->windows_that_prevent_hibernation);
-		priv->cached_editor = NULL;
+		priv->windows_that_prevent_hibernation = NULL;
 	}
 
 	modest_signal_mgr_disconnect_all_and_destroy (priv->sighandlers);
@@ -305,8 +414,8 @@ modest_window_mgr_finalize (GObject *obj)
 		priv->progress_operations = NULL;
 	}
 
-	g_slist_foreach (priv->preregistered_uids, (GFunc)g_free, NULL);
-	g_slist_free (priv->preregistered_uids);
+	g_hash_table_destroy (priv->window_uids);
+	g_hash_table_destroy (priv->uids);
 
 	G_OBJECT_CLASS(parent_class)->finalize (obj);
 }
@@ -320,57 +429,163 @@ modest_window_mgr_new (void)
 
 
 
-/* do we have uid? */
-static gboolean
-has_uid (GSList *list, const gchar *uid)
+static UidEntry *
+uid_entry_ref (ModestWindowMgrPrivate *priv, const gchar *uid)
 {
-	GSList *cursor = list;
+	UidEntry *entry;
 
-	if (!uid)
-		return FALSE;
-	
-	while (cursor) {
-		if (cursor->data && strcmp (cursor->data, uid) == 0)
-			return TRUE;
-		cursor = g_slist_next (cursor);
+	entry = g_hash_table_lookup (priv->uids, uid);
+	if (!entry) {
+		entry = g_slice_new0 (UidEntry);
+		g_hash_table_insert (priv->uids, g_strdup (uid), entry);
 	}
-	return FALSE;
+	entry->ref_count++;
+
+	return entry;
 }
 
+static void
+uid_entry_unref (ModestWindowMgrPrivate *priv, const gchar *uid)
+{
+	UidEntry *entry;
+
+	entry = g_hash_table_lookup (priv->uids, uid);
+	g_return_if_fail (entry && entry->ref_count > 0);
 
-/* remove all from the list have have uid = uid */
-static GSList*
-remove_uid (GSList *list, const gchar *uid)
+	if (--entry->ref_count == 0)
+		g_hash_table_remove (priv->uids, uid);
+}
+
+/* the uid of the message shown by a view or an editor. Embedded
+   messages do not have uid */
+static gchar *
+get_window_uid (ModestWindow *window)
 {
-	GSList *cursor = list, *start = list;
-	
-	if (!uid)
-		return list;
-	
-	while (cursor) {
-		GSList *next = g_slist_next (cursor);
-		if (cursor->data && strcmp (cursor->data, uid) == 0) {
-			g_free (cursor->data);
-			start = g_slist_delete_link (start, cursor);
+	gchar *uid = NULL;
+
+	if (MODEST_IS_MSG_VIEW_WINDOW (window)) {
+		uid = g_strdup (modest_msg_view_window_get_message_uid (MODEST_MSG_VIEW_WINDOW (window)));
+		if (!uid) {
+			TnyHeader *header;
+
+			header = modest_msg_view_window_get_header (MODEST_MSG_VIEW_WINDOW (window));
+			if (header) {
+				uid = modest_tny_folder_get_header_unique_id (header);
+				g_object_unref (header);
+			}
 		}
-		cursor = next;
+	} else if (MODEST_IS_MSG_EDIT_WINDOW (window)) {
+		uid = g_strdup (modest_msg_edit_window_get_message_uid (MODEST_MSG_EDIT_WINDOW (window)));
 	}
-	return start;
+
+	return uid;
 }
 
+static void
+index_window (ModestWindowMgr *self, ModestWindow *window)
+{
+	ModestWindowMgrPrivate *priv;
+	UidEntry *entry;
+	gchar *uid;
+
+	priv = MODEST_WINDOW_MGR_GET_PRIVATE (self);
+
+	uid = get_window_uid (window);
+	if (!uid)
+		return;
+
+	entry = uid_entry_ref (priv, uid);
+	entry->windows = g_slist_prepend (entry->windows, window);
+	g_hash_table_insert (priv->window_uids, window, uid);
+}
 
-static GSList *
-append_uid (GSList *list, const gchar *uid)
+static void
+unindex_window (ModestWindowMgr *self, ModestWindow *window)
 {
-	return g_slist_append (list, g_strdup(uid));
+	ModestWindowMgrPrivate *priv;
+	UidEntry *entry;
+	const gchar *uid;
+
+	priv = MODEST_WINDOW_MGR_GET_PRIVATE (self);
+
+	uid = g_hash_table_lookup (priv->window_uids, window);
+	if (!uid)
+		return;
+
+	entry = g_hash_table_lookup (priv->uids, uid);
+	if (entry) {
+		entry->windows = g_slist_remove (entry->windows, window);
+		uid_entry_unref (priv, uid);
+	}
+	g_hash_table_remove (priv->window_uids, window);
 }
 
+void
+_modest_window_mgr_unindex_window (ModestWindowMgr *self, ModestWindow *window)
+{
+	ModestWindowMgrPrivate *priv;
+
+	g_return_if_fail (MODEST_IS_WINDOW_MGR (self));
+
+	priv = MODEST_WINDOW_MGR_GET_PRIVATE (self);
+
+	unindex_window (self, window);
+	if (MODEST_IS_MSG_VIEW_WINDOW (window))
+		priv->sighandlers = modest_signal_mgr_disconnect (priv->sighandlers,
+								  G_OBJECT (window), "msg-changed");
+}
+
+ModestWindow *
+_modest_window_mgr_lookup_window (ModestWindowMgr *self, const gchar *msg_uid)
+{
+	ModestWindowMgrPrivate *priv;
+	UidEntry *entry;
+
+	g_return_val_if_fail (MODEST_IS_WINDOW_MGR (self), NULL);
+
+	if (!msg_uid)
+		return NULL;
+
+	priv = MODEST_WINDOW_MGR_GET_PRIVATE (self);
+
+	entry = g_hash_table_lookup (priv->uids, msg_uid);
+
+	return (entry && entry->windows) ? MODEST_WINDOW (entry->windows->data) : NULL;
+}
+
+void
+modest_window_mgr_window_uid_changed (ModestWindowMgr *self, ModestWindow *window)
+{
+	ModestWindowMgrPrivate *priv;
+
+	g_return_if_fail (MODEST_IS_WINDOW_MGR (self));
+	g_return_if_fail (MODEST_IS_WINDOW (window));
+
+	priv = MODEST_WINDOW_MGR_GET_PRIVATE (self);
 
+	/* Only the registered windows are indexed */
+	if (!g_hash_table_lookup (priv->window_uids, window))
+		return;
+
+	unindex_window (self, window);
+	index_window (self, window);
+}
+
+static void
+on_window_msg_changed (ModestMsgViewWindow *window,
+		       GtkTreeModel *model,
+		       GtkTreeRowReference *row_reference,
+		       gpointer user_data)
+{
+	modest_window_mgr_window_uid_changed (MODEST_WINDOW_MGR (user_data),
+					      MODEST_WINDOW (window));
+}
 
 void 
 modest_window_mgr_register_header (ModestWindowMgr *self,  TnyHeader *header, const gchar *alt_uid)
 {
 	ModestWindowMgrPrivate *priv;
+	UidEntry *entry;
 	gchar* uid;
 	
 	g_return_if_fail (MODEST_IS_WINDOW_MGR (self));
@@ -383,9 +598,11 @@ modest_window_mgr_register_header (ModestWindowMgr *self,  TnyHeader *header, co
 		uid = modest_tny_folder_get_header_unique_id (header);
 	}
 
-	if (!has_uid (priv->preregistered_uids, uid)) {
+	entry = g_hash_table_lookup (priv->uids, uid);
+	if (!entry || !entry->preregistered) {
 		MODEST_DEBUG_BLOCK(g_debug ("registering new uid %s", uid););
-		priv->preregistered_uids = append_uid (priv->preregistered_uids, uid);
+		entry = uid_entry_ref (priv, uid);
+		entry->preregistered = TRUE;
 	} else
 		MODEST_DEBUG_BLOCK(g_debug ("already had uid %s", uid););
 	
@@ -396,6 +613,7 @@ void
 modest_window_mgr_unregister_header (ModestWindowMgr *self,  TnyHeader *header)
 {
 	ModestWindowMgrPrivate *priv;
+	UidEntry *entry;
 	gchar* uid;
 	
 	g_return_if_fail (MODEST_IS_WINDOW_MGR (self));
@@ -403,20 +621,16 @@ modest_window_mgr_unregister_header (ModestWindowMgr *self,  TnyHeader *header)
 		
 	priv = MODEST_WINDOW_MGR_GET_PRIVATE (self);
 	uid = modest_tny_folder_get_header_unique_id (header);
+	if (!uid)
+		return;
 
-	if (!has_uid (priv->preregistered_uids, uid)) {
-		MODEST_DEBUG_BLOCK(g_debug ("trying to unregister non-existing uid %s", uid););
-		priv->preregistered_uids = append_uid (priv->preregistered_uids, uid);
-	} else
+	entry = g_hash_table_lookup (priv->uids, uid);
+	if (entry && entry->preregistered) {
 		MODEST_DEBUG_BLOCK(g_debug ("unregistering uid %s", uid););
-	
-	if (has_uid (priv->preregistered_uids, uid)) {
-		priv->preregistered_uids = remove_uid (priv->preregistered_uids, uid);
-		if (has_uid (priv->preregistered_uids, uid))
-			g_debug ("BUG: uid %s NOT removed", uid);
-		else
-			MODEST_DEBUG_BLOCK(g_debug ("uid %s removed", uid););
-	}
+		entry->preregistered = FALSE;
+		uid_entry_unref (priv, uid);
+	} else
+		MODEST_DEBUG_BLOCK(g_debug ("trying to unregister non-existing uid %s", uid););
 		
 	g_free (uid);
 }
@@ -498,21 +712,19 @@ modest_window_mgr_find_registered_message_uid_default (ModestWindowMgr *self, co
 						       ModestWindow **win)
 {
 	ModestWindowMgrPrivate *priv = NULL;
-	gchar* uid = NULL;
-	gboolean has_header = FALSE;
+	UidEntry *entry;
 
 	g_return_val_if_fail (MODEST_IS_WINDOW_MGR (self), FALSE);
 	g_return_val_if_fail (msg_uid && msg_uid[0] != '\0', FALSE);
 
 	priv = MODEST_WINDOW_MGR_GET_PRIVATE (self);
 
-	if (win)
-		*win = NULL;
+	entry = g_hash_table_lookup (priv->uids, msg_uid);
 
-	has_header = has_uid (priv->preregistered_uids, msg_uid);
-	g_free (uid);
+	if (win)
+		*win = (entry && entry->windows) ? MODEST_WINDOW (entry->windows->data) : NULL;
 
-	return has_header;
+	return entry != NULL;
 }
 
 GList *
@@ -573,29 +785,32 @@ modest_window_mgr_register_window_default (ModestWindowMgr *self,
 						       self);
 
 
-	/* remove from the list of pre-registered uids */
-	if (MODEST_IS_MSG_VIEW_WINDOW(window)) {
-		const gchar *uid = modest_msg_view_window_get_message_uid
-			(MODEST_MSG_VIEW_WINDOW (window));
+	/* remove from the pre-registered uids, the window is the one
+	   holding it from now on */
+	if (MODEST_IS_MSG_VIEW_WINDOW(window) || MODEST_IS_MSG_EDIT_WINDOW(window)) {
+		const gchar *uid;
+		UidEntry *entry;
+
+		uid = MODEST_IS_MSG_VIEW_WINDOW(window) ?
+			modest_msg_view_window_get_message_uid (MODEST_MSG_VIEW_WINDOW (window)) :
+			modest_msg_edit_window_get_message_uid (MODEST_MSG_EDIT_WINDOW (window));
 
 		MODEST_DEBUG_BLOCK(g_debug ("registering window for %s", uid ? uid : "<none>"););
 
-		if (has_uid (priv->preregistered_uids, uid)) {
-			priv->preregistered_uids = 
-				remove_uid (priv->preregistered_uids,
-					    modest_msg_view_window_get_message_uid
-					    (MODEST_MSG_VIEW_WINDOW (window)));
+		entry = uid ? g_hash_table_lookup (priv->uids, uid) : NULL;
+		if (entry && entry->preregistered) {
+			entry->preregistered = FALSE;
+			uid_entry_unref (priv, uid);
 		}
-	} else if (MODEST_IS_MSG_EDIT_WINDOW(window)) {
-		const gchar *uid = modest_msg_edit_window_get_message_uid
-			(MODEST_MSG_EDIT_WINDOW (window));
 
-		MODEST_DEBUG_BLOCK(g_debug ("registering window for %s", uid););
+		index_window (self, window);
 
-		priv->preregistered_uids = 
-			remove_uid (priv->preregistered_uids,
-				    modest_msg_edit_window_get_message_uid
-				    (MODEST_MSG_EDIT_WINDOW (window)));
+		/* Views could move to other messages */
+		if (MODEST_IS_MSG_VIEW_WINDOW (window))
+			priv->sighandlers = modest_signal_mgr_connect (priv->sighandlers,
+								       G_OBJECT (window), "msg-changed",
+								       G_CALLBACK (on_window_msg_changed),
+								       self);
 	}
 
 	return TRUE;
@@ -615,6 +830,9 @@ modest_window_mgr_unregister_window_default (ModestWindowMgr *self,
 	g_return_if_fail (MODEST_IS_WINDOW_MGR (self));
 	g_return_if_fail (MODEST_IS_WINDOW (window));
 
+	/* Remove it from the index of windows by message */
+	_modest_window_mgr_unindex_window (self, window);
+
 	/* Save state */
 	modest_window_save_state (window);
 
@@ -804,43 +1022,79 @@ modest_window_mgr_get_num_windows (ModestWindowMgr *self)
 GtkWidget *   
 modest_window_mgr_get_msg_edit_window (ModestWindowMgr *self)
 {
-	GtkWidget *result;
 	ModestWindowMgrPrivate *priv;
 
 	g_return_val_if_fail (self && MODEST_IS_WINDOW_MGR(self), NULL);
 
 	priv = MODEST_WINDOW_MGR_GET_PRIVATE(self);
-		
-	if (priv->cached_editor) {
-		result = priv->cached_editor;
-		priv->cached_editor = NULL;
-		load_new_editor (self);
-	} else {
-		result = g_object_new (MODEST_TYPE_MSG_EDIT_WINDOW, NULL);
-	}
 
-	return result;
+	return window_pool_get (priv->editor_pool);
 }
 
 GtkWidget *   
 modest_window_mgr_get_msg_view_window (ModestWindowMgr *self)
 {
-	GtkWidget *result;
 	ModestWindowMgrPrivate *priv;
 
 	g_return_val_if_fail (self && MODEST_IS_WINDOW_MGR(self), NULL);
 	
 	priv = MODEST_WINDOW_MGR_GET_PRIVATE(self);
 
-	if (priv->cached_view) {
-		result = priv->cached_view;
-		priv->cached_view = NULL;
-		load_new_view (self);
-	} else {
-		result = g_object_new (MODEST_TYPE_MSG_VIEW_WINDOW, NULL);
-	}
+	return window_pool_get (priv->view_pool);
+}
 
-	return result;
+void
+modest_window_mgr_set_caches_size (ModestWindowMgr *self,
+				   guint views,
+				   guint editors)
+{
+	ModestWindowMgrPrivate *priv;
+
+	g_return_if_fail (MODEST_IS_WINDOW_MGR (self));
+
+	priv = MODEST_WINDOW_MGR_GET_PRIVATE(self);
+
+	priv->view_pool->max_size = views;
+	priv->editor_pool->max_size = editors;
+
+	/* Destroy the windows that do not fit anymore */
+	while (g_queue_get_length (priv->view_pool->windows) > views)
+		gtk_widget_destroy (g_queue_pop_tail (priv->view_pool->windows));
+	while (g_queue_get_length (priv->editor_pool->windows) > editors)
+		gtk_widget_destroy (g_queue_pop_tail (priv->editor_pool->windows));
+}
+
+void
+modest_window_mgr_release_caches (ModestWindowMgr *self)
+{
+	ModestWindowMgrPrivate *priv;
+
+	g_return_if_fail (MODEST_IS_WINDOW_MGR (self));
+
+	priv = MODEST_WINDOW_MGR_GET_PRIVATE(self);
+
+	/* They'll be refilled the next time a window is requested */
+	window_pool_clear (priv->view_pool);
+	window_pool_clear (priv->editor_pool);
+}
+
+gchar *
+modest_window_mgr_caches_to_string (ModestWindowMgr *self)
+{
+	ModestWindowMgrPrivate *priv;
+	gchar *view_str, *editor_str, *str;
+
+	g_return_val_if_fail (MODEST_IS_WINDOW_MGR (self), NULL);
+
+	priv = MODEST_WINDOW_MGR_GET_PRIVATE(self);
+
+	view_str = window_pool_to_string (priv->view_pool);
+	editor_str = window_pool_to_string (priv->editor_pool);
+	str = g_strdup_printf ("%s\n%s", view_str, editor_str);
+	g_free (view_str);
+	g_free (editor_str);
+
+	return str;
 }
 
 void
@@ -938,8 +1192,12 @@ modest_window_mgr_create_caches (ModestWindowMgr *mgr)
 static void
 modest_window_mgr_create_caches_default (ModestWindowMgr *self)
 {
-	load_new_editor (self);
-	load_new_view (self);
+	ModestWindowMgrPrivate *priv;
+
+	priv = MODEST_WINDOW_MGR_GET_PRIVATE(self);
+
+	window_pool_schedule_refill (priv->editor_pool);
+	window_pool_schedule_refill (priv->view_pool);
 }
 
 static gboolean
@@ -44,6 +44,10 @@ G_BEGIN_DECLS
 #define MODEST_IS_WINDOW_MGR_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE((klass),MODEST_TYPE_WINDOW_MGR))
 #define MODEST_WINDOW_MGR_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS((obj),MODEST_TYPE_WINDOW_MGR,ModestWindowMgrClass))
 
+/* number of message view and editor windows kept pre-built */
+#define MODEST_WINDOW_MGR_DEFAULT_VIEW_POOL_SIZE   2
+#define MODEST_WINDOW_MGR_DEFAULT_EDITOR_POOL_SIZE 1
+
 typedef struct _ModestWindowMgr      ModestWindowMgr;
 typedef struct _ModestWindowMgrClass ModestWindowMgrClass;
 
@@ -372,6 +376,41 @@ GtkWidget *   modest_window_mgr_get_msg_view_window (ModestWindowMgr *self);
  */
 GtkWidget *   modest_window_mgr_get_msg_edit_window (ModestWindowMgr *self);
 
+/**
+ * modest_window_mgr_set_caches_size:
+ * @self: a #ModestWindowMgr
+ * @views: the number of #ModestMsgViewWindow to keep pre-built
+ * @editors: the number of #ModestMsgEditWindow to keep pre-built
+ *
+ * sets the size of the pools of windows returned by
+ * modest_window_mgr_get_msg_view_window() and
+ * modest_window_mgr_get_msg_edit_window(). 0 disables the pool
+ */
+void          modest_window_mgr_set_caches_size (ModestWindowMgr *self,
+						 guint views,
+						 guint editors);
+
+/**
+ * modest_window_mgr_release_caches:
+ * @self: a #ModestWindowMgr
+ *
+ * destroys the pre-built windows, for example when the system is
+ * running out of memory. The pools are refilled the next time a
+ * window is requested
+ */
+void          modest_window_mgr_release_caches (ModestWindowMgr *self);
+
+/**
+ * modest_window_mgr_caches_to_string:
+ * @self: a #ModestWindowMgr
+ *
+ * Returns a string with the state and the hit/miss and build time
+ * metrics of the pools of pre-built windows (for debugging)
+ *
+ * Returns: a newly allocated string
+ */
+gchar *       modest_window_mgr_caches_to_string (ModestWindowMgr *self);
+
 /**
  * modest_window_mgr_show_initial_window:
  * @self: a #ModestWindowMgr
@@ -460,6 +499,17 @@ gboolean modest_window_mgr_close_all_but_initial (ModestWindowMgr *self);
 
 ModestWindow *modest_window_mgr_get_folder_window (ModestWindowMgr *self);
 
+/**
+ * modest_window_mgr_window_uid_changed:
+ * @self: a #ModestWindowMgr
+ * @window: a #ModestWindow
+ *
+ * notifies the window manager that @window now shows a message with
+ * a different unique id, for example because a draft was saved, so
+ * that it could be found by the new one
+ */
+void modest_window_mgr_window_uid_changed (ModestWindowMgr *self, ModestWindow *window);
+
 
 G_END_DECLS
 
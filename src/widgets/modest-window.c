@@ -312,8 +312,27 @@ modest_window_check_dimming_rules_group (ModestWindow *self,
 	g_return_if_fail (MODEST_IS_WINDOW (self));
 	priv = MODEST_WINDOW_GET_PRIVATE(self);
 
+	modest_window_check_dimming_rules_group_for (self, group_name, MODEST_DIMMING_DEPS_ALL);
+}
+
+void
+modest_window_check_dimming_rules_group_for (ModestWindow *self,
+					     const gchar *group_name,
+					     ModestDimmingDeps deps)
+{
+	ModestWindowPrivate *priv;	
+
+	g_return_if_fail (MODEST_IS_WINDOW (self));
+	priv = MODEST_WINDOW_GET_PRIVATE(self);
+
+	/* Even if dimming is disabled we have to remember what
+	   changed, otherwise the next partial check would miss it */
 	if (priv->ui_dimming_enabled)
-		modest_ui_dimming_manager_process_dimming_rules_group (priv->ui_dimming_manager, group_name);
+		modest_ui_dimming_manager_process_dimming_rules_group_for (priv->ui_dimming_manager,
+									   group_name, deps);
+	else if (priv->ui_dimming_manager)
+		modest_ui_dimming_manager_invalidate_dimming_rules_group (priv->ui_dimming_manager,
+									  group_name, deps);
 }
 
 void
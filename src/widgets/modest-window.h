@@ -79,6 +79,20 @@ typedef struct _DimmedState {
 	gboolean all_selected;
 } DimmedState;
 
+/* The inputs a dimming rule depends on. A rule is only evaluated
+ * again if one of its inputs changed since the last time it was
+ * evaluated. Rules with no dependencies are only evaluated on full
+ * refreshes */
+typedef enum {
+	MODEST_DIMMING_DEPS_NONE         = 0,
+	MODEST_DIMMING_DEPS_SELECTION    = 1 << 0,
+	MODEST_DIMMING_DEPS_FOLDER       = 1 << 1,
+	MODEST_DIMMING_DEPS_CONNECTIVITY = 1 << 2,
+	MODEST_DIMMING_DEPS_CLIPBOARD    = 1 << 3,
+	MODEST_DIMMING_DEPS_OPERATIONS   = 1 << 4,
+	MODEST_DIMMING_DEPS_ALL          = (1 << 5) - 1
+} ModestDimmingDeps;
+
 /* convenience macros */
 #define MODEST_TYPE_WINDOW             (modest_window_get_type())
 #define MODEST_WINDOW(obj)             (G_TYPE_CHECK_INSTANCE_CAST((obj),MODEST_TYPE_WINDOW,ModestWindow))
@@ -313,6 +327,19 @@ void modest_window_check_dimming_rules (ModestWindow *self);
 void modest_window_check_dimming_rules_group (ModestWindow *self,
 					      const gchar *group_name);
 
+/**
+ * modest_window_check_dimming_rules_group_for:
+ * @self: a #ModestWindow instance object
+ * @group_name: the name of the dimming rules group
+ * @deps: the #ModestDimmingDeps inputs that changed
+ *
+ * Like modest_window_check_dimming_rules_group() but only the rules
+ * of @group_name that depend on any of @deps are evaluated again.
+ **/
+void modest_window_check_dimming_rules_group_for (ModestWindow *self,
+						  const gchar *group_name,
+						  ModestDimmingDeps deps);
+
 
 /**
  * modest_window_enable_dimming:
@@ -0,0 +1,170 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Benchmark of the address list utilities with long lists, like the
+ * ones of a reply to all of a mailing list message. For every list
+ * size it builds a list of addresses in the usual formats, with some
+ * duplicates, and runs the operations done to compose a reply. The
+ * latencies are measured with modest-trace, and the p50/p95 of every
+ * operation are reported.
+ *
+ *   bench_address-list [-n ITERATIONS] [-m MAX_ADDRESSES]
+ */
+
+#include <string.h>
+#include <glib.h>
+#include <modest-text-utils.h>
+#include <modest-trace.h>
+
+static gint iterations = 10;
+static gint max_addresses = 5000;
+
+static GOptionEntry options[] = {
+	{ "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations,
+	  "Number of times every operation is run (default 10)", "N" },
+	{ "max", 'm', 0, G_OPTION_ARG_INT, &max_addresses,
+	  "Do not run the lists longer than N addresses (default 5000)", "N" },
+	{ NULL }
+};
+
+/* One address of every four is a duplicate, with a different
+   format */
+static gchar *
+create_address_list (gint count)
+{
+	GString *str;
+	gint i;
+
+	str = g_string_new ("");
+	for (i = 0; i < count; i++) {
+		gint n = (i % 4 == 3) ? i / 2 : i;
+
+		if (i > 0)
+			g_string_append (str, (i % 2) ? ", " : "; ");
+		switch (i % 3) {
+		case 0:
+			g_string_append_printf (str, "user%d@example.com", n);
+			break;
+		case 1:
+			g_string_append_printf (str, "User %d <user%d@example.com>", n, n);
+			break;
+		default:
+			g_string_append_printf (str, "\"Doe, User %d\" <USER%d@example.com>", n, n);
+			break;
+		}
+	}
+
+	return g_string_free (str, FALSE);
+}
+
+static void
+run (const gchar *name, gint count, const gchar *list)
+{
+	ModestTraceSpan *span;
+	gchar *detail, *result;
+	GSList *addresses;
+	GArray *spans;
+
+	detail = g_strdup_printf ("%d", count);
+
+	span = modest_trace_begin (name, detail);
+	if (!strcmp (name, "parse")) {
+		spans = modest_text_utils_parse_addresses (list);
+		g_array_free (spans, TRUE);
+	} else if (!strcmp (name, "split")) {
+		addresses = modest_text_utils_split_addresses_list (list);
+		g_slist_foreach (addresses, (GFunc) g_free, NULL);
+		g_slist_free (addresses);
+	} else if (!strcmp (name, "remove-dups")) {
+		result = modest_text_utils_remove_duplicate_addresses (list);
+		g_free (result);
+	} else if (!strcmp (name, "remove")) {
+		result = modest_text_utils_remove_address (list, "User 1 <user1@example.com>");
+		g_free (result);
+	} else if (!strcmp (name, "display")) {
+		result = modest_text_utils_get_display_addresses (list);
+		g_free (result);
+	}
+	modest_trace_end (span);
+
+	g_free (detail);
+}
+
+static void
+print_stats (const gchar *name, gint count)
+{
+	ModestTraceStats stats;
+
+	if (modest_trace_get_stats (name, &stats))
+		g_print ("%-12s %6d %10.3f %10.3f %10.3f %10.3f\n", name, count,
+			 stats.min, stats.p50, stats.p95, stats.max);
+}
+
+int
+main (int argc, char *argv[])
+{
+	const gchar *operations[] = { "parse", "split", "remove-dups", "remove", "display" };
+	const gint sizes[] = { 10, 100, 500, 1000, 2500, 5000 };
+	GOptionContext *context;
+	GError *error = NULL;
+	guint j, k;
+	gint i;
+
+	g_thread_init (NULL);
+
+	context = g_option_context_new ("- benchmark the address list utilities");
+	g_option_context_add_main_entries (context, options, NULL);
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		g_option_context_free (context);
+		return 1;
+	}
+	g_option_context_free (context);
+
+	modest_trace_set_enabled (TRUE);
+
+	g_print ("%-12s %6s %10s %10s %10s %10s\n", "operation", "count",
+		 "min(ms)", "p50(ms)", "p95(ms)", "max(ms)");
+
+	for (k = 0; k < G_N_ELEMENTS (sizes) && sizes[k] <= max_addresses; k++) {
+		gchar *list = create_address_list (sizes[k]);
+
+		for (j = 0; j < G_N_ELEMENTS (operations); j++) {
+			modest_trace_clear ();
+			for (i = 0; i < iterations; i++)
+				run (operations[j], sizes[k], list);
+			print_stats (operations[j], sizes[k]);
+		}
+		g_free (list);
+	}
+
+	return 0;
+}
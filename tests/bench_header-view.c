@@ -0,0 +1,236 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Scroll benchmark of the header view. It fills a header list model
+ * with fake headers, shows them in a two lines header view and
+ * scrolls it from top to bottom, painting it synchronously after
+ * every step, like the kinetic panning does. The frames per second
+ * are reported for every pass: the first one fills the row cache,
+ * the others should paint from it. With -u the row cache is
+ * invalidated before every frame, to compare with the uncached
+ * rendering.
+ *
+ *   bench_header-view [-r ROWS] [-p PASSES] [-s STEP] [-u]
+ */
+
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+#include <gtk/gtk.h>
+#include <tny-list.h>
+#include <tny-camel-msg.h>
+#include <tny-gtk-header-list-model.h>
+#include <modest-init.h>
+#include <modest-trace.h>
+#include <widgets/modest-header-view.h>
+#include <widgets/modest-header-view-priv.h>
+
+static gint rows = 10000;
+static gint passes = 3;
+static gint step = 16;
+static gboolean uncached = FALSE;
+
+static GOptionEntry options[] = {
+	{ "rows", 'r', 0, G_OPTION_ARG_INT, &rows,
+	  "Number of headers in the view (default 10000)", "N" },
+	{ "passes", 'p', 0, G_OPTION_ARG_INT, &passes,
+	  "Number of times the view is scrolled (default 3)", "N" },
+	{ "step", 's', 0, G_OPTION_ARG_INT, &step,
+	  "Pixels scrolled per frame (default 16)", "PIXELS" },
+	{ "uncached", 'u', 0, G_OPTION_ARG_NONE, &uncached,
+	  "Invalidate the row cache before every frame", NULL },
+	{ NULL }
+};
+
+/* Camel parses the date out of the header, so it must be in RFC822
+   format, that is not localized */
+static gchar *
+get_rfc822_date (time_t date)
+{
+	static const gchar *days[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+	static const gchar *months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+					 "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+	struct tm date_tm;
+
+	gmtime_r (&date, &date_tm);
+
+	return g_strdup_printf ("%s, %02d %s %04d %02d:%02d:%02d +0000",
+				days[date_tm.tm_wday], date_tm.tm_mday,
+				months[date_tm.tm_mon], date_tm.tm_year + 1900,
+				date_tm.tm_hour, date_tm.tm_min, date_tm.tm_sec);
+}
+
+static GtkTreeModel *
+create_model (gint n_rows)
+{
+	TnyList *model;
+	time_t now;
+	gint i;
+
+	model = TNY_LIST (tny_gtk_header_list_model_new ());
+	now = time (NULL);
+
+	for (i = 0; i < n_rows; i++) {
+		TnyMsg *msg;
+		TnyHeader *header;
+		gchar *to, *subject, *date;
+
+		msg = tny_camel_msg_new ();
+		header = tny_msg_get_header (msg);
+
+		to = g_strdup_printf ("\"Recipient %d\" <recipient%d@example.com>, "
+				      "\"Other recipient\" <other@example.com>", i % 97, i % 97);
+		subject = g_strdup_printf ("Re: benchmark message number %d", i);
+		date = get_rfc822_date (now - i * 600);
+
+		tny_header_set_from (header, "\"Modest\" <modest@example.com>");
+		tny_header_set_to (header, to);
+		tny_header_set_subject (header, subject);
+		tny_mime_part_set_header_pair (TNY_MIME_PART (msg), "Date", date);
+		if (i % 3 == 0)
+			tny_header_set_flag (header, TNY_HEADER_FLAG_SEEN);
+
+		tny_list_append (model, G_OBJECT (header));
+
+		g_free (to);
+		g_free (subject);
+		g_free (date);
+		g_object_unref (header);
+		g_object_unref (msg);
+	}
+
+	return GTK_TREE_MODEL (model);
+}
+
+static void
+process_events (void)
+{
+	while (gtk_events_pending ())
+		gtk_main_iteration ();
+}
+
+/* Scrolls the whole view, painting every step. Returns the frames
+   painted and the elapsed time in seconds */
+static gint
+scroll_pass (GtkWidget *header_view, GtkAdjustment *vadj, gdouble *elapsed)
+{
+	ModestHeaderViewRowCache *cache;
+	gint64 start;
+	gdouble value;
+	gint frames = 0;
+
+	cache = _modest_header_view_get_row_cache (MODEST_HEADER_VIEW (header_view));
+
+	start = modest_trace_get_monotonic_time ();
+	for (value = 0; value <= vadj->upper - vadj->page_size; value += step) {
+		if (uncached)
+			_modest_header_view_row_cache_invalidate (cache);
+		gtk_adjustment_set_value (vadj, value);
+		gdk_window_process_updates (header_view->window, TRUE);
+		gdk_flush ();
+		frames++;
+	}
+	*elapsed = (modest_trace_get_monotonic_time () - start) / 1000000.0;
+
+	return frames;
+}
+
+int
+main (int argc, char *argv[])
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	GtkWidget *window, *scrolled, *header_view;
+	GtkAdjustment *vadj;
+	GtkTreeModel *model;
+	GList *columns;
+	gchar *stats;
+	gint i;
+
+	g_thread_init (NULL);
+
+	context = g_option_context_new ("- benchmark the scrolling of the header view");
+	g_option_context_add_main_entries (context, options, NULL);
+	g_option_context_add_group (context, gtk_get_option_group (TRUE));
+	if (!g_option_context_parse (context, &argc, &argv, &error) || step <= 0) {
+		g_printerr ("%s\n", error ? error->message : "Invalid scroll step");
+		g_clear_error (&error);
+		g_option_context_free (context);
+		return 1;
+	}
+	g_option_context_free (context);
+
+	if (!modest_init (argc, argv)) {
+		g_printerr ("Failed running modest_init\n");
+		return 1;
+	}
+
+	model = create_model (rows);
+
+	header_view = modest_header_view_new (NULL, MODEST_HEADER_VIEW_STYLE_TWOLINES);
+	columns = g_list_append (NULL, GINT_TO_POINTER (MODEST_HEADER_VIEW_COLUMN_COMPACT_HEADER_OUT));
+	modest_header_view_set_columns (MODEST_HEADER_VIEW (header_view), columns, TNY_FOLDER_TYPE_SENT);
+	g_list_free (columns);
+	gtk_tree_view_set_model (GTK_TREE_VIEW (header_view), model);
+	g_object_unref (model);
+
+	window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+	gtk_window_set_default_size (GTK_WINDOW (window), 800, 480);
+	scrolled = gtk_scrolled_window_new (NULL, NULL);
+	gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scrolled),
+					GTK_POLICY_NEVER, GTK_POLICY_ALWAYS);
+	gtk_container_add (GTK_CONTAINER (scrolled), header_view);
+	gtk_container_add (GTK_CONTAINER (window), scrolled);
+	gtk_widget_show_all (window);
+	process_events ();
+
+	vadj = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (scrolled));
+
+	g_print ("%d rows, %d pixels per frame%s\n\n", rows, step,
+		 uncached ? ", uncached" : "");
+	g_print ("%-6s %8s %10s %10s\n", "pass", "frames", "time(s)", "fps");
+	for (i = 0; i < passes; i++) {
+		gdouble elapsed;
+		gint frames;
+
+		frames = scroll_pass (header_view, vadj, &elapsed);
+		g_print ("%-6d %8d %10.3f %10.1f\n", i + 1, frames, elapsed,
+			 (elapsed > 0) ? frames / elapsed : 0);
+		process_events ();
+	}
+
+	stats = _modest_header_view_row_cache_to_string (_modest_header_view_get_row_cache (MODEST_HEADER_VIEW (header_view)));
+	g_print ("\n%s", stats);
+	g_free (stats);
+
+	gtk_widget_destroy (window);
+
+	return 0;
+}
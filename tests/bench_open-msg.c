@@ -0,0 +1,339 @@
+/* Copyright (c) 2009, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Benchmark of the message open path. It opens every message of a
+ * corpus (a directory with one RFC822 message per file, like the
+ * cur/ directory of a maildir) in the message view used by the
+ * message windows, and measures the time since the message is set
+ * until its body is completely rendered. The samples are kept by
+ * the benchmark itself, so the p50/p95 take all the opens into
+ * account no matter how many there are. The spans recorded by
+ * modest-trace are reported too, as a breakdown of the last opens.
+ *
+ * With -H, or when there is no display, no widget is created and
+ * the open is measured until the body is decoded and converted to
+ * HTML, the same way the mime part views do it before handing it to
+ * the HTML widget. That is the mode to use in the automated builds.
+ *
+ *   bench_open-msg [-H] [-n ITERATIONS] [-t TIMEOUT] [-o TRACE_FILE] CORPUS_DIR
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+#include <tny-fs-stream.h>
+#include <tny-camel-msg.h>
+#include <tny-camel-mem-stream.h>
+#include <tny-msg-view.h>
+#include <tny-platform-factory.h>
+#include <modest-init.h>
+#include <modest-tny-platform-factory.h>
+#include <modest-tny-msg.h>
+#include <modest-stream-text-to-html.h>
+#include <modest-trace.h>
+#include <widgets/modest-msg-view.h>
+
+static gint iterations = 5;
+static gint timeout = 10;
+static gchar *trace_file = NULL;
+static gboolean headless = FALSE;
+
+static GOptionEntry options[] = {
+	{ "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations,
+	  "Number of times every message is opened (default 5)", "N" },
+	{ "timeout", 't', 0, G_OPTION_ARG_INT, &timeout,
+	  "Max seconds to wait for a message to be rendered (default 10)", "SECS" },
+	{ "output", 'o', 0, G_OPTION_ARG_FILENAME, &trace_file,
+	  "Write the whole trace to FILE", "FILE" },
+	{ "headless", 'H', 0, G_OPTION_ARG_NONE, &headless,
+	  "Do not create any widget, measure until the body is decoded", NULL },
+	{ NULL }
+};
+
+static gboolean rendered = FALSE;
+static gboolean timed_out = FALSE;
+
+static void
+on_rendered (ModestMsgView *view, gpointer user_data)
+{
+	rendered = TRUE;
+}
+
+static gboolean
+on_timeout (gpointer user_data)
+{
+	timed_out = TRUE;
+	return FALSE;
+}
+
+static TnyMsg *
+parse_msg (const gchar *path, GArray *samples)
+{
+	TnyStream *file_stream;
+	TnyMsg *msg;
+	gint64 start;
+	gint fd;
+
+	fd = g_open (path, O_RDONLY, 0);
+	if (fd == -1)
+		return NULL;
+
+	start = modest_trace_get_monotonic_time ();
+	file_stream = tny_fs_stream_new (fd);
+	msg = tny_camel_msg_new ();
+	tny_camel_msg_parse (msg, file_stream);
+	g_object_unref (file_stream);
+	start = modest_trace_get_monotonic_time () - start;
+	g_array_append_val (samples, start);
+
+	return msg;
+}
+
+/* Shows @msg in @view, and waits until its body is rendered. Returns
+   FALSE if it took more than the timeout */
+static gboolean
+open_msg (TnyMsgView *view, TnyMsg *msg, GArray *samples)
+{
+	gint64 start;
+	guint timeout_id;
+
+	rendered = FALSE;
+	timed_out = FALSE;
+	timeout_id = g_timeout_add_seconds (timeout, on_timeout, NULL);
+
+	start = modest_trace_get_monotonic_time ();
+	tny_msg_view_set_msg (view, msg);
+	while (!rendered && !timed_out)
+		g_main_context_iteration (NULL, TRUE);
+
+	if (!rendered)
+		return FALSE;
+
+	start = modest_trace_get_monotonic_time () - start;
+	g_array_append_val (samples, start);
+	g_source_remove (timeout_id);
+
+	/* Paint it, like the message window would do before the
+	   next one is opened */
+	while (gtk_events_pending ())
+		gtk_main_iteration ();
+
+	return TRUE;
+}
+
+/* The same limits used by the mime part views */
+static TnyStream *
+create_text_to_html_stream (TnyStream *out_stream)
+{
+	TnyStream *stream;
+
+	stream = TNY_STREAM (modest_stream_text_to_html_new (out_stream));
+	modest_stream_text_to_html_set_linkify_limit (MODEST_STREAM_TEXT_TO_HTML (stream), 64*1024);
+	modest_stream_text_to_html_set_full_limit (MODEST_STREAM_TEXT_TO_HTML (stream), 128*1024);
+	modest_stream_text_to_html_set_line_limit (MODEST_STREAM_TEXT_TO_HTML (stream), 1024);
+
+	return stream;
+}
+
+/* Does what the message views do with @msg before the HTML widget
+   gets the rendered body, without any widget */
+static gboolean
+decode_msg (TnyMsg *msg, GArray *samples)
+{
+	TnyMimePart *body;
+	TnyStream *out_stream;
+	gint64 start;
+
+	start = modest_trace_get_monotonic_time ();
+	body = modest_tny_msg_find_body_part (msg, TRUE);
+	if (body) {
+		out_stream = TNY_STREAM (tny_camel_mem_stream_new ());
+		if (tny_mime_part_content_type_is (body, "text/html")) {
+			tny_mime_part_decode_to_stream (body, out_stream, NULL);
+		} else {
+			TnyStream *text_to_html_stream;
+
+			text_to_html_stream = create_text_to_html_stream (out_stream);
+			tny_mime_part_decode_to_stream (body, text_to_html_stream, NULL);
+			tny_stream_close (text_to_html_stream);
+			g_object_unref (text_to_html_stream);
+		}
+		g_object_unref (out_stream);
+		g_object_unref (body);
+	}
+	start = modest_trace_get_monotonic_time () - start;
+	g_array_append_val (samples, start);
+
+	return TRUE;
+}
+
+static void
+print_samples (const gchar *name, GArray *samples)
+{
+	ModestTraceStats stats;
+
+	modest_trace_compute_stats ((gint64 *) samples->data, samples->len, &stats);
+	if (stats.count > 0)
+		g_print ("%-20s %6u %10.3f %10.3f %10.3f %10.3f\n", name, stats.count,
+			 stats.min, stats.p50, stats.p95, stats.max);
+}
+
+static void
+print_span (const gchar *name)
+{
+	ModestTraceStats stats;
+
+	if (modest_trace_get_stats (name, &stats))
+		g_print ("%-20s %6u %10.3f %10.3f %10.3f %10.3f\n", name, stats.count,
+			 stats.min, stats.p50, stats.p95, stats.max);
+}
+
+int
+main (int argc, char *argv[])
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	GDir *dir;
+	const gchar *name;
+	GSList *files = NULL, *node;
+	GArray *parse_samples, *open_samples;
+	GtkWidget *window = NULL, *scrolled;
+	TnyMsgView *view = NULL;
+	gint i, opened = 0, failed = 0;
+
+	g_thread_init (NULL);
+
+	context = g_option_context_new ("CORPUS_DIR - benchmark the message open path");
+	g_option_context_add_main_entries (context, options, NULL);
+	/* Do not fail if there is no display, it's checked below */
+	g_option_context_add_group (context, gtk_get_option_group (FALSE));
+	if (!g_option_context_parse (context, &argc, &argv, &error) || argc != 2 || timeout <= 0) {
+		g_printerr ("%s\n", error ? error->message : "Missing CORPUS_DIR");
+		g_clear_error (&error);
+		g_option_context_free (context);
+		return 1;
+	}
+	g_option_context_free (context);
+
+	dir = g_dir_open (argv[1], 0, &error);
+	if (!dir) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+	while ((name = g_dir_read_name (dir)) != NULL)
+		files = g_slist_prepend (files, g_build_filename (argv[1], name, NULL));
+	g_dir_close (dir);
+
+	if (!headless && !gtk_init_check (&argc, &argv)) {
+		g_printerr ("No display available, running headless\n");
+		headless = TRUE;
+	}
+
+	if (!headless) {
+		if (!modest_init (argc, argv)) {
+			g_printerr ("Failed running modest_init\n");
+			return 1;
+		}
+
+		/* The same view the message windows use */
+		view = tny_platform_factory_new_msg_view (modest_tny_platform_factory_get_instance ());
+		g_signal_connect (view, "rendered", G_CALLBACK (on_rendered), NULL);
+
+		window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+		gtk_window_set_default_size (GTK_WINDOW (window), 800, 480);
+		scrolled = gtk_scrolled_window_new (NULL, NULL);
+		gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scrolled),
+						GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+		gtk_container_add (GTK_CONTAINER (scrolled), GTK_WIDGET (view));
+		gtk_container_add (GTK_CONTAINER (window), scrolled);
+		gtk_widget_show_all (window);
+	}
+
+	modest_trace_set_enabled (TRUE);
+	modest_trace_clear ();
+
+	parse_samples = g_array_new (FALSE, FALSE, sizeof (gint64));
+	open_samples = g_array_new (FALSE, FALSE, sizeof (gint64));
+	for (i = 0; i < iterations; i++) {
+		for (node = files; node; node = g_slist_next (node)) {
+			TnyMsg *msg;
+
+			msg = parse_msg ((const gchar *) node->data, parse_samples);
+			if (!msg)
+				continue;
+
+			if (headless) {
+				if (decode_msg (msg, open_samples))
+					opened++;
+			} else if (open_msg (view, msg, open_samples)) {
+				opened++;
+			} else {
+				g_printerr ("%s was not rendered in %d seconds\n",
+					    (const gchar *) node->data, timeout);
+				failed++;
+			}
+			g_object_unref (msg);
+		}
+	}
+	if (view)
+		tny_msg_view_clear (view);
+
+	g_print ("%d messages opened%s, %d not rendered, %d iterations\n\n",
+		 opened, headless ? " headless" : "", failed, iterations);
+	g_print ("%-20s %6s %10s %10s %10s %10s\n", "sample", "count",
+		 "min(ms)", "p50(ms)", "p95(ms)", "max(ms)");
+	print_samples ("parse", parse_samples);
+	print_samples ("open", open_samples);
+
+	g_print ("\nlast %d spans recorded by modest-trace\n", MODEST_TRACE_DEFAULT_CAPACITY);
+	print_span ("msg-view:open");
+	print_span ("find-body-part");
+	print_span ("text-to-html");
+	print_span ("gtkhtml-view:render");
+	print_span ("webkit-view:render");
+	print_span ("webkit-view:load");
+
+	if (trace_file && !modest_trace_dump_to_file (trace_file, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+	}
+
+	g_array_free (parse_samples, TRUE);
+	g_array_free (open_samples, TRUE);
+	if (window)
+		gtk_widget_destroy (window);
+	g_slist_foreach (files, (GFunc) g_free, NULL);
+	g_slist_free (files);
+
+	return 0;
+}
@@ -0,0 +1,374 @@
+/* Copyright (c) 2006, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <check.h>
+#include <string.h>
+#include <gtk/gtk.h>
+#include <tny-mime-part.h>
+#include <modest-defs.h>
+#include <modest-init.h>
+#include <modest-tny-msg.h>
+#include <modest-conversation-index.h>
+
+/* ------------------ Global variables ------------------ */
+
+static ModestConversationIndex *conv_index = NULL;
+static GSList *msgs = NULL;
+static guint threads_changed = 0;
+
+/* ---------------------- Fixtures --------------------- */
+
+static void
+on_threads_changed (ModestConversationIndex *self, gpointer user_data)
+{
+	threads_changed++;
+}
+
+static void
+fx_setup_conversation_index ()
+{
+	fail_unless (gtk_init_check (NULL, NULL));
+
+	fail_unless (g_setenv (MODEST_DIR_ENV, ".modesttest", TRUE));
+	fail_unless (g_setenv (MODEST_NAMESPACE_ENV, "/apps/modesttest", TRUE));
+	fail_unless (modest_init (0, NULL), "Failed running modest_init");
+
+	/* An index that does not belong to a folder, so the links
+	   are not saved */
+	conv_index = MODEST_CONVERSATION_INDEX (g_object_new (MODEST_TYPE_CONVERSATION_INDEX, NULL));
+	g_signal_connect (conv_index, "threads-changed", G_CALLBACK (on_threads_changed), NULL);
+	threads_changed = 0;
+}
+
+static void
+fx_teardown_conversation_index ()
+{
+	g_object_unref (conv_index);
+	conv_index = NULL;
+
+	g_slist_foreach (msgs, (GFunc) g_object_unref, NULL);
+	g_slist_free (msgs);
+	msgs = NULL;
+}
+
+/* The header of a new message. The messages are kept until the
+   teardown, as their headers are used by the tests */
+static TnyHeader *
+new_header (const gchar *msgid, const gchar *subject, const gchar *date)
+{
+	TnyMsg *msg;
+
+	msg = modest_tny_msg_new ("to@example.com", "from@example.com", NULL, NULL,
+				  subject, NULL, NULL, "body", NULL, NULL, NULL);
+	fail_unless (TNY_IS_MSG (msg), "modest_tny_msg_new failed");
+	tny_mime_part_set_header_pair (TNY_MIME_PART (msg), "Message-ID", msgid);
+	tny_mime_part_set_header_pair (TNY_MIME_PART (msg), "Date", date);
+	msgs = g_slist_prepend (msgs, msg);
+
+	return tny_msg_get_header (msg);
+}
+
+#define DATE_1 "Mon, 1 Jun 2009 10:00:00 +0000"
+#define DATE_2 "Tue, 2 Jun 2009 10:00:00 +0000"
+#define DATE_3 "Wed, 3 Jun 2009 10:00:00 +0000"
+#define DATE_4 "Thu, 4 Jun 2009 10:00:00 +0000"
+
+/* ---------------- parse msgids tests ---------------- */
+
+START_TEST (test_parse_msgids_regular)
+{
+	struct {
+		const gchar *value;
+		const gchar *expected[4];
+	} tests[] = {
+		{ "<a@example.com>", { "a@example.com", NULL } },
+		{ "<a@example.com> <b@example.com>\n\t<c@example.com>",
+		  { "a@example.com", "b@example.com", "c@example.com", NULL } },
+		{ "<a@example.com><b@example.com>", { "a@example.com", "b@example.com", NULL } },
+		{ "< a@example.com >", { "a@example.com", NULL } },
+		{ "a@example.com b@example.com", { "a@example.com", "b@example.com", NULL } },
+		{ "  a@example.com\n", { "a@example.com", NULL } },
+	};
+	guint i, j;
+
+	for (i = 0; i < G_N_ELEMENTS (tests); i++) {
+		gchar **ids = modest_conversation_index_parse_msgids (tests[i].value);
+
+		fail_unless (ids != NULL,
+			     "modest_conversation_index_parse_msgids returned NULL for '%s'",
+			     tests[i].value);
+		for (j = 0; tests[i].expected[j]; j++)
+			fail_unless (ids[j] && strcmp (ids[j], tests[i].expected[j]) == 0,
+				     "modest_conversation_index_parse_msgids failed for '%s': "
+				     "expected '%s' but got '%s'",
+				     tests[i].value, tests[i].expected[j], ids[j]);
+		fail_unless (ids[j] == NULL,
+			     "modest_conversation_index_parse_msgids returned too many ids for '%s'",
+			     tests[i].value);
+		g_strfreev (ids);
+	}
+}
+END_TEST
+
+START_TEST (test_parse_msgids_invalid)
+{
+	const gchar *tests[] = { NULL, "", "   ", "<>", "< >", "<a@example.com" };
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (tests); i++) {
+		gchar **ids = modest_conversation_index_parse_msgids (tests[i]);
+
+		fail_unless (ids != NULL && ids[0] == NULL,
+			     "modest_conversation_index_parse_msgids should return no ids for '%s'",
+			     tests[i]);
+		g_strfreev (ids);
+	}
+}
+END_TEST
+
+/* ------------------- linking tests ------------------- */
+
+START_TEST (test_link_references)
+{
+	TnyHeader *a, *b, *c;
+
+	a = new_header ("<a@example.com>", "First", DATE_1);
+	c = new_header ("<c@example.com>", "Unrelated", DATE_2);
+	b = new_header ("<b@example.com>", "Another subject", DATE_3);
+	fail_unless (tny_header_get_date_sent (a) < tny_header_get_date_sent (b),
+		     "the Date headers were not parsed");
+
+	modest_conversation_index_add_header (conv_index, a);
+	modest_conversation_index_add_header (conv_index, b);
+	modest_conversation_index_add_header (conv_index, c);
+
+	/* Three threads, sorted by date */
+	fail_unless (!modest_conversation_index_is_reply (conv_index, b));
+	fail_unless (modest_conversation_index_compare (conv_index, a, c, FALSE) < 0);
+	fail_unless (modest_conversation_index_compare (conv_index, c, b, FALSE) < 0);
+	fail_unless (modest_conversation_index_compare (conv_index, b, c, TRUE) < 0);
+
+	/* b replies to a, so it joins the older thread of a */
+	threads_changed = 0;
+	modest_conversation_index_add_references (conv_index, "<b@example.com>",
+						  "<a@example.com>", NULL);
+	fail_unless (threads_changed > 0, "threads-changed should be emitted");
+	fail_unless (modest_conversation_index_is_reply (conv_index, b));
+	fail_unless (!modest_conversation_index_is_reply (conv_index, a));
+	fail_unless (modest_conversation_index_compare (conv_index, b, c, FALSE) < 0);
+
+	/* The newest threads first, but the messages of a thread are
+	   always the oldest first */
+	fail_unless (modest_conversation_index_compare (conv_index, c, b, TRUE) < 0);
+	fail_unless (modest_conversation_index_compare (conv_index, a, b, TRUE) < 0);
+	fail_unless (modest_conversation_index_compare (conv_index, b, a, FALSE) > 0);
+	fail_unless (modest_conversation_index_compare (conv_index, a, a, FALSE) == 0);
+
+	/* The same link again changes nothing */
+	threads_changed = 0;
+	modest_conversation_index_add_references (conv_index, "<b@example.com>",
+						  "<a@example.com>", NULL);
+	fail_unless (threads_changed == 0, "threads-changed should not be emitted");
+}
+END_TEST
+
+START_TEST (test_link_through_missing)
+{
+	TnyHeader *a, *d, *e;
+
+	a = new_header ("<a@example.com>", "First", DATE_1);
+	d = new_header ("<d@example.com>", "Second", DATE_3);
+	e = new_header ("<e@example.com>", "Third", DATE_2);
+
+	/* Links learnt before the headers are added. d and e reply
+	   to a message that is not in the folder, that replies to a */
+	modest_conversation_index_add_references (conv_index, "<d@example.com>",
+						  "<a@example.com> <m@example.com>", NULL);
+	modest_conversation_index_add_references (conv_index, "<e@example.com>",
+						  NULL, "<m@example.com>");
+
+	modest_conversation_index_add_header (conv_index, d);
+	modest_conversation_index_add_header (conv_index, e);
+	fail_unless (!modest_conversation_index_is_reply (conv_index, e));
+	fail_unless (modest_conversation_index_is_reply (conv_index, d));
+
+	/* a is older than the messages of its thread already added */
+	threads_changed = 0;
+	modest_conversation_index_add_header (conv_index, a);
+	fail_unless (threads_changed > 0, "threads-changed should be emitted");
+	fail_unless (!modest_conversation_index_is_reply (conv_index, a));
+	fail_unless (modest_conversation_index_is_reply (conv_index, e));
+	fail_unless (modest_conversation_index_compare (conv_index, a, e, TRUE) < 0);
+	fail_unless (modest_conversation_index_compare (conv_index, e, d, TRUE) < 0);
+
+	/* Without a message id there is nothing to link */
+	threads_changed = 0;
+	modest_conversation_index_add_references (conv_index, NULL, "<a@example.com>", NULL);
+	fail_unless (threads_changed == 0, "threads-changed should not be emitted");
+}
+END_TEST
+
+/* The index must not change while it's used to sort */
+START_TEST (test_compare_read_only)
+{
+	TnyHeader *a, *b;
+
+	a = new_header ("<a@example.com>", "Hello", DATE_1);
+	b = new_header ("<b@example.com>", "Re: Hello", DATE_2);
+
+	modest_conversation_index_add_header (conv_index, b);
+
+	threads_changed = 0;
+	fail_unless (modest_conversation_index_compare (conv_index, a, b, FALSE) < 0);
+	fail_unless (modest_conversation_index_compare (conv_index, b, a, FALSE) > 0);
+	fail_unless (!modest_conversation_index_is_reply (conv_index, a));
+	fail_unless (!modest_conversation_index_is_reply (conv_index, b),
+		     "a header that was not added should not be threaded");
+	fail_unless (threads_changed == 0, "threads-changed should not be emitted");
+
+	/* Once added, b joins the thread of a */
+	modest_conversation_index_add_header (conv_index, a);
+	fail_unless (modest_conversation_index_is_reply (conv_index, b));
+}
+END_TEST
+
+/* ---------------- subject fallback tests ---------------- */
+
+START_TEST (test_subject_fallback)
+{
+	TnyHeader *foo, *re_foo, *hello1, *hello2;
+
+	foo = new_header ("<foo@example.com>", "Foo", DATE_1);
+	hello1 = new_header ("<hello1@example.com>", "Hello", DATE_1);
+	re_foo = new_header ("<re-foo@example.com>", "Re: foo", DATE_2);
+	hello2 = new_header ("<hello2@example.com>", "Hello", DATE_3);
+
+	modest_conversation_index_add_header (conv_index, foo);
+	modest_conversation_index_add_header (conv_index, hello1);
+	modest_conversation_index_add_header (conv_index, re_foo);
+	modest_conversation_index_add_header (conv_index, hello2);
+
+	/* A reply joins the thread of its subject, case insensitive */
+	fail_unless (modest_conversation_index_is_reply (conv_index, re_foo));
+	fail_unless (modest_conversation_index_compare (conv_index, re_foo, hello2, FALSE) < 0);
+
+	/* Two messages with the same subject but no reply are not */
+	fail_unless (!modest_conversation_index_is_reply (conv_index, hello2));
+}
+END_TEST
+
+START_TEST (test_subject_fallback_undone)
+{
+	TnyHeader *bar, *foo, *re_foo, *re_foo2;
+
+	bar = new_header ("<bar@example.com>", "Bar", DATE_1);
+	foo = new_header ("<foo@example.com>", "Foo", DATE_2);
+	re_foo = new_header ("<re-foo@example.com>", "Re: Foo", DATE_3);
+	re_foo2 = new_header ("<re-foo2@example.com>", "Re: Foo", DATE_4);
+
+	modest_conversation_index_add_header (conv_index, bar);
+	modest_conversation_index_add_header (conv_index, foo);
+	modest_conversation_index_add_header (conv_index, re_foo);
+	modest_conversation_index_add_header (conv_index, re_foo2);
+	fail_unless (modest_conversation_index_is_reply (conv_index, re_foo));
+	fail_unless (modest_conversation_index_compare (conv_index, bar, re_foo, FALSE) < 0);
+
+	/* re_foo2 really replies to foo, so it stays */
+	threads_changed = 0;
+	modest_conversation_index_add_references (conv_index, "<re-foo2@example.com>",
+						  "<foo@example.com>", NULL);
+	fail_unless (modest_conversation_index_is_reply (conv_index, re_foo2));
+
+	/* re_foo replies to bar, so it leaves the thread of foo */
+	modest_conversation_index_add_references (conv_index, "<re-foo@example.com>",
+						  NULL, "<bar@example.com>");
+	fail_unless (threads_changed > 0, "threads-changed should be emitted");
+	fail_unless (modest_conversation_index_is_reply (conv_index, re_foo));
+	fail_unless (modest_conversation_index_compare (conv_index, re_foo, foo, FALSE) < 0,
+		     "the reply should be in the older thread of bar");
+	fail_unless (modest_conversation_index_compare (conv_index, foo, re_foo2, FALSE) < 0);
+	fail_unless (modest_conversation_index_is_reply (conv_index, re_foo2));
+	fail_unless (!modest_conversation_index_is_reply (conv_index, foo));
+}
+END_TEST
+
+/* ------------------- Suite creation ------------------ */
+
+static Suite*
+conversation_index_suite (void)
+{
+	Suite *suite = suite_create ("ModestConversationIndex");
+	TCase *tc = NULL;
+
+	/* Test case for "parse msgids" */
+	tc = tcase_create ("parse_msgids");
+	tcase_add_test (tc, test_parse_msgids_regular);
+	tcase_add_test (tc, test_parse_msgids_invalid);
+	suite_add_tcase (suite, tc);
+
+	/* Test case for "linking" */
+	tc = tcase_create ("linking");
+	tcase_add_checked_fixture (tc,
+				   fx_setup_conversation_index,
+				   fx_teardown_conversation_index);
+	tcase_add_test (tc, test_link_references);
+	tcase_add_test (tc, test_link_through_missing);
+	tcase_add_test (tc, test_compare_read_only);
+	suite_add_tcase (suite, tc);
+
+	/* Test case for "subject fallback" */
+	tc = tcase_create ("subject_fallback");
+	tcase_add_checked_fixture (tc,
+				   fx_setup_conversation_index,
+				   fx_teardown_conversation_index);
+	tcase_add_test (tc, test_subject_fallback);
+	tcase_add_test (tc, test_subject_fallback_undone);
+	suite_add_tcase (suite, tc);
+
+	return suite;
+}
+
+/* --------------------- Main program ------------------- */
+
+gint
+main ()
+{
+	SRunner *srunner;
+	Suite   *suite;
+	int     failures;
+
+	suite   = conversation_index_suite ();
+	srunner = srunner_create (suite);
+
+	srunner_run_all (srunner, CK_ENV);
+	failures = srunner_ntests_failed (srunner);
+	srunner_free (srunner);
+
+	return failures;
+}
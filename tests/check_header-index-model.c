@@ -0,0 +1,543 @@
+/* Copyright (c) 2006, Nokia Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * * Neither the name of the Nokia Corporation nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The header index model is checked against the GtkTreeModelFilter +
+ * GtkTreeModelSort stack it replaces: both are built over the same
+ * child list store, with the same visible function and sort column,
+ * and after every change of the child rows they must show the same
+ * rows in the same order. The signals of the index model are also
+ * replayed in a plain array, that must end up with the same rows,
+ * as a tree view would.
+ */
+
+#include <check.h>
+#include <gtk/gtk.h>
+#include <string.h>
+#include <widgets/modest-header-index-model.h>
+
+enum {
+	COL_DATE,
+	COL_SUBJECT,
+	COL_SHOWN,
+	N_COLS
+};
+
+#define SORT_FUNC_COLUMN_ID 100
+#define N_ROWS 300
+#define N_CHANGES 400
+
+typedef struct {
+	GtkListStore *child;
+	GtkTreeModel *index;
+	GtkTreeModel *filter;
+	GtkTreeModel *sort;
+	GArray *mirror;
+	GRand *rand;
+	guint counter;
+	gint divisor;
+} Fixture;
+
+static Fixture fx;
+
+/* The dates and the subjects are unique, so the ties are never
+   broken by the child position, which the reference models do in a
+   different way */
+static gint
+next_date (void)
+{
+	return (gint) ((fx.counter++ * 7919) % 1000003);
+}
+
+static void
+set_row (GtkTreeIter *iter, gint date, gboolean shown)
+{
+	gchar *subject;
+
+	subject = g_strdup_printf ("%07d", (gint) ((date * 31) % 1000003));
+	gtk_list_store_set (fx.child, iter,
+			    COL_DATE, date,
+			    COL_SUBJECT, subject,
+			    COL_SHOWN, shown,
+			    -1);
+	g_free (subject);
+}
+
+static gboolean
+visible_func (GtkTreeModel *model, GtkTreeIter *iter, gpointer data)
+{
+	gint *divisor = (gint *) data;
+	gboolean shown;
+	gint date;
+
+	gtk_tree_model_get (model, iter, COL_DATE, &date, COL_SHOWN, &shown, -1);
+
+	return shown && (*divisor == 0 || date % *divisor != 0);
+}
+
+/* Orders by the last digit of the date and then by the date */
+static gint
+sort_func (GtkTreeModel *model, GtkTreeIter *a, GtkTreeIter *b, gpointer data)
+{
+	gint date_a, date_b;
+
+	gtk_tree_model_get (model, a, COL_DATE, &date_a, -1);
+	gtk_tree_model_get (model, b, COL_DATE, &date_b, -1);
+
+	if (date_a % 10 != date_b % 10)
+		return (date_a % 10) - (date_b % 10);
+	return (date_a < date_b) ? -1 : (date_a > date_b) ? 1 : 0;
+}
+
+static gint
+get_date (GtkTreeModel *model, GtkTreeIter *iter)
+{
+	gint date;
+
+	gtk_tree_model_get (model, iter, COL_DATE, &date, -1);
+	return date;
+}
+
+/* Mirror of the rows, updated only from the signals of the index
+   model */
+
+static void
+on_row_inserted (GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter, gpointer data)
+{
+	gint date = get_date (model, iter);
+
+	g_array_insert_val (fx.mirror, gtk_tree_path_get_indices (path)[0], date);
+}
+
+static void
+on_row_deleted (GtkTreeModel *model, GtkTreePath *path, gpointer data)
+{
+	gint pos = gtk_tree_path_get_indices (path)[0];
+
+	fail_unless (pos >= 0 && pos < fx.mirror->len,
+		     "row-deleted notified for a row that does not exist");
+	g_array_remove_index (fx.mirror, pos);
+}
+
+static void
+on_row_changed (GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter, gpointer data)
+{
+	gint pos = gtk_tree_path_get_indices (path)[0];
+
+	fail_unless (pos >= 0 && pos < fx.mirror->len,
+		     "row-changed notified for a row that does not exist");
+	g_array_index (fx.mirror, gint, pos) = get_date (model, iter);
+}
+
+static void
+on_rows_reordered (GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter,
+		   gint *new_order, gpointer data)
+{
+	GArray *reordered;
+	guint i;
+
+	reordered = g_array_sized_new (FALSE, FALSE, sizeof (gint), fx.mirror->len);
+	for (i = 0; i < fx.mirror->len; i++) {
+		fail_unless (new_order[i] >= 0 && new_order[i] < fx.mirror->len,
+			     "rows-reordered notified a wrong position");
+		g_array_append_val (reordered, g_array_index (fx.mirror, gint, new_order[i]));
+	}
+	g_array_free (fx.mirror, TRUE);
+	fx.mirror = reordered;
+}
+
+static void
+run_pending (void)
+{
+	while (g_main_context_pending (NULL))
+		g_main_context_iteration (NULL, FALSE);
+}
+
+static void
+set_sort_column (gint sort_column_id, GtkSortType order)
+{
+	gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (fx.index), sort_column_id, order);
+	gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (fx.sort), sort_column_id, order);
+}
+
+static void
+refilter (gint divisor)
+{
+	fx.divisor = divisor;
+	modest_header_index_model_refilter (MODEST_HEADER_INDEX_MODEL (fx.index));
+	gtk_tree_model_filter_refilter (GTK_TREE_MODEL_FILTER (fx.filter));
+}
+
+static void
+check_same_rows (const gchar *step)
+{
+	GtkTreeIter index_iter, sort_iter;
+	gboolean index_valid, sort_valid;
+	guint pos = 0;
+
+	run_pending ();
+
+	fail_unless (gtk_tree_model_iter_n_children (fx.index, NULL) ==
+		     gtk_tree_model_iter_n_children (fx.sort, NULL),
+		     "%s: %d rows shown instead of %d", step,
+		     gtk_tree_model_iter_n_children (fx.index, NULL),
+		     gtk_tree_model_iter_n_children (fx.sort, NULL));
+	fail_unless (fx.mirror->len == gtk_tree_model_iter_n_children (fx.index, NULL),
+		     "%s: the signals notified %d rows instead of %d", step,
+		     fx.mirror->len, gtk_tree_model_iter_n_children (fx.index, NULL));
+
+	index_valid = gtk_tree_model_get_iter_first (fx.index, &index_iter);
+	sort_valid = gtk_tree_model_get_iter_first (fx.sort, &sort_iter);
+	while (index_valid && sort_valid) {
+		gint date = get_date (fx.index, &index_iter);
+
+		fail_unless (date == get_date (fx.sort, &sort_iter),
+			     "%s: row %d is %d instead of %d", step, pos,
+			     date, get_date (fx.sort, &sort_iter));
+		fail_unless (date == g_array_index (fx.mirror, gint, pos),
+			     "%s: the signals left %d in row %d instead of %d", step,
+			     g_array_index (fx.mirror, gint, pos), pos, date);
+
+		index_valid = gtk_tree_model_iter_next (fx.index, &index_iter);
+		sort_valid = gtk_tree_model_iter_next (fx.sort, &sort_iter);
+		pos++;
+	}
+	fail_unless (index_valid == sort_valid, "%s: different number of rows", step);
+}
+
+static void
+fill_child (guint n_rows)
+{
+	GtkTreeIter iter;
+	guint i;
+
+	for (i = 0; i < n_rows; i++) {
+		gtk_list_store_append (fx.child, &iter);
+		set_row (&iter, next_date (), g_rand_int_range (fx.rand, 0, 4) != 0);
+	}
+}
+
+static void
+fx_setup_models ()
+{
+	fail_unless (gtk_init_check (NULL, NULL));
+
+	memset (&fx, 0, sizeof (Fixture));
+	fx.rand = g_rand_new_with_seed (4242);
+	fx.counter = 1;
+	fx.divisor = 0;
+	fx.mirror = g_array_new (FALSE, FALSE, sizeof (gint));
+
+	fx.child = gtk_list_store_new (N_COLS, G_TYPE_INT, G_TYPE_STRING, G_TYPE_BOOLEAN);
+
+	fx.index = modest_header_index_model_new (GTK_TREE_MODEL (fx.child));
+	fail_unless (MODEST_IS_HEADER_INDEX_MODEL (fx.index));
+	modest_header_index_model_set_visible_func (MODEST_HEADER_INDEX_MODEL (fx.index),
+						    visible_func, &fx.divisor, NULL);
+	gtk_tree_sortable_set_sort_func (GTK_TREE_SORTABLE (fx.index), SORT_FUNC_COLUMN_ID,
+					 sort_func, NULL, NULL);
+	g_signal_connect (fx.index, "row-inserted", G_CALLBACK (on_row_inserted), NULL);
+	g_signal_connect (fx.index, "row-deleted", G_CALLBACK (on_row_deleted), NULL);
+	g_signal_connect (fx.index, "row-changed", G_CALLBACK (on_row_changed), NULL);
+	g_signal_connect (fx.index, "rows-reordered", G_CALLBACK (on_rows_reordered), NULL);
+
+	fx.filter = gtk_tree_model_filter_new (GTK_TREE_MODEL (fx.child), NULL);
+	gtk_tree_model_filter_set_visible_func (GTK_TREE_MODEL_FILTER (fx.filter),
+						visible_func, &fx.divisor, NULL);
+	fx.sort = gtk_tree_model_sort_new_with_model (fx.filter);
+	gtk_tree_sortable_set_sort_func (GTK_TREE_SORTABLE (fx.sort), SORT_FUNC_COLUMN_ID,
+					 sort_func, NULL, NULL);
+
+	set_sort_column (COL_DATE, GTK_SORT_DESCENDING);
+}
+
+static void
+fx_teardown_models ()
+{
+	g_object_unref (fx.sort);
+	g_object_unref (fx.filter);
+	g_object_unref (fx.index);
+	g_object_unref (fx.child);
+	g_array_free (fx.mirror, TRUE);
+	g_rand_free (fx.rand);
+}
+
+/* ----------------- insert tests ----------------- */
+
+START_TEST (test_insert_batch)
+{
+	fill_child (N_ROWS);
+
+	/* The rows are merged from an idle */
+	fail_unless (gtk_tree_model_iter_n_children (fx.index, NULL) == 0,
+		     "the inserted rows should be merged in a batch");
+	check_same_rows ("batch");
+
+	fill_child (N_ROWS);
+	check_same_rows ("second batch");
+}
+END_TEST
+
+START_TEST (test_insert_positions)
+{
+	GtkTreeIter iter;
+	gint i;
+
+	fill_child (N_ROWS);
+	check_same_rows ("fill");
+
+	/* Insertions in the middle and at the start shift the child
+	   rows after them */
+	for (i = 0; i < N_CHANGES; i++) {
+		gint n = gtk_tree_model_iter_n_children (GTK_TREE_MODEL (fx.child), NULL);
+
+		gtk_list_store_insert (fx.child, &iter, g_rand_int_range (fx.rand, 0, n + 1));
+		set_row (&iter, next_date (), g_rand_boolean (fx.rand));
+
+		/* Some batches of several rows */
+		if (g_rand_int_range (fx.rand, 0, 5) == 0)
+			check_same_rows ("insert");
+	}
+	check_same_rows ("insert");
+
+	gtk_list_store_prepend (fx.child, &iter);
+	set_row (&iter, next_date (), TRUE);
+	check_same_rows ("prepend");
+}
+END_TEST
+
+/* ----------------- delete tests ----------------- */
+
+START_TEST (test_delete)
+{
+	GtkTreeIter iter;
+	gint n;
+
+	fill_child (N_ROWS);
+	check_same_rows ("fill");
+
+	while ((n = gtk_tree_model_iter_n_children (GTK_TREE_MODEL (fx.child), NULL)) > 0) {
+		fail_unless (gtk_tree_model_iter_nth_child (GTK_TREE_MODEL (fx.child), &iter,
+							    NULL, g_rand_int_range (fx.rand, 0, n)));
+		gtk_list_store_remove (fx.child, &iter);
+		check_same_rows ("delete");
+	}
+}
+END_TEST
+
+START_TEST (test_delete_pending)
+{
+	GtkTreeIter iter;
+	gint i;
+
+	fill_child (N_ROWS);
+	check_same_rows ("fill");
+
+	/* Rows removed before they are merged */
+	fill_child (N_ROWS);
+	for (i = 0; i < N_ROWS / 2; i++) {
+		gint n = gtk_tree_model_iter_n_children (GTK_TREE_MODEL (fx.child), NULL);
+
+		fail_unless (gtk_tree_model_iter_nth_child (GTK_TREE_MODEL (fx.child), &iter,
+							    NULL, g_rand_int_range (fx.rand, 0, n)));
+		gtk_list_store_remove (fx.child, &iter);
+	}
+	check_same_rows ("delete pending");
+}
+END_TEST
+
+/* ----------------- change tests ----------------- */
+
+START_TEST (test_change)
+{
+	GtkTreeIter iter;
+	gboolean shown;
+	gint i;
+
+	fill_child (N_ROWS);
+	check_same_rows ("fill");
+
+	/* Changes of the sort key and of the visibility, that move,
+	   hide and show rows */
+	for (i = 0; i < N_CHANGES; i++) {
+		gint n = gtk_tree_model_iter_n_children (GTK_TREE_MODEL (fx.child), NULL);
+
+		fail_unless (gtk_tree_model_iter_nth_child (GTK_TREE_MODEL (fx.child), &iter,
+							    NULL, g_rand_int_range (fx.rand, 0, n)));
+		switch (g_rand_int_range (fx.rand, 0, 3)) {
+		case 0:
+			set_row (&iter, next_date (), TRUE);
+			break;
+		case 1:
+			gtk_list_store_set (fx.child, &iter, COL_SHOWN, g_rand_boolean (fx.rand), -1);
+			break;
+		default:
+			/* Same values */
+			gtk_tree_model_get (GTK_TREE_MODEL (fx.child), &iter, COL_SHOWN, &shown, -1);
+			gtk_list_store_set (fx.child, &iter, COL_SHOWN, shown, -1);
+			break;
+		}
+		check_same_rows ("change");
+	}
+}
+END_TEST
+
+START_TEST (test_change_pending)
+{
+	GtkTreeIter iter;
+	gint i;
+
+	/* Rows changed after they are inserted but before they are
+	   merged */
+	for (i = 0; i < N_ROWS; i++) {
+		gtk_list_store_append (fx.child, &iter);
+		set_row (&iter, next_date (), FALSE);
+		set_row (&iter, next_date (), g_rand_boolean (fx.rand));
+	}
+	check_same_rows ("change pending");
+}
+END_TEST
+
+/* ----------------- refilter tests ----------------- */
+
+START_TEST (test_refilter)
+{
+	gint divisors[] = { 2, 3, 0, 5, 2, 7, 0 };
+	guint i;
+
+	fill_child (N_ROWS);
+	check_same_rows ("fill");
+
+	for (i = 0; i < G_N_ELEMENTS (divisors); i++) {
+		refilter (divisors[i]);
+		check_same_rows ("refilter");
+	}
+
+	/* Refiltered with pending rows */
+	fill_child (N_ROWS);
+	refilter (3);
+	check_same_rows ("refilter pending");
+}
+END_TEST
+
+/* ----------------- resort tests ----------------- */
+
+START_TEST (test_resort)
+{
+	GtkTreeIter iter;
+
+	fill_child (N_ROWS);
+	check_same_rows ("fill");
+
+	set_sort_column (COL_DATE, GTK_SORT_ASCENDING);
+	check_same_rows ("date ascending");
+
+	set_sort_column (COL_SUBJECT, GTK_SORT_ASCENDING);
+	check_same_rows ("subject ascending");
+
+	set_sort_column (COL_SUBJECT, GTK_SORT_DESCENDING);
+	check_same_rows ("subject descending");
+
+	set_sort_column (SORT_FUNC_COLUMN_ID, GTK_SORT_ASCENDING);
+	check_same_rows ("sort func");
+
+	/* Changes keep the new order */
+	fail_unless (gtk_tree_model_get_iter_first (GTK_TREE_MODEL (fx.child), &iter));
+	set_row (&iter, next_date (), TRUE);
+	check_same_rows ("sort func change");
+
+	/* Resorted with pending rows */
+	fill_child (N_ROWS);
+	set_sort_column (COL_DATE, GTK_SORT_DESCENDING);
+	check_same_rows ("resort pending");
+}
+END_TEST
+
+/* ------------------- Suite creation ------------------- */
+
+static Suite*
+header_index_model_suite (void)
+{
+	Suite *suite = suite_create ("ModestHeaderIndexModel");
+	TCase *tc = NULL;
+
+	/* Test case for "insert" */
+	tc = tcase_create ("insert");
+	tcase_add_checked_fixture (tc, fx_setup_models, fx_teardown_models);
+	tcase_add_test (tc, test_insert_batch);
+	tcase_add_test (tc, test_insert_positions);
+	suite_add_tcase (suite, tc);
+
+	/* Test case for "delete" */
+	tc = tcase_create ("delete");
+	tcase_add_checked_fixture (tc, fx_setup_models, fx_teardown_models);
+	tcase_add_test (tc, test_delete);
+	tcase_add_test (tc, test_delete_pending);
+	suite_add_tcase (suite, tc);
+
+	/* Test case for "change" */
+	tc = tcase_create ("change");
+	tcase_add_checked_fixture (tc, fx_setup_models, fx_teardown_models);
+	tcase_add_test (tc, test_change);
+	tcase_add_test (tc, test_change_pending);
+	suite_add_tcase (suite, tc);
+
+	/* Test case for "refilter" */
+	tc = tcase_create ("refilter");
+	tcase_add_checked_fixture (tc, fx_setup_models, fx_teardown_models);
+	tcase_add_test (tc, test_refilter);
+	suite_add_tcase (suite, tc);
+
+	/* Test case for "resort" */
+	tc = tcase_create ("resort");
+	tcase_add_checked_fixture (tc, fx_setup_models, fx_teardown_models);
+	tcase_add_test (tc, test_resort);
+	suite_add_tcase (suite, tc);
+
+	return suite;
+}
+
+/* --------------------- Main program ------------------- */
+
+gint
+main ()
+{
+	SRunner *srunner;
+	Suite   *suite;
+	int     failures;
+
+	suite   = header_index_model_suite ();
+	srunner = srunner_create (suite);
+
+	srunner_run_all (srunner, CK_ENV);
+	failures = srunner_ntests_failed (srunner);
+	srunner_free (srunner);
+
+	return failures;
+}
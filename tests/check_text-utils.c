@@ -724,6 +724,120 @@ START_TEST (test_remove_address_invalid)
 }
 END_TEST
 
+/* --------------- parse addresses tests ---------------- */
+
+/**
+ * Test regular usage of modest_text_utils_parse_addresses
+ *  - Test 1: Check the separators inside quotes, comments and angle addresses
+ *  - Test 2: Check that a ',' does not end an address without email
+ *  - Test 3: Check the email of the addresses without angle address
+ *  - Test 4: Check an empty list
+ */
+START_TEST (test_parse_addresses_regular)
+{
+	GArray *spans;
+	ModestAddressSpan *span;
+	gint i;
+	const gchar *list;
+	const gchar *expected[] = { "\"Doe, John\" <john@example.com>",
+				    "Smith (a, b) <s@example.com>",
+				    "x@y" };
+	const gchar *emails[] = { "john@example.com", "s@example.com", "x@y" };
+
+	/* Test 1 */
+	list = " \"Doe, John\" <john@example.com>;\nSmith (a, b) <s@example.com> , x@y ";
+	spans = modest_text_utils_parse_addresses (list);
+	fail_unless (spans->len == 3,
+		     "modest_text_utils_parse_addresses failed: " \
+		     "\"%s\" has 3 addresses, not %d", list, spans->len);
+	for (i = 0; i < 3; i++) {
+		span = &g_array_index (spans, ModestAddressSpan, i);
+		fail_unless (strlen (expected[i]) == span->end - span->start &&
+			     !strncmp (list + span->start, expected[i], span->end - span->start),
+			     "modest_text_utils_parse_addresses failed: " \
+			     "address %d of \"%s\" is not \"%s\"", i, list, expected[i]);
+		fail_unless (strlen (emails[i]) == span->email_end - span->email_start &&
+			     !strncmp (list + span->email_start, emails[i], span->email_end - span->email_start),
+			     "modest_text_utils_parse_addresses failed: " \
+			     "email %d of \"%s\" is not \"%s\"", i, list, emails[i]);
+	}
+	g_array_free (spans, TRUE);
+
+	/* Test 2 */
+	list = "Doe, John <john@example.com>, foo@bar";
+	spans = modest_text_utils_parse_addresses (list);
+	fail_unless (spans->len == 2,
+		     "modest_text_utils_parse_addresses failed: " \
+		     "\"%s\" has 2 addresses, not %d", list, spans->len);
+	g_array_free (spans, TRUE);
+
+	/* Test 3 */
+	list = "foo@bar <FOO BAR>";
+	spans = modest_text_utils_parse_addresses (list);
+	span = &g_array_index (spans, ModestAddressSpan, 0);
+	fail_unless (spans->len == 1 && span->email_start == 0 && span->email_end == 7,
+		     "modest_text_utils_parse_addresses failed: " \
+		     "the email of \"%s\" is not foo@bar", list);
+	g_array_free (spans, TRUE);
+
+	/* Test 4 */
+	spans = modest_text_utils_parse_addresses (" ;, \n");
+	fail_unless (spans->len == 0,
+		     "modest_text_utils_parse_addresses failed: " \
+		     "an empty list has %d addresses", spans->len);
+	g_array_free (spans, TRUE);
+}
+END_TEST
+
+/**
+ * Test modest_text_utils_remove_duplicate_addresses and
+ * modest_text_utils_remove_addresses with long lists
+ *  - Test 1: Remove the duplicates of a list of 5000 addresses
+ *  - Test 2: Remove half of the addresses of a list of 5000 addresses
+ */
+START_TEST (test_address_list_long)
+{
+	GString *list, *remove;
+	GArray *spans;
+	gchar *new_list;
+	gint i;
+
+	list = g_string_new ("");
+	remove = g_string_new ("");
+	for (i = 0; i < 5000; i++) {
+		g_string_append_printf (list, "%sUser %d <user%d@example.com>",
+					i ? ", " : "", i % 2500, i % 2500);
+		if (i % 2)
+			g_string_append_printf (remove, "%sUSER%d@example.com",
+						remove->len ? "; " : "", i);
+	}
+
+	/* Test 1 */
+	new_list = modest_text_utils_remove_duplicate_addresses (list->str);
+	spans = modest_text_utils_parse_addresses (new_list);
+	fail_unless (spans->len == 2500,
+		     "modest_text_utils_remove_duplicate_addresses failed: " \
+		     "%d addresses left instead of 2500", spans->len);
+	g_array_free (spans, TRUE);
+
+	/* Test 2 */
+	g_free (new_list);
+	new_list = modest_text_utils_remove_addresses (list->str, remove->str);
+	spans = modest_text_utils_parse_addresses (new_list);
+	fail_unless (spans->len == 2500,
+		     "modest_text_utils_remove_addresses failed: " \
+		     "%d addresses left instead of 2500", spans->len);
+	fail_unless (strstr (new_list, "user1@example.com") == NULL,
+		     "modest_text_utils_remove_addresses failed: " \
+		     "user1@example.com was not removed");
+	g_array_free (spans, TRUE);
+
+	g_free (new_list);
+	g_string_free (list, TRUE);
+	g_string_free (remove, TRUE);
+}
+END_TEST
+
 /* --------------- convert to html tests ---------------- */
 
 /**
@@ -855,6 +969,15 @@ text_utils_suite (void)
 	tcase_add_test (tc, test_remove_address_invalid);
 	suite_add_tcase (suite, tc);
 
+	/* Test case for "parse addresses" */
+	tc = tcase_create ("parse_addresses");
+	tcase_add_checked_fixture (tc,
+				   fx_setup_i18n,
+				   NULL);
+	tcase_add_test (tc, test_parse_addresses_regular);
+	tcase_add_test (tc, test_address_list_long);
+	suite_add_tcase (suite, tc);
+
 	/* Test case for "convert to html" */
 	tc = tcase_create ("convert_to_html");
 	tcase_add_checked_fixture (tc,